@@ -52,6 +52,14 @@ EfipPeLoaderGetAddress (
     UINTN TeStrippedOffset
     );
 
+UINT16 *
+EfipPeLoaderRelocateRun (
+    CHAR8 *FixupBase,
+    UINT16 *Relocation,
+    UINT16 *RelocationEnd,
+    UINT64 Adjust
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -557,6 +565,7 @@ Return Value:
     EFI_IMAGE_DATA_DIRECTORY *RelocationDirectory;
     UINT16 *RelocationEnd;
     UINT32 TeStrippedOffset;
+    UINT16 Type;
 
     ASSERT(Context != NULL);
 
@@ -656,10 +665,13 @@ Return Value:
     }
 
     //
-    // If there are adjustments to be made, relocate the image.
+    // If there are adjustments to be made, relocate the image. Runtime
+    // drivers need the relocations walked even if the image landed at its
+    // link address, since the fixup data recorded here is what lets the
+    // runtime core find the relocations again at SetVirtualAddressMap time.
     //
 
-    if (Adjust != 0) {
+    if ((Adjust != 0) || (Context->FixupData != NULL)) {
         FixupData = Context->FixupData;
 
         //
@@ -694,8 +706,28 @@ Return Value:
             //
 
             while (Relocation < RelocationEnd) {
+                Type = (*Relocation) >> 12;
+
+                //
+                // When no fixup data needs to be recorded, apply runs of the
+                // pointer sized relocation types in one go rather than going
+                // through the switch for every entry.
+                //
+
+                if ((FixupData == NULL) &&
+                    ((Type == EFI_IMAGE_REL_BASED_DIR64) ||
+                     (Type == EFI_IMAGE_REL_BASED_HIGHLOW))) {
+
+                    Relocation = EfipPeLoaderRelocateRun(FixupBase,
+                                                         Relocation,
+                                                         RelocationEnd,
+                                                         Adjust);
+
+                    continue;
+                }
+
                 Fixup = FixupBase + (*Relocation & 0xFFF);
-                switch ((*Relocation) >> 12) {
+                switch (Type) {
                 case EFI_IMAGE_REL_BASED_ABSOLUTE:
                     break;
 
@@ -1457,3 +1489,79 @@ Return Value:
     return (CHAR8 *)((UINTN)Context->ImageAddress + Address - TeStrippedOffset);
 }
 
+UINT16 *
+EfipPeLoaderRelocateRun (
+    CHAR8 *FixupBase,
+    UINT16 *Relocation,
+    UINT16 *RelocationEnd,
+    UINT64 Adjust
+    )
+
+/*++
+
+Routine Description:
+
+    This routine applies a run of consecutive relocation entries of the same
+    type within a relocation block. Only the HIGHLOW and DIR64 types are
+    handled here, and no fixup data is recorded.
+
+Arguments:
+
+    FixupBase - Supplies the in-memory address of the page the relocation
+        block covers.
+
+    Relocation - Supplies a pointer to the first relocation entry of the run.
+
+    RelocationEnd - Supplies a pointer one beyond the last relocation entry
+        in the block.
+
+    Adjust - Supplies the difference between the load address and the
+        address the image was linked at.
+
+Return Value:
+
+    Returns a pointer to the first relocation entry after the run.
+
+--*/
+
+{
+
+    UINT32 Adjust32;
+    UINT16 Entry;
+    UINT32 *Fixup32;
+    UINT64 *Fixup64;
+    UINT16 Type;
+
+    Type = (*Relocation) & 0xF000;
+
+    ASSERT((Type == (EFI_IMAGE_REL_BASED_DIR64 << 12)) ||
+           (Type == (EFI_IMAGE_REL_BASED_HIGHLOW << 12)));
+
+    if (Type == (EFI_IMAGE_REL_BASED_DIR64 << 12)) {
+        while (Relocation < RelocationEnd) {
+            Entry = *Relocation;
+            if ((Entry & 0xF000) != Type) {
+                break;
+            }
+
+            Fixup64 = (UINT64 *)(FixupBase + (Entry & 0xFFF));
+            *Fixup64 += Adjust;
+            Relocation += 1;
+        }
+
+    } else {
+        Adjust32 = (UINT32)Adjust;
+        while (Relocation < RelocationEnd) {
+            Entry = *Relocation;
+            if ((Entry & 0xF000) != Type) {
+                break;
+            }
+
+            Fixup32 = (UINT32 *)(FixupBase + (Entry & 0xFFF));
+            *Fixup32 += Adjust32;
+            Relocation += 1;
+        }
+    }
+
+    return Relocation;
+}
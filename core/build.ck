@@ -33,6 +33,9 @@ function build() {
     var arch = mconfig.arch;
     var armSources;
     var baseSources;
+    var buildLib;
+    var buildSources;
+    var buildSourcesConfig;
     var emptyrdLib;
     var entries;
     var fwCoreVersionMajor;
@@ -158,6 +161,40 @@ function build() {
     }
 
     entries += staticLibrary(emptyrdLib);
+
+    //
+    // Build the hardware independent parts of the core for the build machine
+    // so the core test can exercise them. The core only knows about the
+    // firmware architectures, so build it as x86.
+    //
+
+    buildSources = [
+        "basepe.c",
+        "event.c",
+        "fwvol.c",
+        "fwvolio.c",
+        "memory.c",
+        "pool.c",
+        "timer.c",
+        "tpl.c",
+        "util.c"
+    ];
+
+    buildSourcesConfig = {
+        "CFLAGS": ["-fshort-wchar", "-DEFI_X86"],
+    };
+
+    buildLib = {
+        "label": "build_ueficore",
+        "output": "ueficore",
+        "inputs": buildSources,
+        "sources_config": buildSourcesConfig,
+        "includes": includes,
+        "build": true,
+        "prefix": "build"
+    };
+
+    entries += staticLibrary(buildLib);
     return entries;
 }
 
@@ -0,0 +1,72 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    Core Test
+
+Abstract:
+
+    This program tests the hardware independent parts of the UEFI core.
+
+Environment:
+
+    Test
+
+--*/
+
+from menv import application;
+
+function build() {
+    var buildApp;
+    var buildLibs;
+    var entries;
+    var includes;
+    var sources;
+    var sourcesConfig;
+
+    sources = [
+        "coretest.c",
+        "fvtest.c",
+        "memtest.c",
+        "petest.c",
+        "pooltest.c",
+        "teststub.c",
+        "timertest.c",
+        "utiltest.c"
+    ];
+
+    buildLibs = [
+        "uefi/core:build_ueficore",
+        "lib/rtl/base:build_basertl"
+    ];
+
+    includes = [
+        "$S/uefi/include",
+        "$S/uefi/core"
+    ];
+
+    sourcesConfig = {
+        "CFLAGS": ["-fshort-wchar", "-DEFI_X86"],
+    };
+
+    buildApp = {
+        "label": "build_coretest",
+        "output": "coretest",
+        "inputs": sources + buildLibs,
+        "sources_config": sourcesConfig,
+        "includes": includes,
+        "build": true,
+        "prefix": "build"
+    };
+
+    entries = application(buildApp);
+    return entries;
+}
+
@@ -0,0 +1,180 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    coretest.c
+
+Abstract:
+
+    This module implements the UEFI core test program. It runs the hardware
+    independent parts of the core on the build machine, checks them against
+    simple reference models, and optionally benchmarks them.
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include "coretest.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+#define USAGE_STRING \
+    "Coretest will test the hardware independent parts of the UEFI core.\n\n" \
+    "Usage: coretest [-v] [-b] [-s seed]\n\n" \
+    "    -v  Verbose mode\n" \
+    "    -b  Run the benchmarks after the tests\n" \
+    "    -s  Seed the random number generator with the given value\n\n" \
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+BOOLEAN CoreTestVerbose = FALSE;
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+INT
+main (
+    INT ArgumentCount,
+    CHAR **Arguments
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is the main entry point for the program.
+
+Arguments:
+
+    ArgumentCount - Supplies the number of command line arguments the program
+        was invoked with.
+
+    Arguments - Supplies a tokenized array of command line arguments.
+
+Return Value:
+
+    Returns an integer exit code. 0 for success, nonzero otherwise.
+
+--*/
+
+{
+
+    PSTR Argument;
+    BOOLEAN Benchmark;
+    ULONG Failures;
+    UINTN Seed;
+
+    Benchmark = FALSE;
+    Failures = 0;
+    Seed = time(NULL);
+    while ((ArgumentCount > 1) && (Arguments[1][0] == '-')) {
+        Argument = &(Arguments[1][1]);
+        if (strcmp(Argument, "v") == 0) {
+            CoreTestVerbose = TRUE;
+
+        } else if (strcmp(Argument, "b") == 0) {
+            Benchmark = TRUE;
+
+        } else if ((strcmp(Argument, "s") == 0) && (ArgumentCount > 2)) {
+            Seed = strtoul(Arguments[2], NULL, 0);
+            ArgumentCount -= 1;
+            Arguments += 1;
+
+        } else {
+            printf("%s: Invalid option\n\n%s", Argument, USAGE_STRING);
+            return 1;
+        }
+
+        ArgumentCount -= 1;
+        Arguments += 1;
+    }
+
+    VPRINT("Seed %ld\n", (long)Seed);
+    srand(Seed);
+    Failures += TestUtil();
+    Failures += TestMemory();
+    Failures += TestPool();
+    Failures += TestPe();
+    Failures += TestTimer();
+    Failures += TestFirmwareVolume();
+    if (Failures != 0) {
+        printf("*** %d failure(s) in UEFI core test. ***\n", Failures);
+        return Failures;
+    }
+
+    printf("All UEFI core tests passed.\n");
+    if (Benchmark != FALSE) {
+        BenchmarkUtil();
+        BenchmarkMemory();
+        BenchmarkPool();
+        BenchmarkPe();
+        BenchmarkTimer();
+        BenchmarkFirmwareVolume();
+    }
+
+    return 0;
+}
+
+double
+CoreTestGetSeconds (
+    clock_t Start,
+    clock_t End
+    )
+
+/*++
+
+Routine Description:
+
+    This routine converts a span of processor time into seconds, never
+    returning zero so that rates can be computed from the result.
+
+Arguments:
+
+    Start - Supplies the clock value at the start of the span.
+
+    End - Supplies the clock value at the end of the span.
+
+Return Value:
+
+    Returns the number of seconds elapsed.
+
+--*/
+
+{
+
+    double Seconds;
+
+    Seconds = (double)(End - Start) / CLOCKS_PER_SEC;
+    if (Seconds <= 0) {
+        Seconds = 1.0 / CLOCKS_PER_SEC;
+    }
+
+    return Seconds;
+}
+
@@ -0,0 +1,397 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    coretest.h
+
+Abstract:
+
+    This header contains definitions shared across the UEFI core test program.
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include "ueficore.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+#define VPRINT(_Format, _Args...)       \
+    {                                   \
+                                        \
+        if (CoreTestVerbose != FALSE) { \
+            printf(_Format, ## _Args);  \
+        }                               \
+    }
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the frequency of the fake time counter, which stands in for a 24-bit
+// ACPI PM timer.
+//
+
+#define CORE_TEST_TIMER_FREQUENCY 3579545ULL
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+extern BOOLEAN CoreTestVerbose;
+
+//
+// Store the location of the memory given to the core.
+//
+
+extern EFI_PHYSICAL_ADDRESS CoreTestArenaBase;
+extern UINTN CoreTestArenaPages;
+
+//
+// Store the full value of the fake time counter. The core only sees the low
+// bits.
+//
+
+extern UINT64 CoreTestTimeCounter;
+
+//
+// -------------------------------------------------------- Function Prototypes
+//
+
+double
+CoreTestGetSeconds (
+    clock_t Start,
+    clock_t End
+    );
+
+/*++
+
+Routine Description:
+
+    This routine converts a span of processor time into seconds, never
+    returning zero so that rates can be computed from the result.
+
+Arguments:
+
+    Start - Supplies the clock value at the start of the span.
+
+    End - Supplies the clock value at the end of the span.
+
+Return Value:
+
+    Returns the number of seconds elapsed.
+
+--*/
+
+EFI_STATUS
+CoreTestInitializeMemory (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine initializes the core memory services on a block of host
+    memory, if that has not been done already. The first page stands in for
+    the firmware image and the second for its stack.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    EFI status code.
+
+--*/
+
+ULONG
+TestUtil (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine tests the core memory copy, set, and compare routines
+    against simple byte loops.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+VOID
+BenchmarkUtil (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine measures the throughput of the core memory copy, set, and
+    compare routines against byte loops, across a range of buffer sizes.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+ULONG
+TestPe (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine tests PE32+ base relocation against a reference walk.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+VOID
+BenchmarkPe (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine measures PE32+ relocation throughput with and without
+    runtime fixup data being recorded, against the per-entry reference walk.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+ULONG
+TestMemory (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine replays a generated page allocation trace through the core
+    memory services, checking every call and the resulting memory map
+    against a model.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+VOID
+BenchmarkMemory (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine measures the time the core page allocator takes per call
+    when replaying the allocation trace.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+ULONG
+TestTimer (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine drives the core timer queue through a generated trace,
+    checking every expiry and the heap against a reference model.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+VOID
+BenchmarkTimer (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine measures the time the core timer queue takes per operation
+    when replaying the timer trace.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+ULONG
+TestPool (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine replays a generated allocation trace through the core pool,
+    checking every block and measuring the page footprint.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+VOID
+BenchmarkPool (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine measures the time the core pool takes per operation when
+    replaying the allocation trace.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+ULONG
+TestFirmwareVolume (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine tests enumerating the files of a firmware volume, with every
+    file type filter, against a reference list.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+VOID
+BenchmarkFirmwareVolume (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine measures the time it takes to enumerate the files of each
+    type in a firmware volume.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
@@ -0,0 +1,897 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    fvtest.c
+
+Abstract:
+
+    This module tests firmware volume file enumeration. It builds a volume
+    out of randomly typed FFS files, including pad, deleted, OEM and debug
+    files, and checks every file the get next file routine returns against
+    a reference list. This covers searches for all files, for each of the
+    256 file type filters, and searches whose filter changes from call to
+    call.
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include "coretest.h"
+#include "fwvolp.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the shape of the test volume.
+//
+
+#define FV_TEST_FILES 1024
+#define FV_TEST_MAX_DATA 64
+#define FV_TEST_BLOCK_SIZE 0x1000
+
+//
+// Define the number of file types the volume is built from.
+//
+
+#define FV_TEST_TYPE_COUNT (sizeof(FvTestTypes) / sizeof(FvTestTypes[0]))
+
+//
+// Define one in how many files is marked deleted.
+//
+
+#define FV_TEST_DELETED_FREQUENCY 16
+
+//
+// Define the number of calls made with a filter that changes from call to
+// call.
+//
+
+#define FV_TEST_MIXED_STEPS 100000
+
+//
+// Define the number of times the benchmark enumerates each file type.
+//
+
+#define FV_BENCHMARK_ITERATIONS 200
+
+//
+// Define the file state of a file that was completely written. The volume is
+// erased to ones, so the state bits are stored inverted.
+//
+
+#define FV_TEST_STATE_VALID                                         \
+    (UINT8)~(EFI_FILE_HEADER_CONSTRUCTION | EFI_FILE_HEADER_VALID | \
+             EFI_FILE_DATA_VALID)
+
+#define FV_TEST_STATE_DELETED \
+    (UINT8)(FV_TEST_STATE_VALID & ~EFI_FILE_DELETED)
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+/*++
+
+Structure Description:
+
+    This structure stores the reference copy of one file in the test volume.
+
+Members:
+
+    Name - Stores the file name.
+
+    Type - Stores the file type.
+
+    Size - Stores the size of the file data, not including the header.
+
+    Deleted - Stores a boolean indicating if the file is marked deleted, in
+        which case it should never be returned.
+
+--*/
+
+typedef struct _FV_TEST_FILE {
+    EFI_GUID Name;
+    EFI_FV_FILETYPE Type;
+    UINTN Size;
+    BOOLEAN Deleted;
+} FV_TEST_FILE, *PFV_TEST_FILE;
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+PEFI_FIRMWARE_VOLUME
+FvTestCreateVolume (
+    VOID
+    );
+
+VOID
+FvTestDestroyVolume (
+    PEFI_FIRMWARE_VOLUME Device
+    );
+
+VOID
+FvTestBuildImage (
+    VOID
+    );
+
+ULONG
+FvTestEnumerate (
+    PEFI_FIRMWARE_VOLUME Device,
+    EFI_FV_FILETYPE Filter
+    );
+
+ULONG
+FvTestMixedSearch (
+    PEFI_FIRMWARE_VOLUME Device
+    );
+
+ULONG
+FvTestCheckNext (
+    PEFI_FIRMWARE_VOLUME Device,
+    UINTN *Key,
+    UINTN *Cursor,
+    EFI_FV_FILETYPE Filter
+    );
+
+EFIAPI
+EFI_STATUS
+FvTestGetAttributes (
+    CONST EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL *This,
+    EFI_FVB_ATTRIBUTES *Attributes
+    );
+
+EFIAPI
+EFI_STATUS
+FvTestRead (
+    CONST EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL *This,
+    EFI_LBA Lba,
+    UINTN Offset,
+    UINTN *ByteCount,
+    UINT8 *Buffer
+    );
+
+//
+// These routines live in fwvol.c. They are normally reached when a firmware
+// volume block protocol is installed, which the test skips.
+//
+
+EFI_STATUS
+EfipFvCheck (
+    PEFI_FIRMWARE_VOLUME Device
+    );
+
+VOID
+EfipFvFreeDeviceResource (
+    PEFI_FIRMWARE_VOLUME Volume
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// Store the file types the volume is built from. Types past the SMM core have
+// no per-type list, and pad files are never returned.
+//
+
+EFI_FV_FILETYPE FvTestTypes[] = {
+    EFI_FV_FILETYPE_RAW,
+    EFI_FV_FILETYPE_FREEFORM,
+    EFI_FV_FILETYPE_DXE_CORE,
+    EFI_FV_FILETYPE_DRIVER,
+    EFI_FV_FILETYPE_APPLICATION,
+    EFI_FV_FILETYPE_FIRMWARE_VOLUME_IMAGE,
+    EFI_FV_FILETYPE_SMM_CORE,
+    EFI_FV_FILETYPE_OEM_MIN,
+    EFI_FV_FILETYPE_OEM_MAX,
+    EFI_FV_FILETYPE_DEBUG_MIN,
+    EFI_FV_FILETYPE_DEBUG_MAX,
+    EFI_FV_FILETYPE_FFS_PAD,
+    EFI_FV_FILETYPE_FFS_MAX
+};
+
+//
+// Store the volume image and the reference copy of its files.
+//
+
+UINT8 *FvTestImage;
+UINTN FvTestImageSize;
+FV_TEST_FILE FvTestFiles[FV_TEST_FILES];
+
+EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL FvTestBlockIo = {
+    FvTestGetAttributes,
+    NULL,
+    NULL,
+    NULL,
+    FvTestRead,
+    NULL,
+    NULL,
+    NULL
+};
+
+//
+// The template for new volume devices and the file system GUIDs live in
+// fwvol.c.
+//
+
+extern EFI_FIRMWARE_VOLUME EfiFirmwareVolumeTemplate;
+extern EFI_GUID EfiFirmwareFileSystem2Guid;
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+ULONG
+TestFirmwareVolume (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine tests enumerating the files of a firmware volume, with every
+    file type filter, against a reference list.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    PEFI_FIRMWARE_VOLUME Device;
+    ULONG Failures;
+    UINTN Filter;
+
+    Device = FvTestCreateVolume();
+    if (Device == NULL) {
+        return 1;
+    }
+
+    Failures = 0;
+    for (Filter = EFI_FV_FILETYPE_ALL;
+         Filter <= EFI_FV_FILETYPE_FFS_MAX;
+         Filter += 1) {
+
+        Failures += FvTestEnumerate(Device, Filter);
+    }
+
+    Failures += FvTestMixedSearch(Device);
+    FvTestDestroyVolume(Device);
+    VPRINT("Firmware volume: %d files, %d mixed searches, %d failures.\n",
+           FV_TEST_FILES,
+           FV_TEST_MIXED_STEPS,
+           Failures);
+
+    return Failures;
+}
+
+VOID
+BenchmarkFirmwareVolume (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine measures the time it takes to enumerate the files of each
+    type in a firmware volume.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    EFI_FV_FILE_ATTRIBUTES Attributes;
+    UINTN Calls;
+    PEFI_FIRMWARE_VOLUME Device;
+    clock_t End;
+    EFI_FV_FILETYPE FileType;
+    UINTN Iteration;
+    UINTN Key;
+    EFI_GUID Name;
+    double Nanoseconds;
+    UINTN Size;
+    clock_t Start;
+    EFI_STATUS Status;
+    UINTN TypeIndex;
+
+    Device = FvTestCreateVolume();
+    if (Device == NULL) {
+        return;
+    }
+
+    Calls = 0;
+    Start = clock();
+    for (Iteration = 0; Iteration < FV_BENCHMARK_ITERATIONS; Iteration += 1) {
+        for (TypeIndex = 0; TypeIndex < FV_TEST_TYPE_COUNT; TypeIndex += 1) {
+            Key = 0;
+            do {
+                FileType = FvTestTypes[TypeIndex];
+                Status = Device->VolumeProtocol.GetNextFile(
+                                                     &(Device->VolumeProtocol),
+                                                     &Key,
+                                                     &FileType,
+                                                     &Name,
+                                                     &Attributes,
+                                                     &Size);
+
+                Calls += 1;
+
+            } while (!EFI_ERROR(Status));
+        }
+    }
+
+    End = clock();
+    FvTestDestroyVolume(Device);
+    Nanoseconds = CoreTestGetSeconds(Start, End) * 1000000000.0 /
+                  (double)Calls;
+
+    printf("Firmware volume typed enumeration over %d files: %.1fns per "
+           "call.\n",
+           FV_TEST_FILES,
+           Nanoseconds);
+
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+PEFI_FIRMWARE_VOLUME
+FvTestCreateVolume (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine builds a new test volume image and opens a firmware volume
+    device on it.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns a pointer to the firmware volume device on success.
+
+    NULL on failure.
+
+--*/
+
+{
+
+    PEFI_FIRMWARE_VOLUME Device;
+    EFI_FIRMWARE_VOLUME_HEADER *Header;
+    EFI_STATUS Status;
+
+    if (EFI_ERROR(CoreTestInitializeMemory())) {
+        return NULL;
+    }
+
+    FvTestBuildImage();
+    if (FvTestImage == NULL) {
+        return NULL;
+    }
+
+    Header = (EFI_FIRMWARE_VOLUME_HEADER *)FvTestImage;
+    Device = EfiCoreAllocateBootPool(sizeof(EFI_FIRMWARE_VOLUME));
+    if (Device == NULL) {
+        return NULL;
+    }
+
+    EfiCoreCopyMemory(Device,
+                      &EfiFirmwareVolumeTemplate,
+                      sizeof(EFI_FIRMWARE_VOLUME));
+
+    Device->BlockIo = &FvTestBlockIo;
+    Device->VolumeHeader = EfiCoreAllocateBootPool(Header->HeaderLength);
+    if (Device->VolumeHeader == NULL) {
+        EfiCoreFreePool(Device);
+        return NULL;
+    }
+
+    EfiCoreCopyMemory(Device->VolumeHeader, Header, Header->HeaderLength);
+    Status = EfipFvCheck(Device);
+    if (EFI_ERROR(Status)) {
+        printf("Error: Failed to check the test volume: 0x%llx.\n",
+               (unsigned long long)Status);
+
+        EfiCoreFreePool(Device);
+        return NULL;
+    }
+
+    return Device;
+}
+
+VOID
+FvTestDestroyVolume (
+    PEFI_FIRMWARE_VOLUME Device
+    )
+
+/*++
+
+Routine Description:
+
+    This routine closes a test firmware volume device and frees its image.
+
+Arguments:
+
+    Device - Supplies a pointer to the device to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    EfipFvFreeDeviceResource(Device);
+    EfiCoreFreePool(Device);
+    free(FvTestImage);
+    FvTestImage = NULL;
+    return;
+}
+
+VOID
+FvTestBuildImage (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine builds a firmware volume image out of randomly typed and
+    sized files, recording each file in the reference list.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None. The image is NULL if it could not be allocated.
+
+--*/
+
+{
+
+    UINTN DataIndex;
+    UINT8 *FileData;
+    EFI_FFS_FILE_HEADER *FileHeader;
+    UINTN FileSize;
+    EFI_FIRMWARE_VOLUME_HEADER *Header;
+    UINTN HeaderLength;
+    UINTN Index;
+    UINTN Offset;
+    PFV_TEST_FILE Reference;
+    UINT8 Sum;
+
+    HeaderLength = sizeof(EFI_FIRMWARE_VOLUME_HEADER) +
+                   sizeof(EFI_FV_BLOCK_MAP_ENTRY);
+
+    HeaderLength = ALIGN_VALUE(HeaderLength, 8);
+    FvTestImageSize = HeaderLength +
+                      (FV_TEST_FILES *
+                       ALIGN_VALUE(sizeof(EFI_FFS_FILE_HEADER) +
+                                   FV_TEST_MAX_DATA,
+                                   8));
+
+    FvTestImageSize = ALIGN_VALUE(FvTestImageSize, FV_TEST_BLOCK_SIZE);
+    FvTestImage = malloc(FvTestImageSize);
+    if (FvTestImage == NULL) {
+        return;
+    }
+
+    memset(FvTestImage, 0xFF, FvTestImageSize);
+    Header = (EFI_FIRMWARE_VOLUME_HEADER *)FvTestImage;
+    memset(Header, 0, HeaderLength);
+    Header->FileSystemGuid = EfiFirmwareFileSystem2Guid;
+    Header->Length = FvTestImageSize;
+    Header->Attributes = EFI_FVB_READ_STATUS | EFI_FVB_ERASE_POLARITY;
+    Header->HeaderLength = HeaderLength;
+    Header->Revision = 2;
+    Header->BlockMap[0].BlockCount = FvTestImageSize / FV_TEST_BLOCK_SIZE;
+    Header->BlockMap[0].BlockLength = FV_TEST_BLOCK_SIZE;
+    Offset = HeaderLength;
+    for (Index = 0; Index < FV_TEST_FILES; Index += 1) {
+        Reference = &(FvTestFiles[Index]);
+        memset(&(Reference->Name), 0, sizeof(EFI_GUID));
+        Reference->Name.Data1 = Index;
+        Reference->Name.Data2 = 0x7646;
+        Reference->Name.Data4[7] = rand();
+        Reference->Type = FvTestTypes[rand() % FV_TEST_TYPE_COUNT];
+        Reference->Size = rand() % (FV_TEST_MAX_DATA + 1);
+        Reference->Deleted = FALSE;
+        if ((rand() % FV_TEST_DELETED_FREQUENCY) == 0) {
+            Reference->Deleted = TRUE;
+        }
+
+        FileHeader = (EFI_FFS_FILE_HEADER *)(FvTestImage + Offset);
+        FileSize = sizeof(EFI_FFS_FILE_HEADER) + Reference->Size;
+        memset(FileHeader, 0, sizeof(EFI_FFS_FILE_HEADER));
+        FileHeader->Name = Reference->Name;
+        FileHeader->Type = Reference->Type;
+        FileHeader->Size[0] = (UINT8)FileSize;
+        FileHeader->Size[1] = (UINT8)(FileSize >> 8);
+        FileHeader->Size[2] = (UINT8)(FileSize >> 16);
+        FileData = (UINT8 *)(FileHeader + 1);
+        for (DataIndex = 0; DataIndex < Reference->Size; DataIndex += 1) {
+            FileData[DataIndex] = rand();
+        }
+
+        //
+        // The header checksum covers everything but the state and the file
+        // checksum, which are filled in afterwards.
+        //
+
+        Sum = 0;
+        for (DataIndex = 0;
+             DataIndex < sizeof(EFI_FFS_FILE_HEADER);
+             DataIndex += 1) {
+
+            Sum += ((UINT8 *)FileHeader)[DataIndex];
+        }
+
+        FileHeader->IntegrityCheck.Checksum.Header = (UINT8)(0x100 - Sum);
+        FileHeader->IntegrityCheck.Checksum.File = FFS_FIXED_CHECKSUM;
+        FileHeader->State = FV_TEST_STATE_VALID;
+        if (Reference->Deleted != FALSE) {
+            FileHeader->State = FV_TEST_STATE_DELETED;
+        }
+
+        Offset += ALIGN_VALUE(FileSize, 8);
+    }
+
+    return;
+}
+
+ULONG
+FvTestEnumerate (
+    PEFI_FIRMWARE_VOLUME Device,
+    EFI_FV_FILETYPE Filter
+    )
+
+/*++
+
+Routine Description:
+
+    This routine enumerates every file of the given type in the test volume,
+    checking each against the reference list.
+
+Arguments:
+
+    Device - Supplies a pointer to the firmware volume device.
+
+    Filter - Supplies the file type to search for.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    UINTN Cursor;
+    ULONG Failures;
+    UINTN Key;
+
+    Cursor = 0;
+    Key = 0;
+    while (Cursor < FV_TEST_FILES) {
+        Failures = FvTestCheckNext(Device, &Key, &Cursor, Filter);
+        if (Failures != 0) {
+            printf("Error: Enumerating file type 0x%02x failed.\n", Filter);
+            return Failures;
+        }
+    }
+
+    return 0;
+}
+
+ULONG
+FvTestMixedSearch (
+    PEFI_FIRMWARE_VOLUME Device
+    )
+
+/*++
+
+Routine Description:
+
+    This routine searches the test volume with a filter that changes from call
+    to call, so that searches continue from files of other types.
+
+Arguments:
+
+    Device - Supplies a pointer to the firmware volume device.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    UINTN Choice;
+    UINTN Cursor;
+    ULONG Failures;
+    EFI_FV_FILETYPE Filter;
+    UINTN Key;
+    UINTN Step;
+
+    Cursor = 0;
+    Key = 0;
+    for (Step = 0; Step < FV_TEST_MIXED_STEPS; Step += 1) {
+
+        //
+        // Mostly stick with types in the volume, but sometimes search for
+        // everything or for a type with no files.
+        //
+
+        Choice = rand() % (FV_TEST_TYPE_COUNT + 2);
+        if (Choice < FV_TEST_TYPE_COUNT) {
+            Filter = FvTestTypes[Choice];
+
+        } else if (Choice == FV_TEST_TYPE_COUNT) {
+            Filter = EFI_FV_FILETYPE_ALL;
+
+        } else {
+            Filter = EFI_FV_FILETYPE_SMM_CORE + 1 +
+                     (rand() % (EFI_FV_FILETYPE_OEM_MIN -
+                                EFI_FV_FILETYPE_SMM_CORE - 1));
+        }
+
+        Failures = FvTestCheckNext(Device, &Key, &Cursor, Filter);
+        if (Failures != 0) {
+            printf("Error: Mixed search step %ld for file type 0x%02x "
+                   "failed.\n",
+                   (long)Step,
+                   Filter);
+
+            return Failures;
+        }
+
+        //
+        // Start over once the search runs off the end of the volume.
+        //
+
+        if (Cursor == FV_TEST_FILES) {
+            Cursor = 0;
+            Key = 0;
+        }
+    }
+
+    return 0;
+}
+
+ULONG
+FvTestCheckNext (
+    PEFI_FIRMWARE_VOLUME Device,
+    UINTN *Key,
+    UINTN *Cursor,
+    EFI_FV_FILETYPE Filter
+    )
+
+/*++
+
+Routine Description:
+
+    This routine gets the next file matching the given filter and checks it
+    against the reference list.
+
+Arguments:
+
+    Device - Supplies a pointer to the firmware volume device.
+
+    Key - Supplies a pointer to the search key.
+
+    Cursor - Supplies a pointer to the index in the reference list where the
+        search continues. On return, this is advanced past the file returned,
+        or to the end of the list if no file was found.
+
+    Filter - Supplies the file type to search for.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    EFI_FV_FILE_ATTRIBUTES Attributes;
+    EFI_FV_FILETYPE FileType;
+    UINTN Index;
+    EFI_GUID Name;
+    PFV_TEST_FILE Reference;
+    UINTN Size;
+    EFI_STATUS Status;
+
+    Reference = NULL;
+    for (Index = *Cursor; Index < FV_TEST_FILES; Index += 1) {
+        Reference = &(FvTestFiles[Index]);
+        if ((Reference->Deleted == FALSE) &&
+            (Reference->Type != EFI_FV_FILETYPE_FFS_PAD) &&
+            ((Filter == EFI_FV_FILETYPE_ALL) || (Reference->Type == Filter))) {
+
+            break;
+        }
+    }
+
+    FileType = Filter;
+    Status = Device->VolumeProtocol.GetNextFile(&(Device->VolumeProtocol),
+                                                Key,
+                                                &FileType,
+                                                &Name,
+                                                &Attributes,
+                                                &Size);
+
+    if (Index == FV_TEST_FILES) {
+        *Cursor = FV_TEST_FILES;
+        if (Status != EFI_NOT_FOUND) {
+            printf("Error: Expected no more files, got status 0x%llx, file "
+                   "0x%x.\n",
+                   (unsigned long long)Status,
+                   Name.Data1);
+
+            return 1;
+        }
+
+        return 0;
+    }
+
+    *Cursor = Index + 1;
+    if (EFI_ERROR(Status)) {
+        printf("Error: Expected file 0x%lx, got status 0x%llx.\n",
+               (long)Index,
+               (unsigned long long)Status);
+
+        return 1;
+    }
+
+    if ((memcmp(&Name, &(Reference->Name), sizeof(EFI_GUID)) != 0) ||
+        (FileType != Reference->Type) ||
+        (Size != Reference->Size)) {
+
+        printf("Error: Expected file 0x%lx type 0x%02x size %ld, got file "
+               "0x%x type 0x%02x size %ld.\n",
+               (long)Index,
+               Reference->Type,
+               (long)Reference->Size,
+               Name.Data1,
+               FileType,
+               (long)Size);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+EFIAPI
+EFI_STATUS
+FvTestGetAttributes (
+    CONST EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL *This,
+    EFI_FVB_ATTRIBUTES *Attributes
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the attributes of the test volume, which is readable
+    and erased to ones.
+
+Arguments:
+
+    This - Supplies the protocol instance.
+
+    Attributes - Supplies a pointer where the attributes will be returned.
+
+Return Value:
+
+    EFI_SUCCESS always.
+
+--*/
+
+{
+
+    *Attributes = EFI_FVB_READ_STATUS | EFI_FVB_ERASE_POLARITY;
+    return EFI_SUCCESS;
+}
+
+EFIAPI
+EFI_STATUS
+FvTestRead (
+    CONST EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL *This,
+    EFI_LBA Lba,
+    UINTN Offset,
+    UINTN *ByteCount,
+    UINT8 *Buffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads from the test volume image.
+
+Arguments:
+
+    This - Supplies the protocol instance.
+
+    Lba - Supplies the block to read from.
+
+    Offset - Supplies the offset within the block to start reading from.
+
+    ByteCount - Supplies a pointer that on input contains the number of bytes
+        to read. On output, returns the number of bytes read.
+
+    Buffer - Supplies a pointer where the data will be returned.
+
+Return Value:
+
+    EFI_SUCCESS on success.
+
+    EFI_BAD_BUFFER_SIZE if the read crossed a block boundary.
+
+    EFI_INVALID_PARAMETER if the block is out of range.
+
+--*/
+
+{
+
+    if ((Lba * FV_TEST_BLOCK_SIZE) >= FvTestImageSize) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    if ((Offset + *ByteCount) > FV_TEST_BLOCK_SIZE) {
+        return EFI_BAD_BUFFER_SIZE;
+    }
+
+    memcpy(Buffer,
+           FvTestImage + (Lba * FV_TEST_BLOCK_SIZE) + Offset,
+           *ByteCount);
+
+    return EFI_SUCCESS;
+}
+
@@ -0,0 +1,1515 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    memtest.c
+
+Abstract:
+
+    This module stress tests the core page allocator. It replays a generated
+    AllocatePages and FreePages trace against a page granular model of the
+    test arena, and after every call compares the memory map returned by
+    GetMemoryMap against the model. The map must come back sorted,
+    non-overlapping and fully coalesced, and allocations must land at the
+    highest free range that fits, as they do when no memory type bins are
+    set up.
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include "coretest.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the trace parameters. The live set target swings between zero and
+// the maximum over each phase.
+//
+
+#define MEMORY_TEST_OPERATIONS 50000
+#define MEMORY_TEST_MAX_LIVE 256
+#define MEMORY_TEST_PHASE_LENGTH 10000
+
+//
+// Define how often the checked replay mixes in an extra probe, such as an
+// allocation at a fixed address or a free of memory that is already free.
+//
+
+#define MEMORY_TEST_PROBE_INTERVAL 8
+#define MEMORY_TEST_MAX_PROBES 64
+
+//
+// Define the number of reserved ranges scattered around the arena up front
+// to fragment it the way a platform memory map would.
+//
+
+#define MEMORY_TEST_HOLES 32
+
+//
+// Define the number of descriptors to create and destroy before the trace
+// runs. This leaves enough entries on the free descriptor list that the core
+// never has to allocate another descriptor page in the middle of the trace,
+// which the model would not expect.
+//
+
+#define MEMORY_TEST_WARM_DESCRIPTORS 2048
+
+//
+// Define the number of failures after which the replay gives up.
+//
+
+#define MEMORY_TEST_MAX_FAILURES 10
+
+//
+// Define the number of times the benchmark replays the trace.
+//
+
+#define MEMORY_BENCHMARK_ITERATIONS 20
+
+//
+// Define the value the map reader puts in pages no descriptor covers.
+//
+
+#define MEMORY_TEST_UNMAPPED 0xFF
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+typedef enum _MEMORY_TEST_ACTION {
+    MemoryTestAllocate,
+    MemoryTestAllocateBelow,
+    MemoryTestFree
+} MEMORY_TEST_ACTION, *PMEMORY_TEST_ACTION;
+
+/*++
+
+Structure Description:
+
+    This structure stores one operation in the allocation trace.
+
+Members:
+
+    Action - Stores the call to make.
+
+    MemoryType - Stores the memory type to allocate.
+
+    Slot - Stores the index of the live range slot the operation acts on.
+
+    Pages - Stores the number of pages to allocate.
+
+    MaxOffset - Stores the offset from the base of the arena of the maximum
+        address, for allocations below an address.
+
+--*/
+
+typedef struct _MEMORY_TEST_OPERATION {
+    MEMORY_TEST_ACTION Action;
+    EFI_MEMORY_TYPE MemoryType;
+    UINT32 Slot;
+    UINT32 Pages;
+    UINT64 MaxOffset;
+} MEMORY_TEST_OPERATION, *PMEMORY_TEST_OPERATION;
+
+/*++
+
+Structure Description:
+
+    This structure stores a range of pages the test has allocated.
+
+Members:
+
+    Address - Stores the physical address of the first page.
+
+    Pages - Stores the number of pages, or zero if the range is empty.
+
+--*/
+
+typedef struct _MEMORY_TEST_RANGE {
+    EFI_PHYSICAL_ADDRESS Address;
+    UINTN Pages;
+} MEMORY_TEST_RANGE, *PMEMORY_TEST_RANGE;
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+EFI_STATUS
+MemoryTestPrepare (
+    VOID
+    );
+
+PMEMORY_TEST_OPERATION
+MemoryTestCreateTrace (
+    UINTN Count
+    );
+
+ULONG
+MemoryTestReplay (
+    PMEMORY_TEST_OPERATION Trace,
+    UINTN Count,
+    BOOLEAN Check
+    );
+
+ULONG
+MemoryTestProbe (
+    VOID
+    );
+
+ULONG
+MemoryTestCheckStatus (
+    PSTR Operation,
+    EFI_PHYSICAL_ADDRESS Address,
+    UINTN Pages,
+    EFI_STATUS Status,
+    EFI_STATUS ExpectedStatus
+    );
+
+EFI_STATUS
+MemoryTestConvertModel (
+    EFI_PHYSICAL_ADDRESS Address,
+    UINTN Pages,
+    EFI_MEMORY_TYPE NewType,
+    UINTN *Converted
+    );
+
+EFI_PHYSICAL_ADDRESS
+MemoryTestFindFreePages (
+    EFI_PHYSICAL_ADDRESS MaxAddress,
+    UINTN Pages
+    );
+
+ULONG
+MemoryTestCheckMap (
+    VOID
+    );
+
+ULONG
+MemoryTestReadMap (
+    UINT8 *Pages
+    );
+
+EFI_MEMORY_TYPE
+MemoryTestGetRandomType (
+    VOID
+    );
+
+UINT32
+MemoryTestGetRandomPages (
+    VOID
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// Store the model of the arena, one memory type per page, along with the
+// pages read back from the memory map and the state before the trace.
+//
+
+UINT8 *MemoryTestModel;
+UINT8 *MemoryTestActual;
+UINT8 *MemoryTestSnapshot;
+
+//
+// Store the memory map buffer.
+//
+
+EFI_MEMORY_DESCRIPTOR *MemoryTestMap;
+UINTN MemoryTestMapSize;
+
+//
+// Store the largest number of descriptors seen in the map.
+//
+
+UINTN MemoryTestPeakDescriptors;
+
+//
+// Store the ranges allocated by the trace, indexed by slot, and the ranges
+// allocated by probes.
+//
+
+MEMORY_TEST_RANGE MemoryTestSlots[MEMORY_TEST_MAX_LIVE];
+MEMORY_TEST_RANGE MemoryTestProbes[MEMORY_TEST_MAX_PROBES];
+UINTN MemoryTestProbeCount;
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+ULONG
+TestMemory (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine replays a generated page allocation trace through the core
+    memory services, checking every call and the resulting memory map
+    against a model.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    UINTN Converted;
+    EFI_STATUS ExpectedStatus;
+    ULONG Failures;
+    MEMORY_TEST_RANGE Holes[MEMORY_TEST_HOLES];
+    UINTN Index;
+    UINTN Page;
+    UINTN Pages;
+    EFI_STATUS Status;
+    PMEMORY_TEST_OPERATION Trace;
+
+    if (EFI_ERROR(MemoryTestPrepare())) {
+        return 1;
+    }
+
+    //
+    // Take the map as it stands as the starting model. Everything outside
+    // the test's own ranges is left alone, so it should stay put.
+    //
+
+    Failures = MemoryTestReadMap(MemoryTestModel);
+    memcpy(MemoryTestSnapshot, MemoryTestModel, CoreTestArenaPages);
+
+    //
+    // Punch reserved holes into the free memory.
+    //
+
+    for (Index = 0; Index < MEMORY_TEST_HOLES; Index += 1) {
+        do {
+            Page = rand() % CoreTestArenaPages;
+
+        } while (MemoryTestModel[Page] != EfiConventionalMemory);
+
+        Holes[Index].Address = CoreTestArenaBase + EFI_PAGES_TO_SIZE(Page);
+        Pages = 1 + (rand() % 16);
+        ExpectedStatus = MemoryTestConvertModel(Holes[Index].Address,
+                                                Pages,
+                                                EfiReservedMemoryType,
+                                                &Converted);
+
+        Status = EfiCoreAllocatePages(AllocateAddress,
+                                      EfiReservedMemoryType,
+                                      Pages,
+                                      &(Holes[Index].Address));
+
+        Failures += MemoryTestCheckStatus("Reserving",
+                                          Holes[Index].Address,
+                                          Pages,
+                                          Status,
+                                          ExpectedStatus);
+
+        Holes[Index].Pages = Converted;
+    }
+
+    Failures += MemoryTestCheckMap();
+    Trace = MemoryTestCreateTrace(MEMORY_TEST_OPERATIONS);
+    if (Trace == NULL) {
+        return Failures + 1;
+    }
+
+    if (Failures == 0) {
+        Failures += MemoryTestReplay(Trace, MEMORY_TEST_OPERATIONS, TRUE);
+    }
+
+    for (Index = 0; Index < MEMORY_TEST_HOLES; Index += 1) {
+        if (Holes[Index].Pages != 0) {
+            ExpectedStatus = MemoryTestConvertModel(Holes[Index].Address,
+                                                    Holes[Index].Pages,
+                                                    EfiConventionalMemory,
+                                                    &Converted);
+
+            Status = EfiCoreFreePages(Holes[Index].Address,
+                                      Holes[Index].Pages);
+
+            Failures += MemoryTestCheckStatus("Freeing reserved",
+                                              Holes[Index].Address,
+                                              Holes[Index].Pages,
+                                              Status,
+                                              ExpectedStatus);
+        }
+    }
+
+    //
+    // With everything freed the map should be back where it started.
+    //
+
+    Failures += MemoryTestCheckMap();
+    if (memcmp(MemoryTestModel, MemoryTestSnapshot, CoreTestArenaPages) != 0) {
+        printf("Memory: Map did not return to its starting state.\n");
+        Failures += 1;
+    }
+
+    VPRINT("Memory: %d operations, up to %ld descriptors.\n",
+           MEMORY_TEST_OPERATIONS,
+           (long)MemoryTestPeakDescriptors);
+
+    VPRINT("Memory: %d failures.\n", Failures);
+    free(Trace);
+    return Failures;
+}
+
+VOID
+BenchmarkMemory (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine measures the time the core page allocator takes per call
+    when replaying the allocation trace.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    clock_t End;
+    ULONG Failures;
+    UINTN Iteration;
+    double Nanoseconds;
+    clock_t Start;
+    PMEMORY_TEST_OPERATION Trace;
+
+    if (EFI_ERROR(MemoryTestPrepare())) {
+        return;
+    }
+
+    Trace = MemoryTestCreateTrace(MEMORY_TEST_OPERATIONS);
+    if (Trace == NULL) {
+        return;
+    }
+
+    Failures = 0;
+    Start = clock();
+    for (Iteration = 0;
+         Iteration < MEMORY_BENCHMARK_ITERATIONS;
+         Iteration += 1) {
+
+        Failures += MemoryTestReplay(Trace, MEMORY_TEST_OPERATIONS, FALSE);
+    }
+
+    End = clock();
+    if (Failures != 0) {
+        printf("Error: Memory benchmark failed.\n");
+    }
+
+    Nanoseconds = CoreTestGetSeconds(Start, End) * 1000000000.0 /
+                  ((double)MEMORY_TEST_OPERATIONS *
+                   MEMORY_BENCHMARK_ITERATIONS);
+
+    printf("Page allocator trace of %d operations: %.1fns per operation.\n",
+           MEMORY_TEST_OPERATIONS,
+           Nanoseconds);
+
+    free(Trace);
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+EFI_STATUS
+MemoryTestPrepare (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine initializes memory services and the model buffers, and
+    stocks the free descriptor list, if that has not been done already.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    EFI status code.
+
+--*/
+
+{
+
+    EFI_PHYSICAL_ADDRESS *Addresses;
+    UINTN Index;
+    EFI_MEMORY_TYPE MemoryType;
+    static EFI_STATUS Status = EFI_NOT_STARTED;
+
+    if (Status != EFI_NOT_STARTED) {
+        return Status;
+    }
+
+    Status = CoreTestInitializeMemory();
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Status = EFI_OUT_OF_RESOURCES;
+    MemoryTestModel = malloc(CoreTestArenaPages);
+    MemoryTestActual = malloc(CoreTestArenaPages);
+    MemoryTestSnapshot = malloc(CoreTestArenaPages);
+    Addresses = malloc(MEMORY_TEST_WARM_DESCRIPTORS *
+                       sizeof(EFI_PHYSICAL_ADDRESS));
+
+    if ((MemoryTestModel == NULL) || (MemoryTestActual == NULL) ||
+        (MemoryTestSnapshot == NULL) || (Addresses == NULL)) {
+
+        goto PrepareEnd;
+    }
+
+    //
+    // Allocate single pages of alternating types so that each one needs
+    // its own descriptor, then free them all to put those descriptors on the
+    // free list.
+    //
+
+    for (Index = 0; Index < MEMORY_TEST_WARM_DESCRIPTORS; Index += 1) {
+        MemoryType = EfiLoaderCode;
+        if ((Index & 0x1) != 0) {
+            MemoryType = EfiLoaderData;
+        }
+
+        Status = EfiCoreAllocatePages(AllocateAnyPages,
+                                      MemoryType,
+                                      1,
+                                      &(Addresses[Index]));
+
+        if (EFI_ERROR(Status)) {
+            goto PrepareEnd;
+        }
+    }
+
+    for (Index = 0; Index < MEMORY_TEST_WARM_DESCRIPTORS; Index += 1) {
+        Status = EfiCoreFreePages(Addresses[Index], 1);
+        if (EFI_ERROR(Status)) {
+            goto PrepareEnd;
+        }
+    }
+
+    Status = EFI_SUCCESS;
+
+PrepareEnd:
+    if (Addresses != NULL) {
+        free(Addresses);
+    }
+
+    if (EFI_ERROR(Status)) {
+        printf("Memory: Failed to prepare: 0x%llx.\n",
+               (unsigned long long)Status);
+    }
+
+    return Status;
+}
+
+PMEMORY_TEST_OPERATION
+MemoryTestCreateTrace (
+    UINTN Count
+    )
+
+/*++
+
+Routine Description:
+
+    This routine generates an allocation trace. The live set target rises
+    and falls over each phase, and frees take a random live range. Anything
+    still live at the end of the trace is left for the replay to free.
+
+Arguments:
+
+    Count - Supplies the number of operations to generate.
+
+Return Value:
+
+    Returns a pointer to the trace, allocated with malloc.
+
+    NULL on allocation failure.
+
+--*/
+
+{
+
+    UINT32 Free[MEMORY_TEST_MAX_LIVE];
+    UINTN FreeCount;
+    UINTN Index;
+    UINT32 Live[MEMORY_TEST_MAX_LIVE];
+    UINTN LiveCount;
+    UINTN Phase;
+    UINTN Pick;
+    UINTN Target;
+    PMEMORY_TEST_OPERATION Trace;
+
+    Trace = malloc(Count * sizeof(MEMORY_TEST_OPERATION));
+    if (Trace == NULL) {
+        return NULL;
+    }
+
+    memset(Trace, 0, Count * sizeof(MEMORY_TEST_OPERATION));
+    LiveCount = 0;
+    for (Index = 0; Index < MEMORY_TEST_MAX_LIVE; Index += 1) {
+        Free[Index] = MEMORY_TEST_MAX_LIVE - 1 - Index;
+    }
+
+    FreeCount = MEMORY_TEST_MAX_LIVE;
+    for (Index = 0; Index < Count; Index += 1) {
+        Phase = Index % MEMORY_TEST_PHASE_LENGTH;
+        if (Phase < (MEMORY_TEST_PHASE_LENGTH / 2)) {
+            Target = Phase;
+
+        } else {
+            Target = MEMORY_TEST_PHASE_LENGTH - Phase;
+        }
+
+        Target = Target * (MEMORY_TEST_MAX_LIVE - 1) /
+                 (MEMORY_TEST_PHASE_LENGTH / 2);
+
+        //
+        // Allocate with a bias toward the target live count. One in five
+        // allocations has a maximum address somewhere in the arena.
+        //
+
+        if ((LiveCount == 0) ||
+            ((FreeCount != 0) &&
+             ((rand() % 4) < ((LiveCount < Target) ? 3 : 1)))) {
+
+            FreeCount -= 1;
+            Trace[Index].Action = MemoryTestAllocate;
+            Trace[Index].Slot = Free[FreeCount];
+            Trace[Index].Pages = MemoryTestGetRandomPages();
+            Trace[Index].MemoryType = MemoryTestGetRandomType();
+            if ((rand() % 5) == 0) {
+                Trace[Index].Action = MemoryTestAllocateBelow;
+                Trace[Index].MaxOffset =
+                            EFI_PAGES_TO_SIZE(rand() % CoreTestArenaPages) +
+                            (rand() % EFI_PAGE_SIZE);
+            }
+
+            Live[LiveCount] = Trace[Index].Slot;
+            LiveCount += 1;
+
+        } else {
+            Pick = rand() % LiveCount;
+            Trace[Index].Action = MemoryTestFree;
+            Trace[Index].Slot = Live[Pick];
+            LiveCount -= 1;
+            Live[Pick] = Live[LiveCount];
+            Free[FreeCount] = Trace[Index].Slot;
+            FreeCount += 1;
+        }
+    }
+
+    return Trace;
+}
+
+ULONG
+MemoryTestReplay (
+    PMEMORY_TEST_OPERATION Trace,
+    UINTN Count,
+    BOOLEAN Check
+    )
+
+/*++
+
+Routine Description:
+
+    This routine replays an allocation trace, then frees whatever is still
+    live.
+
+Arguments:
+
+    Trace - Supplies a pointer to the trace.
+
+    Count - Supplies the number of operations in the trace.
+
+    Check - Supplies a boolean indicating whether to predict each call with
+        the model, mix in probes, and compare the memory map after every
+        call. If this is FALSE only the calls themselves are made.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    EFI_PHYSICAL_ADDRESS Address;
+    EFI_ALLOCATE_TYPE AllocateType;
+    UINTN Converted;
+    EFI_PHYSICAL_ADDRESS Expected;
+    EFI_STATUS ExpectedStatus;
+    ULONG Failures;
+    UINTN Index;
+    PMEMORY_TEST_OPERATION Operation;
+    PMEMORY_TEST_RANGE Range;
+    EFI_STATUS Status;
+
+    Failures = 0;
+    memset(MemoryTestSlots, 0, sizeof(MemoryTestSlots));
+    for (Index = 0; Index < Count; Index += 1) {
+        Operation = &(Trace[Index]);
+        Range = &(MemoryTestSlots[Operation->Slot]);
+        if (Operation->Action == MemoryTestFree) {
+            if (Range->Pages == 0) {
+                continue;
+            }
+
+            Status = EfiCoreFreePages(Range->Address, Range->Pages);
+            if (Check != FALSE) {
+                ExpectedStatus = MemoryTestConvertModel(Range->Address,
+                                                        Range->Pages,
+                                                        EfiConventionalMemory,
+                                                        &Converted);
+
+                Failures += MemoryTestCheckStatus("Freeing",
+                                                  Range->Address,
+                                                  Range->Pages,
+                                                  Status,
+                                                  ExpectedStatus);
+
+            } else if (EFI_ERROR(Status)) {
+                Failures += 1;
+            }
+
+            Range->Pages = 0;
+
+        } else {
+            AllocateType = AllocateAnyPages;
+            Address = 0;
+            Expected = 0;
+            if (Operation->Action == MemoryTestAllocateBelow) {
+                AllocateType = AllocateMaxAddress;
+                Address = CoreTestArenaBase + Operation->MaxOffset;
+            }
+
+            if (Check != FALSE) {
+                if (AllocateType == AllocateAnyPages) {
+                    Expected = MemoryTestFindFreePages(MAX_ADDRESS,
+                                                       Operation->Pages);
+
+                } else {
+                    Expected = MemoryTestFindFreePages(Address,
+                                                       Operation->Pages);
+                }
+            }
+
+            Status = EfiCoreAllocatePages(AllocateType,
+                                          Operation->MemoryType,
+                                          Operation->Pages,
+                                          &Address);
+
+            if (Check != FALSE) {
+                ExpectedStatus = EFI_OUT_OF_RESOURCES;
+                if (Expected != 0) {
+                    ExpectedStatus = MemoryTestConvertModel(
+                                                        Expected,
+                                                        Operation->Pages,
+                                                        Operation->MemoryType,
+                                                        &Converted);
+                }
+
+                Failures += MemoryTestCheckStatus("Allocating",
+                                                  Expected,
+                                                  Operation->Pages,
+                                                  Status,
+                                                  ExpectedStatus);
+
+                if ((!EFI_ERROR(Status)) && (Address != Expected)) {
+                    printf("Memory: Allocation of %d pages at operation %ld "
+                           "went to 0x%llx instead of 0x%llx.\n",
+                           Operation->Pages,
+                           (long)Index,
+                           (unsigned long long)Address,
+                           (unsigned long long)Expected);
+
+                    Failures += 1;
+                }
+            }
+
+            Range->Pages = 0;
+            if (!EFI_ERROR(Status)) {
+                Range->Address = Address;
+                Range->Pages = Operation->Pages;
+            }
+        }
+
+        if (Check != FALSE) {
+            if ((rand() % MEMORY_TEST_PROBE_INTERVAL) == 0) {
+                Failures += MemoryTestProbe();
+            }
+
+            Failures += MemoryTestCheckMap();
+            if (Failures >= MEMORY_TEST_MAX_FAILURES) {
+                printf("Memory: Giving up at operation %ld.\n", (long)Index);
+                break;
+            }
+        }
+    }
+
+    //
+    // Free everything still live.
+    //
+
+    for (Index = 0; Index < MEMORY_TEST_MAX_LIVE; Index += 1) {
+        Range = &(MemoryTestSlots[Index]);
+        if (Range->Pages != 0) {
+            Status = EfiCoreFreePages(Range->Address, Range->Pages);
+            if (Check != FALSE) {
+                ExpectedStatus = MemoryTestConvertModel(Range->Address,
+                                                        Range->Pages,
+                                                        EfiConventionalMemory,
+                                                        &Converted);
+
+                Failures += MemoryTestCheckStatus("Freeing",
+                                                  Range->Address,
+                                                  Range->Pages,
+                                                  Status,
+                                                  ExpectedStatus);
+
+            } else if (EFI_ERROR(Status)) {
+                Failures += 1;
+            }
+
+            Range->Pages = 0;
+        }
+    }
+
+    while (MemoryTestProbeCount != 0) {
+        MemoryTestProbeCount -= 1;
+        Range = &(MemoryTestProbes[MemoryTestProbeCount]);
+        ExpectedStatus = MemoryTestConvertModel(Range->Address,
+                                                Range->Pages,
+                                                EfiConventionalMemory,
+                                                &Converted);
+
+        Status = EfiCoreFreePages(Range->Address, Range->Pages);
+        Failures += MemoryTestCheckStatus("Freeing probe",
+                                          Range->Address,
+                                          Range->Pages,
+                                          Status,
+                                          ExpectedStatus);
+    }
+
+    if (Check != FALSE) {
+        Failures += MemoryTestCheckMap();
+    }
+
+    return Failures;
+}
+
+ULONG
+MemoryTestProbe (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine makes one call outside the trace: an allocation at a fixed
+    address, which may run into allocated memory part way through, a free of
+    a probe allocation, a free of part of a live range, a free of memory
+    that is already free, or a free at an address that is not page aligned.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    EFI_PHYSICAL_ADDRESS Address;
+    UINTN Attempt;
+    UINTN Converted;
+    EFI_STATUS ExpectedStatus;
+    ULONG Failures;
+    UINTN Index;
+    EFI_MEMORY_TYPE MemoryType;
+    UINTN Page;
+    UINTN Pages;
+    PMEMORY_TEST_RANGE Range;
+    EFI_STATUS Status;
+
+    Failures = 0;
+    Range = NULL;
+    switch (rand() % 5) {
+
+    //
+    // Allocate at a fixed address. If the range runs into something already
+    // allocated, the pages up to that point stay converted.
+    //
+
+    case 0:
+        if (MemoryTestProbeCount == MEMORY_TEST_MAX_PROBES) {
+            break;
+        }
+
+        Page = rand() % CoreTestArenaPages;
+        Address = CoreTestArenaBase + EFI_PAGES_TO_SIZE(Page);
+        Pages = 1 + (rand() % 16);
+        MemoryType = MemoryTestGetRandomType();
+        ExpectedStatus = MemoryTestConvertModel(Address,
+                                                Pages,
+                                                MemoryType,
+                                                &Converted);
+
+        Status = EfiCoreAllocatePages(AllocateAddress,
+                                      MemoryType,
+                                      Pages,
+                                      &Address);
+
+        Failures += MemoryTestCheckStatus("Allocating at",
+                                          Address,
+                                          Pages,
+                                          Status,
+                                          ExpectedStatus);
+
+        if (Converted != 0) {
+            Range = &(MemoryTestProbes[MemoryTestProbeCount]);
+            MemoryTestProbeCount += 1;
+            Range->Address = Address;
+            Range->Pages = Converted;
+        }
+
+        break;
+
+    //
+    // Free a probe allocation.
+    //
+
+    case 1:
+        if (MemoryTestProbeCount == 0) {
+            break;
+        }
+
+        Index = rand() % MemoryTestProbeCount;
+        Range = &(MemoryTestProbes[Index]);
+        ExpectedStatus = MemoryTestConvertModel(Range->Address,
+                                                Range->Pages,
+                                                EfiConventionalMemory,
+                                                &Converted);
+
+        Status = EfiCoreFreePages(Range->Address, Range->Pages);
+        Failures += MemoryTestCheckStatus("Freeing probe",
+                                          Range->Address,
+                                          Range->Pages,
+                                          Status,
+                                          ExpectedStatus);
+
+        MemoryTestProbeCount -= 1;
+        *Range = MemoryTestProbes[MemoryTestProbeCount];
+        break;
+
+    //
+    // Free the head or tail of a live range.
+    //
+
+    case 2:
+        Index = rand() % MEMORY_TEST_MAX_LIVE;
+        for (Attempt = 0; Attempt < MEMORY_TEST_MAX_LIVE; Attempt += 1) {
+            Range = &(MemoryTestSlots[Index]);
+            if (Range->Pages >= 2) {
+                break;
+            }
+
+            Range = NULL;
+            Index = (Index + 1) % MEMORY_TEST_MAX_LIVE;
+        }
+
+        if (Range == NULL) {
+            break;
+        }
+
+        Pages = 1 + (rand() % (Range->Pages - 1));
+        Address = Range->Address;
+        if ((rand() & 0x1) != 0) {
+            Address += EFI_PAGES_TO_SIZE(Range->Pages - Pages);
+
+        } else {
+            Range->Address += EFI_PAGES_TO_SIZE(Pages);
+        }
+
+        Range->Pages -= Pages;
+        ExpectedStatus = MemoryTestConvertModel(Address,
+                                                Pages,
+                                                EfiConventionalMemory,
+                                                &Converted);
+
+        Status = EfiCoreFreePages(Address, Pages);
+        Failures += MemoryTestCheckStatus("Freeing part",
+                                          Address,
+                                          Pages,
+                                          Status,
+                                          ExpectedStatus);
+
+        break;
+
+    //
+    // Free memory that is already free. Nothing should change.
+    //
+
+    case 3:
+        for (Attempt = 0; Attempt < 16; Attempt += 1) {
+            Page = rand() % CoreTestArenaPages;
+            if (MemoryTestModel[Page] == EfiConventionalMemory) {
+                break;
+            }
+        }
+
+        if (MemoryTestModel[Page] != EfiConventionalMemory) {
+            break;
+        }
+
+        Address = CoreTestArenaBase + EFI_PAGES_TO_SIZE(Page);
+        Pages = 1 + (rand() % 8);
+        ExpectedStatus = MemoryTestConvertModel(Address,
+                                                Pages,
+                                                EfiConventionalMemory,
+                                                &Converted);
+
+        Status = EfiCoreFreePages(Address, Pages);
+        Failures += MemoryTestCheckStatus("Freeing free",
+                                          Address,
+                                          Pages,
+                                          Status,
+                                          ExpectedStatus);
+
+        break;
+
+    //
+    // Free at an unaligned address inside a live range.
+    //
+
+    case 4:
+        Range = &(MemoryTestSlots[rand() % MEMORY_TEST_MAX_LIVE]);
+        if (Range->Pages == 0) {
+            break;
+        }
+
+        Address = Range->Address + 1 + (rand() % EFI_PAGE_MASK);
+        Status = EfiCoreFreePages(Address, 1);
+        Failures += MemoryTestCheckStatus("Freeing unaligned",
+                                          Address,
+                                          1,
+                                          Status,
+                                          EFI_INVALID_PARAMETER);
+
+        break;
+
+    default:
+        break;
+    }
+
+    return Failures;
+}
+
+ULONG
+MemoryTestCheckStatus (
+    PSTR Operation,
+    EFI_PHYSICAL_ADDRESS Address,
+    UINTN Pages,
+    EFI_STATUS Status,
+    EFI_STATUS ExpectedStatus
+    )
+
+/*++
+
+Routine Description:
+
+    This routine compares the status a call returned with the one the model
+    predicted.
+
+Arguments:
+
+    Operation - Supplies a description of the call, for the error message.
+
+    Address - Supplies the address the call acted on.
+
+    Pages - Supplies the number of pages the call acted on.
+
+    Status - Supplies the status the call returned.
+
+    ExpectedStatus - Supplies the status the model predicted.
+
+Return Value:
+
+    Returns the number of failures, zero or one.
+
+--*/
+
+{
+
+    if (Status == ExpectedStatus) {
+        return 0;
+    }
+
+    printf("Memory: %s %ld pages at 0x%llx returned 0x%llx, expected "
+           "0x%llx.\n",
+           Operation,
+           (long)Pages,
+           (unsigned long long)Address,
+           (unsigned long long)Status,
+           (unsigned long long)ExpectedStatus);
+
+    return 1;
+}
+
+EFI_STATUS
+MemoryTestConvertModel (
+    EFI_PHYSICAL_ADDRESS Address,
+    UINTN Pages,
+    EFI_MEMORY_TYPE NewType,
+    UINTN *Converted
+    )
+
+/*++
+
+Routine Description:
+
+    This routine applies a page conversion to the model the way the core
+    does: page by page from the start, stopping at the first page that is
+    not in the map or cannot be converted. Allocations convert only free
+    pages, and frees only allocated ones.
+
+Arguments:
+
+    Address - Supplies the address of the first page to convert.
+
+    Pages - Supplies the number of pages to convert.
+
+    NewType - Supplies the type to convert the pages to.
+
+    Converted - Supplies a pointer where the number of pages converted
+        before stopping is returned.
+
+Return Value:
+
+    EFI_SUCCESS if every page was converted.
+
+    EFI_NOT_FOUND if the conversion stopped early.
+
+--*/
+
+{
+
+    UINTN Index;
+    UINTN Page;
+    UINT8 Type;
+
+    *Converted = 0;
+    if (Address < CoreTestArenaBase) {
+        return EFI_NOT_FOUND;
+    }
+
+    Page = (Address - CoreTestArenaBase) >> EFI_PAGE_SHIFT;
+    for (Index = 0; Index < Pages; Index += 1) {
+        if (Page + Index >= CoreTestArenaPages) {
+            return EFI_NOT_FOUND;
+        }
+
+        Type = MemoryTestModel[Page + Index];
+        if (NewType == EfiConventionalMemory) {
+            if (Type == EfiConventionalMemory) {
+                return EFI_NOT_FOUND;
+            }
+
+        } else if (Type != EfiConventionalMemory) {
+            return EFI_NOT_FOUND;
+        }
+
+        MemoryTestModel[Page + Index] = NewType;
+        *Converted += 1;
+    }
+
+    return EFI_SUCCESS;
+}
+
+EFI_PHYSICAL_ADDRESS
+MemoryTestFindFreePages (
+    EFI_PHYSICAL_ADDRESS MaxAddress,
+    UINTN Pages
+    )
+
+/*++
+
+Routine Description:
+
+    This routine finds where the model says an allocation should go: the
+    highest run of free pages that fits entirely at or below the maximum
+    address.
+
+Arguments:
+
+    MaxAddress - Supplies the highest address the allocation may touch.
+
+    Pages - Supplies the number of pages to allocate.
+
+Return Value:
+
+    Returns the address of the allocation.
+
+    0 if nothing fits.
+
+--*/
+
+{
+
+    UINTN Limit;
+    UINTN Page;
+    UINTN Run;
+
+    //
+    // Work out how many pages of the arena lie entirely at or below the
+    // maximum address.
+    //
+
+    if (MaxAddress < CoreTestArenaBase + EFI_PAGE_MASK) {
+        return 0;
+    }
+
+    Limit = CoreTestArenaPages;
+    if (MaxAddress - CoreTestArenaBase <
+        EFI_PAGES_TO_SIZE(CoreTestArenaPages)) {
+
+        Limit = (MaxAddress - CoreTestArenaBase + 1) >> EFI_PAGE_SHIFT;
+    }
+
+    Run = 0;
+    for (Page = Limit; Page != 0; Page -= 1) {
+        if (MemoryTestModel[Page - 1] != EfiConventionalMemory) {
+            Run = 0;
+            continue;
+        }
+
+        Run += 1;
+        if (Run == Pages) {
+            return CoreTestArenaBase + EFI_PAGES_TO_SIZE(Page - 1);
+        }
+    }
+
+    return 0;
+}
+
+ULONG
+MemoryTestCheckMap (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads back the memory map and compares it with the model.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    ULONG Failures;
+    UINTN Page;
+
+    Failures = MemoryTestReadMap(MemoryTestActual);
+    if (memcmp(MemoryTestActual, MemoryTestModel, CoreTestArenaPages) == 0) {
+        return Failures;
+    }
+
+    for (Page = 0; Page < CoreTestArenaPages; Page += 1) {
+        if (MemoryTestActual[Page] != MemoryTestModel[Page]) {
+            printf("Memory: Page 0x%llx has type %d in the map, expected "
+                   "%d.\n",
+                   (unsigned long long)(CoreTestArenaBase +
+                                        EFI_PAGES_TO_SIZE(Page)),
+                   MemoryTestActual[Page],
+                   MemoryTestModel[Page]);
+
+            break;
+        }
+    }
+
+    return Failures + 1;
+}
+
+ULONG
+MemoryTestReadMap (
+    UINT8 *Pages
+    )
+
+/*++
+
+Routine Description:
+
+    This routine gets the memory map, checks that it is sorted,
+    non-overlapping, coalesced, inside the arena and carries the right
+    attributes, and expands it into one memory type per page.
+
+Arguments:
+
+    Pages - Supplies a pointer where the type of each page in the arena is
+        returned. Pages not covered by the map are set to an invalid type.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    UINT64 ArenaEnd;
+    UINT64 Attribute;
+    EFI_MEMORY_DESCRIPTOR *Descriptor;
+    UINTN DescriptorCount;
+    UINTN DescriptorSize;
+    UINT32 DescriptorVersion;
+    UINT64 End;
+    ULONG Failures;
+    UINTN MapKey;
+    UINTN MapSize;
+    UINTN Offset;
+    EFI_MEMORY_DESCRIPTOR *Previous;
+    EFI_STATUS Status;
+
+    while (TRUE) {
+        MapSize = MemoryTestMapSize;
+        Status = EfiCoreGetMemoryMap(&MapSize,
+                                     MemoryTestMap,
+                                     &MapKey,
+                                     &DescriptorSize,
+                                     &DescriptorVersion);
+
+        if (Status != EFI_BUFFER_TOO_SMALL) {
+            break;
+        }
+
+        free(MemoryTestMap);
+        MemoryTestMapSize = MapSize * 2;
+        MemoryTestMap = malloc(MemoryTestMapSize);
+        if (MemoryTestMap == NULL) {
+            MemoryTestMapSize = 0;
+            return 1;
+        }
+    }
+
+    if (EFI_ERROR(Status)) {
+        printf("Memory: Failed to get the memory map: 0x%llx.\n",
+               (unsigned long long)Status);
+
+        return 1;
+    }
+
+    ArenaEnd = CoreTestArenaBase + EFI_PAGES_TO_SIZE(CoreTestArenaPages);
+    DescriptorCount = MapSize / DescriptorSize;
+    if (DescriptorCount > MemoryTestPeakDescriptors) {
+        MemoryTestPeakDescriptors = DescriptorCount;
+    }
+
+    Failures = 0;
+    Previous = NULL;
+    memset(Pages, MEMORY_TEST_UNMAPPED, CoreTestArenaPages);
+    for (Offset = 0; Offset < MapSize; Offset += DescriptorSize) {
+        Descriptor = (EFI_MEMORY_DESCRIPTOR *)((UINT8 *)MemoryTestMap + Offset);
+        End = Descriptor->PhysicalStart +
+              EFI_PAGES_TO_SIZE(Descriptor->NumberOfPages);
+
+        Attribute = EFI_MEMORY_WB;
+        if ((Descriptor->Type == EfiRuntimeServicesCode) ||
+            (Descriptor->Type == EfiRuntimeServicesData) ||
+            (Descriptor->Type == EfiPalCode)) {
+
+            Attribute |= EFI_MEMORY_RUNTIME;
+        }
+
+        if (((Descriptor->PhysicalStart & EFI_PAGE_MASK) != 0) ||
+            (Descriptor->NumberOfPages == 0) ||
+            (Descriptor->PhysicalStart < CoreTestArenaBase) ||
+            (End > ArenaEnd) ||
+            (Descriptor->Type >= EfiMaxMemoryType) ||
+            (Descriptor->Attribute != Attribute)) {
+
+            printf("Memory: Bad descriptor: type %d, 0x%llx, 0x%llx pages, "
+                   "attributes 0x%llx.\n",
+                   Descriptor->Type,
+                   (unsigned long long)Descriptor->PhysicalStart,
+                   (unsigned long long)Descriptor->NumberOfPages,
+                   (unsigned long long)Descriptor->Attribute);
+
+            Failures += 1;
+            continue;
+        }
+
+        if (Previous != NULL) {
+            if (Descriptor->PhysicalStart <
+                Previous->PhysicalStart +
+                EFI_PAGES_TO_SIZE(Previous->NumberOfPages)) {
+
+                printf("Memory: Descriptor at 0x%llx overlaps or is out of "
+                       "order with the one at 0x%llx.\n",
+                       (unsigned long long)Descriptor->PhysicalStart,
+                       (unsigned long long)Previous->PhysicalStart);
+
+                Failures += 1;
+
+            } else if ((Descriptor->PhysicalStart ==
+                        Previous->PhysicalStart +
+                        EFI_PAGES_TO_SIZE(Previous->NumberOfPages)) &&
+                       (Descriptor->Type == Previous->Type) &&
+                       (Descriptor->Attribute == Previous->Attribute)) {
+
+                printf("Memory: Descriptor at 0x%llx was not coalesced with "
+                       "the one at 0x%llx.\n",
+                       (unsigned long long)Descriptor->PhysicalStart,
+                       (unsigned long long)Previous->PhysicalStart);
+
+                Failures += 1;
+            }
+        }
+
+        memset(Pages +
+               ((Descriptor->PhysicalStart - CoreTestArenaBase) >>
+                EFI_PAGE_SHIFT),
+               Descriptor->Type,
+               Descriptor->NumberOfPages);
+
+        Previous = Descriptor;
+    }
+
+    return Failures;
+}
+
+EFI_MEMORY_TYPE
+MemoryTestGetRandomType (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine picks a memory type to allocate, weighted toward boot
+    services data as in a firmware boot.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the memory type.
+
+--*/
+
+{
+
+    INT32 Bucket;
+
+    Bucket = rand() % 100;
+    if (Bucket < 50) {
+        return EfiBootServicesData;
+
+    } else if (Bucket < 70) {
+        return EfiLoaderData;
+
+    } else if (Bucket < 80) {
+        return EfiBootServicesCode;
+
+    } else if (Bucket < 90) {
+        return EfiLoaderCode;
+
+    } else if (Bucket < 95) {
+        return EfiRuntimeServicesData;
+    }
+
+    return EfiACPIReclaimMemory;
+}
+
+UINT32
+MemoryTestGetRandomPages (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine picks an allocation size in pages: mostly a few pages, with
+    a tail of larger buffers and images.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of pages to allocate.
+
+--*/
+
+{
+
+    INT32 Bucket;
+
+    Bucket = rand() % 100;
+    if (Bucket < 70) {
+        return 1 + (rand() % 8);
+
+    } else if (Bucket < 95) {
+        return 9 + (rand() % (64 - 8));
+    }
+
+    return 65 + (rand() % (512 - 64));
+}
@@ -0,0 +1,677 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    petest.c
+
+Abstract:
+
+    This module tests PE32+ base relocation. It builds images in memory with
+    random mixes of relocation types, relocates them with the core loader,
+    and checks both the image and the runtime fixup data against a simple
+    per-entry reference walk.
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include "coretest.h"
+#include "imagep.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+#define PE_TEST_PAGE_SIZE 0x1000
+
+//
+// Define the number of random images to relocate and their size in pages.
+//
+
+#define PE_TEST_ITERATIONS 50
+#define PE_TEST_PAGES 16
+
+//
+// Define the benchmark parameters: a 64MB image with a DIR64 relocation in
+// every quadword.
+//
+
+#define PE_BENCHMARK_PAGES (16 * 1024)
+#define PE_BENCHMARK_ITERATIONS 8
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+ULONG
+TestPeRelocation (
+    UINT64 Adjust,
+    BOOLEAN RecordFixups
+    );
+
+UINT8 *
+PeTestCreateImage (
+    UINTN PageCount,
+    BOOLEAN Random,
+    UINTN *ImageSize,
+    UINTN *FixupDataSize
+    );
+
+VOID
+PeTestInitializeContext (
+    PEFI_PE_LOADER_CONTEXT Context,
+    UINT8 *Image,
+    UINTN ImageSize,
+    UINT64 LinkAddress
+    );
+
+VOID
+PeTestReferenceRelocate (
+    UINT8 *Image,
+    UINT64 Adjust,
+    UINT8 *FixupData
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+ULONG
+TestPe (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine tests PE32+ base relocation against a reference walk.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    ULONG Failures;
+    ULONG Iteration;
+
+    Failures = 0;
+    for (Iteration = 0; Iteration < PE_TEST_ITERATIONS; Iteration += 1) {
+        Failures += TestPeRelocation(0x10000000, FALSE);
+        Failures += TestPeRelocation(-0x2345000LL, TRUE);
+
+        //
+        // An image loaded at its link address still has to have its fixup
+        // data recorded, or runtime drivers keep their physical pointers
+        // after SetVirtualAddressMap.
+        //
+
+        Failures += TestPeRelocation(0, TRUE);
+        Failures += TestPeRelocation(0, FALSE);
+    }
+
+    VPRINT("PE relocation: %d failures.\n", Failures);
+    return Failures;
+}
+
+VOID
+BenchmarkPe (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine measures PE32+ relocation throughput with and without
+    runtime fixup data being recorded, against the per-entry reference walk.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    EFI_PE_LOADER_CONTEXT Context;
+    clock_t End;
+    UINT8 *FixupData;
+    UINTN FixupDataSize;
+    double Fixups;
+    UINT8 *Image;
+    UINTN ImageSize;
+    UINTN Iteration;
+    double Rates[3];
+    clock_t Start;
+    RETURN_STATUS Status;
+
+    FixupData = NULL;
+    Image = PeTestCreateImage(PE_BENCHMARK_PAGES,
+                              FALSE,
+                              &ImageSize,
+                              &FixupDataSize);
+
+    if (Image == NULL) {
+        goto BenchmarkPeEnd;
+    }
+
+    FixupData = malloc(FixupDataSize);
+    if (FixupData == NULL) {
+        goto BenchmarkPeEnd;
+    }
+
+    Fixups = (double)(FixupDataSize / sizeof(UINT64)) *
+             PE_BENCHMARK_ITERATIONS;
+
+    Status = RETURN_SUCCESS;
+
+    //
+    // Pretend the image was linked somewhere else each time, so that every
+    // pass has to apply a nonzero adjustment.
+    //
+
+    Start = clock();
+    for (Iteration = 0; Iteration < PE_BENCHMARK_ITERATIONS; Iteration += 1) {
+        PeTestInitializeContext(&Context, Image, ImageSize, 0x400000);
+        Status |= EfiPeLoaderRelocateImage(&Context);
+    }
+
+    End = clock();
+    Rates[0] = Fixups / CoreTestGetSeconds(Start, End) / 1000000.0;
+    Start = clock();
+    for (Iteration = 0; Iteration < PE_BENCHMARK_ITERATIONS; Iteration += 1) {
+        PeTestInitializeContext(&Context, Image, ImageSize, 0x400000);
+        Context.FixupData = FixupData;
+        Context.FixupDataSize = FixupDataSize;
+        Status |= EfiPeLoaderRelocateImage(&Context);
+    }
+
+    End = clock();
+    Rates[1] = Fixups / CoreTestGetSeconds(Start, End) / 1000000.0;
+    Start = clock();
+    for (Iteration = 0; Iteration < PE_BENCHMARK_ITERATIONS; Iteration += 1) {
+        PeTestReferenceRelocate(Image, 0x10000, NULL);
+    }
+
+    End = clock();
+    Rates[2] = Fixups / CoreTestGetSeconds(Start, End) / 1000000.0;
+    if (Status != RETURN_SUCCESS) {
+        printf("Error: Relocation benchmark failed.\n");
+    }
+
+    printf("PE32+ relocation of %ld DIR64 fixups over %ldMB, Mfixups/s:\n"
+           "    Core: %.0f, core recording fixup data: %.0f, "
+           "per-entry reference: %.0f\n",
+           (long)(FixupDataSize / sizeof(UINT64)),
+           (long)(PE_BENCHMARK_PAGES * PE_TEST_PAGE_SIZE / (1024 * 1024)),
+           Rates[0],
+           Rates[1],
+           Rates[2]);
+
+BenchmarkPeEnd:
+    if (Image != NULL) {
+        free(Image);
+    }
+
+    if (FixupData != NULL) {
+        free(FixupData);
+    }
+
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+ULONG
+TestPeRelocation (
+    UINT64 Adjust,
+    BOOLEAN RecordFixups
+    )
+
+/*++
+
+Routine Description:
+
+    This routine relocates a random image by the given amount and compares
+    the results with the reference walk.
+
+Arguments:
+
+    Adjust - Supplies the difference between the load address and the link
+        address.
+
+    RecordFixups - Supplies a boolean indicating whether to record runtime
+        fixup data, as is done for runtime drivers.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    EFI_PE_LOADER_CONTEXT Context;
+    UINT8 *ExpectedFixupData;
+    UINT8 *ExpectedImage;
+    ULONG Failures;
+    UINT8 *FixupData;
+    UINTN FixupDataSize;
+    UINT8 *Image;
+    UINTN ImageSize;
+    UINT64 LinkAddress;
+    RETURN_STATUS Status;
+
+    ExpectedFixupData = NULL;
+    ExpectedImage = NULL;
+    Failures = 1;
+    FixupData = NULL;
+    Image = PeTestCreateImage(PE_TEST_PAGES, TRUE, &ImageSize, &FixupDataSize);
+    if (Image == NULL) {
+        goto TestPeRelocationEnd;
+    }
+
+    ExpectedImage = malloc(ImageSize);
+    ExpectedFixupData = malloc(FixupDataSize);
+    FixupData = malloc(FixupDataSize);
+    if ((ExpectedImage == NULL) || (ExpectedFixupData == NULL) ||
+        (FixupData == NULL)) {
+
+        goto TestPeRelocationEnd;
+    }
+
+    //
+    // Fill the fixup data with junk so that any record the loader fails to
+    // write shows up.
+    //
+
+    memset(FixupData, 0xCC, FixupDataSize);
+    memset(ExpectedFixupData, 0xCC, FixupDataSize);
+    memcpy(ExpectedImage, Image, ImageSize);
+    PeTestReferenceRelocate(ExpectedImage, Adjust, ExpectedFixupData);
+    LinkAddress = (UINTN)Image - Adjust;
+    PeTestInitializeContext(&Context, Image, ImageSize, LinkAddress);
+    if (RecordFixups != FALSE) {
+        Context.FixupData = FixupData;
+        Context.FixupDataSize = FixupDataSize;
+    }
+
+    Status = EfiPeLoaderRelocateImage(&Context);
+    if (Status != RETURN_SUCCESS) {
+        printf("PE: Relocating by 0x%llx failed: 0x%llx.\n",
+               (unsigned long long)Adjust,
+               (unsigned long long)Status);
+
+        goto TestPeRelocationEnd;
+    }
+
+    //
+    // The loader also rewrites the image base in the header, which the
+    // reference walk does not.
+    //
+
+    ((EFI_IMAGE_NT_HEADERS64 *)ExpectedImage)->OptionalHeader.ImageBase =
+                                                                 (UINTN)Image;
+
+    if (memcmp(Image, ExpectedImage, ImageSize) != 0) {
+        printf("PE: Relocating by 0x%llx produced the wrong image.\n",
+               (unsigned long long)Adjust);
+
+        goto TestPeRelocationEnd;
+    }
+
+    if ((RecordFixups != FALSE) &&
+        (memcmp(FixupData, ExpectedFixupData, FixupDataSize) != 0)) {
+
+        printf("PE: Relocating by 0x%llx recorded the wrong fixup data.\n",
+               (unsigned long long)Adjust);
+
+        goto TestPeRelocationEnd;
+    }
+
+    Failures = 0;
+
+TestPeRelocationEnd:
+    if (Image != NULL) {
+        free(Image);
+    }
+
+    if (ExpectedImage != NULL) {
+        free(ExpectedImage);
+    }
+
+    if (ExpectedFixupData != NULL) {
+        free(ExpectedFixupData);
+    }
+
+    if (FixupData != NULL) {
+        free(FixupData);
+    }
+
+    return Failures;
+}
+
+UINT8 *
+PeTestCreateImage (
+    UINTN PageCount,
+    BOOLEAN Random,
+    UINTN *ImageSize,
+    UINTN *FixupDataSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine builds a PE32+ image in memory: a header page, the given
+    number of data pages, and a base relocation directory covering them.
+
+Arguments:
+
+    PageCount - Supplies the number of data pages to create.
+
+    Random - Supplies a boolean indicating whether to fill the pages with a
+        random mix of DIR64, HIGHLOW, and padding relocations. If FALSE,
+        every quadword gets a DIR64 relocation.
+
+    ImageSize - Supplies a pointer where the size of the image is returned.
+
+    FixupDataSize - Supplies a pointer where the number of bytes of runtime
+        fixup data the image needs is returned.
+
+Return Value:
+
+    Returns a pointer to the image, allocated with malloc.
+
+    NULL on allocation failure.
+
+--*/
+
+{
+
+    UINT16 *Entry;
+    UINTN FixupSize;
+    EFI_IMAGE_NT_HEADERS64 *Header;
+    UINT8 *Image;
+    UINTN Index;
+    UINTN Page;
+    UINTN RelocationOffset;
+    UINTN RelocationSize;
+    EFI_IMAGE_BASE_RELOCATION *Block;
+    UINTN Slot;
+    UINTN SlotCount;
+    UINTN Type;
+    UINTN Types[4] = {
+        EFI_IMAGE_REL_BASED_DIR64,
+        EFI_IMAGE_REL_BASED_HIGHLOW,
+        EFI_IMAGE_REL_BASED_ABSOLUTE,
+        EFI_IMAGE_REL_BASED_HIGH
+    };
+
+    //
+    // Each page gets at most two entries per quadword, plus a padding entry
+    // to keep the block a multiple of four bytes.
+    //
+
+    SlotCount = PE_TEST_PAGE_SIZE / sizeof(UINT64);
+    RelocationOffset = (PageCount + 1) * PE_TEST_PAGE_SIZE;
+    RelocationSize = PageCount * (sizeof(EFI_IMAGE_BASE_RELOCATION) +
+                                  ((SlotCount * 2) + 1) * sizeof(UINT16));
+
+    *ImageSize = RelocationOffset + RelocationSize;
+    Image = malloc(*ImageSize);
+    if (Image == NULL) {
+        return NULL;
+    }
+
+    memset(Image, 0, PE_TEST_PAGE_SIZE);
+    for (Index = PE_TEST_PAGE_SIZE; Index < RelocationOffset; Index += 1) {
+        Image[Index] = rand();
+    }
+
+    Header = (EFI_IMAGE_NT_HEADERS64 *)Image;
+    Header->Signature = EFI_IMAGE_NT_SIGNATURE;
+    Header->OptionalHeader.Magic = EFI_IMAGE_NT_OPTIONAL_HDR64_MAGIC;
+    Header->OptionalHeader.NumberOfRvaAndSizes =
+                                         EFI_IMAGE_NUMBER_OF_DIRECTORY_ENTRIES;
+
+    FixupSize = 0;
+    Block = (EFI_IMAGE_BASE_RELOCATION *)(Image + RelocationOffset);
+    for (Page = 0; Page < PageCount; Page += 1) {
+        Block->VirtualAddress = (Page + 1) * PE_TEST_PAGE_SIZE;
+        Entry = (UINT16 *)(Block + 1);
+        for (Slot = 0; Slot < SlotCount; Slot += 1) {
+            //
+            // Leave a quadword without relocations when HIGH comes up, since
+            // 16-bit relocations never appear in PE32+ images.
+            //
+
+            Type = EFI_IMAGE_REL_BASED_DIR64;
+            if (Random != FALSE) {
+                Type = Types[rand() % 4];
+            }
+
+            switch (Type) {
+            case EFI_IMAGE_REL_BASED_DIR64:
+                *Entry = (EFI_IMAGE_REL_BASED_DIR64 << 12) |
+                         (Slot * sizeof(UINT64));
+
+                Entry += 1;
+                FixupSize = ALIGN_RANGE_UP(FixupSize, sizeof(UINT64)) +
+                            sizeof(UINT64);
+
+                break;
+
+            //
+            // Relocate both halves of the quadword as separate HIGHLOW
+            // entries.
+            //
+
+            case EFI_IMAGE_REL_BASED_HIGHLOW:
+                for (Index = 0; Index < 2; Index += 1) {
+                    *Entry = (EFI_IMAGE_REL_BASED_HIGHLOW << 12) |
+                             ((Slot * sizeof(UINT64)) +
+                              (Index * sizeof(UINT32)));
+
+                    Entry += 1;
+                    FixupSize = ALIGN_RANGE_UP(FixupSize, sizeof(UINT32)) +
+                                sizeof(UINT32);
+                }
+
+                break;
+
+            case EFI_IMAGE_REL_BASED_ABSOLUTE:
+                *Entry = EFI_IMAGE_REL_BASED_ABSOLUTE << 12;
+                Entry += 1;
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        if ((((UINT8 *)Entry - (UINT8 *)Block) & 0x3) != 0) {
+            *Entry = EFI_IMAGE_REL_BASED_ABSOLUTE << 12;
+            Entry += 1;
+        }
+
+        Block->SizeOfBlock = (UINT8 *)Entry - (UINT8 *)Block;
+        Block = (EFI_IMAGE_BASE_RELOCATION *)Entry;
+    }
+
+    Header->OptionalHeader.DataDirectory[
+                        EFI_IMAGE_DIRECTORY_ENTRY_BASERELOC].VirtualAddress =
+                                                              RelocationOffset;
+
+    Header->OptionalHeader.DataDirectory[
+                                  EFI_IMAGE_DIRECTORY_ENTRY_BASERELOC].Size =
+                                    (UINT8 *)Block - (Image + RelocationOffset);
+
+    *FixupDataSize = ALIGN_RANGE_UP(FixupSize, sizeof(UINT64));
+    return Image;
+}
+
+VOID
+PeTestInitializeContext (
+    PEFI_PE_LOADER_CONTEXT Context,
+    UINT8 *Image,
+    UINTN ImageSize,
+    UINT64 LinkAddress
+    )
+
+/*++
+
+Routine Description:
+
+    This routine sets up a loader context for relocating an image in place,
+    as if it had been linked at the given address.
+
+Arguments:
+
+    Context - Supplies a pointer to the context to initialize.
+
+    Image - Supplies a pointer to the loaded image.
+
+    ImageSize - Supplies the size of the image in bytes.
+
+    LinkAddress - Supplies the address the image claims to be linked at.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    EFI_IMAGE_NT_HEADERS64 *Header;
+
+    memset(Context, 0, sizeof(EFI_PE_LOADER_CONTEXT));
+    Context->ImageAddress = (UINTN)Image;
+    Context->ImageSize = ImageSize;
+    Header = (EFI_IMAGE_NT_HEADERS64 *)Image;
+    Header->OptionalHeader.ImageBase = LinkAddress;
+    return;
+}
+
+VOID
+PeTestReferenceRelocate (
+    UINT8 *Image,
+    UINT64 Adjust,
+    UINT8 *FixupData
+    )
+
+/*++
+
+Routine Description:
+
+    This routine applies an image's base relocations one entry at a time,
+    the way the loader did before runs of entries were batched.
+
+Arguments:
+
+    Image - Supplies a pointer to the image built by the test.
+
+    Adjust - Supplies the amount to add to each relocated value.
+
+    FixupData - Supplies an optional pointer where the relocated values are
+        recorded in the runtime fixup data format.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    EFI_IMAGE_BASE_RELOCATION *Block;
+    EFI_IMAGE_DATA_DIRECTORY *Directory;
+    UINT16 *Entry;
+    UINT16 *EntryEnd;
+    UINT8 *Fixup;
+    UINTN FixupOffset;
+    EFI_IMAGE_NT_HEADERS64 *Header;
+    UINT8 *RelocationEnd;
+
+    Header = (EFI_IMAGE_NT_HEADERS64 *)Image;
+    Directory = &(Header->OptionalHeader.DataDirectory[
+                                         EFI_IMAGE_DIRECTORY_ENTRY_BASERELOC]);
+
+    Block = (EFI_IMAGE_BASE_RELOCATION *)(Image + Directory->VirtualAddress);
+    RelocationEnd = Image + Directory->VirtualAddress + Directory->Size;
+    FixupOffset = 0;
+    while ((UINT8 *)Block < RelocationEnd) {
+        Entry = (UINT16 *)(Block + 1);
+        EntryEnd = (UINT16 *)((UINT8 *)Block + Block->SizeOfBlock);
+        while (Entry < EntryEnd) {
+            Fixup = Image + Block->VirtualAddress + (*Entry & 0xFFF);
+            switch (*Entry >> 12) {
+            case EFI_IMAGE_REL_BASED_HIGHLOW:
+                *(UINT32 *)Fixup += (UINT32)Adjust;
+                if (FixupData != NULL) {
+                    FixupOffset = ALIGN_RANGE_UP(FixupOffset, sizeof(UINT32));
+                    *(UINT32 *)(FixupData + FixupOffset) = *(UINT32 *)Fixup;
+                    FixupOffset += sizeof(UINT32);
+                }
+
+                break;
+
+            case EFI_IMAGE_REL_BASED_DIR64:
+                *(UINT64 *)Fixup += Adjust;
+                if (FixupData != NULL) {
+                    FixupOffset = ALIGN_RANGE_UP(FixupOffset, sizeof(UINT64));
+                    *(UINT64 *)(FixupData + FixupOffset) = *(UINT64 *)Fixup;
+                    FixupOffset += sizeof(UINT64);
+                }
+
+                break;
+
+            default:
+                break;
+            }
+
+            Entry += 1;
+        }
+
+        Block = (EFI_IMAGE_BASE_RELOCATION *)EntryEnd;
+    }
+
+    return;
+}
+
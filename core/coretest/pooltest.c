@@ -0,0 +1,676 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    pooltest.c
+
+Abstract:
+
+    This module stress tests the core pool allocator. It replays a generated
+    allocation trace shaped like a firmware boot, with mostly small short
+    lived blocks, a tail of large ones, and a live set that grows and shrinks
+    in phases. Every block is filled and checked before it is freed, and the
+    peak page footprint is measured from the memory map.
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include "coretest.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the trace parameters. The live set target swings between zero and
+// the maximum over each phase.
+//
+
+#define POOL_TEST_OPERATIONS 200000
+#define POOL_TEST_MAX_LIVE 4096
+#define POOL_TEST_PHASE_LENGTH 20000
+
+//
+// Define the number of times the benchmark replays the trace.
+//
+
+#define POOL_BENCHMARK_ITERATIONS 10
+
+//
+// Define the alignment UEFI requires of pool allocations.
+//
+
+#define POOL_TEST_ALIGNMENT 8
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+/*++
+
+Structure Description:
+
+    This structure stores one operation in the allocation trace.
+
+Members:
+
+    Slot - Stores the index of the live block slot the operation acts on.
+
+    Size - Stores the size to allocate, or zero to free the slot.
+
+    MemoryType - Stores the memory type to allocate from.
+
+--*/
+
+typedef struct _POOL_TEST_OPERATION {
+    UINT32 Slot;
+    UINT32 Size;
+    EFI_MEMORY_TYPE MemoryType;
+} POOL_TEST_OPERATION, *PPOOL_TEST_OPERATION;
+
+/*++
+
+Structure Description:
+
+    This structure stores the results of replaying a trace.
+
+Members:
+
+    Failures - Stores the number of failures seen.
+
+    PeakLive - Stores the largest number of bytes requested and not yet freed
+        at any point.
+
+    PeakFootprint - Stores the largest number of bytes of pool pages seen in
+        the memory map at any sample.
+
+    RetainedFootprint - Stores the number of bytes of pool pages left in the
+        memory map after everything was freed.
+
+--*/
+
+typedef struct _POOL_TEST_RESULTS {
+    ULONG Failures;
+    UINTN PeakLive;
+    UINTN PeakFootprint;
+    UINTN RetainedFootprint;
+} POOL_TEST_RESULTS, *PPOOL_TEST_RESULTS;
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+PPOOL_TEST_OPERATION
+PoolTestCreateTrace (
+    UINTN Count
+    );
+
+UINT32
+PoolTestGetRandomSize (
+    VOID
+    );
+
+VOID
+PoolTestReplay (
+    PPOOL_TEST_OPERATION Trace,
+    UINTN Count,
+    PPOOL_TEST_RESULTS Results
+    );
+
+UINTN
+PoolTestGetFootprint (
+    VOID
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// Store the live blocks and their sizes, indexed by slot.
+//
+
+VOID *PoolTestBlocks[POOL_TEST_MAX_LIVE];
+UINT32 PoolTestSizes[POOL_TEST_MAX_LIVE];
+
+//
+// Store the memory map buffer used to measure the footprint.
+//
+
+EFI_MEMORY_DESCRIPTOR *PoolTestMap;
+UINTN PoolTestMapSize;
+
+//
+// The memory map key changes whenever the map does. The replay peeks at it
+// to skip measuring the footprint when the pool has not touched the page
+// allocator.
+//
+
+extern UINTN EfiMemoryMapKey;
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+ULONG
+TestPool (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine replays a generated allocation trace through the core pool,
+    checking every block and measuring the page footprint.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    POOL_TEST_RESULTS Results;
+    PPOOL_TEST_OPERATION Trace;
+
+    if (EFI_ERROR(CoreTestInitializeMemory())) {
+        return 1;
+    }
+
+    Trace = PoolTestCreateTrace(POOL_TEST_OPERATIONS);
+    if (Trace == NULL) {
+        return 1;
+    }
+
+    PoolTestReplay(Trace, POOL_TEST_OPERATIONS, &Results);
+    VPRINT("Pool: %d operations, peak live %ldkB, peak footprint %ldkB, "
+           "%ldkB retained after freeing everything.\n",
+           POOL_TEST_OPERATIONS,
+           (long)(Results.PeakLive / 1024),
+           (long)(Results.PeakFootprint / 1024),
+           (long)(Results.RetainedFootprint / 1024));
+
+    VPRINT("Pool: %d failures.\n", Results.Failures);
+    free(Trace);
+    return Results.Failures;
+}
+
+VOID
+BenchmarkPool (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine measures the time the core pool takes per operation when
+    replaying the allocation trace.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    clock_t End;
+    UINTN Index;
+    UINTN Iteration;
+    double Nanoseconds;
+    PPOOL_TEST_OPERATION Operation;
+    POOL_TEST_RESULTS Results;
+    clock_t Start;
+    EFI_STATUS Status;
+    PPOOL_TEST_OPERATION Trace;
+
+    if (EFI_ERROR(CoreTestInitializeMemory())) {
+        return;
+    }
+
+    Trace = PoolTestCreateTrace(POOL_TEST_OPERATIONS);
+    if (Trace == NULL) {
+        return;
+    }
+
+    //
+    // Replay once with checking to warm the pool, then time bare replays.
+    // The footprint is reported by the test, which starts from a fresh
+    // pool; here the baseline already includes whatever earlier replays
+    // left behind.
+    //
+
+    PoolTestReplay(Trace, POOL_TEST_OPERATIONS, &Results);
+    Status = EFI_SUCCESS;
+    Start = clock();
+    for (Iteration = 0;
+         Iteration < POOL_BENCHMARK_ITERATIONS;
+         Iteration += 1) {
+
+        for (Index = 0; Index < POOL_TEST_OPERATIONS; Index += 1) {
+            Operation = &(Trace[Index]);
+            if (Operation->Size != 0) {
+                Status |= EfiCoreAllocatePool(
+                                         Operation->MemoryType,
+                                         Operation->Size,
+                                         &(PoolTestBlocks[Operation->Slot]));
+
+            } else {
+                Status |= EfiCoreFreePool(PoolTestBlocks[Operation->Slot]);
+            }
+        }
+
+        for (Index = 0; Index < POOL_TEST_MAX_LIVE; Index += 1) {
+            if (PoolTestSizes[Index] != 0) {
+                Status |= EfiCoreFreePool(PoolTestBlocks[Index]);
+            }
+        }
+    }
+
+    End = clock();
+    if (Status != EFI_SUCCESS) {
+        printf("Error: Pool benchmark failed.\n");
+    }
+
+    Nanoseconds = CoreTestGetSeconds(Start, End) * 1000000000.0 /
+                  ((double)POOL_TEST_OPERATIONS * POOL_BENCHMARK_ITERATIONS);
+
+    printf("Pool trace of %d operations: %.1fns per operation, peak live "
+           "%ldkB.\n",
+           POOL_TEST_OPERATIONS,
+           Nanoseconds,
+           (long)(Results.PeakLive / 1024));
+
+    free(Trace);
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+PPOOL_TEST_OPERATION
+PoolTestCreateTrace (
+    UINTN Count
+    )
+
+/*++
+
+Routine Description:
+
+    This routine generates an allocation trace. The live set target rises
+    and falls over each phase. Frees usually take the most recent block, as
+    scoped allocations do, and otherwise a random one. Anything still live
+    at the end of the trace is left for the replay to free.
+
+Arguments:
+
+    Count - Supplies the number of operations to generate.
+
+Return Value:
+
+    Returns a pointer to the trace, allocated with malloc.
+
+    NULL on allocation failure.
+
+--*/
+
+{
+
+    UINT32 Free[POOL_TEST_MAX_LIVE];
+    UINTN FreeCount;
+    UINTN Index;
+    UINT32 Live[POOL_TEST_MAX_LIVE];
+    UINTN LiveCount;
+    UINTN Phase;
+    UINTN Pick;
+    UINTN Target;
+    PPOOL_TEST_OPERATION Trace;
+    INT32 Type;
+
+    Trace = malloc(Count * sizeof(POOL_TEST_OPERATION));
+    if (Trace == NULL) {
+        return NULL;
+    }
+
+    LiveCount = 0;
+    for (Index = 0; Index < POOL_TEST_MAX_LIVE; Index += 1) {
+        Free[Index] = POOL_TEST_MAX_LIVE - 1 - Index;
+    }
+
+    FreeCount = POOL_TEST_MAX_LIVE;
+    for (Index = 0; Index < Count; Index += 1) {
+        Phase = Index % POOL_TEST_PHASE_LENGTH;
+        if (Phase < (POOL_TEST_PHASE_LENGTH / 2)) {
+            Target = Phase;
+
+        } else {
+            Target = POOL_TEST_PHASE_LENGTH - Phase;
+        }
+
+        Target = Target * (POOL_TEST_MAX_LIVE - 1) /
+                 (POOL_TEST_PHASE_LENGTH / 2);
+
+        //
+        // Allocate with a bias toward the target live count.
+        //
+
+        if ((LiveCount == 0) ||
+            ((FreeCount != 0) &&
+             ((rand() % 4) < ((LiveCount < Target) ? 3 : 1)))) {
+
+            FreeCount -= 1;
+            Trace[Index].Slot = Free[FreeCount];
+            Trace[Index].Size = PoolTestGetRandomSize();
+            Type = rand() % 100;
+            if (Type < 90) {
+                Trace[Index].MemoryType = EfiBootServicesData;
+
+            } else if (Type < 97) {
+                Trace[Index].MemoryType = EfiRuntimeServicesData;
+
+            } else {
+                Trace[Index].MemoryType = EfiLoaderData;
+            }
+
+            Live[LiveCount] = Trace[Index].Slot;
+            LiveCount += 1;
+
+        } else {
+            Pick = LiveCount - 1;
+            if ((rand() % 10) < 3) {
+                Pick = rand() % LiveCount;
+            }
+
+            Trace[Index].Slot = Live[Pick];
+            Trace[Index].Size = 0;
+            Trace[Index].MemoryType = EfiMaxMemoryType;
+            LiveCount -= 1;
+            Live[Pick] = Live[LiveCount];
+            Free[FreeCount] = Trace[Index].Slot;
+            FreeCount += 1;
+        }
+    }
+
+    return Trace;
+}
+
+UINT32
+PoolTestGetRandomSize (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine picks an allocation size. Most firmware allocations are
+    small structures like handles, protocol entries and events, with a tail
+    of buffers and copied tables.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of bytes to allocate.
+
+--*/
+
+{
+
+    INT32 Bucket;
+
+    Bucket = rand() % 100;
+    if (Bucket < 60) {
+        return 1 + (rand() % 128);
+
+    } else if (Bucket < 85) {
+        return 129 + (rand() % (1024 - 128));
+
+    } else if (Bucket < 95) {
+        return 1025 + (rand() % (4096 - 1024));
+
+    } else if (Bucket < 99) {
+        return 4097 + (rand() % (16384 - 4096));
+    }
+
+    return 16385 + (rand() % (131072 - 16384));
+}
+
+VOID
+PoolTestReplay (
+    PPOOL_TEST_OPERATION Trace,
+    UINTN Count,
+    PPOOL_TEST_RESULTS Results
+    )
+
+/*++
+
+Routine Description:
+
+    This routine replays an allocation trace, filling each block with a
+    pattern and checking it when the block is freed, then frees whatever is
+    still live.
+
+Arguments:
+
+    Trace - Supplies a pointer to the trace.
+
+    Count - Supplies the number of operations in the trace.
+
+    Results - Supplies a pointer where the results are returned.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN Baseline;
+    UINT8 *Bytes;
+    UINTN ByteIndex;
+    UINTN Footprint;
+    UINTN Index;
+    UINTN Live;
+    UINTN MapKey;
+    PPOOL_TEST_OPERATION Operation;
+    UINT8 Pattern;
+    UINT32 Slot;
+    EFI_STATUS Status;
+
+    memset(Results, 0, sizeof(POOL_TEST_RESULTS));
+    memset(PoolTestSizes, 0, sizeof(PoolTestSizes));
+    Baseline = PoolTestGetFootprint();
+    Live = 0;
+    MapKey = EfiMemoryMapKey;
+    for (Index = 0; Index < Count; Index += 1) {
+        Operation = &(Trace[Index]);
+        Slot = Operation->Slot;
+        Pattern = (UINT8)(Slot * 7 + 1);
+        if (Operation->Size != 0) {
+            Status = EfiCoreAllocatePool(Operation->MemoryType,
+                                         Operation->Size,
+                                         &(PoolTestBlocks[Slot]));
+
+            if ((EFI_ERROR(Status)) ||
+                (((UINTN)PoolTestBlocks[Slot] &
+                  (POOL_TEST_ALIGNMENT - 1)) != 0)) {
+
+                printf("Pool: Allocating %d bytes at operation %ld returned "
+                       "0x%llx, %p.\n",
+                       Operation->Size,
+                       (long)Index,
+                       (unsigned long long)Status,
+                       PoolTestBlocks[Slot]);
+
+                Results->Failures += 1;
+                PoolTestSizes[Slot] = 0;
+                continue;
+            }
+
+            PoolTestSizes[Slot] = Operation->Size;
+            memset(PoolTestBlocks[Slot], Pattern, Operation->Size);
+            Live += Operation->Size;
+            if (Live > Results->PeakLive) {
+                Results->PeakLive = Live;
+            }
+
+            //
+            // The footprint only grows when an allocation changes the memory
+            // map, so sampling here catches the exact peak.
+            //
+
+            if (EfiMemoryMapKey != MapKey) {
+                MapKey = EfiMemoryMapKey;
+                Footprint = PoolTestGetFootprint() - Baseline;
+                if (Footprint > Results->PeakFootprint) {
+                    Results->PeakFootprint = Footprint;
+                }
+            }
+
+        } else if (PoolTestSizes[Slot] != 0) {
+            Bytes = PoolTestBlocks[Slot];
+            for (ByteIndex = 0;
+                 ByteIndex < PoolTestSizes[Slot];
+                 ByteIndex += 1) {
+
+                if (Bytes[ByteIndex] != Pattern) {
+                    printf("Pool: Block %p of %d bytes was corrupted at "
+                           "offset %ld.\n",
+                           Bytes,
+                           PoolTestSizes[Slot],
+                           (long)ByteIndex);
+
+                    Results->Failures += 1;
+                    break;
+                }
+            }
+
+            Status = EfiCoreFreePool(Bytes);
+            if (EFI_ERROR(Status)) {
+                printf("Pool: Freeing %p failed: 0x%llx.\n",
+                       Bytes,
+                       (unsigned long long)Status);
+
+                Results->Failures += 1;
+            }
+
+            Live -= PoolTestSizes[Slot];
+            PoolTestSizes[Slot] = 0;
+        }
+    }
+
+    //
+    // Free everything still live. The sizes are left intact for the
+    // benchmark, which reuses them to know what to free.
+    //
+
+    for (Slot = 0; Slot < POOL_TEST_MAX_LIVE; Slot += 1) {
+        if (PoolTestSizes[Slot] != 0) {
+            if (EFI_ERROR(EfiCoreFreePool(PoolTestBlocks[Slot]))) {
+                Results->Failures += 1;
+            }
+        }
+    }
+
+    Results->RetainedFootprint = PoolTestGetFootprint() - Baseline;
+    return;
+}
+
+UINTN
+PoolTestGetFootprint (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the number of bytes of memory currently allocated
+    as one of the memory types the trace uses, according to the memory map.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the footprint in bytes.
+
+--*/
+
+{
+
+    EFI_MEMORY_DESCRIPTOR *Descriptor;
+    UINTN DescriptorSize;
+    UINT32 DescriptorVersion;
+    UINTN Footprint;
+    UINTN MapKey;
+    UINTN MapSize;
+    UINTN Offset;
+    EFI_STATUS Status;
+
+    while (TRUE) {
+        MapSize = PoolTestMapSize;
+        Status = EfiCoreGetMemoryMap(&MapSize,
+                                     PoolTestMap,
+                                     &MapKey,
+                                     &DescriptorSize,
+                                     &DescriptorVersion);
+
+        if (Status != EFI_BUFFER_TOO_SMALL) {
+            break;
+        }
+
+        free(PoolTestMap);
+        PoolTestMapSize = MapSize * 2;
+        PoolTestMap = malloc(PoolTestMapSize);
+        if (PoolTestMap == NULL) {
+            PoolTestMapSize = 0;
+            return 0;
+        }
+    }
+
+    Footprint = 0;
+    for (Offset = 0; Offset < MapSize; Offset += DescriptorSize) {
+        Descriptor = (EFI_MEMORY_DESCRIPTOR *)((UINT8 *)PoolTestMap + Offset);
+        if ((Descriptor->Type == EfiBootServicesData) ||
+            (Descriptor->Type == EfiRuntimeServicesData) ||
+            (Descriptor->Type == EfiLoaderData)) {
+
+            Footprint += EFI_PAGES_TO_SIZE(Descriptor->NumberOfPages);
+        }
+    }
+
+    return Footprint;
+}
+
@@ -0,0 +1,883 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    teststub.c
+
+Abstract:
+
+    This module implements the firmware services the core test links against
+    in place of the platform and the parts of the core that are not under
+    test.
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include "coretest.h"
+#include "fwvolp.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the size of the block of host memory handed to the core as its
+// initial memory map. It is aligned well beyond any alignment the core asks
+// for.
+//
+
+#define CORE_TEST_ARENA_SIZE (64 * 1024 * 1024)
+#define CORE_TEST_ARENA_ALIGNMENT (1024 * 1024)
+
+//
+// Define the width of the fake time counter.
+//
+
+#define CORE_TEST_TIMER_WIDTH 24
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+UINT64
+CoreTestReadTimer (
+    VOID
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// The core routines under test never reach the system table. The boot
+// services table only carries the handful of services the core calls back
+// into through it, and is filled in when memory services start.
+//
+
+EFI_SYSTEM_TABLE *EfiSystemTable;
+EFI_BOOT_SERVICES CoreTestBootServices;
+EFI_BOOT_SERVICES *EfiBootServices = &CoreTestBootServices;
+
+//
+// Store the location of the memory given to the core.
+//
+
+EFI_PHYSICAL_ADDRESS CoreTestArenaBase;
+UINTN CoreTestArenaPages;
+
+//
+// Store the full value of the fake time counter.
+//
+
+UINT64 CoreTestTimeCounter;
+
+//
+// The test has no runtime services, as far as the event services can tell.
+//
+
+EFI_RUNTIME_ARCH_PROTOCOL *EfiRuntimeProtocol;
+
+//
+// The firmware volume code installs no protocols in the test, but still
+// refers to the block protocol GUID.
+//
+
+EFI_GUID EfiFirmwareVolumeBlockProtocolGuid =
+                                       EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL_GUID;
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+EFI_STATUS
+CoreTestInitializeMemory (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine initializes the core memory services on a block of host
+    memory, if that has not been done already. The first page stands in for
+    the firmware image and the second for its stack. As in the real core
+    startup, the event queues are set up first since memory map changes
+    signal an event group.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    EFI status code.
+
+--*/
+
+{
+
+    UINT8 *Arena;
+    static EFI_STATUS Status = EFI_NOT_STARTED;
+
+    if (Status != EFI_NOT_STARTED) {
+        return Status;
+    }
+
+    Arena = malloc(CORE_TEST_ARENA_SIZE + CORE_TEST_ARENA_ALIGNMENT);
+    if (Arena == NULL) {
+        Status = EFI_OUT_OF_RESOURCES;
+        return Status;
+    }
+
+    CoreTestArenaBase = ALIGN_VALUE((UINTN)Arena, CORE_TEST_ARENA_ALIGNMENT);
+    CoreTestArenaPages = EFI_SIZE_TO_PAGES(CORE_TEST_ARENA_SIZE);
+    Arena = (UINT8 *)(UINTN)CoreTestArenaBase;
+    CoreTestBootServices.RaiseTPL = EfiCoreRaiseTpl;
+    CoreTestBootServices.RestoreTPL = EfiCoreRestoreTpl;
+    CoreTestBootServices.AllocatePool = EfiCoreAllocatePool;
+    CoreTestBootServices.FreePool = EfiCoreFreePool;
+    CoreTestBootServices.CreateEvent = EfiCoreCreateEvent;
+    CoreTestBootServices.SignalEvent = EfiCoreSignalEvent;
+    CoreTestBootServices.CloseEvent = EfiCoreCloseEvent;
+    EfiCoreInitializeEventServices(0);
+    Status = EfiCoreInitializeMemoryServices(Arena,
+                                             EFI_PAGE_SIZE,
+                                             Arena + EFI_PAGE_SIZE,
+                                             EFI_PAGE_SIZE);
+
+    if (EFI_ERROR(Status)) {
+        printf("Error: Failed to initialize memory services: 0x%llx.\n",
+               (unsigned long long)Status);
+    }
+
+    return Status;
+}
+
+EFI_STATUS
+EfiPlatformGetInitialMemoryMap (
+    EFI_MEMORY_DESCRIPTOR **Map,
+    UINTN *MapSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the initial platform memory map to the EFI core,
+    which is just the test arena.
+
+Arguments:
+
+    Map - Supplies a pointer where the array of memory descriptors
+        constituting the initial memory map is returned on success.
+
+    MapSize - Supplies a pointer where the number of elements in the initial
+        memory map will be returned on success.
+
+Return Value:
+
+    EFI status code.
+
+--*/
+
+{
+
+    static EFI_MEMORY_DESCRIPTOR Descriptor;
+
+    Descriptor.Type = EfiConventionalMemory;
+    Descriptor.PhysicalStart = CoreTestArenaBase;
+    Descriptor.NumberOfPages = CoreTestArenaPages;
+    Descriptor.Attribute = EFI_MEMORY_WB;
+    *Map = &Descriptor;
+    *MapSize = 1;
+    return EFI_SUCCESS;
+}
+
+VOID
+EfiCoreInitializeLock (
+    PEFI_LOCK Lock,
+    EFI_TPL Tpl
+    )
+
+/*++
+
+Routine Description:
+
+    This routine initializes an EFI lock. The test is single threaded, so
+    beyond raising the TPL the lock just tracks whether it is held.
+
+Arguments:
+
+    Lock - Supplies a pointer to the lock to initialize.
+
+    Tpl - Supplies the TPL the lock would raise to.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    Lock->Tpl = Tpl;
+    Lock->OwnerTpl = TPL_APPLICATION;
+    Lock->State = EfiLockReleased;
+    return;
+}
+
+EFI_STATUS
+EfiCoreAcquireLockOrFail (
+    PEFI_LOCK Lock
+    )
+
+/*++
+
+Routine Description:
+
+    This routine attempts to acquire the given lock.
+
+Arguments:
+
+    Lock - Supplies a pointer to the lock to acquire.
+
+Return Value:
+
+    EFI_SUCCESS if the lock was acquired.
+
+    EFI_ACCESS_DENIED if the lock was already held.
+
+--*/
+
+{
+
+    if (Lock->State == EfiLockAcquired) {
+        return EFI_ACCESS_DENIED;
+    }
+
+    Lock->OwnerTpl = EfiCoreRaiseTpl(Lock->Tpl);
+    Lock->State = EfiLockAcquired;
+    return EFI_SUCCESS;
+}
+
+VOID
+EfiCoreAcquireLock (
+    PEFI_LOCK Lock
+    )
+
+/*++
+
+Routine Description:
+
+    This routine raises to the task priority level of the given lock and
+    acquires it. Since there is only one thread, acquiring a held lock is a
+    bug in the code under test.
+
+Arguments:
+
+    Lock - Supplies a pointer to the lock to acquire.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    if (Lock->State == EfiLockAcquired) {
+        printf("Error: Lock %p acquired recursively.\n", Lock);
+        abort();
+    }
+
+    Lock->OwnerTpl = EfiCoreRaiseTpl(Lock->Tpl);
+    Lock->State = EfiLockAcquired;
+    return;
+}
+
+VOID
+EfiCoreReleaseLock (
+    PEFI_LOCK Lock
+    )
+
+/*++
+
+Routine Description:
+
+    This routine releases the given lock and lowers back down to the
+    original TPL.
+
+Arguments:
+
+    Lock - Supplies a pointer to the lock to release.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    if (Lock->State != EfiLockAcquired) {
+        printf("Error: Lock %p released while not held.\n", Lock);
+        abort();
+    }
+
+    Lock->State = EfiLockReleased;
+    EfiCoreRestoreTpl(Lock->OwnerTpl);
+    return;
+}
+
+BOOLEAN
+EfiCoreIsLockHeld (
+    PEFI_LOCK Lock
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines if the given lock is held.
+
+Arguments:
+
+    Lock - Supplies a pointer to the lock.
+
+Return Value:
+
+    TRUE if the lock is held.
+
+    FALSE if the lock is not held.
+
+--*/
+
+{
+
+    if (Lock->State == EfiLockAcquired) {
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+EFI_STATUS
+EfiPlatformInitializeTimers (
+    UINT32 *ClockTimerInterruptNumber,
+    EFI_PLATFORM_SERVICE_TIMER_INTERRUPT *ClockTimerServiceRoutine,
+    EFI_PLATFORM_READ_TIMER *ReadTimerRoutine,
+    UINT64 *ReadTimerFrequency,
+    UINT32 *ReadTimerWidth
+    )
+
+/*++
+
+Routine Description:
+
+    This routine hands the core a fake time counter and no clock interrupt,
+    so that timers run tickless as they do on coreboot.
+
+Arguments:
+
+    ClockTimerInterruptNumber - Supplies a pointer where the clock timer
+        interrupt number is returned.
+
+    ClockTimerServiceRoutine - Supplies a pointer where a pointer to the clock
+        timer service routine is returned.
+
+    ReadTimerRoutine - Supplies a pointer where a pointer to the routine that
+        reads the time counter is returned.
+
+    ReadTimerFrequency - Supplies a pointer where the frequency of the time
+        counter is returned.
+
+    ReadTimerWidth - Supplies a pointer where the number of bits in the time
+        counter is returned.
+
+Return Value:
+
+    EFI_SUCCESS always.
+
+--*/
+
+{
+
+    *ClockTimerInterruptNumber = 0;
+    *ClockTimerServiceRoutine = NULL;
+    *ReadTimerRoutine = CoreTestReadTimer;
+    *ReadTimerFrequency = CORE_TEST_TIMER_FREQUENCY;
+    *ReadTimerWidth = CORE_TEST_TIMER_WIDTH;
+    return EFI_SUCCESS;
+}
+
+VOID
+EfiPlatformTerminateTimers (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine stands in for terminating platform timer services.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    return;
+}
+
+EFIAPI
+EFI_STATUS
+EfiPlatformSetWatchdogTimer (
+    UINTN Timeout,
+    UINT64 WatchdogCode,
+    UINTN DataSize,
+    CHAR16 *WatchdogData
+    )
+
+/*++
+
+Routine Description:
+
+    This routine stands in for setting the platform watchdog timer.
+
+Arguments:
+
+    Timeout - Supplies the number of seconds to set the timer for.
+
+    WatchdogCode - Supplies a numeric code to log on a watchdog timeout event.
+
+    DataSize - Supplies the size of the watchdog data.
+
+    WatchdogData - Supplies an optional buffer that includes a null-terminated
+        string, optionally followed by additional binary data.
+
+Return Value:
+
+    EFI_UNSUPPORTED always.
+
+--*/
+
+{
+
+    return EFI_UNSUPPORTED;
+}
+
+BOOLEAN
+EfiDisableInterrupts (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine stands in for disabling interrupts. There are none.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    FALSE, indicating interrupts were not previously enabled.
+
+--*/
+
+{
+
+    return FALSE;
+}
+
+VOID
+EfiEnableInterrupts (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine stands in for enabling interrupts.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    return;
+}
+
+BOOLEAN
+EfiAreInterruptsEnabled (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reports that interrupts are disabled.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    FALSE always.
+
+--*/
+
+{
+
+    return FALSE;
+}
+
+EFI_STATUS
+EfipCoreUnregisterProtocolNotify (
+    EFI_EVENT Event
+    )
+
+/*++
+
+Routine Description:
+
+    This routine stands in for removing an event from protocol notify lists.
+    The test registers no protocol notifies.
+
+Arguments:
+
+    Event - Supplies the event being closed.
+
+Return Value:
+
+    EFI_SUCCESS always.
+
+--*/
+
+{
+
+    return EFI_SUCCESS;
+}
+
+UINT32
+EfiCoreHashGuid (
+    EFI_GUID *Guid,
+    UINT32 Mask
+    )
+
+/*++
+
+Routine Description:
+
+    This routine stands in for the GUID hash in the protocol database, which
+    the test does not link. Firmware volumes use it to index file names.
+
+Arguments:
+
+    Guid - Supplies a pointer to the GUID to hash.
+
+    Mask - Supplies the mask to apply to the hash.
+
+Return Value:
+
+    Returns the masked hash of the GUID.
+
+--*/
+
+{
+
+    UINT32 *Words;
+
+    Words = (UINT32 *)Guid;
+    return (Words[0] ^ Words[1] ^ Words[2] ^ Words[3]) & Mask;
+}
+
+EFIAPI
+EFI_STATUS
+EfiCoreHandleProtocol (
+    EFI_HANDLE Handle,
+    EFI_GUID *Protocol,
+    VOID **Interface
+    )
+
+/*++
+
+Routine Description:
+
+    This routine stands in for querying a handle for a protocol. The test has
+    no handles.
+
+Arguments:
+
+    Handle - Supplies the handle being queried.
+
+    Protocol - Supplies the published unique identifier of the protocol.
+
+    Interface - Supplies a pointer where the protocol interface would be
+        returned.
+
+Return Value:
+
+    EFI_UNSUPPORTED always.
+
+--*/
+
+{
+
+    return EFI_UNSUPPORTED;
+}
+
+EFIAPI
+EFI_STATUS
+EfiCoreInstallProtocolInterface (
+    EFI_HANDLE *Handle,
+    EFI_GUID *Protocol,
+    EFI_INTERFACE_TYPE InterfaceType,
+    VOID *Interface
+    )
+
+/*++
+
+Routine Description:
+
+    This routine stands in for installing a protocol interface. The test has
+    no handles.
+
+Arguments:
+
+    Handle - Supplies a pointer to the handle to install the protocol on.
+
+    Protocol - Supplies a pointer to the protocol GUID.
+
+    InterfaceType - Supplies the interface type.
+
+    Interface - Supplies the interface pointer.
+
+Return Value:
+
+    EFI_UNSUPPORTED always.
+
+--*/
+
+{
+
+    return EFI_UNSUPPORTED;
+}
+
+EFIAPI
+EFI_STATUS
+EfiCoreLocateHandle (
+    EFI_LOCATE_SEARCH_TYPE SearchType,
+    EFI_GUID *Protocol,
+    VOID *SearchKey,
+    UINTN *BufferSize,
+    EFI_HANDLE *Buffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine stands in for locating handles. The test has no handles.
+
+Arguments:
+
+    SearchType - Supplies which handle(s) are to be returned.
+
+    Protocol - Supplies an optional pointer to the protocols to search by.
+
+    SearchKey - Supplies an optional pointer to the search key.
+
+    BufferSize - Supplies a pointer to the size of the buffer.
+
+    Buffer - Supplies a pointer where the handles would be returned.
+
+Return Value:
+
+    EFI_NOT_FOUND always.
+
+--*/
+
+{
+
+    return EFI_NOT_FOUND;
+}
+
+EFIAPI
+EFI_STATUS
+EfiFvOpenSectionStream (
+    UINTN SectionStreamLength,
+    VOID *SectionStream,
+    UINTN *SectionStreamHandle
+    )
+
+/*++
+
+Routine Description:
+
+    This routine stands in for opening a section stream. The firmware volume
+    test only enumerates files and never reads their sections.
+
+Arguments:
+
+    SectionStreamLength - Supplies the size in bytes of the section stream.
+
+    SectionStream - Supplies the section stream.
+
+    SectionStreamHandle - Supplies a pointer where a handle to the stream
+        would be returned.
+
+Return Value:
+
+    EFI_UNSUPPORTED always.
+
+--*/
+
+{
+
+    return EFI_UNSUPPORTED;
+}
+
+EFIAPI
+EFI_STATUS
+EfiFvCloseSectionStream (
+    UINTN StreamHandle
+    )
+
+/*++
+
+Routine Description:
+
+    This routine stands in for closing a section stream.
+
+Arguments:
+
+    StreamHandle - Supplies the stream handle.
+
+Return Value:
+
+    EFI_SUCCESS always.
+
+--*/
+
+{
+
+    return EFI_SUCCESS;
+}
+
+EFIAPI
+EFI_STATUS
+EfiFvGetSection (
+    UINTN SectionStreamHandle,
+    EFI_SECTION_TYPE *SectionType,
+    EFI_GUID *SectionDefinitionGuid,
+    UINTN SectionInstance,
+    VOID **Buffer,
+    UINTN *BufferSize,
+    UINT32 *AuthenticationStatus,
+    BOOLEAN IsFfs3Fv
+    )
+
+/*++
+
+Routine Description:
+
+    This routine stands in for reading a section from a section stream.
+
+Arguments:
+
+    SectionStreamHandle - Supplies the stream handle.
+
+    SectionType - Supplies a pointer to the type of section to get.
+
+    SectionDefinitionGuid - Supplies a pointer to the GUID of the section.
+
+    SectionInstance - Supplies the instance of the section to get.
+
+    Buffer - Supplies a pointer where the section would be returned.
+
+    BufferSize - Supplies a pointer to the size of the buffer.
+
+    AuthenticationStatus - Supplies a pointer where the authentication status
+        would be returned.
+
+    IsFfs3Fv - Supplies a boolean indicating if the volume is FFS3.
+
+Return Value:
+
+    EFI_UNSUPPORTED always.
+
+--*/
+
+{
+
+    return EFI_UNSUPPORTED;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+UINT64
+CoreTestReadTimer (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads the fake time counter, returning only the bits the
+    hardware would have.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the low bits of the fake time counter.
+
+--*/
+
+{
+
+    return CoreTestTimeCounter & ((1ULL << CORE_TEST_TIMER_WIDTH) - 1);
+}
@@ -0,0 +1,1128 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    timertest.c
+
+Abstract:
+
+    This module stress tests the core timer queue. It drives ten thousand
+    timer events through a generated trace of set, cancel, close and clock
+    advance operations against a reference model, running tickless off a
+    fake 24-bit ACPI PM timer. Every expiry is checked against the model,
+    and the timer heap ordering is checked periodically.
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include "coretest.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the trace parameters.
+//
+
+#define TIMER_TEST_EVENTS 10000
+#define TIMER_TEST_OPERATIONS 200000
+
+//
+// Define the largest relative due time and period in 100ns units, and the
+// largest clock advance in time counter ticks.
+//
+
+#define TIMER_TEST_MAX_RELATIVE 10000000
+#define TIMER_TEST_MAX_PERIOD 5000000
+#define TIMER_TEST_MAX_ADVANCE 2000
+
+//
+// Define how often the whole heap is checked against the model.
+//
+
+#define TIMER_TEST_HEAP_CHECK_INTERVAL 1000
+
+//
+// Define the number of failures after which the replay gives up.
+//
+
+#define TIMER_TEST_MAX_FAILURES 10
+
+//
+// Define the number of times the benchmark replays the trace.
+//
+
+#define TIMER_BENCHMARK_ITERATIONS 10
+
+//
+// Define the due time the core reports when no timers are queued.
+//
+
+#define TIMER_TEST_NEVER_DUE MAX_UINT64
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+typedef enum _TIMER_TEST_ACTION {
+    TimerTestSetRelative,
+    TimerTestSetPeriodic,
+    TimerTestCancel,
+    TimerTestRecreate,
+    TimerTestAdvance
+} TIMER_TEST_ACTION, *PTIMER_TEST_ACTION;
+
+/*++
+
+Structure Description:
+
+    This structure stores one operation in the timer trace.
+
+Members:
+
+    Action - Stores the operation to perform.
+
+    Slot - Stores the index of the timer event the operation acts on.
+
+    Value - Stores the trigger time in 100ns units for set operations, or the
+        number of time counter ticks to advance the clock by.
+
+--*/
+
+typedef struct _TIMER_TEST_OPERATION {
+    TIMER_TEST_ACTION Action;
+    UINT32 Slot;
+    UINT64 Value;
+} TIMER_TEST_OPERATION, *PTIMER_TEST_OPERATION;
+
+/*++
+
+Structure Description:
+
+    This structure stores the model of one timer event.
+
+Members:
+
+    Armed - Stores a boolean indicating if the timer is queued.
+
+    DueTime - Stores the time counter value at which the timer expires.
+
+    Period - Stores the period in ticks, or zero for a one-shot timer.
+
+--*/
+
+typedef struct _TIMER_TEST_MODEL {
+    BOOLEAN Armed;
+    UINT64 DueTime;
+    UINT64 Period;
+} TIMER_TEST_MODEL, *PTIMER_TEST_MODEL;
+
+/*++
+
+Structure Description:
+
+    This structure pairs an event handle with its slot, so that heap entries
+    can be looked up.
+
+Members:
+
+    Event - Stores the event handle.
+
+    Slot - Stores the index of the event in the test's arrays.
+
+--*/
+
+typedef struct _TIMER_TEST_HANDLE {
+    EFI_EVENT Event;
+    UINT32 Slot;
+} TIMER_TEST_HANDLE, *PTIMER_TEST_HANDLE;
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+EFI_STATUS
+TimerTestPrepare (
+    VOID
+    );
+
+VOID
+TimerTestDestroyEvents (
+    VOID
+    );
+
+PTIMER_TEST_OPERATION
+TimerTestCreateTrace (
+    UINTN Count
+    );
+
+ULONG
+TimerTestReplay (
+    PTIMER_TEST_OPERATION Trace,
+    UINTN Count,
+    BOOLEAN Check
+    );
+
+VOID
+TimerTestArm (
+    UINT32 Slot,
+    UINT64 TriggerTime,
+    BOOLEAN Periodic
+    );
+
+VOID
+TimerTestDisarm (
+    UINT32 Slot
+    );
+
+ULONG
+TimerTestCheckExpiry (
+    VOID
+    );
+
+ULONG
+TimerTestCheckHeap (
+    VOID
+    );
+
+INT
+TimerTestCompareHandles (
+    const VOID *Left,
+    const VOID *Right
+    );
+
+EFIAPI
+VOID
+TimerTestNotify (
+    EFI_EVENT Event,
+    VOID *Context
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// Store the timer events and their models.
+//
+
+EFI_EVENT TimerTestEvents[TIMER_TEST_EVENTS];
+TIMER_TEST_MODEL TimerTestModel[TIMER_TEST_EVENTS];
+UINTN TimerTestArmedCount;
+
+//
+// Store the number of times each event fired since the clock last advanced,
+// and the order they fired in.
+//
+
+UINT32 TimerTestFired[TIMER_TEST_EVENTS];
+UINT32 TimerTestFiredList[TIMER_TEST_EVENTS];
+UINTN TimerTestFiredCount;
+
+//
+// Store the event handles sorted by address, and whether they need sorting
+// again after events were recreated.
+//
+
+TIMER_TEST_HANDLE TimerTestHandles[TIMER_TEST_EVENTS];
+BOOLEAN TimerTestHandlesDirty = TRUE;
+
+//
+// The timer heap lives in event.c. It is an array of event pointers indexed
+// from one, which is all the test looks at.
+//
+
+extern EFI_EVENT *EfiTimerHeap;
+extern UINTN EfiTimerHeapCount;
+extern volatile UINT64 EfiTimerNextDueTime;
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+ULONG
+TestTimer (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine drives the core timer queue through a generated trace,
+    checking every expiry and the heap against a reference model.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    ULONG Failures;
+    PTIMER_TEST_OPERATION Trace;
+
+    if (EFI_ERROR(TimerTestPrepare())) {
+        return 1;
+    }
+
+    Trace = TimerTestCreateTrace(TIMER_TEST_OPERATIONS);
+    if (Trace == NULL) {
+        TimerTestDestroyEvents();
+        return 1;
+    }
+
+    Failures = TimerTestReplay(Trace, TIMER_TEST_OPERATIONS, TRUE);
+    TimerTestDestroyEvents();
+    VPRINT("Timer: %d events, %d operations, %d failures.\n",
+           TIMER_TEST_EVENTS,
+           TIMER_TEST_OPERATIONS,
+           Failures);
+
+    free(Trace);
+    return Failures;
+}
+
+VOID
+BenchmarkTimer (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine measures the time the core timer queue takes per operation
+    when replaying the timer trace.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    clock_t End;
+    ULONG Failures;
+    UINTN Iteration;
+    double Nanoseconds;
+    clock_t Start;
+    PTIMER_TEST_OPERATION Trace;
+
+    if (EFI_ERROR(TimerTestPrepare())) {
+        return;
+    }
+
+    Trace = TimerTestCreateTrace(TIMER_TEST_OPERATIONS);
+    if (Trace == NULL) {
+        TimerTestDestroyEvents();
+        return;
+    }
+
+    Failures = 0;
+    Start = clock();
+    for (Iteration = 0;
+         Iteration < TIMER_BENCHMARK_ITERATIONS;
+         Iteration += 1) {
+
+        Failures += TimerTestReplay(Trace, TIMER_TEST_OPERATIONS, FALSE);
+    }
+
+    End = clock();
+    TimerTestDestroyEvents();
+    if (Failures != 0) {
+        printf("Error: Timer benchmark failed.\n");
+    }
+
+    Nanoseconds = CoreTestGetSeconds(Start, End) * 1000000000.0 /
+                  ((double)TIMER_TEST_OPERATIONS * TIMER_BENCHMARK_ITERATIONS);
+
+    printf("Timer trace of %d operations over %d events: %.1fns per "
+           "operation.\n",
+           TIMER_TEST_OPERATIONS,
+           TIMER_TEST_EVENTS,
+           Nanoseconds);
+
+    free(Trace);
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+EFI_STATUS
+TimerTestPrepare (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates the timer events. The first time through it also
+    finishes initializing event services and starts timer services.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    EFI status code.
+
+--*/
+
+{
+
+    static BOOLEAN Initialized = FALSE;
+    UINT32 Slot;
+    EFI_STATUS Status;
+
+    if (Initialized == FALSE) {
+        Status = CoreTestInitializeMemory();
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+
+        EfiCoreInitializeEventServices(1);
+        Status = EfiCoreInitializeTimerServices();
+        if (EFI_ERROR(Status)) {
+            goto PrepareEnd;
+        }
+
+        Initialized = TRUE;
+    }
+
+    TimerTestHandlesDirty = TRUE;
+    for (Slot = 0; Slot < TIMER_TEST_EVENTS; Slot += 1) {
+        Status = EfiCoreCreateEvent(EVT_TIMER | EVT_NOTIFY_SIGNAL,
+                                    TPL_CALLBACK,
+                                    TimerTestNotify,
+                                    (VOID *)(UINTN)Slot,
+                                    &(TimerTestEvents[Slot]));
+
+        if (EFI_ERROR(Status)) {
+            goto PrepareEnd;
+        }
+    }
+
+PrepareEnd:
+    if (EFI_ERROR(Status)) {
+        printf("Timer: Failed to prepare: 0x%llx.\n",
+               (unsigned long long)Status);
+
+        TimerTestDestroyEvents();
+    }
+
+    return Status;
+}
+
+VOID
+TimerTestDestroyEvents (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine closes the timer events. Memory map changes walk every
+    event looking for group members, so leaving thousands of events around
+    would skew the tests and benchmarks that run afterwards.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINT32 Slot;
+
+    for (Slot = 0; Slot < TIMER_TEST_EVENTS; Slot += 1) {
+        if (TimerTestEvents[Slot] != NULL) {
+            EfiCoreCloseEvent(TimerTestEvents[Slot]);
+            TimerTestEvents[Slot] = NULL;
+        }
+    }
+
+    return;
+}
+
+PTIMER_TEST_OPERATION
+TimerTestCreateTrace (
+    UINTN Count
+    )
+
+/*++
+
+Routine Description:
+
+    This routine generates a timer trace. A few set operations use a zero
+    trigger time, and a few clock advances are zero, to cover the edges.
+
+Arguments:
+
+    Count - Supplies the number of operations to generate.
+
+Return Value:
+
+    Returns a pointer to the trace, allocated with malloc.
+
+    NULL on allocation failure.
+
+--*/
+
+{
+
+    INT32 Bucket;
+    UINTN Index;
+    PTIMER_TEST_OPERATION Trace;
+
+    Trace = malloc(Count * sizeof(TIMER_TEST_OPERATION));
+    if (Trace == NULL) {
+        return NULL;
+    }
+
+    for (Index = 0; Index < Count; Index += 1) {
+        Trace[Index].Slot = rand() % TIMER_TEST_EVENTS;
+        Trace[Index].Value = 0;
+        Bucket = rand() % 100;
+        if (Bucket < 35) {
+            Trace[Index].Action = TimerTestSetRelative;
+            if ((rand() % 20) != 0) {
+                Trace[Index].Value = rand() % TIMER_TEST_MAX_RELATIVE;
+            }
+
+        } else if (Bucket < 50) {
+            Trace[Index].Action = TimerTestSetPeriodic;
+            if ((rand() % 100) != 0) {
+                Trace[Index].Value = rand() % TIMER_TEST_MAX_PERIOD;
+            }
+
+        } else if (Bucket < 65) {
+            Trace[Index].Action = TimerTestCancel;
+
+        } else if (Bucket < 70) {
+            Trace[Index].Action = TimerTestRecreate;
+
+        } else {
+            Trace[Index].Action = TimerTestAdvance;
+            if ((rand() % 10) != 0) {
+                Trace[Index].Value = rand() % TIMER_TEST_MAX_ADVANCE;
+            }
+        }
+    }
+
+    return Trace;
+}
+
+ULONG
+TimerTestReplay (
+    PTIMER_TEST_OPERATION Trace,
+    UINTN Count,
+    BOOLEAN Check
+    )
+
+/*++
+
+Routine Description:
+
+    This routine replays a timer trace, then cancels every timer.
+
+Arguments:
+
+    Trace - Supplies a pointer to the trace.
+
+    Count - Supplies the number of operations in the trace.
+
+    Check - Supplies a boolean indicating whether to check each operation
+        against the model. If this is FALSE only the calls are made.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    ULONG Failures;
+    UINTN Index;
+    PTIMER_TEST_OPERATION Operation;
+    UINT32 Slot;
+    EFI_STATUS Status;
+    UINT64 Time;
+
+    Failures = 0;
+    for (Index = 0; Index < Count; Index += 1) {
+        Operation = &(Trace[Index]);
+        Slot = Operation->Slot;
+        Status = EFI_SUCCESS;
+        switch (Operation->Action) {
+        case TimerTestSetRelative:
+            if (Check != FALSE) {
+                TimerTestArm(Slot, Operation->Value, FALSE);
+            }
+
+            Status = EfiCoreSetTimer(TimerTestEvents[Slot],
+                                     TimerRelative,
+                                     Operation->Value);
+
+            break;
+
+        case TimerTestSetPeriodic:
+            if (Check != FALSE) {
+                TimerTestArm(Slot, Operation->Value, TRUE);
+            }
+
+            Status = EfiCoreSetTimer(TimerTestEvents[Slot],
+                                     TimerPeriodic,
+                                     Operation->Value);
+
+            break;
+
+        case TimerTestCancel:
+            if (Check != FALSE) {
+                TimerTestDisarm(Slot);
+            }
+
+            Status = EfiCoreSetTimer(TimerTestEvents[Slot], TimerCancel, 0);
+            break;
+
+        //
+        // Close the event and create a new one in its place. The new event
+        // may well land at the same address.
+        //
+
+        case TimerTestRecreate:
+            if (Check != FALSE) {
+                TimerTestDisarm(Slot);
+            }
+
+            Status = EfiCoreCloseEvent(TimerTestEvents[Slot]);
+            if (!EFI_ERROR(Status)) {
+                Status = EfiCoreCreateEvent(EVT_TIMER | EVT_NOTIFY_SIGNAL,
+                                            TPL_CALLBACK,
+                                            TimerTestNotify,
+                                            (VOID *)(UINTN)Slot,
+                                            &(TimerTestEvents[Slot]));
+            }
+
+            TimerTestHandlesDirty = TRUE;
+            break;
+
+        //
+        // Move the clock forward and poll the deadline the way CheckEvent
+        // does. Lowering the TPL after the signal runs the notifications
+        // that queues up.
+        //
+
+        case TimerTestAdvance:
+            CoreTestTimeCounter += Operation->Value;
+            Time = EfiCoreReadTimeCounter();
+            if ((Check != FALSE) && (Time != CoreTestTimeCounter)) {
+                printf("Timer: Time counter read 0x%llx, expected 0x%llx.\n",
+                       (unsigned long long)Time,
+                       (unsigned long long)CoreTestTimeCounter);
+
+                Failures += 1;
+            }
+
+            EfiCorePollTimerDeadline();
+            if (Check != FALSE) {
+                Failures += TimerTestCheckExpiry();
+
+            } else {
+                while (TimerTestFiredCount != 0) {
+                    TimerTestFiredCount -= 1;
+                    Slot = TimerTestFiredList[TimerTestFiredCount];
+                    TimerTestFired[Slot] = 0;
+                }
+            }
+
+            break;
+
+        default:
+            break;
+        }
+
+        if (EFI_ERROR(Status)) {
+            printf("Timer: Operation %ld on slot %d failed: 0x%llx.\n",
+                   (long)Index,
+                   Slot,
+                   (unsigned long long)Status);
+
+            Failures += 1;
+        }
+
+        if (Check != FALSE) {
+
+            //
+            // A timer set to expire right away fires before SetTimer
+            // returns, since lowering the TPL runs its notification. Check
+            // it now, along with anything else that fired when it
+            // shouldn't have.
+            //
+
+            if ((TimerTestFiredCount != 0) ||
+                ((TimerTestModel[Slot].Armed != FALSE) &&
+                 (TimerTestModel[Slot].DueTime <= CoreTestTimeCounter))) {
+
+                Failures += TimerTestCheckExpiry();
+            }
+
+            if (EfiTimerHeapCount != TimerTestArmedCount) {
+                printf("Timer: %ld timers queued after operation %ld, "
+                       "expected %ld.\n",
+                       (long)EfiTimerHeapCount,
+                       (long)Index,
+                       (long)TimerTestArmedCount);
+
+                Failures += 1;
+            }
+
+            if (((Index + 1) % TIMER_TEST_HEAP_CHECK_INTERVAL) == 0) {
+                Failures += TimerTestCheckHeap();
+            }
+
+            if (Failures >= TIMER_TEST_MAX_FAILURES) {
+                printf("Timer: Giving up at operation %ld.\n", (long)Index);
+                break;
+            }
+        }
+    }
+
+    //
+    // Cancel everything. The heap should end up empty with nothing due.
+    //
+
+    for (Slot = 0; Slot < TIMER_TEST_EVENTS; Slot += 1) {
+        TimerTestDisarm(Slot);
+        EfiCoreSetTimer(TimerTestEvents[Slot], TimerCancel, 0);
+    }
+
+    if ((EfiTimerHeapCount != 0) ||
+        (EfiTimerNextDueTime != TIMER_TEST_NEVER_DUE)) {
+
+        printf("Timer: %ld timers still queued after cancelling all, next "
+               "due 0x%llx.\n",
+               (long)EfiTimerHeapCount,
+               (unsigned long long)EfiTimerNextDueTime);
+
+        Failures += 1;
+    }
+
+    return Failures;
+}
+
+VOID
+TimerTestArm (
+    UINT32 Slot,
+    UINT64 TriggerTime,
+    BOOLEAN Periodic
+    )
+
+/*++
+
+Routine Description:
+
+    This routine updates the model for a timer being set.
+
+Arguments:
+
+    Slot - Supplies the index of the timer.
+
+    TriggerTime - Supplies the trigger time in 100ns units.
+
+    Periodic - Supplies a boolean indicating if the timer is periodic.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PTIMER_TEST_MODEL Model;
+    UINT64 Ticks;
+
+    Model = &(TimerTestModel[Slot]);
+    if (Model->Armed == FALSE) {
+        Model->Armed = TRUE;
+        TimerTestArmedCount += 1;
+    }
+
+    Ticks = (TriggerTime * CORE_TEST_TIMER_FREQUENCY) / 10000000ULL;
+    Model->DueTime = CoreTestTimeCounter + Ticks;
+    Model->Period = 0;
+    if (Periodic != FALSE) {
+        Model->Period = Ticks;
+        if (Ticks == 0) {
+            Model->Period = 1;
+        }
+    }
+
+    return;
+}
+
+VOID
+TimerTestDisarm (
+    UINT32 Slot
+    )
+
+/*++
+
+Routine Description:
+
+    This routine updates the model for a timer being cancelled.
+
+Arguments:
+
+    Slot - Supplies the index of the timer.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    if (TimerTestModel[Slot].Armed != FALSE) {
+        TimerTestModel[Slot].Armed = FALSE;
+        TimerTestArmedCount -= 1;
+    }
+
+    return;
+}
+
+ULONG
+TimerTestCheckExpiry (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine checks the timers that fired when the clock advanced or a
+    timer was set to expire immediately against the model, then moves the
+    model along. Every timer due at or
+    before the current time must have fired exactly once, in due time order,
+    and nothing else may have fired. Periodic timers that fell behind pick
+    up again one period from now.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    BOOLEAN Due;
+    ULONG Failures;
+    UINTN Index;
+    PTIMER_TEST_MODEL Model;
+    UINT64 NextDueTime;
+    UINT64 Now;
+    UINT32 Slot;
+
+    Failures = 0;
+    Now = CoreTestTimeCounter;
+    for (Slot = 0; Slot < TIMER_TEST_EVENTS; Slot += 1) {
+        Model = &(TimerTestModel[Slot]);
+        Due = FALSE;
+        if ((Model->Armed != FALSE) && (Model->DueTime <= Now)) {
+            Due = TRUE;
+        }
+
+        if (TimerTestFired[Slot] != Due) {
+            printf("Timer: Slot %d fired %d times at 0x%llx, due 0x%llx, "
+                   "armed %d.\n",
+                   Slot,
+                   TimerTestFired[Slot],
+                   (unsigned long long)Now,
+                   (unsigned long long)Model->DueTime,
+                   Model->Armed);
+
+            Failures += 1;
+        }
+    }
+
+    for (Index = 1; Index < TimerTestFiredCount; Index += 1) {
+        if (TimerTestModel[TimerTestFiredList[Index - 1]].DueTime >
+            TimerTestModel[TimerTestFiredList[Index]].DueTime) {
+
+            printf("Timer: Slot %d fired before slot %d but is due later.\n",
+                   TimerTestFiredList[Index - 1],
+                   TimerTestFiredList[Index]);
+
+            Failures += 1;
+            break;
+        }
+    }
+
+    //
+    // Move the fired timers along and work out the next due time.
+    //
+
+    while (TimerTestFiredCount != 0) {
+        TimerTestFiredCount -= 1;
+        Slot = TimerTestFiredList[TimerTestFiredCount];
+        TimerTestFired[Slot] = 0;
+        Model = &(TimerTestModel[Slot]);
+        if ((Model->Armed == FALSE) || (Model->DueTime > Now)) {
+            continue;
+        }
+
+        if (Model->Period != 0) {
+            Model->DueTime += Model->Period;
+            if (Model->DueTime <= Now) {
+                Model->DueTime = Now + Model->Period;
+            }
+
+        } else {
+            TimerTestDisarm(Slot);
+        }
+    }
+
+    NextDueTime = TIMER_TEST_NEVER_DUE;
+    for (Slot = 0; Slot < TIMER_TEST_EVENTS; Slot += 1) {
+        Model = &(TimerTestModel[Slot]);
+        if ((Model->Armed != FALSE) && (Model->DueTime < NextDueTime)) {
+            NextDueTime = Model->DueTime;
+        }
+    }
+
+    if (EfiTimerNextDueTime != NextDueTime) {
+        printf("Timer: Next due time is 0x%llx, expected 0x%llx.\n",
+               (unsigned long long)EfiTimerNextDueTime,
+               (unsigned long long)NextDueTime);
+
+        Failures += 1;
+    }
+
+    return Failures;
+}
+
+ULONG
+TimerTestCheckHeap (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine checks the whole timer heap against the model. Every armed
+    timer must appear exactly once, every parent must be due no later than
+    its children, and the cached next due time must match the root.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    ULONG Failures;
+    PTIMER_TEST_HANDLE Found;
+    static UINT32 HeapSlots[TIMER_TEST_EVENTS + 1];
+    UINTN Index;
+    TIMER_TEST_HANDLE Search;
+    UINT32 Slot;
+
+    if (TimerTestHandlesDirty != FALSE) {
+        for (Slot = 0; Slot < TIMER_TEST_EVENTS; Slot += 1) {
+            TimerTestHandles[Slot].Event = TimerTestEvents[Slot];
+            TimerTestHandles[Slot].Slot = Slot;
+        }
+
+        qsort(TimerTestHandles,
+              TIMER_TEST_EVENTS,
+              sizeof(TIMER_TEST_HANDLE),
+              TimerTestCompareHandles);
+
+        TimerTestHandlesDirty = FALSE;
+    }
+
+    Failures = 0;
+    for (Index = 1; Index <= EfiTimerHeapCount; Index += 1) {
+        Search.Event = EfiTimerHeap[Index];
+        Found = bsearch(&Search,
+                        TimerTestHandles,
+                        TIMER_TEST_EVENTS,
+                        sizeof(TIMER_TEST_HANDLE),
+                        TimerTestCompareHandles);
+
+        if (Found == NULL) {
+            printf("Timer: Heap entry %ld is not a test event.\n",
+                   (long)Index);
+
+            return Failures + 1;
+        }
+
+        Slot = Found->Slot;
+        HeapSlots[Index] = Slot;
+        if ((TimerTestModel[Slot].Armed == FALSE) ||
+            (TimerTestFired[Slot] != 0)) {
+
+            printf("Timer: Slot %d is in the heap twice or not armed.\n",
+                   Slot);
+
+            Failures += 1;
+        }
+
+        TimerTestFired[Slot] = 1;
+        if ((Index > 1) &&
+            (TimerTestModel[HeapSlots[Index / 2]].DueTime >
+             TimerTestModel[Slot].DueTime)) {
+
+            printf("Timer: Heap entry %ld is due before its parent.\n",
+                   (long)Index);
+
+            Failures += 1;
+        }
+    }
+
+    for (Index = 1; Index <= EfiTimerHeapCount; Index += 1) {
+        TimerTestFired[HeapSlots[Index]] = 0;
+    }
+
+    if ((EfiTimerHeapCount != 0) &&
+        (EfiTimerNextDueTime != TimerTestModel[HeapSlots[1]].DueTime)) {
+
+        printf("Timer: Next due time 0x%llx does not match the root.\n",
+               (unsigned long long)EfiTimerNextDueTime);
+
+        Failures += 1;
+    }
+
+    return Failures;
+}
+
+INT
+TimerTestCompareHandles (
+    const VOID *Left,
+    const VOID *Right
+    )
+
+/*++
+
+Routine Description:
+
+    This routine compares two event handles by address, for sorting.
+
+Arguments:
+
+    Left - Supplies a pointer to the left handle.
+
+    Right - Supplies a pointer to the right handle.
+
+Return Value:
+
+    Returns less than zero, zero, or greater than zero as the left event is
+    below, equal to, or above the right one.
+
+--*/
+
+{
+
+    UINTN LeftEvent;
+    UINTN RightEvent;
+
+    LeftEvent = (UINTN)(((PTIMER_TEST_HANDLE)Left)->Event);
+    RightEvent = (UINTN)(((PTIMER_TEST_HANDLE)Right)->Event);
+    if (LeftEvent < RightEvent) {
+        return -1;
+
+    } else if (LeftEvent > RightEvent) {
+        return 1;
+    }
+
+    return 0;
+}
+
+EFIAPI
+VOID
+TimerTestNotify (
+    EFI_EVENT Event,
+    VOID *Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called when a test timer fires. It records the firing.
+
+Arguments:
+
+    Event - Supplies the event that fired.
+
+    Context - Supplies the slot of the timer, cast to a pointer.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINT32 Slot;
+
+    Slot = (UINTN)Context;
+    if ((TimerTestFired[Slot] == 0) &&
+        (TimerTestFiredCount < TIMER_TEST_EVENTS)) {
+
+        TimerTestFiredList[TimerTestFiredCount] = Slot;
+        TimerTestFiredCount += 1;
+    }
+
+    TimerTestFired[Slot] += 1;
+    return;
+}
@@ -0,0 +1,731 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    utiltest.c
+
+Abstract:
+
+    This module tests the core memory copy, set, and compare routines. Every
+    combination of small lengths and alignments is checked against byte
+    loops, including overlapping copies in both directions.
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include "coretest.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the largest length and misalignment checked exhaustively.
+//
+
+#define UTIL_TEST_MAX_LENGTH 300
+#define UTIL_TEST_MAX_OFFSET 16
+
+//
+// Define the size of the scratch buffers, which leaves room for guard bytes on
+// either side of every copy.
+//
+
+#define UTIL_TEST_BUFFER_SIZE \
+    (UTIL_TEST_MAX_LENGTH + (UTIL_TEST_MAX_OFFSET * 4))
+
+//
+// Define the benchmark parameters. Each size is run enough times to move the
+// same total number of bytes.
+//
+
+#define UTIL_BENCHMARK_MIN_SIZE 16
+#define UTIL_BENCHMARK_MAX_SIZE (16 * 1024 * 1024)
+#define UTIL_BENCHMARK_TOTAL_BYTES (256ULL * 1024 * 1024)
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+ULONG
+TestCopyMemory (
+    VOID
+    );
+
+ULONG
+TestSetMemory (
+    VOID
+    );
+
+ULONG
+TestCompareMemory (
+    VOID
+    );
+
+VOID
+UtilTestFill (
+    UINT8 *Buffer,
+    UINTN Size
+    );
+
+VOID
+UtilTestByteCopy (
+    VOID *Destination,
+    VOID *Source,
+    UINTN Length
+    );
+
+VOID
+UtilTestByteSet (
+    VOID *Buffer,
+    UINTN Size,
+    UINT8 Value
+    );
+
+INTN
+UtilTestByteCompare (
+    VOID *FirstBuffer,
+    VOID *SecondBuffer,
+    UINTN Length
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+ULONG
+TestUtil (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine tests the core memory copy, set, and compare routines
+    against simple byte loops.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    ULONG Failures;
+
+    Failures = TestCopyMemory();
+    Failures += TestSetMemory();
+    Failures += TestCompareMemory();
+    return Failures;
+}
+
+VOID
+BenchmarkUtil (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine measures the throughput of the core memory copy, set, and
+    compare routines against byte loops, across a range of buffer sizes.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINT8 *Destination;
+    clock_t End;
+    UINTN Iteration;
+    UINTN Iterations;
+    double Megabytes;
+    double Rates[6];
+    INTN Result;
+    UINTN Size;
+    UINT8 *Source;
+    clock_t Start;
+
+    //
+    // Offset the source by a byte so that the copies are not trivially
+    // aligned with each other.
+    //
+
+    Destination = malloc(UTIL_BENCHMARK_MAX_SIZE);
+    Source = malloc(UTIL_BENCHMARK_MAX_SIZE + 1);
+    if ((Destination == NULL) || (Source == NULL)) {
+        printf("Error: Failed to allocate benchmark buffers.\n");
+        goto BenchmarkUtilEnd;
+    }
+
+    UtilTestFill(Source, UTIL_BENCHMARK_MAX_SIZE + 1);
+    printf("Memory routines in MB/s (core / byte loop):\n"
+           "%10s %19s %19s %19s\n",
+           "Size",
+           "Copy",
+           "Set",
+           "Compare");
+
+    Result = 0;
+    for (Size = UTIL_BENCHMARK_MIN_SIZE;
+         Size <= UTIL_BENCHMARK_MAX_SIZE;
+         Size *= 4) {
+
+        Iterations = UTIL_BENCHMARK_TOTAL_BYTES / Size;
+        Megabytes = (double)Size * Iterations / (1024.0 * 1024.0);
+        Start = clock();
+        for (Iteration = 0; Iteration < Iterations; Iteration += 1) {
+            EfiCoreCopyMemory(Destination, Source + 1, Size);
+        }
+
+        End = clock();
+        Rates[0] = Megabytes / CoreTestGetSeconds(Start, End);
+        Start = clock();
+        for (Iteration = 0; Iteration < Iterations; Iteration += 1) {
+            UtilTestByteCopy(Destination, Source + 1, Size);
+        }
+
+        End = clock();
+        Rates[1] = Megabytes / CoreTestGetSeconds(Start, End);
+        Start = clock();
+        for (Iteration = 0; Iteration < Iterations; Iteration += 1) {
+            EfiCoreSetMemory(Destination, Size, (UINT8)Iteration);
+        }
+
+        End = clock();
+        Rates[2] = Megabytes / CoreTestGetSeconds(Start, End);
+        Start = clock();
+        for (Iteration = 0; Iteration < Iterations; Iteration += 1) {
+            UtilTestByteSet(Destination, Size, (UINT8)Iteration);
+        }
+
+        End = clock();
+        Rates[3] = Megabytes / CoreTestGetSeconds(Start, End);
+
+        //
+        // Compare equal buffers so that the whole length is walked.
+        //
+
+        EfiCoreCopyMemory(Destination, Source + 1, Size);
+        Start = clock();
+        for (Iteration = 0; Iteration < Iterations; Iteration += 1) {
+            Result |= EfiCoreCompareMemory(Destination, Source + 1, Size);
+        }
+
+        End = clock();
+        Rates[4] = Megabytes / CoreTestGetSeconds(Start, End);
+        Start = clock();
+        for (Iteration = 0; Iteration < Iterations; Iteration += 1) {
+            Result |= UtilTestByteCompare(Destination, Source + 1, Size);
+        }
+
+        End = clock();
+        Rates[5] = Megabytes / CoreTestGetSeconds(Start, End);
+        printf("%10ld %9.0f /%8.0f %9.0f /%8.0f %9.0f /%8.0f\n",
+               (long)Size,
+               Rates[0],
+               Rates[1],
+               Rates[2],
+               Rates[3],
+               Rates[4],
+               Rates[5]);
+    }
+
+    if (Result != 0) {
+        printf("Error: Benchmark buffers unexpectedly differed.\n");
+    }
+
+BenchmarkUtilEnd:
+    if (Destination != NULL) {
+        free(Destination);
+    }
+
+    if (Source != NULL) {
+        free(Source);
+    }
+
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+ULONG
+TestCopyMemory (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine tests the core copy routine at every small length and
+    alignment, for separate buffers and for overlapping copies in both
+    directions.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    UINT8 Actual[UTIL_TEST_BUFFER_SIZE];
+    UINTN DestinationOffset;
+    UINT8 Expected[UTIL_TEST_BUFFER_SIZE];
+    ULONG Failures;
+    UINTN Length;
+    UINT8 Original[UTIL_TEST_BUFFER_SIZE];
+    UINT8 Source[UTIL_TEST_BUFFER_SIZE];
+    UINTN SourceOffset;
+
+    Failures = 0;
+    UtilTestFill(Original, sizeof(Original));
+    UtilTestFill(Source, sizeof(Source));
+    for (Length = 0; Length <= UTIL_TEST_MAX_LENGTH; Length += 1) {
+        for (DestinationOffset = 0;
+             DestinationOffset < UTIL_TEST_MAX_OFFSET;
+             DestinationOffset += 1) {
+
+            for (SourceOffset = 0;
+                 SourceOffset < UTIL_TEST_MAX_OFFSET;
+                 SourceOffset += 1) {
+
+                //
+                // Copy between two separate buffers.
+                //
+
+                memcpy(Actual, Original, sizeof(Actual));
+                memcpy(Expected, Original, sizeof(Expected));
+                EfiCoreCopyMemory(Actual + DestinationOffset,
+                                  Source + SourceOffset,
+                                  Length);
+
+                UtilTestByteCopy(Expected + DestinationOffset,
+                                 Source + SourceOffset,
+                                 Length);
+
+                if (memcmp(Actual, Expected, sizeof(Actual)) != 0) {
+                    printf("CopyMemory: Length %ld, destination offset %ld, "
+                           "source offset %ld failed.\n",
+                           (long)Length,
+                           (long)DestinationOffset,
+                           (long)SourceOffset);
+
+                    Failures += 1;
+                }
+
+                //
+                // Copy within one buffer, so that the source and destination
+                // overlap whenever the length exceeds their distance.
+                //
+
+                memcpy(Actual, Original, sizeof(Actual));
+                memcpy(Expected, Original, sizeof(Expected));
+                EfiCoreCopyMemory(Actual + DestinationOffset,
+                                  Actual + SourceOffset,
+                                  Length);
+
+                UtilTestByteCopy(Expected + DestinationOffset,
+                                 Expected + SourceOffset,
+                                 Length);
+
+                if (memcmp(Actual, Expected, sizeof(Actual)) != 0) {
+                    printf("CopyMemory: Overlapping length %ld, destination "
+                           "offset %ld, source offset %ld failed.\n",
+                           (long)Length,
+                           (long)DestinationOffset,
+                           (long)SourceOffset);
+
+                    Failures += 1;
+                }
+            }
+        }
+    }
+
+    VPRINT("CopyMemory: %d failures.\n", Failures);
+    return Failures;
+}
+
+ULONG
+TestSetMemory (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine tests the core set routine at every small length and
+    alignment.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    UINT8 Actual[UTIL_TEST_BUFFER_SIZE];
+    UINT8 Expected[UTIL_TEST_BUFFER_SIZE];
+    ULONG Failures;
+    UINTN Length;
+    UINTN Offset;
+    UINT8 Original[UTIL_TEST_BUFFER_SIZE];
+    UINT8 Value;
+
+    Failures = 0;
+    UtilTestFill(Original, sizeof(Original));
+    for (Length = 0; Length <= UTIL_TEST_MAX_LENGTH; Length += 1) {
+        for (Offset = 0; Offset < UTIL_TEST_MAX_OFFSET; Offset += 1) {
+            Value = rand();
+            memcpy(Actual, Original, sizeof(Actual));
+            memcpy(Expected, Original, sizeof(Expected));
+            EfiCoreSetMemory(Actual + Offset, Length, Value);
+            UtilTestByteSet(Expected + Offset, Length, Value);
+            if (memcmp(Actual, Expected, sizeof(Actual)) != 0) {
+                printf("SetMemory: Length %ld, offset %ld, value 0x%x "
+                       "failed.\n",
+                       (long)Length,
+                       (long)Offset,
+                       Value);
+
+                Failures += 1;
+            }
+        }
+    }
+
+    VPRINT("SetMemory: %d failures.\n", Failures);
+    return Failures;
+}
+
+ULONG
+TestCompareMemory (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine tests the core compare routine at every small length and
+    alignment, for equal buffers and for buffers differing at each position.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    INTN Actual;
+    INTN Expected;
+    ULONG Failures;
+    UINT8 First[UTIL_TEST_BUFFER_SIZE];
+    UINTN FirstOffset;
+    UINTN Length;
+    UINTN Mismatch;
+    UINT8 Second[UTIL_TEST_BUFFER_SIZE];
+    UINTN SecondOffset;
+
+    Failures = 0;
+    UtilTestFill(First, sizeof(First));
+    for (FirstOffset = 0;
+         FirstOffset < UTIL_TEST_MAX_OFFSET;
+         FirstOffset += 1) {
+
+        for (SecondOffset = 0;
+             SecondOffset < UTIL_TEST_MAX_OFFSET;
+             SecondOffset += 1) {
+
+            memcpy(Second + SecondOffset,
+                   First + FirstOffset,
+                   UTIL_TEST_MAX_LENGTH);
+
+            for (Length = 0; Length <= UTIL_TEST_MAX_LENGTH; Length += 1) {
+                Actual = EfiCoreCompareMemory(First + FirstOffset,
+                                              Second + SecondOffset,
+                                              Length);
+
+                if (Actual != 0) {
+                    printf("CompareMemory: Equal length %ld, offsets %ld and "
+                           "%ld returned %ld.\n",
+                           (long)Length,
+                           (long)FirstOffset,
+                           (long)SecondOffset,
+                           (long)Actual);
+
+                    Failures += 1;
+                }
+            }
+
+            //
+            // Change one byte at each position and make sure the difference
+            // is found and reported with the right sign and magnitude.
+            //
+
+            Length = UTIL_TEST_MAX_LENGTH;
+            for (Mismatch = 0; Mismatch < Length; Mismatch += 1) {
+                Second[SecondOffset + Mismatch] += 1 + (rand() % 255);
+                Expected = UtilTestByteCompare(First + FirstOffset,
+                                               Second + SecondOffset,
+                                               Length);
+
+                Actual = EfiCoreCompareMemory(First + FirstOffset,
+                                              Second + SecondOffset,
+                                              Length);
+
+                if ((Actual != Expected) || (Actual == 0)) {
+                    printf("CompareMemory: Mismatch at %ld, offsets %ld and "
+                           "%ld returned %ld, expected %ld.\n",
+                           (long)Mismatch,
+                           (long)FirstOffset,
+                           (long)SecondOffset,
+                           (long)Actual,
+                           (long)Expected);
+
+                    Failures += 1;
+                }
+
+                Second[SecondOffset + Mismatch] =
+                                             First[FirstOffset + Mismatch];
+            }
+        }
+    }
+
+    VPRINT("CompareMemory: %d failures.\n", Failures);
+    return Failures;
+}
+
+VOID
+UtilTestFill (
+    UINT8 *Buffer,
+    UINTN Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine fills a buffer with random bytes.
+
+Arguments:
+
+    Buffer - Supplies a pointer to the buffer to fill.
+
+    Size - Supplies the size of the buffer in bytes.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN Index;
+
+    for (Index = 0; Index < Size; Index += 1) {
+        Buffer[Index] = rand();
+    }
+
+    return;
+}
+
+VOID
+UtilTestByteCopy (
+    VOID *Destination,
+    VOID *Source,
+    UINTN Length
+    )
+
+/*++
+
+Routine Description:
+
+    This routine copies memory one byte at a time, the way the core used to.
+    The accesses are volatile so that the build compiler cannot turn the
+    loop back into a call to its own copy routine. Overlapping copies are
+    handled by picking the direction.
+
+Arguments:
+
+    Destination - Supplies a pointer to the destination of the copy.
+
+    Source - Supplies a pointer to the source of the copy.
+
+    Length - Supplies the number of bytes to copy.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    volatile UINT8 *DestinationBytes;
+    volatile UINT8 *SourceBytes;
+
+    DestinationBytes = Destination;
+    SourceBytes = Source;
+    if ((DestinationBytes > SourceBytes) &&
+        (DestinationBytes < SourceBytes + Length)) {
+
+        while (Length != 0) {
+            Length -= 1;
+            DestinationBytes[Length] = SourceBytes[Length];
+        }
+
+        return;
+    }
+
+    while (Length != 0) {
+        *DestinationBytes = *SourceBytes;
+        DestinationBytes += 1;
+        SourceBytes += 1;
+        Length -= 1;
+    }
+
+    return;
+}
+
+VOID
+UtilTestByteSet (
+    VOID *Buffer,
+    UINTN Size,
+    UINT8 Value
+    )
+
+/*++
+
+Routine Description:
+
+    This routine fills memory one byte at a time.
+
+Arguments:
+
+    Buffer - Supplies a pointer to the buffer to fill.
+
+    Size - Supplies the size of the buffer in bytes.
+
+    Value - Supplies the value to fill the buffer with.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    volatile UINT8 *Bytes;
+    UINTN Index;
+
+    Bytes = Buffer;
+    for (Index = 0; Index < Size; Index += 1) {
+        Bytes[Index] = Value;
+    }
+
+    return;
+}
+
+INTN
+UtilTestByteCompare (
+    VOID *FirstBuffer,
+    VOID *SecondBuffer,
+    UINTN Length
+    )
+
+/*++
+
+Routine Description:
+
+    This routine compares memory one byte at a time.
+
+Arguments:
+
+    FirstBuffer - Supplies a pointer to the first buffer to compare.
+
+    SecondBuffer - Supplies a pointer to the second buffer to compare.
+
+    Length - Supplies the number of bytes to compare.
+
+Return Value:
+
+    0 if the buffers are identical.
+
+    Returns the first mismatched byte as
+    First[MismatchIndex] - Second[MismatchIndex].
+
+--*/
+
+{
+
+    volatile UINT8 *FirstBytes;
+    UINTN Index;
+    volatile UINT8 *SecondBytes;
+
+    FirstBytes = FirstBuffer;
+    SecondBytes = SecondBuffer;
+    for (Index = 0; Index < Length; Index += 1) {
+        if (FirstBytes[Index] != SecondBytes[Index]) {
+            return (INTN)FirstBytes[Index] - (INTN)SecondBytes[Index];
+        }
+    }
+
+    return 0;
+}
+
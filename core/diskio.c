@@ -30,6 +30,7 @@ Environment:
 //
 
 #include "ueficore.h"
+#include <stdio.h>
 #include <minoca/uefi/protocol/diskio.h>
 #include <minoca/uefi/protocol/blockio.h>
 #include <minoca/uefi/protocol/drvbind.h>
@@ -52,12 +53,68 @@ Environment:
 
 #define EFI_DISK_IO_DATA_MAGIC 0x6B736944 // 'ksiD'
 
+//
+// Define the size of the block cache kept for each physical disk, in bytes.
+//
+
+#ifdef CONFIG_DISK_IO_CACHE_SIZE
+
+#define EFI_DISK_IO_CACHE_SIZE (CONFIG_DISK_IO_CACHE_SIZE * 1024)
+
+#else
+
+#define EFI_DISK_IO_CACHE_SIZE 0x80000
+
+#endif
+
+//
+// Define the size of a cache line. Disks with larger block sizes (or block
+// sizes that do not divide this evenly) use a line per block.
+//
+
+#define EFI_DISK_IO_CACHE_LINE_SIZE 0x1000
+
+//
+// Define the largest number of lines filled by a single read, which bounds
+// both the read-ahead window and the size of the staging buffer.
+//
+
+#define EFI_DISK_IO_MAX_FILL_LINES 16
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
 
 /*++
 
+Structure Description:
+
+    This structure stores a single line of the disk I/O block cache.
+
+Members:
+
+    LruListEntry - Stores pointers to the next and previous lines in least
+        recently used order. The most recently used line is at the head.
+
+    HashListEntry - Stores pointers to the next and previous lines in the
+        same hash bucket. The next pointer is NULL if the line holds no data.
+
+    Line - Stores the line number, which is the disk byte offset divided by
+        the line size.
+
+    Data - Stores a pointer to the cached data.
+
+--*/
+
+typedef struct _EFI_DISK_IO_CACHE_LINE {
+    LIST_ENTRY LruListEntry;
+    LIST_ENTRY HashListEntry;
+    UINT64 Line;
+    UINT8 *Data;
+} EFI_DISK_IO_CACHE_LINE, *PEFI_DISK_IO_CACHE_LINE;
+
+/*++
+
 Structure Description:
 
     This structure stores the disk I/O protocol's private context.
@@ -70,12 +127,70 @@ Members:
 
     BlockIo - Stores a pointer to the block I/O protocol.
 
+    ListEntry - Stores pointers to the next and previous cached disk I/O
+        instances.
+
+    CacheAllocation - Stores the single allocation backing the cache lines,
+        hash table, line data, and staging buffer. This is NULL if the
+        instance is not cached.
+
+    Lines - Stores the array of cache lines.
+
+    LineCount - Stores the number of elements in the lines array.
+
+    LineSize - Stores the size of each cache line in bytes.
+
+    MediaId - Stores the media ID the cache contents belong to.
+
+    LruList - Stores the head of the list of cache lines in least recently
+        used order.
+
+    HashTable - Stores the array of hash bucket list heads.
+
+    HashMask - Stores the mask to apply to a line number to get its bucket.
+
+    StagingBuffer - Stores a pointer to the aligned buffer that fills are read
+        into.
+
+    MaxFillLines - Stores the maximum number of lines read in a single fill.
+
+    ReadAheadLines - Stores the current read-ahead window in lines. This
+        doubles for each sequential read and collapses on a seek.
+
+    NextOffset - Stores the byte offset just after the previous read, used to
+        detect sequential access.
+
+    Hits - Stores the number of cache line lookups that found their data.
+
+    Misses - Stores the number of cache line lookups that went to the disk.
+
+    ReadAheadCount - Stores the number of lines read ahead of a request.
+
+    DirectCount - Stores the number of large reads that bypassed the cache.
+
 --*/
 
 typedef struct _EFI_DISK_IO_DATA {
     UINT32 Magic;
     EFI_DISK_IO_PROTOCOL DiskIo;
     EFI_BLOCK_IO_PROTOCOL *BlockIo;
+    LIST_ENTRY ListEntry;
+    VOID *CacheAllocation;
+    PEFI_DISK_IO_CACHE_LINE Lines;
+    UINTN LineCount;
+    UINT32 LineSize;
+    UINT32 MediaId;
+    LIST_ENTRY LruList;
+    LIST_ENTRY *HashTable;
+    UINTN HashMask;
+    UINT8 *StagingBuffer;
+    UINTN MaxFillLines;
+    UINTN ReadAheadLines;
+    UINT64 NextOffset;
+    UINTN Hits;
+    UINTN Misses;
+    UINTN ReadAheadCount;
+    UINTN DirectCount;
 } EFI_DISK_IO_DATA, *PEFI_DISK_IO_DATA;
 
 //
@@ -127,6 +242,71 @@ EfiDiskIoWrite (
     VOID *Buffer
     );
 
+EFI_STATUS
+EfipDiskIoValidateRequest (
+    PEFI_DISK_IO_DATA Instance,
+    UINT32 MediaId,
+    UINT64 Offset,
+    UINTN BufferSize,
+    VOID *Buffer
+    );
+
+EFI_STATUS
+EfipDiskIoReadInternal (
+    PEFI_DISK_IO_DATA Instance,
+    UINT64 Offset,
+    UINTN BufferSize,
+    VOID *Buffer
+    );
+
+EFI_STATUS
+EfipDiskIoReadUncached (
+    PEFI_DISK_IO_DATA Instance,
+    UINT64 Offset,
+    UINTN BufferSize,
+    VOID *Buffer
+    );
+
+EFI_STATUS
+EfipDiskIoReadCached (
+    PEFI_DISK_IO_DATA Instance,
+    UINT64 Offset,
+    UINTN BufferSize,
+    VOID *Buffer
+    );
+
+VOID
+EfipDiskIoInitializeCache (
+    PEFI_DISK_IO_DATA Instance
+    );
+
+VOID
+EfipDiskIoFlushCache (
+    PEFI_DISK_IO_DATA Instance
+    );
+
+PEFI_DISK_IO_CACHE_LINE
+EfipDiskIoLookupCacheLine (
+    PEFI_DISK_IO_DATA Instance,
+    UINT64 Line
+    );
+
+EFI_STATUS
+EfipDiskIoFillCache (
+    PEFI_DISK_IO_DATA Instance,
+    UINT64 Line,
+    UINTN LineCount
+    );
+
+VOID
+EfipDiskIoUpdateCache (
+    PEFI_DISK_IO_DATA Instance,
+    UINT64 Offset,
+    UINTN BufferSize,
+    VOID *Buffer,
+    BOOLEAN Invalidate
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -153,6 +333,12 @@ EFI_DISK_IO_DATA EfiDiskIoDataTemplate = {
 
 EFI_GUID EfiDiskIoProtocolGuid = EFI_DISK_IO_PROTOCOL_GUID;
 
+//
+// Store the list of disk I/O instances that have a block cache.
+//
+
+LIST_ENTRY EfiDiskIoCacheList;
+
 //
 // ------------------------------------------------------------------ Functions
 //
@@ -186,6 +372,7 @@ Return Value:
 
     EFI_STATUS Status;
 
+    INITIALIZE_LIST_HEAD(&EfiDiskIoCacheList);
     EfiDiskIoDriverBinding.ImageHandle = ImageHandle;
     EfiDiskIoDriverBinding.DriverBindingHandle = ImageHandle;
     Status = EfiInstallMultipleProtocolInterfaces(
@@ -197,6 +384,52 @@ Return Value:
     return Status;
 }
 
+VOID
+EfiDiskIoDumpStatistics (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine prints the block cache hit and miss counts for each disk.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PLIST_ENTRY CurrentEntry;
+    UINTN Index;
+    PEFI_DISK_IO_DATA Instance;
+
+    Index = 0;
+    CurrentEntry = EfiDiskIoCacheList.Next;
+    while (CurrentEntry != &EfiDiskIoCacheList) {
+        Instance = LIST_VALUE(CurrentEntry, EFI_DISK_IO_DATA, ListEntry);
+        CurrentEntry = CurrentEntry->Next;
+        printf("Disk %d cache: %d hits, %d misses, %d lines read ahead, "
+               "%d direct reads.\n",
+               Index,
+               Instance->Hits,
+               Instance->Misses,
+               Instance->ReadAheadCount,
+               Instance->DirectCount);
+
+        Index += 1;
+    }
+
+    return;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -327,6 +560,7 @@ Return Value:
     }
 
     EfiCopyMem(Instance, &EfiDiskIoDataTemplate, sizeof(EFI_DISK_IO_DATA));
+    EfipDiskIoInitializeCache(Instance);
     Status = EfiInstallMultipleProtocolInterfaces(&ControllerHandle,
                                                   &EfiDiskIoProtocolGuid,
                                                   &(Instance->DiskIo),
@@ -336,9 +570,17 @@ Return Value:
         goto DiskIoStartEnd;
     }
 
+    if (Instance->CacheAllocation != NULL) {
+        INSERT_BEFORE(&(Instance->ListEntry), &EfiDiskIoCacheList);
+    }
+
 DiskIoStartEnd:
     if (EFI_ERROR(Status)) {
         if (Instance != NULL) {
+            if (Instance->CacheAllocation != NULL) {
+                EfiFreePool(Instance->CacheAllocation);
+            }
+
             EfiFreePool(Instance);
         }
 
@@ -427,12 +669,18 @@ Return Value:
 
         ASSERT(!EFI_ERROR(Status));
 
+        if (Instance->CacheAllocation != NULL) {
+            LIST_REMOVE(&(Instance->ListEntry));
+            EfiFreePool(Instance->CacheAllocation);
+        }
+
         EfiFreePool(Instance);
     }
 
     return Status;
 }
 
+
 EFIAPI
 EFI_STATUS
 EfiDiskIoRead (
@@ -479,93 +727,24 @@ Return Value:
 
 {
 
-    EFI_BLOCK_IO_PROTOCOL *BlockIo;
-    EFI_LBA BlockOffset;
-    UINTN BlockOffsetRemainder;
-    UINT32 BlockSize;
-    VOID *BounceBuffer;
-    VOID *BounceBufferAllocation;
-    UINTN BounceBufferSize;
     PEFI_DISK_IO_DATA Instance;
-    UINT32 IoAlign;
-    UINTN IoSize;
     EFI_STATUS Status;
 
     Instance = EFI_DISK_IO_DATA_FROM_THIS(This);
 
     ASSERT(Instance->Magic == EFI_DISK_IO_DATA_MAGIC);
 
-    BlockIo = Instance->BlockIo;
-    if (BlockIo->Media->MediaPresent == FALSE) {
-        return EFI_NO_MEDIA;
-    }
-
-    if (BufferSize == 0) {
-        return EFI_INVALID_PARAMETER;
-    }
-
-    ASSERT(BufferSize != 0);
-
-    //
-    // Pass it down directly if it all lines up.
-    //
-
-    BlockSize = BlockIo->Media->BlockSize;
-    IoAlign = BlockIo->Media->IoAlign;
-    if (((Offset % BlockSize) == 0) &&
-        ((IoAlign == 0) || (((UINTN)Buffer % IoAlign) == 0))) {
-
-        Status = BlockIo->ReadBlocks(BlockIo,
-                                     BlockIo->Media->MediaId,
-                                     Offset / BlockSize,
-                                     BufferSize,
-                                     Buffer);
+    Status = EfipDiskIoValidateRequest(Instance,
+                                       MediaId,
+                                       Offset,
+                                       BufferSize,
+                                       Buffer);
 
+    if (EFI_ERROR(Status)) {
         return Status;
     }
 
-    //
-    // Allocate a bounce buffer for the read. The I/O size must be a multiple
-    // of the block size. The buffer must be aligned, so allocate enough
-    // space to scoot it up by the alignment.
-    //
-
-    BlockOffset = Offset / BlockSize;
-    BlockOffsetRemainder = Offset - (Offset * BlockSize);
-    IoSize = (BufferSize + BlockOffsetRemainder + (BlockSize - 1)) / BlockSize;
-    BounceBufferSize = IoSize + IoAlign;
-    BounceBufferAllocation = EfiCoreAllocateBootPool(BounceBufferSize);
-    if (BounceBufferAllocation == NULL) {
-        return EFI_OUT_OF_RESOURCES;
-    }
-
-    BounceBuffer = ALIGN_POINTER(BounceBufferAllocation, IoAlign);
-
-    //
-    // Perform the read.
-    //
-
-    Status = BlockIo->ReadBlocks(BlockIo,
-                                 BlockIo->Media->MediaId,
-                                 BlockOffset,
-                                 IoSize,
-                                 BounceBuffer);
-
-    //
-    // If nothing went wrong, copy the result in to the final buffer.
-    //
-
-    if (!EFI_ERROR(Status)) {
-        EfiCopyMem(Buffer, BounceBuffer + BlockOffsetRemainder, BufferSize);
-
-    } else {
-        EfiDebugPrint("IO Read Error block 0x%I64x Size %x: %x\n",
-                      BlockOffset,
-                      IoSize,
-                      Status);
-    }
-
-    EfiFreePool(BounceBufferAllocation);
+    Status = EfipDiskIoReadInternal(Instance, Offset, BufferSize, Buffer);
     return Status;
 }
 
@@ -633,16 +812,20 @@ Return Value:
 
     ASSERT(Instance->Magic == EFI_DISK_IO_DATA_MAGIC);
 
-    BlockIo = Instance->BlockIo;
-    if (BlockIo->Media->MediaPresent == FALSE) {
-        return STATUS_NO_MEDIA;
-    }
+    Status = EfipDiskIoValidateRequest(Instance,
+                                       MediaId,
+                                       Offset,
+                                       BufferSize,
+                                       Buffer);
 
-    if (BufferSize == 0) {
-        return EFI_INVALID_PARAMETER;
+    if (EFI_ERROR(Status)) {
+        return Status;
     }
 
-    ASSERT(BufferSize != 0);
+    BlockIo = Instance->BlockIo;
+    if (BlockIo->Media->ReadOnly != FALSE) {
+        return EFI_WRITE_PROTECTED;
+    }
 
     //
     // Pass it down directly if it all lines up.
@@ -651,7 +834,8 @@ Return Value:
     BlockSize = BlockIo->Media->BlockSize;
     IoAlign = BlockIo->Media->IoAlign;
     if (((Offset % BlockSize) == 0) &&
-        ((IoAlign == 0) || (((UINTN)Buffer % IoAlign) == 0))) {
+        ((BufferSize % BlockSize) == 0) &&
+        ((IoAlign <= 1) || (((UINTN)Buffer % IoAlign) == 0))) {
 
         Status = BlockIo->WriteBlocks(BlockIo,
                                       BlockIo->Media->MediaId,
@@ -659,6 +843,12 @@ Return Value:
                                       BufferSize,
                                       Buffer);
 
+        EfipDiskIoUpdateCache(Instance,
+                              Offset,
+                              BufferSize,
+                              Buffer,
+                              EFI_ERROR(Status));
+
         return Status;
     }
 
@@ -669,29 +859,44 @@ Return Value:
     //
 
     BlockOffset = Offset / BlockSize;
-    BlockOffsetRemainder = Offset - (Offset * BlockSize);
-    IoSize = (BufferSize + BlockOffsetRemainder + (BlockSize - 1)) / BlockSize;
+    BlockOffsetRemainder = Offset % BlockSize;
+    IoSize = ALIGN_VALUE(BufferSize + BlockOffsetRemainder, BlockSize);
     BounceBufferSize = IoSize + IoAlign;
     BounceBufferAllocation = EfiCoreAllocateBootPool(BounceBufferSize);
     if (BounceBufferAllocation == NULL) {
         return EFI_OUT_OF_RESOURCES;
     }
 
-    BounceBuffer = ALIGN_POINTER(BounceBufferAllocation, IoAlign);
+    BounceBuffer = BounceBufferAllocation;
+    if (IoAlign > 1) {
+        BounceBuffer = ALIGN_POINTER(BounceBufferAllocation, IoAlign);
+    }
 
     //
-    // Perform the read to get the original block data.
+    // Read in the original contents of the partial first and last blocks.
+    // Every block in between is about to be completely overwritten. These
+    // reads are usually satisfied by the cache.
     //
 
-    Status = BlockIo->ReadBlocks(BlockIo,
-                                 BlockIo->Media->MediaId,
-                                 BlockOffset,
-                                 IoSize,
-                                 BounceBuffer);
+    Status = EFI_SUCCESS;
+    if (BlockOffsetRemainder != 0) {
+        Status = EfipDiskIoReadInternal(Instance,
+                                        BlockOffset * BlockSize,
+                                        BlockSize,
+                                        BounceBuffer);
+    }
 
-    //
-    // If nothing went wrong, copy the result in to the final buffer.
-    //
+    if ((!EFI_ERROR(Status)) &&
+        (((BlockOffsetRemainder + BufferSize) % BlockSize) != 0) &&
+        ((BlockOffsetRemainder == 0) || (IoSize > BlockSize))) {
+
+        Status = EfipDiskIoReadInternal(
+                                    Instance,
+                                    (BlockOffset * BlockSize) + IoSize -
+                                    BlockSize,
+                                    BlockSize,
+                                    BounceBuffer + IoSize - BlockSize);
+    }
 
     if (EFI_ERROR(Status)) {
         EfiDebugPrint("IO Read Error block 0x%I64x Size %x: %x\n",
@@ -718,6 +923,12 @@ Return Value:
                                   IoSize,
                                   BounceBuffer);
 
+    EfipDiskIoUpdateCache(Instance,
+                          BlockOffset * BlockSize,
+                          IoSize,
+                          BounceBuffer,
+                          EFI_ERROR(Status));
+
     if (EFI_ERROR(Status)) {
         EfiDebugPrint("IO Write Error block 0x%I64x Size %x: %x\n",
                       BlockOffset,
@@ -732,3 +943,765 @@ DiskIoWriteEnd:
     return Status;
 }
 
+EFI_STATUS
+EfipDiskIoValidateRequest (
+    PEFI_DISK_IO_DATA Instance,
+    UINT32 MediaId,
+    UINT64 Offset,
+    UINTN BufferSize,
+    VOID *Buffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine validates the parameters of a disk I/O request against the
+    current media. If the media has changed since the cache was filled, the
+    cache is flushed.
+
+Arguments:
+
+    Instance - Supplies a pointer to the disk I/O instance.
+
+    MediaId - Supplies the media ID the caller believes is present.
+
+    Offset - Supplies the starting byte offset of the request.
+
+    BufferSize - Supplies the size of the request in bytes.
+
+    Buffer - Supplies the caller's buffer.
+
+Return Value:
+
+    EFI_SUCCESS if the request can be performed.
+
+    EFI_NO_MEDIA if there is no media in the device.
+
+    EFI_MEDIA_CHANGED if the current media ID doesn't match the one passed in.
+
+    EFI_INVALID_PARAMETER if the buffer or range is invalid.
+
+--*/
+
+{
+
+    EFI_BLOCK_IO_MEDIA *Media;
+    UINT64 MediaSize;
+
+    Media = Instance->BlockIo->Media;
+    if (Instance->MediaId != Media->MediaId) {
+        EfipDiskIoFlushCache(Instance);
+        Instance->MediaId = Media->MediaId;
+    }
+
+    if (Media->MediaPresent == FALSE) {
+        return EFI_NO_MEDIA;
+    }
+
+    if (MediaId != Media->MediaId) {
+        return EFI_MEDIA_CHANGED;
+    }
+
+    if ((BufferSize == 0) || (Buffer == NULL)) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    MediaSize = (Media->LastBlock + 1) * Media->BlockSize;
+    if ((Offset >= MediaSize) || (MediaSize - Offset < BufferSize)) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    return EFI_SUCCESS;
+}
+
+EFI_STATUS
+EfipDiskIoReadInternal (
+    PEFI_DISK_IO_DATA Instance,
+    UINT64 Offset,
+    UINTN BufferSize,
+    VOID *Buffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads validated bytes from the disk, going through the block
+    cache if the instance has one. Large aligned reads skip the cache so they
+    do not evict everything in it.
+
+Arguments:
+
+    Instance - Supplies a pointer to the disk I/O instance.
+
+    Offset - Supplies the starting byte offset to read from.
+
+    BufferSize - Supplies the number of bytes to read.
+
+    Buffer - Supplies a pointer where the read data will be returned.
+
+Return Value:
+
+    EFI status code.
+
+--*/
+
+{
+
+    UINT32 BlockSize;
+
+    BlockSize = Instance->BlockIo->Media->BlockSize;
+    if ((Instance->CacheAllocation == NULL) ||
+        ((Instance->LineSize % BlockSize) != 0)) {
+
+        return EfipDiskIoReadUncached(Instance, Offset, BufferSize, Buffer);
+    }
+
+    if ((BufferSize >= Instance->MaxFillLines * Instance->LineSize) &&
+        ((Offset % BlockSize) == 0) &&
+        ((BufferSize % BlockSize) == 0)) {
+
+        Instance->DirectCount += 1;
+        Instance->NextOffset = Offset + BufferSize;
+        return EfipDiskIoReadUncached(Instance, Offset, BufferSize, Buffer);
+    }
+
+    return EfipDiskIoReadCached(Instance, Offset, BufferSize, Buffer);
+}
+
+EFI_STATUS
+EfipDiskIoReadUncached (
+    PEFI_DISK_IO_DATA Instance,
+    UINT64 Offset,
+    UINTN BufferSize,
+    VOID *Buffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads bytes directly from the block device, using a bounce
+    buffer if the request is not block aligned.
+
+Arguments:
+
+    Instance - Supplies a pointer to the disk I/O instance.
+
+    Offset - Supplies the starting byte offset to read from.
+
+    BufferSize - Supplies the number of bytes to read.
+
+    Buffer - Supplies a pointer where the read data will be returned.
+
+Return Value:
+
+    EFI status code.
+
+--*/
+
+{
+
+    EFI_BLOCK_IO_PROTOCOL *BlockIo;
+    EFI_LBA BlockOffset;
+    UINTN BlockOffsetRemainder;
+    UINT32 BlockSize;
+    VOID *BounceBuffer;
+    VOID *BounceBufferAllocation;
+    UINTN BounceBufferSize;
+    UINT32 IoAlign;
+    UINTN IoSize;
+    EFI_STATUS Status;
+
+    //
+    // Pass it down directly if it all lines up.
+    //
+
+    BlockIo = Instance->BlockIo;
+    BlockSize = BlockIo->Media->BlockSize;
+    IoAlign = BlockIo->Media->IoAlign;
+    if (((Offset % BlockSize) == 0) &&
+        ((BufferSize % BlockSize) == 0) &&
+        ((IoAlign <= 1) || (((UINTN)Buffer % IoAlign) == 0))) {
+
+        Status = BlockIo->ReadBlocks(BlockIo,
+                                     BlockIo->Media->MediaId,
+                                     Offset / BlockSize,
+                                     BufferSize,
+                                     Buffer);
+
+        return Status;
+    }
+
+    //
+    // Allocate a bounce buffer for the read. The I/O size must be a multiple
+    // of the block size. The buffer must be aligned, so allocate enough
+    // space to scoot it up by the alignment.
+    //
+
+    BlockOffset = Offset / BlockSize;
+    BlockOffsetRemainder = Offset % BlockSize;
+    IoSize = ALIGN_VALUE(BufferSize + BlockOffsetRemainder, BlockSize);
+    BounceBufferSize = IoSize + IoAlign;
+    BounceBufferAllocation = EfiCoreAllocateBootPool(BounceBufferSize);
+    if (BounceBufferAllocation == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    BounceBuffer = BounceBufferAllocation;
+    if (IoAlign > 1) {
+        BounceBuffer = ALIGN_POINTER(BounceBufferAllocation, IoAlign);
+    }
+
+    //
+    // Perform the read.
+    //
+
+    Status = BlockIo->ReadBlocks(BlockIo,
+                                 BlockIo->Media->MediaId,
+                                 BlockOffset,
+                                 IoSize,
+                                 BounceBuffer);
+
+    //
+    // If nothing went wrong, copy the result in to the final buffer.
+    //
+
+    if (!EFI_ERROR(Status)) {
+        EfiCopyMem(Buffer, BounceBuffer + BlockOffsetRemainder, BufferSize);
+
+    } else {
+        EfiDebugPrint("IO Read Error block 0x%I64x Size %x: %x\n",
+                      BlockOffset,
+                      IoSize,
+                      Status);
+    }
+
+    EfiFreePool(BounceBufferAllocation);
+    return Status;
+}
+
+EFI_STATUS
+EfipDiskIoReadCached (
+    PEFI_DISK_IO_DATA Instance,
+    UINT64 Offset,
+    UINTN BufferSize,
+    VOID *Buffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads bytes through the block cache, filling any missing
+    lines from the disk. Reads that pick up where the previous one left off
+    grow the read-ahead window.
+
+Arguments:
+
+    Instance - Supplies a pointer to the disk I/O instance.
+
+    Offset - Supplies the starting byte offset to read from.
+
+    BufferSize - Supplies the number of bytes to read.
+
+    Buffer - Supplies a pointer where the read data will be returned.
+
+Return Value:
+
+    EFI status code.
+
+--*/
+
+{
+
+    PEFI_DISK_IO_CACHE_LINE CacheLine;
+    UINTN CopySize;
+    UINT8 *CurrentBuffer;
+    UINT64 LastLine;
+    UINT64 Line;
+    UINTN LineOffset;
+    UINTN LineSize;
+    EFI_STATUS Status;
+
+    //
+    // Grow the read-ahead window if this read is sequential, or drop it if
+    // this is a seek.
+    //
+
+    if (Offset == Instance->NextOffset) {
+        if (Instance->ReadAheadLines == 0) {
+            Instance->ReadAheadLines = 1;
+
+        } else if (Instance->ReadAheadLines * 2 <= Instance->MaxFillLines) {
+            Instance->ReadAheadLines *= 2;
+        }
+
+    } else {
+        Instance->ReadAheadLines = 0;
+    }
+
+    Instance->NextOffset = Offset + BufferSize;
+    LineSize = Instance->LineSize;
+    Line = Offset / LineSize;
+    LastLine = (Offset + BufferSize - 1) / LineSize;
+    LineOffset = Offset % LineSize;
+    CurrentBuffer = Buffer;
+    while (Line <= LastLine) {
+        CacheLine = EfipDiskIoLookupCacheLine(Instance, Line);
+        if (CacheLine == NULL) {
+            Instance->Misses += 1;
+            Status = EfipDiskIoFillCache(
+                               Instance,
+                               Line,
+                               LastLine - Line + 1 + Instance->ReadAheadLines);
+
+            if (EFI_ERROR(Status)) {
+                return Status;
+            }
+
+            CacheLine = EfipDiskIoLookupCacheLine(Instance, Line);
+
+            ASSERT(CacheLine != NULL);
+
+        } else {
+            Instance->Hits += 1;
+        }
+
+        //
+        // Mark the line as most recently used and copy out of it.
+        //
+
+        LIST_REMOVE(&(CacheLine->LruListEntry));
+        INSERT_AFTER(&(CacheLine->LruListEntry), &(Instance->LruList));
+        CopySize = LineSize - LineOffset;
+        if (CopySize > BufferSize) {
+            CopySize = BufferSize;
+        }
+
+        EfiCopyMem(CurrentBuffer, CacheLine->Data + LineOffset, CopySize);
+        CurrentBuffer += CopySize;
+        BufferSize -= CopySize;
+        LineOffset = 0;
+        Line += 1;
+    }
+
+    ASSERT(BufferSize == 0);
+
+    return EFI_SUCCESS;
+}
+
+VOID
+EfipDiskIoInitializeCache (
+    PEFI_DISK_IO_DATA Instance
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates and initializes the block cache for a disk I/O
+    instance. Logical partitions are not cached, since their reads already
+    go through the disk I/O instance of the parent disk. Failure to allocate
+    the cache is not fatal; the instance simply runs uncached.
+
+Arguments:
+
+    Instance - Supplies a pointer to the disk I/O instance.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN AllocationSize;
+    UINT32 BlockSize;
+    UINT8 *Data;
+    UINTN HashSize;
+    UINTN Index;
+    UINT32 IoAlign;
+    UINTN LineCount;
+    UINT32 LineSize;
+    EFI_BLOCK_IO_MEDIA *Media;
+
+    Media = Instance->BlockIo->Media;
+    Instance->MediaId = Media->MediaId;
+    Instance->NextOffset = MAX_UINT64;
+    if ((EFI_DISK_IO_CACHE_SIZE == 0) || (Media->LogicalPartition != FALSE)) {
+        return;
+    }
+
+    BlockSize = Media->BlockSize;
+    LineSize = EFI_DISK_IO_CACHE_LINE_SIZE;
+    if ((BlockSize == 0) || (BlockSize > LineSize) ||
+        ((LineSize % BlockSize) != 0)) {
+
+        LineSize = BlockSize;
+    }
+
+    if (LineSize == 0) {
+        return;
+    }
+
+    LineCount = EFI_DISK_IO_CACHE_SIZE / LineSize;
+    if (LineCount < EFI_DISK_IO_MAX_FILL_LINES * 2) {
+        LineCount = EFI_DISK_IO_MAX_FILL_LINES * 2;
+    }
+
+    HashSize = 1;
+    while (HashSize < LineCount) {
+        HashSize <<= 1;
+    }
+
+    //
+    // Carve the line array, hash table, line data, and staging buffer out of
+    // a single allocation. Keep the data aligned for the device.
+    //
+
+    IoAlign = Media->IoAlign;
+    if (IoAlign < sizeof(UINTN)) {
+        IoAlign = sizeof(UINTN);
+    }
+
+    AllocationSize = (LineCount * sizeof(EFI_DISK_IO_CACHE_LINE)) +
+                     (HashSize * sizeof(LIST_ENTRY)) +
+                     IoAlign +
+                     ((LineCount + EFI_DISK_IO_MAX_FILL_LINES) * LineSize);
+
+    Instance->CacheAllocation = EfiCoreAllocateBootPool(AllocationSize);
+    if (Instance->CacheAllocation == NULL) {
+        return;
+    }
+
+    Instance->Lines = Instance->CacheAllocation;
+    Instance->LineCount = LineCount;
+    Instance->LineSize = LineSize;
+    Instance->HashTable = (LIST_ENTRY *)(Instance->Lines + LineCount);
+    Instance->HashMask = HashSize - 1;
+    Instance->MaxFillLines = EFI_DISK_IO_MAX_FILL_LINES;
+    INITIALIZE_LIST_HEAD(&(Instance->LruList));
+    for (Index = 0; Index < HashSize; Index += 1) {
+        INITIALIZE_LIST_HEAD(&(Instance->HashTable[Index]));
+    }
+
+    Data = ALIGN_POINTER(Instance->HashTable + HashSize, IoAlign);
+    Instance->StagingBuffer = Data;
+    Data += EFI_DISK_IO_MAX_FILL_LINES * LineSize;
+    for (Index = 0; Index < LineCount; Index += 1) {
+        Instance->Lines[Index].HashListEntry.Next = NULL;
+        Instance->Lines[Index].Line = 0;
+        Instance->Lines[Index].Data = Data;
+        INSERT_BEFORE(&(Instance->Lines[Index].LruListEntry),
+                      &(Instance->LruList));
+
+        Data += LineSize;
+    }
+
+    return;
+}
+
+VOID
+EfipDiskIoFlushCache (
+    PEFI_DISK_IO_DATA Instance
+    )
+
+/*++
+
+Routine Description:
+
+    This routine discards the contents of the block cache, usually because
+    the media was changed.
+
+Arguments:
+
+    Instance - Supplies a pointer to the disk I/O instance.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PEFI_DISK_IO_CACHE_LINE CacheLine;
+    UINTN Index;
+
+    for (Index = 0; Index < Instance->LineCount; Index += 1) {
+        CacheLine = &(Instance->Lines[Index]);
+        if (CacheLine->HashListEntry.Next != NULL) {
+            LIST_REMOVE(&(CacheLine->HashListEntry));
+            CacheLine->HashListEntry.Next = NULL;
+        }
+    }
+
+    Instance->ReadAheadLines = 0;
+    Instance->NextOffset = MAX_UINT64;
+    return;
+}
+
+PEFI_DISK_IO_CACHE_LINE
+EfipDiskIoLookupCacheLine (
+    PEFI_DISK_IO_DATA Instance,
+    UINT64 Line
+    )
+
+/*++
+
+Routine Description:
+
+    This routine finds a line in the block cache.
+
+Arguments:
+
+    Instance - Supplies a pointer to the disk I/O instance.
+
+    Line - Supplies the line number to find.
+
+Return Value:
+
+    Returns a pointer to the cache line on success.
+
+    NULL if the line is not cached.
+
+--*/
+
+{
+
+    PEFI_DISK_IO_CACHE_LINE CacheLine;
+    PLIST_ENTRY CurrentEntry;
+    PLIST_ENTRY Head;
+
+    Head = &(Instance->HashTable[Line & Instance->HashMask]);
+    CurrentEntry = Head->Next;
+    while (CurrentEntry != Head) {
+        CacheLine = LIST_VALUE(CurrentEntry,
+                               EFI_DISK_IO_CACHE_LINE,
+                               HashListEntry);
+
+        if (CacheLine->Line == Line) {
+            return CacheLine;
+        }
+
+        CurrentEntry = CurrentEntry->Next;
+    }
+
+    return NULL;
+}
+
+EFI_STATUS
+EfipDiskIoFillCache (
+    PEFI_DISK_IO_DATA Instance,
+    UINT64 Line,
+    UINTN LineCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads a run of lines from the disk into the block cache,
+    evicting the least recently used lines. The run is cut short at the end
+    of the media and at the first line that is already cached.
+
+Arguments:
+
+    Instance - Supplies a pointer to the disk I/O instance.
+
+    Line - Supplies the first line to read. This line must not be cached.
+
+    LineCount - Supplies the desired number of lines to read.
+
+Return Value:
+
+    EFI status code.
+
+--*/
+
+{
+
+    EFI_BLOCK_IO_PROTOCOL *BlockIo;
+    UINT64 BlockCount;
+    UINT64 BlockOffset;
+    UINT32 BlockSize;
+    PEFI_DISK_IO_CACHE_LINE CacheLine;
+    UINTN CopySize;
+    UINT8 *Data;
+    UINT64 EndBlock;
+    UINTN Index;
+    UINTN LineBlocks;
+    UINTN ReadSize;
+    EFI_STATUS Status;
+
+    BlockIo = Instance->BlockIo;
+    BlockSize = BlockIo->Media->BlockSize;
+    LineBlocks = Instance->LineSize / BlockSize;
+    EndBlock = BlockIo->Media->LastBlock + 1;
+    BlockOffset = Line * LineBlocks;
+
+    ASSERT(BlockOffset < EndBlock);
+
+    if (LineCount > Instance->MaxFillLines) {
+        LineCount = Instance->MaxFillLines;
+    }
+
+    if (LineCount > (EndBlock - BlockOffset + LineBlocks - 1) / LineBlocks) {
+        LineCount = (EndBlock - BlockOffset + LineBlocks - 1) / LineBlocks;
+    }
+
+    for (Index = 1; Index < LineCount; Index += 1) {
+        if (EfipDiskIoLookupCacheLine(Instance, Line + Index) != NULL) {
+            LineCount = Index;
+            break;
+        }
+    }
+
+    BlockCount = LineCount * LineBlocks;
+    if (BlockCount > EndBlock - BlockOffset) {
+        BlockCount = EndBlock - BlockOffset;
+    }
+
+    ReadSize = BlockCount * BlockSize;
+    Status = BlockIo->ReadBlocks(BlockIo,
+                                 BlockIo->Media->MediaId,
+                                 BlockOffset,
+                                 ReadSize,
+                                 Instance->StagingBuffer);
+
+    if (EFI_ERROR(Status)) {
+        EfiDebugPrint("IO Read Error block 0x%I64x Size %x: %x\n",
+                      BlockOffset,
+                      ReadSize,
+                      Status);
+
+        return Status;
+    }
+
+    //
+    // Recycle the least recently used lines to hold the new data. The last
+    // line may be partial if the media ends partway through it, but nothing
+    // beyond the media is ever read back out.
+    //
+
+    Data = Instance->StagingBuffer;
+    for (Index = 0; Index < LineCount; Index += 1) {
+        CacheLine = LIST_VALUE(Instance->LruList.Previous,
+                               EFI_DISK_IO_CACHE_LINE,
+                               LruListEntry);
+
+        LIST_REMOVE(&(CacheLine->LruListEntry));
+        INSERT_AFTER(&(CacheLine->LruListEntry), &(Instance->LruList));
+        if (CacheLine->HashListEntry.Next != NULL) {
+            LIST_REMOVE(&(CacheLine->HashListEntry));
+        }
+
+        CacheLine->Line = Line + Index;
+        INSERT_AFTER(&(CacheLine->HashListEntry),
+                     &(Instance->HashTable[CacheLine->Line &
+                                           Instance->HashMask]));
+
+        CopySize = Instance->LineSize;
+        if (CopySize > ReadSize) {
+            CopySize = ReadSize;
+        }
+
+        EfiCopyMem(CacheLine->Data, Data, CopySize);
+        Data += CopySize;
+        ReadSize -= CopySize;
+    }
+
+    Instance->ReadAheadCount += LineCount - 1;
+    return EFI_SUCCESS;
+}
+
+VOID
+EfipDiskIoUpdateCache (
+    PEFI_DISK_IO_DATA Instance,
+    UINT64 Offset,
+    UINTN BufferSize,
+    VOID *Buffer,
+    BOOLEAN Invalidate
+    )
+
+/*++
+
+Routine Description:
+
+    This routine keeps the block cache coherent with a write that has been
+    sent to the disk. Cached lines covering the written range are updated
+    with the new data, or dropped if the write failed and the disk contents
+    are unknown.
+
+Arguments:
+
+    Instance - Supplies a pointer to the disk I/O instance.
+
+    Offset - Supplies the byte offset that was written.
+
+    BufferSize - Supplies the number of bytes written.
+
+    Buffer - Supplies the data that was written.
+
+    Invalidate - Supplies a boolean indicating whether to drop the affected
+        lines rather than update them.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PEFI_DISK_IO_CACHE_LINE CacheLine;
+    UINTN CopySize;
+    UINT8 *CurrentBuffer;
+    UINT64 LastLine;
+    UINT64 Line;
+    UINTN LineOffset;
+    UINTN LineSize;
+
+    if ((Instance->CacheAllocation == NULL) || (BufferSize == 0)) {
+        return;
+    }
+
+    LineSize = Instance->LineSize;
+    Line = Offset / LineSize;
+    LastLine = (Offset + BufferSize - 1) / LineSize;
+    LineOffset = Offset % LineSize;
+    CurrentBuffer = Buffer;
+    while (Line <= LastLine) {
+        CopySize = LineSize - LineOffset;
+        if (CopySize > BufferSize) {
+            CopySize = BufferSize;
+        }
+
+        CacheLine = EfipDiskIoLookupCacheLine(Instance, Line);
+        if (CacheLine != NULL) {
+            if (Invalidate != FALSE) {
+                LIST_REMOVE(&(CacheLine->HashListEntry));
+                CacheLine->HashListEntry.Next = NULL;
+                LIST_REMOVE(&(CacheLine->LruListEntry));
+                INSERT_BEFORE(&(CacheLine->LruListEntry),
+                              &(Instance->LruList));
+
+            } else {
+                EfiCopyMem(CacheLine->Data + LineOffset,
+                           CurrentBuffer,
+                           CopySize);
+            }
+        }
+
+        CurrentBuffer += CopySize;
+        BufferSize -= CopySize;
+        LineOffset = 0;
+        Line += 1;
+    }
+
+    return;
+}
+
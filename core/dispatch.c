@@ -39,6 +39,19 @@ Environment:
 
 #define EFI_CORE_DRIVER_ENTRY_MAGIC 0x76697244 // 'virD'
 
+//
+// Define the number of buckets in the table of drivers waiting on protocols.
+// This must be a power of two.
+//
+
+#define EFI_DEPEX_WAIT_BUCKET_COUNT 64
+
+//
+// Define the maximum depth of the dependency expression evaluation stack.
+//
+
+#define EFI_DEPEX_STACK_SIZE 64
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -49,20 +62,39 @@ typedef struct _EFI_KNOWN_HANDLE {
     EFI_GUID NameGuid;
 } EFI_KNOWN_HANDLE, *PEFI_KNOWN_HANDLE;
 
+typedef struct _EFI_CORE_DEPEX_WAIT {
+    LIST_ENTRY ListEntry;
+    struct _EFI_CORE_DRIVER_ENTRY *Driver;
+    EFI_GUID Protocol;
+} EFI_CORE_DEPEX_WAIT, *PEFI_CORE_DEPEX_WAIT;
+
 typedef struct _EFI_CORE_DRIVER_ENTRY {
     UINTN Magic;
     LIST_ENTRY DriverListEntry;
     LIST_ENTRY SchedulerListEntry;
+    LIST_ENTRY BeforeList;
+    LIST_ENTRY AfterList;
+    LIST_ENTRY BeforeAfterListEntry;
     EFI_HANDLE VolumeHandle;
     EFI_GUID FileName;
     EFI_DEVICE_PATH_PROTOCOL *FileDevicePath;
     EFI_FIRMWARE_VOLUME2_PROTOCOL *Volume;
     EFI_HANDLE ImageHandle;
+    VOID *ImageBuffer;
+    UINTN ImageBufferSize;
+    UINT8 *Depex;
+    UINTN DepexSize;
+    EFI_GUID BeforeAfterGuid;
+    PEFI_CORE_DEPEX_WAIT Waits;
+    UINTN WaitCapacity;
+    UINTN WaitCount;
     BOOLEAN IsFirmwareVolumeImage;
     BOOLEAN Untrusted;
     BOOLEAN Initialized;
     BOOLEAN Scheduled;
     BOOLEAN Dependent;
+    BOOLEAN Before;
+    BOOLEAN After;
 } EFI_CORE_DRIVER_ENTRY, *PEFI_CORE_DRIVER_ENTRY;
 
 typedef struct _EFI_FIRMWARE_VOLUME_FILE_DEVICE_PATH {
@@ -111,6 +143,36 @@ EfipCoreInsertOnScheduledQueue (
     PEFI_CORE_DRIVER_ENTRY DriverEntry
     );
 
+VOID
+EfipCoreReadScheduledImages (
+    VOID
+    );
+
+EFI_STATUS
+EfipCorePreprocessDependency (
+    PEFI_CORE_DRIVER_ENTRY DriverEntry
+    );
+
+BOOLEAN
+EfipCoreEvaluateDependency (
+    PEFI_CORE_DRIVER_ENTRY DriverEntry
+    );
+
+VOID
+EfipCoreWaitForProtocols (
+    PEFI_CORE_DRIVER_ENTRY DriverEntry
+    );
+
+VOID
+EfipCoreWakeDriver (
+    PEFI_CORE_DRIVER_ENTRY DriverEntry
+    );
+
+BOOLEAN
+EfipCoreAttachBeforeAfterDriver (
+    PEFI_CORE_DRIVER_ENTRY DriverEntry
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -141,6 +203,30 @@ EFI_LOCK EfiDispatcherLock;
 LIST_ENTRY EfiDiscoveredList;
 LIST_ENTRY EfiScheduledQueue;
 
+//
+// Store the queue of drivers whose dependency expressions need to be
+// evaluated, either because they are new or because a protocol they were
+// waiting on was installed.
+//
+
+LIST_ENTRY EfiDependentQueue;
+
+//
+// Store the queue of drivers ordered before or after a driver that hasn't
+// been discovered yet.
+//
+
+LIST_ENTRY EfiBeforeAfterQueue;
+
+//
+// Store the drivers waiting on protocols, hashed by protocol GUID. The
+// generation is bumped on every protocol installation.
+//
+
+LIST_ENTRY EfiDepexWaitBuckets[EFI_DEPEX_WAIT_BUCKET_COUNT];
+UINTN EfiDispatcherProtocolGeneration;
+
+BOOLEAN EfiDispatcherInitialized;
 BOOLEAN EfiDispatcherRunning;
 
 //
@@ -170,10 +256,19 @@ Return Value:
 
 {
 
+    UINTN Index;
+
     INITIALIZE_LIST_HEAD(&EfiFirmwareVolumeList);
     INITIALIZE_LIST_HEAD(&EfiDiscoveredList);
     INITIALIZE_LIST_HEAD(&EfiScheduledQueue);
+    INITIALIZE_LIST_HEAD(&EfiDependentQueue);
+    INITIALIZE_LIST_HEAD(&EfiBeforeAfterQueue);
+    for (Index = 0; Index < EFI_DEPEX_WAIT_BUCKET_COUNT; Index += 1) {
+        INITIALIZE_LIST_HEAD(&(EfiDepexWaitBuckets[Index]));
+    }
+
     EfiCoreInitializeLock(&EfiDispatcherLock, TPL_HIGH_LEVEL);
+    EfiDispatcherInitialized = TRUE;
     EfiFirmwareVolumeEvent = EfiCoreCreateProtocolNotifyEvent(
                                          &EfiFirmwareVolume2ProtocolGuid,
                                          TPL_CALLBACK,
@@ -217,6 +312,7 @@ Return Value:
 
     PLIST_ENTRY CurrentEntry;
     PEFI_CORE_DRIVER_ENTRY DriverEntry;
+    UINTN Generation;
     BOOLEAN ReadyToRun;
     EFI_STATUS ReturnStatus;
     EFI_STATUS Status;
@@ -229,6 +325,13 @@ Return Value:
     ReturnStatus = EFI_NOT_FOUND;
     do {
 
+        //
+        // Pull every scheduled image out of its firmware volume in one pass
+        // before starting any of them.
+        //
+
+        EfipCoreReadScheduledImages();
+
         //
         // Drain the scheduled queue.
         //
@@ -250,10 +353,16 @@ Return Value:
                 Status = EfiCoreLoadImage(FALSE,
                                           EfiFirmwareImageHandle,
                                           DriverEntry->FileDevicePath,
-                                          NULL,
-                                          0,
+                                          DriverEntry->ImageBuffer,
+                                          DriverEntry->ImageBufferSize,
                                           &(DriverEntry->ImageHandle));
 
+                if (DriverEntry->ImageBuffer != NULL) {
+                    EfiCoreFreePool(DriverEntry->ImageBuffer);
+                    DriverEntry->ImageBuffer = NULL;
+                    DriverEntry->ImageBufferSize = 0;
+                }
+
                 if (EFI_ERROR(Status)) {
                     printf("Warning: Driver failed load with status "
                                   "0x%x.\n",
@@ -302,23 +411,71 @@ Return Value:
             ReturnStatus = EFI_SUCCESS;
         }
 
+        ReadyToRun = FALSE;
+
         //
-        // Search the discovered list for items to place on the scheduled
-        // queue.
+        // Hook up any drivers ordered before or after another driver whose
+        // target has shown up since the last pass.
         //
 
-        ReadyToRun = FALSE;
-        CurrentEntry = EfiDiscoveredList.Next;
-        while (CurrentEntry != &EfiDiscoveredList) {
+        CurrentEntry = EfiBeforeAfterQueue.Next;
+        while (CurrentEntry != &EfiBeforeAfterQueue) {
             DriverEntry = LIST_VALUE(CurrentEntry,
                                      EFI_CORE_DRIVER_ENTRY,
-                                     DriverListEntry);
+                                     SchedulerListEntry);
 
             CurrentEntry = CurrentEntry->Next;
-            if (DriverEntry->Dependent != FALSE) {
+            if (EfipCoreAttachBeforeAfterDriver(DriverEntry) != FALSE) {
+                ReadyToRun = TRUE;
+            }
+        }
+
+        //
+        // Evaluate the dependencies of every driver that is new or has had a
+        // protocol it was waiting on installed. Drivers that still can't run
+        // go back to waiting on whichever of their protocols are missing, so
+        // only an installation of one of those will look at them again.
+        //
+
+        while (TRUE) {
+            EfiCoreAcquireLock(&EfiDispatcherLock);
+            if (LIST_EMPTY(&EfiDependentQueue) != FALSE) {
+                EfiCoreReleaseLock(&EfiDispatcherLock);
+                break;
+            }
+
+            DriverEntry = LIST_VALUE(EfiDependentQueue.Next,
+                                     EFI_CORE_DRIVER_ENTRY,
+                                     SchedulerListEntry);
+
+            LIST_REMOVE(&(DriverEntry->SchedulerListEntry));
+            Generation = EfiDispatcherProtocolGeneration;
+            EfiCoreReleaseLock(&EfiDispatcherLock);
+
+            ASSERT(DriverEntry->Magic == EFI_CORE_DRIVER_ENTRY_MAGIC);
+
+            if (EfipCoreEvaluateDependency(DriverEntry) != FALSE) {
                 EfipCoreInsertOnScheduledQueue(DriverEntry);
                 ReadyToRun = TRUE;
+                continue;
             }
+
+            //
+            // If a protocol was installed while the expression was being
+            // evaluated, it may have been one this driver needs. Look at it
+            // again rather than risk missing the wakeup.
+            //
+
+            EfiCoreAcquireLock(&EfiDispatcherLock);
+            if (Generation != EfiDispatcherProtocolGeneration) {
+                INSERT_BEFORE(&(DriverEntry->SchedulerListEntry),
+                              &EfiDependentQueue);
+
+            } else {
+                EfipCoreWaitForProtocols(DriverEntry);
+            }
+
+            EfiCoreReleaseLock(&EfiDispatcherLock);
         }
 
     } while (ReadyToRun != FALSE);
@@ -327,6 +484,65 @@ Return Value:
     return ReturnStatus;
 }
 
+VOID
+EfiCoreDispatcherProtocolInstalled (
+    EFI_GUID *Protocol
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called when a protocol interface is installed. It moves
+    any drivers waiting on that protocol back to the dependent queue so their
+    dependency expressions are evaluated again on the next dispatch pass.
+
+Arguments:
+
+    Protocol - Supplies a pointer to the GUID of the installed protocol.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PLIST_ENTRY Bucket;
+    UINT32 BucketIndex;
+    PLIST_ENTRY CurrentEntry;
+    PEFI_CORE_DEPEX_WAIT Wait;
+
+    if (EfiDispatcherInitialized == FALSE) {
+        return;
+    }
+
+    BucketIndex = EfiCoreHashGuid(Protocol, EFI_DEPEX_WAIT_BUCKET_COUNT - 1);
+    Bucket = &(EfiDepexWaitBuckets[BucketIndex]);
+    EfiCoreAcquireLock(&EfiDispatcherLock);
+    EfiDispatcherProtocolGeneration += 1;
+    CurrentEntry = Bucket->Next;
+    while (CurrentEntry != Bucket) {
+        Wait = LIST_VALUE(CurrentEntry, EFI_CORE_DEPEX_WAIT, ListEntry);
+        if (EfiCoreCompareGuids(&(Wait->Protocol), Protocol) == FALSE) {
+            CurrentEntry = CurrentEntry->Next;
+            continue;
+        }
+
+        //
+        // Waking the driver pulls all of its waits, possibly including the
+        // next one in this bucket, so start the bucket over.
+        //
+
+        EfipCoreWakeDriver(Wait->Driver);
+        CurrentEntry = Bucket->Next;
+    }
+
+    EfiCoreReleaseLock(&EfiDispatcherLock);
+    return;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -680,6 +896,7 @@ Return Value:
 {
 
     EFI_CORE_DRIVER_ENTRY *DriverEntry;
+    EFI_STATUS Status;
 
     DriverEntry = EfiCoreAllocateBootPool(sizeof(EFI_CORE_DRIVER_ENTRY));
     if (DriverEntry == NULL) {
@@ -687,6 +904,8 @@ Return Value:
     }
 
     EfiCoreSetMemory(DriverEntry, sizeof(EFI_CORE_DRIVER_ENTRY), 0);
+    INITIALIZE_LIST_HEAD(&(DriverEntry->BeforeList));
+    INITIALIZE_LIST_HEAD(&(DriverEntry->AfterList));
     if (Type == EFI_FV_FILETYPE_FIRMWARE_VOLUME_IMAGE) {
         DriverEntry->IsFirmwareVolumeImage = TRUE;
     }
@@ -701,8 +920,30 @@ Return Value:
                                                                   DriverName);
 
     DriverEntry->Dependent = TRUE;
+    Status = EfipCorePreprocessDependency(DriverEntry);
+    if (EFI_ERROR(Status)) {
+        printf("Warning: Failed to process driver dependencies: 0x%x.\n",
+               Status);
+    }
+
+    //
+    // A driver whose dependencies couldn't be processed is remembered but
+    // never scheduled.
+    //
+
     EfiCoreAcquireLock(&EfiDispatcherLock);
     INSERT_BEFORE(&(DriverEntry->DriverListEntry), &EfiDiscoveredList);
+    if (!EFI_ERROR(Status)) {
+        if ((DriverEntry->Before != FALSE) || (DriverEntry->After != FALSE)) {
+            INSERT_BEFORE(&(DriverEntry->SchedulerListEntry),
+                          &EfiBeforeAfterQueue);
+
+        } else {
+            INSERT_BEFORE(&(DriverEntry->SchedulerListEntry),
+                          &EfiDependentQueue);
+        }
+    }
+
     EfiCoreReleaseLock(&EfiDispatcherLock);
     return EFI_SUCCESS;
 }
@@ -774,7 +1015,8 @@ EfipCoreInsertOnScheduledQueue (
 
 Routine Description:
 
-    This routine inserts a driver entry onto the scheduled queue.
+    This routine inserts a driver entry onto the scheduled queue. Any drivers
+    that asked to run immediately before or after it are scheduled around it.
 
 Arguments:
 
@@ -788,11 +1030,577 @@ Return Value:
 
 {
 
+    PEFI_CORE_DRIVER_ENTRY OtherEntry;
+
+    while (LIST_EMPTY(&(DriverEntry->BeforeList)) == FALSE) {
+        OtherEntry = LIST_VALUE(DriverEntry->BeforeList.Next,
+                                EFI_CORE_DRIVER_ENTRY,
+                                BeforeAfterListEntry);
+
+        LIST_REMOVE(&(OtherEntry->BeforeAfterListEntry));
+        EfipCoreInsertOnScheduledQueue(OtherEntry);
+    }
+
     EfiCoreAcquireLock(&EfiDispatcherLock);
     DriverEntry->Dependent = FALSE;
     DriverEntry->Scheduled = TRUE;
     INSERT_BEFORE(&(DriverEntry->SchedulerListEntry), &EfiScheduledQueue);
     EfiCoreReleaseLock(&EfiDispatcherLock);
+    while (LIST_EMPTY(&(DriverEntry->AfterList)) == FALSE) {
+        OtherEntry = LIST_VALUE(DriverEntry->AfterList.Next,
+                                EFI_CORE_DRIVER_ENTRY,
+                                BeforeAfterListEntry);
+
+        LIST_REMOVE(&(OtherEntry->BeforeAfterListEntry));
+        EfipCoreInsertOnScheduledQueue(OtherEntry);
+    }
+
+    return;
+}
+
+VOID
+EfipCoreReadScheduledImages (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads the PE image of every driver on the scheduled queue out
+    of its firmware volume, so that the volumes are walked in one batch rather
+    than in between starting drivers. Drivers whose image can't be read this
+    way are left for the image loader to find through their device paths.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINT32 AuthenticationStatus;
+    PLIST_ENTRY CurrentEntry;
+    PEFI_CORE_DRIVER_ENTRY DriverEntry;
+    EFI_STATUS Status;
+    EFI_FIRMWARE_VOLUME2_PROTOCOL *Volume;
+
+    //
+    // Only the dispatcher itself adds to or removes from the scheduled queue,
+    // so it can be walked without the lock.
+    //
+
+    CurrentEntry = EfiScheduledQueue.Next;
+    while (CurrentEntry != &EfiScheduledQueue) {
+        DriverEntry = LIST_VALUE(CurrentEntry,
+                                 EFI_CORE_DRIVER_ENTRY,
+                                 SchedulerListEntry);
+
+        CurrentEntry = CurrentEntry->Next;
+        if ((DriverEntry->ImageHandle != NULL) ||
+            (DriverEntry->IsFirmwareVolumeImage != FALSE) ||
+            (DriverEntry->ImageBuffer != NULL)) {
+
+            continue;
+        }
+
+        Volume = DriverEntry->Volume;
+        Status = Volume->ReadSection(Volume,
+                                     &(DriverEntry->FileName),
+                                     EFI_SECTION_PE32,
+                                     0,
+                                     &(DriverEntry->ImageBuffer),
+                                     &(DriverEntry->ImageBufferSize),
+                                     &AuthenticationStatus);
+
+        if (EFI_ERROR(Status)) {
+            if (DriverEntry->ImageBuffer != NULL) {
+                EfiCoreFreePool(DriverEntry->ImageBuffer);
+            }
+
+            DriverEntry->ImageBuffer = NULL;
+            DriverEntry->ImageBufferSize = 0;
+        }
+    }
+
     return;
 }
 
+EFI_STATUS
+EfipCorePreprocessDependency (
+    PEFI_CORE_DRIVER_ENTRY DriverEntry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads the dependency expression section of a driver, checks
+    that it is well formed, and sets up the driver entry to evaluate it.
+    Drivers without a dependency expression are always ready to run.
+
+Arguments:
+
+    DriverEntry - Supplies a pointer to the driver entry.
+
+Return Value:
+
+    EFI_SUCCESS on success.
+
+    EFI_OUT_OF_RESOURCES if memory could not be allocated.
+
+    EFI_VOLUME_CORRUPTED if the dependency expression is malformed.
+
+--*/
+
+{
+
+    UINT32 AuthenticationStatus;
+    UINT8 *Depex;
+    UINTN Offset;
+    UINTN PushCount;
+    UINTN Size;
+    EFI_STATUS Status;
+    EFI_FIRMWARE_VOLUME2_PROTOCOL *Volume;
+
+    Volume = DriverEntry->Volume;
+    Status = Volume->ReadSection(Volume,
+                                 &(DriverEntry->FileName),
+                                 EFI_SECTION_DXE_DEPEX,
+                                 0,
+                                 (VOID **)&(DriverEntry->Depex),
+                                 &(DriverEntry->DepexSize),
+                                 &AuthenticationStatus);
+
+    if (EFI_ERROR(Status)) {
+        if (DriverEntry->Depex != NULL) {
+            EfiCoreFreePool(DriverEntry->Depex);
+        }
+
+        DriverEntry->Depex = NULL;
+        DriverEntry->DepexSize = 0;
+        return EFI_SUCCESS;
+    }
+
+    Depex = DriverEntry->Depex;
+    Size = DriverEntry->DepexSize;
+
+    //
+    // A BEFORE or AFTER opcode stands alone, and ties the driver to another
+    // driver rather than to protocols.
+    //
+
+    if ((Size != 0) &&
+        ((Depex[0] == EFI_DEP_BEFORE) || (Depex[0] == EFI_DEP_AFTER))) {
+
+        if ((Size < 1 + sizeof(EFI_GUID) + 1) ||
+            (Depex[1 + sizeof(EFI_GUID)] != EFI_DEP_END)) {
+
+            return EFI_VOLUME_CORRUPTED;
+        }
+
+        EfiCoreCopyMemory(&(DriverEntry->BeforeAfterGuid),
+                          &(Depex[1]),
+                          sizeof(EFI_GUID));
+
+        if (Depex[0] == EFI_DEP_BEFORE) {
+            DriverEntry->Before = TRUE;
+
+        } else {
+            DriverEntry->After = TRUE;
+        }
+
+        return EFI_SUCCESS;
+    }
+
+    //
+    // Walk the expression to make sure it's terminated and count the
+    // protocols it references, which bounds how many the driver can wait on.
+    //
+
+    Offset = 0;
+    PushCount = 0;
+    while (TRUE) {
+        if (Offset >= Size) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+
+        switch (Depex[Offset]) {
+        case EFI_DEP_PUSH:
+            if (Size - Offset < 1 + sizeof(EFI_GUID)) {
+                return EFI_VOLUME_CORRUPTED;
+            }
+
+            PushCount += 1;
+            Offset += 1 + sizeof(EFI_GUID);
+            break;
+
+        case EFI_DEP_SOR:
+            if (Offset != 0) {
+                return EFI_VOLUME_CORRUPTED;
+            }
+
+            Offset += 1;
+            break;
+
+        case EFI_DEP_AND:
+        case EFI_DEP_OR:
+        case EFI_DEP_NOT:
+        case EFI_DEP_TRUE:
+        case EFI_DEP_FALSE:
+            Offset += 1;
+            break;
+
+        case EFI_DEP_END:
+            goto CorePreprocessDependencyEnd;
+
+        default:
+            return EFI_VOLUME_CORRUPTED;
+        }
+    }
+
+CorePreprocessDependencyEnd:
+    if (PushCount != 0) {
+        DriverEntry->Waits = EfiCoreAllocateBootPool(
+                                       PushCount * sizeof(EFI_CORE_DEPEX_WAIT));
+
+        if (DriverEntry->Waits == NULL) {
+            return EFI_OUT_OF_RESOURCES;
+        }
+
+        EfiCoreSetMemory(DriverEntry->Waits,
+                         PushCount * sizeof(EFI_CORE_DEPEX_WAIT),
+                         0);
+
+        DriverEntry->WaitCapacity = PushCount;
+    }
+
+    return EFI_SUCCESS;
+}
+
+BOOLEAN
+EfipCoreEvaluateDependency (
+    PEFI_CORE_DRIVER_ENTRY DriverEntry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine evaluates the dependency expression of a driver against the
+    protocols currently installed. If the expression is false, every protocol
+    referenced by the expression that is not yet installed is recorded in the
+    driver's wait array. This routine must not be called with the dispatcher
+    lock held.
+
+Arguments:
+
+    DriverEntry - Supplies a pointer to the driver entry to evaluate.
+
+Return Value:
+
+    TRUE if the driver can run now.
+
+    FALSE if the driver has to wait.
+
+--*/
+
+{
+
+    UINT8 *Depex;
+    EFI_GUID Guid;
+    UINTN Index;
+    VOID *Interface;
+    UINTN Offset;
+    BOOLEAN Present;
+    BOOLEAN Stack[EFI_DEPEX_STACK_SIZE];
+    UINTN StackSize;
+    EFI_STATUS Status;
+
+    DriverEntry->WaitCount = 0;
+    Depex = DriverEntry->Depex;
+    if (Depex == NULL) {
+        return TRUE;
+    }
+
+    //
+    // The expression was checked for valid opcodes and termination when the
+    // driver was discovered. Only the stack needs watching here.
+    //
+
+    Offset = 0;
+    StackSize = 0;
+    while (TRUE) {
+        switch (Depex[Offset]) {
+        case EFI_DEP_SOR:
+            Offset += 1;
+            break;
+
+        case EFI_DEP_PUSH:
+            if (StackSize == EFI_DEPEX_STACK_SIZE) {
+                goto CoreEvaluateDependencyCorrupt;
+            }
+
+            EfiCoreCopyMemory(&Guid, &(Depex[Offset + 1]), sizeof(EFI_GUID));
+            Status = EfiCoreLocateProtocol(&Guid, NULL, &Interface);
+            Present = TRUE;
+            if (EFI_ERROR(Status)) {
+                Present = FALSE;
+
+                //
+                // Remember the missing protocol once, so its installation
+                // wakes this driver.
+                //
+
+                for (Index = 0; Index < DriverEntry->WaitCount; Index += 1) {
+                    if (EfiCoreCompareGuids(
+                                    &(DriverEntry->Waits[Index].Protocol),
+                                    &Guid) != FALSE) {
+
+                        break;
+                    }
+                }
+
+                if (Index == DriverEntry->WaitCount) {
+
+                    ASSERT(Index < DriverEntry->WaitCapacity);
+
+                    EfiCoreCopyMemory(&(DriverEntry->Waits[Index].Protocol),
+                                      &Guid,
+                                      sizeof(EFI_GUID));
+
+                    DriverEntry->WaitCount += 1;
+                }
+            }
+
+            Stack[StackSize] = Present;
+            StackSize += 1;
+            Offset += 1 + sizeof(EFI_GUID);
+            break;
+
+        case EFI_DEP_AND:
+        case EFI_DEP_OR:
+            if (StackSize < 2) {
+                goto CoreEvaluateDependencyCorrupt;
+            }
+
+            StackSize -= 1;
+            if (Depex[Offset] == EFI_DEP_AND) {
+                Stack[StackSize - 1] = Stack[StackSize - 1] & Stack[StackSize];
+
+            } else {
+                Stack[StackSize - 1] = Stack[StackSize - 1] | Stack[StackSize];
+            }
+
+            Offset += 1;
+            break;
+
+        case EFI_DEP_NOT:
+            if (StackSize < 1) {
+                goto CoreEvaluateDependencyCorrupt;
+            }
+
+            Stack[StackSize - 1] = !Stack[StackSize - 1];
+            Offset += 1;
+            break;
+
+        case EFI_DEP_TRUE:
+        case EFI_DEP_FALSE:
+            if (StackSize == EFI_DEPEX_STACK_SIZE) {
+                goto CoreEvaluateDependencyCorrupt;
+            }
+
+            Stack[StackSize] = FALSE;
+            if (Depex[Offset] == EFI_DEP_TRUE) {
+                Stack[StackSize] = TRUE;
+            }
+
+            StackSize += 1;
+            Offset += 1;
+            break;
+
+        case EFI_DEP_END:
+            if (StackSize != 1) {
+                goto CoreEvaluateDependencyCorrupt;
+            }
+
+            return Stack[0];
+
+        default:
+
+            ASSERT(FALSE);
+
+            goto CoreEvaluateDependencyCorrupt;
+        }
+    }
+
+CoreEvaluateDependencyCorrupt:
+    printf("Warning: Driver has a malformed dependency expression.\n");
+    DriverEntry->WaitCount = 0;
+    return FALSE;
+}
+
+VOID
+EfipCoreWaitForProtocols (
+    PEFI_CORE_DRIVER_ENTRY DriverEntry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine parks a driver whose dependency expression evaluated to false
+    on the wait buckets of each protocol it is missing. A driver missing none
+    (for example one whose expression is simply false) will never run. This
+    routine assumes the dispatcher lock is held.
+
+Arguments:
+
+    DriverEntry - Supplies a pointer to the driver entry.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PLIST_ENTRY Bucket;
+    UINTN BucketIndex;
+    UINTN Index;
+    PEFI_CORE_DEPEX_WAIT Wait;
+
+    ASSERT(EfiCoreIsLockHeld(&EfiDispatcherLock) != FALSE);
+
+    for (Index = 0; Index < DriverEntry->WaitCount; Index += 1) {
+        Wait = &(DriverEntry->Waits[Index]);
+        Wait->Driver = DriverEntry;
+        BucketIndex = EfiCoreHashGuid(&(Wait->Protocol),
+                                      EFI_DEPEX_WAIT_BUCKET_COUNT - 1);
+        Bucket = &(EfiDepexWaitBuckets[BucketIndex]);
+        INSERT_BEFORE(&(Wait->ListEntry), Bucket);
+    }
+
+    return;
+}
+
+VOID
+EfipCoreWakeDriver (
+    PEFI_CORE_DRIVER_ENTRY DriverEntry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine takes a waiting driver off of all of its wait buckets and
+    puts it back on the dependent queue. This routine assumes the dispatcher
+    lock is held.
+
+Arguments:
+
+    DriverEntry - Supplies a pointer to the driver entry.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN Index;
+
+    ASSERT(EfiCoreIsLockHeld(&EfiDispatcherLock) != FALSE);
+
+    for (Index = 0; Index < DriverEntry->WaitCount; Index += 1) {
+        LIST_REMOVE(&(DriverEntry->Waits[Index].ListEntry));
+    }
+
+    DriverEntry->WaitCount = 0;
+    INSERT_BEFORE(&(DriverEntry->SchedulerListEntry), &EfiDependentQueue);
+    return;
+}
+
+BOOLEAN
+EfipCoreAttachBeforeAfterDriver (
+    PEFI_CORE_DRIVER_ENTRY DriverEntry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine tries to tie a driver with a BEFORE or AFTER dependency to
+    the driver it names. Once attached, the driver is scheduled right around
+    its target. If the target has already been scheduled or run, the driver
+    is scheduled right away.
+
+Arguments:
+
+    DriverEntry - Supplies a pointer to the driver entry, which is on the
+        before/after queue.
+
+Return Value:
+
+    TRUE if the driver was scheduled.
+
+    FALSE if the driver is attached to its target or still waiting for it to
+    be discovered.
+
+--*/
+
+{
+
+    PLIST_ENTRY CurrentEntry;
+    PEFI_CORE_DRIVER_ENTRY Target;
+
+    Target = NULL;
+    CurrentEntry = EfiDiscoveredList.Next;
+    while (CurrentEntry != &EfiDiscoveredList) {
+        Target = LIST_VALUE(CurrentEntry,
+                            EFI_CORE_DRIVER_ENTRY,
+                            DriverListEntry);
+
+        if ((Target != DriverEntry) &&
+            (EfiCoreCompareGuids(&(Target->FileName),
+                                 &(DriverEntry->BeforeAfterGuid)) != FALSE)) {
+
+            break;
+        }
+
+        CurrentEntry = CurrentEntry->Next;
+    }
+
+    if (CurrentEntry == &EfiDiscoveredList) {
+        return FALSE;
+    }
+
+    EfiCoreAcquireLock(&EfiDispatcherLock);
+    LIST_REMOVE(&(DriverEntry->SchedulerListEntry));
+    EfiCoreReleaseLock(&EfiDispatcherLock);
+    if ((Target->Dependent == FALSE) ||
+        (Target->Scheduled != FALSE) ||
+        (Target->Initialized != FALSE)) {
+
+        EfipCoreInsertOnScheduledQueue(DriverEntry);
+        return TRUE;
+    }
+
+    if (DriverEntry->Before != FALSE) {
+        INSERT_BEFORE(&(DriverEntry->BeforeAfterListEntry),
+                      &(Target->BeforeList));
+
+    } else {
+        INSERT_BEFORE(&(DriverEntry->BeforeAfterListEntry),
+                      &(Target->AfterList));
+    }
+
+    return FALSE;
+}
@@ -737,6 +737,7 @@ Return Value:
     EFI_DRIVER_BINDING_PROTOCOL **SortedDriverBindingProtocols;
     UINTN SortIndex;
     EFI_STATUS Status;
+    UINTN Token;
 
     DriverBindingHandleCount = 0;
     DriverBindingHandleBuffer = NULL;
@@ -988,10 +989,16 @@ Return Value:
                     // so start the driver on the controller.
                     //
 
+                    Token = EfiCorePerfStart(
+                               EfiPerfRecordDriverStart,
+                               EfiCoreGetImageName(DriverBinding->ImageHandle),
+                               (UINTN)ControllerHandle);
+
                     Status = DriverBinding->Start(DriverBinding,
                                                   ControllerHandle,
                                                   RemainingDevicePath);
 
+                    EfiCorePerfEnd(Token);
                     if (!EFI_ERROR(Status)) {
                         OneStarted = TRUE;
                     }
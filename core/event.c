@@ -38,6 +38,20 @@ Environment:
 
 #define EFI_EVENT_MAGIC 0x746F7645 // 'tnvE'
 
+//
+// Define the initial number of slots in the timer heap. The heap is indexed
+// starting at one, so slot zero is never used. A heap index of zero in a
+// timer event indicates the timer is not queued.
+//
+
+#define EFI_TIMER_HEAP_INITIAL_SIZE 64
+
+//
+// Define the due time reported when no timers are queued.
+//
+
+#define EFI_TIMER_NEVER_DUE MAX_UINT64
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -50,7 +64,8 @@ Structure Description:
 
 Members:
 
-    ListEntry - Stores pointers to the next and previous timer event structures.
+    HeapIndex - Stores the index of this timer in the timer heap, or zero if
+        the timer is not queued.
 
     DueTime - Stores the time when the timer expires.
 
@@ -59,7 +74,7 @@ Members:
 --*/
 
 typedef struct _EFI_TIMER_EVENT {
-    LIST_ENTRY ListEntry;
+    UINTN HeapIndex;
     UINT64 DueTime;
     UINT64 Period;
 } EFI_TIMER_EVENT, *PEFI_TIMER_EVENT;
@@ -136,11 +151,26 @@ EfipCoreNotifyEvent (
     PEFI_EVENT_DATA Event
     );
 
+EFI_STATUS
+EfipCoreReserveEventTimer (
+    VOID
+    );
+
 VOID
 EfipCoreInsertEventTimer (
     PEFI_EVENT_DATA Event
     );
 
+VOID
+EfipCoreRemoveEventTimer (
+    PEFI_EVENT_DATA Event
+    );
+
+VOID
+EfipCoreSiftEventTimer (
+    UINTN Index
+    );
+
 EFIAPI
 VOID
 EfipCoreCheckTimers (
@@ -188,11 +218,18 @@ UINTN EfiEventsPending;
 LIST_ENTRY EfiEventSignalQueue;
 
 //
-// Store the timer list.
+// Store the timer queue, a binary min-heap of timer events ordered by due
+// time. The heap starts out in a static buffer and grows into pool as timer
+// events are created, so that queuing a timer never needs to allocate.
 //
 
 EFI_LOCK EfiTimerLock;
-LIST_ENTRY EfiTimerList;
+PEFI_EVENT_DATA EfiTimerHeapBuffer[EFI_TIMER_HEAP_INITIAL_SIZE];
+PEFI_EVENT_DATA *EfiTimerHeap;
+UINTN EfiTimerHeapSize;
+UINTN EfiTimerHeapCount;
+UINTN EfiTimerEventCount;
+volatile UINT64 EfiTimerNextDueTime;
 EFI_EVENT EfiCheckTimerEvent;
 
 //
@@ -383,6 +420,12 @@ Return Value:
 
     if ((EventData->Type & EVT_TIMER) != 0) {
         EfiCoreSetTimer(EventData, TimerCancel, 0);
+        EfiCoreAcquireLock(&EfiTimerLock);
+
+        ASSERT(EfiTimerEventCount != 0);
+
+        EfiTimerEventCount -= 1;
+        EfiCoreReleaseLock(&EfiTimerLock);
     }
 
     EfiCoreAcquireLock(&EfiEventQueueLock);
@@ -514,6 +557,12 @@ Return Value:
         return EFI_INVALID_PARAMETER;
     }
 
+    //
+    // Without a periodic clock interrupt, callers spinning on events are what
+    // drive timer expiration.
+    //
+
+    EfiCorePollTimerDeadline();
     Status = EFI_NOT_READY;
     if ((EventData->SignalCount == 0) &&
         ((EventData->Type & EVT_NOTIFY_WAIT) != 0)) {
@@ -665,9 +714,8 @@ Return Value:
     // If the timer is queued to a database, remove it.
     //
 
-    if (EventData->TimerData.ListEntry.Next != NULL) {
-        LIST_REMOVE(&(EventData->TimerData.ListEntry));
-        EventData->TimerData.ListEntry.Next = NULL;
+    if (EventData->TimerData.HeapIndex != 0) {
+        EfipCoreRemoveEventTimer(EventData);
     }
 
     EventData->TimerData.DueTime = 0;
@@ -687,7 +735,7 @@ Return Value:
         EventData->TimerData.DueTime = EfiCoreReadTimeCounter() + TriggerTime;
         EfipCoreInsertEventTimer(EventData);
         if (TriggerTime == 0) {
-            EfiCoreSignalEvent(&EfiCheckTimerEvent);
+            EfiCoreSignalEvent(EfiCheckTimerEvent);
         }
     }
 
@@ -728,7 +776,11 @@ Return Value:
         }
 
         INITIALIZE_LIST_HEAD(&EfiEventSignalQueue);
-        INITIALIZE_LIST_HEAD(&EfiTimerList);
+        EfiTimerHeap = EfiTimerHeapBuffer;
+        EfiTimerHeapSize = EFI_TIMER_HEAP_INITIAL_SIZE;
+        EfiTimerHeapCount = 0;
+        EfiTimerEventCount = 0;
+        EfiTimerNextDueTime = EFI_TIMER_NEVER_DUE;
 
     } else {
 
@@ -824,7 +876,8 @@ EfipCoreTimerTick (
 
 Routine Description:
 
-    This routine is called when a clock interrupt comes in.
+    This routine is called when a clock interrupt comes in, or when the next
+    timer deadline is polled on platforms without a periodic clock interrupt.
 
 Arguments:
 
@@ -838,21 +891,46 @@ Return Value:
 
 {
 
-    PEFI_EVENT_DATA Event;
-
-    if (LIST_EMPTY(&EfiTimerList) == FALSE) {
-        Event = LIST_VALUE(EfiTimerList.Next,
-                           EFI_EVENT_DATA,
-                           TimerData.ListEntry);
+    //
+    // Only the earliest deadline needs to be checked. It is cached outside
+    // the heap so that it can be read without the timer lock.
+    //
 
-        if (Event->TimerData.DueTime <= CurrentTime) {
-            EfiCoreSignalEvent(EfiCheckTimerEvent);
-        }
+    if (EfiTimerNextDueTime <= CurrentTime) {
+        EfiCoreSignalEvent(EfiCheckTimerEvent);
     }
 
     return;
 }
 
+UINT64
+EfipCoreGetNextTimerDueTime (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the due time of the earliest queued timer.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the time counter value at which the next timer expires.
+
+    MAX_UINT64 if no timers are queued.
+
+--*/
+
+{
+
+    return EfiTimerNextDueTime;
+}
+
 VOID
 EfipCoreNotifySignalList (
     EFI_GUID *EventGroup
@@ -1029,6 +1107,18 @@ Return Value:
         NotifyContext = NULL;
     }
 
+    //
+    // Make sure the timer heap has room for this event, so that setting the
+    // timer later never has to allocate.
+    //
+
+    if ((Type & EVT_TIMER) != 0) {
+        Status = EfipCoreReserveEventTimer();
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+    }
+
     //
     // Allocate and initialize the new event.
     //
@@ -1041,6 +1131,12 @@ Return Value:
     }
 
     if (NewEvent == NULL) {
+        if ((Type & EVT_TIMER) != 0) {
+            EfiCoreAcquireLock(&EfiTimerLock);
+            EfiTimerEventCount -= 1;
+            EfiCoreReleaseLock(&EfiTimerLock);
+        }
+
         return EFI_OUT_OF_RESOURCES;
     }
 
@@ -1120,10 +1216,86 @@ Return Value:
     INSERT_BEFORE(&(Event->NotifyListEntry),
                   &(EfiEventQueue[Event->NotifyTpl]));
 
-    EfiEventsPending = 1 << Event->NotifyTpl;
+    EfiEventsPending |= 1 << Event->NotifyTpl;
     return;
 }
 
+EFI_STATUS
+EfipCoreReserveEventTimer (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reserves a slot in the timer heap for a new timer event,
+    growing the heap if needed.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    EFI_SUCCESS on success.
+
+    EFI_OUT_OF_RESOURCES if the heap could not be expanded.
+
+--*/
+
+{
+
+    PEFI_EVENT_DATA *NewHeap;
+    UINTN NewSize;
+    PEFI_EVENT_DATA *OldHeap;
+
+    //
+    // Pool cannot be allocated with the timer lock held, since it is above
+    // the memory lock. Allocate the larger heap without the lock, and try
+    // again if someone else expanded the heap in the meantime.
+    //
+
+    EfiCoreAcquireLock(&EfiTimerLock);
+    while (EfiTimerEventCount + 1 >= EfiTimerHeapSize) {
+        NewSize = EfiTimerHeapSize * 2;
+        EfiCoreReleaseLock(&EfiTimerLock);
+        NewHeap = EfiCoreAllocateBootPool(NewSize * sizeof(PEFI_EVENT_DATA));
+        if (NewHeap == NULL) {
+            return EFI_OUT_OF_RESOURCES;
+        }
+
+        OldHeap = NULL;
+        EfiCoreAcquireLock(&EfiTimerLock);
+        if (EfiTimerHeapSize < NewSize) {
+            EfiCoreCopyMemory(NewHeap,
+                              EfiTimerHeap,
+                              (EfiTimerHeapCount + 1) *
+                              sizeof(PEFI_EVENT_DATA));
+
+            if (EfiTimerHeap != EfiTimerHeapBuffer) {
+                OldHeap = EfiTimerHeap;
+            }
+
+            EfiTimerHeap = NewHeap;
+            EfiTimerHeapSize = NewSize;
+
+        } else {
+            OldHeap = NewHeap;
+        }
+
+        if (OldHeap != NULL) {
+            EfiCoreReleaseLock(&EfiTimerLock);
+            EfiCoreFreePool(OldHeap);
+            EfiCoreAcquireLock(&EfiTimerLock);
+        }
+    }
+
+    EfiTimerEventCount += 1;
+    EfiCoreReleaseLock(&EfiTimerLock);
+    return EFI_SUCCESS;
+}
+
 VOID
 EfipCoreInsertEventTimer (
     PEFI_EVENT_DATA Event
@@ -1133,7 +1305,7 @@ EfipCoreInsertEventTimer (
 
 Routine Description:
 
-    This routine inserts the given timer event into the global list.
+    This routine inserts the given timer event into the timer heap.
 
 Arguments:
 
@@ -1147,25 +1319,156 @@ Return Value:
 
 {
 
-    PLIST_ENTRY CurrentEntry;
-    PEFI_EVENT_DATA SearchEvent;
+    UINTN Index;
 
     ASSERT(EfiCoreIsLockHeld(&EfiTimerLock) != FALSE);
+    ASSERT(Event->TimerData.HeapIndex == 0);
+    ASSERT(EfiTimerHeapCount + 1 < EfiTimerHeapSize);
+
+    EfiTimerHeapCount += 1;
+    Index = EfiTimerHeapCount;
+    EfiTimerHeap[Index] = Event;
+    Event->TimerData.HeapIndex = Index;
+    EfipCoreSiftEventTimer(Index);
+    return;
+}
+
+VOID
+EfipCoreRemoveEventTimer (
+    PEFI_EVENT_DATA Event
+    )
+
+/*++
+
+Routine Description:
+
+    This routine removes the given timer event from the timer heap.
+
+Arguments:
+
+    Event - Supplies the queued timer event to remove.
 
-    CurrentEntry = EfiTimerList.Next;
-    while (CurrentEntry != &EfiTimerList) {
-        SearchEvent = LIST_VALUE(CurrentEntry,
-                                 EFI_EVENT_DATA,
-                                 TimerData.ListEntry);
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN Index;
+    PEFI_EVENT_DATA Last;
+
+    ASSERT(EfiCoreIsLockHeld(&EfiTimerLock) != FALSE);
+
+    Index = Event->TimerData.HeapIndex;
+
+    ASSERT((Index != 0) && (Index <= EfiTimerHeapCount));
+    ASSERT(EfiTimerHeap[Index] == Event);
+
+    Event->TimerData.HeapIndex = 0;
+    Last = EfiTimerHeap[EfiTimerHeapCount];
+    EfiTimerHeap[EfiTimerHeapCount] = NULL;
+    EfiTimerHeapCount -= 1;
+
+    //
+    // Move the last element into the hole and restore the heap ordering from
+    // there.
+    //
+
+    if (Last != Event) {
+        EfiTimerHeap[Index] = Last;
+        Last->TimerData.HeapIndex = Index;
+        EfipCoreSiftEventTimer(Index);
+
+    } else if (EfiTimerHeapCount == 0) {
+        EfiTimerNextDueTime = EFI_TIMER_NEVER_DUE;
+    }
+
+    return;
+}
+
+VOID
+EfipCoreSiftEventTimer (
+    UINTN Index
+    )
+
+/*++
+
+Routine Description:
+
+    This routine moves the timer at the given heap index up or down until the
+    heap is correctly ordered again. This is called after a timer is placed
+    into the heap or its due time changes. It also updates the cached next due
+    time.
+
+Arguments:
+
+    Index - Supplies the heap index of the timer that may be out of place.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN Child;
+    PEFI_EVENT_DATA Event;
+    UINTN Parent;
+
+    ASSERT(EfiCoreIsLockHeld(&EfiTimerLock) != FALSE);
+    ASSERT((Index != 0) && (Index <= EfiTimerHeapCount));
+
+    Event = EfiTimerHeap[Index];
+
+    //
+    // Move the timer up while it is due before its parent.
+    //
+
+    while (Index > 1) {
+        Parent = Index / 2;
+        if (EfiTimerHeap[Parent]->TimerData.DueTime <=
+            Event->TimerData.DueTime) {
 
-        if (SearchEvent->TimerData.DueTime > Event->TimerData.DueTime) {
             break;
         }
 
-        CurrentEntry = CurrentEntry->Next;
+        EfiTimerHeap[Index] = EfiTimerHeap[Parent];
+        EfiTimerHeap[Index]->TimerData.HeapIndex = Index;
+        Index = Parent;
     }
 
-    INSERT_BEFORE(&(Event->TimerData.ListEntry), CurrentEntry);
+    //
+    // Move the timer down while one of its children is due before it.
+    //
+
+    while (TRUE) {
+        Child = Index * 2;
+        if (Child > EfiTimerHeapCount) {
+            break;
+        }
+
+        if ((Child < EfiTimerHeapCount) &&
+            (EfiTimerHeap[Child + 1]->TimerData.DueTime <
+             EfiTimerHeap[Child]->TimerData.DueTime)) {
+
+            Child += 1;
+        }
+
+        if (Event->TimerData.DueTime <= EfiTimerHeap[Child]->TimerData.DueTime) {
+            break;
+        }
+
+        EfiTimerHeap[Index] = EfiTimerHeap[Child];
+        EfiTimerHeap[Index]->TimerData.HeapIndex = Index;
+        Index = Child;
+    }
+
+    EfiTimerHeap[Index] = Event;
+    Event->TimerData.HeapIndex = Index;
+    EfiTimerNextDueTime = EfiTimerHeap[1]->TimerData.DueTime;
     return;
 }
 
@@ -1180,8 +1483,8 @@ EfipCoreCheckTimers (
 
 Routine Description:
 
-    This routine checks the sorted timer list against the current system time,
-    and signals any expired timers.
+    This routine checks the timer heap against the current system time, and
+    signals any expired timers.
 
 Arguments:
 
@@ -1203,27 +1506,23 @@ Return Value:
 
     TimeCounter = EfiCoreReadTimeCounter();
     EfiCoreAcquireLock(&EfiTimerLock);
-    while (LIST_EMPTY(&EfiTimerList) == FALSE) {
-        Event = LIST_VALUE(EfiTimerList.Next,
-                           EFI_EVENT_DATA,
-                           TimerData.ListEntry);
+    while (EfiTimerHeapCount != 0) {
+        Event = EfiTimerHeap[1];
 
         //
-        // If this timer is not expired, then neither is anything after it,
-        // so break.
+        // If the earliest timer is not expired, then neither is anything
+        // else, so break.
         //
 
         if (Event->TimerData.DueTime > TimeCounter) {
             break;
         }
 
-        LIST_REMOVE(&(Event->TimerData.ListEntry));
-        Event->TimerData.ListEntry.Next = NULL;
         EfiCoreSignalEvent(Event);
 
         //
-        // If this is a periodic timer, compute the next due time and set it
-        // again.
+        // If this is a periodic timer, compute the next due time and sift it
+        // back down from the top of the heap. Otherwise remove it.
         //
 
         if (Event->TimerData.Period != 0) {
@@ -1239,7 +1538,10 @@ Return Value:
                 EfiCoreSignalEvent(EfiCheckTimerEvent);
             }
 
-            EfipCoreInsertEventTimer(Event);
+            EfipCoreSiftEventTimer(1);
+
+        } else {
+            EfipCoreRemoveEventTimer(Event);
         }
     }
 
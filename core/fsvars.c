@@ -38,10 +38,79 @@ Environment:
 // ---------------------------------------------------------------- Definitions
 //
 
+#define EFI_VARIABLES_FILE_NAME L"EFI\\NvVars"
+#define EFI_VARIABLES_JOURNAL_FILE_NAME L"EFI\\NvVarsLog"
+
+#define EFI_VARIABLE_JOURNAL_MAGIC 0x6C4A764E
+#define EFI_VARIABLE_JOURNAL_RECORD_MAGIC 0x63655276
+
+//
+// Define the size the journal may grow to before the next save folds it back
+// into the base variables file.
+//
+
+#define EFI_VARIABLE_JOURNAL_CHECKPOINT_SIZE 0x4000
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
 
+typedef enum _EFI_VARIABLES_FILE_DISPOSITION {
+    EfiVariablesFileRead,
+    EfiVariablesFileReplace,
+    EfiVariablesFileAppend,
+    EfiVariablesFileDelete
+} EFI_VARIABLES_FILE_DISPOSITION, *PEFI_VARIABLES_FILE_DISPOSITION;
+
+/*++
+
+Structure Description:
+
+    This structure sits at the head of the variable journal file.
+
+Members:
+
+    Magic - Stores the constant value EFI_VARIABLE_JOURNAL_MAGIC.
+
+    BaseDataCrc32 - Stores the data CRC of the base variables file this
+        journal applies on top of. A journal left behind by a crash during a
+        checkpoint will not match the new base file, and is ignored.
+
+--*/
+
+typedef struct _EFI_VARIABLE_JOURNAL_HEADER {
+    UINT32 Magic;
+    UINT32 BaseDataCrc32;
+} EFI_VARIABLE_JOURNAL_HEADER, *PEFI_VARIABLE_JOURNAL_HEADER;
+
+/*++
+
+Structure Description:
+
+    This structure defines a single variable change in the journal. The
+    variable name and data follow the entry, as in the base file. A data size
+    of zero records that the variable was deleted.
+
+Members:
+
+    Magic - Stores the constant value EFI_VARIABLE_JOURNAL_RECORD_MAGIC.
+
+    Size - Stores the size of the whole record in bytes, including this
+        header and the padding out to a four byte boundary.
+
+    Crc32 - Stores the CRC32 of the entry, name, and data.
+
+    Entry - Stores the variable entry.
+
+--*/
+
+typedef struct _EFI_VARIABLE_JOURNAL_RECORD {
+    UINT32 Magic;
+    UINT32 Size;
+    UINT32 Crc32;
+    EFI_VARIABLE_ENTRY Entry;
+} EFI_VARIABLE_JOURNAL_RECORD, *PEFI_VARIABLE_JOURNAL_RECORD;
+
 //
 // ----------------------------------------------- Internal Function Prototypes
 //
@@ -56,6 +125,70 @@ EfipCoreSaveVariablesToFileSystem (
     EFI_HANDLE Handle
     );
 
+VOID
+EfipCoreReplayVariableJournal (
+    EFI_HANDLE Handle,
+    PEFI_VARIABLE_HEADER Base,
+    UINTN BaseSize
+    );
+
+EFI_STATUS
+EfipCoreAppendVariableJournal (
+    EFI_HANDLE Handle,
+    PEFI_VARIABLE_HEADER Current,
+    UINTN CurrentSize
+    );
+
+VOID
+EfipCoreDeleteVariableJournal (
+    EFI_HANDLE Handle
+    );
+
+UINTN
+EfipCoreGetVariableJournalDelta (
+    PEFI_VARIABLE_HEADER Previous,
+    PEFI_VARIABLE_HEADER Current,
+    UINT8 *Buffer
+    );
+
+UINTN
+EfipCoreWriteVariableJournalRecord (
+    PEFI_VARIABLE_ENTRY Entry,
+    UINTN DataSize,
+    UINT8 *Buffer
+    );
+
+BOOLEAN
+EfipCoreValidateVariableJournalRecord (
+    PEFI_VARIABLE_JOURNAL_RECORD Record,
+    UINTN Size
+    );
+
+BOOLEAN
+EfipCoreApplyVariableJournalRecord (
+    PEFI_VARIABLE_HEADER Header,
+    PEFI_VARIABLE_JOURNAL_RECORD Record
+    );
+
+PEFI_VARIABLE_ENTRY
+EfipCoreGetNextVariableEntry (
+    PEFI_VARIABLE_HEADER Header,
+    PEFI_VARIABLE_ENTRY Entry
+    );
+
+PEFI_VARIABLE_ENTRY
+EfipCoreFindVariableEntry (
+    PEFI_VARIABLE_HEADER Header,
+    PEFI_VARIABLE_ENTRY Entry
+    );
+
+VOID
+EfipCoreSetVariableSnapshot (
+    EFI_HANDLE Handle,
+    PEFI_VARIABLE_HEADER Data,
+    UINTN DataSize
+    );
+
 EFI_STATUS
 EfipCoreGetFileInformation (
     EFI_FILE_PROTOCOL *File,
@@ -66,7 +199,8 @@ EfipCoreGetFileInformation (
 EFI_STATUS
 EfipCoreGetVariablesFile (
     EFI_HANDLE Handle,
-    BOOLEAN OpenForRead,
+    CHAR16 *FileName,
+    EFI_VARIABLES_FILE_DISPOSITION Disposition,
     EFI_FILE_PROTOCOL **File
     );
 
@@ -83,6 +217,24 @@ BOOLEAN EfiFileSystemVariablesLoaded = FALSE;
 
 EFI_GUID EfiVariableBackendProtocolGuid = EFI_VARIABLE_BACKEND_PROTOCOL_GUID;
 
+//
+// Store a copy of the variables as they stand in the files on one file
+// system, and the handle of that file system. Saves to it only append the
+// differences from this copy to the journal.
+//
+
+PEFI_VARIABLE_HEADER EfiVariableSnapshot;
+UINTN EfiVariableSnapshotSize;
+EFI_HANDLE EfiVariableSnapshotHandle;
+
+//
+// Store the current size of the journal on the snapshot file system, and
+// the data CRC of the base file it applies to.
+//
+
+UINTN EfiVariableJournalSize;
+UINT32 EfiVariableJournalBaseCrc;
+
 //
 // ------------------------------------------------------------------ Functions
 //
@@ -297,7 +449,11 @@ Return Value:
     FileData = NULL;
     FileInformation = NULL;
     Handles = NULL;
-    Status = EfipCoreGetVariablesFile(Handle, TRUE, &File);
+    Status = EfipCoreGetVariablesFile(Handle,
+                                      EFI_VARIABLES_FILE_NAME,
+                                      EfiVariablesFileRead,
+                                      &File);
+
     if (EFI_ERROR(Status)) {
         goto CoreLoadVariablesFromFileSystemEnd;
     }
@@ -380,6 +536,13 @@ Return Value:
 
     EfipSetVariablesFileVariable(FALSE);
 
+    //
+    // Apply any changes journaled on top of the base file since it was last
+    // written.
+    //
+
+    EfipCoreReplayVariableJournal(Handle, FileData, FileSize);
+
 CoreLoadVariablesFromFileSystemEnd:
     if (FileInformation != NULL) {
         EfiFreePool(FileInformation);
@@ -410,7 +573,10 @@ EfipCoreSaveVariablesToFileSystem (
 Routine Description:
 
     This routine saves variable data to the given file system interface
-    handle.
+    handle. If the file system holds the variable snapshot, only the changes
+    since the last save are appended to the journal. Otherwise, or if the
+    journal has grown too large, the whole base file is rewritten and the
+    journal is discarded.
 
 Arguments:
 
@@ -432,17 +598,9 @@ Return Value:
     EFI_STATUS Status;
     EFI_VARIABLE_BACKEND_PROTOCOL *VariableBackend;
 
-    //
-    // Open up the file.
-    //
-
     File = NULL;
     FileData = NULL;
     Handles = NULL;
-    Status = EfipCoreGetVariablesFile(Handle, FALSE, &File);
-    if (EFI_ERROR(Status)) {
-        goto CoreWriteVariablesToFileSystemEnd;
-    }
 
     //
     // Open up the variable backend protocol.
@@ -484,14 +642,52 @@ Return Value:
     }
 
     //
-    // Try to write it out.
+    // Try to just append the changes to the journal. On any failure, fall
+    // back to rewriting the base file.
+    //
+
+    if ((EfiVariableSnapshot != NULL) &&
+        (EfiVariableSnapshotHandle == Handle)) {
+
+        Status = EfipCoreAppendVariableJournal(Handle, FileData, FileSize);
+        if (!EFI_ERROR(Status)) {
+            goto CoreWriteVariablesToFileSystemEnd;
+        }
+    }
+
+    //
+    // Open up the file and try to write it out.
     //
 
+    Status = EfipCoreGetVariablesFile(Handle,
+                                      EFI_VARIABLES_FILE_NAME,
+                                      EfiVariablesFileReplace,
+                                      &File);
+
+    if (EFI_ERROR(Status)) {
+        goto CoreWriteVariablesToFileSystemEnd;
+    }
+
     Status = File->Write(File, &FileSize, FileData);
     if (EFI_ERROR(Status)) {
         goto CoreWriteVariablesToFileSystemEnd;
     }
 
+    //
+    // The base file now holds everything, so the journal is stale. It is
+    // deleted after the base file is written. If that doesn't happen, the
+    // base CRC recorded in the journal no longer matches and it is ignored.
+    //
+
+    EfipCoreDeleteVariableJournal(Handle);
+    if ((EfiVariableSnapshotHandle == NULL) ||
+        (EfiVariableSnapshotHandle == Handle)) {
+
+        EfipCoreSetVariableSnapshot(Handle, FileData, FileSize);
+        EfiVariableJournalSize = 0;
+        EfiVariableJournalBaseCrc = ((PEFI_VARIABLE_HEADER)FileData)->DataCrc32;
+    }
+
 CoreWriteVariablesToFileSystemEnd:
     if (Handles != NULL) {
         EfiFreePool(Handles);
@@ -504,157 +700,960 @@ CoreWriteVariablesToFileSystemEnd:
     return Status;
 }
 
-EFI_STATUS
-EfipCoreGetFileInformation (
-    EFI_FILE_PROTOCOL *File,
-    EFI_FILE_INFO **FileInformation,
-    UINTN *FileInformationSize
+VOID
+EfipCoreReplayVariableJournal (
+    EFI_HANDLE Handle,
+    PEFI_VARIABLE_HEADER Base,
+    UINTN BaseSize
     )
 
 /*++
 
 Routine Description:
 
-    This routine returns the file information, allocated from pool.
+    This routine applies the variable journal on the given file system to the
+    current variables. If no other file system holds the variable snapshot,
+    the snapshot is set to the base file with the journal applied.
 
 Arguments:
 
-    File - Supplies the open file protocol instance.
+    Handle - Supplies the handle that contains the simple file system interface.
 
-    FileInformation - Supplies a pointer where a pointer to the file
-        information will be returned on success. The caller is responsible
-        for freeing this buffer.
+    Base - Supplies a pointer to the contents of the base variables file,
+        which has already been validated and loaded.
 
-    FileInformationSize - Supplies a pointer where the size of the file
-        information will be returned on success.
+    BaseSize - Supplies the size of the base variables file in bytes.
 
 Return Value:
 
-    EFI status code.
+    None. A missing or mismatched journal is simply ignored.
 
 --*/
 
 {
 
-    EFI_FILE_INFO *Information;
-    UINTN InformationSize;
+    EFI_FILE_PROTOCOL *File;
+    EFI_FILE_INFO *FileInformation;
+    UINTN FileInformationSize;
+    UINT8 *Journal;
+    PEFI_VARIABLE_JOURNAL_HEADER JournalHeader;
+    UINTN JournalSize;
+    UINTN Offset;
+    PEFI_VARIABLE_JOURNAL_RECORD Record;
     EFI_STATUS Status;
+    BOOLEAN TrackSnapshot;
+    UINT8 *VariableData;
+    CHAR16 *VariableName;
 
-    Information = NULL;
-    InformationSize = 0;
-    Status = File->GetInfo(File,
-                           &EfiFileInformationGuid,
-                           &InformationSize,
-                           NULL);
+    File = NULL;
+    FileInformation = NULL;
+    Journal = NULL;
+    TrackSnapshot = FALSE;
+    if (EfiVariableSnapshotHandle == NULL) {
+        EfipCoreSetVariableSnapshot(Handle, Base, BaseSize);
+        if (EfiVariableSnapshot != NULL) {
+            TrackSnapshot = TRUE;
+            EfiVariableJournalSize = 0;
+            EfiVariableJournalBaseCrc = Base->DataCrc32;
+        }
+    }
 
-    if (Status == EFI_BUFFER_TOO_SMALL) {
-        Information = EfiCoreAllocateBootPool(InformationSize);
-        if (Information == NULL) {
-            return EFI_OUT_OF_RESOURCES;
+    Status = EfipCoreGetVariablesFile(Handle,
+                                      EFI_VARIABLES_JOURNAL_FILE_NAME,
+                                      EfiVariablesFileRead,
+                                      &File);
+
+    if (EFI_ERROR(Status)) {
+        goto CoreReplayVariableJournalEnd;
+    }
+
+    Status = EfipCoreGetFileInformation(File,
+                                        &FileInformation,
+                                        &FileInformationSize);
+
+    if (EFI_ERROR(Status)) {
+        goto CoreReplayVariableJournalEnd;
+    }
+
+    JournalSize = FileInformation->FileSize;
+    if (((FileInformation->Attribute & EFI_FILE_DIRECTORY) != 0) ||
+        (JournalSize < sizeof(EFI_VARIABLE_JOURNAL_HEADER))) {
+
+        goto CoreReplayVariableJournalEnd;
+    }
+
+    Journal = EfiCoreAllocateBootPool(JournalSize);
+    if (Journal == NULL) {
+        goto CoreReplayVariableJournalEnd;
+    }
+
+    Status = File->Read(File, &JournalSize, Journal);
+    if (EFI_ERROR(Status)) {
+        goto CoreReplayVariableJournalEnd;
+    }
+
+    //
+    // Skip a journal that was written against some other base file.
+    //
+
+    JournalHeader = (PEFI_VARIABLE_JOURNAL_HEADER)Journal;
+    if ((JournalSize < sizeof(EFI_VARIABLE_JOURNAL_HEADER)) ||
+        (JournalHeader->Magic != EFI_VARIABLE_JOURNAL_MAGIC) ||
+        (JournalHeader->BaseDataCrc32 != Base->DataCrc32)) {
+
+        goto CoreReplayVariableJournalEnd;
+    }
+
+    //
+    // Apply each record in turn, stopping at the first one that is torn or
+    // corrupt.
+    //
+
+    Offset = sizeof(EFI_VARIABLE_JOURNAL_HEADER);
+    while (Offset < JournalSize) {
+        Record = (PEFI_VARIABLE_JOURNAL_RECORD)(Journal + Offset);
+        if (EfipCoreValidateVariableJournalRecord(Record,
+                                                  JournalSize - Offset) ==
+            FALSE) {
+
+            break;
         }
 
-        EfiSetMem(Information, InformationSize, 0);
-        Status = File->GetInfo(File,
-                               &EfiFileInformationGuid,
-                               &InformationSize,
-                               Information);
+        VariableName = (CHAR16 *)(&(Record->Entry) + 1);
+        VariableData = (UINT8 *)VariableName + Record->Entry.NameSize;
+        EfiSetVariable(VariableName,
+                       &(Record->Entry.VendorGuid),
+                       Record->Entry.Attributes,
+                       Record->Entry.DataSize,
+                       VariableData);
+
+        if (TrackSnapshot != FALSE) {
+            if (EfipCoreApplyVariableJournalRecord(EfiVariableSnapshot,
+                                                   Record) == FALSE) {
+
+                EfipCoreSetVariableSnapshot(NULL, NULL, 0);
+                TrackSnapshot = FALSE;
+            }
+        }
 
-        if (EFI_ERROR(Status)) {
-            EfiFreePool(Information);
-            InformationSize = 0;
+        Offset += Record->Size;
+    }
+
+    //
+    // New records can't be appended after a damaged tail, so drop the
+    // snapshot to force the next save to rewrite the base file.
+    //
+
+    if (TrackSnapshot != FALSE) {
+        if (Offset != JournalSize) {
+            EfipCoreSetVariableSnapshot(NULL, NULL, 0);
+
+        } else {
+            EfiVariableJournalSize = JournalSize;
         }
     }
 
-    *FileInformation = Information;
-    *FileInformationSize = InformationSize;
-    return Status;
+CoreReplayVariableJournalEnd:
+    if (FileInformation != NULL) {
+        EfiFreePool(FileInformation);
+    }
+
+    if (File != NULL) {
+        File->Close(File);
+    }
+
+    if (Journal != NULL) {
+        EfiFreePool(Journal);
+    }
+
+    return;
 }
 
 EFI_STATUS
-EfipCoreGetVariablesFile (
+EfipCoreAppendVariableJournal (
     EFI_HANDLE Handle,
-    BOOLEAN OpenForRead,
-    EFI_FILE_PROTOCOL **File
+    PEFI_VARIABLE_HEADER Current,
+    UINTN CurrentSize
     )
 
 /*++
 
 Routine Description:
 
-    This routine opens the variables file for reading or writing.
+    This routine appends the differences between the variable snapshot and
+    the current variables to the journal on the given file system.
 
 Arguments:
 
-    Handle - Supplies the handle that supports the simple file system protocol.
+    Handle - Supplies the handle that contains the simple file system interface.
 
-    OpenForRead - Supplies a boolean indicating whether to open the file for
-        reading (TRUE) or writing (FALSE).
+    Current - Supplies a pointer to the current serialized variables.
 
-    File - Supplies a pointer where the opened file protocol will be returned.
+    CurrentSize - Supplies the size of the current serialized variables in
+        bytes.
 
 Return Value:
 
-    EFI status code.
+    EFI_SUCCESS if the journal is up to date.
+
+    EFI_VOLUME_FULL if the journal has grown too large and the base file
+    should be rewritten instead.
+
+    EFI_NOT_FOUND if the journal written earlier is gone, and the base file
+    should be rewritten instead.
+
+    Other error codes on failure.
 
 --*/
 
 {
 
-    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *FileSystem;
-    UINT64 OpenMode;
-    EFI_FILE_PROTOCOL *Root;
+    UINT8 *Buffer;
+    UINTN DeltaSize;
+    EFI_VARIABLES_FILE_DISPOSITION Disposition;
+    EFI_FILE_PROTOCOL *File;
+    UINTN HeaderSize;
+    PEFI_VARIABLE_JOURNAL_HEADER JournalHeader;
+    UINTN Size;
     EFI_STATUS Status;
 
-    Status = EfiHandleProtocol(Handle,
-                               &EfiSimpleFileSystemProtocolGuid,
-                               (VOID **)&FileSystem);
+    DeltaSize = EfipCoreGetVariableJournalDelta(EfiVariableSnapshot,
+                                                Current,
+                                                NULL);
 
-    if (EFI_ERROR(Status)) {
-        return Status;
+    if (DeltaSize == 0) {
+        return EFI_SUCCESS;
     }
 
-    Status = FileSystem->OpenVolume(FileSystem, &Root);
-    if (EFI_ERROR(Status)) {
-        return Status;
+    //
+    // A fresh journal starts with a header tying it to the base file. The
+    // snapshot matches the base file exactly when the journal is empty.
+    //
+
+    HeaderSize = 0;
+    Disposition = EfiVariablesFileAppend;
+    if (EfiVariableJournalSize == 0) {
+        HeaderSize = sizeof(EFI_VARIABLE_JOURNAL_HEADER);
+        Disposition = EfiVariablesFileReplace;
     }
 
-    if (OpenForRead != FALSE) {
-        OpenMode = EFI_FILE_MODE_READ;
+    Size = HeaderSize + DeltaSize;
+    if (EfiVariableJournalSize + Size > EFI_VARIABLE_JOURNAL_CHECKPOINT_SIZE) {
+        return EFI_VOLUME_FULL;
+    }
 
-    //
-    // If opening the file to write, first open and delete it.
-    //
+    Buffer = EfiCoreAllocateBootPool(Size);
+    if (Buffer == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
 
-    } else {
-        OpenMode = EFI_FILE_MODE_WRITE;
+    if (HeaderSize != 0) {
+        JournalHeader = (PEFI_VARIABLE_JOURNAL_HEADER)Buffer;
+        JournalHeader->Magic = EFI_VARIABLE_JOURNAL_MAGIC;
+        JournalHeader->BaseDataCrc32 = EfiVariableJournalBaseCrc;
     }
 
-    Status = Root->Open(Root,
-                        File,
-                        L"EFI\\NvVars",
-                        OpenMode,
-                        0);
+    EfipCoreGetVariableJournalDelta(EfiVariableSnapshot,
+                                    Current,
+                                    Buffer + HeaderSize);
 
     //
-    // If opening for write, delete the file if it opened successfully, and
-    // then reopen with create. Deleting closes the file handle too.
+    // If a journal that was written before has gone missing, the changes it
+    // held are only in the snapshot. A new journal of changes against the
+    // snapshot would lose them, so fail and let the caller rewrite the whole
+    // base file instead.
     //
 
-    if (OpenForRead == FALSE) {
-        if (!EFI_ERROR(Status)) {
-            (*File)->Delete(*File);
+    Status = EfipCoreGetVariablesFile(Handle,
+                                      EFI_VARIABLES_JOURNAL_FILE_NAME,
+                                      Disposition,
+                                      &File);
+
+    if (EFI_ERROR(Status)) {
+        if (Disposition == EfiVariablesFileAppend) {
+            Status = EFI_NOT_FOUND;
         }
 
-        OpenMode = EFI_FILE_MODE_CREATE | EFI_FILE_MODE_READ |
-                   EFI_FILE_MODE_WRITE;
+        goto CoreAppendVariableJournalEnd;
+    }
+
+    Status = File->Write(File, &Size, Buffer);
+    File->Close(File);
+    if (EFI_ERROR(Status)) {
+        goto CoreAppendVariableJournalEnd;
+    }
+
+    EfiVariableJournalSize += Size;
+    EfipCoreSetVariableSnapshot(Handle, Current, CurrentSize);
+
+CoreAppendVariableJournalEnd:
+    EfiFreePool(Buffer);
+    return Status;
+}
+
+VOID
+EfipCoreDeleteVariableJournal (
+    EFI_HANDLE Handle
+    )
+
+/*++
+
+Routine Description:
+
+    This routine deletes the variable journal on the given file system, if
+    there is one.
+
+Arguments:
+
+    Handle - Supplies the handle that contains the simple file system interface.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
 
-        Status = Root->Open(Root,
-                            File,
-                            L"EFI\\NvVars",
-                            OpenMode,
-                            0);
+    EFI_FILE_PROTOCOL *File;
+
+    EfipCoreGetVariablesFile(Handle,
+                             EFI_VARIABLES_JOURNAL_FILE_NAME,
+                             EfiVariablesFileDelete,
+                             &File);
+
+    return;
+}
+
+UINTN
+EfipCoreGetVariableJournalDelta (
+    PEFI_VARIABLE_HEADER Previous,
+    PEFI_VARIABLE_HEADER Current,
+    UINT8 *Buffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine builds the journal records that turn one set of serialized
+    variables into another. Variable counts are small, so each variable is
+    simply looked up in the other set.
+
+Arguments:
+
+    Previous - Supplies a pointer to the serialized variables the records
+        apply on top of.
+
+    Current - Supplies a pointer to the serialized variables the records
+        should produce.
+
+    Buffer - Supplies an optional pointer to a buffer where the records will
+        be written. Supply NULL to just compute the size.
+
+Return Value:
+
+    Returns the size of the records in bytes.
+
+--*/
+
+{
+
+    PEFI_VARIABLE_ENTRY Entry;
+    PEFI_VARIABLE_ENTRY Match;
+    UINTN Size;
+    UINT8 *Target;
+
+    Size = 0;
+    Target = NULL;
+
+    //
+    // Record every variable that is new or whose value has changed.
+    //
+
+    Entry = EfipCoreGetNextVariableEntry(Current, NULL);
+    while (Entry != NULL) {
+        Match = EfipCoreFindVariableEntry(Previous, Entry);
+        if ((Match == NULL) ||
+            (Match->Attributes != Entry->Attributes) ||
+            (Match->DataSize != Entry->DataSize) ||
+            (EfiCoreCompareMemory((UINT8 *)(Match + 1) + Match->NameSize,
+                                  (UINT8 *)(Entry + 1) + Entry->NameSize,
+                                  Entry->DataSize) != 0)) {
+
+            if (Buffer != NULL) {
+                Target = Buffer + Size;
+            }
+
+            Size += EfipCoreWriteVariableJournalRecord(Entry,
+                                                       Entry->DataSize,
+                                                       Target);
+        }
+
+        Entry = EfipCoreGetNextVariableEntry(Current, Entry);
+    }
+
+    //
+    // Record every variable that has gone away.
+    //
+
+    Entry = EfipCoreGetNextVariableEntry(Previous, NULL);
+    while (Entry != NULL) {
+        if (EfipCoreFindVariableEntry(Current, Entry) == NULL) {
+            if (Buffer != NULL) {
+                Target = Buffer + Size;
+            }
+
+            Size += EfipCoreWriteVariableJournalRecord(Entry, 0, Target);
+        }
+
+        Entry = EfipCoreGetNextVariableEntry(Previous, Entry);
+    }
+
+    return Size;
+}
+
+UINTN
+EfipCoreWriteVariableJournalRecord (
+    PEFI_VARIABLE_ENTRY Entry,
+    UINTN DataSize,
+    UINT8 *Buffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes a single journal record for the given variable.
+
+Arguments:
+
+    Entry - Supplies a pointer to the serialized variable entry, followed by
+        its name and data.
+
+    DataSize - Supplies the data size to record, either the entry's data size
+        or zero to record a deletion.
+
+    Buffer - Supplies an optional pointer where the record will be written.
+        Supply NULL to just compute the size.
+
+Return Value:
+
+    Returns the size of the record in bytes.
+
+--*/
+
+{
+
+    UINTN Length;
+    PEFI_VARIABLE_JOURNAL_RECORD Record;
+    UINTN Size;
+
+    Length = sizeof(EFI_VARIABLE_ENTRY) + Entry->NameSize + DataSize;
+    Size = ALIGN_VALUE(OFFSET_OF(EFI_VARIABLE_JOURNAL_RECORD, Entry) + Length,
+                       4);
+
+    if (Buffer == NULL) {
+        return Size;
+    }
+
+    EfiSetMem(Buffer, Size, 0);
+    Record = (PEFI_VARIABLE_JOURNAL_RECORD)Buffer;
+    Record->Magic = EFI_VARIABLE_JOURNAL_RECORD_MAGIC;
+    Record->Size = Size;
+    EfiCopyMem(&(Record->Entry), Entry, Length);
+    Record->Entry.DataSize = DataSize;
+    EfiCoreCalculateCrc32(&(Record->Entry), Length, &(Record->Crc32));
+    return Size;
+}
+
+BOOLEAN
+EfipCoreValidateVariableJournalRecord (
+    PEFI_VARIABLE_JOURNAL_RECORD Record,
+    UINTN Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines whether a journal record is complete and intact.
+
+Arguments:
+
+    Record - Supplies a pointer to the record to validate.
+
+    Size - Supplies the number of journal bytes remaining from the start of
+        the record.
+
+Return Value:
+
+    TRUE if the record is valid.
+
+    FALSE if the record is truncated or corrupt.
+
+--*/
+
+{
+
+    UINT32 Crc32;
+    UINTN Length;
+    CHAR16 *VariableName;
+
+    if ((Size < sizeof(EFI_VARIABLE_JOURNAL_RECORD)) ||
+        (Record->Magic != EFI_VARIABLE_JOURNAL_RECORD_MAGIC) ||
+        (Record->Size < sizeof(EFI_VARIABLE_JOURNAL_RECORD)) ||
+        (Record->Size > Size)) {
+
+        return FALSE;
+    }
+
+    if ((Record->Entry.NameSize < sizeof(CHAR16)) ||
+        ((Record->Entry.NameSize % sizeof(CHAR16)) != 0) ||
+        (Record->Entry.NameSize > Record->Size) ||
+        (Record->Entry.DataSize > Record->Size)) {
+
+        return FALSE;
+    }
+
+    Length = sizeof(EFI_VARIABLE_ENTRY) + Record->Entry.NameSize +
+             Record->Entry.DataSize;
+
+    if (OFFSET_OF(EFI_VARIABLE_JOURNAL_RECORD, Entry) + Length > Record->Size) {
+        return FALSE;
+    }
+
+    VariableName = (CHAR16 *)(&(Record->Entry) + 1);
+    if (VariableName[(Record->Entry.NameSize / sizeof(CHAR16)) - 1] != L'\0') {
+        return FALSE;
+    }
+
+    Crc32 = 0;
+    EfiCoreCalculateCrc32(&(Record->Entry), Length, &Crc32);
+    if (Crc32 != Record->Crc32) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+BOOLEAN
+EfipCoreApplyVariableJournalRecord (
+    PEFI_VARIABLE_HEADER Header,
+    PEFI_VARIABLE_JOURNAL_RECORD Record
+    )
+
+/*++
+
+Routine Description:
+
+    This routine applies a journal record to a serialized variable buffer.
+
+Arguments:
+
+    Header - Supplies a pointer to the serialized variables to update.
+
+    Record - Supplies a pointer to the validated record to apply.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE if the buffer has no room for the new variable value.
+
+--*/
+
+{
+
+    UINT8 *End;
+    PEFI_VARIABLE_ENTRY Entry;
+    UINTN Length;
+    UINT8 *Next;
+    UINTN Size;
+
+    End = (UINT8 *)(Header + 1) +
+          (Header->DataSize - sizeof(EFI_VARIABLE_HEADER) - Header->FreeSize);
+
+    //
+    // Remove the old value, if any, sliding everything after it down.
+    //
+
+    Entry = EfipCoreFindVariableEntry(Header, &(Record->Entry));
+    if (Entry != NULL) {
+        Size = sizeof(EFI_VARIABLE_ENTRY) + Entry->NameSize + Entry->DataSize;
+        Size = ALIGN_VALUE(Size, 4);
+        Next = (UINT8 *)Entry + Size;
+        EfiCopyMem(Entry, Next, End - Next);
+        Header->FreeSize += Size;
+        End -= Size;
+    }
+
+    if (Record->Entry.DataSize == 0) {
+        return TRUE;
+    }
+
+    //
+    // Add the new value at the end.
+    //
+
+    Length = sizeof(EFI_VARIABLE_ENTRY) + Record->Entry.NameSize +
+             Record->Entry.DataSize;
+
+    Size = ALIGN_VALUE(Length, 4);
+    if (Size > Header->FreeSize) {
+        return FALSE;
+    }
+
+    EfiSetMem(End, Size, 0);
+    EfiCopyMem(End, &(Record->Entry), Length);
+    Header->FreeSize -= Size;
+    return TRUE;
+}
+
+PEFI_VARIABLE_ENTRY
+EfipCoreGetNextVariableEntry (
+    PEFI_VARIABLE_HEADER Header,
+    PEFI_VARIABLE_ENTRY Entry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the next live variable in a serialized variable
+    buffer.
+
+Arguments:
+
+    Header - Supplies a pointer to the serialized variables.
+
+    Entry - Supplies an optional pointer to the current entry. Supply NULL
+        to get the first entry.
+
+Return Value:
+
+    Returns a pointer to the next entry.
+
+    NULL if there are no more entries, or the next one runs off the end of the
+    buffer.
+
+--*/
+
+{
+
+    UINT8 *End;
+    UINTN Size;
+
+    End = (UINT8 *)(Header + 1) +
+          (Header->DataSize - sizeof(EFI_VARIABLE_HEADER) - Header->FreeSize);
+
+    if (Entry == NULL) {
+        Entry = (PEFI_VARIABLE_ENTRY)(Header + 1);
+
+    } else {
+        Size = sizeof(EFI_VARIABLE_ENTRY) + Entry->NameSize + Entry->DataSize;
+        Size = ALIGN_VALUE(Size, 4);
+        Entry = (PEFI_VARIABLE_ENTRY)((UINT8 *)Entry + Size);
+    }
+
+    while ((UINT8 *)(Entry + 1) <= End) {
+        if ((Entry->NameSize == 0) ||
+            ((UINT8 *)(Entry + 1) + Entry->NameSize + Entry->DataSize > End)) {
+
+            return NULL;
+        }
+
+        if (Entry->DataSize != 0) {
+            return Entry;
+        }
+
+        Size = sizeof(EFI_VARIABLE_ENTRY) + Entry->NameSize;
+        Size = ALIGN_VALUE(Size, 4);
+        Entry = (PEFI_VARIABLE_ENTRY)((UINT8 *)Entry + Size);
+    }
+
+    return NULL;
+}
+
+PEFI_VARIABLE_ENTRY
+EfipCoreFindVariableEntry (
+    PEFI_VARIABLE_HEADER Header,
+    PEFI_VARIABLE_ENTRY Entry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine finds the variable with the same name and vendor GUID as the
+    given entry in a serialized variable buffer.
+
+Arguments:
+
+    Header - Supplies a pointer to the serialized variables to search.
+
+    Entry - Supplies a pointer to the entry to look for, followed by its name.
+
+Return Value:
+
+    Returns a pointer to the matching entry.
+
+    NULL if the variable is not present.
+
+--*/
+
+{
+
+    PEFI_VARIABLE_ENTRY Search;
+
+    Search = EfipCoreGetNextVariableEntry(Header, NULL);
+    while (Search != NULL) {
+        if ((Search->NameSize == Entry->NameSize) &&
+            (EfiCoreCompareGuids(&(Search->VendorGuid),
+                                 &(Entry->VendorGuid)) != FALSE) &&
+            (EfiCoreCompareMemory(Search + 1,
+                                  Entry + 1,
+                                  Entry->NameSize) == 0)) {
+
+            return Search;
+        }
+
+        Search = EfipCoreGetNextVariableEntry(Header, Search);
+    }
+
+    return NULL;
+}
+
+VOID
+EfipCoreSetVariableSnapshot (
+    EFI_HANDLE Handle,
+    PEFI_VARIABLE_HEADER Data,
+    UINTN DataSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine replaces the variable snapshot with a copy of the given
+    serialized variables.
+
+Arguments:
+
+    Handle - Supplies the handle of the file system whose files the snapshot
+        describes.
+
+    Data - Supplies an optional pointer to the serialized variables. Supply
+        NULL to drop the snapshot.
+
+    DataSize - Supplies the size of the serialized variables in bytes.
+
+Return Value:
+
+    None. If the copy can't be allocated, the snapshot is dropped.
+
+--*/
+
+{
+
+    if ((EfiVariableSnapshot != NULL) &&
+        ((Data == NULL) || (EfiVariableSnapshotSize < DataSize))) {
+
+        EfiFreePool(EfiVariableSnapshot);
+        EfiVariableSnapshot = NULL;
+        EfiVariableSnapshotSize = 0;
+    }
+
+    EfiVariableSnapshotHandle = NULL;
+    if (Data == NULL) {
+        return;
+    }
+
+    if (EfiVariableSnapshot == NULL) {
+        EfiVariableSnapshot = EfiCoreAllocateBootPool(DataSize);
+        if (EfiVariableSnapshot == NULL) {
+            return;
+        }
+
+        EfiVariableSnapshotSize = DataSize;
+    }
+
+    EfiCopyMem(EfiVariableSnapshot, Data, DataSize);
+    EfiVariableSnapshotHandle = Handle;
+    return;
+}
+
+EFI_STATUS
+EfipCoreGetFileInformation (
+    EFI_FILE_PROTOCOL *File,
+    EFI_FILE_INFO **FileInformation,
+    UINTN *FileInformationSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the file information, allocated from pool.
+
+Arguments:
+
+    File - Supplies the open file protocol instance.
+
+    FileInformation - Supplies a pointer where a pointer to the file
+        information will be returned on success. The caller is responsible
+        for freeing this buffer.
+
+    FileInformationSize - Supplies a pointer where the size of the file
+        information will be returned on success.
+
+Return Value:
+
+    EFI status code.
+
+--*/
+
+{
+
+    EFI_FILE_INFO *Information;
+    UINTN InformationSize;
+    EFI_STATUS Status;
+
+    Information = NULL;
+    InformationSize = 0;
+    Status = File->GetInfo(File,
+                           &EfiFileInformationGuid,
+                           &InformationSize,
+                           NULL);
+
+    if (Status == EFI_BUFFER_TOO_SMALL) {
+        Information = EfiCoreAllocateBootPool(InformationSize);
+        if (Information == NULL) {
+            return EFI_OUT_OF_RESOURCES;
+        }
+
+        EfiSetMem(Information, InformationSize, 0);
+        Status = File->GetInfo(File,
+                               &EfiFileInformationGuid,
+                               &InformationSize,
+                               Information);
+
+        if (EFI_ERROR(Status)) {
+            EfiFreePool(Information);
+            InformationSize = 0;
+        }
+    }
+
+    *FileInformation = Information;
+    *FileInformationSize = InformationSize;
+    return Status;
+}
+
+EFI_STATUS
+EfipCoreGetVariablesFile (
+    EFI_HANDLE Handle,
+    CHAR16 *FileName,
+    EFI_VARIABLES_FILE_DISPOSITION Disposition,
+    EFI_FILE_PROTOCOL **File
+    )
+
+/*++
+
+Routine Description:
+
+    This routine opens one of the variables files.
+
+Arguments:
+
+    Handle - Supplies the handle that supports the simple file system protocol.
+
+    FileName - Supplies the path of the file to open.
+
+    Disposition - Supplies how to open the file: for reading, replacing any
+        existing file, appending to the end of an existing file, or just
+        deleting it.
+
+    File - Supplies a pointer where the opened file protocol will be returned.
+        This is set to NULL when the file is deleted.
+
+Return Value:
+
+    EFI status code.
+
+--*/
+
+{
+
+    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *FileSystem;
+    UINT64 OpenMode;
+    EFI_FILE_PROTOCOL *Root;
+    EFI_STATUS Status;
+
+    *File = NULL;
+    Status = EfiHandleProtocol(Handle,
+                               &EfiSimpleFileSystemProtocolGuid,
+                               (VOID **)&FileSystem);
+
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Status = FileSystem->OpenVolume(FileSystem, &Root);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    if (Disposition == EfiVariablesFileRead) {
+        OpenMode = EFI_FILE_MODE_READ;
+
+    } else {
+        OpenMode = EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE;
+    }
+
+    Status = Root->Open(Root, File, FileName, OpenMode, 0);
+
+    //
+    // If replacing or deleting the file, delete it if it opened successfully.
+    // Deleting closes the file handle too.
+    //
+
+    if ((Disposition == EfiVariablesFileReplace) ||
+        (Disposition == EfiVariablesFileDelete)) {
+
+        if (!EFI_ERROR(Status)) {
+            (*File)->Delete(*File);
+            *File = NULL;
+        }
+
+        Status = EFI_SUCCESS;
+        if (Disposition == EfiVariablesFileDelete) {
+            goto CoreGetVariablesFileEnd;
+        }
+    }
+
+    //
+    // Create the file if it's being replaced. Appending to a file that does
+    // not exist fails rather than creating one, since the caller has to write
+    // a fresh file differently.
+    //
+
+    if (Disposition == EfiVariablesFileReplace) {
+        OpenMode = EFI_FILE_MODE_CREATE | EFI_FILE_MODE_READ |
+                   EFI_FILE_MODE_WRITE;
+
+        Status = Root->Open(Root, File, FileName, OpenMode, 0);
+
+    } else if ((Disposition == EfiVariablesFileAppend) &&
+               (!EFI_ERROR(Status))) {
+
+        Status = (*File)->SetPosition(*File, (UINT64)-1);
+        if (EFI_ERROR(Status)) {
+            (*File)->Close(*File);
+            *File = NULL;
+        }
     }
 
+CoreGetVariablesFileEnd:
     Root->Close(Root);
     return Status;
 }
@@ -32,6 +32,7 @@ Environment:
 
 #include "ueficore.h"
 #include "fwvolp.h"
+#include <minoca/lib/lzma.h>
 #include <stdio.h>
 
 //
@@ -184,12 +185,50 @@ EfipFvFreeChildNode (
     PEFI_SECTION_CHILD_NODE ChildNode
     );
 
+EFI_STATUS
+EfipFvOpenEncapsulatedStream (
+    PEFI_SECTION_STREAM_NODE Stream,
+    PEFI_SECTION_CHILD_NODE Node
+    );
+
+EFI_STATUS
+EfipFvDecompressSection (
+    EFI_GUID *Guid,
+    UINT8 *Data,
+    UINTN DataSize,
+    VOID **Buffer,
+    UINTN *BufferSize
+    );
+
+PVOID
+EfipFvLzReallocate (
+    PVOID Allocation,
+    UINTN NewSize
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
 
 LIST_ENTRY EfiStreamRoot;
 
+EFI_GUID EfiLzmaCustomDecompressGuid = EFI_LZMA_CUSTOM_DECOMPRESS_GUID;
+EFI_GUID EfiLz4CustomDecompressGuid = EFI_LZ4_CUSTOM_DECOMPRESS_GUID;
+
+//
+// Store the context the LZ library uses to allocate its probability model.
+//
+
+LZ_CONTEXT EfiFvLzContext = {
+    NULL,
+    EfipFvLzReallocate,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
+
 //
 // ------------------------------------------------------------------ Functions
 //
@@ -620,8 +659,9 @@ Return Value:
 
     EFI_SUCCESS on success.
 
-    EFI_PROTOCOL_ERROR if the GUIDed extraction protocol needed does not
-    exist.
+    EFI_OUT_OF_RESOURCES if memory could not be allocated.
+
+    EFI_VOLUME_CORRUPTED if an encapsulation section could not be decoded.
 
 --*/
 
@@ -656,28 +696,34 @@ Return Value:
     switch (Node->Type) {
 
     //
-    // Handle compressed encapsulation sections.
+    // Decode encapsulation sections into a stream of their own. The child
+    // node holds that stream for as long as the parent is open, so the work
+    // is only ever done once per section.
     //
 
     case EFI_SECTION_COMPRESSION:
-        Status = EFI_SUCCESS;
+    case EFI_SECTION_GUID_DEFINED:
+        Status = EfipFvOpenEncapsulatedStream(Stream, Node);
         break;
 
     //
-    // Handle GUIDed encapsulation sections.
+    // No processing is needed on leaf nodes.
     //
 
-    case EFI_SECTION_GUID_DEFINED:
+    default:
         Status = EFI_SUCCESS;
         break;
+    }
 
     //
-    // No processing is needed on leaf nodes.
+    // Don't keep a node that failed to decode, so that the next search tries
+    // again rather than skipping over it.
     //
 
-    default:
-        Status = EFI_SUCCESS;
-        break;
+    if (EFI_ERROR(Status)) {
+        EfiCoreFreePool(Node);
+        *ChildNode = NULL;
+        return Status;
     }
 
     INSERT_BEFORE(&(Node->ListEntry), &(Stream->ChildList));
@@ -1120,3 +1166,340 @@ Return Value:
     return;
 }
 
+EFI_STATUS
+EfipFvOpenEncapsulatedStream (
+    PEFI_SECTION_STREAM_NODE Stream,
+    PEFI_SECTION_CHILD_NODE Node
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates the encapsulated stream for a compression or GUIDed
+    section. Sections that need an extraction this core does not implement
+    are left without a stream.
+
+Arguments:
+
+    Stream - Supplies a pointer to the stream containing the section.
+
+    Node - Supplies a pointer to the child node of the section.
+
+Return Value:
+
+    EFI_SUCCESS on success, including when the section cannot be extracted.
+
+    EFI_OUT_OF_RESOURCES if memory could not be allocated.
+
+    EFI_VOLUME_CORRUPTED if the section is malformed or its data could not be
+    decompressed.
+
+--*/
+
+{
+
+    UINT16 Attributes;
+    EFI_COMPRESSION_SECTION *CompressionSection;
+    EFI_COMPRESSION_SECTION2 *CompressionSection2;
+    UINT8 CompressionType;
+    UINT8 *Data;
+    UINT32 DataOffset;
+    UINTN DataSize;
+    EFI_GUID_DEFINED_SECTION *GuidedSection;
+    EFI_GUID_DEFINED_SECTION2 *GuidedSection2;
+    EFI_COMMON_SECTION_HEADER *SectionHeader;
+    VOID *StreamBuffer;
+    UINTN StreamSize;
+    EFI_STATUS Status;
+    UINT32 UncompressedLength;
+
+    SectionHeader = (EFI_COMMON_SECTION_HEADER *)(Stream->StreamBuffer +
+                                                  Node->OffsetInStream);
+
+    //
+    // Of the compression section types, only the trivial one is supported.
+    // Standard EFI compression is not implemented; compressed images should
+    // use the LZMA or LZ4 GUIDed sections instead.
+    //
+
+    if (Node->Type == EFI_SECTION_COMPRESSION) {
+        if (EFI_IS_SECTION2(SectionHeader)) {
+            CompressionSection2 = (EFI_COMPRESSION_SECTION2 *)SectionHeader;
+            DataOffset = sizeof(EFI_COMPRESSION_SECTION2);
+            UncompressedLength = CompressionSection2->UncompressedLength;
+            CompressionType = CompressionSection2->CompressionType;
+
+        } else {
+            CompressionSection = (EFI_COMPRESSION_SECTION *)SectionHeader;
+            DataOffset = sizeof(EFI_COMPRESSION_SECTION);
+            UncompressedLength = CompressionSection->UncompressedLength;
+            CompressionType = CompressionSection->CompressionType;
+        }
+
+        if (CompressionType != EFI_NOT_COMPRESSED) {
+            return EFI_SUCCESS;
+        }
+
+        if ((DataOffset > Node->Size) ||
+            (UncompressedLength > Node->Size - DataOffset)) {
+
+            return EFI_VOLUME_CORRUPTED;
+        }
+
+        Status = EfipFvOpenSectionStream(UncompressedLength,
+                                         (UINT8 *)SectionHeader + DataOffset,
+                                         TRUE,
+                                         Stream->AuthenticationStatus,
+                                         &(Node->EncapsulatedStreamHandle));
+
+        return Status;
+    }
+
+    ASSERT(Node->Type == EFI_SECTION_GUID_DEFINED);
+
+    if (EFI_IS_SECTION2(SectionHeader)) {
+        GuidedSection2 = (EFI_GUID_DEFINED_SECTION2 *)SectionHeader;
+        Node->EncapsulationGuid = &(GuidedSection2->SectionDefinitionGuid);
+        DataOffset = GuidedSection2->DataOffset;
+        Attributes = GuidedSection2->Attributes;
+
+    } else {
+        GuidedSection = (EFI_GUID_DEFINED_SECTION *)SectionHeader;
+        Node->EncapsulationGuid = &(GuidedSection->SectionDefinitionGuid);
+        DataOffset = GuidedSection->DataOffset;
+        Attributes = GuidedSection->Attributes;
+    }
+
+    if (DataOffset > Node->Size) {
+        return EFI_VOLUME_CORRUPTED;
+    }
+
+    Data = (UINT8 *)SectionHeader + DataOffset;
+    DataSize = Node->Size - DataOffset;
+
+    //
+    // If no processing is required, the data is usable as it is.
+    //
+
+    if ((Attributes & EFI_GUIDED_SECTION_PROCESSING_REQUIRED) == 0) {
+        Status = EfipFvOpenSectionStream(DataSize,
+                                         Data,
+                                         TRUE,
+                                         Stream->AuthenticationStatus,
+                                         &(Node->EncapsulatedStreamHandle));
+
+        return Status;
+    }
+
+    Status = EfipFvDecompressSection(Node->EncapsulationGuid,
+                                     Data,
+                                     DataSize,
+                                     &StreamBuffer,
+                                     &StreamSize);
+
+    if (Status == EFI_UNSUPPORTED) {
+        return EFI_SUCCESS;
+
+    } else if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    //
+    // Hand the decompressed buffer straight to the new stream rather than
+    // having it make a copy. The stream frees it when closed.
+    //
+
+    Status = EfipFvOpenSectionStream(StreamSize,
+                                     StreamBuffer,
+                                     FALSE,
+                                     Stream->AuthenticationStatus,
+                                     &(Node->EncapsulatedStreamHandle));
+
+    if ((EFI_ERROR(Status)) && (StreamBuffer != NULL)) {
+        EfiCoreFreePool(StreamBuffer);
+    }
+
+    return Status;
+}
+
+EFI_STATUS
+EfipFvDecompressSection (
+    EFI_GUID *Guid,
+    UINT8 *Data,
+    UINTN DataSize,
+    VOID **Buffer,
+    UINTN *BufferSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine decompresses the data of an LZMA or LZ4 GUIDed section into
+    a newly allocated buffer sized from the section's header.
+
+Arguments:
+
+    Guid - Supplies a pointer to the section definition GUID.
+
+    Data - Supplies a pointer to the section data.
+
+    DataSize - Supplies the size of the section data in bytes.
+
+    Buffer - Supplies a pointer where a pointer to the decompressed data will
+        be returned. The caller is responsible for freeing this buffer from
+        pool. NULL is returned if the decompressed data is empty.
+
+    BufferSize - Supplies a pointer where the size of the decompressed data
+        will be returned.
+
+Return Value:
+
+    EFI_SUCCESS on success.
+
+    EFI_UNSUPPORTED if the GUID is not a known compression format.
+
+    EFI_OUT_OF_RESOURCES if the buffer could not be allocated.
+
+    EFI_VOLUME_CORRUPTED if the data could not be decompressed.
+
+--*/
+
+{
+
+    LZ_COMPLETION_STATUS Completion;
+    UINTN DecodedSize;
+    BOOLEAN Lzma;
+    LZ_STATUS LzStatus;
+    UINT8 *Output;
+    UINTN SourceSize;
+    UINT64 UncompressedSize;
+
+    *Buffer = NULL;
+    *BufferSize = 0;
+    if (EfiCoreCompareGuids(Guid, &EfiLzmaCustomDecompressGuid) != FALSE) {
+        if (DataSize < LZMA_HEADER_SIZE) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+
+        EfiCoreCopyMemory(&UncompressedSize,
+                          Data + LZMA_HEADER_SIZE - sizeof(UINT64),
+                          sizeof(UINT64));
+
+        Lzma = TRUE;
+
+    } else if (EfiCoreCompareGuids(Guid, &EfiLz4CustomDecompressGuid) !=
+               FALSE) {
+
+        if (DataSize < EFI_LZ4_SECTION_HEADER_SIZE) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+
+        UncompressedSize = *((UINT32 *)Data);
+        Lzma = FALSE;
+
+    } else {
+        return EFI_UNSUPPORTED;
+    }
+
+    //
+    // The size must be known up front, since the whole output is decoded
+    // directly into one buffer.
+    //
+
+    if ((UncompressedSize == MAX_UINT64) || (UncompressedSize > MAX_UINTN)) {
+        return EFI_VOLUME_CORRUPTED;
+    }
+
+    if (UncompressedSize == 0) {
+        return EFI_SUCCESS;
+    }
+
+    Output = EfiCoreAllocateBootPool((UINTN)UncompressedSize);
+    if (Output == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    DecodedSize = (UINTN)UncompressedSize;
+    if (Lzma != FALSE) {
+        SourceSize = DataSize - LZMA_HEADER_SIZE;
+        LzStatus = LzLzmaDecode(&EfiFvLzContext,
+                                Output,
+                                &DecodedSize,
+                                Data + LZMA_HEADER_SIZE,
+                                &SourceSize,
+                                Data,
+                                LZMA_HEADER_SIZE - sizeof(UINT64),
+                                FALSE,
+                                &Completion);
+
+    } else {
+        LzStatus = LzLz4Decode(Output,
+                               &DecodedSize,
+                               Data + EFI_LZ4_SECTION_HEADER_SIZE,
+                               DataSize - EFI_LZ4_SECTION_HEADER_SIZE);
+    }
+
+    if ((LzStatus != LzSuccess) || (DecodedSize != UncompressedSize)) {
+        printf("Failed to decompress %s section: %d.\n",
+               (Lzma != FALSE) ? "LZMA" : "LZ4",
+               LzStatus);
+
+        EfiCoreFreePool(Output);
+        return EFI_VOLUME_CORRUPTED;
+    }
+
+    *Buffer = Output;
+    *BufferSize = DecodedSize;
+    return EFI_SUCCESS;
+}
+
+PVOID
+EfipFvLzReallocate (
+    PVOID Allocation,
+    UINTN NewSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates or frees memory on behalf of the LZ library. The
+    decoders only ever allocate and free, so resizing is not supported.
+
+Arguments:
+
+    Allocation - Supplies an optional pointer to the allocation to free.
+
+    NewSize - Supplies the size of the desired allocation. If this is 0 and the
+        allocation parameter is non-null, the given allocation will be freed.
+
+Return Value:
+
+    Returns a pointer to the allocation on success.
+
+    NULL on allocation failure, or in the case the memory is being freed.
+
+--*/
+
+{
+
+    if (NewSize == 0) {
+        if (Allocation != NULL) {
+            EfiCoreFreePool(Allocation);
+        }
+
+        return NULL;
+    }
+
+    if (Allocation != NULL) {
+
+        ASSERT(FALSE);
+
+        return NULL;
+    }
+
+    return EfiCoreAllocateBootPool(NewSize);
+}
+
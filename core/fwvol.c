@@ -70,27 +70,23 @@ EfipFvIsBufferErased (
     );
 
 BOOLEAN
-EfipFvIsValidFfsHeader (
+EfipFvIsValidFfsFile (
     UINT8 ErasePolarity,
     EFI_FFS_FILE_HEADER *FfsHeader,
+    UINTN MaximumSize,
     EFI_FFS_FILE_STATE *FileState
     );
 
-BOOLEAN
-EfipFvIsValidFfsFile (
-    UINT8 ErasePolarity,
-    EFI_FFS_FILE_HEADER *FfsHeader
-    );
-
 EFI_FFS_FILE_STATE
 EfipFvGetFileState (
     UINT8 ErasePolarity,
     EFI_FFS_FILE_HEADER *FfsHeader
     );
 
-BOOLEAN
-EfipFvVerifyFileHeaderChecksum (
-    EFI_FFS_FILE_HEADER *FfsHeader
+VOID
+EfipFvIndexFile (
+    PEFI_FIRMWARE_VOLUME Device,
+    PEFI_FFS_FILE_LIST_ENTRY FfsFileEntry
     );
 
 UINT16
@@ -99,12 +95,6 @@ EfipFvCalculateSum16 (
     UINTN Size
     );
 
-UINT8
-EfipFvCalculateChecksum8 (
-    UINT8 *Buffer,
-    UINTN Size
-    );
-
 UINT8
 EfipFvCalculateSum8 (
     UINT8 *Buffer,
@@ -154,7 +144,9 @@ EFI_FIRMWARE_VOLUME EfiFirmwareVolumeTemplate = {
     {NULL, NULL},
     0,
     FALSE,
-    0
+    0,
+    {{NULL, NULL}},
+    {{NULL, NULL}}
 };
 
 //
@@ -478,6 +470,64 @@ Return Value:
     return FALSE;
 }
 
+PEFI_FFS_FILE_LIST_ENTRY
+EfiFvFindFile (
+    PEFI_FIRMWARE_VOLUME Device,
+    CONST EFI_GUID *NameGuid
+    )
+
+/*++
+
+Routine Description:
+
+    This routine looks up a file in the firmware volume by name using the
+    volume's name hash. Pad files are never returned.
+
+Arguments:
+
+    Device - Supplies a pointer to the firmware volume.
+
+    NameGuid - Supplies a pointer to the name of the file to find.
+
+Return Value:
+
+    Returns a pointer to the file's list entry on success.
+
+    NULL if no file with the given name exists in the volume.
+
+--*/
+
+{
+
+    PLIST_ENTRY Bucket;
+    UINT32 BucketIndex;
+    PLIST_ENTRY CurrentEntry;
+    PEFI_FFS_FILE_LIST_ENTRY FfsFileEntry;
+    BOOLEAN Match;
+
+    BucketIndex = EfiCoreHashGuid((EFI_GUID *)NameGuid,
+                                  EFI_FV_FILE_HASH_BUCKET_COUNT - 1);
+
+    Bucket = &(Device->FileHash[BucketIndex]);
+    CurrentEntry = Bucket->Next;
+    while (CurrentEntry != Bucket) {
+        FfsFileEntry = LIST_VALUE(CurrentEntry,
+                                  EFI_FFS_FILE_LIST_ENTRY,
+                                  HashListEntry);
+
+        Match = EfiCoreCompareGuids(&(FfsFileEntry->FileHeader->Name),
+                                    (EFI_GUID *)NameGuid);
+
+        if (Match != FALSE) {
+            return FfsFileEntry;
+        }
+
+        CurrentEntry = CurrentEntry->Next;
+    }
+
+    return NULL;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -792,11 +842,20 @@ Return Value:
 
     //
     // Go through the entire firmware volume cache and check the consistency of
-    // the firmware volume. Make a linked list of all the FFS file headers.
+    // the firmware volume. Make a linked list of all the FFS file headers,
+    // and index them by name and type as they go by.
     //
 
     Status = EFI_SUCCESS;
     INITIALIZE_LIST_HEAD(&(Device->FfsFileList));
+    for (Index = 0; Index < EFI_FV_FILE_HASH_BUCKET_COUNT; Index += 1) {
+        INITIALIZE_LIST_HEAD(&(Device->FileHash[Index]));
+    }
+
+    for (Index = 0; Index < EFI_FV_FILE_TYPE_LIST_COUNT; Index += 1) {
+        INITIALIZE_LIST_HEAD(&(Device->FileTypeList[Index]));
+    }
+
     if (VolumeHeader->ExtHeaderOffset != 0) {
         VolumeHeaderExt =
             (EFI_FIRMWARE_VOLUME_EXT_HEADER *)(Device->CachedVolume +
@@ -831,9 +890,15 @@ Return Value:
             goto FvCheckEnd;
         }
 
-        Valid = EfipFvIsValidFfsHeader(Device->ErasePolarity,
-                                       FfsHeader,
-                                       &FileState);
+        //
+        // Validate the header and data checksums together. Headers that are
+        // still under construction or were never completed are skipped.
+        //
+
+        Valid = EfipFvIsValidFfsFile(Device->ErasePolarity,
+                                     FfsHeader,
+                                     TopAddress - (UINT8 *)FfsHeader,
+                                     &FileState);
 
         if (Valid == FALSE) {
             if ((FileState == EFI_FILE_HEADER_INVALID) ||
@@ -863,12 +928,6 @@ Return Value:
             }
         }
 
-        Valid = EfipFvIsValidFfsFile(Device->ErasePolarity, FfsHeader);
-        if (Valid == FALSE) {
-            Status = EFI_VOLUME_CORRUPTED;
-            goto FvCheckEnd;
-        }
-
         if (EFI_IS_FFS_FILE2(FfsHeader)) {
 
             ASSERT(EFI_FFS_FILE2_SIZE(FfsHeader) > MAX_FFS_SIZE);
@@ -890,7 +949,6 @@ Return Value:
             }
         }
 
-        FileState = EfipFvGetFileState(Device->ErasePolarity, FfsHeader);
         if (FileState != EFI_FILE_DELETED) {
             FfsFileEntry = EfiCoreAllocateBootPool(
                                               sizeof(EFI_FFS_FILE_LIST_ENTRY));
@@ -903,6 +961,7 @@ Return Value:
             EfiCoreSetMemory(FfsFileEntry, sizeof(EFI_FFS_FILE_LIST_ENTRY), 0);
             FfsFileEntry->FileHeader = FfsHeader;
             INSERT_BEFORE(&(FfsFileEntry->ListEntry), &(Device->FfsFileList));
+            EfipFvIndexFile(Device, FfsFileEntry);
         }
 
         //
@@ -1033,9 +1092,10 @@ Return Value:
 }
 
 BOOLEAN
-EfipFvIsValidFfsHeader (
+EfipFvIsValidFfsFile (
     UINT8 ErasePolarity,
     EFI_FFS_FILE_HEADER *FfsHeader,
+    UINTN MaximumSize,
     EFI_FFS_FILE_STATE *FileState
     )
 
@@ -1043,7 +1103,9 @@ EfipFvIsValidFfsHeader (
 
 Routine Description:
 
-    This routine determines if the given supposed FFS file header is valid.
+    This routine determines if the given supposed FFS file is valid. The file
+    state is computed once, and the header and data checksums are verified
+    back to back in a single walk of the file.
 
 Arguments:
 
@@ -1051,106 +1113,90 @@ Arguments:
 
     FfsHeader - Supplies a pointer to the FFS file header to be checked.
 
-    FileState - Supplies a pointer where the file state will be returned if the
-        header is valid.
+    MaximumSize - Supplies the number of bytes from the header to the end of
+        the volume. Files that claim to be larger than this are invalid.
+
+    FileState - Supplies a pointer where the file state will be returned.
 
 Return Value:
 
-    TRUE if the FFS file header is valid.
+    TRUE if the FFS file header and data are valid.
 
-    FALSE if the header is not valid.
+    FALSE if the header or data is not valid.
 
 --*/
 
 {
 
+    UINT8 DataSum;
+    UINTN FileSize;
+    UINT8 HeaderSum;
+    UINTN HeaderSize;
+
     *FileState = EfipFvGetFileState(ErasePolarity, FfsHeader);
     switch (*FileState) {
+    case EFI_FILE_DELETED:
+    case EFI_FILE_DATA_VALID:
+    case EFI_FILE_MARKED_FOR_UPDATE:
+        break;
 
     //
-    // If the file state looks good verify the header checksum.
+    // A file whose header is valid but whose data was never completed is
+    // treated the same as a corrupt file.
     //
 
     case EFI_FILE_HEADER_VALID:
-    case EFI_FILE_DATA_VALID:
-    case EFI_FILE_MARKED_FOR_UPDATE:
-    case EFI_FILE_DELETED:
-        return EfipFvVerifyFileHeaderChecksum(FfsHeader);
-
     case EFI_FILE_HEADER_CONSTRUCTION:
     case EFI_FILE_HEADER_INVALID:
     default:
-        break;
+        return FALSE;
     }
 
-    return FALSE;
-}
-
-BOOLEAN
-EfipFvIsValidFfsFile (
-    UINT8 ErasePolarity,
-    EFI_FFS_FILE_HEADER *FfsHeader
-    )
-
-/*++
-
-Routine Description:
-
-    This routine determines if the given supposed FFS file is valid.
-
-Arguments:
-
-    ErasePolarity - Supplies the erase polarity of the volume.
-
-    FfsHeader - Supplies a pointer to the FFS file header to be checked.
-
-Return Value:
-
-    TRUE if the FFS file is valid.
+    if (EFI_IS_FFS_FILE2(FfsHeader)) {
+        HeaderSize = sizeof(EFI_FFS_FILE_HEADER2);
+        FileSize = EFI_FFS_FILE2_SIZE(FfsHeader);
 
-    FALSE if the header is not valid.
+    } else {
+        HeaderSize = sizeof(EFI_FFS_FILE_HEADER);
+        FileSize = EFI_FFS_FILE_SIZE(FfsHeader);
+    }
 
---*/
+    if ((HeaderSize > MaximumSize) ||
+        (FileSize < HeaderSize) ||
+        (FileSize > MaximumSize)) {
 
-{
+        return FALSE;
+    }
 
-    UINT8 DataChecksum;
-    UINT8 *FileData;
-    UINTN FileDataSize;
-    EFI_FFS_FILE_STATE FileState;
+    //
+    // The state and file checksum are not covered by the header checksum.
+    //
 
-    FileState = EfipFvGetFileState(ErasePolarity, FfsHeader);
-    switch (FileState) {
-    case EFI_FILE_DELETED:
-    case EFI_FILE_DATA_VALID:
-    case EFI_FILE_MARKED_FOR_UPDATE:
-        DataChecksum = FFS_FIXED_CHECKSUM;
-        if ((FfsHeader->Attributes & FFS_ATTRIB_CHECKSUM) != 0) {
-            if (EFI_IS_FFS_FILE2(FfsHeader)) {
-                FileData = (UINT8 *)FfsHeader + sizeof(EFI_FFS_FILE_HEADER2);
-                FileDataSize = EFI_FFS_FILE2_SIZE(FfsHeader) -
-                               sizeof(EFI_FFS_FILE_HEADER2);
+    HeaderSum = EfipFvCalculateSum8((UINT8 *)FfsHeader, HeaderSize);
+    HeaderSum = (UINT8)(HeaderSum - FfsHeader->State -
+                        FfsHeader->IntegrityCheck.Checksum.File);
 
-            } else {
-                FileData = (UINT8 *)FfsHeader + sizeof(EFI_FFS_FILE_HEADER);
-                FileDataSize = EFI_FFS_FILE_SIZE(FfsHeader) -
-                               sizeof(EFI_FFS_FILE_HEADER);
-            }
+    if (HeaderSum != 0) {
+        return FALSE;
+    }
 
-            DataChecksum = EfipFvCalculateChecksum8(FileData, FileDataSize);
+    if ((FfsHeader->Attributes & FFS_ATTRIB_CHECKSUM) == 0) {
+        if (FfsHeader->IntegrityCheck.Checksum.File != FFS_FIXED_CHECKSUM) {
+            return FALSE;
         }
 
-        if (FfsHeader->IntegrityCheck.Checksum.File == DataChecksum) {
-            return TRUE;
-        }
+        return TRUE;
+    }
 
-        break;
+    DataSum = EfipFvCalculateSum8((UINT8 *)FfsHeader + HeaderSize,
+                                  FileSize - HeaderSize);
 
-    default:
-        break;
+    DataSum = (UINT8)(DataSum + FfsHeader->IntegrityCheck.Checksum.File);
+    if (DataSum != 0) {
+        return FALSE;
     }
 
-    return FALSE;
+    return TRUE;
 }
 
 EFI_FFS_FILE_STATE
@@ -1195,50 +1241,63 @@ Return Value:
     return (EFI_FFS_FILE_STATE)HighestBit;
 }
 
-BOOLEAN
-EfipFvVerifyFileHeaderChecksum (
-    EFI_FFS_FILE_HEADER *FfsHeader
+VOID
+EfipFvIndexFile (
+    PEFI_FIRMWARE_VOLUME Device,
+    PEFI_FFS_FILE_LIST_ENTRY FfsFileEntry
     )
 
 /*++
 
 Routine Description:
 
-    This routine verifies the checksum of an FFS file header.
+    This routine adds a file to the volume's name hash and type lists. Files
+    are added in volume order, so the first file with a given name or type is
+    always found first.
 
 Arguments:
 
-    FfsHeader - Supplies a pointer to the volume header to verify.
+    Device - Supplies a pointer to the firmware volume.
 
-Return Value:
+    FfsFileEntry - Supplies a pointer to the file entry to index.
 
-    TRUE if the checksum verification passed.
+Return Value:
 
-    FALSE if the checksum verification failed.
+    None.
 
 --*/
 
 {
 
-    UINT8 HeaderChecksum;
+    PLIST_ENTRY Bucket;
+    UINT32 BucketIndex;
+    EFI_FFS_FILE_HEADER *FfsHeader;
 
-    if (EFI_IS_FFS_FILE2(FfsHeader)) {
-        HeaderChecksum = EfipFvCalculateSum8((UINT8 *)FfsHeader,
-                                             sizeof(EFI_FFS_FILE_HEADER2));
+    FfsHeader = FfsFileEntry->FileHeader;
+    INITIALIZE_LIST_HEAD(&(FfsFileEntry->HashListEntry));
+    INITIALIZE_LIST_HEAD(&(FfsFileEntry->TypeListEntry));
 
-    } else {
-        HeaderChecksum = EfipFvCalculateSum8((UINT8 *)FfsHeader,
-                                             sizeof(EFI_FFS_FILE_HEADER));
+    //
+    // Pad files are never returned by name or type, so leave them out.
+    //
+
+    if (FfsHeader->Type == EFI_FV_FILETYPE_FFS_PAD) {
+        return;
     }
 
-    HeaderChecksum = (UINT8)(HeaderChecksum - FfsHeader->State -
-                             FfsHeader->IntegrityCheck.Checksum.File);
+    BucketIndex = EfiCoreHashGuid(&(FfsHeader->Name),
+                                  EFI_FV_FILE_HASH_BUCKET_COUNT - 1);
 
-    if (HeaderChecksum == 0) {
-        return TRUE;
+    Bucket = &(Device->FileHash[BucketIndex]);
+    INSERT_BEFORE(&(FfsFileEntry->HashListEntry), Bucket);
+    if ((FfsHeader->Type != EFI_FV_FILETYPE_ALL) &&
+        (FfsHeader->Type < EFI_FV_FILE_TYPE_LIST_COUNT)) {
+
+        INSERT_BEFORE(&(FfsFileEntry->TypeListEntry),
+                      &(Device->FileTypeList[FfsHeader->Type]));
     }
 
-    return FALSE;
+    return;
 }
 
 UINT16
@@ -1336,12 +1395,45 @@ Return Value:
 
 {
 
+    UINTN Count;
     UINTN Index;
+    UINT32 Lanes;
     UINT8 Sum;
+    UINT32 Word;
 
     Sum = 0;
-    for (Index = 0; Index < Size; Index += 1) {
+    Index = 0;
+    while ((Index < Size) && ((((UINTN)Buffer + Index) & 0x3) != 0)) {
+        Sum = (UINT8)(Sum + Buffer[Index]);
+        Index += 1;
+    }
+
+    //
+    // Sum aligned words four bytes at a time. Each word adds at most 0x1FE to
+    // each of the two 16-bit lanes, so the lanes are folded into the sum every
+    // 128 words, before they can overflow into one another.
+    //
+
+    while (Size - Index >= sizeof(UINT32)) {
+        Count = (Size - Index) / sizeof(UINT32);
+        if (Count > 128) {
+            Count = 128;
+        }
+
+        Lanes = 0;
+        while (Count != 0) {
+            Word = *((UINT32 *)(Buffer + Index));
+            Lanes += (Word & 0x00FF00FF) + ((Word >> 8) & 0x00FF00FF);
+            Index += sizeof(UINT32);
+            Count -= 1;
+        }
+
+        Sum = (UINT8)(Sum + Lanes + (Lanes >> 16));
+    }
+
+    while (Index < Size) {
         Sum = (UINT8)(Sum + Buffer[Index]);
+        Index += 1;
     }
 
     return Sum;
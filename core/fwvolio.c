@@ -539,44 +539,48 @@ Return Value:
 {
 
     PEFI_FIRMWARE_VOLUME Device;
+    PEFI_FFS_FILE_LIST_ENTRY FfsEntry;
     EFI_FFS_FILE_HEADER *FfsHeader;
     UINTN FileSize;
     UINTN InputBufferSize;
-    EFI_FV_FILE_ATTRIBUTES LocalAttributes;
-    EFI_FV_FILETYPE LocalFoundType;
-    EFI_GUID SearchNameGuid;
     UINT8 *SourcePointer;
     EFI_STATUS Status;
+    EFI_FV_ATTRIBUTES VolumeAttributes;
 
     if (NameGuid == NULL) {
         return EFI_INVALID_PARAMETER;
     }
 
     Device = EFI_FIRMWARE_VOLUME_FROM_THIS(This);
+    Status = EfiFvGetVolumeAttributes(This, &VolumeAttributes);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    if ((VolumeAttributes & EFI_FV2_READ_STATUS) == 0) {
+        return EFI_ACCESS_DENIED;
+    }
 
     //
-    // Keep working until the matching name GUID is found. The key is really an
-    // FFS file list entry.
+    // Look the file up by name. The last key is the FFS file list entry, which
+    // the read file section routine picks up to find the file's stream.
     //
 
-    Device->LastKey = NULL;
-    do {
-        LocalFoundType = 0;
-        Status = EfiFvGetNextFile(This,
-                                  &(Device->LastKey),
-                                  &LocalFoundType,
-                                  &SearchNameGuid,
-                                  &LocalAttributes,
-                                  &FileSize);
+    FfsEntry = EfiFvFindFile(Device, NameGuid);
+    if (FfsEntry == NULL) {
+        return EFI_NOT_FOUND;
+    }
 
-        if (EFI_ERROR(Status)) {
-            return EFI_NOT_FOUND;
-        }
+    Device->LastKey = FfsEntry;
+    FfsHeader = FfsEntry->FileHeader;
+    if (EFI_IS_FFS_FILE2(FfsHeader)) {
+        FileSize = EFI_FFS_FILE2_SIZE(FfsHeader) -
+                   sizeof(EFI_FFS_FILE_HEADER2);
 
-    } while (EfiCoreCompareGuids(&SearchNameGuid, (EFI_GUID *)NameGuid) ==
-             FALSE);
+    } else {
+        FileSize = EFI_FFS_FILE_SIZE(FfsHeader) - sizeof(EFI_FFS_FILE_HEADER);
+    }
 
-    FfsHeader = Device->LastKey->FileHeader;
     InputBufferSize = *BufferSize;
     *FoundType = FfsHeader->Type;
     *FileAttributes = EfipFvConvertFfsAttributesToFileAttributes(
@@ -700,6 +704,7 @@ Return Value:
     EFI_FFS_FILE_HEADER *FfsHeader;
     UINTN *KeyValue;
     EFI_STATUS Status;
+    PLIST_ENTRY TypeList;
     EFI_FV_ATTRIBUTES VolumeAttributes;
 
     Device = EFI_FIRMWARE_VOLUME_FROM_THIS(This);
@@ -716,52 +721,89 @@ Return Value:
         return EFI_ACCESS_DENIED;
     }
 
-    if (*FileType > EFI_FV_FILETYPE_SMM_CORE) {
-        return EFI_NOT_FOUND;
+    KeyValue = (UINTN *)Key;
+    FfsEntry = NULL;
+    if (*KeyValue != 0) {
+        FfsEntry = LIST_VALUE((PLIST_ENTRY)(*KeyValue),
+                              EFI_FFS_FILE_LIST_ENTRY,
+                              ListEntry);
     }
 
-    KeyValue = (UINTN *)Key;
-    while (TRUE) {
-        if (*KeyValue == 0) {
-            CurrentEntry = &(Device->FfsFileList);
+    //
+    // When searching for a specific type, go straight to the next file on
+    // that type's list. The key is still the file's entry on the main list,
+    // so this only works if the previous file was of the same type. If the
+    // caller changed the type mid-search, walk the main list instead. OEM,
+    // debug, and FFS types have no lists, so they are always found by walking
+    // the main list.
+    //
+
+    if ((*FileType != EFI_FV_FILETYPE_ALL) &&
+        (*FileType < EFI_FV_FILE_TYPE_LIST_COUNT) &&
+        ((FfsEntry == NULL) || (FfsEntry->FileHeader->Type == *FileType))) {
+
+        TypeList = &(Device->FileTypeList[*FileType]);
+        if (FfsEntry == NULL) {
+            CurrentEntry = TypeList;
 
         } else {
-            CurrentEntry = (PLIST_ENTRY)(*KeyValue);
+            CurrentEntry = &(FfsEntry->TypeListEntry);
         }
 
-        //
-        // If the next entry is the end of the list then there are no more
-        // files.
-        //
-
-        if (CurrentEntry->Next == &(Device->FfsFileList)) {
+        if (CurrentEntry->Next == TypeList) {
             return EFI_NOT_FOUND;
         }
 
         FfsEntry = LIST_VALUE(CurrentEntry->Next,
                               EFI_FFS_FILE_LIST_ENTRY,
-                              ListEntry);
+                              TypeListEntry);
 
         FfsHeader = FfsEntry->FileHeader;
+        *KeyValue = (UINTN)&(FfsEntry->ListEntry);
 
-        //
-        // Save the key.
-        //
+    } else {
+        while (TRUE) {
+            if (*KeyValue == 0) {
+                CurrentEntry = &(Device->FfsFileList);
 
-        *KeyValue = (UINTN)&(FfsEntry->ListEntry);
+            } else {
+                CurrentEntry = (PLIST_ENTRY)(*KeyValue);
+            }
 
-        //
-        // Stop if there's a match. Ignore pad files.
-        //
+            //
+            // If the next entry is the end of the list then there are no more
+            // files.
+            //
 
-        if (FfsHeader->Type == EFI_FV_FILETYPE_FFS_PAD) {
-            continue;
-        }
+            if (CurrentEntry->Next == &(Device->FfsFileList)) {
+                return EFI_NOT_FOUND;
+            }
+
+            FfsEntry = LIST_VALUE(CurrentEntry->Next,
+                                  EFI_FFS_FILE_LIST_ENTRY,
+                                  ListEntry);
+
+            FfsHeader = FfsEntry->FileHeader;
+
+            //
+            // Save the key.
+            //
+
+            *KeyValue = (UINTN)&(FfsEntry->ListEntry);
+
+            //
+            // Stop if there's a match. Ignore pad files.
+            //
+
+            if (FfsHeader->Type == EFI_FV_FILETYPE_FFS_PAD) {
+                continue;
+            }
 
-        if ((*FileType == EFI_FV_FILETYPE_ALL) ||
-            (*FileType == FfsHeader->Type)) {
+            if ((*FileType == EFI_FV_FILETYPE_ALL) ||
+                (*FileType == FfsHeader->Type)) {
 
-            break;
+                break;
+            }
         }
     }
 
@@ -49,6 +49,20 @@ Author:
 
 #define EFI_FIRMWARE_VOLUME_MAGIC 0x6F567746 // 'oVwF'
 
+//
+// Define the number of buckets in each volume's table of files hashed by name.
+// This must be a power of two.
+//
+
+#define EFI_FV_FILE_HASH_BUCKET_COUNT 128
+
+//
+// Define the number of per-type file lists in each volume. Files are indexed
+// by their type directly; slot zero (EFI_FV_FILETYPE_ALL) is unused.
+//
+
+#define EFI_FV_FILE_TYPE_LIST_COUNT (EFI_FV_FILETYPE_SMM_CORE + 1)
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -62,6 +76,14 @@ Structure Description:
 Members:
 
     ListEntry - Stores pointers to the next and previous FFS file list entries.
+        This must be the first member, as the search key handed out by the
+        get next file routine points to it.
+
+    HashListEntry - Stores pointers to the next and previous files in the
+        same name hash bucket.
+
+    TypeListEntry - Stores pointers to the next and previous files of the same
+        type. This is only used for files whose type has a type list.
 
     FileHeader - Stores a pointer to the FFS file header.
 
@@ -71,6 +93,8 @@ Members:
 
 typedef struct _EFI_FFS_FILE_LIST_ENTRY {
     LIST_ENTRY ListEntry;
+    LIST_ENTRY HashListEntry;
+    LIST_ENTRY TypeListEntry;
     EFI_FFS_FILE_HEADER *FileHeader;
     UINTN StreamHandle;
 } EFI_FFS_FILE_LIST_ENTRY, *PEFI_FFS_FILE_LIST_ENTRY;
@@ -108,6 +132,12 @@ Members:
 
     AuthenticationStatus - Stores the authentication status.
 
+    FileHash - Stores the heads of the lists of files hashed by name. Pad
+        files are not included.
+
+    FileTypeList - Stores the heads of the lists of files of each type, in
+        volume order.
+
 --*/
 
 typedef struct _EFI_FIRMWARE_VOLUME {
@@ -123,6 +153,8 @@ typedef struct _EFI_FIRMWARE_VOLUME {
     UINT8 ErasePolarity;
     BOOLEAN IsFfs3;
     UINT32 AuthenticationStatus;
+    LIST_ENTRY FileHash[EFI_FV_FILE_HASH_BUCKET_COUNT];
+    LIST_ENTRY FileTypeList[EFI_FV_FILE_TYPE_LIST_COUNT];
 } EFI_FIRMWARE_VOLUME, *PEFI_FIRMWARE_VOLUME;
 
 //
@@ -222,6 +254,33 @@ Return Value:
 
 --*/
 
+PEFI_FFS_FILE_LIST_ENTRY
+EfiFvFindFile (
+    PEFI_FIRMWARE_VOLUME Device,
+    CONST EFI_GUID *NameGuid
+    );
+
+/*++
+
+Routine Description:
+
+    This routine looks up a file in the firmware volume by name using the
+    volume's name hash. Pad files are never returned.
+
+Arguments:
+
+    Device - Supplies a pointer to the firmware volume.
+
+    NameGuid - Supplies a pointer to the name of the file to find.
+
+Return Value:
+
+    Returns a pointer to the file's list entry on success.
+
+    NULL if no file with the given name exists in the volume.
+
+--*/
+
 EFIAPI
 EFI_STATUS
 EfiFvOpenSectionStream (
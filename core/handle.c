@@ -30,11 +30,26 @@ Environment:
 //
 
 #include "ueficore.h"
+#include <stdio.h>
 
 //
 // ---------------------------------------------------------------- Definitions
 //
 
+//
+// Define the initial number of slots in the protocol hash table. This must be
+// a power of two. The table doubles whenever it becomes half full.
+//
+
+#define EFI_PROTOCOL_HASH_INITIAL_SIZE 64
+
+//
+// Define the number of slots in the direct-mapped cache of recently looked up
+// protocols. This must be a power of two.
+//
+
+#define EFI_PROTOCOL_CACHE_SIZE 16
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -79,6 +94,11 @@ EfipCoreNotifyProtocolEntry (
     PEFI_PROTOCOL_ENTRY ProtocolEntry
     );
 
+BOOLEAN
+EfipCoreInsertProtocolHashEntry (
+    PEFI_PROTOCOL_ENTRY ProtocolEntry
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -88,6 +108,28 @@ LIST_ENTRY EfiHandleList;
 LIST_ENTRY EfiProtocolDatabase;
 UINTN EfiHandleDatabaseKey;
 
+//
+// Store the open-addressed hash table of protocol entries, keyed by GUID. The
+// protocol database list above is kept for ordered enumeration. Protocol
+// entries are never removed, so the table needs no deletion markers.
+//
+
+PEFI_PROTOCOL_ENTRY
+    EfiProtocolHashTableBuffer[EFI_PROTOCOL_HASH_INITIAL_SIZE];
+
+PEFI_PROTOCOL_ENTRY *EfiProtocolHashTable = EfiProtocolHashTableBuffer;
+UINTN EfiProtocolHashTableSize = EFI_PROTOCOL_HASH_INITIAL_SIZE;
+UINTN EfiProtocolHashTableCount;
+
+//
+// Store the cache of the most recently looked up protocols, indexed by the
+// low bits of the GUID hash.
+//
+
+PEFI_PROTOCOL_ENTRY EfiProtocolCache[EFI_PROTOCOL_CACHE_SIZE];
+UINTN EfiProtocolCacheHits;
+UINTN EfiProtocolCacheMisses;
+
 //
 // ------------------------------------------------------------------ Functions
 //
@@ -1350,6 +1392,16 @@ Return Value:
     INITIALIZE_LIST_HEAD(&EfiProtocolDatabase);
     INITIALIZE_LIST_HEAD(&EfiHandleList);
     EfiHandleDatabaseKey = 0;
+    EfiCoreSetMemory(EfiProtocolHashTableBuffer,
+                     sizeof(EfiProtocolHashTableBuffer),
+                     0);
+
+    EfiCoreSetMemory(EfiProtocolCache, sizeof(EfiProtocolCache), 0);
+    EfiProtocolHashTable = EfiProtocolHashTableBuffer;
+    EfiProtocolHashTableSize = EFI_PROTOCOL_HASH_INITIAL_SIZE;
+    EfiProtocolHashTableCount = 0;
+    EfiProtocolCacheHits = 0;
+    EfiProtocolCacheMisses = 0;
     return;
 }
 
@@ -1503,6 +1555,7 @@ CoreInstallProtocolInterfaceNotifyEnd:
     EfiCoreReleaseLock(&EfiProtocolDatabaseLock);
     if (!EFI_ERROR(Status)) {
         *EfiHandle = Handle;
+        EfiCoreDispatcherProtocolInstalled(Protocol);
 
     } else {
         if (ProtocolInterface != NULL) {
@@ -1577,28 +1630,53 @@ Return Value:
 
 {
 
-    PLIST_ENTRY CurrentEntry;
+    PEFI_PROTOCOL_ENTRY *CacheSlot;
+    UINT32 Hash;
     PEFI_PROTOCOL_ENTRY Item;
     PEFI_PROTOCOL_ENTRY ProtocolEntry;
+    UINTN Slot;
 
     ASSERT(EfiCoreIsLockHeld(&EfiProtocolDatabaseLock) != FALSE);
 
     //
-    // Search the database for the matching GUID.
+    // Check the cache of recently used protocols first.
+    //
+
+    Hash = EfiCoreHashGuid(Protocol, MAX_UINT32);
+    CacheSlot = &(EfiProtocolCache[Hash & (EFI_PROTOCOL_CACHE_SIZE - 1)]);
+    ProtocolEntry = *CacheSlot;
+    if ((ProtocolEntry != NULL) &&
+        (ProtocolEntry->Hash == Hash) &&
+        (EfiCoreCompareGuids(&(ProtocolEntry->ProtocolId), Protocol) !=
+         FALSE)) {
+
+        EfiProtocolCacheHits += 1;
+        ProtocolEntry->LookupCount += 1;
+        return ProtocolEntry;
+    }
+
+    EfiProtocolCacheMisses += 1;
+
+    //
+    // Probe the hash table for the matching GUID. The table is never full, so
+    // an empty slot always terminates the search.
     //
 
     ProtocolEntry = NULL;
-    CurrentEntry = EfiProtocolDatabase.Next;
-    while (CurrentEntry != &EfiProtocolDatabase) {
-        Item = LIST_VALUE(CurrentEntry, EFI_PROTOCOL_ENTRY, ListEntry);
-        CurrentEntry = CurrentEntry->Next;
+    Slot = Hash & (EfiProtocolHashTableSize - 1);
+    while (EfiProtocolHashTable[Slot] != NULL) {
+        Item = EfiProtocolHashTable[Slot];
 
         ASSERT(Item->Magic == EFI_PROTOCOL_ENTRY_MAGIC);
 
-        if (EfiCoreCompareGuids(&(Item->ProtocolId), Protocol) != FALSE) {
+        if ((Item->Hash == Hash) &&
+            (EfiCoreCompareGuids(&(Item->ProtocolId), Protocol) != FALSE)) {
+
             ProtocolEntry = Item;
             break;
         }
+
+        Slot = (Slot + 1) & (EfiProtocolHashTableSize - 1);
     }
 
     if ((ProtocolEntry == NULL) && (Create != FALSE)) {
@@ -1609,15 +1687,86 @@ Return Value:
                               Protocol,
                               sizeof(EFI_GUID));
 
+            ProtocolEntry->Hash = Hash;
+            ProtocolEntry->LookupCount = 0;
             INITIALIZE_LIST_HEAD(&(ProtocolEntry->ProtocolList));
             INITIALIZE_LIST_HEAD(&(ProtocolEntry->NotifyList));
+            if (EfipCoreInsertProtocolHashEntry(ProtocolEntry) == FALSE) {
+                EfiCoreFreePool(ProtocolEntry);
+                return NULL;
+            }
+
             INSERT_BEFORE(&(ProtocolEntry->ListEntry), &EfiProtocolDatabase);
         }
     }
 
+    if (ProtocolEntry != NULL) {
+        ProtocolEntry->LookupCount += 1;
+        *CacheSlot = ProtocolEntry;
+    }
+
     return ProtocolEntry;
 }
 
+VOID
+EfiCoreDumpProtocolStatistics (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine prints the number of lookups performed on each protocol GUID
+    in the protocol database, along with the protocol lookup cache hit rate.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PLIST_ENTRY CurrentEntry;
+    EFI_GUID *Guid;
+    PEFI_PROTOCOL_ENTRY ProtocolEntry;
+
+    EfiCoreAcquireLock(&EfiProtocolDatabaseLock);
+    printf("Protocol lookups: %d cache hits, %d misses, %d protocols.\n",
+           EfiProtocolCacheHits,
+           EfiProtocolCacheMisses,
+           EfiProtocolHashTableCount);
+
+    CurrentEntry = EfiProtocolDatabase.Next;
+    while (CurrentEntry != &EfiProtocolDatabase) {
+        ProtocolEntry = LIST_VALUE(CurrentEntry, EFI_PROTOCOL_ENTRY, ListEntry);
+        CurrentEntry = CurrentEntry->Next;
+        Guid = &(ProtocolEntry->ProtocolId);
+        printf("  %08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x "
+               "%d\n",
+               Guid->Data1,
+               Guid->Data2,
+               Guid->Data3,
+               Guid->Data4[0],
+               Guid->Data4[1],
+               Guid->Data4[2],
+               Guid->Data4[3],
+               Guid->Data4[4],
+               Guid->Data4[5],
+               Guid->Data4[6],
+               Guid->Data4[7],
+               ProtocolEntry->LookupCount);
+    }
+
+    EfiCoreReleaseLock(&EfiProtocolDatabaseLock);
+    return;
+}
+
 EFI_STATUS
 EfipCoreValidateHandle (
     EFI_HANDLE Handle
@@ -1774,6 +1923,50 @@ Return Value:
     return;
 }
 
+UINT32
+EfiCoreHashGuid (
+    EFI_GUID *Guid,
+    UINT32 Mask
+    )
+
+/*++
+
+Routine Description:
+
+    This routine computes the hash of a GUID, used to index the protocol
+    database, the dispatcher wait lists, and the firmware volume file names.
+
+Arguments:
+
+    Guid - Supplies a pointer to the GUID to hash.
+
+    Mask - Supplies the mask to apply to the hash. Hash tables with a power of
+        two number of buckets should pass the bucket count minus one. Supply
+        MAX_UINT32 to get the full hash.
+
+Return Value:
+
+    Returns the masked hash of the GUID.
+
+--*/
+
+{
+
+    UINT32 Hash;
+    UINT32 *Words;
+
+    //
+    // Fold the GUID down to 32 bits, then scramble it with a multiplicative
+    // hash so that GUIDs differing in only a few bits spread out.
+    //
+
+    Words = (UINT32 *)Guid;
+    Hash = Words[0] ^ Words[1] ^ Words[2] ^ Words[3];
+    Hash *= 0x9E3779B1;
+    Hash ^= Hash >> 16;
+    return Hash & Mask;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -2201,3 +2394,77 @@ Return Value:
     return;
 }
 
+BOOLEAN
+EfipCoreInsertProtocolHashEntry (
+    PEFI_PROTOCOL_ENTRY ProtocolEntry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine inserts a protocol entry into the protocol hash table,
+    growing the table if it is half full. This routine assumes the protocol
+    database lock is already held.
+
+Arguments:
+
+    ProtocolEntry - Supplies a pointer to the new protocol entry. Its hash must
+        already be filled in.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE if the table needed to grow but could not be allocated.
+
+--*/
+
+{
+
+    PEFI_PROTOCOL_ENTRY Entry;
+    UINTN Index;
+    PEFI_PROTOCOL_ENTRY *NewTable;
+    UINTN NewSize;
+    UINTN Slot;
+
+    if ((EfiProtocolHashTableCount + 1) * 2 > EfiProtocolHashTableSize) {
+        NewSize = EfiProtocolHashTableSize * 2;
+        NewTable = EfiCoreAllocateBootPool(NewSize * sizeof(PVOID));
+        if (NewTable == NULL) {
+            return FALSE;
+        }
+
+        EfiCoreSetMemory(NewTable, NewSize * sizeof(PVOID), 0);
+        for (Index = 0; Index < EfiProtocolHashTableSize; Index += 1) {
+            Entry = EfiProtocolHashTable[Index];
+            if (Entry == NULL) {
+                continue;
+            }
+
+            Slot = Entry->Hash & (NewSize - 1);
+            while (NewTable[Slot] != NULL) {
+                Slot = (Slot + 1) & (NewSize - 1);
+            }
+
+            NewTable[Slot] = Entry;
+        }
+
+        if (EfiProtocolHashTable != EfiProtocolHashTableBuffer) {
+            EfiCoreFreePool(EfiProtocolHashTable);
+        }
+
+        EfiProtocolHashTable = NewTable;
+        EfiProtocolHashTableSize = NewSize;
+    }
+
+    Slot = ProtocolEntry->Hash & (EfiProtocolHashTableSize - 1);
+    while (EfiProtocolHashTable[Slot] != NULL) {
+        Slot = (Slot + 1) & (EfiProtocolHashTableSize - 1);
+    }
+
+    EfiProtocolHashTable[Slot] = ProtocolEntry;
+    EfiProtocolHashTableCount += 1;
+    return TRUE;
+}
+
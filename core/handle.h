@@ -96,6 +96,11 @@ Members:
 
     ProtocolId - Stores the GUID of the protocol.
 
+    Hash - Stores the hash of the protocol GUID, used to index the protocol
+        hash table.
+
+    LookupCount - Stores the number of times this entry has been looked up.
+
 --*/
 
 typedef struct _EFI_PROTOCOL_ENTRY {
@@ -104,6 +109,8 @@ typedef struct _EFI_PROTOCOL_ENTRY {
     LIST_ENTRY ProtocolList;
     LIST_ENTRY NotifyList;
     EFI_GUID ProtocolId;
+    UINT32 Hash;
+    UINTN LookupCount;
 } EFI_PROTOCOL_ENTRY, *PEFI_PROTOCOL_ENTRY;
 
 /*++
@@ -675,6 +682,28 @@ Return Value:
 
 --*/
 
+VOID
+EfiCoreDumpProtocolStatistics (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine prints the number of lookups performed on each protocol GUID
+    in the protocol database, along with the protocol lookup cache hit rate.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
 EFI_STATUS
 EfipCoreInstallProtocolInterfaceNotify (
     EFI_HANDLE *EfiHandle,
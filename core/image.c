@@ -37,7 +37,6 @@ Environment:
 #include "fv2.h"
 #include <minoca/uefi/protocol/loadfil.h>
 #include <minoca/uefi/protocol/loadfil2.h>
-#include <minoca/uefi/protocol/sfilesys.h>
 #include <minoca/kernel/hmod.h>
 #include <minoca/kernel/kdebug.h>
 #include <stdio.h>
@@ -78,6 +77,14 @@ EfipCoreGetFileBufferByFilePath (
     UINT32 *AuthenticationStatus
     );
 
+EFI_STATUS
+EfipCoreOpenImageFile (
+    CONST EFI_DEVICE_PATH_PROTOCOL *FilePath,
+    CHAR16 **FileName,
+    UINTN *FileSize,
+    EFI_FILE_HANDLE *File
+    );
+
 EFI_STATUS
 EfipCoreLoadPeImage (
     BOOLEAN BootPolicy,
@@ -233,11 +240,13 @@ Return Value:
 
     UINT32 Attributes;
     EFI_STATUS Status;
+    UINTN Token;
 
     Attributes =
                EFI_LOAD_PE_IMAGE_ATTRIBUTE_RUNTIME_REGISTRATION |
                EFI_LOAD_PE_IMAGE_ATTRIBUTE_DEBUG_IMAGE_INFO_TABLE_REGISTRATION;
 
+    Token = EfiCorePerfStart(EfiPerfRecordLoadImage, NULL, 0);
     Status = EfipCoreLoadImage(BootPolicy,
                                ParentImageHandle,
                                DevicePath,
@@ -249,6 +258,17 @@ Return Value:
                                NULL,
                                Attributes);
 
+    //
+    // The image's name is only known once it has been loaded.
+    //
+
+    if (!EFI_ERROR(Status)) {
+        EfiCorePerfSetIdentity(Token,
+                               EfiCoreGetImageName(*ImageHandle),
+                               (UINTN)*ImageHandle);
+    }
+
+    EfiCorePerfEnd(Token);
     return Status;
 }
 
@@ -365,6 +385,7 @@ Return Value:
     PEFI_IMAGE_DATA LastImage;
     UINTN SetJumpFlag;
     EFI_STATUS Status;
+    UINTN Token;
 
     Image = EfipCoreGetImageDataFromHandle(ImageHandle);
     if ((Image == NULL) || (Image->Started != FALSE)) {
@@ -379,6 +400,10 @@ Return Value:
         return EFI_UNSUPPORTED;
     }
 
+    Token = EfiCorePerfStart(EfiPerfRecordStartImage,
+                             EfiCoreGetImageName(ImageHandle),
+                             (UINTN)ImageHandle);
+
     //
     // Push the current start image context, and link the current image to the
     // head. This is the only image that can call exit.
@@ -399,6 +424,7 @@ Return Value:
                           sizeof(EFI_JUMP_BUFFER) + EFI_JUMP_BUFFER_ALIGNMENT);
 
     if (Image->JumpBuffer == NULL) {
+        EfiCorePerfEnd(Token);
         return EFI_OUT_OF_RESOURCES;
     }
 
@@ -431,6 +457,7 @@ Return Value:
 
     ASSERT(Image->Tpl == EfiCurrentTpl);
 
+    EfiCorePerfEnd(Token);
     EfiCoreRestoreTpl(Image->Tpl);
     EfiCoreFreePool(Image->JumpBuffer);
     EfiCurrentImage = LastImage;
@@ -648,6 +675,74 @@ Return Value:
     return Status;
 }
 
+CONST CHAR8 *
+EfiCoreGetImageName (
+    EFI_HANDLE ImageHandle
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns a short name for a loaded image, taken from the file
+    name of its debug information.
+
+Arguments:
+
+    ImageHandle - Supplies the handle of the loaded image.
+
+Return Value:
+
+    Returns a pointer to the null terminated file name, without any leading
+    directories.
+
+    NULL if the handle is not an image or the image carries no debug
+    information.
+
+--*/
+
+{
+
+    CONST CHAR8 *Current;
+    PEFI_IMAGE_DATA Image;
+    EFI_LOADED_IMAGE_PROTOCOL *LoadedImage;
+    CONST CHAR8 *Name;
+    EFI_STATUS Status;
+
+    //
+    // Builtin drivers have no image handle, so don't use the get image data
+    // routine, which asserts on failure.
+    //
+
+    if (ImageHandle == NULL) {
+        return NULL;
+    }
+
+    Status = EfiCoreHandleProtocol(ImageHandle,
+                                   &EfiLoadedImageProtocolGuid,
+                                   (VOID **)&LoadedImage);
+
+    if (EFI_ERROR(Status)) {
+        return NULL;
+    }
+
+    Image = PARENT_STRUCTURE(LoadedImage, EFI_IMAGE_DATA, Information);
+    if ((Image->Magic != EFI_IMAGE_DATA_MAGIC) ||
+        (Image->ImageContext.PdbPointer == NULL)) {
+
+        return NULL;
+    }
+
+    Name = Image->ImageContext.PdbPointer;
+    for (Current = Name; *Current != '\0'; Current += 1) {
+        if ((*Current == '/') || (*Current == '\\')) {
+            Name = Current + 1;
+        }
+    }
+
+    return Name;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -780,14 +875,49 @@ Return Value:
             return EFI_INVALID_PARAMETER;
         }
 
-        FileHandle.Source = EfipCoreGetFileBufferByFilePath(
+        //
+        // Images on a file system are read straight into their final pages
+        // rather than buffered whole first. Firmware volume files and the
+        // load file protocols still go through a buffer.
+        //
+
+        Status = EfiCoreLocateDevicePath(&EfiFirmwareVolume2ProtocolGuid,
+                                         &HandleFilePath,
+                                         &DeviceHandle);
+
+        if (EFI_ERROR(Status)) {
+            Status = EfipCoreOpenImageFile(FilePath,
+                                           &FileName,
+                                           &(FileHandle.SourceSize),
+                                           &(FileHandle.File));
+
+            if (!EFI_ERROR(Status)) {
+                HandleFilePath = FilePath;
+                Status = EfiCoreLocateDevicePath(
+                                              &EfiSimpleFileSystemProtocolGuid,
+                                              &HandleFilePath,
+                                              &DeviceHandle);
+
+                if (EFI_ERROR(Status)) {
+                    DeviceHandle = NULL;
+                }
+            }
+        }
+
+        if (FileHandle.File == NULL) {
+            FileHandle.Source = EfipCoreGetFileBufferByFilePath(
                                                       BootPolicy,
                                                       FilePath,
                                                       &FileName,
                                                       &(FileHandle.SourceSize),
                                                       &AuthenticationStatus);
+        }
+
+        HandleFilePath = FilePath;
+        if (FileHandle.File != NULL) {
+            Status = EFI_SUCCESS;
 
-        if (FileHandle.Source == NULL) {
+        } else if (FileHandle.Source == NULL) {
             Status = EFI_NOT_FOUND;
 
         } else {
@@ -1011,6 +1141,10 @@ CoreLoadImageEnd:
         EfiCoreFreePool(FileHandle.Source);
     }
 
+    if (FileHandle.File != NULL) {
+        FileHandle.File->Close(FileHandle.File);
+    }
+
     if (FileName != NULL) {
         EfiCoreFreePool(FileName);
     }
@@ -1082,16 +1216,12 @@ Return Value:
 
     EFI_FV_FILE_ATTRIBUTES Attributes;
     EFI_DEVICE_PATH_PROTOCOL *DevicePathNode;
-    EFI_DEVICE_PATH_PROTOCOL *DevicePathNodeCopy;
     EFI_FILE_HANDLE FileHandle;
-    EFI_FILE_INFO *FileInformation;
-    UINTN FileInformationSize;
     UINTN FileNameSize;
     EFI_FIRMWARE_VOLUME2_PROTOCOL *FirmwareVolume;
     EFI_HANDLE Handle;
     UINT8 *ImageBuffer;
     UINTN ImageBufferSize;
-    EFI_FILE_HANDLE LastHandle;
     EFI_LOAD_FILE_PROTOCOL *LoadFile;
     EFI_LOAD_FILE2_PROTOCOL *LoadFile2;
     EFI_GUID *NameGuid;
@@ -1099,7 +1229,6 @@ Return Value:
     EFI_SECTION_TYPE SectionType;
     EFI_STATUS Status;
     EFI_FV_FILETYPE Type;
-    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *Volume;
 
     if ((FilePath == NULL) || (FileSize == NULL) ||
         (AuthenticationStatus == NULL)) {
@@ -1107,9 +1236,7 @@ Return Value:
         return NULL;
     }
 
-    DevicePathNodeCopy = NULL;
     NameGuid = NULL;
-    FileInformation = NULL;
     FileHandle = NULL;
     ImageBuffer = NULL;
     ImageBufferSize = 0;
@@ -1212,163 +1339,36 @@ Return Value:
     // Try to access the file via a file system interface.
     //
 
-    DevicePathNode = OriginalDevicePathNode;
-    Status = EfiLocateDevicePath(&EfiSimpleFileSystemProtocolGuid,
-                                 &DevicePathNode,
-                                 &Handle);
+    Status = EfipCoreOpenImageFile(OriginalDevicePathNode,
+                                   FileName,
+                                   &ImageBufferSize,
+                                   &FileHandle);
 
     if (!EFI_ERROR(Status)) {
-        Status = EfiHandleProtocol(Handle,
-                                   &EfiSimpleFileSystemProtocolGuid,
-                                   (VOID **)&Volume);
-
-        if (!EFI_ERROR(Status)) {
-
-            //
-            // Open the volume to get the file system handle.
-            //
-
-            Status = Volume->OpenVolume(Volume, &FileHandle);
-            if (!EFI_ERROR(Status)) {
-
-                //
-                // Duplicate the device path to avoid access to an unaligned
-                // device path node.
-                //
-
-                DevicePathNodeCopy = EfiCoreDuplicateDevicePath(DevicePathNode);
-                if (DevicePathNodeCopy == NULL) {
-                    FileHandle->Close(FileHandle);
-                    Status = EFI_OUT_OF_RESOURCES;
-                }
-
-                DevicePathNode = DevicePathNodeCopy;
-                while ((!EFI_ERROR(Status)) &&
-                       (EfiCoreIsDevicePathEnd(DevicePathNode) == FALSE)) {
-
-                    if ((EfiCoreGetDevicePathType(DevicePathNode) !=
-                         MEDIA_DEVICE_PATH) ||
-                        (EfiCoreGetDevicePathSubType(DevicePathNode) !=
-                         MEDIA_FILEPATH_DP)) {
-
-                        Status = EFI_UNSUPPORTED;
-                        break;
-                    }
-
-                    LastHandle = FileHandle;
-                    FileHandle = NULL;
-                    Status = LastHandle->Open(
-                            LastHandle,
-                            &FileHandle,
-                            ((FILEPATH_DEVICE_PATH *)DevicePathNode)->PathName,
-                            EFI_FILE_MODE_READ,
-                            0);
-
-                    LastHandle->Close(LastHandle);
-                    DevicePathNode =
-                                  EfiCoreGetNextDevicePathNode(DevicePathNode);
-                }
-
-                //
-                // If no error occurred, then the file was found. Load the
-                // file.
-                //
-
-                if (!EFI_ERROR(Status)) {
-                    FileInformation = NULL;
-                    FileInformationSize = 0;
-                    Status = FileHandle->GetInfo(FileHandle,
-                                                 &EfiFileInformationGuid,
-                                                 &FileInformationSize,
-                                                 FileInformation);
-
-                    if (Status == EFI_BUFFER_TOO_SMALL) {
-                        FileInformation =
-                                  EfiCoreAllocateBootPool(FileInformationSize);
-
-                        if (FileInformation == NULL) {
-                            Status = EFI_OUT_OF_RESOURCES;
-
-                        } else {
-                            Status = FileHandle->GetInfo(
-                                                       FileHandle,
-                                                       &EfiFileInformationGuid,
-                                                       &FileInformationSize,
-                                                       FileInformation);
-                        }
-                    }
-
-                    if ((!EFI_ERROR(Status)) && (FileInformation != NULL)) {
-
-                        //
-                        // Fail if it's a directory.
-                        //
-
-                        if ((FileInformation->Attribute & EFI_FILE_DIRECTORY) !=
-                            0) {
-
-                            Status = EFI_LOAD_ERROR;
-
-                        //
-                        // Allocate space for the file and read it in.
-                        //
-
-                        } else {
-                            ImageBuffer = EfiCoreAllocateBootPool(
-                                           (UINTN)(FileInformation->FileSize));
-
-                            if (ImageBuffer == NULL) {
-                                Status = EFI_OUT_OF_RESOURCES;
-
-                            } else {
-                                ImageBufferSize = FileInformation->FileSize;
-                                Status = FileHandle->Read(FileHandle,
-                                                          &ImageBufferSize,
-                                                          ImageBuffer);
-
-                                if (!EFI_ERROR(Status)) {
-
-                                    //
-                                    // Also read in the file name.
-                                    //
-
-                                    FileNameSize = EfiCoreStringLength(
-                                                    FileInformation->FileName);
-
-                                    FileNameSize = (FileNameSize + 1) *
-                                                   sizeof(CHAR16);
-
-                                    *FileName = EfiCoreAllocateBootPool(
-                                                                 FileNameSize);
-
-                                    if (*FileName != NULL) {
-                                        EfiCopyMem(*FileName,
-                                                   FileInformation->FileName,
-                                                   FileNameSize);
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-
-                if (FileInformation != NULL) {
-                    EfiCoreFreePool(FileInformation);
-                }
-
-                if (FileHandle != NULL) {
-                    FileHandle->Close(FileHandle);
-                }
+        ImageBuffer = EfiCoreAllocateBootPool(ImageBufferSize);
+        if (ImageBuffer == NULL) {
+            Status = EFI_OUT_OF_RESOURCES;
 
-                if (DevicePathNodeCopy != NULL) {
-                    EfiCoreFreePool(DevicePathNodeCopy);
-                }
-            }
+        } else {
+            Status = FileHandle->Read(FileHandle,
+                                      &ImageBufferSize,
+                                      ImageBuffer);
         }
 
+        FileHandle->Close(FileHandle);
         if (!EFI_ERROR(Status)) {
             goto CoreGetFileBufferByFilePathEnd;
         }
+
+        if (ImageBuffer != NULL) {
+            EfiCoreFreePool(ImageBuffer);
+            ImageBuffer = NULL;
+        }
+
+        if (*FileName != NULL) {
+            EfiCoreFreePool(*FileName);
+            *FileName = NULL;
+        }
     }
 
     //
@@ -1486,6 +1486,204 @@ CoreGetFileBufferByFilePathEnd:
     return ImageBuffer;
 }
 
+EFI_STATUS
+EfipCoreOpenImageFile (
+    CONST EFI_DEVICE_PATH_PROTOCOL *FilePath,
+    CHAR16 **FileName,
+    UINTN *FileSize,
+    EFI_FILE_HANDLE *File
+    )
+
+/*++
+
+Routine Description:
+
+    This routine opens a file for reading through the simple file system
+    protocol on the given device path.
+
+Arguments:
+
+    FilePath - Supplies a pointer to the device path of the file to open.
+
+    FileName - Supplies a pointer where a pointer to the file name will be
+        returned. The caller is responsible for freeing this buffer.
+
+    FileSize - Supplies a pointer where the size of the file in bytes will be
+        returned on success.
+
+    File - Supplies a pointer where the open file handle will be returned on
+        success. The caller is responsible for closing it.
+
+Return Value:
+
+    EFI_SUCCESS on success.
+
+    EFI_LOAD_ERROR if the path refers to a directory.
+
+    Other error codes if the path does not lead to a file system or the file
+    could not be opened.
+
+--*/
+
+{
+
+    EFI_DEVICE_PATH_PROTOCOL *DevicePathNode;
+    EFI_DEVICE_PATH_PROTOCOL *DevicePathNodeCopy;
+    EFI_FILE_HANDLE FileHandle;
+    EFI_FILE_INFO *FileInformation;
+    UINTN FileInformationSize;
+    UINTN FileNameSize;
+    EFI_HANDLE Handle;
+    EFI_FILE_HANDLE LastHandle;
+    EFI_DEVICE_PATH_PROTOCOL *OriginalDevicePathNode;
+    EFI_STATUS Status;
+    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *Volume;
+
+    DevicePathNodeCopy = NULL;
+    FileHandle = NULL;
+    FileInformation = NULL;
+    *FileName = NULL;
+    *File = NULL;
+    OriginalDevicePathNode = EfiCoreDuplicateDevicePath(FilePath);
+    if (OriginalDevicePathNode == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    DevicePathNode = OriginalDevicePathNode;
+    Status = EfiLocateDevicePath(&EfiSimpleFileSystemProtocolGuid,
+                                 &DevicePathNode,
+                                 &Handle);
+
+    if (EFI_ERROR(Status)) {
+        goto CoreOpenImageFileEnd;
+    }
+
+    Status = EfiHandleProtocol(Handle,
+                               &EfiSimpleFileSystemProtocolGuid,
+                               (VOID **)&Volume);
+
+    if (EFI_ERROR(Status)) {
+        goto CoreOpenImageFileEnd;
+    }
+
+    //
+    // Open the volume to get the file system handle.
+    //
+
+    Status = Volume->OpenVolume(Volume, &FileHandle);
+    if (EFI_ERROR(Status)) {
+        FileHandle = NULL;
+        goto CoreOpenImageFileEnd;
+    }
+
+    //
+    // Duplicate the device path to avoid access to an unaligned device path
+    // node.
+    //
+
+    DevicePathNodeCopy = EfiCoreDuplicateDevicePath(DevicePathNode);
+    if (DevicePathNodeCopy == NULL) {
+        Status = EFI_OUT_OF_RESOURCES;
+        goto CoreOpenImageFileEnd;
+    }
+
+    DevicePathNode = DevicePathNodeCopy;
+    while (EfiCoreIsDevicePathEnd(DevicePathNode) == FALSE) {
+        if ((EfiCoreGetDevicePathType(DevicePathNode) != MEDIA_DEVICE_PATH) ||
+            (EfiCoreGetDevicePathSubType(DevicePathNode) !=
+             MEDIA_FILEPATH_DP)) {
+
+            Status = EFI_UNSUPPORTED;
+            goto CoreOpenImageFileEnd;
+        }
+
+        LastHandle = FileHandle;
+        FileHandle = NULL;
+        Status = LastHandle->Open(
+                            LastHandle,
+                            &FileHandle,
+                            ((FILEPATH_DEVICE_PATH *)DevicePathNode)->PathName,
+                            EFI_FILE_MODE_READ,
+                            0);
+
+        LastHandle->Close(LastHandle);
+        if (EFI_ERROR(Status)) {
+            FileHandle = NULL;
+            goto CoreOpenImageFileEnd;
+        }
+
+        DevicePathNode = EfiCoreGetNextDevicePathNode(DevicePathNode);
+    }
+
+    //
+    // The file was found. Get its size and name.
+    //
+
+    FileInformationSize = 0;
+    Status = FileHandle->GetInfo(FileHandle,
+                                 &EfiFileInformationGuid,
+                                 &FileInformationSize,
+                                 FileInformation);
+
+    if (Status == EFI_BUFFER_TOO_SMALL) {
+        FileInformation = EfiCoreAllocateBootPool(FileInformationSize);
+        if (FileInformation == NULL) {
+            Status = EFI_OUT_OF_RESOURCES;
+            goto CoreOpenImageFileEnd;
+        }
+
+        Status = FileHandle->GetInfo(FileHandle,
+                                     &EfiFileInformationGuid,
+                                     &FileInformationSize,
+                                     FileInformation);
+    }
+
+    if ((EFI_ERROR(Status)) || (FileInformation == NULL)) {
+        if (!EFI_ERROR(Status)) {
+            Status = EFI_LOAD_ERROR;
+        }
+
+        goto CoreOpenImageFileEnd;
+    }
+
+    //
+    // Fail if it's a directory.
+    //
+
+    if ((FileInformation->Attribute & EFI_FILE_DIRECTORY) != 0) {
+        Status = EFI_LOAD_ERROR;
+        goto CoreOpenImageFileEnd;
+    }
+
+    FileNameSize = EfiCoreStringLength(FileInformation->FileName);
+    FileNameSize = (FileNameSize + 1) * sizeof(CHAR16);
+    *FileName = EfiCoreAllocateBootPool(FileNameSize);
+    if (*FileName != NULL) {
+        EfiCopyMem(*FileName, FileInformation->FileName, FileNameSize);
+    }
+
+    *FileSize = (UINTN)(FileInformation->FileSize);
+    *File = FileHandle;
+    FileHandle = NULL;
+    Status = EFI_SUCCESS;
+
+CoreOpenImageFileEnd:
+    if (FileInformation != NULL) {
+        EfiCoreFreePool(FileInformation);
+    }
+
+    if (FileHandle != NULL) {
+        FileHandle->Close(FileHandle);
+    }
+
+    if (DevicePathNodeCopy != NULL) {
+        EfiCoreFreePool(DevicePathNodeCopy);
+    }
+
+    EfiCoreFreePool(OriginalDevicePathNode);
+    return Status;
+}
+
 EFI_STATUS
 EfipCoreLoadPeImage (
     BOOLEAN BootPolicy,
@@ -1599,12 +1797,15 @@ Return Value:
         Image->ImagePageCount = EFI_SIZE_TO_PAGES(Size);
 
         //
-        // If image relocations have not been stripped, then load at any
-        // address. Otherwise, load at the address the image was linked at.
+        // Try to load the image at the address it was linked at, which lets
+        // relocation be skipped entirely. If that fails and relocations have
+        // not been stripped, then load at any address.
         //
 
         Status = EFI_OUT_OF_RESOURCES;
-        if (Image->ImageContext.RelocationsStripped != FALSE) {
+        if ((Image->ImageContext.RelocationsStripped != FALSE) ||
+            (Image->ImageContext.ImageAddress != 0)) {
+
             Status = EfiCoreAllocatePages(
                     AllocateAddress,
                     (EFI_MEMORY_TYPE)(Image->ImageContext.ImageCodeMemoryType),
@@ -1998,7 +2199,8 @@ EfipCoreReadImageFile (
 
 Routine Description:
 
-    This routine reads contents of the PE/COFF image file.
+    This routine reads contents of the PE/COFF image file, either from the
+    buffered copy or directly from the open file.
 
 Arguments:
 
@@ -2022,6 +2224,7 @@ Return Value:
 
     UINTN EndPosition;
     PEFI_IMAGE_FILE_HANDLE ImageHandle;
+    EFI_STATUS Status;
 
     if ((FileHandle == NULL) || (ReadSize == NULL) || (Buffer == NULL)) {
         return EFI_INVALID_PARAMETER;
@@ -2044,12 +2247,41 @@ Return Value:
         *ReadSize = 0;
     }
 
-    if (*ReadSize != 0) {
-        EfiCoreCopyMemory(Buffer,
-                          (CHAR8 *)ImageHandle->Source + FileOffset,
-                          *ReadSize);
+    if (*ReadSize == 0) {
+        return EFI_SUCCESS;
+    }
+
+    //
+    // Read straight from the file into the caller's buffer if the image was
+    // not buffered.
+    //
+
+    if (ImageHandle->File != NULL) {
+        if (ImageHandle->FilePosition != FileOffset) {
+            Status = ImageHandle->File->SetPosition(ImageHandle->File,
+                                                    FileOffset);
+
+            if (EFI_ERROR(Status)) {
+                return Status;
+            }
+
+            ImageHandle->FilePosition = FileOffset;
+        }
+
+        Status = ImageHandle->File->Read(ImageHandle->File, ReadSize, Buffer);
+        if (EFI_ERROR(Status)) {
+            ImageHandle->FilePosition = MAX_UINT64;
+            return Status;
+        }
+
+        ImageHandle->FilePosition += *ReadSize;
+        return EFI_SUCCESS;
     }
 
+    EfiCoreCopyMemory(Buffer,
+                      (CHAR8 *)ImageHandle->Source + FileOffset,
+                      *ReadSize);
+
     return EFI_SUCCESS;
 }
 
@@ -27,6 +27,7 @@ Author:
 
 #include "peimage.h"
 #include <minoca/uefi/protocol/loadimg.h>
+#include <minoca/uefi/protocol/sfilesys.h>
 
 //
 // ---------------------------------------------------------------- Definitions
@@ -75,7 +76,14 @@ Members:
 
     Source - Stores a pointer to the file buffer.
 
-    SourceSize - Stores the size of the buffer in bytes.
+    SourceSize - Stores the size of the buffer in bytes. If the image is being
+        read from an open file, this is the size of the file.
+
+    File - Stores an optional pointer to an open file the image is read from
+        directly, in which case there is no source buffer.
+
+    FilePosition - Stores the current position of the open file, used to avoid
+        needless seeks.
 
 --*/
 
@@ -84,6 +92,8 @@ typedef struct _EFI_IMAGE_FILE_HANDLE {
     BOOLEAN FreeBuffer;
     VOID *Source;
     UINTN SourceSize;
+    EFI_FILE_HANDLE File;
+    UINT64 FilePosition;
 } EFI_IMAGE_FILE_HANDLE, *PEFI_IMAGE_FILE_HANDLE;
 
 typedef
@@ -367,6 +367,7 @@ Return Value:
     OriginalTimeout = 0;
     KStatus = STATUS_SUCCESS;
     Step = 0;
+    EfiCorePerfStartPhase("Processor");
 
     //
     // Perform very basic processor initialization, preparing it to take
@@ -375,6 +376,7 @@ Return Value:
 
     EfipInitializeProcessor();
     Step += 1;
+    EfiCorePerfStartPhase("Debug");
     DebugModule = (PDEBUG_MODULE)EfiModuleBuffer;
 
     //
@@ -414,6 +416,7 @@ Return Value:
     //
 
     Step += 1;
+    EfiCorePerfStartPhase("RuntimeTemplate");
     INITIALIZE_LIST_HEAD(&(EfiRuntimeProtocol->ImageListHead));
     INITIALIZE_LIST_HEAD(&(EfiRuntimeProtocol->EventListHead));
     EfiRuntimeProtocol->MemoryDescriptorSize =
@@ -433,6 +436,7 @@ Return Value:
     }
 
     Step += 1;
+    EfiCorePerfStartPhase("HandleDb");
     EfiCoreInitializeHandleDatabase();
     EfiStatus = EfiCoreInitializeEventServices(0);
     if (EFI_ERROR(EfiStatus)) {
@@ -440,6 +444,7 @@ Return Value:
     }
 
     Step += 1;
+    EfiCorePerfStartPhase("Memory");
     EfiStatus = EfiCoreInitializeMemoryServices(FirmwareLowestAddress,
                                                 FirmwareSize,
                                                 StackBase,
@@ -450,28 +455,37 @@ Return Value:
     }
 
     Step += 1;
+    EfiCorePerfStartPhase("Events");
     EfiStatus = EfiCoreInitializeEventServices(1);
     if (EFI_ERROR(EfiStatus)) {
         goto InitializeEnd;
     }
 
     Step += 1;
+    EfiCorePerfStartPhase("Interrupts");
     EfiStatus = EfiCoreInitializeInterruptServices();
     if (EFI_ERROR(EfiStatus)) {
         goto InitializeEnd;
     }
 
     Step += 1;
+    EfiCorePerfStartPhase("Timers");
     EfiStatus = EfiCoreInitializeTimerServices();
     if (EFI_ERROR(EfiStatus)) {
         goto InitializeEnd;
     }
 
+    EfiStatus = EfiCoreInitializePerformanceTracing();
+    if (EFI_ERROR(EfiStatus)) {
+        goto InitializeEnd;
+    }
+
     //
     // Create the runtime services table.
     //
 
     Step += 1;
+    EfiCorePerfStartPhase("RuntimeTable");
     EfiBootServices = &EfiBootServicesTemplate;
     EfiRuntimeServices =
                       EfiCoreAllocateRuntimePool(sizeof(EFI_RUNTIME_SERVICES));
@@ -489,12 +503,14 @@ Return Value:
     //
 
     Step += 1;
+    EfiCorePerfStartPhase("SystemTable");
     EfiSystemTable = EfiCoreAllocateRuntimePool(sizeof(EFI_SYSTEM_TABLE));
     if (EfiSystemTable == NULL) {
         goto InitializeEnd;
     }
 
     Step += 1;
+    EfiCorePerfStartPhase("SystemTableInit");
     EfiCoreSetMemory(EfiSystemTable, sizeof(EFI_SYSTEM_TABLE), 0);
     EfiSystemTable->Hdr.Signature = EFI_SYSTEM_TABLE_SIGNATURE;
     EfiSystemTable->Hdr.Revision = EFI_SYSTEM_TABLE_REVISION;
@@ -507,6 +523,17 @@ Return Value:
     EfiSystemTable->ConIn = EfiConIn;
     EfiSystemTable->ConOut = EfiConOut;
 
+    //
+    // Set up buffered serial input now that timers are available.
+    //
+
+    Step += 1;
+    EfiCorePerfStartPhase("SerialConsole");
+    EfiStatus = EfiCoreInitializeSerialConsole(EfiConIn);
+    if (EFI_ERROR(EfiStatus)) {
+        goto InitializeEnd;
+    }
+
     //
     // Allow KD to use stall now that timer services are set up.
     //
@@ -524,12 +551,14 @@ Return Value:
     }
 
     Step += 1;
+    EfiCorePerfStartPhase("Notifies");
     EfiStatus = EfipCoreRegisterForInterestingNotifies();
     if (EFI_ERROR(EfiStatus)) {
         goto InitializeEnd;
     }
 
     Step += 1;
+    EfiCorePerfStartPhase("SectionExtraction");
     EfiStatus = EfiFvInitializeSectionExtraction(EfiFirmwareImageHandle,
                                                  EfiSystemTable);
 
@@ -538,6 +567,7 @@ Return Value:
     }
 
     Step += 1;
+    EfiCorePerfStartPhase("BlockSupport");
     EfiStatus = EfiFvInitializeBlockSupport(EfiFirmwareImageHandle,
                                             EfiSystemTable);
 
@@ -546,12 +576,14 @@ Return Value:
     }
 
     Step += 1;
+    EfiCorePerfStartPhase("Platform1");
     EfiStatus = EfiPlatformInitialize(1);
     if (EFI_ERROR(EfiStatus)) {
         goto InitializeEnd;
     }
 
     Step += 1;
+    EfiCorePerfStartPhase("FvDriver");
     EfiStatus = EfiFvDriverInit(EfiFirmwareImageHandle, EfiSystemTable);
     if (EFI_ERROR(EfiStatus)) {
         goto InitializeEnd;
@@ -562,24 +594,28 @@ Return Value:
     //
 
     Step += 1;
+    EfiCorePerfStartPhase("DiskIo");
     EfiStatus = EfiDiskIoDriverEntry(NULL, EfiSystemTable);
     if (EFI_ERROR(EfiStatus)) {
         goto InitializeEnd;
     }
 
     Step += 1;
+    EfiCorePerfStartPhase("Partition");
     EfiStatus = EfiPartitionDriverEntry(NULL, EfiSystemTable);
     if (EFI_ERROR(EfiStatus)) {
         goto InitializeEnd;
     }
 
     Step += 1;
+    EfiCorePerfStartPhase("Fat");
     EfiStatus = EfiFatDriverEntry(NULL, EfiSystemTable);
     if (EFI_ERROR(EfiStatus)) {
         goto InitializeEnd;
     }
 
     Step += 1;
+    EfiCorePerfStartPhase("GraphicsText");
     EfiStatus = EfiGraphicsTextDriverEntry(NULL, EfiSystemTable);
     if (EFI_ERROR(EfiStatus)) {
         goto InitializeEnd;
@@ -591,6 +627,7 @@ Return Value:
     //
 
     Step += 1;
+    EfiCorePerfStartPhase("FvEnumeration");
     EfiStatus = EfiPlatformEnumerateFirmwareVolumes();
     if (EFI_ERROR(EfiStatus)) {
         goto InitializeEnd;
@@ -598,6 +635,7 @@ Return Value:
 
     EfiStatus = EfiRuntimeCoreEntry(NULL, EfiSystemTable);
 
+    EfiCorePerfStartPhase("Dispatcher");
     EfiCoreInitializeDispatcher();
     EfiCoreDispatcher();
 
@@ -607,12 +645,14 @@ Return Value:
     //
 
     Step += 1;
+    EfiCorePerfStartPhase("Acpi");
     EfiStatus = EfiAcpiDriverEntry(NULL, EfiSystemTable);
     if (EFI_ERROR(EfiStatus)) {
         goto InitializeEnd;
     }
 
     Step += 1;
+    EfiCorePerfStartPhase("Smbios");
     EfiStatus = EfiSmbiosDriverEntry(NULL, EfiSystemTable);
     if (EFI_ERROR(EfiStatus)) {
         goto InitializeEnd;
@@ -623,12 +663,14 @@ Return Value:
     //
 
     Step += 1;
+    EfiCorePerfStartPhase("DeviceEnumeration");
     EfiStatus = EfiPlatformEnumerateDevices();
     if (EFI_ERROR(EfiStatus)) {
         goto InitializeEnd;
     }
 
     Step += 1;
+    EfiCorePerfStartPhase("Platform2");
     EfiStatus = EfiPlatformInitialize(2);
     if (EFI_ERROR(EfiStatus)) {
         goto InitializeEnd;
@@ -654,6 +696,7 @@ Return Value:
     //
 
     Step += 1;
+    EfiCorePerfStartPhase("Bds");
     EfiBdsEntry();
 
 InitializeEnd:
@@ -704,12 +747,21 @@ Return Value:
 {
 
     EFI_STATUS Status;
+    UINTN Token;
 
+    Token = EfiCorePerfStart(EfiPerfRecordExitBootServices, NULL, 0);
     Status = EfiCoreTerminateMemoryServices(MapKey);
     if (EFI_ERROR(Status)) {
+        EfiCorePerfEnd(Token);
         return Status;
     }
 
+    if (EfiDebugFirmware != FALSE) {
+        EfiCoreDumpProtocolStatistics();
+        EfiDiskIoDumpStatistics();
+        EfiCorePerfDump();
+    }
+
     EfiSetWatchdogTimer(0, 0, 0, NULL);
     EfiCoreTerminateTimerServices();
     EfiCoreTerminateInterruptServices();
@@ -731,6 +783,7 @@ Return Value:
     EfiSetMem(EfiBootServices, sizeof(EFI_BOOT_SERVICES), 0);
     EfiBootServices = NULL;
     EfiRuntimeProtocol->AtRuntime = TRUE;
+    EfiCorePerfEnd(Token);
     return Status;
 }
 
@@ -65,9 +65,40 @@ typedef struct _EFI_MEMORY_TYPE_INFORMATION {
     UINT32 PageCount;
 } EFI_MEMORY_TYPE_INFORMATION, *PEFI_MEMORY_TYPE_INFORMATION;
 
+/*++
+
+Structure Description:
+
+    This structure stores a single descriptor in the memory map.
+
+Members:
+
+    Node - Stores the node in the memory map tree, which is ordered by physical
+        address.
+
+    FreeNode - Stores the node in the free memory tree, which also is ordered
+        by physical address but only contains conventional memory. This is
+        only valid while the entry is in the map and describes free memory.
+
+    ListEntry - Stores pointers to the next and previous entries on the free
+        descriptor list, when the entry is not in use.
+
+    Temporary - Stores a boolean indicating if this entry comes from the
+        temporary descriptor stack.
+
+    InMap - Stores a boolean indicating if this entry is currently inserted in
+        the memory map.
+
+    Descriptor - Stores the memory descriptor itself.
+
+--*/
+
 typedef struct _EFI_MEMORY_MAP_ENTRY {
+    RED_BLACK_TREE_NODE Node;
+    RED_BLACK_TREE_NODE FreeNode;
     LIST_ENTRY ListEntry;
     BOOL Temporary;
+    BOOL InMap;
     EFI_MEMORY_DESCRIPTOR Descriptor;
 } EFI_MEMORY_MAP_ENTRY, *PEFI_MEMORY_MAP_ENTRY;
 
@@ -122,11 +153,35 @@ EfipCoreMergeMemoryMapDescriptor (
     UINTN DescriptorSize
     );
 
+PEFI_MEMORY_MAP_ENTRY
+EfipCoreFindMemoryMapEntry (
+    EFI_PHYSICAL_ADDRESS Address
+    );
+
+VOID
+EfipCoreInsertMemoryMapEntry (
+    PEFI_MEMORY_MAP_ENTRY Entry
+    );
+
 VOID
 EfipCoreRemoveMemoryMapEntry (
     PEFI_MEMORY_MAP_ENTRY Entry
     );
 
+COMPARISON_RESULT
+EfipCoreCompareMemoryMapNodes (
+    PRED_BLACK_TREE Tree,
+    PRED_BLACK_TREE_NODE FirstNode,
+    PRED_BLACK_TREE_NODE SecondNode
+    );
+
+COMPARISON_RESULT
+EfipCoreCompareFreeMemoryNodes (
+    PRED_BLACK_TREE Tree,
+    PRED_BLACK_TREE_NODE FirstNode,
+    PRED_BLACK_TREE_NODE SecondNode
+    );
+
 VOID
 EfipCoreFlushMemoryMapStack (
     VOID
@@ -161,11 +216,18 @@ EfipDebugPrintMemoryDescriptor (
 EFI_LOCK EfiMemoryLock;
 
 //
-// Store the memory map itself, which is just a list of EFI_MEMORY_MAP_ENTRY
-// structures.
+// Store the memory map itself, which is a tree of EFI_MEMORY_MAP_ENTRY
+// structures ordered by physical address.
+//
+
+RED_BLACK_TREE EfiMemoryMap;
+
+//
+// Store the tree of free (conventional memory) entries, also ordered by
+// physical address. Page searches only need to visit these.
 //
 
-LIST_ENTRY EfiMemoryMap;
+RED_BLACK_TREE EfiFreeMemoryMap;
 
 //
 // Store the memory map key, essentially a sequence number on the memory map.
@@ -387,37 +449,17 @@ Return Value:
 {
 
     UINTN Alignment;
-    PLIST_ENTRY CurrentEntry;
     PEFI_MEMORY_MAP_ENTRY Entry;
-    UINT64 EntryEnd;
-    UINT64 EntryStart;
     EFI_STATUS Status;
 
     EfiCoreAcquireLock(&EfiMemoryLock);
-    Entry = NULL;
-    CurrentEntry = EfiMemoryMap.Next;
-    while (CurrentEntry != &EfiMemoryMap) {
-        Entry = LIST_VALUE(CurrentEntry, EFI_MEMORY_MAP_ENTRY, ListEntry);
-        EntryStart = Entry->Descriptor.PhysicalStart;
-        EntryEnd = EntryStart +
-                   (Entry->Descriptor.NumberOfPages << EFI_PAGE_SHIFT) - 1;
-
-        if ((EntryStart <= Memory) && (EntryEnd > Memory)) {
-            break;
-        }
-
-        CurrentEntry = CurrentEntry->Next;
-    }
-
-    if (CurrentEntry == &EfiMemoryMap) {
+    Entry = EfipCoreFindMemoryMapEntry(Memory);
+    if (Entry == NULL) {
         Status = EFI_NOT_FOUND;
         goto CoreFreePagesEnd;
     }
 
     Alignment = EFI_DEFAULT_PAGE_ALLOCATION_ALIGNMENT;
-
-    ASSERT(Entry != NULL);
-
     if ((Entry->Descriptor.Type == EfiACPIReclaimMemory) ||
         (Entry->Descriptor.Type == EfiACPIMemoryNVS) ||
         (Entry->Descriptor.Type == EfiRuntimeServicesCode) ||
@@ -492,11 +534,11 @@ Return Value:
 {
 
     UINTN BufferSize;
-    PLIST_ENTRY CurrentEntry;
     PEFI_MEMORY_MAP_ENTRY Entry;
     UINT64 EntryEnd;
     UINT64 EntryStart;
     EFI_MEMORY_DESCRIPTOR *MemoryMapStart;
+    PRED_BLACK_TREE_NODE Node;
     UINTN Size;
     EFI_STATUS Status;
     EFI_MEMORY_TYPE Type;
@@ -528,11 +570,10 @@ Return Value:
     //
 
     BufferSize = 0;
-    CurrentEntry = EfiMemoryMap.Next;
-    while (CurrentEntry != &EfiMemoryMap) {
-        Entry = LIST_VALUE(CurrentEntry, EFI_MEMORY_MAP_ENTRY, ListEntry);
+    Node = RtlRedBlackTreeGetLowestNode(&EfiMemoryMap);
+    while (Node != NULL) {
         BufferSize += Size;
-        CurrentEntry = CurrentEntry->Next;
+        Node = RtlRedBlackTreeGetNextNode(&EfiMemoryMap, FALSE, Node);
     }
 
     if (*MemoryMapSize < BufferSize) {
@@ -551,10 +592,10 @@ Return Value:
 
     EfiCoreSetMemory(MemoryMap, BufferSize, 0);
     MemoryMapStart = MemoryMap;
-    CurrentEntry = EfiMemoryMap.Next;
-    while (CurrentEntry != &EfiMemoryMap) {
-        Entry = LIST_VALUE(CurrentEntry, EFI_MEMORY_MAP_ENTRY, ListEntry);
-        CurrentEntry = CurrentEntry->Next;
+    Node = RtlRedBlackTreeGetLowestNode(&EfiMemoryMap);
+    while (Node != NULL) {
+        Entry = RED_BLACK_TREE_VALUE(Node, EFI_MEMORY_MAP_ENTRY, Node);
+        Node = RtlRedBlackTreeGetNextNode(&EfiMemoryMap, FALSE, Node);
 
         ASSERT(Entry->Descriptor.VirtualStart == 0);
 
@@ -739,7 +780,11 @@ Return Value:
     EFI_STATUS Status;
 
     EfiCoreInitializeLock(&EfiMemoryLock, TPL_NOTIFY);
-    INITIALIZE_LIST_HEAD(&EfiMemoryMap);
+    RtlRedBlackTreeInitialize(&EfiMemoryMap, 0, EfipCoreCompareMemoryMapNodes);
+    RtlRedBlackTreeInitialize(&EfiFreeMemoryMap,
+                              0,
+                              EfipCoreCompareFreeMemoryNodes);
+
     INITIALIZE_LIST_HEAD(&EfiFreeDescriptorList);
 
     //
@@ -861,17 +906,17 @@ Return Value:
 
 {
 
-    PLIST_ENTRY CurrentEntry;
     PEFI_MEMORY_MAP_ENTRY Entry;
+    PRED_BLACK_TREE_NODE Node;
     EFI_STATUS Status;
 
     Status = EFI_SUCCESS;
     EfiCoreAcquireLock(&EfiMemoryLock);
     if (MapKey == EfiMemoryMapKey) {
-        CurrentEntry = EfiMemoryMap.Next;
-        while (CurrentEntry != &EfiMemoryMap) {
-            Entry = LIST_VALUE(CurrentEntry, EFI_MEMORY_MAP_ENTRY, ListEntry);
-            CurrentEntry = CurrentEntry->Next;
+        Node = RtlRedBlackTreeGetLowestNode(&EfiMemoryMap);
+        while (Node != NULL) {
+            Entry = RED_BLACK_TREE_VALUE(Node, EFI_MEMORY_MAP_ENTRY, Node);
+            Node = RtlRedBlackTreeGetNextNode(&EfiMemoryMap, FALSE, Node);
             if ((Entry->Descriptor.Attribute & EFI_MEMORY_RUNTIME) != 0) {
                 if ((Entry->Descriptor.Type == EfiACPIReclaimMemory) ||
                     (Entry->Descriptor.Type == EfiACPIMemoryNVS)) {
@@ -1235,11 +1280,12 @@ Return Value:
 {
 
     UINT64 ByteCount;
-    PLIST_ENTRY CurrentEntry;
     PEFI_MEMORY_MAP_ENTRY Entry;
     UINT64 EntryEnd;
     UINT64 EntrySize;
     UINT64 EntryStart;
+    PRED_BLACK_TREE_NODE Node;
+    EFI_MEMORY_MAP_ENTRY SearchEntry;
     UINT64 Target;
 
     if ((MaxAddress < EFI_PAGE_MASK) || (PageCount == 0)) {
@@ -1256,25 +1302,39 @@ Return Value:
         MaxAddress |= EFI_PAGE_MASK;
     }
 
+    //
+    // Walk the free descriptors downwards starting at the maximum address.
+    // Descriptors never overlap, so the clipped end addresses only decrease
+    // along the way, and the first descriptor that fits is the highest one.
+    //
+
     ByteCount = PageCount << EFI_PAGE_SHIFT;
     Target = 0;
-    CurrentEntry = EfiMemoryMap.Next;
-    while (CurrentEntry != &EfiMemoryMap) {
-        Entry = LIST_VALUE(CurrentEntry, EFI_MEMORY_MAP_ENTRY, ListEntry);
-        CurrentEntry = CurrentEntry->Next;
-        if (Entry->Descriptor.Type != EfiConventionalMemory) {
-            continue;
-        }
+    SearchEntry.Descriptor.PhysicalStart = MaxAddress;
+    Node = RtlRedBlackTreeSearchClosest(&EfiFreeMemoryMap,
+                                        &(SearchEntry.FreeNode),
+                                        FALSE);
+
+    while (Node != NULL) {
+        Entry = RED_BLACK_TREE_VALUE(Node, EFI_MEMORY_MAP_ENTRY, FreeNode);
+        Node = RtlRedBlackTreeGetNextNode(&EfiFreeMemoryMap, TRUE, Node);
+
+        ASSERT(Entry->Descriptor.Type == EfiConventionalMemory);
 
         EntryStart = Entry->Descriptor.PhysicalStart;
         EntryEnd = EntryStart +
                    (Entry->Descriptor.NumberOfPages << EFI_PAGE_SHIFT);
 
         //
-        // Skip descriptors that are outside of the requested range.
+        // Skip descriptors that are outside of the requested range. Everything
+        // further down is below the minimum too.
         //
 
-        if ((EntryStart >= MaxAddress) || (EntryEnd < MinAddress)) {
+        if (EntryEnd < MinAddress) {
+            break;
+        }
+
+        if (EntryStart >= MaxAddress) {
             continue;
         }
 
@@ -1287,25 +1347,23 @@ Return Value:
         }
 
         EntryEnd = ((EntryEnd + 1) & (~(Alignment - 1))) - 1;
+        if (EntryEnd < EntryStart) {
+            continue;
+        }
 
         //
         // If the entry is big enough, and does not dip below the minimum
-        // address, then it works.
+        // address, then it works. If it's big enough but dips below the
+        // minimum, then all lower entries will too.
         //
 
         EntrySize = EntryEnd - EntryStart + 1;
         if (EntrySize >= ByteCount) {
-            if ((EntryEnd - ByteCount + 1) < MinAddress) {
-                continue;
-            }
-
-            //
-            // If this is the highest match, save it.
-            //
-
-            if (EntryEnd > Target) {
+            if ((EntryEnd - ByteCount + 1) >= MinAddress) {
                 Target = EntryEnd;
             }
+
+            break;
         }
     }
 
@@ -1360,7 +1418,6 @@ Return Value:
 
     UINT64 Attribute;
     UINT64 ByteCount;
-    PLIST_ENTRY CurrentEntry;
     UINT64 End;
     PEFI_MEMORY_MAP_ENTRY Entry;
     UINT64 EntryEnd;
@@ -1390,27 +1447,18 @@ Return Value:
     while (Start < End) {
 
         //
-        // Loop through looking for the descriptor that contains this range.
+        // Look up the descriptor that contains this range.
         //
 
-        CurrentEntry = EfiMemoryMap.Next;
-        while (CurrentEntry != &EfiMemoryMap) {
-            Entry = LIST_VALUE(CurrentEntry, EFI_MEMORY_MAP_ENTRY, ListEntry);
-            EntryStart = Entry->Descriptor.PhysicalStart;
-            EntryEnd = EntryStart +
-                       (Entry->Descriptor.NumberOfPages << EFI_PAGE_SHIFT) - 1;
-
-            if ((EntryStart <= Start) && (EntryEnd > Start)) {
-                break;
-            }
-
-            CurrentEntry = CurrentEntry->Next;
-        }
-
-        if (CurrentEntry == &EfiMemoryMap) {
+        Entry = EfipCoreFindMemoryMapEntry(Start);
+        if (Entry == NULL) {
             return EFI_NOT_FOUND;
         }
 
+        EntryStart = Entry->Descriptor.PhysicalStart;
+        EntryEnd = EntryStart +
+                   (Entry->Descriptor.NumberOfPages << EFI_PAGE_SHIFT) - 1;
+
         //
         // Convert the range to the end, or to the end of the descriptor if the
         // range covers more than the descriptor.
@@ -1512,7 +1560,7 @@ Return Value:
 
             ASSERT(EntryStart < EntryEnd);
 
-            INSERT_BEFORE(&(NewEntry->ListEntry), &EfiMemoryMap);
+            EfipCoreInsertMemoryMapEntry(NewEntry);
         }
 
         Attribute = Entry->Descriptor.Attribute;
@@ -1583,10 +1631,7 @@ Return Value:
 
 {
 
-    PLIST_ENTRY CurrentEntry;
     PEFI_MEMORY_MAP_ENTRY Entry;
-    UINT64 EntryEnd;
-    UINT64 EntryStart;
     PEFI_MEMORY_MAP_ENTRY NewEntry;
 
     ASSERT((Start & EFI_PAGE_MASK) == 0);
@@ -1620,33 +1665,31 @@ Return Value:
     EfipCoreNotifySignalList(&EfiEventMemoryMapChangeGuid);
 
     //
-    // Look for descriptors to coalesce with.
+    // Coalesce with the descriptors immediately below and above the range if
+    // they have the same type and attributes.
     //
 
-    CurrentEntry = EfiMemoryMap.Next;
-    while (CurrentEntry != &EfiMemoryMap) {
-        Entry = LIST_VALUE(CurrentEntry, EFI_MEMORY_MAP_ENTRY, ListEntry);
-        CurrentEntry = CurrentEntry->Next;
-        if (Entry->Descriptor.Type != Type) {
-            continue;
-        }
+    if (Start != 0) {
+        Entry = EfipCoreFindMemoryMapEntry(Start - 1);
+        if ((Entry != NULL) &&
+            (Entry->Descriptor.Type == Type) &&
+            (Entry->Descriptor.Attribute == Attribute)) {
 
-        if (Entry->Descriptor.Attribute != Attribute) {
-            continue;
+            Start = Entry->Descriptor.PhysicalStart;
+            EfipCoreRemoveMemoryMapEntry(Entry);
         }
+    }
 
-        EntryStart = Entry->Descriptor.PhysicalStart;
-        EntryEnd = EntryStart +
-                   (Entry->Descriptor.NumberOfPages << EFI_PAGE_SHIFT) - 1;
+    Entry = EfipCoreFindMemoryMapEntry(End + 1);
+    if ((Entry != NULL) &&
+        (Entry->Descriptor.PhysicalStart == End + 1) &&
+        (Entry->Descriptor.Type == Type) &&
+        (Entry->Descriptor.Attribute == Attribute)) {
 
-        if (EntryEnd + 1 == EntryStart) {
-            Start = EntryStart;
-            EfipCoreRemoveMemoryMapEntry(Entry);
+        End = Entry->Descriptor.PhysicalStart +
+              (Entry->Descriptor.NumberOfPages << EFI_PAGE_SHIFT) - 1;
 
-        } else if (EntryStart == End + 1) {
-            End = EntryEnd;
-            EfipCoreRemoveMemoryMapEntry(Entry);
-        }
+        EfipCoreRemoveMemoryMapEntry(Entry);
     }
 
     //
@@ -1663,7 +1706,7 @@ Return Value:
     NewEntry->Descriptor.VirtualStart = 0;
     NewEntry->Descriptor.NumberOfPages = (End + 1 - Start) >> EFI_PAGE_SHIFT;
     NewEntry->Descriptor.Attribute = Attribute;
-    INSERT_BEFORE(&(NewEntry->ListEntry), &EfiMemoryMap);
+    EfipCoreInsertMemoryMapEntry(NewEntry);
     return;
 }
 
@@ -1757,6 +1800,96 @@ Return Value:
     return LastDescriptor;
 }
 
+PEFI_MEMORY_MAP_ENTRY
+EfipCoreFindMemoryMapEntry (
+    EFI_PHYSICAL_ADDRESS Address
+    )
+
+/*++
+
+Routine Description:
+
+    This routine finds the memory map entry containing the given address.
+
+Arguments:
+
+    Address - Supplies the physical address to look up.
+
+Return Value:
+
+    Returns a pointer to the memory map entry covering the address.
+
+    NULL if no descriptor covers the given address.
+
+--*/
+
+{
+
+    PEFI_MEMORY_MAP_ENTRY Entry;
+    UINT64 EntryEnd;
+    PRED_BLACK_TREE_NODE Node;
+    EFI_MEMORY_MAP_ENTRY SearchEntry;
+
+    //
+    // Find the entry with the highest start address at or below the given
+    // address. It's the only one that could contain it.
+    //
+
+    SearchEntry.Descriptor.PhysicalStart = Address;
+    Node = RtlRedBlackTreeSearchClosest(&EfiMemoryMap,
+                                        &(SearchEntry.Node),
+                                        FALSE);
+
+    if (Node == NULL) {
+        return NULL;
+    }
+
+    Entry = RED_BLACK_TREE_VALUE(Node, EFI_MEMORY_MAP_ENTRY, Node);
+    EntryEnd = Entry->Descriptor.PhysicalStart +
+               (Entry->Descriptor.NumberOfPages << EFI_PAGE_SHIFT) - 1;
+
+    if (EntryEnd < Address) {
+        return NULL;
+    }
+
+    return Entry;
+}
+
+VOID
+EfipCoreInsertMemoryMapEntry (
+    PEFI_MEMORY_MAP_ENTRY Entry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine inserts a descriptor entry into the memory map, and into the
+    free memory tree if it describes conventional memory.
+
+Arguments:
+
+    Entry - Supplies a pointer to the entry to insert.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ASSERT(Entry->InMap == FALSE);
+
+    RtlRedBlackTreeInsert(&EfiMemoryMap, &(Entry->Node));
+    if (Entry->Descriptor.Type == EfiConventionalMemory) {
+        RtlRedBlackTreeInsert(&EfiFreeMemoryMap, &(Entry->FreeNode));
+    }
+
+    Entry->InMap = TRUE;
+    return;
+}
+
 VOID
 EfipCoreRemoveMemoryMapEntry (
     PEFI_MEMORY_MAP_ENTRY Entry
@@ -1781,8 +1914,14 @@ Return Value:
 
 {
 
-    LIST_REMOVE(&(Entry->ListEntry));
-    Entry->ListEntry.Next = NULL;
+    ASSERT(Entry->InMap != FALSE);
+
+    RtlRedBlackTreeRemove(&EfiMemoryMap, &(Entry->Node));
+    if (Entry->Descriptor.Type == EfiConventionalMemory) {
+        RtlRedBlackTreeRemove(&EfiFreeMemoryMap, &(Entry->FreeNode));
+    }
+
+    Entry->InMap = FALSE;
     if (Entry->Temporary == FALSE) {
         INSERT_BEFORE(&(Entry->ListEntry), &EfiFreeDescriptorList);
     }
@@ -1814,8 +1953,6 @@ Return Value:
 
 {
 
-    PLIST_ENTRY CurrentEntry;
-    PEFI_MEMORY_MAP_ENTRY Entry;
     PEFI_MEMORY_MAP_ENTRY NewEntry;
     PEFI_MEMORY_MAP_ENTRY StackEntry;
 
@@ -1840,36 +1977,15 @@ Return Value:
         // If it's in the memory map, then create a replacement copy.
         //
 
-        if (StackEntry->ListEntry.Next != NULL) {
-            LIST_REMOVE(&(StackEntry->ListEntry));
-            StackEntry->ListEntry.Next = NULL;
-            EfiCoreCopyMemory(NewEntry,
-                              StackEntry,
-                              sizeof(EFI_MEMORY_MAP_ENTRY));
+        if (StackEntry->InMap != FALSE) {
+            EfipCoreRemoveMemoryMapEntry(StackEntry);
+            EfiCoreCopyMemory(&(NewEntry->Descriptor),
+                              &(StackEntry->Descriptor),
+                              sizeof(EFI_MEMORY_DESCRIPTOR));
 
             NewEntry->Temporary = FALSE;
-
-            //
-            // Find the proper insertion location.
-            //
-
-            CurrentEntry = EfiMemoryMap.Next;
-            while (CurrentEntry != &EfiMemoryMap) {
-                Entry = LIST_VALUE(CurrentEntry,
-                                   EFI_MEMORY_MAP_ENTRY,
-                                   ListEntry);
-
-                if ((Entry->Temporary == FALSE) &&
-                    (Entry->Descriptor.PhysicalStart >
-                     NewEntry->Descriptor.PhysicalStart)) {
-
-                    break;
-                }
-
-                CurrentEntry = CurrentEntry->Next;
-            }
-
-            INSERT_BEFORE(&(NewEntry->ListEntry), CurrentEntry);
+            NewEntry->InMap = FALSE;
+            EfipCoreInsertMemoryMapEntry(NewEntry);
 
         //
         // This descriptor was already removed, so the descriptor just
@@ -1953,6 +2069,104 @@ Return Value:
     return Entry;
 }
 
+COMPARISON_RESULT
+EfipCoreCompareMemoryMapNodes (
+    PRED_BLACK_TREE Tree,
+    PRED_BLACK_TREE_NODE FirstNode,
+    PRED_BLACK_TREE_NODE SecondNode
+    )
+
+/*++
+
+Routine Description:
+
+    This routine compares two memory map tree nodes by physical address.
+
+Arguments:
+
+    Tree - Supplies a pointer to the Red-Black tree that owns both nodes.
+
+    FirstNode - Supplies a pointer to the left side of the comparison.
+
+    SecondNode - Supplies a pointer to the second side of the comparison.
+
+Return Value:
+
+    Same if the two nodes have the same value.
+
+    Ascending if the first node is less than the second node.
+
+    Descending if the second node is less than the first node.
+
+--*/
+
+{
+
+    PEFI_MEMORY_MAP_ENTRY First;
+    PEFI_MEMORY_MAP_ENTRY Second;
+
+    First = RED_BLACK_TREE_VALUE(FirstNode, EFI_MEMORY_MAP_ENTRY, Node);
+    Second = RED_BLACK_TREE_VALUE(SecondNode, EFI_MEMORY_MAP_ENTRY, Node);
+    if (First->Descriptor.PhysicalStart > Second->Descriptor.PhysicalStart) {
+        return ComparisonResultDescending;
+    }
+
+    if (First->Descriptor.PhysicalStart < Second->Descriptor.PhysicalStart) {
+        return ComparisonResultAscending;
+    }
+
+    return ComparisonResultSame;
+}
+
+COMPARISON_RESULT
+EfipCoreCompareFreeMemoryNodes (
+    PRED_BLACK_TREE Tree,
+    PRED_BLACK_TREE_NODE FirstNode,
+    PRED_BLACK_TREE_NODE SecondNode
+    )
+
+/*++
+
+Routine Description:
+
+    This routine compares two free memory tree nodes by physical address.
+
+Arguments:
+
+    Tree - Supplies a pointer to the Red-Black tree that owns both nodes.
+
+    FirstNode - Supplies a pointer to the left side of the comparison.
+
+    SecondNode - Supplies a pointer to the second side of the comparison.
+
+Return Value:
+
+    Same if the two nodes have the same value.
+
+    Ascending if the first node is less than the second node.
+
+    Descending if the second node is less than the first node.
+
+--*/
+
+{
+
+    PEFI_MEMORY_MAP_ENTRY First;
+    PEFI_MEMORY_MAP_ENTRY Second;
+
+    First = RED_BLACK_TREE_VALUE(FirstNode, EFI_MEMORY_MAP_ENTRY, FreeNode);
+    Second = RED_BLACK_TREE_VALUE(SecondNode, EFI_MEMORY_MAP_ENTRY, FreeNode);
+    if (First->Descriptor.PhysicalStart > Second->Descriptor.PhysicalStart) {
+        return ComparisonResultDescending;
+    }
+
+    if (First->Descriptor.PhysicalStart < Second->Descriptor.PhysicalStart) {
+        return ComparisonResultAscending;
+    }
+
+    return ComparisonResultSame;
+}
+
 VOID
 EfipDebugPrintMemoryMap (
     EFI_MEMORY_DESCRIPTOR *Map,
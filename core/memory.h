@@ -314,7 +314,8 @@ EfiCoreCopyMemory (
 
 Routine Description:
 
-    This routine copies the contents of one buffer to another.
+    This routine copies the contents of one buffer to another. The buffers
+    may overlap.
 
 Arguments:
 
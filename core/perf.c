@@ -0,0 +1,1086 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    perf.c
+
+Abstract:
+
+    This module implements boot performance tracing. Boot phases, image loads
+    and starts, driver binding starts, and block I/O requests are stamped with
+    the time counter into preallocated records. At ReadyToBoot the records are
+    published to the OS through the ACPI firmware performance data table.
+
+Environment:
+
+    Firmware
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include "ueficore.h"
+#include <stdio.h>
+#include <minoca/fw/acpitabs.h>
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the number of records in the trace ring. This must be a power of
+// two. Once the ring is full the oldest records are overwritten.
+//
+
+#ifdef CONFIG_PERF_TRACE_RECORDS
+
+#define EFI_PERF_RECORD_COUNT CONFIG_PERF_TRACE_RECORDS
+
+#else
+
+#define EFI_PERF_RECORD_COUNT 512
+
+#endif
+
+#if (EFI_PERF_RECORD_COUNT & (EFI_PERF_RECORD_COUNT - 1)) != 0
+
+#error EFI_PERF_RECORD_COUNT must be a power of two.
+
+#endif
+
+//
+// Define the number of boot phases that can be recorded. Phases are kept
+// apart from the ring so that block I/O never pushes them out.
+//
+
+#define EFI_PERF_PHASE_COUNT 32
+
+//
+// Define the number of name characters kept per record, including the null
+// terminator.
+//
+
+#define EFI_PERF_NAME_SIZE 24
+
+//
+// Define the firmware-specific string event record, which carries one start
+// or end timestamp along with a name.
+//
+
+#define EFI_PERF_STRING_EVENT_RECORD_TYPE 0x1011
+#define EFI_PERF_STRING_EVENT_RECORD_REVISION 0x01
+
+//
+// Define the progress identifiers that mark the start of each kind of event.
+// The matching end identifier is always one greater.
+//
+
+#define EFI_PERF_PROGRESS_MODULE_START 0x01
+#define EFI_PERF_PROGRESS_LOAD_IMAGE_START 0x03
+#define EFI_PERF_PROGRESS_BINDING_START 0x05
+#define EFI_PERF_PROGRESS_IN_MODULE_START 0x40
+#define EFI_PERF_PROGRESS_CROSS_MODULE_START 0x50
+
+//
+// Define the largest size of the boot performance table, assuming every
+// record is complete and carries a full name.
+//
+
+#define EFI_PERF_BOOT_TABLE_SIZE                                    \
+    (sizeof(FBPT) + sizeof(FPDT_BASIC_BOOT_RECORD) +                \
+     ((EFI_PERF_PHASE_COUNT + EFI_PERF_RECORD_COUNT) * 2 *          \
+      sizeof(EFI_PERF_STRING_EVENT_RECORD)))
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+/*++
+
+Structure Description:
+
+    This structure stores a single trace record.
+
+Members:
+
+    Sequence - Stores the sequence number of the event occupying the record,
+        which is also the token handed back to the caller. This is zero while
+        the record is being filled in.
+
+    Type - Stores the kind of event.
+
+    Data - Stores the type-specific data for the event.
+
+    StartTime - Stores the time counter value when the event began.
+
+    EndTime - Stores the time counter value when the event finished, or zero
+        if it has not finished.
+
+    Name - Stores the truncated name of the event.
+
+--*/
+
+typedef struct _EFI_PERF_RECORD {
+    volatile ULONG Sequence;
+    EFI_PERF_RECORD_TYPE Type;
+    UINT64 Data;
+    UINT64 StartTime;
+    volatile UINT64 EndTime;
+    CHAR8 Name[EFI_PERF_NAME_SIZE];
+} EFI_PERF_RECORD, *PEFI_PERF_RECORD;
+
+/*++
+
+Structure Description:
+
+    This structure defines a string event record in the boot performance
+    table. Only as much of the string as is used, including its terminator,
+    is stored.
+
+Members:
+
+    Header - Stores the record header.
+
+    ProgressId - Stores the progress identifier of the event.
+
+    ApicId - Stores the APIC ID of the processor that logged the event.
+
+    Timestamp - Stores the time of the event in nanoseconds.
+
+    Guid - Stores the GUID of the module that logged the event.
+
+    String - Stores the null terminated name of the event.
+
+--*/
+
+typedef struct _EFI_PERF_STRING_EVENT_RECORD {
+    FPDT_RECORD_HEADER Header;
+    UINT16 ProgressId;
+    UINT32 ApicId;
+    UINT64 Timestamp;
+    EFI_GUID Guid;
+    CHAR8 String[EFI_PERF_NAME_SIZE];
+} PACKED EFI_PERF_STRING_EVENT_RECORD, *PEFI_PERF_STRING_EVENT_RECORD;
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+EFIAPI
+VOID
+EfipCorePerfReadyToBoot (
+    EFI_EVENT Event,
+    VOID *Context
+    );
+
+VOID
+EfipCorePerfBuildBootTable (
+    VOID
+    );
+
+UINT8 *
+EfipCorePerfAddStringEvent (
+    UINT8 *Buffer,
+    PEFI_PERF_RECORD Record
+    );
+
+EFI_STATUS
+EfipCorePerfInstallFpdt (
+    VOID
+    );
+
+VOID
+EfipCorePerfUpdateBootRecord (
+    EFI_PERF_RECORD_TYPE Type,
+    BOOLEAN End,
+    UINT64 Time
+    );
+
+BOOLEAN
+EfipCorePerfReadRecord (
+    ULONG Sequence,
+    PEFI_PERF_RECORD Record
+    );
+
+VOID
+EfipCorePerfPrintRecord (
+    PEFI_PERF_RECORD Record
+    );
+
+VOID
+EfipCorePerfCopyName (
+    CHAR8 *Destination,
+    CONST CHAR8 *Source
+    );
+
+UINT64
+EfipCorePerfCounterToNanoseconds (
+    UINT64 Counter
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// Store the boot phases, which are only ever logged by the main thread of
+// initialization.
+//
+
+EFI_PERF_RECORD EfiPerfPhases[EFI_PERF_PHASE_COUNT];
+UINTN EfiPerfPhaseCount;
+
+//
+// Store the trace ring. Writers claim a record by atomically incrementing the
+// sequence number, so logging needs neither a lock nor a TPL raise.
+//
+
+EFI_PERF_RECORD EfiPerfRing[EFI_PERF_RECORD_COUNT];
+volatile ULONG EfiPerfSequence;
+
+//
+// Store the published boot performance table. The basic boot record is
+// updated in place as the OS loader runs.
+//
+
+PFBPT EfiPerfBootTable;
+PFPDT_BASIC_BOOT_RECORD EfiPerfBootRecord;
+BOOLEAN EfiPerfFpdtInstalled;
+EFI_EVENT EfiPerfReadyToBootEvent;
+
+//
+// Store the progress identifier that starts each type of event.
+//
+
+UINT16 EfiPerfProgressIds[EfiPerfRecordTypeCount] = {
+    0,
+    EFI_PERF_PROGRESS_IN_MODULE_START,
+    EFI_PERF_PROGRESS_LOAD_IMAGE_START,
+    EFI_PERF_PROGRESS_MODULE_START,
+    EFI_PERF_PROGRESS_BINDING_START,
+    EFI_PERF_PROGRESS_CROSS_MODULE_START,
+    EFI_PERF_PROGRESS_CROSS_MODULE_START,
+    EFI_PERF_PROGRESS_IN_MODULE_START
+};
+
+CHAR8 *EfiPerfTypeNames[EfiPerfRecordTypeCount] = {
+    "Invalid",
+    "Phase",
+    "LoadImage",
+    "StartImage",
+    "DriverStart",
+    "BlockRead",
+    "BlockWrite",
+    "ExitBootServices"
+};
+
+//
+// The ACPI table header defaults live in the ACPI driver.
+//
+
+extern CHAR8 *EfiAcpiDefaultOemId;
+extern UINT64 EfiAcpiDefaultOemTableId;
+extern UINT32 EfiAcpiDefaultOemRevision;
+extern UINT32 EfiAcpiDefaultCreatorId;
+extern UINT32 EfiAcpiDefaultCreatorRevision;
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+EFI_STATUS
+EfiCoreInitializePerformanceTracing (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine signs up to publish the firmware performance data table when
+    the ReadyToBoot event group is signaled.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    EFI status code.
+
+--*/
+
+{
+
+    EFI_STATUS Status;
+
+    Status = EfiCoreCreateEventEx(EVT_NOTIFY_SIGNAL,
+                                  TPL_CALLBACK,
+                                  EfipCorePerfReadyToBoot,
+                                  NULL,
+                                  &EfiEventReadyToBootGuid,
+                                  &EfiPerfReadyToBootEvent);
+
+    return Status;
+}
+
+VOID
+EfiCorePerfStartPhase (
+    CONST CHAR8 *Name
+    )
+
+/*++
+
+Routine Description:
+
+    This routine closes the current boot phase, if any, and opens a new one.
+
+Arguments:
+
+    Name - Supplies the name of the new phase, or NULL to just close the
+        current phase.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PEFI_PERF_RECORD Record;
+    UINT64 Time;
+
+    Time = EfiCoreReadTimeCounter();
+    if (EfiPerfPhaseCount != 0) {
+        Record = &(EfiPerfPhases[EfiPerfPhaseCount - 1]);
+        if (Record->EndTime == 0) {
+            Record->EndTime = Time;
+        }
+    }
+
+    if ((Name == NULL) || (EfiPerfPhaseCount == EFI_PERF_PHASE_COUNT)) {
+        return;
+    }
+
+    Record = &(EfiPerfPhases[EfiPerfPhaseCount]);
+    Record->Type = EfiPerfRecordPhase;
+    Record->Data = EfiPerfPhaseCount;
+    Record->StartTime = Time;
+    Record->EndTime = 0;
+    EfipCorePerfCopyName(Record->Name, Name);
+    EfiPerfPhaseCount += 1;
+    Record->Sequence = EfiPerfPhaseCount;
+    return;
+}
+
+UINTN
+EfiCorePerfStart (
+    EFI_PERF_RECORD_TYPE Type,
+    CONST CHAR8 *Name,
+    UINT64 Data
+    )
+
+/*++
+
+Routine Description:
+
+    This routine opens a performance trace record, stamping it with the
+    current time counter value. This routine is safe to call at any TPL.
+
+Arguments:
+
+    Type - Supplies the kind of event being traced.
+
+    Name - Supplies an optional name for the event. Only the first few
+        characters are kept.
+
+    Data - Supplies a value whose meaning depends on the type, such as a
+        handle or a logical block address.
+
+Return Value:
+
+    Returns a token to pass to the end routine.
+
+--*/
+
+{
+
+    PEFI_PERF_RECORD Record;
+    ULONG Sequence;
+
+    Sequence = RtlAtomicAdd32((PULONG)&EfiPerfSequence, 1) + 1;
+    Record = &(EfiPerfRing[(Sequence - 1) & (EFI_PERF_RECORD_COUNT - 1)]);
+
+    //
+    // Mark the record as in progress while it's filled in, so that a reader
+    // never sees a mix of the old and new events.
+    //
+
+    Record->Sequence = 0;
+    Record->Type = Type;
+    Record->Data = Data;
+    Record->EndTime = 0;
+    EfipCorePerfCopyName(Record->Name, Name);
+    Record->StartTime = EfiCoreReadTimeCounter();
+    Record->Sequence = Sequence;
+    if (EfiPerfBootRecord != NULL) {
+        EfipCorePerfUpdateBootRecord(Type, FALSE, Record->StartTime);
+    }
+
+    return Sequence;
+}
+
+VOID
+EfiCorePerfEnd (
+    UINTN Token
+    )
+
+/*++
+
+Routine Description:
+
+    This routine closes a performance trace record, stamping it with the
+    current time counter value. If the record has since been overwritten by a
+    newer one, this routine does nothing.
+
+Arguments:
+
+    Token - Supplies the token returned when the record was opened.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PEFI_PERF_RECORD Record;
+    UINT64 Time;
+
+    Time = EfiCoreReadTimeCounter();
+    if (Token == 0) {
+        return;
+    }
+
+    Record = &(EfiPerfRing[(Token - 1) & (EFI_PERF_RECORD_COUNT - 1)]);
+    if (Record->Sequence != Token) {
+        return;
+    }
+
+    Record->EndTime = Time;
+    if (EfiPerfBootRecord != NULL) {
+        EfipCorePerfUpdateBootRecord(Record->Type, TRUE, Time);
+    }
+
+    return;
+}
+
+VOID
+EfiCorePerfSetIdentity (
+    UINTN Token,
+    CONST CHAR8 *Name,
+    UINT64 Data
+    )
+
+/*++
+
+Routine Description:
+
+    This routine replaces the name and data of an open performance trace
+    record, for events whose subject is only known once they finish.
+
+Arguments:
+
+    Token - Supplies the token returned when the record was opened.
+
+    Name - Supplies an optional name for the event.
+
+    Data - Supplies the new data value for the record.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PEFI_PERF_RECORD Record;
+
+    if (Token == 0) {
+        return;
+    }
+
+    Record = &(EfiPerfRing[(Token - 1) & (EFI_PERF_RECORD_COUNT - 1)]);
+    if (Record->Sequence != Token) {
+        return;
+    }
+
+    Record->Data = Data;
+    EfipCorePerfCopyName(Record->Name, Name);
+    return;
+}
+
+VOID
+EfiCorePerfDump (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine prints the boot phase timings and the contents of the
+    performance trace ring to the console.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG First;
+    UINTN Index;
+    ULONG Last;
+    EFI_PERF_RECORD Record;
+    ULONG Sequence;
+
+    printf("Boot performance, in microseconds since reset:\n");
+    for (Index = 0; Index < EfiPerfPhaseCount; Index += 1) {
+        EfipCorePerfPrintRecord(&(EfiPerfPhases[Index]));
+    }
+
+    Last = EfiPerfSequence;
+    First = 1;
+    if (Last > EFI_PERF_RECORD_COUNT) {
+        First = Last - EFI_PERF_RECORD_COUNT + 1;
+        printf("%d older records were overwritten.\n", First - 1);
+    }
+
+    for (Sequence = First; Sequence <= Last; Sequence += 1) {
+        if (EfipCorePerfReadRecord(Sequence, &Record) != FALSE) {
+            EfipCorePerfPrintRecord(&Record);
+        }
+    }
+
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+EFIAPI
+VOID
+EfipCorePerfReadyToBoot (
+    EFI_EVENT Event,
+    VOID *Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called when the ReadyToBoot event group is signaled. It
+    publishes the records logged so far in the firmware performance data
+    table.
+
+Arguments:
+
+    Event - Supplies the event that fired.
+
+    Context - Supplies an unused context pointer.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    EFI_PHYSICAL_ADDRESS Address;
+    EFI_STATUS Status;
+
+    //
+    // The boot manager may signal ReadyToBoot once per boot option it tries.
+    // The table is allocated and installed the first time, and rebuilt in
+    // place each time after that.
+    //
+
+    if (EfiPerfBootTable == NULL) {
+        Status = EfiAllocatePages(AllocateAnyPages,
+                                  EfiReservedMemoryType,
+                                  EFI_SIZE_TO_PAGES(EFI_PERF_BOOT_TABLE_SIZE),
+                                  &Address);
+
+        if (EFI_ERROR(Status)) {
+            return;
+        }
+
+        EfiPerfBootTable = (PFBPT)(UINTN)Address;
+    }
+
+    EfipCorePerfBuildBootTable();
+    if (EfiPerfFpdtInstalled == FALSE) {
+        Status = EfipCorePerfInstallFpdt();
+        if (!EFI_ERROR(Status)) {
+            EfiPerfFpdtInstalled = TRUE;
+        }
+    }
+
+#ifdef CONFIG_PERF_TRACE_DUMP
+
+    EfiCorePerfDump();
+
+#endif
+
+    return;
+}
+
+VOID
+EfipCorePerfBuildBootTable (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine fills in the boot performance table from the phase records
+    and the trace ring.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PFPDT_BASIC_BOOT_RECORD BootRecord;
+    UINT8 *Buffer;
+    ULONG First;
+    UINTN Index;
+    ULONG Last;
+    EFI_PERF_RECORD Record;
+    ULONG Sequence;
+
+    //
+    // Stop updating the basic boot record while the table is rebuilt.
+    //
+
+    EfiPerfBootRecord = NULL;
+    Buffer = (UINT8 *)EfiPerfBootTable;
+    EfiSetMem(Buffer, sizeof(FBPT) + sizeof(FPDT_BASIC_BOOT_RECORD), 0);
+    EfiPerfBootTable->Signature = FBPT_SIGNATURE;
+    Buffer += sizeof(FBPT);
+    BootRecord = (PFPDT_BASIC_BOOT_RECORD)Buffer;
+    BootRecord->Header.Type = FPDT_RECORD_TYPE_BASIC_BOOT;
+    BootRecord->Header.Length = sizeof(FPDT_BASIC_BOOT_RECORD);
+    BootRecord->Header.Revision = FPDT_RECORD_REVISION_BASIC_BOOT;
+    if (EfiPerfPhaseCount != 0) {
+        BootRecord->ResetEnd =
+             EfipCorePerfCounterToNanoseconds(EfiPerfPhases[0].StartTime);
+    }
+
+    Buffer += sizeof(FPDT_BASIC_BOOT_RECORD);
+    for (Index = 0; Index < EfiPerfPhaseCount; Index += 1) {
+        Buffer = EfipCorePerfAddStringEvent(Buffer, &(EfiPerfPhases[Index]));
+    }
+
+    Last = EfiPerfSequence;
+    First = 1;
+    if (Last > EFI_PERF_RECORD_COUNT) {
+        First = Last - EFI_PERF_RECORD_COUNT + 1;
+    }
+
+    for (Sequence = First; Sequence <= Last; Sequence += 1) {
+        if (EfipCorePerfReadRecord(Sequence, &Record) != FALSE) {
+            Buffer = EfipCorePerfAddStringEvent(Buffer, &Record);
+        }
+    }
+
+    EfiPerfBootTable->Length = Buffer - (UINT8 *)EfiPerfBootTable;
+
+    ASSERT(EfiPerfBootTable->Length <= EFI_PERF_BOOT_TABLE_SIZE);
+
+    EfiPerfBootRecord = BootRecord;
+    return;
+}
+
+UINT8 *
+EfipCorePerfAddStringEvent (
+    UINT8 *Buffer,
+    PEFI_PERF_RECORD Record
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes the start and end string event records for a trace
+    record into the boot performance table.
+
+Arguments:
+
+    Buffer - Supplies a pointer where the records will be written.
+
+    Record - Supplies a pointer to the trace record to write out.
+
+Return Value:
+
+    Returns a pointer just after the written records.
+
+--*/
+
+{
+
+    PEFI_PERF_STRING_EVENT_RECORD Event;
+    UINTN Length;
+    UINTN Pass;
+
+    Length = RtlStringLength(Record->Name) + 1;
+    for (Pass = 0; Pass < 2; Pass += 1) {
+        Event = (PEFI_PERF_STRING_EVENT_RECORD)Buffer;
+        Event->Header.Type = EFI_PERF_STRING_EVENT_RECORD_TYPE;
+        Event->Header.Length = OFFSET_OF(EFI_PERF_STRING_EVENT_RECORD, String) +
+                               Length;
+
+        Event->Header.Revision = EFI_PERF_STRING_EVENT_RECORD_REVISION;
+        Event->ProgressId = EfiPerfProgressIds[Record->Type] + Pass;
+        Event->ApicId = 0;
+        if (Pass == 0) {
+            Event->Timestamp =
+                         EfipCorePerfCounterToNanoseconds(Record->StartTime);
+
+        } else {
+
+            //
+            // Events that never finished, like starting the OS loader, only
+            // get a start record.
+            //
+
+            if (Record->EndTime == 0) {
+                break;
+            }
+
+            Event->Timestamp =
+                           EfipCorePerfCounterToNanoseconds(Record->EndTime);
+        }
+
+        EfiSetMem(&(Event->Guid), sizeof(EFI_GUID), 0);
+        EfiCopyMem(Event->String, Record->Name, Length);
+        Buffer += Event->Header.Length;
+    }
+
+    return Buffer;
+}
+
+EFI_STATUS
+EfipCorePerfInstallFpdt (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine installs the firmware performance data table, pointing it at
+    the boot performance table.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    EFI status code.
+
+--*/
+
+{
+
+    FPDT Fpdt;
+    UINTN TableKey;
+
+    EfiSetMem(&Fpdt, sizeof(FPDT), 0);
+    Fpdt.Header.Signature = FPDT_SIGNATURE;
+    Fpdt.Header.Length = sizeof(FPDT);
+    Fpdt.Header.Revision = FPDT_REVISION;
+    EfiCopyMem(&(Fpdt.Header.OemId),
+               EfiAcpiDefaultOemId,
+               sizeof(Fpdt.Header.OemId));
+
+    Fpdt.Header.OemTableId = EfiAcpiDefaultOemTableId;
+    Fpdt.Header.OemRevision = EfiAcpiDefaultOemRevision;
+    Fpdt.Header.CreatorId = EfiAcpiDefaultCreatorId;
+    Fpdt.Header.CreatorRevision = EfiAcpiDefaultCreatorRevision;
+    Fpdt.BootPointer.Type = FPDT_RECORD_TYPE_BASIC_BOOT_POINTER;
+    Fpdt.BootPointer.Length = sizeof(FPDT) - sizeof(DESCRIPTION_HEADER);
+    Fpdt.BootPointer.Revision = FPDT_RECORD_REVISION_BASIC_BOOT_POINTER;
+    Fpdt.BootTable = (UINTN)EfiPerfBootTable;
+    return EfiAcpiInstallTable(&Fpdt, sizeof(FPDT), &TableKey);
+}
+
+VOID
+EfipCorePerfUpdateBootRecord (
+    EFI_PERF_RECORD_TYPE Type,
+    BOOLEAN End,
+    UINT64 Time
+    )
+
+/*++
+
+Routine Description:
+
+    This routine updates the published basic boot record for events that
+    happen after ReadyToBoot, which belong to the OS loader.
+
+Arguments:
+
+    Type - Supplies the kind of event.
+
+    End - Supplies a boolean indicating whether the event is finishing (TRUE)
+        or starting (FALSE).
+
+    Time - Supplies the time counter value of the event.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PFPDT_BASIC_BOOT_RECORD BootRecord;
+
+    BootRecord = EfiPerfBootRecord;
+    if (End == FALSE) {
+        switch (Type) {
+        case EfiPerfRecordLoadImage:
+            BootRecord->OsLoaderLoadImageStart =
+                                       EfipCorePerfCounterToNanoseconds(Time);
+
+            break;
+
+        case EfiPerfRecordStartImage:
+            BootRecord->OsLoaderStartImageStart =
+                                       EfipCorePerfCounterToNanoseconds(Time);
+
+            break;
+
+        case EfiPerfRecordExitBootServices:
+            BootRecord->ExitBootServicesEntry =
+                                       EfipCorePerfCounterToNanoseconds(Time);
+
+            break;
+
+        default:
+            break;
+        }
+
+    } else if (Type == EfiPerfRecordExitBootServices) {
+        BootRecord->ExitBootServicesExit =
+                                       EfipCorePerfCounterToNanoseconds(Time);
+    }
+
+    return;
+}
+
+BOOLEAN
+EfipCorePerfReadRecord (
+    ULONG Sequence,
+    PEFI_PERF_RECORD Record
+    )
+
+/*++
+
+Routine Description:
+
+    This routine takes a consistent copy of a record in the trace ring.
+
+Arguments:
+
+    Sequence - Supplies the sequence number of the desired record.
+
+    Record - Supplies a pointer where the copy will be returned.
+
+Return Value:
+
+    TRUE if the copy was taken.
+
+    FALSE if the record is being written or has been overwritten.
+
+--*/
+
+{
+
+    PEFI_PERF_RECORD RingRecord;
+
+    RingRecord = &(EfiPerfRing[(Sequence - 1) & (EFI_PERF_RECORD_COUNT - 1)]);
+    if (RingRecord->Sequence != Sequence) {
+        return FALSE;
+    }
+
+    EfiCopyMem(Record, RingRecord, sizeof(EFI_PERF_RECORD));
+
+    //
+    // If a writer claimed the record during the copy, the copy is torn.
+    //
+
+    if (RingRecord->Sequence != Sequence) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+VOID
+EfipCorePerfPrintRecord (
+    PEFI_PERF_RECORD Record
+    )
+
+/*++
+
+Routine Description:
+
+    This routine prints a single trace record.
+
+Arguments:
+
+    Record - Supplies a pointer to the record to print.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINT32 Duration;
+    UINT32 Start;
+
+    Start = EfipCorePerfCounterToNanoseconds(Record->StartTime) / 1000;
+    Duration = 0;
+    if (Record->EndTime != 0) {
+        Duration = EfipCorePerfCounterToNanoseconds(
+                                   Record->EndTime - Record->StartTime) / 1000;
+    }
+
+    printf("%-16s %-24s %10u %10u 0x%llx\n",
+           EfiPerfTypeNames[Record->Type],
+           Record->Name,
+           Start,
+           Duration,
+           (unsigned long long)Record->Data);
+
+    return;
+}
+
+VOID
+EfipCorePerfCopyName (
+    CHAR8 *Destination,
+    CONST CHAR8 *Source
+    )
+
+/*++
+
+Routine Description:
+
+    This routine copies an event name into a record, truncating it if needed.
+
+Arguments:
+
+    Destination - Supplies a pointer to the record's name buffer.
+
+    Source - Supplies an optional pointer to the name to copy.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN Index;
+
+    Index = 0;
+    if (Source != NULL) {
+        while ((Index < EFI_PERF_NAME_SIZE - 1) && (Source[Index] != '\0')) {
+            Destination[Index] = Source[Index];
+            Index += 1;
+        }
+    }
+
+    Destination[Index] = '\0';
+    return;
+}
+
+UINT64
+EfipCorePerfCounterToNanoseconds (
+    UINT64 Counter
+    )
+
+/*++
+
+Routine Description:
+
+    This routine converts a time counter value into nanoseconds.
+
+Arguments:
+
+    Counter - Supplies the time counter value.
+
+Return Value:
+
+    Returns the number of nanoseconds, or zero if the time counter frequency
+    is not yet known.
+
+--*/
+
+{
+
+    UINT64 Frequency;
+    UINT64 Nanoseconds;
+
+    Frequency = EfiCoreGetTimeCounterFrequency();
+    if (Frequency == 0) {
+        return 0;
+    }
+
+    //
+    // Split off whole seconds first so the multiply cannot overflow.
+    //
+
+    Nanoseconds = (Counter / Frequency) * NANOSECONDS_PER_SECOND;
+    Nanoseconds += ((Counter % Frequency) * NANOSECONDS_PER_SECOND) /
+                   Frequency;
+
+    return Nanoseconds;
+}
+
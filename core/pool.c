@@ -13,7 +13,11 @@ Module Name:
 
 Abstract:
 
-    This module implements support for core UEFI pool allocations.
+    This module implements support for core UEFI pool allocations. Small
+    allocations are carved out of slabs, each of which serves one block size
+    for one memory type. Slabs for the larger block sizes span several pages
+    so that every slab holds a handful of blocks. Slabs that become completely
+    free are handed back to the page allocator.
 
 Author:
 
@@ -54,6 +58,14 @@ Environment:
 
 #define POOL_LIST_TO_SIZE(_List) (((_List) + 1) << POOL_SHIFT)
 
+//
+// This macro gets the slab that owns the given small pool block. Slabs are
+// aligned to their size.
+//
+
+#define POOL_HEADER_TO_SLAB(_Header, _SlabSize) \
+    ((PPOOL_SLAB)ALIGN_POINTER_DOWN((_Header), (_SlabSize)))
+
 //
 // ---------------------------------------------------------------- Definitions
 //
@@ -66,6 +78,7 @@ Environment:
 #define POOL_HEADER_MAGIC 0x6C6F6F50 // 'looP'
 #define POOL_FREE_MAGIC 0x65657246 // 'eerF'
 #define POOL_TAIL_MAGIC 0x6C696154 // 'liaT'
+#define POOL_SLAB_MAGIC 0x62616C53 // 'balS'
 
 //
 // Define the granularity of the pool buckets.
@@ -79,6 +92,22 @@ Environment:
 
 #define POOL_OVERHEAD (sizeof(POOL_HEADER) + sizeof(POOL_TAIL))
 
+//
+// Define the smallest slab, and the space reserved at the start of each slab
+// for its header.
+//
+
+#define POOL_MIN_SLAB_SIZE EFI_MEMORY_EXPANSION_SIZE
+#define POOL_SLAB_HEADER_SIZE ALIGN_VALUE(sizeof(POOL_SLAB), 16)
+
+//
+// Define the number of blocks a slab is sized for. Each bucket's slabs are
+// the smallest power of two this many blocks fit in, though the slab header
+// may cost the slab one of them.
+//
+
+#define POOL_SLAB_BLOCKS 4
+
 //
 // Define the number of pool buckets to store before it makes sense to just
 // start allocating pages directly.
@@ -86,6 +115,14 @@ Environment:
 
 #define MAX_POOL_LIST POOL_SIZE_TO_LIST(EFI_PAGE_SIZE)
 
+//
+// Define the number of completely free slabs each bucket holds on to before
+// returning them to the page allocator. Keeping a few around avoids
+// thrashing the memory map when blocks are repeatedly allocated and freed.
+//
+
+#define POOL_MAX_EMPTY_SLABS 4
+
 //
 // Define the level that pool raises to.
 //
@@ -96,11 +133,12 @@ Environment:
 // ------------------------------------------------------ Data Type Definitions
 //
 
-typedef struct _POOL_FREE_ENTRY {
-    LIST_ENTRY ListEntry;
+typedef struct _POOL_FREE_ENTRY POOL_FREE_ENTRY, *PPOOL_FREE_ENTRY;
+struct _POOL_FREE_ENTRY {
+    PPOOL_FREE_ENTRY Next;
     UINT32 Magic;
     UINT32 Index;
-} POOL_FREE_ENTRY, *PPOOL_FREE_ENTRY;
+};
 
 typedef struct _POOL_HEADER {
     UINT32 Magic;
@@ -115,12 +153,78 @@ typedef struct _POOL_TAIL {
     UINTN Size;
 } POOL_TAIL, *PPOOL_TAIL;
 
+/*++
+
+Structure Description:
+
+    This structure sits at the beginning of each slab of small pool blocks.
+
+Members:
+
+    ListEntry - Stores pointers to the next and previous slabs on whichever
+        partial, full, or empty list of the pool the slab is on.
+
+    Magic - Stores the constant POOL_SLAB_MAGIC.
+
+    Index - Stores the bucket index this slab serves.
+
+    UsedCount - Stores the number of blocks currently allocated.
+
+    BlockCount - Stores the total number of blocks in the slab.
+
+    FreeList - Stores a pointer to the first free block in the slab.
+
+    Pool - Stores a pointer back to the pool that owns the slab.
+
+--*/
+
+typedef struct _POOL_SLAB {
+    LIST_ENTRY ListEntry;
+    UINT32 Magic;
+    UINT32 Index;
+    UINT32 UsedCount;
+    UINT32 BlockCount;
+    PPOOL_FREE_ENTRY FreeList;
+    struct _POOL *Pool;
+} POOL_SLAB, *PPOOL_SLAB;
+
+/*++
+
+Structure Description:
+
+    This structure stores the state for the pool of a single memory type.
+
+Members:
+
+    ListEntry - Stores pointers to the next and previous non-builtin pools.
+
+    Magic - Stores the constant POOL_MAGIC.
+
+    UsedSize - Stores the number of bytes currently allocated, including
+        overhead.
+
+    MemoryType - Stores the memory type the pool allocates from.
+
+    PartialList - Stores the list of slabs per bucket that have both free and
+        allocated blocks. Allocations are satisfied from here first.
+
+    FullList - Stores the list of slabs per bucket with no free blocks.
+
+    EmptyList - Stores the list of slabs per bucket with no allocated blocks.
+
+    EmptyCount - Stores the number of slabs on each empty list.
+
+--*/
+
 typedef struct _POOL {
     LIST_ENTRY ListEntry;
     UINTN Magic;
     UINTN UsedSize;
     EFI_MEMORY_TYPE MemoryType;
-    LIST_ENTRY FreeList[MAX_POOL_LIST];
+    LIST_ENTRY PartialList[MAX_POOL_LIST];
+    LIST_ENTRY FullList[MAX_POOL_LIST];
+    LIST_ENTRY EmptyList[MAX_POOL_LIST];
+    UINTN EmptyCount[MAX_POOL_LIST];
 } POOL, *PPOOL;
 
 //
@@ -143,6 +247,18 @@ EfipCoreLookupPool (
     EFI_MEMORY_TYPE PoolType
     );
 
+VOID
+EfipCoreInitializePoolStructure (
+    PPOOL Pool,
+    EFI_MEMORY_TYPE PoolType
+    );
+
+PPOOL_SLAB
+EfipCoreCreatePoolSlab (
+    PPOOL Pool,
+    UINTN ListIndex
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -159,6 +275,12 @@ POOL EfiPool[EfiMaxMemoryType];
 
 LIST_ENTRY EfiPoolList;
 
+//
+// Store the size of a slab for each bucket.
+//
+
+UINTN EfiPoolSlabSize[MAX_POOL_LIST];
+
 //
 // ------------------------------------------------------------------ Functions
 //
@@ -186,22 +308,23 @@ Return Value:
 
 {
 
-    PPOOL Pool;
+    UINTN ListIndex;
     UINTN PoolIndex;
-    UINTN PoolListIndex;
+    UINTN SlabSize;
+
+    for (ListIndex = 0; ListIndex < MAX_POOL_LIST; ListIndex += 1) {
+        SlabSize = POOL_MIN_SLAB_SIZE;
+        while (SlabSize < POOL_SLAB_BLOCKS * POOL_LIST_TO_SIZE(ListIndex)) {
+            SlabSize <<= 1;
+        }
+
+        EfiPoolSlabSize[ListIndex] = SlabSize;
+    }
 
     INITIALIZE_LIST_HEAD(&EfiPoolList);
     for (PoolIndex = 0; PoolIndex < EfiMaxMemoryType; PoolIndex += 1) {
-        Pool = &(EfiPool[PoolIndex]);
-        Pool->Magic = POOL_MAGIC;
-        Pool->UsedSize = 0;
-        Pool->MemoryType = (EFI_MEMORY_TYPE)PoolIndex;
-        for (PoolListIndex = 0;
-             PoolListIndex < MAX_POOL_LIST;
-             PoolListIndex += 1) {
-
-            INITIALIZE_LIST_HEAD(&(Pool->FreeList[PoolListIndex]));
-        }
+        EfipCoreInitializePoolStructure(&(EfiPool[PoolIndex]),
+                                        (EFI_MEMORY_TYPE)PoolIndex);
     }
 
     return EFI_SUCCESS;
@@ -343,15 +466,13 @@ Return Value:
 
 {
 
-    UINTN BlockSize;
     VOID *Buffer;
     PPOOL_FREE_ENTRY FreeEntry;
     PPOOL_HEADER Header;
     UINTN ListIndex;
-    CHAR8 *NewPage;
-    UINTN Offset;
     UINTN PageCount;
     PPOOL Pool;
+    PPOOL_SLAB Slab;
     PPOOL_TAIL Tail;
 
     ASSERT(EfiCoreIsLockHeld(&EfiMemoryLock) != FALSE);
@@ -382,58 +503,57 @@ Return Value:
     }
 
     //
-    // If there's no free pool left in the bucket, allocate more pages.
+    // Prefer a partially used slab, then a cached empty one, and only go to
+    // the page allocator if neither exists.
     //
 
-    if (LIST_EMPTY(&(Pool->FreeList[ListIndex])) != FALSE) {
-        NewPage = EfiCoreAllocatePoolPages(
-                                  PoolType,
-                                  EFI_SIZE_TO_PAGES(EFI_MEMORY_EXPANSION_SIZE),
-                                  EFI_MEMORY_EXPANSION_SIZE);
+    if (LIST_EMPTY(&(Pool->PartialList[ListIndex])) == FALSE) {
+        Slab = LIST_VALUE(Pool->PartialList[ListIndex].Next,
+                          POOL_SLAB,
+                          ListEntry);
+
+    } else if (LIST_EMPTY(&(Pool->EmptyList[ListIndex])) == FALSE) {
+        Slab = LIST_VALUE(Pool->EmptyList[ListIndex].Next,
+                          POOL_SLAB,
+                          ListEntry);
+
+        ASSERT(Pool->EmptyCount[ListIndex] != 0);
 
-        if (NewPage == NULL) {
+        Pool->EmptyCount[ListIndex] -= 1;
+        LIST_REMOVE(&(Slab->ListEntry));
+        INSERT_AFTER(&(Slab->ListEntry), &(Pool->PartialList[ListIndex]));
+
+    } else {
+        Slab = EfipCoreCreatePoolSlab(Pool, ListIndex);
+        if (Slab == NULL) {
             goto CoreAllocatePoolEnd;
         }
 
-        //
-        // Carve up the new page into free pool blocks. Add as many as possible
-        // to the desired list, then successively add the remainders to the
-        // smaller lists.
-        //
+        INSERT_AFTER(&(Slab->ListEntry), &(Pool->PartialList[ListIndex]));
+    }
 
-        Offset = 0;
-        while (Offset < EFI_MEMORY_EXPANSION_SIZE) {
+    //
+    // Pop the first free block off the slab, and move the slab to the full
+    // list if that was the last one.
+    //
 
-            ASSERT(ListIndex < MAX_POOL_LIST);
+    ASSERT((Slab->Magic == POOL_SLAB_MAGIC) && (Slab->FreeList != NULL));
 
-            BlockSize = POOL_LIST_TO_SIZE(ListIndex);
-            while (Offset + BlockSize <= EFI_MEMORY_EXPANSION_SIZE) {
-                FreeEntry = (PPOOL_FREE_ENTRY)(&(NewPage[Offset]));
-                FreeEntry->Magic = POOL_FREE_MAGIC;
-                FreeEntry->Index = ListIndex;
-                INSERT_BEFORE(&(FreeEntry->ListEntry),
-                              &(Pool->FreeList[ListIndex]));
+    FreeEntry = Slab->FreeList;
 
-                Offset += BlockSize;
-            }
+    ASSERT((FreeEntry->Magic == POOL_FREE_MAGIC) &&
+           (FreeEntry->Index == ListIndex));
 
-            ListIndex -= 1;
-        }
+    Slab->FreeList = FreeEntry->Next;
+    Slab->UsedCount += 1;
+    if (Slab->UsedCount == Slab->BlockCount) {
 
-        ASSERT(Offset == EFI_MEMORY_EXPANSION_SIZE);
+        ASSERT(Slab->FreeList == NULL);
 
-        ListIndex = POOL_SIZE_TO_LIST(Size);
+        LIST_REMOVE(&(Slab->ListEntry));
+        INSERT_AFTER(&(Slab->ListEntry), &(Pool->FullList[ListIndex]));
     }
 
-    //
-    // Remove the first free entry from the pool.
-    //
-
-    FreeEntry = LIST_VALUE(Pool->FreeList[ListIndex].Next,
-                           POOL_FREE_ENTRY,
-                           ListEntry);
-
-    LIST_REMOVE(&(FreeEntry->ListEntry));
     Header = (PPOOL_HEADER)FreeEntry;
 
 CoreAllocatePoolEnd:
@@ -487,6 +607,7 @@ Return Value:
     UINTN ListIndex;
     UINTN PageCount;
     PPOOL Pool;
+    PPOOL_SLAB Slab;
     PPOOL_TAIL Tail;
 
     ASSERT(Buffer != NULL);
@@ -550,14 +671,45 @@ Return Value:
         EfiCoreFreePoolPages((EFI_PHYSICAL_ADDRESS)(UINTN)Header, PageCount);
 
     //
-    // Put the pool entry back onto the free list.
+    // Put the block back on its slab's free list, and move the slab to
+    // whichever list now describes it.
     //
 
     } else {
+        Slab = POOL_HEADER_TO_SLAB(Header, EfiPoolSlabSize[ListIndex]);
+        if ((Slab->Magic != POOL_SLAB_MAGIC) || (Slab->Pool != Pool) ||
+            (Slab->Index != ListIndex) || (Slab->UsedCount == 0)) {
+
+            ASSERT(FALSE);
+
+            return EFI_INVALID_PARAMETER;
+        }
+
         FreeEntry = (PPOOL_FREE_ENTRY)Header;
         FreeEntry->Magic = POOL_FREE_MAGIC;
         FreeEntry->Index = ListIndex;
-        INSERT_AFTER(&(FreeEntry->ListEntry), &(Pool->FreeList[ListIndex]));
+        FreeEntry->Next = Slab->FreeList;
+        Slab->FreeList = FreeEntry;
+        Slab->UsedCount -= 1;
+        if (Slab->UsedCount == 0) {
+            LIST_REMOVE(&(Slab->ListEntry));
+            if (Pool->EmptyCount[ListIndex] < POOL_MAX_EMPTY_SLABS) {
+                INSERT_AFTER(&(Slab->ListEntry),
+                             &(Pool->EmptyList[ListIndex]));
+
+                Pool->EmptyCount[ListIndex] += 1;
+
+            } else {
+                Slab->Magic = 0;
+                PageCount = EFI_SIZE_TO_PAGES(EfiPoolSlabSize[ListIndex]);
+                EfiCoreFreePoolPages((EFI_PHYSICAL_ADDRESS)(UINTN)Slab,
+                                     PageCount);
+            }
+
+        } else if (Slab->UsedCount == Slab->BlockCount - 1) {
+            LIST_REMOVE(&(Slab->ListEntry));
+            INSERT_AFTER(&(Slab->ListEntry), &(Pool->PartialList[ListIndex]));
+        }
     }
 
     return EFI_SUCCESS;
@@ -590,7 +742,6 @@ Return Value:
 {
 
     PLIST_ENTRY CurrentEntry;
-    UINTN FreeListIndex;
     PPOOL Pool;
 
     //
@@ -625,14 +776,128 @@ Return Value:
         return NULL;
     }
 
+    EfipCoreInitializePoolStructure(Pool, PoolType);
+    INSERT_BEFORE(&(Pool->ListEntry), &EfiPoolList);
+    return Pool;
+}
+
+VOID
+EfipCoreInitializePoolStructure (
+    PPOOL Pool,
+    EFI_MEMORY_TYPE PoolType
+    )
+
+/*++
+
+Routine Description:
+
+    This routine initializes an empty pool.
+
+Arguments:
+
+    Pool - Supplies a pointer to the pool to initialize.
+
+    PoolType - Supplies the memory type the pool allocates from.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN ListIndex;
+
     Pool->Magic = POOL_MAGIC;
     Pool->UsedSize = 0;
     Pool->MemoryType = PoolType;
-    for (FreeListIndex = 0; FreeListIndex < MAX_POOL_LIST; FreeListIndex += 1) {
-        INITIALIZE_LIST_HEAD(&(Pool->FreeList[FreeListIndex]));
+    for (ListIndex = 0; ListIndex < MAX_POOL_LIST; ListIndex += 1) {
+        INITIALIZE_LIST_HEAD(&(Pool->PartialList[ListIndex]));
+        INITIALIZE_LIST_HEAD(&(Pool->FullList[ListIndex]));
+        INITIALIZE_LIST_HEAD(&(Pool->EmptyList[ListIndex]));
+        Pool->EmptyCount[ListIndex] = 0;
     }
 
-    INSERT_BEFORE(&(Pool->ListEntry), &EfiPoolList);
-    return Pool;
+    return;
+}
+
+PPOOL_SLAB
+EfipCoreCreatePoolSlab (
+    PPOOL Pool,
+    UINTN ListIndex
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates a new slab from the page allocator and carves it
+    into free blocks for the given bucket. The slab is not put on any list.
+
+Arguments:
+
+    Pool - Supplies a pointer to the pool the slab will belong to.
+
+    ListIndex - Supplies the bucket index the slab will serve.
+
+Return Value:
+
+    Returns a pointer to the new slab on success.
+
+    NULL on allocation failure.
+
+--*/
+
+{
+
+    UINTN BlockSize;
+    PPOOL_FREE_ENTRY FreeEntry;
+    PPOOL_FREE_ENTRY *Link;
+    CHAR8 *NewPage;
+    UINTN Offset;
+    PPOOL_SLAB Slab;
+    UINTN SlabSize;
+
+    ASSERT(ListIndex < MAX_POOL_LIST);
+
+    SlabSize = EfiPoolSlabSize[ListIndex];
+    NewPage = EfiCoreAllocatePoolPages(Pool->MemoryType,
+                                       EFI_SIZE_TO_PAGES(SlabSize),
+                                       SlabSize);
+
+    if (NewPage == NULL) {
+        return NULL;
+    }
+
+    Slab = (PPOOL_SLAB)NewPage;
+    Slab->Magic = POOL_SLAB_MAGIC;
+    Slab->Index = ListIndex;
+    Slab->UsedCount = 0;
+    Slab->BlockCount = 0;
+    Slab->Pool = Pool;
+
+    //
+    // Chain the blocks together in address order.
+    //
+
+    BlockSize = POOL_LIST_TO_SIZE(ListIndex);
+    Link = &(Slab->FreeList);
+    Offset = POOL_SLAB_HEADER_SIZE;
+    while (Offset + BlockSize <= SlabSize) {
+        FreeEntry = (PPOOL_FREE_ENTRY)(&(NewPage[Offset]));
+        FreeEntry->Magic = POOL_FREE_MAGIC;
+        FreeEntry->Index = ListIndex;
+        *Link = FreeEntry;
+        Link = &(FreeEntry->Next);
+        Slab->BlockCount += 1;
+        Offset += BlockSize;
+    }
+
+    *Link = NULL;
+
+    ASSERT(Slab->BlockCount != 0);
+
+    return Slab;
 }
 
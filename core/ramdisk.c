@@ -393,6 +393,7 @@ Return Value:
 
     EFI_RAM_DISK_CONTEXT *Context;
     VOID *DiskBuffer;
+    UINTN Token;
 
     Context = EFI_RAM_DISK_FROM_THIS(This);
     if (Lba + (BufferSize / EFI_RAM_DISK_BLOCK_SIZE) > Context->BlockCount) {
@@ -406,7 +407,9 @@ Return Value:
     DiskBuffer = (VOID *)(UINTN)(Context->RamDisk.Base +
                                  (Lba * EFI_RAM_DISK_BLOCK_SIZE));
 
+    Token = EfiCorePerfStart(EfiPerfRecordBlockRead, "ramdisk", Lba);
     EfiCopyMem(Buffer, DiskBuffer, BufferSize);
+    EfiCorePerfEnd(Token);
     return EFI_SUCCESS;
 }
 
@@ -464,6 +467,7 @@ Return Value:
 
     EFI_RAM_DISK_CONTEXT *Context;
     VOID *DiskBuffer;
+    UINTN Token;
 
     Context = EFI_RAM_DISK_FROM_THIS(This);
     if (Lba + (BufferSize / EFI_RAM_DISK_BLOCK_SIZE) >= Context->BlockCount) {
@@ -477,7 +481,9 @@ Return Value:
     DiskBuffer = (VOID *)(UINTN)(Context->RamDisk.Base +
                                  (Lba * EFI_RAM_DISK_BLOCK_SIZE));
 
+    Token = EfiCorePerfStart(EfiPerfRecordBlockWrite, "ramdisk", Lba);
     EfiCopyMem(DiskBuffer, Buffer, BufferSize);
+    EfiCorePerfEnd(Token);
     return EFI_SUCCESS;
 }
 
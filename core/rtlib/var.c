@@ -36,9 +36,6 @@ Environment:
 // ---------------------------------------------------------------- Definitions
 //
 
-#define EFI_VARIABLE_HEADER_MAGIC 0x73726156
-#define EFI_VARIABLE_HEADER_VERSION 0x00010000
-
 //
 // Define the default allocation size for EFI variable storages.
 //
@@ -52,83 +49,24 @@ Environment:
 #define EFI_VARIABLE_HEADER_CRC_SIZE OFFSET_OF(EFI_VARIABLE_HEADER, HeaderCrc32)
 
 //
-// This flag is set if the variable storage area has been written to but not
-// flushed to non-volatile storage.
+// Define the smallest possible variable entry: a one character name plus its
+// terminator, and a single byte of data. This bounds the number of entries
+// the region can hold, which sizes the hash index.
 //
 
-#define EFI_VARIABLE_FLAG_DIRTY 0x00000001
+#define EFI_VARIABLE_MINIMUM_ENTRY_SIZE \
+    ALIGN_VALUE(sizeof(EFI_VARIABLE_ENTRY) + (2 * sizeof(CHAR16)) + 1, 4)
 
 //
-// ------------------------------------------------------ Data Type Definitions
+// Define the FNV-1a constants used to hash variable names and GUIDs.
 //
 
-/*++
-
-Structure Description:
-
-    This structure sits at the head of the variable storage area.
-
-Members:
-
-    Magic - Stores the constant value EFI_VARIABLE_HEADER_MAGIC.
-
-    Version - Stores the version of the storage format. Set to
-        EFI_VARIABLE_HEADER_VERSION.
-
-    Flags - Stores a bitfield of flags describing the variable state. See
-        EFI_VARIABLE_FLAG_* definitions.
-
-    DataSize - Stores the size of the region of valid data following this
-        header, including the header itself.
-
-    FreeSize - Stores the amount of space that's free data. This may not be
-        contiguous.
-
-    HeaderCrc32 - Stores the CRC32 of the header, up to this field. Use the
-        EFI_VARIABLE_HEADER_CRC_SIZE define.
-
-    DataCrc32 - Stores the CRC32 of the data portion, not including this header.
-
---*/
-
-typedef struct _EFI_VARIABLE_HEADER {
-    UINT32 Magic;
-    UINT32 Version;
-    UINT32 Flags;
-    UINT32 DataSize;
-    UINT32 FreeSize;
-    UINT32 HeaderCrc32;
-    UINT32 DataCrc32;
-} EFI_VARIABLE_HEADER, *PEFI_VARIABLE_HEADER;
-
-/*++
-
-Structure Description:
-
-    This structure defines the layout of an EFI variable. This structure
-    is laid out in an array, but there's variable length data off the end of
-    each structure.
+#define EFI_VARIABLE_HASH_OFFSET_BASIS 0x811C9DC5
+#define EFI_VARIABLE_HASH_PRIME 0x01000193
 
-Members:
-
-    VendorGuid - Stores the vendor GUID of the variable.
-
-    Attributes - Stores the variable attributes.
-
-    NameSize - Stores the size of the name that immediately follows this
-        structure, in bytes, including the null terminator.
-
-    DataSize - Stores the size of the data that immediately follows the name
-        data, in bytes.
-
---*/
-
-typedef struct _EFI_VARIABLE_ENTRY {
-    EFI_GUID VendorGuid;
-    UINT32 Attributes;
-    UINT32 NameSize;
-    UINT32 DataSize;
-} EFI_VARIABLE_ENTRY, *PEFI_VARIABLE_ENTRY;
+//
+// ------------------------------------------------------ Data Type Definitions
+//
 
 //
 // ----------------------------------------------- Internal Function Prototypes
@@ -173,6 +111,14 @@ EfipCoreGetVariableEntry (
     VOID **Data
     );
 
+BOOLEAN
+EfipCoreVariableEntryMatches (
+    PEFI_VARIABLE_ENTRY Entry,
+    CHAR16 *VariableName,
+    UINTN NameSize,
+    EFI_GUID *VendorGuid
+    );
+
 VOID
 EfipCoreDeleteVariableEntry (
     PEFI_VARIABLE_ENTRY Entry
@@ -187,6 +133,28 @@ EfipCoreAddVariableEntry (
     VOID *Data
     );
 
+VOID
+EfipCoreCompactVariables (
+    VOID
+    );
+
+VOID
+EfipCoreBuildVariableIndex (
+    VOID
+    );
+
+VOID
+EfipCoreIndexVariableEntry (
+    PEFI_VARIABLE_ENTRY Entry
+    );
+
+UINT32
+EfipCoreHashVariable (
+    CHAR16 *VariableName,
+    UINTN NameSize,
+    EFI_GUID *VendorGuid
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -220,6 +188,25 @@ PEFI_VARIABLE_ENTRY EfiVariableNextFree;
 
 BOOLEAN EfiVariablesChanged = FALSE;
 
+//
+// Store the number of bytes in the variable region taken up by deleted
+// entries that have not yet been compacted away.
+//
+
+UINTN EfiVariableDeadSize;
+
+//
+// Store the open addressed hash index of variable entries. Each slot holds
+// the offset of an entry from the variable header, or zero if the slot is
+// empty. Slots of deleted entries stay in place until the next compaction.
+// Offsets do not change across SetVirtualAddressMap, so only the table
+// pointer needs converting. If the index could not be allocated, lookups
+// fall back to scanning the region.
+//
+
+UINT32 *EfiVariableIndex;
+UINT32 EfiVariableIndexMask;
+
 //
 // Store the single instance of the variable backend protocol.
 //
@@ -422,6 +409,7 @@ Return Value:
     BOOLEAN Done;
     PEFI_VARIABLE_ENTRY Entry;
     VOID *InternalData;
+    UINTN Size;
     UINTN StringSize;
 
     Done = FALSE;
@@ -446,15 +434,21 @@ Return Value:
         }
     }
 
-    StringSize = Entry->NameSize;
-    Entry = (PEFI_VARIABLE_ENTRY)((UINT8 *)Entry +
-                                  sizeof(EFI_VARIABLE_ENTRY) +
-                                  StringSize +
-                                  Entry->DataSize);
+    //
+    // Move to the next entry, skipping over any that have been deleted.
+    //
 
-    if (Entry >= EfiVariableEnd) {
-        return EFI_NOT_FOUND;
-    }
+    do {
+        Size = sizeof(EFI_VARIABLE_ENTRY) + Entry->NameSize + Entry->DataSize;
+        Size = ALIGN_VALUE(Size, 4);
+        Entry = (PEFI_VARIABLE_ENTRY)((UINT8 *)Entry + Size);
+        if (Entry + 1 > EfiVariableNextFree) {
+            return EFI_NOT_FOUND;
+        }
+
+    } while (Entry->DataSize == 0);
+
+    StringSize = Entry->NameSize;
 
     if (*VariableNameSize < StringSize) {
         *VariableNameSize = StringSize;
@@ -594,8 +588,10 @@ Return Value:
     }
 
     *MaximumVariableStorageSize = EfiVariableHeader->DataSize;
-    *RemainingVariableStorageSize = EfiVariableHeader->FreeSize;
-    *MaximumVariableSize = EfiVariableHeader->FreeSize;
+    *RemainingVariableStorageSize = EfiVariableHeader->FreeSize +
+                                    EfiVariableDeadSize;
+
+    *MaximumVariableSize = *RemainingVariableStorageSize;
     return EFI_SUCCESS;
 }
 
@@ -656,6 +652,9 @@ Return Value:
     EFI_PHYSICAL_ADDRESS Address;
     UINTN FreeOffset;
     PEFI_VARIABLE_HEADER Header;
+    EFI_PHYSICAL_ADDRESS IndexAddress;
+    UINTN IndexSize;
+    UINTN SlotCount;
     EFI_STATUS Status;
     UINTN TotalSize;
     EFI_ALLOCATE_TYPE Type;
@@ -763,6 +762,35 @@ Return Value:
 
 InitializeVariableServicesEnd:
 
+    //
+    // Allocate the hash index with at least twice as many slots as the region
+    // can hold entries, so probe sequences stay short and always end at an
+    // empty slot. Failure is not fatal, lookups just scan the region instead.
+    //
+
+    if (!EFI_ERROR(Status)) {
+        SlotCount = 1;
+        while (SlotCount <
+               ((TotalSize / EFI_VARIABLE_MINIMUM_ENTRY_SIZE) * 2)) {
+
+            SlotCount <<= 1;
+        }
+
+        IndexSize = SlotCount * sizeof(UINT32);
+        Status = EfiAllocatePages(AllocateAnyPages,
+                                  EfiRuntimeServicesData,
+                                  EFI_SIZE_TO_PAGES(IndexSize),
+                                  &IndexAddress);
+
+        if (!EFI_ERROR(Status)) {
+            EfiVariableIndex = (UINT32 *)(UINTN)IndexAddress;
+            EfiVariableIndexMask = SlotCount - 1;
+        }
+
+        EfipCoreBuildVariableIndex();
+        Status = EFI_SUCCESS;
+    }
+
     //
     // If everything worked, publish the variable backend protocol.
     //
@@ -835,6 +863,10 @@ Return Value:
     EfiConvertPointer(0, (VOID **)&EfiVariableHeader);
     EfiConvertPointer(0, (VOID **)&EfiVariableNextFree);
     EfiConvertPointer(0, (VOID **)&EfiVariableEnd);
+    if (EfiVariableIndex != NULL) {
+        EfiConvertPointer(0, (VOID **)&EfiVariableIndex);
+    }
+
     return;
 }
 
@@ -893,6 +925,7 @@ Return Value:
         EfiVariablesChanged = TRUE;
         EfiVariableHeader->Flags |= EFI_VARIABLE_FLAG_DIRTY;
         EfiVariableNextFree = (PEFI_VARIABLE_ENTRY)(EfiVariableHeader + 1);
+        EfipCoreBuildVariableIndex();
     }
 
     Header = Data;
@@ -965,6 +998,7 @@ Return Value:
         return EFI_NOT_READY;
     }
 
+    EfipCoreCompactVariables();
     EfipSetVariableDataCrc(EfiVariableHeader);
     *Data = EfiVariableHeader;
     *DataSize = (UINTN)EfiVariableEnd - (UINTN)EfiVariableHeader;
@@ -1091,9 +1125,14 @@ Return Value:
     }
 
     //
-    // Recompute the CRCs if anything has changed.
+    // Squeeze out deleted entries so only live variables are written, then
+    // recompute the CRCs.
     //
 
+    if (Header == EfiVariableHeader) {
+        EfipCoreCompactVariables();
+    }
+
     Status = EfipSetVariableDataCrc(Header);
     if (EFI_ERROR(Status)) {
         Header->Flags |= EFI_VARIABLE_FLAG_DIRTY;
@@ -1194,38 +1233,74 @@ Return Value:
 
 {
 
-    INTN CompareResult;
     PEFI_VARIABLE_ENTRY Entry;
+    UINTN NameSize;
     UINTN Size;
+    UINT32 Slot;
 
     //
-    // The first entry is a null terminated string.
+    // An empty name returns the first live entry.
     //
 
     Entry = (PEFI_VARIABLE_ENTRY)(EfiVariableHeader + 1);
     if (*VariableName == L'\0') {
-        if (Entry == EfiVariableNextFree) {
-            return NULL;
+        while (Entry + 1 <= EfiVariableNextFree) {
+            if (Entry->DataSize != 0) {
+                return Entry;
+            }
+
+            Size = sizeof(EFI_VARIABLE_ENTRY) + Entry->NameSize;
+            Size = ALIGN_VALUE(Size, 4);
+            Entry = (PEFI_VARIABLE_ENTRY)((UINT8 *)Entry + Size);
         }
 
-        return Entry;
+        return NULL;
     }
 
-    while (Entry + 1 <= EfiVariableNextFree) {
-        if ((Entry->DataSize != 0) &&
-            (EfiCoreCompareGuids(VendorGuid, &(Entry->VendorGuid)) != FALSE)) {
+    NameSize = (EfiCoreStringLength(VariableName) + 1) * sizeof(CHAR16);
+
+    //
+    // Probe the hash index if there is one. The table is never more than half
+    // full, so the probe always ends at an empty slot.
+    //
+
+    if (EfiVariableIndex != NULL) {
+        Slot = EfipCoreHashVariable(VariableName, NameSize, VendorGuid) &
+               EfiVariableIndexMask;
+
+        while (EfiVariableIndex[Slot] != 0) {
+            Entry = (PEFI_VARIABLE_ENTRY)((UINT8 *)EfiVariableHeader +
+                                          EfiVariableIndex[Slot]);
 
-            CompareResult = EfiCoreCompareMemory(VariableName,
-                                                 (CHAR16 *)(Entry + 1),
-                                                 Entry->NameSize);
+            if (EfipCoreVariableEntryMatches(Entry,
+                                             VariableName,
+                                             NameSize,
+                                             VendorGuid) != FALSE) {
 
-            if (CompareResult == 0) {
                 *Data = (VOID *)((UINT8 *)Entry +
                                  sizeof(EFI_VARIABLE_ENTRY) +
                                  Entry->NameSize);
 
                 return Entry;
             }
+
+            Slot = (Slot + 1) & EfiVariableIndexMask;
+        }
+
+        return NULL;
+    }
+
+    while (Entry + 1 <= EfiVariableNextFree) {
+        if (EfipCoreVariableEntryMatches(Entry,
+                                         VariableName,
+                                         NameSize,
+                                         VendorGuid) != FALSE) {
+
+            *Data = (VOID *)((UINT8 *)Entry +
+                             sizeof(EFI_VARIABLE_ENTRY) +
+                             Entry->NameSize);
+
+            return Entry;
         }
 
         Size = sizeof(EFI_VARIABLE_ENTRY) + Entry->NameSize + Entry->DataSize;
@@ -1236,6 +1311,63 @@ Return Value:
     return NULL;
 }
 
+BOOLEAN
+EfipCoreVariableEntryMatches (
+    PEFI_VARIABLE_ENTRY Entry,
+    CHAR16 *VariableName,
+    UINTN NameSize,
+    EFI_GUID *VendorGuid
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines whether the given variable entry is live and has
+    the given name and vendor GUID.
+
+Arguments:
+
+    Entry - Supplies a pointer to the variable entry to check.
+
+    VariableName - Supplies a pointer to the variable name to compare against.
+
+    NameSize - Supplies the size of the variable name in bytes, including the
+        null terminator.
+
+    VendorGuid - Supplies a pointer to the vendor GUID to compare against.
+
+Return Value:
+
+    TRUE if the entry matches.
+
+    FALSE if the entry is deleted or belongs to a different variable.
+
+--*/
+
+{
+
+    INTN CompareResult;
+
+    if ((Entry->DataSize == 0) || (Entry->NameSize != NameSize)) {
+        return FALSE;
+    }
+
+    if (EfiCoreCompareGuids(VendorGuid, &(Entry->VendorGuid)) == FALSE) {
+        return FALSE;
+    }
+
+    CompareResult = EfiCoreCompareMemory(VariableName,
+                                         (CHAR16 *)(Entry + 1),
+                                         NameSize);
+
+    if (CompareResult != 0) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 VOID
 EfipCoreDeleteVariableEntry (
     PEFI_VARIABLE_ENTRY Entry
@@ -1245,7 +1377,10 @@ EfipCoreDeleteVariableEntry (
 
 Routine Description:
 
-    This routine deletes the given variable entry.
+    This routine deletes the given variable entry. The entry is marked dead
+    in place by folding its data into its name and zeroing its data size, so
+    the region can still be walked. The space is reclaimed the next time the
+    region is compacted.
 
 Arguments:
 
@@ -1260,22 +1395,18 @@ Return Value:
 {
 
     EFI_TPL CurrentTpl;
-    UINT8 *Data;
     UINTN Size;
 
     CurrentTpl = TPL_HIGH_LEVEL;
     Size = sizeof(EFI_VARIABLE_ENTRY) + Entry->NameSize + Entry->DataSize;
     Size = ALIGN_VALUE(Size, 4);
-    Data = ((UINT8 *)Entry) + Size;
-    EfiCoreCopyMemory(Entry, Data, (UINTN)EfiVariableNextFree - (UINTN)Data);
     if (EfiIsAtRuntime() == FALSE) {
         CurrentTpl = EfiRaiseTPL(TPL_HIGH_LEVEL);
     }
 
-    EfiVariableHeader->FreeSize += Size;
-    EfiVariableNextFree =
-                  (PEFI_VARIABLE_ENTRY)(((UINT8 *)EfiVariableNextFree) - Size);
-
+    Entry->NameSize = Size - sizeof(EFI_VARIABLE_ENTRY);
+    Entry->DataSize = 0;
+    EfiVariableDeadSize += Size;
     EfiVariablesChanged = TRUE;
     EfiVariableHeader->Flags |= EFI_VARIABLE_FLAG_DIRTY;
     if (EfiIsAtRuntime() == FALSE) {
@@ -1334,10 +1465,20 @@ Return Value:
     StringSize = (EfiCoreStringLength(VariableName) + 1) * sizeof(CHAR16);
     Size = sizeof(EFI_VARIABLE_ENTRY) + StringSize + DataSize;
     Size = ALIGN_VALUE(Size, 4);
+    //
+    // If there's no room at the end of the region, try to reclaim the space
+    // held by deleted entries.
+    //
+
     if ((PEFI_VARIABLE_ENTRY)(((UINT8 *)EfiVariableNextFree) + Size) >
         EfiVariableEnd) {
 
-        return NULL;
+        EfipCoreCompactVariables();
+        if ((PEFI_VARIABLE_ENTRY)(((UINT8 *)EfiVariableNextFree) + Size) >
+            EfiVariableEnd) {
+
+            return NULL;
+        }
     }
 
     OldTpl = TPL_HIGH_LEVEL;
@@ -1353,6 +1494,7 @@ Return Value:
     EfiCoreCopyMemory(Entry + 1, VariableName, StringSize);
     EfiCoreCopyMemory(((UINT8 *)(Entry + 1)) + Entry->NameSize, Data, DataSize);
     EfiVariableNextFree = (PEFI_VARIABLE_ENTRY)(((UINT8 *)Entry) + Size);
+    EfipCoreIndexVariableEntry(Entry);
     EfiVariableHeader->FreeSize -= Size;
     EfiVariableHeader->Flags |= EFI_VARIABLE_FLAG_DIRTY;
     EfiVariablesChanged = TRUE;
@@ -1363,3 +1505,209 @@ Return Value:
     return Entry;
 }
 
+VOID
+EfipCoreCompactVariables (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine squeezes deleted entries out of the variable region, sliding
+    the live entries down, and then rebuilds the hash index.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    EFI_TPL CurrentTpl;
+    PEFI_VARIABLE_ENTRY Destination;
+    PEFI_VARIABLE_ENTRY Entry;
+    UINTN Size;
+
+    if (EfiVariableDeadSize == 0) {
+        return;
+    }
+
+    CurrentTpl = TPL_HIGH_LEVEL;
+    if (EfiIsAtRuntime() == FALSE) {
+        CurrentTpl = EfiRaiseTPL(TPL_HIGH_LEVEL);
+    }
+
+    Destination = (PEFI_VARIABLE_ENTRY)(EfiVariableHeader + 1);
+    Entry = Destination;
+    while (Entry + 1 <= EfiVariableNextFree) {
+        Size = sizeof(EFI_VARIABLE_ENTRY) + Entry->NameSize + Entry->DataSize;
+        Size = ALIGN_VALUE(Size, 4);
+        if (Entry->DataSize != 0) {
+            if (Destination != Entry) {
+                EfiCoreCopyMemory(Destination, Entry, Size);
+            }
+
+            Destination = (PEFI_VARIABLE_ENTRY)((UINT8 *)Destination + Size);
+        }
+
+        Entry = (PEFI_VARIABLE_ENTRY)((UINT8 *)Entry + Size);
+    }
+
+    EfiVariableHeader->FreeSize += (UINTN)EfiVariableNextFree -
+                                   (UINTN)Destination;
+
+    EfiVariableNextFree = Destination;
+    EfipCoreBuildVariableIndex();
+    if (EfiIsAtRuntime() == FALSE) {
+        EfiRestoreTPL(CurrentTpl);
+    }
+
+    return;
+}
+
+VOID
+EfipCoreBuildVariableIndex (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine rebuilds the hash index from the variable region, and
+    recounts the space taken by deleted entries.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PEFI_VARIABLE_ENTRY Entry;
+    UINTN Size;
+
+    if (EfiVariableIndex != NULL) {
+        EfiCoreSetMemory(EfiVariableIndex,
+                         (EfiVariableIndexMask + 1) * sizeof(UINT32),
+                         0);
+    }
+
+    EfiVariableDeadSize = 0;
+    Entry = (PEFI_VARIABLE_ENTRY)(EfiVariableHeader + 1);
+    while (Entry + 1 <= EfiVariableNextFree) {
+        Size = sizeof(EFI_VARIABLE_ENTRY) + Entry->NameSize + Entry->DataSize;
+        Size = ALIGN_VALUE(Size, 4);
+        if (Entry->DataSize == 0) {
+            EfiVariableDeadSize += Size;
+
+        } else {
+            EfipCoreIndexVariableEntry(Entry);
+        }
+
+        Entry = (PEFI_VARIABLE_ENTRY)((UINT8 *)Entry + Size);
+    }
+
+    return;
+}
+
+VOID
+EfipCoreIndexVariableEntry (
+    PEFI_VARIABLE_ENTRY Entry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a variable entry to the hash index.
+
+Arguments:
+
+    Entry - Supplies a pointer to the live variable entry to add.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINT32 Slot;
+
+    if (EfiVariableIndex == NULL) {
+        return;
+    }
+
+    Slot = EfipCoreHashVariable((CHAR16 *)(Entry + 1),
+                                Entry->NameSize,
+                                &(Entry->VendorGuid));
+
+    Slot &= EfiVariableIndexMask;
+    while (EfiVariableIndex[Slot] != 0) {
+        Slot = (Slot + 1) & EfiVariableIndexMask;
+    }
+
+    EfiVariableIndex[Slot] = (UINTN)Entry - (UINTN)EfiVariableHeader;
+    return;
+}
+
+UINT32
+EfipCoreHashVariable (
+    CHAR16 *VariableName,
+    UINTN NameSize,
+    EFI_GUID *VendorGuid
+    )
+
+/*++
+
+Routine Description:
+
+    This routine computes the index hash of a variable name and vendor GUID.
+
+Arguments:
+
+    VariableName - Supplies a pointer to the variable name.
+
+    NameSize - Supplies the size of the name in bytes, including the null
+        terminator.
+
+    VendorGuid - Supplies a pointer to the vendor GUID.
+
+Return Value:
+
+    Returns the hash value.
+
+--*/
+
+{
+
+    UINT8 *Bytes;
+    UINT32 Hash;
+    UINTN Index;
+
+    Hash = EFI_VARIABLE_HASH_OFFSET_BASIS;
+    Bytes = (UINT8 *)VendorGuid;
+    for (Index = 0; Index < sizeof(EFI_GUID); Index += 1) {
+        Hash = (Hash ^ Bytes[Index]) * EFI_VARIABLE_HASH_PRIME;
+    }
+
+    Bytes = (UINT8 *)VariableName;
+    for (Index = 0; Index < NameSize; Index += 1) {
+        Hash = (Hash ^ Bytes[Index]) * EFI_VARIABLE_HASH_PRIME;
+    }
+
+    return Hash;
+}
@@ -6,6 +6,84 @@
 #define KEY_TAB '\t'
 #define ASCII_CHAR(x)   ((x) & 0xFF)
 
+//
+// Define the number of keystrokes buffered between reads. This must be a
+// power of two.
+//
+
+#define EFI_SERIAL_KEY_BUFFER_SIZE 32
+
+//
+// Define how often the serial console drains its input, in 100ns units.
+//
+
+#define EFI_SERIAL_POLL_PERIOD 100000
+
+EFIAPI
+VOID
+EfipSerialPollNotify (
+    EFI_EVENT Event,
+    VOID *Context
+    );
+
+VOID
+EfipSerialPollInput (
+    VOID
+    );
+
+BOOLEAN
+EfipSerialTranslateKey (
+    INTN Character,
+    EFI_INPUT_KEY *Key
+    );
+
+//
+// Keystrokes are pulled off the console by a periodic timer (and by anyone
+// waiting or reading) into this ring, so that ReadKeyStroke never has to
+// block. The ring is only touched at TPL_NOTIFY.
+//
+
+EFI_SIMPLE_TEXT_INPUT_PROTOCOL *EfiSerialConIn;
+EFI_EVENT EfiSerialPollEvent;
+EFI_INPUT_KEY EfiSerialKeyBuffer[EFI_SERIAL_KEY_BUFFER_SIZE];
+UINTN EfiSerialKeyHead;
+UINTN EfiSerialKeyTail;
+
+EFI_STATUS
+EfiCoreInitializeSerialConsole (
+    EFI_SIMPLE_TEXT_INPUT_PROTOCOL *Input
+    )
+{
+    EFI_STATUS Status;
+
+    EfiSerialConIn = Input;
+    Status = EfiCoreCreateEvent(EVT_NOTIFY_WAIT,
+                                TPL_NOTIFY,
+                                EfipSerialPollNotify,
+                                NULL,
+                                &(Input->WaitForKey));
+
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Status = EfiCoreCreateEvent(EVT_TIMER | EVT_NOTIFY_SIGNAL,
+                                TPL_NOTIFY,
+                                EfipSerialPollNotify,
+                                NULL,
+                                &EfiSerialPollEvent);
+
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Status = EfiCoreSetTimer(EfiSerialPollEvent,
+                             TimerPeriodic,
+                             EFI_SERIAL_POLL_PERIOD);
+
+    return Status;
+}
+
 EFI_STATUS
 EFIAPI
 EfiSimpleTextInputExReset (
@@ -86,45 +164,123 @@ EfiSimpleTextInputReadKeyStroke (
         EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *This,
         EFI_INPUT_KEY *Key
         )
+{
+    EFI_TPL OldTpl;
+    EFI_STATUS Status;
+
+    OldTpl = EfiCoreRaiseTpl(TPL_NOTIFY);
+    EfipSerialPollInput();
+    if (EfiSerialKeyHead == EfiSerialKeyTail) {
+        Status = EFI_NOT_READY;
+
+    } else {
+        *Key = EfiSerialKeyBuffer[EfiSerialKeyHead];
+        EfiSerialKeyHead = (EfiSerialKeyHead + 1) &
+                           (EFI_SERIAL_KEY_BUFFER_SIZE - 1);
+
+        Status = EFI_SUCCESS;
+    }
+
+    EfiCoreRestoreTpl(OldTpl);
+    return Status;
+}
+
+EFIAPI
+VOID
+EfipSerialPollNotify (
+    EFI_EVENT Event,
+    VOID *Context
+    )
+{
+    EfipSerialPollInput();
+    return;
+}
+
+VOID
+EfipSerialPollInput (
+    VOID
+    )
+{
+    INTN Character;
+    EFI_INPUT_KEY Key;
+    UINTN NextTail;
+
+    //
+    // Drain everything the console has, even if the ring is full, so the
+    // UART's receive FIFO never overflows. Keystrokes that don't fit are
+    // dropped.
+    //
+
+    while (havekey() != 0) {
+        Character = getchar();
+        if (EfipSerialTranslateKey(Character, &Key) == FALSE) {
+            continue;
+        }
+
+        NextTail = (EfiSerialKeyTail + 1) & (EFI_SERIAL_KEY_BUFFER_SIZE - 1);
+        if (NextTail != EfiSerialKeyHead) {
+            EfiSerialKeyBuffer[EfiSerialKeyTail] = Key;
+            EfiSerialKeyTail = NextTail;
+        }
+    }
+
+    if ((EfiSerialKeyHead != EfiSerialKeyTail) &&
+        (EfiSerialConIn != NULL) &&
+        (EfiSerialConIn->WaitForKey != NULL)) {
+
+        EfiCoreSignalEvent(EfiSerialConIn->WaitForKey);
+    }
+
+    return;
+}
+
+BOOLEAN
+EfipSerialTranslateKey (
+    INTN Character,
+    EFI_INPUT_KEY *Key
+    )
 {
     CHAR16 c;
 
-    c = getchar();
+    if (Character == ERR) {
+        return FALSE;
+    }
 
+    c = (CHAR16)Character;
     if (c == KEY_TAB) {
         Key->ScanCode = 0x00;
         Key->UnicodeChar = '\t';
-        return EFI_SUCCESS;
+        return TRUE;
     }
 
     if (c == KEY_ESC) {
         Key->ScanCode = 0x17;
         Key->UnicodeChar = 0x00;
-        return EFI_SUCCESS;
+        return TRUE;
     }
 
     if (c == KEY_ENTER) {
         Key->ScanCode = 0x00;
         Key->UnicodeChar = '\n';
-        return EFI_SUCCESS;
+        return TRUE;
     }
 
     if (c == KEY_BACKSPACE) {
         Key->ScanCode = 0x00;
         Key->UnicodeChar = 0x08;
-        return EFI_SUCCESS;
+        return TRUE;
     }
 
     if (c == KEY_DC) {
         Key->ScanCode = 0x08;
         Key->UnicodeChar = 0x00;
-        return EFI_SUCCESS;
+        return TRUE;
     }
 
     if (c >= KEY_F(1) && c <= KEY_F(10)) {
         Key->ScanCode = (CHAR16)(0x0b + c - KEY_F(1));
         Key->UnicodeChar = 0x00;
-        return EFI_SUCCESS;
+        return TRUE;
     }
 
     Key->UnicodeChar = 0x00;
@@ -135,9 +291,6 @@ EfiSimpleTextInputReadKeyStroke (
         case KEY_DOWN:
             Key->ScanCode = 0x0a;
             break;
-        case KEY_DC:
-            Key->ScanCode = 0x08;
-            break;
         case KEY_HOME:
             Key->ScanCode = 0x05;
             break;
@@ -150,13 +303,7 @@ EfiSimpleTextInputReadKeyStroke (
             break;
     }
 
-    if (c == ERR) {
-        Key->ScanCode = 0x00;
-        Key->UnicodeChar = 0x00;
-        return EFI_SUCCESS;
-    }
-
-    return EFI_SUCCESS;
+    return TRUE;
 }
 
 EFI_STATUS
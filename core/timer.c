@@ -369,6 +369,53 @@ Return Value:
     return;
 }
 
+VOID
+EfiCorePollTimerDeadline (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine checks the earliest timer deadline against the time counter
+    on platforms that have no periodic clock interrupt, and kicks off timer
+    expiration if it has passed. On platforms with a clock interrupt this
+    routine does nothing.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINT64 DueTime;
+
+    if ((EfiClockTimerServiceRoutine != NULL) ||
+        (EfiReadTimerRoutine == NULL)) {
+
+        return;
+    }
+
+    //
+    // Avoid touching the timer hardware at all if nothing is queued.
+    //
+
+    DueTime = EfipCoreGetNextTimerDueTime();
+    if (DueTime == MAX_UINT64) {
+        return;
+    }
+
+    EfipCoreTimerTick(EfiCoreReadTimeCounter());
+    return;
+}
+
 EFI_STATUS
 EfiCoreInitializeTimerServices (
     VOID
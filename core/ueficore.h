@@ -438,6 +438,30 @@ Return Value:
 
 --*/
 
+VOID
+EfiCorePollTimerDeadline (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine checks the earliest timer deadline against the time counter
+    on platforms that have no periodic clock interrupt, and kicks off timer
+    expiration if it has passed. On platforms with a clock interrupt this
+    routine does nothing.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
 EFI_STATUS
 EfiCoreInitializeTimerServices (
     VOID
@@ -762,7 +786,8 @@ EfipCoreTimerTick (
 
 Routine Description:
 
-    This routine is called when a clock interrupt comes in.
+    This routine is called when a clock interrupt comes in, or when the next
+    timer deadline is polled on platforms without a periodic clock interrupt.
 
 Arguments:
 
@@ -774,6 +799,29 @@ Return Value:
 
 --*/
 
+UINT64
+EfipCoreGetNextTimerDueTime (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns the due time of the earliest queued timer.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the time counter value at which the next timer expires.
+
+    MAX_UINT64 if no timers are queued.
+
+--*/
+
 VOID
 EfipCoreNotifySignalList (
     EFI_GUID *EventGroup
@@ -886,6 +934,33 @@ Return Value:
 
 --*/
 
+UINT32
+EfiCoreHashGuid (
+    EFI_GUID *Guid,
+    UINT32 Mask
+    );
+
+/*++
+
+Routine Description:
+
+    This routine computes the hash of a GUID, used to index the protocol
+    database, the dispatcher wait lists, and the firmware volume file names.
+
+Arguments:
+
+    Guid - Supplies a pointer to the GUID to hash.
+
+    Mask - Supplies the mask to apply to the hash. Hash tables with a power of
+        two number of buckets should pass the bucket count minus one. Supply
+        MAX_UINT32 to get the full hash.
+
+Return Value:
+
+    Returns the masked hash of the GUID.
+
+--*/
+
 EFI_STATUS
 EfiCoreInitializeImageServices (
     VOID *FirmwareBaseAddress,
@@ -916,6 +991,32 @@ Return Value:
 
 --*/
 
+CONST CHAR8 *
+EfiCoreGetImageName (
+    EFI_HANDLE ImageHandle
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns a short name for a loaded image, taken from the file
+    name of its debug information.
+
+Arguments:
+
+    ImageHandle - Supplies the handle of the loaded image.
+
+Return Value:
+
+    Returns a pointer to the null terminated file name, without any leading
+    directories.
+
+    NULL if the handle is not an image or the image carries no debug
+    information.
+
+--*/
+
 EFIAPI
 EFI_STATUS
 EfiCoreCalculateCrc32 (
@@ -1105,6 +1206,29 @@ Return Value:
 
 --*/
 
+VOID
+EfiCoreDispatcherProtocolInstalled (
+    EFI_GUID *Protocol
+    );
+
+/*++
+
+Routine Description:
+
+    This routine is called when a protocol interface is installed. It moves
+    any drivers waiting on that protocol back to the dependent queue so their
+    dependency expressions are evaluated again on the next dispatch pass.
+
+Arguments:
+
+    Protocol - Supplies a pointer to the GUID of the installed protocol.
+
+Return Value:
+
+    None.
+
+--*/
+
 EFIAPI
 UINTN
 EfipArchSetJump (
@@ -1255,6 +1379,27 @@ Return Value:
 
 --*/
 
+VOID
+EfiDiskIoDumpStatistics (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine prints the block cache hit and miss counts for each disk.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
 EFIAPI
 EFI_STATUS
 EfiPartitionDriverEntry (
@@ -1381,6 +1526,101 @@ Return Value:
 
 --*/
 
+EFI_STATUS
+EfiCoreInitializeSerialConsole (
+    EFI_SIMPLE_TEXT_INPUT_PROTOCOL *Input
+    );
+
+/*++
+
+Routine Description:
+
+    This routine sets up buffered input for the serial console. It creates
+    the WaitForKey event for the given input protocol and a periodic timer
+    that drains incoming keystrokes into a ring buffer.
+
+Arguments:
+
+    Input - Supplies a pointer to the simple text input protocol to set up.
+
+Return Value:
+
+    EFI status code.
+
+--*/
+
+EFI_STATUS
+EfiCoreInitializePerformanceTracing (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine signs up to publish the firmware performance data table when
+    the ReadyToBoot event group is signaled.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    EFI status code.
+
+--*/
+
+VOID
+EfiCorePerfStartPhase (
+    CONST CHAR8 *Name
+    );
+
+/*++
+
+Routine Description:
+
+    This routine closes the current boot phase, if any, and opens a new one.
+
+Arguments:
+
+    Name - Supplies the name of the new phase, or NULL to just close the
+        current phase.
+
+Return Value:
+
+    None.
+
+--*/
+
+VOID
+EfiCorePerfSetIdentity (
+    UINTN Token,
+    CONST CHAR8 *Name,
+    UINT64 Data
+    );
+
+/*++
+
+Routine Description:
+
+    This routine replaces the name and data of an open performance trace
+    record, for events whose subject is only known once they finish.
+
+Arguments:
+
+    Token - Supplies the token returned when the record was opened.
+
+    Name - Supplies an optional name for the event.
+
+    Data - Supplies the new data value for the record.
+
+Return Value:
+
+    None.
+
+--*/
+
 EFI_STATUS
 EFIAPI
 EfiSimpleTextInputExReset (
@@ -34,10 +34,35 @@ Environment:
 #include <minoca/kernel/kdebug.h>
 #include <stdio.h>
 
+//
+// --------------------------------------------------------------------- Macros
+//
+
+//
+// This macro evaluates to non-zero if the memory routines can move whole
+// native words between the two given pointers. x86 handles unaligned word
+// accesses in hardware, so only the destination needs aligning there. Other
+// architectures require both pointers to share the same word alignment.
+//
+
+#if defined(EFI_X86) || defined(EFI_X64)
+
+#define EFI_CORE_CAN_COPY_WORDS(_First, _Second) TRUE
+
+#else
+
+#define EFI_CORE_CAN_COPY_WORDS(_First, _Second) \
+    ((((UINTN)(_First) ^ (UINTN)(_Second)) & EFI_CORE_WORD_MASK) == 0)
+
+#endif
+
 //
 // ---------------------------------------------------------------- Definitions
 //
 
+#define EFI_CORE_WORD_SIZE sizeof(UINTN)
+#define EFI_CORE_WORD_MASK (EFI_CORE_WORD_SIZE - 1)
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -97,7 +122,8 @@ EfiCoreCopyMemory (
 
 Routine Description:
 
-    This routine copies the contents of one buffer to another.
+    This routine copies the contents of one buffer to another. The buffers
+    may overlap.
 
 Arguments:
 
@@ -115,13 +141,106 @@ Return Value:
 
 {
 
+    UINT8 *DestinationBytes;
+    UINTN *DestinationWords;
+    UINT8 *SourceBytes;
+    UINTN *SourceWords;
+
     ASSERT((Destination != NULL) && (Source != NULL));
 
+    if ((Length == 0) || (Destination == Source)) {
+        return;
+    }
+
+    DestinationBytes = Destination;
+    SourceBytes = Source;
+
+    //
+    // If the destination overlaps the end of the source, copy backwards so
+    // that source bytes are read before they get clobbered.
+    //
+
+    if ((DestinationBytes > SourceBytes) &&
+        (DestinationBytes < SourceBytes + Length)) {
+
+        DestinationBytes += Length;
+        SourceBytes += Length;
+        if (EFI_CORE_CAN_COPY_WORDS(DestinationBytes, SourceBytes)) {
+            while ((((UINTN)DestinationBytes & EFI_CORE_WORD_MASK) != 0) &&
+                   (Length != 0)) {
+
+                DestinationBytes -= 1;
+                SourceBytes -= 1;
+                *DestinationBytes = *SourceBytes;
+                Length -= 1;
+            }
+
+            DestinationWords = (UINTN *)DestinationBytes;
+            SourceWords = (UINTN *)SourceBytes;
+            while (Length >= EFI_CORE_WORD_SIZE) {
+                DestinationWords -= 1;
+                SourceWords -= 1;
+                *DestinationWords = *SourceWords;
+                Length -= EFI_CORE_WORD_SIZE;
+            }
+
+            DestinationBytes = (UINT8 *)DestinationWords;
+            SourceBytes = (UINT8 *)SourceWords;
+        }
+
+        while (Length != 0) {
+            DestinationBytes -= 1;
+            SourceBytes -= 1;
+            *DestinationBytes = *SourceBytes;
+            Length -= 1;
+        }
+
+        return;
+    }
+
+    //
+    // Copy forwards, aligning the destination first and then moving a few
+    // words per iteration.
+    //
+
+    if (EFI_CORE_CAN_COPY_WORDS(DestinationBytes, SourceBytes)) {
+        while ((((UINTN)DestinationBytes & EFI_CORE_WORD_MASK) != 0) &&
+               (Length != 0)) {
+
+            *DestinationBytes = *SourceBytes;
+            DestinationBytes += 1;
+            SourceBytes += 1;
+            Length -= 1;
+        }
+
+        DestinationWords = (UINTN *)DestinationBytes;
+        SourceWords = (UINTN *)SourceBytes;
+        while (Length >= (EFI_CORE_WORD_SIZE * 4)) {
+            DestinationWords[0] = SourceWords[0];
+            DestinationWords[1] = SourceWords[1];
+            DestinationWords[2] = SourceWords[2];
+            DestinationWords[3] = SourceWords[3];
+            DestinationWords += 4;
+            SourceWords += 4;
+            Length -= EFI_CORE_WORD_SIZE * 4;
+        }
+
+        while (Length >= EFI_CORE_WORD_SIZE) {
+            *DestinationWords = *SourceWords;
+            DestinationWords += 1;
+            SourceWords += 1;
+            Length -= EFI_CORE_WORD_SIZE;
+        }
+
+        DestinationBytes = (UINT8 *)DestinationWords;
+        SourceBytes = (UINT8 *)SourceWords;
+    }
+
     while (Length != 0) {
-        *(INT8 *)Destination = *(INT8 *)Source;
+        *DestinationBytes = *SourceBytes;
+        DestinationBytes += 1;
+        SourceBytes += 1;
         Length -= 1;
-        Destination += 1;
-        Source += 1;
     }
 
     return;
@@ -158,11 +277,43 @@ Return Value:
 {
 
     UINT8 *Bytes;
-    UINTN Index;
+    UINTN Pattern;
+    UINTN *Words;
 
     Bytes = Buffer;
-    for (Index = 0; Index < Size; Index += 1) {
-        Bytes[Index] = Value;
+    while ((((UINTN)Bytes & EFI_CORE_WORD_MASK) != 0) && (Size != 0)) {
+        *Bytes = Value;
+        Bytes += 1;
+        Size -= 1;
+    }
+
+    //
+    // Replicate the byte across a native word and fill the aligned middle of
+    // the buffer a few words at a time.
+    //
+
+    Pattern = ((UINTN)-1 / 0xFF) * Value;
+    Words = (UINTN *)Bytes;
+    while (Size >= (EFI_CORE_WORD_SIZE * 4)) {
+        Words[0] = Pattern;
+        Words[1] = Pattern;
+        Words[2] = Pattern;
+        Words[3] = Pattern;
+        Words += 4;
+        Size -= EFI_CORE_WORD_SIZE * 4;
+    }
+
+    while (Size >= EFI_CORE_WORD_SIZE) {
+        *Words = Pattern;
+        Words += 1;
+        Size -= EFI_CORE_WORD_SIZE;
+    }
+
+    Bytes = (UINT8 *)Words;
+    while (Size != 0) {
+        *Bytes = Value;
+        Bytes += 1;
+        Size -= 1;
     }
 
     return;
@@ -200,19 +351,56 @@ Return Value:
 
 {
 
-    INTN Result;
+    UINT8 *FirstBytes;
+    UINTN *FirstWords;
+    UINT8 *SecondBytes;
+    UINTN *SecondWords;
 
     ASSERT((FirstBuffer != NULL) && (SecondBuffer != NULL));
 
+    FirstBytes = FirstBuffer;
+    SecondBytes = SecondBuffer;
+
+    //
+    // Skip over matching words quickly. On a mismatch, fall through to the
+    // byte loop, which will find the offending byte within the word.
+    //
+
+    if (EFI_CORE_CAN_COPY_WORDS(FirstBytes, SecondBytes)) {
+        while ((((UINTN)FirstBytes & EFI_CORE_WORD_MASK) != 0) &&
+               (Length != 0)) {
+
+            if (*FirstBytes != *SecondBytes) {
+                return (INTN)*FirstBytes - (INTN)*SecondBytes;
+            }
+
+            FirstBytes += 1;
+            SecondBytes += 1;
+            Length -= 1;
+        }
+
+        FirstWords = (UINTN *)FirstBytes;
+        SecondWords = (UINTN *)SecondBytes;
+        while ((Length >= EFI_CORE_WORD_SIZE) &&
+               (*FirstWords == *SecondWords)) {
+
+            FirstWords += 1;
+            SecondWords += 1;
+            Length -= EFI_CORE_WORD_SIZE;
+        }
+
+        FirstBytes = (UINT8 *)FirstWords;
+        SecondBytes = (UINT8 *)SecondWords;
+    }
+
     while (Length != 0) {
-        if (*(INT8 *)FirstBuffer != *(INT8 *)SecondBuffer) {
-            Result = (INTN)(UINT8 *)FirstBuffer - (INTN)(UINT8 *)SecondBuffer;
-            return Result;
+        if (*FirstBytes != *SecondBytes) {
+            return (INTN)*FirstBytes - (INTN)*SecondBytes;
         }
 
+        FirstBytes += 1;
+        SecondBytes += 1;
         Length -= 1;
-        FirstBuffer += 1;
-        SecondBuffer += 1;
     }
 
     return 0;
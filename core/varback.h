@@ -35,10 +35,88 @@ Author:
         {0xB5, 0x29, 0x86, 0xC7, 0x58, 0x66, 0x2F, 0xAA}        \
     }
 
+#define EFI_VARIABLE_HEADER_MAGIC 0x73726156
+#define EFI_VARIABLE_HEADER_VERSION 0x00010000
+
+//
+// This flag is set if the variable storage area has been written to but not
+// flushed to non-volatile storage.
+//
+
+#define EFI_VARIABLE_FLAG_DIRTY 0x00000001
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
 
+/*++
+
+Structure Description:
+
+    This structure sits at the head of the variable storage area.
+
+Members:
+
+    Magic - Stores the constant value EFI_VARIABLE_HEADER_MAGIC.
+
+    Version - Stores the version of the storage format. Set to
+        EFI_VARIABLE_HEADER_VERSION.
+
+    Flags - Stores a bitfield of flags describing the variable state. See
+        EFI_VARIABLE_FLAG_* definitions.
+
+    DataSize - Stores the size of the region of valid data following this
+        header, including the header itself.
+
+    FreeSize - Stores the amount of space that's free data. This may not be
+        contiguous.
+
+    HeaderCrc32 - Stores the CRC32 of the header, up to this field. Use the
+        EFI_VARIABLE_HEADER_CRC_SIZE define.
+
+    DataCrc32 - Stores the CRC32 of the data portion, not including this header.
+
+--*/
+
+typedef struct _EFI_VARIABLE_HEADER {
+    UINT32 Magic;
+    UINT32 Version;
+    UINT32 Flags;
+    UINT32 DataSize;
+    UINT32 FreeSize;
+    UINT32 HeaderCrc32;
+    UINT32 DataCrc32;
+} EFI_VARIABLE_HEADER, *PEFI_VARIABLE_HEADER;
+
+/*++
+
+Structure Description:
+
+    This structure defines the layout of an EFI variable. This structure
+    is laid out in an array, but there's variable length data off the end of
+    each structure.
+
+Members:
+
+    VendorGuid - Stores the vendor GUID of the variable.
+
+    Attributes - Stores the variable attributes.
+
+    NameSize - Stores the size of the name that immediately follows this
+        structure, in bytes, including the null terminator.
+
+    DataSize - Stores the size of the data that immediately follows the name
+        data, in bytes.
+
+--*/
+
+typedef struct _EFI_VARIABLE_ENTRY {
+    EFI_GUID VendorGuid;
+    UINT32 Attributes;
+    UINT32 NameSize;
+    UINT32 DataSize;
+} EFI_VARIABLE_ENTRY, *PEFI_VARIABLE_ENTRY;
+
 typedef struct _EFI_VARIABLE_BACKEND_PROTOCOL EFI_VARIABLE_BACKEND_PROTOCOL;
 
 typedef
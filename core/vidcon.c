@@ -58,6 +58,14 @@ Environment:
 
 #define EFI_GRAPHICS_CONSOLE_MAGIC 0x43646956 // 'CdiV'
 
+//
+// Define the size of the buffer handed to the base video library to cache
+// expanded glyphs in. This holds a couple hundred 8x16 glyphs at 32 bits per
+// pixel.
+//
+
+#define EFI_GRAPHICS_GLYPH_CACHE_SIZE 0x20000
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -95,6 +103,32 @@ Members:
     GraphicsMode - Stores the graphics mode number the console was initialized
         on.
 
+    Shadow - Stores a pointer to the cached shadow copy of the frame buffer
+        that characters are drawn into, or NULL if drawing goes straight to
+        the frame buffer.
+
+    BytesPerScanLine - Stores the size of one scan line in bytes, in both the
+        shadow and the frame buffer.
+
+    TextRows - Stores the number of text rows on the console.
+
+    TopRow - Stores the shadow text row that is currently displayed at the top
+        of the screen. Scrolling just advances this, treating the text rows of
+        the shadow as a ring.
+
+    DirtyLeft - Stores the left edge of the screen rectangle that has changed
+        in the shadow since the last flush, in pixels, inclusive.
+
+    DirtyTop - Stores the top edge of the dirty rectangle, inclusive.
+
+    DirtyRight - Stores the right edge of the dirty rectangle, exclusive. This
+        is zero if nothing is dirty.
+
+    DirtyBottom - Stores the bottom edge of the dirty rectangle, exclusive.
+
+    GlyphCache - Stores a pointer to the memory the base video library caches
+        expanded glyphs in, or NULL if glyphs are expanded every time.
+
 --*/
 
 typedef struct _EFI_GRAPHICS_CONSOLE {
@@ -108,6 +142,15 @@ typedef struct _EFI_GRAPHICS_CONSOLE {
     UINT32 PixelsPerScanLine;
     UINT32 BitsPerPixel;
     UINT32 GraphicsMode;
+    VOID *Shadow;
+    UINTN BytesPerScanLine;
+    UINT32 TextRows;
+    UINT32 TopRow;
+    UINT32 DirtyLeft;
+    UINT32 DirtyTop;
+    UINT32 DirtyRight;
+    UINT32 DirtyBottom;
+    VOID *GlyphCache;
 } EFI_GRAPHICS_CONSOLE, *PEFI_GRAPHICS_CONSOLE;
 
 //
@@ -185,6 +228,27 @@ EfipGraphicsTextEnableCursor (
     BOOLEAN Visible
     );
 
+VOID
+EfipGraphicsScroll (
+    PEFI_GRAPHICS_CONSOLE Console,
+    UINTN ColumnCount,
+    UINTN RowCount
+    );
+
+VOID
+EfipGraphicsMarkDirty (
+    PEFI_GRAPHICS_CONSOLE Console,
+    UINT32 Left,
+    UINT32 Top,
+    UINT32 Right,
+    UINT32 Bottom
+    );
+
+VOID
+EfipGraphicsFlush (
+    PEFI_GRAPHICS_CONSOLE Console
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -502,15 +566,62 @@ Return Value:
         }
 
         Device->BitsPerPixel = FrameBuffer.BitsPerPixel;
-        FrameBuffer.Header.Size = FrameBuffer.PixelsPerScanLine *
-                                  (FrameBuffer.BitsPerPixel / 8) *
+        Device->BytesPerScanLine = FrameBuffer.PixelsPerScanLine *
+                                   (FrameBuffer.BitsPerPixel / 8);
+
+        FrameBuffer.Header.Size = Device->BytesPerScanLine *
                                   FrameBuffer.Height;
 
         FrameBuffer.Header.Type = SystemResourceFrameBuffer;
+
+        //
+        // Draw into a cached shadow of the frame buffer, and copy only what
+        // changed out to the real thing. Frame buffer memory is usually
+        // uncached or write-combined, so reading it back (as scrolling would)
+        // is very slow. If the shadow can't be allocated, draw directly.
+        //
+
+        Device->Shadow = EfiCoreAllocateBootPool(FrameBuffer.Header.Size);
+        if (Device->Shadow != NULL) {
+            FrameBuffer.Header.VirtualAddress = Device->Shadow;
+        }
+
         VideoStatus = VidInitialize(&EfiVideoContext, &FrameBuffer);
         if (KSUCCESS(VideoStatus)) {
+            Device->TextRows = Device->VerticalResolution /
+                               EfiVideoContext.Font->CellHeight;
+
             VidSetPalette(&EfiVideoContext, &EfiVideoPalette, NULL);
+
+            //
+            // Console output is mostly the same few characters in the same
+            // few colors, so let the base video library keep them around
+            // already expanded. This is just an optimization, carry on
+            // without it if there's no memory.
+            //
+
+            Device->GlyphCache =
+                       EfiCoreAllocateBootPool(EFI_GRAPHICS_GLYPH_CACHE_SIZE);
+
+            if (Device->GlyphCache != NULL) {
+                VideoStatus = VidSetGlyphCache(&EfiVideoContext,
+                                               Device->GlyphCache,
+                                               EFI_GRAPHICS_GLYPH_CACHE_SIZE);
+
+                if (!KSUCCESS(VideoStatus)) {
+                    EfiCoreFreePool(Device->GlyphCache);
+                    Device->GlyphCache = NULL;
+                }
+            }
+
             VidClearScreen(&EfiVideoContext, 0, 0, -1, -1);
+            EfipGraphicsMarkDirty(Device,
+                                  0,
+                                  0,
+                                  Device->HorizontalResolution,
+                                  Device->VerticalResolution);
+
+            EfipGraphicsFlush(Device);
             Status = EFI_SUCCESS;
 
         } else {
@@ -529,6 +640,15 @@ Return Value:
         }
 
         if (EFI_ERROR(Status)) {
+            if (Device->Shadow != NULL) {
+                EfiCoreFreePool(Device->Shadow);
+            }
+
+            if (Device->GlyphCache != NULL) {
+                VidSetGlyphCache(&EfiVideoContext, NULL, 0);
+                EfiCoreFreePool(Device->GlyphCache);
+            }
+
             EfiCoreFreePool(Device);
 
         } else {
@@ -623,12 +743,10 @@ Return Value:
     UINT32 CellWidth;
     UINTN ColumnCount;
     PEFI_GRAPHICS_CONSOLE Console;
-    UINTN CopySize;
     VOID *FrameBuffer;
-    UINTN LastLineY;
-    VOID *LineOne;
     EFI_SIMPLE_TEXT_OUTPUT_MODE *Mode;
     UINTN RowCount;
+    UINTN ShadowRow;
     EFI_STATUS Status;
 
     Console = EFI_GRAPHICS_CONSOLE_FROM_THIS(This);
@@ -655,19 +773,8 @@ Return Value:
         return EFI_DEVICE_ERROR;
     }
 
-    //
-    // Calculate the number of bytes to copy when scrolling, which is the
-    // number of console lines minus one.
-    //
-
     CellWidth = EfiVideoContext.Font->CellWidth;
     CellHeight = EfiVideoContext.Font->CellHeight;
-    CopySize = Console->PixelsPerScanLine * (Console->BitsPerPixel / 8) *
-               ((RowCount - 1) * CellHeight);
-
-    LineOne = FrameBuffer + (Console->PixelsPerScanLine *
-                             (Console->BitsPerPixel / 8) *
-                             CellHeight);
 
     //
     // Loop printing each character.
@@ -697,13 +804,7 @@ Return Value:
             //
 
             } else {
-                EfiCopyMem(FrameBuffer, LineOne, CopySize);
-                LastLineY = (RowCount - 1) * CellHeight;
-                VidClearScreen(&EfiVideoContext,
-                               0,
-                               LastLineY,
-                               ColumnCount * CellWidth,
-                               LastLineY + CellHeight);
+                EfipGraphicsScroll(Console, ColumnCount, RowCount);
             }
 
         } else if (*String == CHAR_CARRIAGE_RETURN) {
@@ -719,24 +820,29 @@ Return Value:
             if (Mode->CursorColumn >= ColumnCount - 1) {
                 Mode->CursorColumn = 0;
                 if (Mode->CursorRow == RowCount - 1) {
-                    EfiCopyMem(FrameBuffer, LineOne, CopySize);
-                    LastLineY = (RowCount - 1) * CellHeight;
-                    VidClearScreen(&EfiVideoContext,
-                                   0,
-                                   LastLineY,
-                                   ColumnCount * CellWidth,
-                                   LastLineY + CellHeight);
+                    EfipGraphicsScroll(Console, ColumnCount, RowCount);
 
                 } else {
                     Mode->CursorRow += 1;
                 }
             }
 
+            ShadowRow = Mode->CursorRow;
+            if (Console->Shadow != NULL) {
+                ShadowRow = (ShadowRow + Console->TopRow) % RowCount;
+            }
+
             VidPrintString(&EfiVideoContext,
                            Mode->CursorColumn,
-                           Mode->CursorRow,
+                           ShadowRow,
                            Ascii);
 
+            EfipGraphicsMarkDirty(Console,
+                                  Mode->CursorColumn * CellWidth,
+                                  Mode->CursorRow * CellHeight,
+                                  (Mode->CursorColumn + 1) * CellWidth,
+                                  (Mode->CursorRow + 1) * CellHeight);
+
             Mode->CursorColumn += 1;
 
         //
@@ -750,6 +856,7 @@ Return Value:
         String += 1;
     }
 
+    EfipGraphicsFlush(Console);
     return EFI_SUCCESS;
 }
 
@@ -983,6 +1090,14 @@ Return Value:
     ASSERT(Console->Magic == EFI_GRAPHICS_CONSOLE_MAGIC);
 
     VidClearScreen(&EfiVideoContext, 0, 0, -1, -1);
+    Console->TopRow = 0;
+    EfipGraphicsMarkDirty(Console,
+                          0,
+                          0,
+                          Console->HorizontalResolution,
+                          Console->VerticalResolution);
+
+    EfipGraphicsFlush(Console);
     return This->SetCursorPosition(This, 0, 0);
 }
 
@@ -1088,3 +1203,241 @@ Return Value:
     return EFI_UNSUPPORTED;
 }
 
+VOID
+EfipGraphicsScroll (
+    PEFI_GRAPHICS_CONSOLE Console,
+    UINTN ColumnCount,
+    UINTN RowCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine scrolls the console up by one text row and clears the new
+    bottom row.
+
+Arguments:
+
+    Console - Supplies a pointer to the graphics console.
+
+    ColumnCount - Supplies the number of text columns on the console.
+
+    RowCount - Supplies the number of text rows on the console.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINT32 CellHeight;
+    UINT32 CellWidth;
+    UINTN CopySize;
+    UINT8 *FrameBuffer;
+    UINTN LastLineY;
+
+    CellWidth = EfiVideoContext.Font->CellWidth;
+    CellHeight = EfiVideoContext.Font->CellHeight;
+
+    //
+    // With a shadow, the row that scrolls off the top simply becomes the new
+    // bottom row. Nothing moves, but the whole text area has to be copied
+    // out again.
+    //
+
+    if (Console->Shadow != NULL) {
+        Console->TopRow = (Console->TopRow + 1) % RowCount;
+        LastLineY = ((Console->TopRow + RowCount - 1) % RowCount) * CellHeight;
+        VidClearScreen(&EfiVideoContext,
+                       0,
+                       LastLineY,
+                       ColumnCount * CellWidth,
+                       LastLineY + CellHeight);
+
+        EfipGraphicsMarkDirty(Console,
+                              0,
+                              0,
+                              ColumnCount * CellWidth,
+                              RowCount * CellHeight);
+
+        return;
+    }
+
+    //
+    // Without a shadow, move everything but the first row up in the frame
+    // buffer itself.
+    //
+
+    FrameBuffer = (UINT8 *)(UINTN)(Console->Graphics->Mode->FrameBufferBase);
+    CopySize = Console->BytesPerScanLine * ((RowCount - 1) * CellHeight);
+    EfiCopyMem(FrameBuffer,
+               FrameBuffer + (Console->BytesPerScanLine * CellHeight),
+               CopySize);
+
+    LastLineY = (RowCount - 1) * CellHeight;
+    VidClearScreen(&EfiVideoContext,
+                   0,
+                   LastLineY,
+                   ColumnCount * CellWidth,
+                   LastLineY + CellHeight);
+
+    return;
+}
+
+VOID
+EfipGraphicsMarkDirty (
+    PEFI_GRAPHICS_CONSOLE Console,
+    UINT32 Left,
+    UINT32 Top,
+    UINT32 Right,
+    UINT32 Bottom
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a screen rectangle to the region that needs to be
+    copied from the shadow out to the frame buffer.
+
+Arguments:
+
+    Console - Supplies a pointer to the graphics console.
+
+    Left - Supplies the left edge of the rectangle in pixels, inclusive.
+
+    Top - Supplies the top edge of the rectangle in pixels, inclusive.
+
+    Right - Supplies the right edge of the rectangle in pixels, exclusive.
+
+    Bottom - Supplies the bottom edge of the rectangle in pixels, exclusive.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    if (Console->Shadow == NULL) {
+        return;
+    }
+
+    if (Right > Console->HorizontalResolution) {
+        Right = Console->HorizontalResolution;
+    }
+
+    if (Bottom > Console->VerticalResolution) {
+        Bottom = Console->VerticalResolution;
+    }
+
+    if ((Left >= Right) || (Top >= Bottom)) {
+        return;
+    }
+
+    if (Console->DirtyRight == 0) {
+        Console->DirtyLeft = Left;
+        Console->DirtyTop = Top;
+        Console->DirtyRight = Right;
+        Console->DirtyBottom = Bottom;
+        return;
+    }
+
+    if (Left < Console->DirtyLeft) {
+        Console->DirtyLeft = Left;
+    }
+
+    if (Top < Console->DirtyTop) {
+        Console->DirtyTop = Top;
+    }
+
+    if (Right > Console->DirtyRight) {
+        Console->DirtyRight = Right;
+    }
+
+    if (Bottom > Console->DirtyBottom) {
+        Console->DirtyBottom = Bottom;
+    }
+
+    return;
+}
+
+VOID
+EfipGraphicsFlush (
+    PEFI_GRAPHICS_CONSOLE Console
+    )
+
+/*++
+
+Routine Description:
+
+    This routine copies the dirty rectangle from the shadow out to the frame
+    buffer. The frame buffer is only ever written, never read.
+
+Arguments:
+
+    Console - Supplies a pointer to the graphics console.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN BytesPerPixel;
+    UINTN ColumnOffset;
+    UINT8 *FrameBuffer;
+    UINTN RowSize;
+    UINT32 ShadowY;
+    UINT32 TextHeight;
+    UINT32 TopY;
+    UINT32 Y;
+
+    if ((Console->Shadow == NULL) || (Console->DirtyRight == 0)) {
+        return;
+    }
+
+    //
+    // Don't draw over a frame buffer that has since been set to another mode.
+    //
+
+    FrameBuffer = (UINT8 *)(UINTN)(Console->Graphics->Mode->FrameBufferBase);
+    if ((FrameBuffer == NULL) ||
+        (Console->Graphics->Mode->Mode != Console->GraphicsMode)) {
+
+        Console->DirtyRight = 0;
+        return;
+    }
+
+    BytesPerPixel = Console->BitsPerPixel / 8;
+    ColumnOffset = Console->DirtyLeft * BytesPerPixel;
+    RowSize = (Console->DirtyRight - Console->DirtyLeft) * BytesPerPixel;
+    TextHeight = Console->TextRows * EfiVideoContext.Font->CellHeight;
+    TopY = Console->TopRow * EfiVideoContext.Font->CellHeight;
+    for (Y = Console->DirtyTop; Y < Console->DirtyBottom; Y += 1) {
+
+        //
+        // Scan lines in the text area come from the ring of shadow rows.
+        // Anything below the last full text row is not part of the ring.
+        //
+
+        ShadowY = Y;
+        if (Y < TextHeight) {
+            ShadowY = (Y + TopY) % TextHeight;
+        }
+
+        EfiCopyMem(FrameBuffer + (Y * Console->BytesPerScanLine) + ColumnOffset,
+                   (UINT8 *)Console->Shadow +
+                   (ShadowY * Console->BytesPerScanLine) + ColumnOffset,
+                   RowSize);
+    }
+
+    Console->DirtyRight = 0;
+    return;
+}
@@ -34,6 +34,7 @@ typedef struct SataDrive {
 
 	AhciCtrlr *ctrlr;
 	AhciIoPort *port;
+	int dirty;	// writes since the last FLUSH CACHE EXT
 } SataDrive;
 
 #define writel_with_flush(a,b)	do { writel(a, b); readl(b); } while (0)
@@ -154,12 +155,15 @@ static int ahci_fill_sg(AhciSg *sg, void *buf, int len)
 }
 
 
-static void ahci_fill_cmd_slot(AhciIoPort *pp, uint32_t opts)
+static void ahci_fill_cmd_slot(AhciIoPort *pp, int tag, void *tbl,
+			       uint32_t opts)
 {
-	pp->cmd_slot->opts = htolel(opts);
-	pp->cmd_slot->status = 0;
-	pp->cmd_slot->tbl_addr = htolel((uint32_t)(uintptr_t)pp->cmd_tbl);
-	pp->cmd_slot->tbl_addr_hi = 0;
+	AhciCommandHeader *slot = pp->cmd_slot + tag;
+
+	slot->opts = htolel(opts);
+	slot->status = 0;
+	slot->tbl_addr = htolel((uint32_t)(uintptr_t)tbl);
+	slot->tbl_addr_hi = 0;
 }
 
 
@@ -188,7 +192,7 @@ static int ahci_port_start(AhciIoPort *port, int index)
 	 * 32 bytes each in size
 	 */
 	port->cmd_slot = (AhciCommandHeader *)mem;
-	mem += (AHCI_CMD_SLOT_SZ + 224);
+	mem += AHCI_CMD_LIST_SZ;
 
 	/*
 	 * Second item: Received-FIS area
@@ -217,6 +221,27 @@ static int ahci_port_start(AhciIoPort *port, int index)
 }
 
 
+/*
+ * Allocate one command table per tag so that up to depth READ FPDMA QUEUED
+ * commands can be outstanding at once. The command list itself already has
+ * room for all 32 slots.
+ */
+static void ahci_port_enable_ncq(AhciIoPort *port, int depth)
+{
+	if (depth > AHCI_MAX_CMD_SLOTS)
+		depth = AHCI_MAX_CMD_SLOTS;
+
+	port->ncq_tbl = memalign(128, depth * AHCI_CMD_TBL_SZ);
+	if (!port->ncq_tbl) {
+		printf("No mem for NCQ tables on port %d.\n", port->index);
+		return;
+	}
+	memset(port->ncq_tbl, 0, depth * AHCI_CMD_TBL_SZ);
+
+	port->queue_depth = depth;
+	printf("Port %d: NCQ enabled, depth %d.\n", port->index, depth);
+}
+
 static int ahci_device_data_io(AhciIoPort *port, void *fis, int fis_len,
 			       void *buf, int buf_len, int is_write, int wait)
 {
@@ -235,7 +260,7 @@ static int ahci_device_data_io(AhciIoPort *port, void *fis, int fis_len,
 	if (buf && buf_len)
 		sg_count = ahci_fill_sg(port->cmd_tbl_sg, buf, buf_len);
 	uint32_t opts = (fis_len >> 2) | (sg_count << 16) | (is_write << 6);
-	ahci_fill_cmd_slot(port, opts);
+	ahci_fill_cmd_slot(port, 0, port->cmd_tbl, opts);
 
 	writel_with_flush(1, port_mmio + PORT_CMD_ISSUE);
 
@@ -252,8 +277,8 @@ static int ahci_device_data_io(AhciIoPort *port, void *fis, int fis_len,
  * In the general case of generic rotating media it makes sense to have a
  * flush capability. It probably even makes sense in the case of SSDs because
  * one cannot always know for sure what kind of internal cache/flush mechanism
- * is embodied therein.  Because writing to the disk in u-boot is very rare,
- * this flush command will be invoked after every block write.
+ * is embodied therein. Writes leave the drive dirty, and this flush is issued
+ * once through the block device's flush op rather than after every write.
  */
 static int ahci_io_flush(AhciIoPort *port)
 {
@@ -284,7 +309,7 @@ static int ahci_io_flush(AhciIoPort *port)
 #define MAX_SATA_BLOCKS_READ_WRITE	0x80
 #endif
 
-static int ahci_read_write(SataDrive *drive, lba_t start, uint16_t count,
+static int ahci_read_write(SataDrive *drive, lba_t start, lba_t count,
 			   void *buf, int is_write)
 {
 	uint8_t fis[20];
@@ -293,21 +318,22 @@ static int ahci_read_write(SataDrive *drive, lba_t start, uint16_t count,
 	memset(fis, 0, 20);
 	fis[0] = 0x27;		 // Host to device FIS.
 	fis[1] = 1 << 7;	 // Command FIS.
-	// Command byte
-	fis[2] = is_write ? ATA_CMD_WRITE_SECTORS_EXT :
-		ATA_CMD_READ_SECTORS_EXT;
+	// Command byte. Reads and writes both use DMA.
+	fis[2] = is_write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
 
 	while (count) {
 		uint16_t tblocks = MIN(MAX_SATA_BLOCKS_READ_WRITE, count);
 		uintptr_t tsize = tblocks * drive->dev.block_size;
 
-		// LBA48 SATA command using 32bit address range.
+		// LBA48 SATA command.
 		fis[3] = 0xe0; /* features */
 		fis[4] = (start >> 0) & 0xff;
 		fis[5] = (start >> 8) & 0xff;
 		fis[6] = (start >> 16) & 0xff;
 		fis[7] = 1 << 6; /* device reg: set LBA mode */
-		fis[8] = ((start >> 24) & 0xff);
+		fis[8] = (start >> 24) & 0xff;
+		fis[9] = (start >> 32) & 0xff;
+		fis[10] = (start >> 40) & 0xff;
 
 		// Block count.
 		fis[12] = (tblocks >> 0) & 0xff;
@@ -321,12 +347,6 @@ static int ahci_read_write(SataDrive *drive, lba_t start, uint16_t count,
 			return -1;
 		}
 
-		// Flush writes.
-		if (is_write) {
-			if (ahci_io_flush(drive->port) < 0)
-				return -1;
-		}
-
 		buf = (uint8_t *)buf + tsize;
 		count -= tblocks;
 		start += tblocks;
@@ -335,9 +355,169 @@ static int ahci_read_write(SataDrive *drive, lba_t start, uint16_t count,
 	return 0;
 }
 
+/*
+ * Stop and restart the command engine after a failed queued command. The
+ * device aborts every outstanding NCQ command on error and will not accept
+ * new ones until the NCQ error log has been read.
+ */
+static void ahci_port_recover(AhciIoPort *port)
+{
+	uint8_t *port_mmio = port->port_mmio;
+	uint8_t fis[20];
+	// The log is a DMA target, and PRD addresses must be word aligned.
+	uint16_t log[256];
+
+	uint32_t port_cmd = readl(port_mmio + PORT_CMD);
+	writel_with_flush(port_cmd & ~PORT_CMD_START, port_mmio + PORT_CMD);
+	if (WAIT_WHILE((readl(port_mmio + PORT_CMD) & PORT_CMD_LIST_ON), 500))
+		printf("AHCI: Port %d engine did not stop.\n", port->index);
+
+	writel(readl(port_mmio + PORT_SCR_ERR), port_mmio + PORT_SCR_ERR);
+	writel(readl(port_mmio + PORT_IRQ_STAT), port_mmio + PORT_IRQ_STAT);
+	writel_with_flush(port_cmd | PORT_CMD_START, port_mmio + PORT_CMD);
+
+	memset(fis, 0, 20);
+	fis[0] = 0x27;		 // Host to device FIS.
+	fis[1] = 1 << 7;	 // Command FIS.
+	fis[2] = ATA_CMD_READ_LOG_EXT;
+	fis[4] = 0x10;		 // NCQ command error log.
+	fis[7] = 1 << 6;
+	fis[12] = 1;		 // One page.
+	if (ahci_device_data_io(port, fis, sizeof(fis), log, sizeof(log), 0,
+				wait_ms_dataio))
+		printf("AHCI: Reading NCQ error log failed.\n");
+}
+
+/* A queued command is outstanding until both its SActive and CI bits clear. */
+static uint32_t ahci_ncq_active(uint8_t *port_mmio)
+{
+	return readl(port_mmio + PORT_SCR_ACT) |
+	       readl(port_mmio + PORT_CMD_ISSUE);
+}
+
+/*
+ * Read or write using FPDMA QUEUED commands, keeping up to queue_depth
+ * commands of up to one full PRD entry each in flight at once, and reaping
+ * completions as the device clears their bits in SActive.
+ */
+static int ahci_queued_io(SataDrive *drive, lba_t start, lba_t count,
+			  void *buf, int is_write)
+{
+	AhciIoPort *port = drive->port;
+	uint8_t *port_mmio = port->port_mmio;
+	uint32_t max_blocks = MAX_DATA_BYTE_COUNT / drive->dev.block_size;
+	uint32_t busy = 0;
+	int wait = wait_ms_dataio;
+
+	uint32_t port_status = readl(port_mmio + PORT_SCR_STAT);
+	if ((port_status & 0xf) != 0x3) {
+		printf("No link on port %d!\n", port->index);
+		return -1;
+	}
+
+	// Clear stale status so only errors from this request are seen.
+	writel(readl(port_mmio + PORT_IRQ_STAT), port_mmio + PORT_IRQ_STAT);
+
+	while (count || busy) {
+		// Fill every free tag with the next chunk.
+		uint32_t issue = 0;
+		for (int tag = 0; count && tag < port->queue_depth; tag++) {
+			if (busy & (1u << tag))
+				continue;
+
+			uint32_t tblocks = MIN(max_blocks, count);
+			uintptr_t tsize = tblocks * drive->dev.block_size;
+			uint8_t *tbl = (uint8_t *)port->ncq_tbl +
+				       tag * AHCI_CMD_TBL_SZ;
+			uint8_t *fis = tbl;
+
+			memset(fis, 0, 20);
+			fis[0] = 0x27;		 // Host to device FIS.
+			fis[1] = 1 << 7;	 // Command FIS.
+			fis[2] = is_write ? ATA_CMD_WRITE_FPDMA_QUEUED :
+				ATA_CMD_READ_FPDMA_QUEUED;
+			fis[3] = (tblocks >> 0) & 0xff;
+			fis[4] = (start >> 0) & 0xff;
+			fis[5] = (start >> 8) & 0xff;
+			fis[6] = (start >> 16) & 0xff;
+			fis[7] = 1 << 6; /* device reg: set LBA mode */
+			fis[8] = (start >> 24) & 0xff;
+			fis[9] = (start >> 32) & 0xff;
+			fis[10] = (start >> 40) & 0xff;
+			fis[11] = (tblocks >> 8) & 0xff;
+			fis[12] = tag << 3;
+
+			int sg_count = ahci_fill_sg((AhciSg *)(tbl +
+						    AHCI_CMD_TBL_HDR), buf,
+						    tsize);
+			if (sg_count < 0)
+				return -1;
+
+			ahci_fill_cmd_slot(port, tag, tbl,
+					   (20 >> 2) | (sg_count << 16) |
+					   (is_write << 6));
+
+			issue |= 1u << tag;
+			buf = (uint8_t *)buf + tsize;
+			count -= tblocks;
+			start += tblocks;
+		}
+
+		if (issue) {
+			busy |= issue;
+			writel(issue, port_mmio + PORT_SCR_ACT);
+			writel_with_flush(issue, port_mmio + PORT_CMD_ISSUE);
+		}
+
+		// Wait for at least one command to finish.
+		if (WAIT_WHILE((ahci_ncq_active(port_mmio) & busy) == busy &&
+			       !(readl(port_mmio + PORT_IRQ_STAT) &
+				 PORT_IRQ_TF_ERR), wait)) {
+			printf("AHCI: Queued I/O timeout!\n");
+			ahci_port_recover(port);
+			return -1;
+		}
+
+		if (readl(port_mmio + PORT_IRQ_STAT) & PORT_IRQ_TF_ERR) {
+			printf("AHCI: Queued %s error, TFD %#x.\n",
+			       is_write ? "write" : "read",
+			       readl(port_mmio + PORT_TFDATA));
+			ahci_port_recover(port);
+			return -1;
+		}
+
+		busy &= ahci_ncq_active(port_mmio);
+	}
+
+	return 0;
+}
+
+/*
+ * Try the queued path first if the drive has NCQ enabled. Returns 0 if the
+ * request completed that way, or -1 if the caller should use the unqueued
+ * path instead.
+ */
+static int ahci_try_queued_io(SataDrive *drive, lba_t start, lba_t count,
+			      void *buf, int is_write)
+{
+	if (!drive->port->queue_depth)
+		return -1;
+
+	if (!ahci_queued_io(drive, start, count, buf, is_write))
+		return 0;
+
+	// Don't trust NCQ on this drive again; retry unqueued.
+	printf("AHCI: Disabling NCQ on port %d.\n", drive->port->index);
+	drive->port->queue_depth = 0;
+	return -1;
+}
+
 static lba_t ahci_read(BlockDevOps *me, lba_t start, lba_t count, void *buffer)
 {
 	SataDrive *drive = container_of(me, SataDrive, dev.ops);
+	if (!ahci_try_queued_io(drive, start, count, buffer, 0))
+		return count;
+
 	if (ahci_read_write(drive, start, count, buffer, 0)) {
 		printf("AHCI: Read failed.\n");
 		return -1;
@@ -349,6 +529,10 @@ static lba_t ahci_write(BlockDevOps *me, lba_t start, lba_t count,
 			const void *buffer)
 {
 	SataDrive *drive = container_of(me, SataDrive, dev.ops);
+	drive->dirty = 1;
+	if (!ahci_try_queued_io(drive, start, count, (void *)buffer, 1))
+		return count;
+
 	if (ahci_read_write(drive, start, count, (void *)buffer, 1)) {
 		printf("AHCI: Write failed.\n");
 		return -1;
@@ -356,6 +540,19 @@ static lba_t ahci_write(BlockDevOps *me, lba_t start, lba_t count,
 	return count;
 }
 
+static int ahci_flush(BlockDevOps *me)
+{
+	SataDrive *drive = container_of(me, SataDrive, dev.ops);
+	if (!drive->dirty)
+		return 0;
+
+	if (ahci_io_flush(drive->port) < 0)
+		return -1;
+
+	drive->dirty = 0;
+	return 0;
+}
+
 static inline int ata_implements_major(AtaIdentify *id, AtaMajorRevision rev)
 {
 	uint16_t major = le16toh(id->major_version);
@@ -415,14 +612,30 @@ static int ahci_identify(AhciIoPort *port, AtaIdentify *id)
 	return ret;
 }
 
+/*
+ * Returns the NCQ queue depth the drive reports in its IDENTIFY data, or 0 if
+ * it does not support NCQ. Word 76 is the SATA capabilities word.
+ */
+static int ata_ncq_depth(AtaIdentify *id)
+{
+	uint16_t sata_cap = le16toh(id->word76_79[0]);
+
+	if (sata_cap == 0 || sata_cap == 0xffff || !(sata_cap & (1 << 8)))
+		return 0;
+
+	return (le16toh(id->queue_depth) & 0x1f) + 1;
+}
+
 static int ahci_read_capacity(AhciIoPort *port, lba_t *cap,
-			      unsigned *block_size)
+			      unsigned *block_size, int *ncq_depth)
 {
 	AtaIdentify id;
 
 	if (ahci_identify(port, &id))
 		return -1;
 
+	*ncq_depth = ata_ncq_depth(&id);
+
 	uint32_t cap32;
 	memcpy(&cap32, &id.sectors28, sizeof(cap32));
 	*cap = letohl(cap32);
@@ -435,125 +648,144 @@ static int ahci_read_capacity(AhciIoPort *port, lba_t *cap,
 	return 0;
 }
 
-static int ahci_ctrlr_init(BlockDevCtrlrOps *me)
+/*
+ * Bring up the SATA link on every implemented port. Each stage is started on
+ * all ports before any of them is polled, so ports without a drive cost one
+ * shared timeout rather than one timeout each.
+ */
+static void ahci_ports_linkup(AhciCtrlr *ctrlr)
 {
-	uint32_t host_impl_bitmap;
-
-	AhciCtrlr *ctrlr = container_of(me, AhciCtrlr, ctrlr.ops);
-
-	ctrlr->mmio_base = (void *)pci_read_resource(ctrlr->dev, 5);
-	printf("AHCI MMIO base = %p\n", ctrlr->mmio_base);
-
-	// JMicron-specific fixup taken from kernel:
-	// make sure we're in AHCI mode
-	if (pci_read_config16(ctrlr->dev, REG_VENDOR_ID) == 0x197b)
-		pci_write_config8(ctrlr->dev, 0x41, 0xa1);
-
-	/* initialize adapter */
-	pcidev_t pdev = ctrlr->dev;
 	void *mmio = ctrlr->mmio_base;
-
-	uint32_t cap_save = readl(mmio + HOST_CAP);
-	cap_save &= ((1 << 28) | (1 << 17));
-	cap_save |= (1 << 27);
-
-	// Global controller reset.
-	uint32_t host_ctl = readl(mmio + HOST_CTL);
-	if ((host_ctl & HOST_RESET) == 0)
-		writel_with_flush(host_ctl | HOST_RESET,
-			(uintptr_t)mmio + HOST_CTL);
-
-	// Reset must complete within 1 second.
-	if (WAIT_WHILE((readl(mmio + HOST_CTL) & HOST_RESET), 1000)) {
-		printf("Controller reset failed.\n");
-		return -1;
-	}
-
-	writel_with_flush(HOST_AHCI_EN, mmio + HOST_CTL);
-	writel(cap_save, mmio + HOST_CAP);
-	writel_with_flush(0xf, mmio + HOST_PORTS_IMPL);
-
-	ctrlr->cap = readl(mmio + HOST_CAP);
-	host_impl_bitmap = ctrlr->port_map = readl(mmio + HOST_PORTS_IMPL);
-	/* ABAR+0x0 (GHC_CAP) reports number of SATA ports, its always read as
-	 * +1 means if '0' which means number of enabled SATA port is 1.
-	 * ABAR+0xC (GHC_PI) provides port bit map, hence relied on Port Map
-	 * not number of SATA port
-	 */
-	ctrlr->n_ports = 0;
-	while (host_impl_bitmap != 0) {
-		ctrlr->n_ports++;
-		host_impl_bitmap = host_impl_bitmap >> 1;
-	}
-
-	printf("cap %#x  port_map %#x  n_ports %d\n",
-	      ctrlr->cap, ctrlr->port_map, ctrlr->n_ports);
-
+	uint32_t port_cmd_bits = PORT_CMD_LIST_ON | PORT_CMD_FIS_ON |
+				 PORT_CMD_FIS_RX | PORT_CMD_START;
+	uint32_t implemented = 0;
+	uint32_t stopping = 0;
+	uint32_t pending;
+	uint32_t linked = 0;
+	uint64_t start;
+
+	/* Make sure no port is active, stopping all of them at once. */
 	for (int i = 0; i < ctrlr->n_ports; i++) {
 		/* Skip ports that are not enabled. */
 		if (!(ctrlr->port_map & (1 << i)))
 			continue;
 
+		implemented |= 1 << i;
 		ctrlr->ports[i].port_mmio = ahci_port_base(mmio, i);
 		uint8_t *port_mmio = (uint8_t *)ctrlr->ports[i].port_mmio;
 		ahci_setup_port(&ctrlr->ports[i], mmio, i);
 
-		/* make sure port is not active */
 		uint32_t port_cmd = readl(port_mmio + PORT_CMD);
-		uint32_t port_cmd_bits =
-			PORT_CMD_LIST_ON | PORT_CMD_FIS_ON |
-			PORT_CMD_FIS_RX | PORT_CMD_START;
 		if (port_cmd & port_cmd_bits) {
 			printf("Port %d is active. Deactivating.\n", i);
 			port_cmd &= ~port_cmd_bits;
 			writel_with_flush(port_cmd, port_mmio + PORT_CMD);
+			stopping |= 1 << i;
+		}
+	}
 
-			/* spec says 500 msecs for each bit, so
-			 * this is slightly incorrect.
-			 */
-			mdelay(500);
+	/* The engines get 500 msecs to stop, shared across all ports. */
+	start = timer_us(0);
+	while (stopping && timer_us(start) < 500 * 1000) {
+		for (int i = 0; i < ctrlr->n_ports; i++) {
+			if (!(stopping & (1 << i)))
+				continue;
+
+			uint8_t *port_mmio = ctrlr->ports[i].port_mmio;
+			if (!(readl(port_mmio + PORT_CMD) &
+			      (PORT_CMD_LIST_ON | PORT_CMD_FIS_ON)))
+				stopping &= ~(1 << i);
 		}
+		udelay(10);
+	}
 
-		/* Bring up SATA link. */
-		port_cmd = PORT_CMD_SPIN_UP | PORT_CMD_FIS_RX;
-		writel_with_flush(port_cmd, port_mmio + PORT_CMD);
-
-		int j;
-		uint32_t tmp;
-		for (j = 0; j < wait_ms_linkup; j++) {
-			tmp = readl(port_mmio + PORT_SCR_STAT);
-			if ((tmp & 0xf) == 0x3)
-				break;
-			mdelay(1);
+	/* Start link bring-up on every port. */
+	for (int i = 0; i < ctrlr->n_ports; i++) {
+		if (!(implemented & (1 << i)))
+			continue;
+
+		uint8_t *port_mmio = ctrlr->ports[i].port_mmio;
+		writel_with_flush(PORT_CMD_SPIN_UP | PORT_CMD_FIS_RX,
+				  port_mmio + PORT_CMD);
+	}
+
+	/* Poll all links together against a single deadline. */
+	start = timer_us(0);
+	pending = implemented;
+	while (pending) {
+		uint64_t elapsed = timer_us(start);
+		for (int i = 0; i < ctrlr->n_ports; i++) {
+			if (!(pending & (1 << i)))
+				continue;
+
+			uint8_t *port_mmio = ctrlr->ports[i].port_mmio;
+			if ((readl(port_mmio + PORT_SCR_STAT) & 0xf) == 0x3) {
+				printf("SATA link %d ok after %llu us.\n", i,
+				       (unsigned long long)elapsed);
+				pending &= ~(1 << i);
+				linked |= 1 << i;
+			}
 		}
-		if (j == wait_ms_linkup) {
+
+		if (elapsed >= wait_ms_linkup * 1000)
+			break;
+
+		udelay(10);
+	}
+
+	for (int i = 0; i < ctrlr->n_ports; i++) {
+		if (pending & (1 << i))
 			printf("SATA link %d timeout.\n", i);
+	}
+
+	/* Clear error status, then wait for all drives to spin up. */
+	for (int i = 0; i < ctrlr->n_ports; i++) {
+		if (!(linked & (1 << i)))
 			continue;
-		} else {
-			printf("SATA link %d ok.\n", i);
-		}
 
-		/* Clear error status */
+		uint8_t *port_mmio = ctrlr->ports[i].port_mmio;
 		uint32_t port_scr_err = readl(port_mmio + PORT_SCR_ERR);
 		if (port_scr_err)
 			writel(port_scr_err, port_mmio + PORT_SCR_ERR);
+	}
 
-		/* Wait for SATA device to complete spin-up. */
-		printf("Waiting for device on port %d... ", i);
+	printf("Waiting for devices on ports %#x... ", linked);
+	start = timer_us(0);
+	pending = linked;
+	while (pending) {
+		uint64_t elapsed = timer_us(start);
+		for (int i = 0; i < ctrlr->n_ports; i++) {
+			if (!(pending & (1 << i)))
+				continue;
 
-		for (j = 0; j < wait_ms_spinup; j++) {
-			tmp = readl(port_mmio + PORT_TFDATA);
-			if (!(tmp & (ATA_STAT_BUSY | ATA_STAT_DRQ)))
-				break;
-			mdelay(1);
+			uint8_t *port_mmio = ctrlr->ports[i].port_mmio;
+			uint32_t tmp = readl(port_mmio + PORT_TFDATA);
+			if (!(tmp & (ATA_STAT_BUSY | ATA_STAT_DRQ))) {
+				printf("%d: %llu ms ", i,
+				       (unsigned long long)elapsed / 1000);
+				pending &= ~(1 << i);
+			}
 		}
-		if (j == wait_ms_spinup)
-			printf("timeout.\n");
-		else
-			printf("ok. Target spinup took %d ms.\n", j);
+
+		if (elapsed >= wait_ms_spinup * 1000)
+			break;
+
+		udelay(10);
+	}
+
+	if (pending)
+		printf("timeout on %#x.\n", pending);
+	else
+		printf("ok.\n");
+
+	for (int i = 0; i < ctrlr->n_ports; i++) {
+		if (!(linked & (1 << i)))
+			continue;
+
+		uint8_t *port_mmio = ctrlr->ports[i].port_mmio;
 
 		/* Clear error status */
-		port_scr_err = readl(port_mmio + PORT_SCR_ERR);
+		uint32_t port_scr_err = readl(port_mmio + PORT_SCR_ERR);
 		if (port_scr_err) {
 			printf("PORT_SCR_ERR %#x\n", port_scr_err);
 			writel(port_scr_err, port_mmio + PORT_SCR_ERR);
@@ -577,6 +809,63 @@ static int ahci_ctrlr_init(BlockDevCtrlrOps *me)
 		if ((port_scr_stat & 0xf) == 0x3)
 			ctrlr->link_port_map |= (0x1 << i);
 	}
+}
+
+static int ahci_ctrlr_init(BlockDevCtrlrOps *me)
+{
+	uint32_t host_impl_bitmap;
+
+	AhciCtrlr *ctrlr = container_of(me, AhciCtrlr, ctrlr.ops);
+
+	ctrlr->mmio_base = (void *)pci_read_resource(ctrlr->dev, 5);
+	printf("AHCI MMIO base = %p\n", ctrlr->mmio_base);
+
+	// JMicron-specific fixup taken from kernel:
+	// make sure we're in AHCI mode
+	if (pci_read_config16(ctrlr->dev, REG_VENDOR_ID) == 0x197b)
+		pci_write_config8(ctrlr->dev, 0x41, 0xa1);
+
+	/* initialize adapter */
+	pcidev_t pdev = ctrlr->dev;
+	void *mmio = ctrlr->mmio_base;
+
+	uint32_t cap_save = readl(mmio + HOST_CAP);
+	cap_save &= ((1 << 28) | (1 << 17));
+	cap_save |= (1 << 27);
+
+	// Global controller reset.
+	uint32_t host_ctl = readl(mmio + HOST_CTL);
+	if ((host_ctl & HOST_RESET) == 0)
+		writel_with_flush(host_ctl | HOST_RESET,
+			(uintptr_t)mmio + HOST_CTL);
+
+	// Reset must complete within 1 second.
+	if (WAIT_WHILE((readl(mmio + HOST_CTL) & HOST_RESET), 1000)) {
+		printf("Controller reset failed.\n");
+		return -1;
+	}
+
+	writel_with_flush(HOST_AHCI_EN, mmio + HOST_CTL);
+	writel(cap_save, mmio + HOST_CAP);
+	writel_with_flush(0xf, mmio + HOST_PORTS_IMPL);
+
+	ctrlr->cap = readl(mmio + HOST_CAP);
+	host_impl_bitmap = ctrlr->port_map = readl(mmio + HOST_PORTS_IMPL);
+	/* ABAR+0x0 (GHC_CAP) reports number of SATA ports, its always read as
+	 * +1 means if '0' which means number of enabled SATA port is 1.
+	 * ABAR+0xC (GHC_PI) provides port bit map, hence relied on Port Map
+	 * not number of SATA port
+	 */
+	ctrlr->n_ports = 0;
+	while (host_impl_bitmap != 0) {
+		ctrlr->n_ports++;
+		host_impl_bitmap = host_impl_bitmap >> 1;
+	}
+
+	printf("cap %#x  port_map %#x  n_ports %d\n",
+	      ctrlr->cap, ctrlr->port_map, ctrlr->n_ports);
+
+	ahci_ports_linkup(ctrlr);
 
 	host_ctl = readl(mmio + HOST_CTL);
 	writel(host_ctl | HOST_IRQ_EN, mmio + HOST_CTL);
@@ -599,17 +888,24 @@ static int ahci_ctrlr_init(BlockDevCtrlrOps *me)
 			}
 			lba_t cap;
 			unsigned block_size;
-			if (ahci_read_capacity(port, &cap, &block_size)) {
+			int ncq_depth;
+			if (ahci_read_capacity(port, &cap, &block_size,
+					       &ncq_depth)) {
 				printf("Can't read port %d's capacity.\n", i);
 				continue;
 			}
 
+			if ((ctrlr->cap & HOST_CAP_NCQ) && ncq_depth > 1)
+				ahci_port_enable_ncq(port, MIN(ncq_depth,
+					((ctrlr->cap >> 8) & 0x1f) + 1));
+
 			SataDrive *sata_drive = xzalloc(sizeof(*sata_drive));
 			static const int name_size = 18;
 			char *name = xmalloc(name_size);
 			snprintf(name, name_size, "Sata port %d", i);
 			sata_drive->dev.ops.read = &ahci_read;
 			sata_drive->dev.ops.write = &ahci_write;
+			sata_drive->dev.ops.flush = &ahci_flush;
 			sata_drive->dev.ops.new_stream = &new_simple_stream;
 			sata_drive->dev.name = name;
 			sata_drive->dev.removable = 0;
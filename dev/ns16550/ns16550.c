@@ -66,6 +66,13 @@ Environment:
 #define NS16550_LINE_STATUS_TRANSMIT_EMPTY 0x20
 #define NS16550_LINE_STATUS_ERRORS         0x8E
 
+//
+// Define the transmit FIFO sizes.
+//
+
+#define NS16550_FIFO_SIZE 16
+#define NS16550_64_BYTE_FIFO_SIZE 64
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -355,8 +362,8 @@ EfipNs16550Transmit (
 
 Routine Description:
 
-    This routine writes data out the serial port. This routine should busily
-    spin if the previously sent byte has not finished transmitting.
+    This routine writes data out the serial port. This routine busily spins
+    whenever the transmit FIFO is full.
 
 Arguments:
 
@@ -376,16 +383,34 @@ Return Value:
 
 {
 
-    UINT32 ByteIndex;
+    UINTN BurstEnd;
+    UINTN BurstSize;
+    UINTN ByteIndex;
     UINT8 *Bytes;
     UINT8 StatusRegister;
 
+    //
+    // The FIFOs are always enabled, so once the holding register reads empty
+    // the whole transmit FIFO is free (or all but the trigger level if the
+    // empty interrupt fires early).
+    //
+
+    BurstSize = NS16550_FIFO_SIZE;
+    if ((Context->Flags & NS16550_FLAG_64_BYTE_FIFO) != 0) {
+        BurstSize = NS16550_64_BYTE_FIFO_SIZE;
+    }
+
+    if ((Context->Flags & NS16550_FLAG_TRANSMIT_TRIGGER_2_CHARACTERS) != 0) {
+        BurstSize -= 2;
+    }
+
     Bytes = Data;
-    for (ByteIndex = 0; ByteIndex < Size; ByteIndex += 1) {
+    ByteIndex = 0;
+    while (ByteIndex < Size) {
 
         //
-        // Spin waiting for the buffer to become ready to send. If an error is
-        // detected, bail out and report to the caller.
+        // Spin waiting for the FIFO to drain. If an error is detected, bail
+        // out and report to the caller.
         //
 
         do {
@@ -397,10 +422,18 @@ Return Value:
         } while ((StatusRegister & NS16550_LINE_STATUS_TRANSMIT_EMPTY) == 0);
 
         //
-        // Send the byte and return.
+        // Fill the FIFO back up without polling in between bytes.
         //
 
-        NS16550_WRITE8(Context, Ns16550Data, Bytes[ByteIndex]);
+        BurstEnd = ByteIndex + BurstSize;
+        if (BurstEnd > Size) {
+            BurstEnd = Size;
+        }
+
+        while (ByteIndex < BurstEnd) {
+            NS16550_WRITE8(Context, Ns16550Data, Bytes[ByteIndex]);
+            ByteIndex += 1;
+        }
     }
 
     return EFI_SUCCESS;
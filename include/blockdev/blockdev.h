@@ -33,6 +33,8 @@ typedef struct BlockDevOps {
 	lba_t (*fill_write)(struct BlockDevOps *me, lba_t start, lba_t count,
 			    uint32_t fill_pattern);
 	lba_t (*erase)(struct BlockDevOps *me, lba_t start, lba_t count);
+	/* Commit cached writes to the media; NULL if nothing is ever cached. */
+	int (*flush)(struct BlockDevOps *me);
 	StreamOps *(*new_stream)(struct BlockDevOps *me, lba_t start,
 				 lba_t count);
 } BlockDevOps;
@@ -53,6 +53,8 @@ typedef enum AtaCommand {
 	ATA_CMD_TRUSTED_RECEIVE_DMA = 0x5d,
 	ATA_CMD_TRUSTED_SEND = 0x5e,
 	ATA_CMD_TRUSTED_SEND_DMA = 0x5f,
+	ATA_CMD_READ_FPDMA_QUEUED = 0x60,
+	ATA_CMD_WRITE_FPDMA_QUEUED = 0x61,
 	ATA_CMD_CFA_TRANSLATE_SECTOR = 0x87,
 	ATA_CMD_EXECUTE_DEVICE_DIAGNOSTIC = 0x90,
 	ATA_CMD_DOWNLOAD_MICROCODE = 0x92,
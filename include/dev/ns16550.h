@@ -160,8 +160,8 @@ EfipNs16550Transmit (
 
 Routine Description:
 
-    This routine writes data out the serial port. This routine should busily
-    spin if the previously sent byte has not finished transmitting.
+    This routine writes data out the serial port. This routine busily spins
+    whenever the transmit FIFO is full.
 
 Arguments:
 
@@ -79,6 +79,21 @@ Author:
 #define EFI_SECTION_LAST_LEAF_SECTION_TYPE  0x1B
 #define EFI_SECTION_LAST_SECTION_TYPE       0x1B
 
+//
+// Define dependency expression opcodes.
+//
+
+#define EFI_DEP_BEFORE 0x00
+#define EFI_DEP_AFTER  0x01
+#define EFI_DEP_PUSH   0x02
+#define EFI_DEP_AND    0x03
+#define EFI_DEP_OR     0x04
+#define EFI_DEP_NOT    0x05
+#define EFI_DEP_TRUE   0x06
+#define EFI_DEP_FALSE  0x07
+#define EFI_DEP_END    0x08
+#define EFI_DEP_SOR    0x09
+
 //
 // Define compression type values.
 //
@@ -94,6 +109,27 @@ Author:
 #define EFI_GUIDED_SECTION_PROCESSING_REQUIRED  0x01
 #define EFI_GUIDED_SECTION_AUTH_STATUS_VALID    0x02
 
+//
+// Define the GUIDs of the compressed GUIDed sections the core can extract.
+// LZMA sections hold the standard 13 byte LZMA header followed by the
+// compressed stream. LZ4 sections hold a 32-bit little endian uncompressed
+// size followed by a single LZ4 block.
+//
+
+#define EFI_LZMA_CUSTOM_DECOMPRESS_GUID                     \
+    {                                                       \
+        0xEE4E5898, 0x3914, 0x4259,                         \
+        {0x9D, 0x6E, 0xDC, 0x7B, 0xD7, 0x94, 0x03, 0xCF}    \
+    }
+
+#define EFI_LZ4_CUSTOM_DECOMPRESS_GUID                      \
+    {                                                       \
+        0xE02EA913, 0x8C47, 0x4CF8,                         \
+        {0xBD, 0x87, 0xFB, 0x52, 0xAF, 0xAA, 0x8D, 0x4E}    \
+    }
+
+#define EFI_LZ4_SECTION_HEADER_SIZE 4
+
 //
 // Define authentication status bits.
 //
@@ -142,6 +178,12 @@ typedef struct _EFI_COMPRESSION_SECTION {
     UINT8 CompressionType;
 } PACKED EFI_COMPRESSION_SECTION, *PEFI_COMPRESSION_SECTION;
 
+typedef struct _EFI_COMPRESSION_SECTION2 {
+    EFI_COMMON_SECTION_HEADER2 CommonHeader;
+    UINT32 UncompressedLength;
+    UINT8 CompressionType;
+} PACKED EFI_COMPRESSION_SECTION2, *PEFI_COMPRESSION_SECTION2;
+
 typedef struct _EFI_GUID_DEFINED_SECTION {
     EFI_COMMON_SECTION_HEADER CommonHeader;
     EFI_GUID SectionDefinitionGuid;
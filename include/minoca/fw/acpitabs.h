@@ -40,10 +40,22 @@ Author:
 #define SSDT_SIGNATURE 0x54445353 // 'SSDT'
 #define DBG2_SIGNATURE 0x32474244 // 'DBG2'
 #define GTDT_SIGNATURE 0x54445447 // 'GTDT'
+#define FPDT_SIGNATURE 0x54445046 // 'FPDT'
+#define FBPT_SIGNATURE 0x54504246 // 'FBPT'
 
 #define ACPI_20_RSDP_REVISION 0x02
 #define ACPI_30_RSDT_REVISION 0x01
 #define ACPI_30_XSDT_REVISION 0x01
+#define FPDT_REVISION 0x01
+
+//
+// Define the firmware performance data table record types and revisions.
+//
+
+#define FPDT_RECORD_TYPE_BASIC_BOOT 0x0002
+#define FPDT_RECORD_TYPE_BASIC_BOOT_POINTER 0x0000
+#define FPDT_RECORD_REVISION_BASIC_BOOT 0x02
+#define FPDT_RECORD_REVISION_BASIC_BOOT_POINTER 0x01
 
 //
 // Normally the entire contents of the table is checksummed, however in the
@@ -1663,6 +1675,117 @@ typedef struct _GTDT {
     ULONG NonSecurePl2Flags;
 } PACKED GTDT, *PGTDT;
 
+/*++
+
+Structure Description:
+
+    This structure defines the header common to every firmware performance
+    record.
+
+Members:
+
+    Type - Stores the record type. See FPDT_RECORD_TYPE_* definitions.
+
+    Length - Stores the length of the record in bytes, including this header.
+
+    Revision - Stores the revision of the record format.
+
+--*/
+
+typedef struct _FPDT_RECORD_HEADER {
+    USHORT Type;
+    UCHAR Length;
+    UCHAR Revision;
+} PACKED FPDT_RECORD_HEADER, *PFPDT_RECORD_HEADER;
+
+/*++
+
+Structure Description:
+
+    This structure defines the firmware performance data table, which points
+    at the firmware basic boot performance table.
+
+Members:
+
+    Header - Stores the table header, including the signature, 'FPDT'.
+
+    BootPointer - Stores the basic boot performance table pointer record.
+
+    Reserved - Stores a reserved value that must be zero.
+
+    BootTable - Stores the physical address of the basic boot performance
+        table.
+
+--*/
+
+typedef struct _FPDT {
+    DESCRIPTION_HEADER Header;
+    FPDT_RECORD_HEADER BootPointer;
+    ULONG Reserved;
+    ULONGLONG BootTable;
+} PACKED FPDT, *PFPDT;
+
+/*++
+
+Structure Description:
+
+    This structure defines the header of the firmware basic boot performance
+    table. It is followed by a basic boot performance record, and then by any
+    number of firmware-specific records.
+
+Members:
+
+    Signature - Stores the signature, 'FBPT'.
+
+    Length - Stores the length of the entire table in bytes, including this
+        header.
+
+--*/
+
+typedef struct _FBPT {
+    ULONG Signature;
+    ULONG Length;
+} PACKED FBPT, *PFBPT;
+
+/*++
+
+Structure Description:
+
+    This structure defines the basic boot performance record. All times are
+    in nanoseconds since reset.
+
+Members:
+
+    Header - Stores the record header.
+
+    Reserved - Stores a reserved value that must be zero.
+
+    ResetEnd - Stores the time at which the firmware image started.
+
+    OsLoaderLoadImageStart - Stores the time at which the OS loader image
+        started loading.
+
+    OsLoaderStartImageStart - Stores the time at which the OS loader image was
+        started.
+
+    ExitBootServicesEntry - Stores the time at which the OS loader called
+        ExitBootServices.
+
+    ExitBootServicesExit - Stores the time at which ExitBootServices returned
+        to the OS loader.
+
+--*/
+
+typedef struct _FPDT_BASIC_BOOT_RECORD {
+    FPDT_RECORD_HEADER Header;
+    ULONG Reserved;
+    ULONGLONG ResetEnd;
+    ULONGLONG OsLoaderLoadImageStart;
+    ULONGLONG OsLoaderStartImageStart;
+    ULONGLONG ExitBootServicesEntry;
+    ULONGLONG ExitBootServicesExit;
+} PACKED FPDT_BASIC_BOOT_RECORD, *PFPDT_BASIC_BOOT_RECORD;
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -288,6 +288,14 @@ Members:
 
     Rows - Stores the number of rows in the frame buffer.
 
+    GlyphCache - Stores an optional pointer to caller supplied memory where
+        glyphs are kept already expanded into the native pixel format.
+
+    GlyphCacheEntryCount - Stores the number of glyphs the cache can hold.
+
+    GlyphCacheEntrySize - Stores the size of a single glyph cache entry in
+        bytes.
+
 --*/
 
 typedef struct _BASE_VIDEO_CONTEXT {
@@ -305,6 +313,9 @@ typedef struct _BASE_VIDEO_CONTEXT {
     PBASE_VIDEO_FONT Font;
     ULONG Columns;
     ULONG Rows;
+    PVOID GlyphCache;
+    ULONG GlyphCacheEntryCount;
+    ULONG GlyphCacheEntrySize;
 } BASE_VIDEO_CONTEXT, *PBASE_VIDEO_CONTEXT;
 
 //
@@ -611,3 +622,39 @@ Return Value:
 
 --*/
 
+KSTATUS
+VidSetGlyphCache (
+    PBASE_VIDEO_CONTEXT Context,
+    PVOID Buffer,
+    ULONG BufferSize
+    );
+
+/*++
+
+Routine Description:
+
+    This routine hands the base video library a buffer to cache expanded
+    glyphs in. Once a glyph has been drawn in a given set of colors, drawing
+    it again is just a copy of each of its rows. It is the caller's
+    responsibility to synchronize with printing.
+
+Arguments:
+
+    Context - Supplies a pointer to the initialized base video context.
+
+    Buffer - Supplies a pointer to the memory to use for the cache, or NULL to
+        stop caching glyphs. The memory must stay valid until the cache is
+        removed or the context is reinitialized.
+
+    BufferSize - Supplies the size of the buffer in bytes.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_NOT_SUPPORTED if the video mode does not draw glyphs.
+
+    STATUS_BUFFER_TOO_SMALL if the buffer cannot hold even a single glyph.
+
+--*/
+
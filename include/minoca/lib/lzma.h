@@ -40,6 +40,20 @@ Author:
 
 #define LZMA_MINIMUM_DICT_SIZE (1 << 12)
 
+//
+// Define the size of the header that precedes a standalone LZMA stream: the
+// five property bytes followed by the 64-bit uncompressed size.
+//
+
+#define LZMA_HEADER_SIZE 13
+
+//
+// This macro returns the worst case size of an LZ4 block compressed from the
+// given number of bytes.
+//
+
+#define LZ4_COMPRESS_BOUND(_Size) ((_Size) + ((_Size) / 255) + 16)
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -481,3 +495,81 @@ Return Value:
 
 --*/
 
+LZ_STATUS
+LzLz4Encode (
+    PUCHAR Destination,
+    PUINTN DestinationSize,
+    PCUCHAR Source,
+    UINTN SourceSize,
+    PLZ_CONTEXT Context
+    );
+
+/*++
+
+Routine Description:
+
+    This routine compresses the given data into a single LZ4 block.
+
+Arguments:
+
+    Destination - Supplies a pointer to the buffer where the compressed block
+        will be returned.
+
+    DestinationSize - Supplies a pointer that on input contains the size of the
+        destination buffer. On output, contains the size of the compressed
+        block. A buffer of LZ4_COMPRESS_BOUND(SourceSize) bytes is always big
+        enough.
+
+    Source - Supplies a pointer to the data to compress.
+
+    SourceSize - Supplies the number of bytes to compress.
+
+    Context - Supplies a pointer to the general LZ context, used for
+        allocation.
+
+Return Value:
+
+    LZ status.
+
+--*/
+
+LZ_STATUS
+LzLz4Decode (
+    PUCHAR Destination,
+    PUINTN DestinationSize,
+    PCUCHAR Source,
+    UINTN SourceSize
+    );
+
+/*++
+
+Routine Description:
+
+    This routine decompresses a single LZ4 block. Every read and write is
+    bounds checked, so corrupt input cannot overrun either buffer.
+
+Arguments:
+
+    Destination - Supplies a pointer where the uncompressed data will be
+        written.
+
+    DestinationSize - Supplies a pointer that on input contains the size of the
+        destination buffer. On output, contains the number of bytes written.
+
+    Source - Supplies a pointer to the compressed block.
+
+    SourceSize - Supplies the size of the compressed block in bytes.
+
+Return Value:
+
+    LzSuccess if the block decoded completely.
+
+    LzErrorInputEof if the block is truncated.
+
+    LzErrorOutputEof if the data does not fit in the destination buffer.
+
+    LzErrorCorruptData if a match refers to data before the start of the
+    output.
+
+--*/
+
@@ -77,6 +77,18 @@ Author:
 // ------------------------------------------------------ Data Type Definitions
 //
 
+typedef enum _EFI_PERF_RECORD_TYPE {
+    EfiPerfRecordInvalid,
+    EfiPerfRecordPhase,
+    EfiPerfRecordLoadImage,
+    EfiPerfRecordStartImage,
+    EfiPerfRecordDriverStart,
+    EfiPerfRecordBlockRead,
+    EfiPerfRecordBlockWrite,
+    EfiPerfRecordExitBootServices,
+    EfiPerfRecordTypeCount
+} EFI_PERF_RECORD_TYPE, *PEFI_PERF_RECORD_TYPE;
+
 typedef
 VOID
 (*EFI_PLATFORM_BEGIN_INTERRUPT) (
@@ -1078,6 +1090,81 @@ Return Value:
 
 --*/
 
+UINTN
+EfiCorePerfStart (
+    EFI_PERF_RECORD_TYPE Type,
+    CONST CHAR8 *Name,
+    UINT64 Data
+    );
+
+/*++
+
+Routine Description:
+
+    This routine opens a performance trace record, stamping it with the
+    current time counter value. This routine is safe to call at any TPL.
+
+Arguments:
+
+    Type - Supplies the kind of event being traced.
+
+    Name - Supplies an optional name for the event. Only the first few
+        characters are kept.
+
+    Data - Supplies a value whose meaning depends on the type, such as a
+        handle or a logical block address.
+
+Return Value:
+
+    Returns a token to pass to the end routine.
+
+--*/
+
+VOID
+EfiCorePerfEnd (
+    UINTN Token
+    );
+
+/*++
+
+Routine Description:
+
+    This routine closes a performance trace record, stamping it with the
+    current time counter value. If the record has since been overwritten by a
+    newer one, this routine does nothing.
+
+Arguments:
+
+    Token - Supplies the token returned when the record was opened.
+
+Return Value:
+
+    None.
+
+--*/
+
+VOID
+EfiCorePerfDump (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine prints the boot phase timings and the contents of the
+    performance trace ring to the console.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
 EFI_STATUS
 EfiConvertCounterToEfiTime (
     INT64 Counter,
@@ -75,6 +75,13 @@ Environment:
 // ---------------------------------------------------------------- Definitions
 //
 
+//
+// Define the multiplier used to spread attributes across the glyph cache so
+// that the same character in different colors lands in different entries.
+//
+
+#define GLYPH_CACHE_ATTRIBUTE_MULTIPLIER 97
+
 //
 // ----------------------------------------------- Internal Function Prototypes
 //
@@ -94,6 +101,29 @@ VidpPrintCharacter (
     PBASE_VIDEO_CHARACTER Character
     );
 
+VOID
+VidpGetCharacterColors (
+    PBASE_VIDEO_CONTEXT Context,
+    PBASE_VIDEO_CHARACTER Character,
+    PULONG ColorOn,
+    PULONG ColorOff
+    );
+
+VOID
+VidpRenderGlyph (
+    PBASE_VIDEO_CONTEXT Context,
+    PBASE_VIDEO_CHARACTER Character,
+    ULONG ColorOn,
+    ULONG ColorOff,
+    PVOID LineStart,
+    ULONG LineSize
+    );
+
+VOID
+VidpFlushGlyphCache (
+    PBASE_VIDEO_CONTEXT Context
+    );
+
 VOID
 VidpConvertIntegerToString (
     LONG Integer,
@@ -119,6 +149,28 @@ typedef struct _COLOR_TRANSLATION {
     ULONG BlueMask;
 } COLOR_TRANSLATION, *PCOLOR_TRANSLATION;
 
+/*++
+
+Structure Description:
+
+    This structure stores the header of a glyph cache entry. The glyph's
+    pixels, already expanded into the native frame buffer format, follow
+    immediately after this header, one cell row after another.
+
+Members:
+
+    Key - Stores the character and attributes the entry was expanded for.
+
+    Valid - Stores a boolean indicating whether or not the entry holds a
+        glyph.
+
+--*/
+
+typedef struct _GLYPH_CACHE_ENTRY {
+    ULONG Key;
+    BOOL Valid;
+} GLYPH_CACHE_ENTRY, *PGLYPH_CACHE_ENTRY;
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -245,6 +297,9 @@ Return Value:
                        &Context->PhysicalPalette);
 
     Context->Font = VidDefaultFont;
+    Context->GlyphCache = NULL;
+    Context->GlyphCacheEntryCount = 0;
+    Context->GlyphCacheEntrySize = 0;
 
     ASSERT(Context->Font != NULL);
 
@@ -725,6 +780,11 @@ Return Value:
                        &(Context->Palette),
                        &(Context->PhysicalPalette));
 
+    //
+    // Cached glyphs have the old colors baked into them.
+    //
+
+    VidpFlushGlyphCache(Context);
     return;
 }
 
@@ -804,6 +864,78 @@ Return Value:
     return;
 }
 
+KSTATUS
+VidSetGlyphCache (
+    PBASE_VIDEO_CONTEXT Context,
+    PVOID Buffer,
+    ULONG BufferSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine hands the base video library a buffer to cache expanded
+    glyphs in. Once a glyph has been drawn in a given set of colors, drawing
+    it again is just a copy of each of its rows. It is the caller's
+    responsibility to synchronize with printing.
+
+Arguments:
+
+    Context - Supplies a pointer to the initialized base video context.
+
+    Buffer - Supplies a pointer to the memory to use for the cache, or NULL to
+        stop caching glyphs. The memory must stay valid until the cache is
+        removed or the context is reinitialized.
+
+    BufferSize - Supplies the size of the buffer in bytes.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_NOT_SUPPORTED if the video mode does not draw glyphs.
+
+    STATUS_BUFFER_TOO_SMALL if the buffer cannot hold even a single glyph.
+
+--*/
+
+{
+
+    ULONG EntryCount;
+    ULONG EntrySize;
+    PBASE_VIDEO_FONT Font;
+
+    Context->GlyphCache = NULL;
+    Context->GlyphCacheEntryCount = 0;
+    Context->GlyphCacheEntrySize = 0;
+    if (Buffer == NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    if (Context->Mode != BaseVideoModeFrameBuffer) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    Font = Context->Font;
+    EntrySize = Font->CellWidth * Font->CellHeight *
+                (Context->BitsPerPixel / BITS_PER_BYTE);
+
+    EntrySize = ALIGN_RANGE_UP(sizeof(GLYPH_CACHE_ENTRY) + EntrySize,
+                               sizeof(ULONG));
+
+    EntryCount = BufferSize / EntrySize;
+    if (EntryCount == 0) {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    Context->GlyphCache = Buffer;
+    Context->GlyphCacheEntryCount = EntryCount;
+    Context->GlyphCacheEntrySize = EntrySize;
+    VidpFlushGlyphCache(Context);
+    return STATUS_SUCCESS;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -984,87 +1116,240 @@ Return Value:
 
 {
 
-    USHORT Attributes;
-    ANSI_COLOR BackgroundAnsiColor;
-    ULONG BitIndex;
-    ULONG ByteIndex;
+    PGLYPH_CACHE_ENTRY CacheEntry;
+    ULONG CacheIndex;
     ULONG ColorOff;
     ULONG ColorOn;
-    ULONG ColumnIndex;
-    PUCHAR Data;
     PUSHORT Destination16;
-    PULONG Destination32;
-    PBYTE Destination8;
     PBASE_VIDEO_FONT Font;
-    ANSI_COLOR ForegroundAnsiColor;
-    ULONG HorizontalIndex;
     ULONG LineSize;
     PVOID LineStart;
-    UCHAR RotateBuffer[8];
     ULONG RowIndex;
-    BYTE Source;
-    ULONG SourceIndex;
-    ULONG SwapColor;
-    ULONG VerticalIndex;
+    ULONG RowSize;
+    PUCHAR Source;
     ULONG YPixel;
 
     //
-    // Get the colors to use.
+    // Handle text mode differently.
+    //
+
+    if (Context->Mode == BaseVideoModeBiosText) {
+        VidpGetCharacterColors(Context, Character, &ColorOn, &ColorOff);
+        Destination16 = Context->FrameBuffer;
+        Destination16 += (YCoordinate * Context->Width) + XCoordinate;
+        *Destination16 = BIOS_TEXT_ATTRIBUTES(ColorOn, ColorOff) |
+                         (UCHAR)(Character->Data.Character);
+
+        return;
+    }
+
+    //
+    // Compute the starting address on the frame buffer.
+    //
+
+    Font = Context->Font;
+    YPixel = (YCoordinate * Font->CellHeight) * Context->PixelsPerScanLine;
+    LineStart = Context->FrameBuffer +
+                ((YPixel + (XCoordinate * Font->CellWidth)) *
+                 (Context->BitsPerPixel / BITS_PER_BYTE));
+
+    LineSize = Context->PixelsPerScanLine *
+               (Context->BitsPerPixel / BITS_PER_BYTE);
+
+    if (Context->GlyphCache == NULL) {
+        VidpGetCharacterColors(Context, Character, &ColorOn, &ColorOff);
+        VidpRenderGlyph(Context,
+                        Character,
+                        ColorOn,
+                        ColorOff,
+                        LineStart,
+                        LineSize);
+
+        return;
+    }
+
+    //
+    // For a given palette the attributes fully determine the colors, and the
+    // cache is flushed whenever the palette changes, so the character and
+    // attributes together are enough to identify an expanded glyph. On a miss,
+    // expand the glyph into its cache entry rather than onto the screen.
     //
 
-    ColorOn = Context->PhysicalPalette.AnsiColor[AnsiColorDefault];
-    ColorOff = Context->PhysicalPalette.DefaultBackground;
+    CacheIndex = (Character->Data.Attributes *
+                  GLYPH_CACHE_ATTRIBUTE_MULTIPLIER) +
+                 Character->Data.Character;
+
+    CacheIndex %= Context->GlyphCacheEntryCount;
+    CacheEntry = (PGLYPH_CACHE_ENTRY)((PUCHAR)Context->GlyphCache +
+                                      (CacheIndex *
+                                       Context->GlyphCacheEntrySize));
+
+    RowSize = Font->CellWidth * (Context->BitsPerPixel / BITS_PER_BYTE);
+    Source = (PUCHAR)(CacheEntry + 1);
+    if ((CacheEntry->Valid == FALSE) ||
+        (CacheEntry->Key != Character->AsUint32)) {
+
+        VidpGetCharacterColors(Context, Character, &ColorOn, &ColorOff);
+        VidpRenderGlyph(Context, Character, ColorOn, ColorOff, Source, RowSize);
+        CacheEntry->Key = Character->AsUint32;
+        CacheEntry->Valid = TRUE;
+    }
+
+    for (RowIndex = 0; RowIndex < Font->CellHeight; RowIndex += 1) {
+        RtlCopyMemory(LineStart, Source, RowSize);
+        LineStart += LineSize;
+        Source += RowSize;
+    }
+
+    return;
+}
+
+VOID
+VidpGetCharacterColors (
+    PBASE_VIDEO_CONTEXT Context,
+    PBASE_VIDEO_CHARACTER Character,
+    PULONG ColorOn,
+    PULONG ColorOff
+    )
+
+/*++
+
+Routine Description:
+
+    This routine resolves the attributes of a character into the physical
+    colors to draw it with.
+
+Arguments:
+
+    Context - Supplies a pointer to the initialized base video context.
+
+    Character - Supplies a pointer to the character whose colors should be
+        computed.
+
+    ColorOn - Supplies a pointer where the foreground color will be returned.
+
+    ColorOff - Supplies a pointer where the background color will be
+        returned.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    USHORT Attributes;
+    ULONG Background;
+    ANSI_COLOR BackgroundAnsiColor;
+    ULONG Foreground;
+    ANSI_COLOR ForegroundAnsiColor;
+    ULONG SwapColor;
+
+    Foreground = Context->PhysicalPalette.AnsiColor[AnsiColorDefault];
+    Background = Context->PhysicalPalette.DefaultBackground;
     if (Character->Data.Attributes != 0) {
         Attributes = Character->Data.Attributes;
         if ((Attributes & BASE_VIDEO_CURSOR) != 0) {
-            ColorOn = Context->PhysicalPalette.CursorText;
-            ColorOff = Context->PhysicalPalette.CursorBackground;
+            Foreground = Context->PhysicalPalette.CursorText;
+            Background = Context->PhysicalPalette.CursorBackground;
 
         } else {
             BackgroundAnsiColor = (Attributes >> BASE_VIDEO_BACKGROUND_SHIFT) &
                                   BASE_VIDEO_COLOR_MASK;
 
             ForegroundAnsiColor = Attributes & BASE_VIDEO_COLOR_MASK;
-            ColorOn = Context->PhysicalPalette.AnsiColor[ForegroundAnsiColor];
+            Foreground =
+                      Context->PhysicalPalette.AnsiColor[ForegroundAnsiColor];
+
             if ((Attributes & BASE_VIDEO_FOREGROUND_BOLD) != 0) {
-                ColorOn =
+                Foreground =
                     Context->PhysicalPalette.BoldAnsiColor[ForegroundAnsiColor];
             }
 
             if (BackgroundAnsiColor != AnsiColorDefault) {
-                ColorOff =
+                Background =
                        Context->PhysicalPalette.AnsiColor[BackgroundAnsiColor];
             }
 
             if ((Attributes & BASE_VIDEO_BACKGROUND_BOLD) != 0) {
-                ColorOff =
+                Background =
                     Context->PhysicalPalette.BoldAnsiColor[BackgroundAnsiColor];
 
                 if (BackgroundAnsiColor == AnsiColorDefault) {
-                    ColorOff = Context->PhysicalPalette.DefaultBoldBackground;
+                    Background = Context->PhysicalPalette.DefaultBoldBackground;
                 }
             }
 
             if ((Attributes & BASE_VIDEO_NEGATIVE) != 0) {
-                SwapColor = ColorOn;
-                ColorOn = ColorOff;
-                ColorOff = SwapColor;
+                SwapColor = Foreground;
+                Foreground = Background;
+                Background = SwapColor;
             }
         }
     }
 
-    //
-    // Handle text mode differently.
-    //
+    *ColorOn = Foreground;
+    *ColorOff = Background;
+    return;
+}
 
-    if (Context->Mode == BaseVideoModeBiosText) {
-        Destination16 = Context->FrameBuffer;
-        Destination16 += (YCoordinate * Context->Width) + XCoordinate;
-        *Destination16 = BIOS_TEXT_ATTRIBUTES(ColorOn, ColorOff) |
-                         (UCHAR)(Character->Data.Character);
+VOID
+VidpRenderGlyph (
+    PBASE_VIDEO_CONTEXT Context,
+    PBASE_VIDEO_CHARACTER Character,
+    ULONG ColorOn,
+    ULONG ColorOff,
+    PVOID LineStart,
+    ULONG LineSize
+    )
 
-        return;
-    }
+/*++
+
+Routine Description:
+
+    This routine expands a character's glyph into pixels in the native frame
+    buffer format.
+
+Arguments:
+
+    Context - Supplies a pointer to the initialized base video context.
+
+    Character - Supplies a pointer to the character to render.
+
+    ColorOn - Supplies the physical color to use for set glyph bits.
+
+    ColorOff - Supplies the physical color to use for clear glyph bits and
+        the rest of the cell.
+
+    LineStart - Supplies a pointer to the first pixel of the top row of the
+        cell.
+
+    LineSize - Supplies the distance in bytes between the starts of two
+        consecutive rows.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG BitIndex;
+    ULONG ByteIndex;
+    ULONG ColumnIndex;
+    PUCHAR Data;
+    PUSHORT Destination16;
+    PULONG Destination32;
+    PBYTE Destination8;
+    PBASE_VIDEO_FONT Font;
+    ULONG HorizontalIndex;
+    UCHAR RotateBuffer[8];
+    ULONG RowIndex;
+    BYTE Source;
+    ULONG SourceIndex;
+    ULONG VerticalIndex;
 
     //
     // Get the glyph data for that character.
@@ -1130,18 +1415,6 @@ Return Value:
         Data = (PUCHAR)&(Font->Data[SourceIndex]);
     }
 
-    //
-    // Compute the starting address on the frame buffer.
-    //
-
-    YPixel = (YCoordinate * Font->CellHeight) * Context->PixelsPerScanLine;
-    LineStart = Context->FrameBuffer +
-                ((YPixel + (XCoordinate * Font->CellWidth)) *
-                 (Context->BitsPerPixel / BITS_PER_BYTE));
-
-    LineSize = Context->PixelsPerScanLine *
-               (Context->BitsPerPixel / BITS_PER_BYTE);
-
     //
     // Separate write loops for different pixel widths does mean more code,
     // but it skips conditionals in the inner loops, which are very hot.
@@ -1394,6 +1667,46 @@ Return Value:
     return;
 }
 
+VOID
+VidpFlushGlyphCache (
+    PBASE_VIDEO_CONTEXT Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine invalidates every entry in the glyph cache, if there is one.
+
+Arguments:
+
+    Context - Supplies a pointer to the initialized base video context.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PGLYPH_CACHE_ENTRY CacheEntry;
+    ULONG CacheIndex;
+
+    for (CacheIndex = 0;
+         CacheIndex < Context->GlyphCacheEntryCount;
+         CacheIndex += 1) {
+
+        CacheEntry = (PGLYPH_CACHE_ENTRY)((PUCHAR)Context->GlyphCache +
+                                          (CacheIndex *
+                                           Context->GlyphCacheEntrySize));
+
+        CacheEntry->Valid = FALSE;
+    }
+
+    return;
+}
+
 VOID
 VidpConvertIntegerToString (
     LONG Integer,
@@ -0,0 +1,52 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    Base Video Test
+
+Abstract:
+
+    This program tests the base video library in an application.
+
+Environment:
+
+    Test
+
+--*/
+
+from menv import application;
+
+function build() {
+    var buildApp;
+    var buildLibs;
+    var entries;
+    var sources;
+
+    sources = [
+        "vidtest.c"
+    ];
+
+    buildLibs = [
+        "lib/basevid:build_basevid",
+        "lib/rtl/base:build_basertl"
+    ];
+
+    buildApp = {
+        "label": "build_vidtest",
+        "output": "vidtest",
+        "inputs": sources + buildLibs,
+        "build": true,
+        "prefix": "build"
+    };
+
+    entries = application(buildApp);
+    return entries;
+}
+
@@ -0,0 +1,842 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    vidtest.c
+
+Abstract:
+
+    This module implements the base video library test program. It draws the
+    same text with and without a glyph cache into frame buffers in memory and
+    makes sure the pixels match, and measures how fast text is drawn at each
+    color depth.
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <minoca/kernel/kernel.h>
+#include <minoca/kernel/sysres.h>
+#include <minoca/lib/basevid.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+#define USAGE_STRING \
+    "Vidtest will test the base video library.\n\n" \
+    "Usage: vidtest [-v] [-b]\n\n" \
+    "    -v  Verbose mode\n" \
+    "    -b  Run the rendering benchmarks after the tests\n\n" \
+
+//
+// Define the size of the frame buffers drawn into.
+//
+
+#define VID_TEST_WIDTH 1024
+#define VID_TEST_HEIGHT 768
+
+//
+// Define the number of random characters drawn in each pass of the test.
+//
+
+#define VID_TEST_CHARACTERS 20000
+
+//
+// Define the glyph cache sizes to test. The small one only holds a handful
+// of glyphs, so entries are constantly replaced. The large one matches what
+// the graphics console uses.
+//
+
+#define VID_TEST_SMALL_CACHE_SIZE 4096
+#define VID_TEST_CACHE_SIZE 0x20000
+
+//
+// Define the number of full screens of text each benchmark run draws.
+//
+
+#define VID_BENCHMARK_SCREENS 1024
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+#define VPRINT(_Format, _Args...)       \
+    {                                   \
+                                        \
+        if (VidTestVerbose != FALSE) {  \
+            printf(_Format, ## _Args);  \
+        }                               \
+    }
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+typedef enum _VID_TEST_CACHE {
+    VidTestCacheNone,
+    VidTestCacheSmall,
+    VidTestCacheFull,
+    VidTestCacheCount
+} VID_TEST_CACHE, *PVID_TEST_CACHE;
+
+/*++
+
+Structure Description:
+
+    This structure describes a frame buffer pixel format to test.
+
+Members:
+
+    BitsPerPixel - Stores the number of bits in a pixel.
+
+    RedMask - Stores the bits of a pixel that hold the red channel.
+
+    GreenMask - Stores the bits of a pixel that hold the green channel.
+
+    BlueMask - Stores the bits of a pixel that hold the blue channel.
+
+--*/
+
+typedef struct _VID_TEST_FORMAT {
+    ULONG BitsPerPixel;
+    ULONG RedMask;
+    ULONG GreenMask;
+    ULONG BlueMask;
+} VID_TEST_FORMAT, *PVID_TEST_FORMAT;
+
+/*++
+
+Structure Description:
+
+    This structure stores a video context along with the memory it draws
+    into.
+
+Members:
+
+    Context - Stores the base video context.
+
+    FrameBuffer - Stores a pointer to the frame buffer memory.
+
+    FrameBufferSize - Stores the size of the frame buffer in bytes.
+
+    GlyphCache - Stores a pointer to the glyph cache memory, if any.
+
+--*/
+
+typedef struct _VID_TEST_SCREEN {
+    BASE_VIDEO_CONTEXT Context;
+    PVOID FrameBuffer;
+    UINTN FrameBufferSize;
+    PVOID GlyphCache;
+} VID_TEST_SCREEN, *PVID_TEST_SCREEN;
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+ULONG
+TestFormat (
+    PVID_TEST_FORMAT Format,
+    PBASE_VIDEO_FONT Font,
+    PCSTR FontName
+    );
+
+ULONG
+TestCacheBufferSizes (
+    PVID_TEST_FORMAT Format
+    );
+
+ULONG
+CompareScreens (
+    PVID_TEST_SCREEN Screens,
+    PVID_TEST_FORMAT Format,
+    PCSTR FontName,
+    PCSTR Description
+    );
+
+VOID
+RunRenderBenchmark (
+    VOID
+    );
+
+KSTATUS
+CreateScreen (
+    PVID_TEST_SCREEN Screen,
+    PVID_TEST_FORMAT Format,
+    PBASE_VIDEO_FONT Font,
+    ULONG CacheSize
+    );
+
+VOID
+DestroyScreen (
+    PVID_TEST_SCREEN Screen
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+BOOL VidTestVerbose = FALSE;
+
+VID_TEST_FORMAT VidTestFormats[] = {
+    {16, 0xF800, 0x07E0, 0x001F},
+    {24, 0xFF0000, 0x00FF00, 0x0000FF},
+    {32, 0xFF0000, 0x00FF00, 0x0000FF}
+};
+
+ULONG VidTestCacheSizes[VidTestCacheCount] = {
+    0,
+    VID_TEST_SMALL_CACHE_SIZE,
+    VID_TEST_CACHE_SIZE
+};
+
+PCSTR VidTestCacheNames[VidTestCacheCount] = {
+    "uncached",
+    "small cache",
+    "full cache"
+};
+
+//
+// Define a palette different enough from the default that stale glyphs left
+// in a cache would show up.
+//
+
+BASE_VIDEO_PARTIAL_PALETTE VidTestPalette = {
+    BASE_VIDEO_COLOR_RGB(250, 200, 10),
+    BASE_VIDEO_COLOR_RGB(255, 255, 128),
+    BASE_VIDEO_COLOR_RGB(10, 20, 90),
+    BASE_VIDEO_COLOR_RGB(40, 60, 140),
+    BASE_VIDEO_COLOR_RGB(0, 0, 0),
+    BASE_VIDEO_COLOR_RGB(0, 255, 0)
+};
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+INT
+main (
+    INT ArgumentCount,
+    CHAR **Arguments
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is the main entry point for the program.
+
+Arguments:
+
+    ArgumentCount - Supplies the number of command line arguments the program
+        was invoked with.
+
+    Arguments - Supplies a tokenized array of command line arguments.
+
+Return Value:
+
+    Returns an integer exit code. 0 for success, nonzero otherwise.
+
+--*/
+
+{
+
+    PSTR Argument;
+    BOOL Benchmark;
+    ULONG Failures;
+    ULONG FormatIndex;
+
+    Benchmark = FALSE;
+    Failures = 0;
+    srand(time(NULL));
+    while ((ArgumentCount > 1) && (Arguments[1][0] == '-')) {
+        Argument = &(Arguments[1][1]);
+        if (strcmp(Argument, "v") == 0) {
+            VidTestVerbose = TRUE;
+
+        } else if (strcmp(Argument, "b") == 0) {
+            Benchmark = TRUE;
+
+        } else {
+            printf("%s: Invalid option\n\n%s", Argument, USAGE_STRING);
+            return 1;
+        }
+
+        ArgumentCount -= 1;
+        Arguments += 1;
+    }
+
+    //
+    // Cover the default font, a font whose cells are wider than its glyphs,
+    // and a rotated font.
+    //
+
+    for (FormatIndex = 0;
+         FormatIndex < sizeof(VidTestFormats) / sizeof(VidTestFormats[0]);
+         FormatIndex += 1) {
+
+        Failures += TestFormat(&(VidTestFormats[FormatIndex]),
+                               VidDefaultFont,
+                               "default");
+
+        Failures += TestFormat(&(VidTestFormats[FormatIndex]),
+                               &VidFontVga9x16,
+                               "9x16");
+
+        Failures += TestFormat(&(VidTestFormats[FormatIndex]),
+                               &VidFont6x8,
+                               "6x8");
+
+        Failures += TestCacheBufferSizes(&(VidTestFormats[FormatIndex]));
+    }
+
+    if (Failures != 0) {
+        printf("*** %d failure(s) in base video test. ***\n", Failures);
+        return Failures;
+    }
+
+    printf("All base video tests passed.\n");
+    if (Benchmark != FALSE) {
+        RunRenderBenchmark();
+    }
+
+    return 0;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+ULONG
+TestFormat (
+    PVID_TEST_FORMAT Format,
+    PBASE_VIDEO_FONT Font,
+    PCSTR FontName
+    )
+
+/*++
+
+Routine Description:
+
+    This routine draws the same random characters without a cache, with a
+    cache too small to hold them all, and with a full sized cache, and makes
+    sure all three screens come out the same. It then changes the palette
+    and does it again, which catches glyphs cached in the old colors.
+
+Arguments:
+
+    Format - Supplies a pointer to the pixel format to test.
+
+    Font - Supplies a pointer to the font to draw with.
+
+    FontName - Supplies the name of the font for failure messages.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    ULONG Attributes;
+    VID_TEST_CACHE Cache;
+    PBASE_VIDEO_CHARACTER Characters;
+    ULONG Failures;
+    ULONG Index;
+    ULONG Pass;
+    VID_TEST_SCREEN Screens[VidTestCacheCount];
+    KSTATUS Status;
+
+    Failures = 0;
+    memset(Screens, 0, sizeof(Screens));
+    Characters = malloc(VID_TEST_CHARACTERS * sizeof(BASE_VIDEO_CHARACTER));
+    if (Characters == NULL) {
+        printf("Error: Failed to allocate characters.\n");
+        Failures += 1;
+        goto TestFormatEnd;
+    }
+
+    for (Cache = 0; Cache < VidTestCacheCount; Cache += 1) {
+        Status = CreateScreen(&(Screens[Cache]),
+                              Format,
+                              Font,
+                              VidTestCacheSizes[Cache]);
+
+        if (!KSUCCESS(Status)) {
+            printf("Error: Failed to create %d bpp %s screen: %d.\n",
+                   Format->BitsPerPixel,
+                   VidTestCacheNames[Cache],
+                   Status);
+
+            Failures += 1;
+            goto TestFormatEnd;
+        }
+    }
+
+    for (Pass = 0; Pass < 2; Pass += 1) {
+
+        //
+        // Pick characters from a little beyond both ends of the font, with
+        // every kind of attribute. Keep the number of distinct characters
+        // down so that the full cache gets plenty of hits.
+        //
+
+        for (Index = 0; Index < VID_TEST_CHARACTERS; Index += 1) {
+            Characters[Index].Data.Character = Font->FirstAsciiCode - 2 +
+                                               (rand() %
+                                                (Font->GlyphCount + 4));
+
+            Attributes = BASE_VIDEO_ATTRIBUTES(rand() % AnsiColorCount,
+                                               rand() % AnsiColorCount);
+
+            if ((rand() % 4) == 0) {
+                Attributes |= BASE_VIDEO_FOREGROUND_BOLD;
+            }
+
+            if ((rand() % 4) == 0) {
+                Attributes |= BASE_VIDEO_BACKGROUND_BOLD;
+            }
+
+            if ((rand() % 8) == 0) {
+                Attributes |= BASE_VIDEO_NEGATIVE;
+            }
+
+            if ((rand() % 16) == 0) {
+                Attributes |= BASE_VIDEO_CURSOR;
+            }
+
+            if ((rand() % 2) == 0) {
+                Attributes = 0;
+            }
+
+            Characters[Index].Data.Attributes = Attributes;
+        }
+
+        for (Cache = 0; Cache < VidTestCacheCount; Cache += 1) {
+            if (Pass != 0) {
+                VidSetPartialPalette(&(Screens[Cache].Context),
+                                     &VidTestPalette);
+            }
+
+            VidPrintCharacters(&(Screens[Cache].Context),
+                               0,
+                               0,
+                               Characters,
+                               VID_TEST_CHARACTERS);
+        }
+
+        if (Pass == 0) {
+            Failures += CompareScreens(Screens,
+                                       Format,
+                                       FontName,
+                                       "default palette");
+
+        } else {
+            Failures += CompareScreens(Screens,
+                                       Format,
+                                       FontName,
+                                       "new palette");
+        }
+    }
+
+TestFormatEnd:
+    for (Cache = 0; Cache < VidTestCacheCount; Cache += 1) {
+        DestroyScreen(&(Screens[Cache]));
+    }
+
+    free(Characters);
+    VPRINT("%d bpp, %s font: %d failures.\n",
+           Format->BitsPerPixel,
+           FontName,
+           Failures);
+
+    return Failures;
+}
+
+ULONG
+TestCacheBufferSizes (
+    PVID_TEST_FORMAT Format
+    )
+
+/*++
+
+Routine Description:
+
+    This routine makes sure glyph cache buffers too small for a single glyph
+    are rejected, and that removing the cache goes back to drawing directly.
+
+Arguments:
+
+    Format - Supplies a pointer to the pixel format to test.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    PVOID Buffer;
+    ULONG Failures;
+    VID_TEST_SCREEN Screen;
+    KSTATUS Status;
+
+    Failures = 0;
+    Buffer = malloc(VID_TEST_SMALL_CACHE_SIZE);
+    Status = CreateScreen(&Screen, Format, VidDefaultFont, 0);
+    if ((Buffer == NULL) || (!KSUCCESS(Status))) {
+        printf("Error: Failed to create a screen.\n");
+        Failures += 1;
+        goto TestCacheBufferSizesEnd;
+    }
+
+    Status = VidSetGlyphCache(&(Screen.Context), Buffer, 1);
+    if ((Status != STATUS_BUFFER_TOO_SMALL) ||
+        (Screen.Context.GlyphCache != NULL)) {
+
+        printf("Error: %d bpp one byte glyph cache returned %d.\n",
+               Format->BitsPerPixel,
+               Status);
+
+        Failures += 1;
+    }
+
+    Status = VidSetGlyphCache(&(Screen.Context),
+                              Buffer,
+                              VID_TEST_SMALL_CACHE_SIZE);
+
+    if ((!KSUCCESS(Status)) || (Screen.Context.GlyphCache != Buffer)) {
+        printf("Error: %d bpp glyph cache returned %d.\n",
+               Format->BitsPerPixel,
+               Status);
+
+        Failures += 1;
+    }
+
+    Status = VidSetGlyphCache(&(Screen.Context), NULL, 0);
+    if ((!KSUCCESS(Status)) || (Screen.Context.GlyphCache != NULL)) {
+        printf("Error: %d bpp glyph cache removal returned %d.\n",
+               Format->BitsPerPixel,
+               Status);
+
+        Failures += 1;
+    }
+
+TestCacheBufferSizesEnd:
+    DestroyScreen(&Screen);
+    free(Buffer);
+    return Failures;
+}
+
+ULONG
+CompareScreens (
+    PVID_TEST_SCREEN Screens,
+    PVID_TEST_FORMAT Format,
+    PCSTR FontName,
+    PCSTR Description
+    )
+
+/*++
+
+Routine Description:
+
+    This routine compares the frame buffers of the cached screens against
+    the uncached one.
+
+Arguments:
+
+    Screens - Supplies the array of screens, indexed by cache type.
+
+    Format - Supplies a pointer to the pixel format being tested.
+
+    FontName - Supplies the name of the font for failure messages.
+
+    Description - Supplies a description of the pass for failure messages.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    PUCHAR Actual;
+    VID_TEST_CACHE Cache;
+    PUCHAR Expected;
+    ULONG Failures;
+    UINTN Offset;
+
+    Failures = 0;
+    Expected = Screens[VidTestCacheNone].FrameBuffer;
+    for (Cache = VidTestCacheNone + 1; Cache < VidTestCacheCount; Cache += 1) {
+        Actual = Screens[Cache].FrameBuffer;
+        for (Offset = 0;
+             Offset < Screens[Cache].FrameBufferSize;
+             Offset += 1) {
+
+            if (Actual[Offset] != Expected[Offset]) {
+                printf("Error: %d bpp, %s font, %s, %s: byte 0x%lx is "
+                       "0x%02x, expected 0x%02x.\n",
+                       Format->BitsPerPixel,
+                       FontName,
+                       Description,
+                       VidTestCacheNames[Cache],
+                       (long)Offset,
+                       Actual[Offset],
+                       Expected[Offset]);
+
+                Failures += 1;
+                break;
+            }
+        }
+    }
+
+    return Failures;
+}
+
+VOID
+RunRenderBenchmark (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine measures how many characters per second are drawn into a
+    frame buffer in memory at each color depth, with and without a glyph
+    cache. Each run prints full screens of 128 column lines, the way the
+    console scrolls through text.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    VID_TEST_CACHE Cache;
+    ULONG CharacterCount;
+    clock_t End;
+    PVID_TEST_FORMAT Format;
+    ULONG FormatIndex;
+    ULONG Index;
+    CHAR Line[129];
+    double Rate[VidTestCacheCount];
+    ULONG Row;
+    ULONG ScreenIndex;
+    VID_TEST_SCREEN Screen;
+    double Seconds;
+    clock_t Start;
+    KSTATUS Status;
+
+    for (Index = 0; Index < sizeof(Line) - 1; Index += 1) {
+        Line[Index] = ' ' + ((Index * 7) % 95);
+    }
+
+    Line[Index] = '\0';
+    printf("Text drawn into a %dx%d frame buffer in Mchars/s "
+           "(uncached / cached):\n",
+           VID_TEST_WIDTH,
+           VID_TEST_HEIGHT);
+
+    for (FormatIndex = 0;
+         FormatIndex < sizeof(VidTestFormats) / sizeof(VidTestFormats[0]);
+         FormatIndex += 1) {
+
+        Format = &(VidTestFormats[FormatIndex]);
+        for (Cache = VidTestCacheNone; Cache < VidTestCacheCount; Cache += 1) {
+            Rate[Cache] = 0;
+            if (Cache == VidTestCacheSmall) {
+                continue;
+            }
+
+            Status = CreateScreen(&Screen,
+                                  Format,
+                                  VidDefaultFont,
+                                  VidTestCacheSizes[Cache]);
+
+            if (!KSUCCESS(Status)) {
+                DestroyScreen(&Screen);
+                continue;
+            }
+
+            CharacterCount = 0;
+            Start = clock();
+            for (ScreenIndex = 0;
+                 ScreenIndex < VID_BENCHMARK_SCREENS;
+                 ScreenIndex += 1) {
+
+                for (Row = 0; Row < Screen.Context.Rows; Row += 1) {
+                    VidPrintString(&(Screen.Context), 0, Row, Line);
+                    CharacterCount += Screen.Context.Columns;
+                }
+            }
+
+            End = clock();
+            Seconds = (double)(End - Start) / CLOCKS_PER_SEC;
+            if (Seconds <= 0) {
+                Seconds = 1.0 / CLOCKS_PER_SEC;
+            }
+
+            Rate[Cache] = CharacterCount / Seconds / 1000000.0;
+            DestroyScreen(&Screen);
+        }
+
+        printf("    %d bpp: %.1f / %.1f\n",
+               Format->BitsPerPixel,
+               Rate[VidTestCacheNone],
+               Rate[VidTestCacheFull]);
+    }
+
+    return;
+}
+
+KSTATUS
+CreateScreen (
+    PVID_TEST_SCREEN Screen,
+    PVID_TEST_FORMAT Format,
+    PBASE_VIDEO_FONT Font,
+    ULONG CacheSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates a frame buffer in memory and initializes a video
+    context to draw into it.
+
+Arguments:
+
+    Screen - Supplies a pointer to the screen to initialize. Whether or not
+        this routine succeeds, the caller should destroy the screen when done
+        with it.
+
+    Format - Supplies a pointer to the pixel format to use.
+
+    Font - Supplies a pointer to the font to draw with.
+
+    CacheSize - Supplies the size of the glyph cache to give the library, or
+        zero to draw without one.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    SYSTEM_RESOURCE_FRAME_BUFFER FrameBuffer;
+    PBASE_VIDEO_FONT OldFont;
+    KSTATUS Status;
+
+    memset(Screen, 0, sizeof(VID_TEST_SCREEN));
+    Screen->FrameBufferSize = VID_TEST_WIDTH * VID_TEST_HEIGHT *
+                              (Format->BitsPerPixel / BITS_PER_BYTE);
+
+    Screen->FrameBuffer = malloc(Screen->FrameBufferSize);
+    if (Screen->FrameBuffer == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    memset(Screen->FrameBuffer, 0, Screen->FrameBufferSize);
+    memset(&FrameBuffer, 0, sizeof(SYSTEM_RESOURCE_FRAME_BUFFER));
+    FrameBuffer.Header.VirtualAddress = Screen->FrameBuffer;
+    FrameBuffer.Mode = BaseVideoModeFrameBuffer;
+    FrameBuffer.Width = VID_TEST_WIDTH;
+    FrameBuffer.Height = VID_TEST_HEIGHT;
+    FrameBuffer.BitsPerPixel = Format->BitsPerPixel;
+    FrameBuffer.PixelsPerScanLine = VID_TEST_WIDTH;
+    FrameBuffer.RedMask = Format->RedMask;
+    FrameBuffer.GreenMask = Format->GreenMask;
+    FrameBuffer.BlueMask = Format->BlueMask;
+
+    //
+    // New contexts always pick up the default font.
+    //
+
+    OldFont = VidDefaultFont;
+    VidDefaultFont = Font;
+    Status = VidInitialize(&(Screen->Context), &FrameBuffer);
+    VidDefaultFont = OldFont;
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    if (CacheSize != 0) {
+        Screen->GlyphCache = malloc(CacheSize);
+        if (Screen->GlyphCache == NULL) {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        Status = VidSetGlyphCache(&(Screen->Context),
+                                  Screen->GlyphCache,
+                                  CacheSize);
+
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+DestroyScreen (
+    PVID_TEST_SCREEN Screen
+    )
+
+/*++
+
+Routine Description:
+
+    This routine frees the memory behind a test screen.
+
+Arguments:
+
+    Screen - Supplies a pointer to the screen to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    free(Screen->FrameBuffer);
+    free(Screen->GlyphCache);
+    Screen->FrameBuffer = NULL;
+    Screen->GlyphCache = NULL;
+    return;
+}
+
@@ -34,6 +34,7 @@ function build() {
     var sources;
 
     sources = [
+        "dircache.c",
         "fat.c",
         "fatcache.c",
         "fatsup.c",
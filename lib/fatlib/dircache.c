@@ -0,0 +1,1271 @@
+/*++
+
+Copyright (c) 2012 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    dircache.c
+
+Abstract:
+
+    This module implements the directory entry cache, which indexes the names
+    in a directory by hash so that lookups in large directories do not have
+    to read and reassemble every directory entry.
+
+Environment:
+
+    Kernel, Boot, Build
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <minoca/lib/fat/fatlib.h>
+#include <minoca/lib/fat/fat.h>
+#include "fatlibp.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the number of hash buckets a directory cache starts with. The bucket
+// arrays double whenever there are more names than buckets.
+//
+
+#define FAT_DIRECTORY_CACHE_INITIAL_BUCKETS 64
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+/*++
+
+Structure Description:
+
+    This structure stores a single name in a directory cache.
+
+Members:
+
+    NameNext - Stores a pointer to the next entry in the same name hash bucket.
+
+    OffsetNext - Stores a pointer to the next entry in the same offset hash
+        bucket.
+
+    NameHash - Stores the case folded hash of the name.
+
+    EntryOffset - Stores the offset of the short directory entry for the name,
+        in directory entries from the beginning of the directory.
+
+    NameSize - Stores the size of the name in bytes, including the null
+        terminator.
+
+    Name - Stores the name as returned when reading the directory.
+
+--*/
+
+typedef struct _FAT_DIRECTORY_CACHE_ENTRY {
+    struct _FAT_DIRECTORY_CACHE_ENTRY *NameNext;
+    struct _FAT_DIRECTORY_CACHE_ENTRY *OffsetNext;
+    ULONG NameHash;
+    ULONG EntryOffset;
+    ULONG NameSize;
+    CHAR Name[ANYSIZE_ARRAY];
+} FAT_DIRECTORY_CACHE_ENTRY, *PFAT_DIRECTORY_CACHE_ENTRY;
+
+/*++
+
+Structure Description:
+
+    This structure stores the cached names of a single directory. A directory
+    cache always describes every name in the directory, so a miss in the cache
+    is a definitive answer. A cache with no buckets marks a directory that was
+    too large to index; lookups in it fall back to reading the directory.
+
+Members:
+
+    ListEntry - Stores pointers to the next and previous directory caches on
+        the volume, in most recently used order.
+
+    DirectoryCluster - Stores the first cluster of the directory.
+
+    EntryCount - Stores the number of names in the cache.
+
+    BucketCount - Stores the number of buckets in each hash table. This is
+        always a power of two.
+
+    NameBuckets - Stores the array of entry lists hashed by name.
+
+    OffsetBuckets - Stores the array of entry lists hashed by directory offset.
+
+    Size - Stores the number of bytes of memory the cache consumes.
+
+--*/
+
+typedef struct _FAT_DIRECTORY_CACHE {
+    LIST_ENTRY ListEntry;
+    ULONG DirectoryCluster;
+    ULONG EntryCount;
+    ULONG BucketCount;
+    PFAT_DIRECTORY_CACHE_ENTRY *NameBuckets;
+    PFAT_DIRECTORY_CACHE_ENTRY *OffsetBuckets;
+    UINTN Size;
+} FAT_DIRECTORY_CACHE, *PFAT_DIRECTORY_CACHE;
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+KSTATUS
+FatpBuildDirectoryCache (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CONTEXT Directory,
+    PFAT_DIRECTORY_CACHE *NewCache
+    );
+
+VOID
+FatpDestroyDirectoryCacheStructure (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CACHE Cache
+    );
+
+VOID
+FatpResetDirectoryCache (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CACHE Cache
+    );
+
+KSTATUS
+FatpAddDirectoryCacheName (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CACHE Cache,
+    PSTR Name,
+    ULONG NameSize,
+    ULONG EntryOffset
+    );
+
+KSTATUS
+FatpGrowDirectoryCache (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CACHE Cache
+    );
+
+PFAT_DIRECTORY_CACHE
+FatpFindDirectoryCache (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster
+    );
+
+KSTATUS
+FatpSearchDirectoryCache (
+    PFAT_DIRECTORY_CACHE Cache,
+    PCSTR Name,
+    ULONG NameLength,
+    ULONG NameHash,
+    PULONG EntryOffset
+    );
+
+VOID
+FatpTrimDirectoryCaches (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CACHE KeepCache,
+    PLIST_ENTRY FreeList
+    );
+
+VOID
+FatpDestroyDirectoryCacheList (
+    PFAT_VOLUME Volume,
+    PLIST_ENTRY FreeList
+    );
+
+ULONG
+FatpHashDirectoryCacheName (
+    PCSTR Name,
+    ULONG NameLength
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+VOID
+FatpInitializeDirectoryCache (
+    PFAT_VOLUME Volume
+    )
+
+/*++
+
+Routine Description:
+
+    This routine initializes the directory entry cache for the given volume.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    INITIALIZE_LIST_HEAD(&(Volume->DirectoryCacheList));
+    Volume->DirectoryCacheSize = 0;
+    return;
+}
+
+VOID
+FatpDestroyDirectoryCache (
+    PFAT_VOLUME Volume
+    )
+
+/*++
+
+Routine Description:
+
+    This routine frees every directory cached on the given volume.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    //
+    // The lock isn't acquired because the volume is being destroyed, so no one
+    // should be doing any accesses.
+    //
+
+    FatpDestroyDirectoryCacheList(Volume, &(Volume->DirectoryCacheList));
+    Volume->DirectoryCacheSize = 0;
+    return;
+}
+
+KSTATUS
+FatpDirectoryCacheLookup (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CONTEXT Directory,
+    PCSTR Name,
+    ULONG NameLength,
+    PULONGLONG EntryOffset
+    )
+
+/*++
+
+Routine Description:
+
+    This routine looks up a name in the directory cache, indexing the
+    directory first if it has not been seen before.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    Directory - Supplies a pointer to the directory context for the open
+        directory. The directory position is changed if the directory needs
+        to be indexed.
+
+    Name - Supplies the name of the file or directory to look up.
+
+    NameLength - Supplies the size of the name buffer in bytes, including the
+        null terminator.
+
+    EntryOffset - Supplies a pointer where the offset of the short directory
+        entry for the name will be returned on success.
+
+Return Value:
+
+    STATUS_SUCCESS if the name was found in the cache.
+
+    STATUS_PATH_NOT_FOUND if the directory does not contain the name.
+
+    STATUS_NOT_FOUND if the directory could not be indexed, in which case the
+    caller must search the directory itself.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_CACHE Cache;
+    ULONG DirectoryCluster;
+    PFAT_DIRECTORY_CACHE ExistingCache;
+    LIST_ENTRY FreeList;
+    ULONG Hash;
+    ULONG Offset;
+    KSTATUS Status;
+
+    Cache = NULL;
+    DirectoryCluster = Directory->File->FirstCluster;
+    Hash = FatpHashDirectoryCacheName(Name, NameLength);
+    INITIALIZE_LIST_HEAD(&FreeList);
+    FatAcquireLock(Volume->Lock);
+    ExistingCache = FatpFindDirectoryCache(Volume, DirectoryCluster);
+    if (ExistingCache != NULL) {
+        Status = FatpSearchDirectoryCache(ExistingCache,
+                                          Name,
+                                          NameLength,
+                                          Hash,
+                                          &Offset);
+    }
+
+    FatReleaseLock(Volume->Lock);
+    if (ExistingCache != NULL) {
+        goto DirectoryCacheLookupEnd;
+    }
+
+    //
+    // Index the directory outside the lock, then publish the new cache unless
+    // someone else beat this thread to it.
+    //
+
+    Status = FatpBuildDirectoryCache(Volume, Directory, &Cache);
+    if (!KSUCCESS(Status)) {
+        Status = STATUS_NOT_FOUND;
+        goto DirectoryCacheLookupEnd;
+    }
+
+    FatAcquireLock(Volume->Lock);
+    ExistingCache = FatpFindDirectoryCache(Volume, DirectoryCluster);
+    if (ExistingCache == NULL) {
+        INSERT_AFTER(&(Cache->ListEntry), &(Volume->DirectoryCacheList));
+        Volume->DirectoryCacheSize += Cache->Size;
+        ExistingCache = Cache;
+        Cache = NULL;
+        FatpTrimDirectoryCaches(Volume, ExistingCache, &FreeList);
+    }
+
+    Status = FatpSearchDirectoryCache(ExistingCache,
+                                      Name,
+                                      NameLength,
+                                      Hash,
+                                      &Offset);
+
+    FatReleaseLock(Volume->Lock);
+
+DirectoryCacheLookupEnd:
+    if (Cache != NULL) {
+        FatpDestroyDirectoryCacheStructure(Volume, Cache);
+    }
+
+    FatpDestroyDirectoryCacheList(Volume, &FreeList);
+    if (KSUCCESS(Status)) {
+        *EntryOffset = Offset;
+    }
+
+    return Status;
+}
+
+VOID
+FatpDirectoryCacheAddEntry (
+    PFAT_DIRECTORY_CONTEXT Directory,
+    ULONGLONG EntryOffset
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a newly written directory entry to the directory cache,
+    if the directory is cached. The entry is read back so that the cache holds
+    exactly the name a directory scan would return.
+
+Arguments:
+
+    Directory - Supplies a pointer to the directory context for the modified
+        directory. The directory position is changed.
+
+    EntryOffset - Supplies the offset of the first directory entry (long or
+        short) making up the new name.
+
+Return Value:
+
+    None. On failure the directory is dropped from the cache.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_CACHE Cache;
+    ULONG DirectoryCluster;
+    ULONG EntriesRead;
+    FAT_DIRECTORY_ENTRY Entry;
+    LIST_ENTRY FreeList;
+    BOOL Indexed;
+    PSTR Name;
+    ULONG NameSize;
+    KSTATUS Status;
+    PFAT_VOLUME Volume;
+
+    DirectoryCluster = Directory->File->FirstCluster;
+    INITIALIZE_LIST_HEAD(&FreeList);
+    Name = NULL;
+    Volume = Directory->File->Volume;
+
+    //
+    // Don't bother reading anything back if the directory isn't indexed.
+    //
+
+    FatAcquireLock(Volume->Lock);
+    Cache = FatpFindDirectoryCache(Volume, DirectoryCluster);
+    Indexed = FALSE;
+    if ((Cache != NULL) && (Cache->NameBuckets != NULL)) {
+        Indexed = TRUE;
+    }
+
+    FatReleaseLock(Volume->Lock);
+    if (Indexed == FALSE) {
+        return;
+    }
+
+    NameSize = FAT_MAX_LONG_FILE_LENGTH + 1;
+    Name = FatAllocatePagedMemory(Volume->Device.DeviceToken, NameSize);
+    if (Name == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto DirectoryCacheAddEntryEnd;
+    }
+
+    Status = FatpDirectorySeek(Directory, EntryOffset);
+    if (!KSUCCESS(Status)) {
+        goto DirectoryCacheAddEntryEnd;
+    }
+
+    Status = FatpReadNextDirectoryEntry(Directory,
+                                        NULL,
+                                        Name,
+                                        &NameSize,
+                                        &Entry,
+                                        &EntriesRead);
+
+    if (!KSUCCESS(Status)) {
+        goto DirectoryCacheAddEntryEnd;
+    }
+
+    ASSERT(EntriesRead != 0);
+
+    EntryOffset += EntriesRead - 1;
+    FatAcquireLock(Volume->Lock);
+    Cache = FatpFindDirectoryCache(Volume, DirectoryCluster);
+    if ((Cache != NULL) && (Cache->NameBuckets != NULL)) {
+        Volume->DirectoryCacheSize -= Cache->Size;
+        Status = FatpAddDirectoryCacheName(Volume,
+                                           Cache,
+                                           Name,
+                                           NameSize,
+                                           (ULONG)EntryOffset);
+
+        if (!KSUCCESS(Status)) {
+            FatpResetDirectoryCache(Volume, Cache);
+        }
+
+        Volume->DirectoryCacheSize += Cache->Size;
+        FatpTrimDirectoryCaches(Volume, Cache, &FreeList);
+    }
+
+    FatReleaseLock(Volume->Lock);
+    Status = STATUS_SUCCESS;
+
+DirectoryCacheAddEntryEnd:
+    if (!KSUCCESS(Status)) {
+        FatpInvalidateDirectoryCache(Volume, DirectoryCluster);
+    }
+
+    FatpDestroyDirectoryCacheList(Volume, &FreeList);
+    if (Name != NULL) {
+        FatFreePagedMemory(Volume->Device.DeviceToken, Name);
+    }
+
+    return;
+}
+
+VOID
+FatpDirectoryCacheRemoveEntry (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster,
+    ULONGLONG EntryOffset
+    )
+
+/*++
+
+Routine Description:
+
+    This routine removes an erased directory entry from the directory cache.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    DirectoryCluster - Supplies the first cluster of the directory that held
+        the entry.
+
+    EntryOffset - Supplies the offset of the short directory entry that was
+        erased.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_CACHE Cache;
+    PFAT_DIRECTORY_CACHE_ENTRY CacheEntry;
+    ULONG Index;
+    PFAT_DIRECTORY_CACHE_ENTRY *Previous;
+
+    CacheEntry = NULL;
+    FatAcquireLock(Volume->Lock);
+    Cache = FatpFindDirectoryCache(Volume, DirectoryCluster);
+    if ((Cache == NULL) || (Cache->NameBuckets == NULL)) {
+        goto DirectoryCacheRemoveEntryEnd;
+    }
+
+    //
+    // Unlink the entry from the offset table, then from the name table.
+    //
+
+    Index = (ULONG)EntryOffset & (Cache->BucketCount - 1);
+    Previous = &(Cache->OffsetBuckets[Index]);
+    while (*Previous != NULL) {
+        if ((*Previous)->EntryOffset == (ULONG)EntryOffset) {
+            CacheEntry = *Previous;
+            *Previous = CacheEntry->OffsetNext;
+            break;
+        }
+
+        Previous = &((*Previous)->OffsetNext);
+    }
+
+    if (CacheEntry == NULL) {
+        goto DirectoryCacheRemoveEntryEnd;
+    }
+
+    Index = CacheEntry->NameHash & (Cache->BucketCount - 1);
+    Previous = &(Cache->NameBuckets[Index]);
+    while (*Previous != CacheEntry) {
+
+        ASSERT(*Previous != NULL);
+
+        Previous = &((*Previous)->NameNext);
+    }
+
+    *Previous = CacheEntry->NameNext;
+    Cache->EntryCount -= 1;
+    Cache->Size -= sizeof(FAT_DIRECTORY_CACHE_ENTRY) + CacheEntry->NameSize;
+    Volume->DirectoryCacheSize -= sizeof(FAT_DIRECTORY_CACHE_ENTRY) +
+                                  CacheEntry->NameSize;
+
+DirectoryCacheRemoveEntryEnd:
+    FatReleaseLock(Volume->Lock);
+    if (CacheEntry != NULL) {
+        FatFreePagedMemory(Volume->Device.DeviceToken, CacheEntry);
+    }
+
+    return;
+}
+
+VOID
+FatpInvalidateDirectoryCache (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster
+    )
+
+/*++
+
+Routine Description:
+
+    This routine drops a directory from the directory cache, if it is cached.
+    It will be indexed again the next time a name is looked up in it.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    DirectoryCluster - Supplies the first cluster of the directory.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_CACHE Cache;
+
+    FatAcquireLock(Volume->Lock);
+    Cache = FatpFindDirectoryCache(Volume, DirectoryCluster);
+    if (Cache != NULL) {
+        LIST_REMOVE(&(Cache->ListEntry));
+        Volume->DirectoryCacheSize -= Cache->Size;
+    }
+
+    FatReleaseLock(Volume->Lock);
+    if (Cache != NULL) {
+        FatpDestroyDirectoryCacheStructure(Volume, Cache);
+    }
+
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+KSTATUS
+FatpBuildDirectoryCache (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CONTEXT Directory,
+    PFAT_DIRECTORY_CACHE *NewCache
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads every name in a directory into a new directory cache.
+    If the directory is too large for the cache budget, an empty cache is
+    returned marking the directory as not indexable.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    Directory - Supplies a pointer to the directory context for the open
+        directory.
+
+    NewCache - Supplies a pointer where a pointer to the new cache will be
+        returned on success.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONG AllocationSize;
+    PFAT_DIRECTORY_CACHE Cache;
+    FAT_DIRECTORY_ENTRY Entry;
+    ULONG EntriesRead;
+    PSTR Name;
+    ULONG NameBufferSize;
+    ULONG NameSize;
+    ULONGLONG Offset;
+    KSTATUS Status;
+
+    Name = NULL;
+    AllocationSize = sizeof(FAT_DIRECTORY_CACHE) +
+                     (2 * FAT_DIRECTORY_CACHE_INITIAL_BUCKETS *
+                      sizeof(PFAT_DIRECTORY_CACHE_ENTRY));
+
+    Cache = FatAllocatePagedMemory(Volume->Device.DeviceToken, AllocationSize);
+    if (Cache == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto BuildDirectoryCacheEnd;
+    }
+
+    RtlZeroMemory(Cache, AllocationSize);
+    Cache->DirectoryCluster = Directory->File->FirstCluster;
+    Cache->BucketCount = FAT_DIRECTORY_CACHE_INITIAL_BUCKETS;
+    Cache->NameBuckets = (PFAT_DIRECTORY_CACHE_ENTRY *)(Cache + 1);
+    Cache->OffsetBuckets = Cache->NameBuckets + Cache->BucketCount;
+    Cache->Size = AllocationSize;
+    NameBufferSize = FAT_MAX_LONG_FILE_LENGTH + 1;
+    Name = FatAllocatePagedMemory(Volume->Device.DeviceToken, NameBufferSize);
+    if (Name == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto BuildDirectoryCacheEnd;
+    }
+
+    Offset = DIRECTORY_CONTENTS_OFFSET;
+    Status = FatpDirectorySeek(Directory, Offset);
+    if (!KSUCCESS(Status)) {
+        goto BuildDirectoryCacheEnd;
+    }
+
+    while (TRUE) {
+        NameSize = NameBufferSize;
+        Status = FatpReadNextDirectoryEntry(Directory,
+                                            NULL,
+                                            Name,
+                                            &NameSize,
+                                            &Entry,
+                                            &EntriesRead);
+
+        if (!KSUCCESS(Status)) {
+            if (Status == STATUS_END_OF_FILE) {
+                Status = STATUS_SUCCESS;
+            }
+
+            break;
+        }
+
+        Offset += EntriesRead;
+        Status = FatpAddDirectoryCacheName(Volume,
+                                           Cache,
+                                           Name,
+                                           NameSize,
+                                           (ULONG)(Offset - 1));
+
+        if (!KSUCCESS(Status)) {
+            break;
+        }
+
+        //
+        // Give up on indexing this directory if it alone would blow the
+        // budget.
+        //
+
+        if (Cache->Size > FAT_DIRECTORY_CACHE_MAX_SIZE) {
+            FatpResetDirectoryCache(Volume, Cache);
+            break;
+        }
+    }
+
+BuildDirectoryCacheEnd:
+    if (Name != NULL) {
+        FatFreePagedMemory(Volume->Device.DeviceToken, Name);
+    }
+
+    if (!KSUCCESS(Status)) {
+        if (Cache != NULL) {
+            FatpDestroyDirectoryCacheStructure(Volume, Cache);
+            Cache = NULL;
+        }
+    }
+
+    *NewCache = Cache;
+    return Status;
+}
+
+VOID
+FatpDestroyDirectoryCacheStructure (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CACHE Cache
+    )
+
+/*++
+
+Routine Description:
+
+    This routine frees a directory cache and all of its entries. The cache
+    must not be on the volume's list.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    Cache - Supplies a pointer to the cache to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    FatpResetDirectoryCache(Volume, Cache);
+    FatFreePagedMemory(Volume->Device.DeviceToken, Cache);
+    return;
+}
+
+VOID
+FatpResetDirectoryCache (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CACHE Cache
+    )
+
+/*++
+
+Routine Description:
+
+    This routine frees all entries and buckets of a directory cache, leaving
+    behind an empty cache that marks the directory as not indexed.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    Cache - Supplies a pointer to the cache to reset.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_CACHE_ENTRY CacheEntry;
+    ULONG Index;
+    PFAT_DIRECTORY_CACHE_ENTRY NextEntry;
+
+    if (Cache->NameBuckets == NULL) {
+        return;
+    }
+
+    for (Index = 0; Index < Cache->BucketCount; Index += 1) {
+        CacheEntry = Cache->NameBuckets[Index];
+        while (CacheEntry != NULL) {
+            NextEntry = CacheEntry->NameNext;
+            FatFreePagedMemory(Volume->Device.DeviceToken, CacheEntry);
+            CacheEntry = NextEntry;
+        }
+    }
+
+    //
+    // The initial buckets come with the cache structure itself.
+    //
+
+    if (Cache->NameBuckets != (PFAT_DIRECTORY_CACHE_ENTRY *)(Cache + 1)) {
+        FatFreePagedMemory(Volume->Device.DeviceToken, Cache->NameBuckets);
+    }
+
+    Cache->NameBuckets = NULL;
+    Cache->OffsetBuckets = NULL;
+    Cache->BucketCount = 0;
+    Cache->EntryCount = 0;
+    Cache->Size = sizeof(FAT_DIRECTORY_CACHE);
+    return;
+}
+
+KSTATUS
+FatpAddDirectoryCacheName (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CACHE Cache,
+    PSTR Name,
+    ULONG NameSize,
+    ULONG EntryOffset
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a name to a directory cache. If the name is already
+    present, the existing entry is kept, matching the first-match behavior of
+    a directory scan.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    Cache - Supplies a pointer to the directory cache.
+
+    Name - Supplies a pointer to the null terminated name.
+
+    NameSize - Supplies the size of the name in bytes, including the null
+        terminator.
+
+    EntryOffset - Supplies the offset of the short directory entry for the
+        name.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_CACHE_ENTRY CacheEntry;
+    ULONG ExistingOffset;
+    ULONG Hash;
+    ULONG Index;
+    KSTATUS Status;
+
+    ASSERT(Cache->NameBuckets != NULL);
+
+    Hash = FatpHashDirectoryCacheName(Name, NameSize);
+    Status = FatpSearchDirectoryCache(Cache,
+                                      Name,
+                                      NameSize,
+                                      Hash,
+                                      &ExistingOffset);
+
+    if (KSUCCESS(Status)) {
+        return STATUS_SUCCESS;
+    }
+
+    if (Cache->EntryCount >= Cache->BucketCount) {
+        Status = FatpGrowDirectoryCache(Volume, Cache);
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+    }
+
+    CacheEntry = FatAllocatePagedMemory(Volume->Device.DeviceToken,
+                                        sizeof(FAT_DIRECTORY_CACHE_ENTRY) +
+                                        NameSize);
+
+    if (CacheEntry == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    CacheEntry->NameHash = Hash;
+    CacheEntry->EntryOffset = EntryOffset;
+    CacheEntry->NameSize = NameSize;
+    RtlCopyMemory(CacheEntry->Name, Name, NameSize);
+    Index = Hash & (Cache->BucketCount - 1);
+    CacheEntry->NameNext = Cache->NameBuckets[Index];
+    Cache->NameBuckets[Index] = CacheEntry;
+    Index = EntryOffset & (Cache->BucketCount - 1);
+    CacheEntry->OffsetNext = Cache->OffsetBuckets[Index];
+    Cache->OffsetBuckets[Index] = CacheEntry;
+    Cache->EntryCount += 1;
+    Cache->Size += sizeof(FAT_DIRECTORY_CACHE_ENTRY) + NameSize;
+    return STATUS_SUCCESS;
+}
+
+KSTATUS
+FatpGrowDirectoryCache (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CACHE Cache
+    )
+
+/*++
+
+Routine Description:
+
+    This routine doubles the number of hash buckets in a directory cache and
+    rehashes every entry.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    Cache - Supplies a pointer to the directory cache.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONG AllocationSize;
+    ULONG BucketCount;
+    PFAT_DIRECTORY_CACHE_ENTRY CacheEntry;
+    ULONG Index;
+    PFAT_DIRECTORY_CACHE_ENTRY *NameBuckets;
+    ULONG NewIndex;
+    PFAT_DIRECTORY_CACHE_ENTRY NextEntry;
+    PFAT_DIRECTORY_CACHE_ENTRY *OffsetBuckets;
+
+    BucketCount = Cache->BucketCount * 2;
+    AllocationSize = 2 * BucketCount * sizeof(PFAT_DIRECTORY_CACHE_ENTRY);
+    NameBuckets = FatAllocatePagedMemory(Volume->Device.DeviceToken,
+                                         AllocationSize);
+
+    if (NameBuckets == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(NameBuckets, AllocationSize);
+    OffsetBuckets = NameBuckets + BucketCount;
+    for (Index = 0; Index < Cache->BucketCount; Index += 1) {
+        CacheEntry = Cache->NameBuckets[Index];
+        while (CacheEntry != NULL) {
+            NextEntry = CacheEntry->NameNext;
+            NewIndex = CacheEntry->NameHash & (BucketCount - 1);
+            CacheEntry->NameNext = NameBuckets[NewIndex];
+            NameBuckets[NewIndex] = CacheEntry;
+            NewIndex = CacheEntry->EntryOffset & (BucketCount - 1);
+            CacheEntry->OffsetNext = OffsetBuckets[NewIndex];
+            OffsetBuckets[NewIndex] = CacheEntry;
+            CacheEntry = NextEntry;
+        }
+    }
+
+    if (Cache->NameBuckets != (PFAT_DIRECTORY_CACHE_ENTRY *)(Cache + 1)) {
+        FatFreePagedMemory(Volume->Device.DeviceToken, Cache->NameBuckets);
+        Cache->Size -= 2 * Cache->BucketCount *
+                       sizeof(PFAT_DIRECTORY_CACHE_ENTRY);
+    }
+
+    Cache->NameBuckets = NameBuckets;
+    Cache->OffsetBuckets = OffsetBuckets;
+    Cache->BucketCount = BucketCount;
+    Cache->Size += AllocationSize;
+    return STATUS_SUCCESS;
+}
+
+PFAT_DIRECTORY_CACHE
+FatpFindDirectoryCache (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster
+    )
+
+/*++
+
+Routine Description:
+
+    This routine finds the cache for the given directory and marks it most
+    recently used. This routine assumes the volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    DirectoryCluster - Supplies the first cluster of the directory.
+
+Return Value:
+
+    Returns a pointer to the directory cache on success.
+
+    NULL if the directory is not cached.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_CACHE Cache;
+    PLIST_ENTRY CurrentEntry;
+
+    CurrentEntry = Volume->DirectoryCacheList.Next;
+    while (CurrentEntry != &(Volume->DirectoryCacheList)) {
+        Cache = LIST_VALUE(CurrentEntry, FAT_DIRECTORY_CACHE, ListEntry);
+        if (Cache->DirectoryCluster == DirectoryCluster) {
+            if (CurrentEntry != Volume->DirectoryCacheList.Next) {
+                LIST_REMOVE(CurrentEntry);
+                INSERT_AFTER(CurrentEntry, &(Volume->DirectoryCacheList));
+            }
+
+            return Cache;
+        }
+
+        CurrentEntry = CurrentEntry->Next;
+    }
+
+    return NULL;
+}
+
+KSTATUS
+FatpSearchDirectoryCache (
+    PFAT_DIRECTORY_CACHE Cache,
+    PCSTR Name,
+    ULONG NameLength,
+    ULONG NameHash,
+    PULONG EntryOffset
+    )
+
+/*++
+
+Routine Description:
+
+    This routine searches a directory cache for a name, using the same
+    comparison as a directory scan.
+
+Arguments:
+
+    Cache - Supplies a pointer to the directory cache.
+
+    Name - Supplies the name to search for, which may not be null terminated.
+
+    NameLength - Supplies the size of the name buffer in bytes, including the
+        null terminator.
+
+    NameHash - Supplies the hash of the name.
+
+    EntryOffset - Supplies a pointer where the offset of the short directory
+        entry will be returned on success.
+
+Return Value:
+
+    STATUS_SUCCESS if the name was found.
+
+    STATUS_PATH_NOT_FOUND if the name is not in the directory.
+
+    STATUS_NOT_FOUND if the directory is not indexed.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_CACHE_ENTRY CacheEntry;
+
+    if (Cache->NameBuckets == NULL) {
+        return STATUS_NOT_FOUND;
+    }
+
+    CacheEntry = Cache->NameBuckets[NameHash & (Cache->BucketCount - 1)];
+    while (CacheEntry != NULL) {
+        if ((CacheEntry->NameHash == NameHash) &&
+            (CacheEntry->NameSize <= NameLength) &&
+            (RtlAreStringsEqual(Name, CacheEntry->Name, NameLength - 1) !=
+             FALSE)) {
+
+            *EntryOffset = CacheEntry->EntryOffset;
+            return STATUS_SUCCESS;
+        }
+
+        CacheEntry = CacheEntry->NameNext;
+    }
+
+    return STATUS_PATH_NOT_FOUND;
+}
+
+VOID
+FatpTrimDirectoryCaches (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CACHE KeepCache,
+    PLIST_ENTRY FreeList
+    )
+
+/*++
+
+Routine Description:
+
+    This routine removes least recently used directory caches until the
+    volume is back within its directory cache budget. This routine assumes
+    the volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    KeepCache - Supplies a pointer to a cache that should not be evicted. If
+        this cache alone is over budget, it is reset instead.
+
+    FreeList - Supplies a pointer to the head of a list where evicted caches
+        are put so they can be freed after the lock is released.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_CACHE Cache;
+    PLIST_ENTRY CurrentEntry;
+
+    CurrentEntry = Volume->DirectoryCacheList.Previous;
+    while ((Volume->DirectoryCacheSize > FAT_DIRECTORY_CACHE_MAX_SIZE) &&
+           (CurrentEntry != &(Volume->DirectoryCacheList))) {
+
+        Cache = LIST_VALUE(CurrentEntry, FAT_DIRECTORY_CACHE, ListEntry);
+        CurrentEntry = CurrentEntry->Previous;
+        if (Cache == KeepCache) {
+            continue;
+        }
+
+        LIST_REMOVE(&(Cache->ListEntry));
+        INSERT_BEFORE(&(Cache->ListEntry), FreeList);
+        Volume->DirectoryCacheSize -= Cache->Size;
+    }
+
+    if (Volume->DirectoryCacheSize > FAT_DIRECTORY_CACHE_MAX_SIZE) {
+        Volume->DirectoryCacheSize -= KeepCache->Size;
+        FatpResetDirectoryCache(Volume, KeepCache);
+        Volume->DirectoryCacheSize += KeepCache->Size;
+    }
+
+    return;
+}
+
+VOID
+FatpDestroyDirectoryCacheList (
+    PFAT_VOLUME Volume,
+    PLIST_ENTRY FreeList
+    )
+
+/*++
+
+Routine Description:
+
+    This routine frees every directory cache on the given list.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    FreeList - Supplies a pointer to the head of the list of caches to free.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_CACHE Cache;
+
+    while (LIST_EMPTY(FreeList) == FALSE) {
+        Cache = LIST_VALUE(FreeList->Next, FAT_DIRECTORY_CACHE, ListEntry);
+        LIST_REMOVE(&(Cache->ListEntry));
+        FatpDestroyDirectoryCacheStructure(Volume, Cache);
+    }
+
+    return;
+}
+
+ULONG
+FatpHashDirectoryCacheName (
+    PCSTR Name,
+    ULONG NameLength
+    )
+
+/*++
+
+Routine Description:
+
+    This routine computes the case folded hash of a name. Only the characters
+    before the first null terminator or the end of the buffer are hashed.
+
+Arguments:
+
+    Name - Supplies the name to hash, which may not be null terminated.
+
+    NameLength - Supplies the size of the name buffer in bytes, including the
+        null terminator.
+
+Return Value:
+
+    Returns the 32-bit FNV-1a hash of the lower case name.
+
+--*/
+
+{
+
+    ULONG Hash;
+    ULONG Index;
+
+    Hash = 0x811C9DC5;
+    for (Index = 0; Index + 1 < NameLength; Index += 1) {
+        if (Name[Index] == STRING_TERMINATOR) {
+            break;
+        }
+
+        Hash ^= (UCHAR)RtlConvertCharacterToLowerCase(Name[Index]);
+        Hash *= 0x01000193;
+    }
+
+    return Hash;
+}
+
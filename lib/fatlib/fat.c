@@ -940,6 +940,7 @@ Return Value:
                   sizeof(BLOCK_DEVICE_PARAMETERS));
 
     FatpInitializeFileMappingTree(FatVolume);
+    FatpInitializeDirectoryCache(FatVolume);
     FatVolume->BlockShift =
                           RtlCountTrailingZeros32(FatVolume->Device.BlockSize);
 
@@ -1184,6 +1185,7 @@ Return Value:
     FatVolume = (PFAT_VOLUME)Volume;
     FatpDestroyFatCache(FatVolume);
     FatpDestroyFileMappingTree(FatVolume);
+    FatpDestroyDirectoryCache(FatVolume);
     FatDestroyLock(FatVolume->Lock);
     FatFreeNonPagedMemory(FatVolume->Device.DeviceToken, FatVolume);
     return STATUS_SUCCESS;
@@ -1232,6 +1234,7 @@ Return Value:
     ULONG ClusterBad;
     PFAT_FILE FatFile;
     PFAT_VOLUME FatVolume;
+    ULONG FileCluster;
     ULONG FirstCluster;
     ULONG PageSize;
     PFAT_IO_BUFFER ScratchIoBuffer;
@@ -1351,10 +1354,37 @@ Return Value:
     RtlZeroMemory(FatFile, sizeof(FAT_FILE));
     FatFile->Volume = FatVolume;
     FatFile->OpenFlags = Flags;
-    FatFile->SeekTable[0] = FirstCluster;
+    FatFile->FirstCluster = FirstCluster;
     FatFile->ScratchIoBuffer = ScratchIoBuffer;
     FatFile->ScratchIoBufferLock = ScratchIoBufferLock;
 
+    //
+    // Seed the extent map with the first cluster. Page files get their whole
+    // chain mapped now, since paging I/O cannot allocate memory to extend
+    // the map later.
+    //
+
+    if ((FirstCluster >= FAT_CLUSTER_BEGIN) && (FirstCluster < ClusterBad)) {
+        FatpRecordFileCluster(FatFile, 0, FirstCluster);
+        if ((Flags & OPEN_FLAG_PAGE_FILE) != 0) {
+            Cluster = FirstCluster;
+            FileCluster = 1;
+            while (TRUE) {
+                Status = FatpGetNextCluster(Volume, 0, Cluster, &Cluster);
+                if (!KSUCCESS(Status)) {
+                    goto OpenFileIdEnd;
+                }
+
+                if ((Cluster < FAT_CLUSTER_BEGIN) || (Cluster >= ClusterBad)) {
+                    break;
+                }
+
+                FatpRecordFileCluster(FatFile, FileCluster, Cluster);
+                FileCluster += 1;
+            }
+        }
+    }
+
     //
     // If this is the root directory and the root directory is outside the
     // main clusters, mark this file as special.
@@ -1380,6 +1410,7 @@ OpenFileIdEnd:
         }
 
         if (FatFile != NULL) {
+            FatpDestroyFileExtents(FatFile);
             if ((Flags & OPEN_FLAG_PAGE_FILE) != 0) {
                 FatFreeNonPagedMemory(FatVolume->Device.DeviceToken, FatFile);
 
@@ -1429,6 +1460,7 @@ Return Value:
         FatDestroyLock(FatFile->ScratchIoBufferLock);
     }
 
+    FatpDestroyFileExtents(FatFile);
     if ((FatFile->OpenFlags & OPEN_FLAG_PAGE_FILE) != 0) {
         FatFreeNonPagedMemory(FatFile->Volume->Device.DeviceToken, FatFile);
 
@@ -2061,7 +2093,7 @@ Return Value:
             ShortEntryOffset = EntryOffset + EntriesRead - 1;
             Status = FatpAllocateClusterForEmptyFile(Volume,
                                                      &DirectoryContext,
-                                                     File->SeekTable[0],
+                                                     File->FirstCluster,
                                                      &FatDirectoryEntry,
                                                      ShortEntryOffset);
 
@@ -2758,6 +2790,7 @@ Return Value:
     ULONGLONG ClusterAlignedDestination;
     ULONG ClusterBad;
     ULONGLONG ClusterEnd;
+    ULONG ClusterShift;
     ULONG ClusterSize;
     ULONGLONG ClusterStart;
     ULONG CurrentCluster;
@@ -2767,10 +2800,9 @@ Return Value:
     ULONGLONG DiskByteOffset;
     PFAT_FILE File;
     ULONGLONG FileByteOffset;
+    ULONG FileCluster;
     ULONG PreviousCluster;
-    ULONG PreviousTableIndex;
     KSTATUS Status;
-    ULONG TableIndex;
     PFAT_VOLUME Volume;
     PVOID Window;
     ULONG WindowIndex;
@@ -2781,6 +2813,7 @@ Return Value:
     BlockShift = Volume->BlockShift;
     BlockSize = Volume->Device.BlockSize;
     ClusterBad = Volume->ClusterBad;
+    ClusterShift = Volume->ClusterShift;
     ClusterSize = Volume->ClusterSize;
     FileByteOffset = FatSeekInformation->FileByteOffset;
     Status = STATUS_SUCCESS;
@@ -2869,15 +2902,15 @@ Return Value:
             // end of the file.
             //
 
-            if ((File->SeekTable[0] == FAT_CLUSTER_FREE) ||
-                (File->SeekTable[0] >= Volume->ClusterCount)) {
+            if ((File->FirstCluster == FAT_CLUSTER_FREE) ||
+                (File->FirstCluster >= Volume->ClusterCount)) {
 
                 Status = STATUS_END_OF_FILE;
                 goto FatFileSeekEnd;
             }
 
-            FatSeekInformation->CurrentCluster = File->SeekTable[0];
-            ByteOffset = FAT_CLUSTER_TO_BYTE(File->Volume, File->SeekTable[0]);
+            FatSeekInformation->CurrentCluster = File->FirstCluster;
+            ByteOffset = FAT_CLUSTER_TO_BYTE(File->Volume, File->FirstCluster);
             FatSeekInformation->CurrentBlock = ByteOffset >> BlockShift;
 
             ASSERT(IS_ALIGNED(ByteOffset, BlockSize) != FALSE);
@@ -2915,19 +2948,32 @@ Return Value:
     }
 
     //
-    // Get the nearest seek table index, and march down until a seek table
-    // entry is filled in. The first one is guaranteed to be filled in.
+    // Look the destination cluster up in the extent map. If it is beyond the
+    // mapped portion of the file, start walking the chain from the last
+    // mapped cluster.
     //
 
-    ASSERT(File->SeekTable[0] != 0);
+    ClusterAlignedDestination = ALIGN_RANGE_DOWN(DestinationOffset,
+                                                 ClusterSize);
 
-    TableIndex = FAT_SEEK_TABLE_INDEX(DestinationOffset);
-    while (File->SeekTable[TableIndex] == 0) {
-        TableIndex -= 1;
-    }
+    FileCluster = ClusterAlignedDestination >> ClusterShift;
+    if (FatpLookupFileExtent(File, FileCluster, &CurrentCluster, NULL) !=
+        FALSE) {
+
+        CurrentOffset = ClusterAlignedDestination;
+
+    } else if (File->MappedClusterCount != 0) {
+        FileCluster = File->MappedClusterCount - 1;
+        FatpLookupFileExtent(File, FileCluster, &CurrentCluster, NULL);
+        CurrentOffset = (ULONGLONG)FileCluster << ClusterShift;
+
+    } else {
 
-    CurrentOffset = FAT_SEEK_TABLE_OFFSET(TableIndex);
-    CurrentCluster = File->SeekTable[TableIndex];
+        ASSERT(File->FirstCluster != 0);
+
+        CurrentOffset = 0;
+        CurrentCluster = File->FirstCluster;
+    }
 
     ASSERT((CurrentCluster >= FAT_CLUSTER_BEGIN) &&
            (CurrentCluster < Volume->ClusterCount));
@@ -2955,11 +3001,7 @@ Return Value:
     // Cruise the singly linked list of clusters.
     //
 
-    ClusterAlignedDestination = ALIGN_RANGE_DOWN(DestinationOffset,
-                                                 ClusterSize);
-
     PreviousCluster = CurrentCluster;
-    PreviousTableIndex = TableIndex;
     CurrentWindowIndex = MAX_ULONG;
     while (CurrentOffset < ClusterAlignedDestination) {
 
@@ -3032,23 +3074,12 @@ Return Value:
         }
 
         //
-        // Populate the seek table.
+        // Extend the extent map.
         //
 
-        TableIndex = FAT_SEEK_TABLE_INDEX(CurrentOffset);
-        if (TableIndex != PreviousTableIndex) {
-            if ((CurrentOffset & FAT_SEEK_OFFSET_MASK) == 0) {
-
-                ASSERT((File->SeekTable[TableIndex] == 0) ||
-                       (File->SeekTable[TableIndex] == CurrentCluster));
-
-                ASSERT(CurrentCluster != 0);
-
-                File->SeekTable[TableIndex] = CurrentCluster;
-            }
-
-            PreviousTableIndex = TableIndex;
-        }
+        FatpRecordFileCluster(File,
+                              (ULONG)(CurrentOffset >> ClusterShift),
+                              CurrentCluster);
 
         PreviousCluster = CurrentCluster;
     }
@@ -3398,10 +3429,10 @@ Return Value:
     PFAT_VOLUME FatVolume;
     PFAT_FILE File;
     KSTATUS FlushStatus;
+    ULONG KeptClusterCount;
     ULONG NextCluster;
     ULONG StartingCluster;
     KSTATUS Status;
-    ULONG TableIndex;
     BOOL VolumeLockHeld;
 
     ASSERT((Truncate != FALSE) || (FileSize == 0));
@@ -3413,6 +3444,21 @@ Return Value:
     StartingCluster = (ULONG)FileId;
     VolumeLockHeld = FALSE;
 
+    //
+    // A truncate always keeps the first cluster, as it is the file ID.
+    //
+
+    KeptClusterCount = 0;
+    if (Truncate != FALSE) {
+        KeptClusterCount = (ULONG)(ALIGN_RANGE_UP(FileSize,
+                                                  FatVolume->ClusterSize) >>
+                                   FatVolume->ClusterShift);
+
+        if (KeptClusterCount == 0) {
+            KeptClusterCount = 1;
+        }
+    }
+
     ASSERT((StartingCluster == FileId) &&
            (StartingCluster >= FAT_CLUSTER_BEGIN) &&
            (StartingCluster < FatVolume->ClusterCount));
@@ -3494,17 +3540,11 @@ Return Value:
     }
 
     //
-    // Clean out the seek table if a file was provided.
+    // Drop the freed clusters from the extent map if a file was provided.
     //
 
     if (File != NULL) {
-        TableIndex = FAT_SEEK_TABLE_INDEX(FileSize);
-        if ((TableIndex == 0) && (Truncate != FALSE)) {
-            TableIndex = 1;
-        }
-
-        RtlZeroMemory(&(File->SeekTable[TableIndex]),
-                      (FAT_SEEK_TABLE_SIZE - TableIndex) * FAT32_CLUSTER_WIDTH);
+        FatpTrimFileExtents(File, KeptClusterCount);
     }
 
     //
@@ -3751,9 +3791,11 @@ Return Value:
 
 {
 
+    ULONG AllocatedCount;
     ULONG Cluster;
     ULONG ClusterCount;
     ULONGLONG CurrentSize;
+    ULONGLONG DesiredCount;
     BOOL Dirty;
     PFAT_VOLUME FatVolume;
     ULONG NextCluster;
@@ -3774,13 +3816,36 @@ Return Value:
             return Status;
         }
 
+        //
+        // At the end of the chain, allocate the rest of the file in as few
+        // runs as possible.
+        //
+
         if (NextCluster >= ClusterCount) {
-            Status = FatpAllocateCluster(Volume, Cluster, &NextCluster, FALSE);
+            DesiredCount = FileSize - CurrentSize;
+            DesiredCount = ALIGN_RANGE_UP(DesiredCount,
+                                          FatVolume->ClusterSize);
+
+            DesiredCount >>= FatVolume->ClusterShift;
+            if (DesiredCount > ClusterCount) {
+                DesiredCount = ClusterCount;
+            }
+
+            Status = FatpAllocateClusterRun(Volume,
+                                            Cluster,
+                                            (ULONG)DesiredCount,
+                                            &NextCluster,
+                                            &AllocatedCount,
+                                            FALSE);
+
             if (!KSUCCESS(Status)) {
                 return Status;
             }
 
             Dirty = TRUE;
+            Cluster = NextCluster + AllocatedCount - 1;
+            CurrentSize += (ULONGLONG)AllocatedCount << FatVolume->ClusterShift;
+            continue;
         }
 
         Cluster = NextCluster;
@@ -3870,17 +3935,21 @@ Return Value:
     ULONG ClusterShift;
     ULONG ClusterSize;
     ULONG CurrentCluster;
+    ULONG DesiredCount;
     PFAT_FILE File;
     ULONGLONG FileByteOffset;
+    ULONG FileCluster;
     KSTATUS FlushStatus;
+    ULONG Index;
     UINTN MaxContiguousBytes;
     ULONG NewCluster;
     BOOL NewTerritory;
     ULONG NextCluster;
+    UINTN RunBytes;
+    ULONG RunLength;
     PFAT_IO_BUFFER ScratchIoBuffer;
     BOOL ScratchLockHeld;
     KSTATUS Status;
-    ULONG TableIndex;
     UINTN TotalBytesProcessed;
     PFAT_VOLUME Volume;
 
@@ -3931,7 +4000,7 @@ Return Value:
             // ID.
             //
 
-            if (File->SeekTable[0] == FAT_CLUSTER_FREE) {
+            if (File->FirstCluster == FAT_CLUSTER_FREE) {
 
                 ASSERT(FALSE);
 
@@ -3939,8 +4008,8 @@ Return Value:
                 goto PerformFileIoEnd;
             }
 
-            if ((File->SeekTable[0] < FAT_CLUSTER_BEGIN) ||
-                (File->SeekTable[0] >= ClusterBad)) {
+            if ((File->FirstCluster < FAT_CLUSTER_BEGIN) ||
+                (File->FirstCluster >= ClusterBad)) {
 
                 Status = STATUS_FILE_CORRUPT;
                 goto PerformFileIoEnd;
@@ -3951,8 +4020,8 @@ Return Value:
             // the file.
             //
 
-            FatSeekInformation->CurrentCluster = File->SeekTable[0];
-            ByteOffset = FAT_CLUSTER_TO_BYTE(Volume, File->SeekTable[0]);
+            FatSeekInformation->CurrentCluster = File->FirstCluster;
+            ByteOffset = FAT_CLUSTER_TO_BYTE(Volume, File->FirstCluster);
             FatSeekInformation->CurrentBlock = ByteOffset >> BlockShift;
 
             ASSERT(IS_ALIGNED(ByteOffset, BlockSize) != FALSE);
@@ -3969,14 +4038,20 @@ Return Value:
     } else if (FatSeekInformation->ClusterByteOffset >= ClusterSize) {
 
         ASSERT(FatSeekInformation->ClusterByteOffset == ClusterSize);
+        ASSERT(IS_ALIGNED(FatSeekInformation->FileByteOffset, ClusterSize));
 
-        Status = FatpGetNextCluster(Volume,
-                                    IoFlags,
-                                    FatSeekInformation->CurrentCluster,
-                                    &NextCluster);
+        FileCluster = FatSeekInformation->FileByteOffset >> ClusterShift;
+        if (FatpLookupFileExtent(File, FileCluster, &NextCluster, NULL) ==
+            FALSE) {
 
-        if (!KSUCCESS(Status)) {
-            goto PerformFileIoEnd;
+            Status = FatpGetNextCluster(Volume,
+                                        IoFlags,
+                                        FatSeekInformation->CurrentCluster,
+                                        &NextCluster);
+
+            if (!KSUCCESS(Status)) {
+                goto PerformFileIoEnd;
+            }
         }
 
         //
@@ -4035,20 +4110,12 @@ Return Value:
         FatSeekInformation->ClusterByteOffset = 0;
 
         //
-        // Populate the seek table.
+        // Extend the extent map.
         //
 
-        TableIndex = FAT_SEEK_TABLE_INDEX(FatSeekInformation->FileByteOffset);
-        if ((FatSeekInformation->FileByteOffset & FAT_SEEK_OFFSET_MASK) == 0) {
-
-            ASSERT((File->SeekTable[TableIndex] == 0) ||
-                   (File->SeekTable[TableIndex] ==
-                    FatSeekInformation->CurrentCluster));
-
-            ASSERT(FatSeekInformation->CurrentCluster != 0);
-
-            File->SeekTable[TableIndex] = FatSeekInformation->CurrentCluster;
-        }
+        FatpRecordFileCluster(File,
+                              FileCluster,
+                              FatSeekInformation->CurrentCluster);
     }
 
     ASSERT(FatSeekInformation->CurrentBlock != 0);
@@ -4074,6 +4141,34 @@ Return Value:
             CurrentCluster = FatSeekInformation->CurrentCluster;
             FileByteOffset = FatSeekInformation->FileByteOffset;
             while (MaxContiguousBytes < SizeInBytes) {
+
+                //
+                // If the extent map knows the next cluster, take as much of
+                // its run as is needed in one step.
+                //
+
+                FileCluster = (ULONG)(FileByteOffset >> ClusterShift) + 1;
+                if (FatpLookupFileExtent(File,
+                                         FileCluster,
+                                         &NextCluster,
+                                         &RunLength) != FALSE) {
+
+                    if (NextCluster != (CurrentCluster + 1)) {
+                        break;
+                    }
+
+                    RunBytes = SizeInBytes - MaxContiguousBytes;
+                    RunBytes = ALIGN_RANGE_UP(RunBytes, ClusterSize);
+                    if (RunBytes > ((UINTN)RunLength << ClusterShift)) {
+                        RunBytes = (UINTN)RunLength << ClusterShift;
+                    }
+
+                    MaxContiguousBytes += RunBytes;
+                    CurrentCluster += (ULONG)(RunBytes >> ClusterShift);
+                    FileByteOffset += RunBytes;
+                    continue;
+                }
+
                 Status = FatpGetNextCluster(Volume,
                                             IoFlags,
                                             CurrentCluster,
@@ -4098,19 +4193,37 @@ Return Value:
                     ASSERT((IoFlags & IO_FLAG_NO_ALLOCATE) == 0);
                     ASSERT((File->OpenFlags & OPEN_FLAG_PAGE_FILE) == 0);
 
-                    Status = FatpAllocateCluster(Volume,
-                                                 CurrentCluster,
-                                                 &NewCluster,
-                                                 FALSE);
+                    //
+                    // Allocate enough clusters for the rest of the transfer
+                    // at once and map them all. The extent lookup above then
+                    // consumes however much of the run is contiguous.
+                    //
+
+                    RunBytes = SizeInBytes - MaxContiguousBytes;
+                    RunBytes = ALIGN_RANGE_UP(RunBytes, ClusterSize);
+                    DesiredCount = (ULONG)(RunBytes >> ClusterShift);
+                    Status = FatpAllocateClusterRun(Volume,
+                                                    CurrentCluster,
+                                                    DesiredCount,
+                                                    &NewCluster,
+                                                    &RunLength,
+                                                    FALSE);
 
                     if (!KSUCCESS(Status)) {
                         goto PerformFileIoEnd;
                     }
 
                     NewTerritory = TRUE;
-                    NextCluster = NewCluster;
+                    for (Index = 0; Index < RunLength; Index += 1) {
+                        FatpRecordFileCluster(File,
+                                              FileCluster + Index,
+                                              NewCluster + Index);
+                    }
+
+                    continue;
                 }
 
+                FatpRecordFileCluster(File, FileCluster, NextCluster);
                 if (NextCluster != (CurrentCluster + 1)) {
                     break;
                 }
@@ -4118,21 +4231,6 @@ Return Value:
                 MaxContiguousBytes += ClusterSize;
                 CurrentCluster = NextCluster;
                 FileByteOffset += ClusterSize;
-
-                //
-                // Populate the seek table.
-                //
-
-                TableIndex = FAT_SEEK_TABLE_INDEX(FileByteOffset);
-                if ((FileByteOffset & FAT_SEEK_OFFSET_MASK) == 0) {
-
-                    ASSERT((File->SeekTable[TableIndex] == 0) ||
-                           (File->SeekTable[TableIndex] == CurrentCluster));
-
-                    ASSERT(CurrentCluster != 0);
-
-                    File->SeekTable[TableIndex] = CurrentCluster;
-                }
             }
         }
 
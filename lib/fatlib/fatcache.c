@@ -38,6 +38,19 @@ Environment:
 // --------------------------------------------------------------------- Macros
 //
 
+//
+// These macros test, set, and clear a cluster's bit in the allocation bitmap.
+//
+
+#define FAT_BITMAP_TEST(_Bitmap, _Cluster) \
+    (((_Bitmap)[(_Cluster) >> 5] & (1 << ((_Cluster) & 31))) != 0)
+
+#define FAT_BITMAP_SET(_Bitmap, _Cluster) \
+    ((_Bitmap)[(_Cluster) >> 5] |= (1 << ((_Cluster) & 31)))
+
+#define FAT_BITMAP_CLEAR(_Bitmap, _Cluster) \
+    ((_Bitmap)[(_Cluster) >> 5] &= ~(1 << ((_Cluster) & 31)))
+
 //
 // ---------------------------------------------------------------- Definitions
 //
@@ -66,12 +79,28 @@ FatpFatCacheReadWindow (
     );
 
 KSTATUS
-FatpFatCacheWriteWindow (
+FatpFatCacheWriteBlocks (
     PFAT_VOLUME Volume,
     ULONG IoFlags,
+    ULONG Block,
+    ULONG BlockCount,
+    PFAT_IO_BUFFER *StagingBuffer
+    );
+
+VOID
+FatpFatCacheFillAllocationBitmap (
+    PFAT_VOLUME Volume,
     ULONG WindowIndex
     );
 
+ULONG
+FatpFatCacheFindBit (
+    PULONG Bitmap,
+    ULONG Start,
+    ULONG End,
+    BOOL Set
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -104,11 +133,15 @@ Return Value:
 {
 
     ULONG AllocationSize;
+    PULONG Bitmap;
+    ULONG BitmapSize;
+    ULONG Cluster;
+    ULONG ClusterCount;
     PVOID DeviceToken;
+    ULONG DirtyBitmapSize;
     ULONGLONG FatSize;
     KSTATUS Status;
     ULONG WindowCount;
-    ULONG WindowIndex;
     ULONG WindowSize;
 
     //
@@ -146,11 +179,17 @@ Return Value:
 
     //
     // Allocate the window array and initialize it to have no present windows.
+    // The dirty block bitmap and the allocation bitmap ride along at the end.
     //
 
+    ClusterCount = Volume->ClusterCount;
+    BitmapSize = ALIGN_RANGE_UP(ClusterCount, 32) / 8;
+    DirtyBitmapSize = WindowCount * (WindowSize >> Volume->BlockShift);
+    DirtyBitmapSize = ALIGN_RANGE_UP(DirtyBitmapSize, 32) / 8;
     AllocationSize = (WindowCount * sizeof(PFAT_IO_BUFFER)) +
                      (WindowCount * sizeof(PVOID)) +
-                     (WindowCount * sizeof(FAT_WINDOW_DIRTY_REGION));
+                     DirtyBitmapSize +
+                     BitmapSize;
 
     DeviceToken = Volume->Device.DeviceToken;
     Volume->FatCache.WindowBuffers = FatAllocateNonPagedMemory(DeviceToken,
@@ -165,11 +204,23 @@ Return Value:
     Volume->FatCache.Windows = (PVOID *)(Volume->FatCache.WindowBuffers +
                                          WindowCount);
 
-    Volume->FatCache.Dirty =
-            (PFAT_WINDOW_DIRTY_REGION)(Volume->FatCache.Windows + WindowCount);
+    Volume->FatCache.DirtyBitmap =
+                             (PULONG)(Volume->FatCache.Windows + WindowCount);
 
-    for (WindowIndex = 0; WindowIndex < WindowCount; WindowIndex += 1) {
-        Volume->FatCache.Dirty[WindowIndex].Min = WindowSize;
+    //
+    // The two reserved clusters and the padding past the end of the FAT are
+    // never free.
+    //
+
+    Bitmap = Volume->FatCache.DirtyBitmap + (DirtyBitmapSize / sizeof(ULONG));
+    Volume->FatCache.AllocationBitmap = Bitmap;
+    FAT_BITMAP_SET(Bitmap, 0);
+    FAT_BITMAP_SET(Bitmap, 1);
+    for (Cluster = ClusterCount;
+         Cluster < ALIGN_RANGE_UP(ClusterCount, 32);
+         Cluster += 1) {
+
+        FAT_BITMAP_SET(Bitmap, Cluster);
     }
 
     Volume->FatCache.DirtyStart = MAX_ULONG;
@@ -489,9 +540,11 @@ Return Value:
 
 {
 
+    ULONG Block;
     ULONG EndOffset;
     PFAT_CACHE FatCache;
     PVOID FatWindow;
+    ULONG LastBlock;
     ULONG Original;
     ULONG StartOffset;
     KSTATUS Status;
@@ -585,16 +638,27 @@ Return Value:
         ((PULONG)FatWindow)[WindowOffset] = NewValue;
     }
 
+    if (NewValue == FAT_CLUSTER_FREE) {
+        FAT_BITMAP_CLEAR(FatCache->AllocationBitmap, Cluster);
+
+    } else {
+        FAT_BITMAP_SET(FatCache->AllocationBitmap, Cluster);
+    }
+
     //
-    // Mark the region in the window that's dirty.
+    // Mark the blocks holding the entry dirty. A FAT12 entry can straddle two
+    // blocks.
     //
 
-    if (FatCache->Dirty[WindowIndex].Min > StartOffset) {
-        FatCache->Dirty[WindowIndex].Min = StartOffset;
-    }
+    Block = ((WindowIndex << FatCache->WindowShift) + StartOffset) >>
+            Volume->BlockShift;
+
+    LastBlock = ((WindowIndex << FatCache->WindowShift) + EndOffset - 1) >>
+                Volume->BlockShift;
 
-    if (FatCache->Dirty[WindowIndex].Max < EndOffset) {
-        FatCache->Dirty[WindowIndex].Max = EndOffset;
+    while (Block <= LastBlock) {
+        FAT_BITMAP_SET(FatCache->DirtyBitmap, Block);
+        Block += 1;
     }
 
     //
@@ -615,6 +679,161 @@ FatCacheWriteNextClusterEnd:
     return Status;
 }
 
+KSTATUS
+FatpFatCacheFindFreeRun (
+    PFAT_VOLUME Volume,
+    ULONG SearchStart,
+    ULONG DesiredCount,
+    PULONG RunStart,
+    PULONG RunLength
+    )
+
+/*++
+
+Routine Description:
+
+    This routine searches the FAT allocation bitmap for a run of free clusters,
+    reading in FAT windows as needed. The first free cluster at or after the
+    search start (wrapping around to the beginning of the FAT) begins the run,
+    which is then extended up to the desired count. This routine assumes the
+    volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    SearchStart - Supplies the cluster to begin searching at.
+
+    DesiredCount - Supplies the maximum number of clusters wanted in the run.
+
+    RunStart - Supplies a pointer where the first free cluster of the run will
+        be returned.
+
+    RunLength - Supplies a pointer where the number of free clusters in the
+        run will be returned. This will be between one and the desired count.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_VOLUME_FULL if no free clusters exist.
+
+    Other error codes on device I/O errors.
+
+--*/
+
+{
+
+    PULONG Bitmap;
+    ULONG Cluster;
+    ULONG ClusterCount;
+    ULONG End;
+    ULONG Length;
+    ULONG Limit;
+    ULONG RunEnd;
+    KSTATUS Status;
+    PVOID Window;
+    ULONG WindowEnd;
+    ULONG WindowOffset;
+    ULONG WindowSize;
+    BOOL Wrapped;
+
+    ASSERT(DesiredCount != 0);
+
+    Bitmap = Volume->FatCache.AllocationBitmap;
+    ClusterCount = Volume->ClusterCount;
+    WindowSize = FAT_WINDOW_INDEX_TO_CLUSTER(Volume, 1);
+    if ((SearchStart < FAT_CLUSTER_BEGIN) || (SearchStart >= ClusterCount)) {
+        SearchStart = FAT_CLUSTER_BEGIN;
+    }
+
+    //
+    // Find the first free cluster, one window at a time. The bits for a window
+    // are only valid once the window is present.
+    //
+
+    Cluster = SearchStart;
+    End = ClusterCount;
+    Wrapped = FALSE;
+    while (TRUE) {
+        if (Cluster >= End) {
+            if ((Wrapped != FALSE) || (SearchStart == FAT_CLUSTER_BEGIN)) {
+                Status = STATUS_VOLUME_FULL;
+                goto FatCacheFindFreeRunEnd;
+            }
+
+            Cluster = FAT_CLUSTER_BEGIN;
+            End = SearchStart;
+            Wrapped = TRUE;
+            continue;
+        }
+
+        Status = FatpFatCacheGetFatWindow(Volume,
+                                          TRUE,
+                                          Cluster,
+                                          &Window,
+                                          &WindowOffset);
+
+        if (!KSUCCESS(Status)) {
+            goto FatCacheFindFreeRunEnd;
+        }
+
+        WindowEnd = Cluster - WindowOffset + WindowSize;
+        if (WindowEnd > End) {
+            WindowEnd = End;
+        }
+
+        Cluster = FatpFatCacheFindBit(Bitmap, Cluster, WindowEnd, FALSE);
+        if (Cluster < WindowEnd) {
+            break;
+        }
+    }
+
+    //
+    // Extend the run as far as it goes, crossing into the following windows
+    // if needed.
+    //
+
+    *RunStart = Cluster;
+    Length = 0;
+    while ((Length < DesiredCount) && (Cluster < ClusterCount)) {
+        Status = FatpFatCacheGetFatWindow(Volume,
+                                          TRUE,
+                                          Cluster,
+                                          &Window,
+                                          &WindowOffset);
+
+        if (!KSUCCESS(Status)) {
+            goto FatCacheFindFreeRunEnd;
+        }
+
+        Limit = Cluster - WindowOffset + WindowSize;
+        if (Limit > ClusterCount) {
+            Limit = ClusterCount;
+        }
+
+        if (Limit - Cluster > DesiredCount - Length) {
+            Limit = Cluster + (DesiredCount - Length);
+        }
+
+        RunEnd = FatpFatCacheFindBit(Bitmap, Cluster, Limit, TRUE);
+        Length += RunEnd - Cluster;
+        if (RunEnd < Limit) {
+            break;
+        }
+
+        Cluster = RunEnd;
+    }
+
+    ASSERT(Length != 0);
+
+    *RunLength = Length;
+    Status = STATUS_SUCCESS;
+
+FatCacheFindFreeRunEnd:
+    return Status;
+}
+
 KSTATUS
 FatpFatCacheFlush (
     PFAT_VOLUME Volume,
@@ -643,42 +862,80 @@ Return Value:
 
 {
 
+    ULONG Block;
+    ULONG BlockShift;
+    ULONG End;
     PFAT_CACHE FatCache;
+    ULONG MaxRun;
+    ULONG RunEnd;
+    PFAT_IO_BUFFER StagingBuffer;
     KSTATUS Status;
     KSTATUS TotalStatus;
-    ULONG WindowIndex;
 
     TotalStatus = STATUS_SUCCESS;
     FatCache = &(Volume->FatCache);
-    for (WindowIndex = FatCache->DirtyStart;
-         WindowIndex < FatCache->DirtyEnd;
-         WindowIndex += 1) {
+    if (FatCache->DirtyStart >= FatCache->DirtyEnd) {
+        return STATUS_SUCCESS;
+    }
 
-        if (FatCache->Dirty[WindowIndex].Min >
-            FatCache->Dirty[WindowIndex].Max) {
+    //
+    // This is metadata, so don't write it synchronized unless the caller
+    // wants metadata flushed.
+    //
 
-            continue;
-        }
+    if ((IoFlags & IO_FLAG_METADATA_SYNCHRONIZED) == 0) {
+        IoFlags &= ~IO_FLAG_DATA_SYNCHRONIZED;
+    }
 
-        //
-        // This is metadata, so don't write it synchronized unless the
-        // caller wants metadata flushed.
-        //
+    //
+    // Write out each run of dirty blocks with a single write per FAT. Runs
+    // may cross from one window into the next, but are capped at a window's
+    // worth of blocks to bound the staging buffer used to join them.
+    //
 
-        if ((IoFlags & IO_FLAG_METADATA_SYNCHRONIZED) == 0) {
-            IoFlags &= ~IO_FLAG_DATA_SYNCHRONIZED;
+    BlockShift = Volume->BlockShift;
+    MaxRun = FatCache->WindowSize >> BlockShift;
+    Block = (FatCache->DirtyStart << FatCache->WindowShift) >> BlockShift;
+    End = (FatCache->DirtyEnd << FatCache->WindowShift) >> BlockShift;
+    StagingBuffer = NULL;
+    while (Block < End) {
+        Block = FatpFatCacheFindBit(FatCache->DirtyBitmap, Block, End, TRUE);
+        if (Block >= End) {
+            break;
         }
 
-        Status = FatpFatCacheWriteWindow(Volume, IoFlags, WindowIndex);
+        RunEnd = End;
+        if (RunEnd - Block > MaxRun) {
+            RunEnd = Block + MaxRun;
+        }
+
+        RunEnd = FatpFatCacheFindBit(FatCache->DirtyBitmap,
+                                     Block,
+                                     RunEnd,
+                                     FALSE);
+
+        Status = FatpFatCacheWriteBlocks(Volume,
+                                         IoFlags,
+                                         Block,
+                                         RunEnd - Block,
+                                         &StagingBuffer);
+
         if (!KSUCCESS(Status)) {
             TotalStatus = Status;
+            Block = RunEnd;
+            continue;
+        }
 
-        } else {
-            FatCache->Dirty[WindowIndex].Min = FatCache->WindowSize;
-            FatCache->Dirty[WindowIndex].Max = 0;
+        while (Block < RunEnd) {
+            FAT_BITMAP_CLEAR(FatCache->DirtyBitmap, Block);
+            Block += 1;
         }
     }
 
+    if (StagingBuffer != NULL) {
+        FatFreeIoBuffer(StagingBuffer);
+    }
+
     if (KSUCCESS(TotalStatus)) {
         FatCache->DirtyStart = MAX_ULONG;
         FatCache->DirtyEnd = 0;
@@ -781,6 +1038,7 @@ Return Value:
 
         Volume->FatCache.WindowBuffers[WindowIndex] = FatIoBuffer;
         Volume->FatCache.Windows[WindowIndex] = Window;
+        FatpFatCacheFillAllocationBitmap(Volume, WindowIndex);
         FatIoBuffer = NULL;
     }
 
@@ -799,17 +1057,21 @@ FatCacheReadWindowEnd:
 }
 
 KSTATUS
-FatpFatCacheWriteWindow (
+FatpFatCacheWriteBlocks (
     PFAT_VOLUME Volume,
     ULONG IoFlags,
-    ULONG WindowIndex
+    ULONG Block,
+    ULONG BlockCount,
+    PFAT_IO_BUFFER *StagingBuffer
     )
 
 /*++
 
 Routine Description:
 
-    This routine writes out a window of the File Allocation Table.
+    This routine writes a run of blocks of the cached File Allocation Table out
+    to every copy of the FAT on the disk. This routine assumes the volume lock
+    is held.
 
 Arguments:
 
@@ -818,7 +1080,15 @@ Arguments:
     IoFlags - Supplies flags regarding the I/O operation. See IO_FLAG_*
         definitions.
 
-    WindowIndex - Supplies the index of the FAT window that is to be written.
+    Block - Supplies the first block of the run, relative to the start of the
+        FAT.
+
+    BlockCount - Supplies the number of blocks in the run. This must not
+        exceed one window's worth of blocks.
+
+    StagingBuffer - Supplies a pointer to a window sized I/O buffer used to
+        join runs that cross two windows. It is allocated here if needed, and
+        the caller frees it.
 
 Return Value:
 
@@ -829,54 +1099,85 @@ Return Value:
 {
 
     ULONGLONG BlockAddress;
-    UINTN BlockCount;
     ULONG BlockShift;
-    PFAT_WINDOW_DIRTY_REGION Dirty;
-    ULONGLONG DirtyEnd;
-    ULONGLONG DirtyStart;
+    ULONG ByteOffset;
+    ULONG ByteSize;
     PFAT_CACHE FatCache;
     ULONG FatIndex;
     PFAT_IO_BUFFER FatIoBuffer;
     ULONGLONG FatStart;
+    ULONG FirstSize;
+    PUCHAR Staging;
     KSTATUS Status;
+    ULONG WindowIndex;
 
     BlockShift = Volume->BlockShift;
-    FatIoBuffer = Volume->FatCache.WindowBuffers[WindowIndex];
+    FatCache = &(Volume->FatCache);
+    ByteOffset = Block << BlockShift;
+    ByteSize = BlockCount << BlockShift;
+    WindowIndex = ByteOffset >> FatCache->WindowShift;
+    ByteOffset -= WindowIndex << FatCache->WindowShift;
 
-    ASSERT(FatIoBuffer != NULL);
+    ASSERT((BlockCount != 0) && (ByteSize <= FatCache->WindowSize));
+    ASSERT((((ULONGLONG)Block + BlockCount) << BlockShift) <= Volume->FatSize);
 
-    FatCache = &(Volume->FatCache);
-    Dirty = &(FatCache->Dirty[WindowIndex]);
+    //
+    // A run within one window is written straight from the window. A run
+    // that spills into the next window is copied into the staging buffer.
+    //
 
-    ASSERT((Dirty->Min < Dirty->Max) && (Dirty->Max <= FatCache->WindowSize));
+    if (ByteOffset + ByteSize <= FatCache->WindowSize) {
+        FatIoBuffer = FatCache->WindowBuffers[WindowIndex];
 
-    IoFlags |= IO_FLAG_FS_DATA | IO_FLAG_FS_METADATA;
-    DirtyStart = ((WindowIndex << FatCache->WindowShift) + Dirty->Min) >>
-                 BlockShift;
+        ASSERT(FatIoBuffer != NULL);
+
+        FatIoBufferSetOffset(FatIoBuffer, ByteOffset);
 
-    DirtyEnd = (WindowIndex << FatCache->WindowShift) + Dirty->Max;
-    DirtyEnd = ALIGN_RANGE_UP(DirtyEnd, Volume->Device.BlockSize);
+    } else {
+        if (*StagingBuffer == NULL) {
+            *StagingBuffer = FatAllocateIoBuffer(Volume->Device.DeviceToken,
+                                                 FatCache->WindowSize);
+
+            if (*StagingBuffer == NULL) {
+                Status = STATUS_INSUFFICIENT_RESOURCES;
+                goto FatCacheWriteBlocksEnd;
+            }
+        }
 
-    ASSERT(DirtyEnd <= Volume->FatSize);
+        FatIoBuffer = *StagingBuffer;
+        Staging = FatMapIoBuffer(FatIoBuffer);
+        if (Staging == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto FatCacheWriteBlocksEnd;
+        }
 
-    DirtyEnd >>= BlockShift;
-    BlockCount = DirtyEnd - DirtyStart;
+        ASSERT((FatCache->Windows[WindowIndex] != NULL) &&
+               (FatCache->Windows[WindowIndex + 1] != NULL));
 
-    ASSERT(BlockCount != 0);
+        FirstSize = FatCache->WindowSize - ByteOffset;
+        RtlCopyMemory(Staging,
+                      (PUCHAR)FatCache->Windows[WindowIndex] + ByteOffset,
+                      FirstSize);
 
-    FatIoBufferSetOffset(FatIoBuffer, (Dirty->Min >> BlockShift) << BlockShift);
+        RtlCopyMemory(Staging + FirstSize,
+                      FatCache->Windows[WindowIndex + 1],
+                      ByteSize - FirstSize);
+
+        FatIoBufferSetOffset(FatIoBuffer, 0);
+    }
 
     //
-    // Write the result out to each FAT.
+    // Write the run to each FAT back to back.
     //
 
+    IoFlags |= IO_FLAG_FS_DATA | IO_FLAG_FS_METADATA;
     Status = STATUS_VOLUME_CORRUPT;
     for (FatIndex = 0; FatIndex < Volume->FatCount; FatIndex += 1) {
         FatStart = Volume->FatByteStart + (FatIndex * Volume->FatSize);
 
         ASSERT(IS_ALIGNED(FatStart, Volume->Device.BlockSize));
 
-        BlockAddress = (FatStart >> BlockShift) + DirtyStart;
+        BlockAddress = (FatStart >> BlockShift) + Block;
         Status = FatWriteDevice(Volume->Device.DeviceToken,
                                 BlockAddress,
                                 BlockCount,
@@ -885,11 +1186,140 @@ Return Value:
                                 FatIoBuffer);
 
         if (!KSUCCESS(Status)) {
-            goto FatCacheReadWindowEnd;
+            goto FatCacheWriteBlocksEnd;
         }
     }
 
-FatCacheReadWindowEnd:
+FatCacheWriteBlocksEnd:
     return Status;
 }
 
+VOID
+FatpFatCacheFillAllocationBitmap (
+    PFAT_VOLUME Volume,
+    ULONG WindowIndex
+    )
+
+/*++
+
+Routine Description:
+
+    This routine sets the allocation bitmap bits for the clusters covered by a
+    newly read FAT window. This routine assumes the volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    WindowIndex - Supplies the index of the FAT window that was just read.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Base;
+    PULONG Bitmap;
+    ULONG Cluster;
+    ULONG End;
+    ULONG Start;
+    ULONG Value;
+    PVOID Window;
+
+    Bitmap = Volume->FatCache.AllocationBitmap;
+    Window = Volume->FatCache.Windows[WindowIndex];
+    Base = FAT_WINDOW_INDEX_TO_CLUSTER(Volume, WindowIndex);
+    Start = Base;
+    End = FAT_WINDOW_INDEX_TO_CLUSTER(Volume, WindowIndex + 1);
+    if (End > Volume->ClusterCount) {
+        End = Volume->ClusterCount;
+    }
+
+    if (Start < FAT_CLUSTER_BEGIN) {
+        Start = FAT_CLUSTER_BEGIN;
+    }
+
+    for (Cluster = Start; Cluster < End; Cluster += 1) {
+        if (Volume->Format == Fat12Format) {
+            Value = FAT12_READ_CLUSTER(Window, Cluster);
+
+        } else if (Volume->Format == Fat16Format) {
+            Value = ((PUSHORT)Window)[Cluster - Base];
+
+        } else {
+            Value = ((PULONG)Window)[Cluster - Base];
+        }
+
+        if (Value == FAT_CLUSTER_FREE) {
+            FAT_BITMAP_CLEAR(Bitmap, Cluster);
+
+        } else {
+            FAT_BITMAP_SET(Bitmap, Cluster);
+        }
+    }
+
+    return;
+}
+
+ULONG
+FatpFatCacheFindBit (
+    PULONG Bitmap,
+    ULONG Start,
+    ULONG End,
+    BOOL Set
+    )
+
+/*++
+
+Routine Description:
+
+    This routine finds the first bit in the given range of a bitmap that is
+    either set or clear, looking at a whole word at a time.
+
+Arguments:
+
+    Bitmap - Supplies a pointer to the bitmap.
+
+    Start - Supplies the first bit to examine.
+
+    End - Supplies the bit to stop at (exclusive).
+
+    Set - Supplies a boolean indicating whether to look for a set bit (TRUE)
+        or a clear bit (FALSE).
+
+Return Value:
+
+    Returns the index of the first matching bit, or the end if none match.
+
+--*/
+
+{
+
+    ULONG Index;
+    ULONG Word;
+
+    Index = Start;
+    while (Index < End) {
+        Word = Bitmap[Index >> 5];
+        if (Set == FALSE) {
+            Word = ~Word;
+        }
+
+        Word >>= Index & 31;
+        if (Word != 0) {
+            Index += RtlCountTrailingZeros32(Word);
+            if (Index > End) {
+                Index = End;
+            }
+
+            return Index;
+        }
+
+        Index = ALIGN_RANGE_DOWN(Index, 32) + 32;
+    }
+
+    return End;
+}
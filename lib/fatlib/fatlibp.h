@@ -69,18 +69,6 @@ Author:
     (((_WindowIndex) << (_Volume)->FatCache.WindowShift) >>     \
      (_Volume)->ClusterWidthShift)
 
-//
-// This macro gets the closest seek table entry for the given file offset.
-//
-
-#define FAT_SEEK_TABLE_INDEX(_Offset) ((_Offset) >> FAT_SEEK_OFFSET_SHIFT)
-
-//
-// This macro converts a seek table index back into an offset.
-//
-
-#define FAT_SEEK_TABLE_OFFSET(_Index) ((_Index) << FAT_SEEK_OFFSET_SHIFT)
-
 //
 // ---------------------------------------------------------------- Definitions
 //
@@ -93,14 +81,18 @@ Author:
 #define FAT_DIRECTORY_FLAG_POSITION_AT_END 0x00000002
 
 //
-// Define the number of seek table entries to keep across the entire
-// theoretical 4GB file.
+// Define the number of extents a file's extent map is first allocated with.
+// The array doubles each time it fills up.
+//
+
+#define FAT_FILE_INITIAL_EXTENT_CAPACITY 8
+
+//
+// Define the maximum number of bytes the directory entry caches of a single
+// volume may consume together.
 //
 
-#define FAT_SEEK_TABLE_SHIFT 6
-#define FAT_SEEK_TABLE_SIZE (1UL << FAT_SEEK_TABLE_SHIFT)
-#define FAT_SEEK_OFFSET_SHIFT (32 - FAT_SEEK_TABLE_SHIFT)
-#define FAT_SEEK_OFFSET_MASK ((1UL << FAT_SEEK_OFFSET_SHIFT) - 1)
+#define FAT_DIRECTORY_CACHE_MAX_SIZE (1024 * 1024)
 
 //
 // Define bits in the encoded non-standard permissions field.
@@ -128,25 +120,6 @@ Author:
 
 /*++
 
-Structure Description:
-
-    This structure stores the dirty region for a particular FAT window.
-
-Members:
-
-    Min - Stores the minimum offset that's dirty.
-
-    Max - Stores the maximum offset that's dirty.
-
---*/
-
-typedef struct _FAT_WINDOW_DIRTY_REGION {
-    ULONG Min;
-    ULONG Max;
-} FAT_WINDOW_DIRTY_REGION, *PFAT_WINDOW_DIRTY_REGION;
-
-/*++
-
 Structure Description:
 
     This structure defines the cache for the File Allocation Table.
@@ -159,7 +132,8 @@ Members:
     Windows - Stores an array of pointers to virtually contiguous mappings of
         the I/O buffers that store windows into the File Allocation Table.
 
-    Dirty - Stores an array of the region that is dirty in each window.
+    DirtyBitmap - Stores a bitmap with one bit per block of the cached FAT,
+        set if the block has been modified since it was last written out.
 
     DirtyStart - Stores the starting index (inclusive) of the dirty FAT windows.
 
@@ -171,17 +145,22 @@ Members:
 
     WindowShift - Stores the number of bits in the window size.
 
+    AllocationBitmap - Stores a bitmap with one bit per cluster, set if the
+        cluster's FAT entry is in use. The bits for a window are filled in when
+        the window is read, so they are only valid for present windows.
+
 --*/
 
 typedef struct _FAT_CACHE {
     PFAT_IO_BUFFER *WindowBuffers;
     PVOID *Windows;
-    PFAT_WINDOW_DIRTY_REGION Dirty;
+    PULONG DirtyBitmap;
     ULONG DirtyStart;
     ULONG DirtyEnd;
     ULONG WindowCount;
     ULONG WindowSize;
     ULONG WindowShift;
+    PULONG AllocationBitmap;
 } FAT_CACHE, *PFAT_CACHE;
 
 /*++
@@ -265,6 +244,12 @@ Members:
     FatCache - Stores the File Allocation Table cache. This is used for cluster
         allocation and next cluster lookup during seek, read, and write.
 
+    DirectoryCacheList - Stores the head of the list of directory entry
+        caches, in most recently used order.
+
+    DirectoryCacheSize - Stores the number of bytes consumed by all directory
+        entry caches on the volume.
+
 --*/
 
 typedef struct _FAT_VOLUME {
@@ -292,10 +277,37 @@ typedef struct _FAT_VOLUME {
     PVOID Lock;
     RED_BLACK_TREE FileMappingTree;
     FAT_CACHE FatCache;
+    LIST_ENTRY DirectoryCacheList;
+    UINTN DirectoryCacheSize;
 } FAT_VOLUME, *PFAT_VOLUME;
 
 /*++
 
+Structure Description:
+
+    This structure defines a run of clusters that are contiguous both in a
+    file and on the volume.
+
+Members:
+
+    FileCluster - Stores the index within the file of the first cluster in
+        the run.
+
+    Cluster - Stores the volume cluster number of the first cluster in the
+        run.
+
+    Length - Stores the number of clusters in the run.
+
+--*/
+
+typedef struct _FAT_FILE_EXTENT {
+    ULONG FileCluster;
+    ULONG Cluster;
+    ULONG Length;
+} FAT_FILE_EXTENT, *PFAT_FILE_EXTENT;
+
+/*++
+
 Structure Description:
 
     This structure defines file system state associated with an open file.
@@ -321,9 +333,19 @@ Members:
         guaranteed to be at least 512 bytes large. This should only be used
         for page file operations.
 
-    SeekTable - Stores cluster numbers for file offsets spread evenly through
-        out the maximum theoretical file size of 4GB. The first value is file
-        offset 0, and is always filled in.
+    FirstCluster - Stores the first cluster of the file.
+
+    Extents - Stores a pointer to the file's extent map, an array of cluster
+        runs sorted by file cluster. The map always describes an unbroken
+        prefix of the file's cluster chain, and is extended lazily as the
+        chain is walked.
+
+    ExtentCount - Stores the number of valid elements in the extent array.
+
+    ExtentCapacity - Stores the number of elements the extent array can hold.
+
+    MappedClusterCount - Stores the number of clusters, starting from the
+        beginning of the file, described by the extent map.
 
 --*/
 
@@ -333,7 +355,11 @@ typedef struct _FAT_FILE {
     BOOL IsRootDirectory;
     PVOID ScratchIoBufferLock;
     PFAT_IO_BUFFER ScratchIoBuffer;
-    ULONG SeekTable[FAT_SEEK_TABLE_SIZE];
+    ULONG FirstCluster;
+    PFAT_FILE_EXTENT Extents;
+    ULONG ExtentCount;
+    ULONG ExtentCapacity;
+    ULONG MappedClusterCount;
 } FAT_FILE, *PFAT_FILE;
 
 /*++
@@ -665,6 +691,56 @@ Return Value:
 
 --*/
 
+KSTATUS
+FatpAllocateClusterRun (
+    PFAT_VOLUME Volume,
+    ULONG PreviousCluster,
+    ULONG DesiredCount,
+    PULONG NewCluster,
+    PULONG AllocatedCount,
+    BOOL Flush
+    );
+
+/*++
+
+Routine Description:
+
+    This routine allocates a run of contiguous free clusters, chains them
+    together, and chains the run so that the specified previous cluster points
+    to its first cluster. Fewer clusters than desired may be allocated if no
+    free run is long enough.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    PreviousCluster - Supplies the cluster that should point to the newly
+        allocated run. Specify FAT32_CLUSTER_END if no previous cluster should
+        be updated.
+
+    DesiredCount - Supplies the number of clusters wanted. This must not be
+        zero.
+
+    NewCluster - Supplies a pointer that will receive the first cluster of the
+        run.
+
+    AllocatedCount - Supplies a pointer that will receive the number of
+        clusters allocated.
+
+    Flush - Supplies a boolean indicating if the FAT cache should be flushed.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_INVALID_PARAMETER if an invalid cluster was supplied.
+
+    STATUS_VOLUME_FULL if no free clusters exist.
+
+    Other error codes on device I/O errors.
+
+--*/
+
 KSTATUS
 FatpFreeClusterChain (
     PFAT_VOLUME Volume,
@@ -693,6 +769,120 @@ Return Value:
 
 --*/
 
+BOOL
+FatpLookupFileExtent (
+    PFAT_FILE File,
+    ULONG FileCluster,
+    PULONG Cluster,
+    PULONG RunLength
+    );
+
+/*++
+
+Routine Description:
+
+    This routine looks up the volume cluster backing a cluster of a file in
+    the file's extent map.
+
+Arguments:
+
+    File - Supplies a pointer to the open file.
+
+    FileCluster - Supplies the index of the cluster within the file.
+
+    Cluster - Supplies a pointer where the volume cluster number will be
+        returned on success.
+
+    RunLength - Supplies an optional pointer where the number of contiguous
+        clusters starting at the returned cluster will be returned, including
+        the returned cluster itself.
+
+Return Value:
+
+    TRUE if the file cluster is described by the extent map.
+
+    FALSE if the file cluster is beyond the mapped portion of the file. The
+    cluster chain must be walked from the last mapped cluster.
+
+--*/
+
+VOID
+FatpRecordFileCluster (
+    PFAT_FILE File,
+    ULONG FileCluster,
+    ULONG Cluster
+    );
+
+/*++
+
+Routine Description:
+
+    This routine adds a cluster discovered while walking a file's cluster
+    chain to the file's extent map. Only the cluster immediately following
+    the mapped portion of the file is recorded; anything else is ignored.
+
+Arguments:
+
+    File - Supplies a pointer to the open file.
+
+    FileCluster - Supplies the index of the cluster within the file.
+
+    Cluster - Supplies the volume cluster number backing that file cluster.
+
+Return Value:
+
+    None. Failure to allocate space for a new extent simply leaves the map
+    shorter.
+
+--*/
+
+VOID
+FatpTrimFileExtents (
+    PFAT_FILE File,
+    ULONG ClusterCount
+    );
+
+/*++
+
+Routine Description:
+
+    This routine discards the portion of a file's extent map beyond the given
+    number of clusters, usually because the file was truncated.
+
+Arguments:
+
+    File - Supplies a pointer to the open file.
+
+    ClusterCount - Supplies the number of clusters at the start of the file
+        that are still valid.
+
+Return Value:
+
+    None.
+
+--*/
+
+VOID
+FatpDestroyFileExtents (
+    PFAT_FILE File
+    );
+
+/*++
+
+Routine Description:
+
+    This routine frees a file's extent map.
+
+Arguments:
+
+    File - Supplies a pointer to the open file.
+
+Return Value:
+
+    None.
+
+--*/
+
 KSTATUS
 FatpIsDirectoryEmpty (
     PFAT_VOLUME Volume,
@@ -1326,6 +1516,177 @@ Return Value:
 
 --*/
 
+//
+// Directory entry cache support functions.
+//
+
+VOID
+FatpInitializeDirectoryCache (
+    PFAT_VOLUME Volume
+    );
+
+/*++
+
+Routine Description:
+
+    This routine initializes the directory entry cache for the given volume.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+Return Value:
+
+    None.
+
+--*/
+
+VOID
+FatpDestroyDirectoryCache (
+    PFAT_VOLUME Volume
+    );
+
+/*++
+
+Routine Description:
+
+    This routine frees every directory cached on the given volume.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+Return Value:
+
+    None.
+
+--*/
+
+KSTATUS
+FatpDirectoryCacheLookup (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CONTEXT Directory,
+    PCSTR Name,
+    ULONG NameLength,
+    PULONGLONG EntryOffset
+    );
+
+/*++
+
+Routine Description:
+
+    This routine looks up a name in the directory cache, indexing the
+    directory first if it has not been seen before.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    Directory - Supplies a pointer to the directory context for the open
+        directory. The directory position is changed if the directory needs
+        to be indexed.
+
+    Name - Supplies the name of the file or directory to look up.
+
+    NameLength - Supplies the size of the name buffer in bytes, including the
+        null terminator.
+
+    EntryOffset - Supplies a pointer where the offset of the short directory
+        entry for the name will be returned on success.
+
+Return Value:
+
+    STATUS_SUCCESS if the name was found in the cache.
+
+    STATUS_PATH_NOT_FOUND if the directory does not contain the name.
+
+    STATUS_NOT_FOUND if the directory could not be indexed, in which case the
+    caller must search the directory itself.
+
+--*/
+
+VOID
+FatpDirectoryCacheAddEntry (
+    PFAT_DIRECTORY_CONTEXT Directory,
+    ULONGLONG EntryOffset
+    );
+
+/*++
+
+Routine Description:
+
+    This routine adds a newly written directory entry to the directory cache,
+    if the directory is cached. The entry is read back so that the cache holds
+    exactly the name a directory scan would return.
+
+Arguments:
+
+    Directory - Supplies a pointer to the directory context for the modified
+        directory. The directory position is changed.
+
+    EntryOffset - Supplies the offset of the first directory entry (long or
+        short) making up the new name.
+
+Return Value:
+
+    None. On failure the directory is dropped from the cache.
+
+--*/
+
+VOID
+FatpDirectoryCacheRemoveEntry (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster,
+    ULONGLONG EntryOffset
+    );
+
+/*++
+
+Routine Description:
+
+    This routine removes an erased directory entry from the directory cache.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    DirectoryCluster - Supplies the first cluster of the directory that held
+        the entry.
+
+    EntryOffset - Supplies the offset of the short directory entry that was
+        erased.
+
+Return Value:
+
+    None.
+
+--*/
+
+VOID
+FatpInvalidateDirectoryCache (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster
+    );
+
+/*++
+
+Routine Description:
+
+    This routine drops a directory from the directory cache, if it is cached.
+    It will be indexed again the next time a name is looked up in it.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    DirectoryCluster - Supplies the first cluster of the directory.
+
+Return Value:
+
+    None.
+
+--*/
+
 //
 // File Allocation Table cache support functions.
 //
@@ -1500,6 +1861,49 @@ Return Value:
 
 --*/
 
+KSTATUS
+FatpFatCacheFindFreeRun (
+    PFAT_VOLUME Volume,
+    ULONG SearchStart,
+    ULONG DesiredCount,
+    PULONG RunStart,
+    PULONG RunLength
+    );
+
+/*++
+
+Routine Description:
+
+    This routine searches the FAT allocation bitmap for a run of free clusters,
+    reading in FAT windows as needed. The first free cluster at or after the
+    search start (wrapping around to the beginning of the FAT) begins the run,
+    which is then extended up to the desired count. This routine assumes the
+    volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    SearchStart - Supplies the cluster to begin searching at.
+
+    DesiredCount - Supplies the maximum number of clusters wanted in the run.
+
+    RunStart - Supplies a pointer where the first free cluster of the run will
+        be returned.
+
+    RunLength - Supplies a pointer where the number of free clusters in the
+        run will be returned. This will be between one and the desired count.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_VOLUME_FULL if no free clusters exist.
+
+    Other error codes on device I/O errors.
+
+--*/
+
 KSTATUS
 FatpFatCacheFlush (
     PFAT_VOLUME Volume,
@@ -149,6 +149,7 @@ Return Value:
 
     ULONG Cluster;
     ULONG EntriesRead;
+    BOOL Found;
     BOOL IsDotEntry;
     ULONGLONG Offset;
     PSTR PotentialName;
@@ -156,6 +157,7 @@ Return Value:
     ULONG PotentialNameSize;
     KSTATUS Status;
 
+    Found = FALSE;
     Offset = DIRECTORY_CONTENTS_OFFSET;
     PotentialName = NULL;
     if (NameLength <= 1) {
@@ -163,91 +165,134 @@ Return Value:
     }
 
     //
-    // Seek to the beginning of the directory.
+    // Ask the directory cache first. It either knows where the entry is, knows
+    // that it does not exist, or could not index the directory.
     //
 
-    Status = FatpDirectorySeek(Directory, Offset);
-    if (!KSUCCESS(Status)) {
+    Status = FatpDirectoryCacheLookup(Volume,
+                                      Directory,
+                                      Name,
+                                      NameLength,
+                                      &Offset);
+
+    if (Status == STATUS_PATH_NOT_FOUND) {
         goto LookupDirectoryEntryEnd;
     }
 
-    //
-    // Allocate a buffer for the name.
-    //
+    if (KSUCCESS(Status)) {
+        Status = FatpDirectorySeek(Directory, Offset);
+        if (KSUCCESS(Status)) {
+            Status = FatpReadDirectory(Directory, Entry, 1, &EntriesRead);
+        }
 
-    PotentialNameBufferSize = FAT_MAX_LONG_FILE_LENGTH + 1;
-    PotentialName = FatAllocatePagedMemory(Volume->Device.DeviceToken,
-                                           PotentialNameBufferSize);
+        if ((KSUCCESS(Status)) &&
+            (EntriesRead == 1) &&
+            (Entry->FileAttributes != FAT_LONG_FILE_NAME_ATTRIBUTES) &&
+            (Entry->DosName[0] != FAT_DIRECTORY_ENTRY_ERASED) &&
+            (Entry->DosName[0] != FAT_DIRECTORY_ENTRY_END)) {
 
-    if (PotentialName == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto LookupDirectoryEntryEnd;
+            Found = TRUE;
+
+        //
+        // The cache disagrees with the directory. Drop it and fall back to
+        // scanning.
+        //
+
+        } else {
+            FatpInvalidateDirectoryCache(Volume, Directory->File->FirstCluster);
+            Offset = DIRECTORY_CONTENTS_OFFSET;
+        }
     }
 
-    //
-    // Loop reading directory entries until a matching one is found or the end
-    // is reached.
-    //
+    if (Found == FALSE) {
 
-    while (TRUE) {
-        PotentialNameSize = PotentialNameBufferSize;
-        Status = FatpReadNextDirectoryEntry(Directory,
-                                            NULL,
-                                            PotentialName,
-                                            &PotentialNameSize,
-                                            Entry,
-                                            &EntriesRead);
+        //
+        // Seek to the beginning of the directory.
+        //
 
+        Status = FatpDirectorySeek(Directory, Offset);
         if (!KSUCCESS(Status)) {
-            if (Status == STATUS_END_OF_FILE) {
-                Status = STATUS_PATH_NOT_FOUND;
-            }
-
             goto LookupDirectoryEntryEnd;
         }
 
-        Offset += EntriesRead;
-        if (PotentialNameSize > NameLength) {
-            continue;
-        }
+        //
+        // Allocate a buffer for the name.
+        //
 
-        if (RtlAreStringsEqual(Name, PotentialName, NameLength - 1) != FALSE) {
+        PotentialNameBufferSize = FAT_MAX_LONG_FILE_LENGTH + 1;
+        PotentialName = FatAllocatePagedMemory(Volume->Device.DeviceToken,
+                                               PotentialNameBufferSize);
 
-            ASSERT(Offset != 0);
+        if (PotentialName == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto LookupDirectoryEntryEnd;
+        }
 
-            Offset -= 1;
+        //
+        // Loop reading directory entries until a matching one is found or the
+        // end is reached.
+        //
 
-            //
-            // Set the mapping between the file and the directory, except for
-            // the . and .. entries. Also, empty files may have a cluster ID of
-            // 0, don't save those either.
-            //
+        while (TRUE) {
+            PotentialNameSize = PotentialNameBufferSize;
+            Status = FatpReadNextDirectoryEntry(Directory,
+                                                NULL,
+                                                PotentialName,
+                                                &PotentialNameSize,
+                                                Entry,
+                                                &EntriesRead);
 
-            IsDotEntry = FALSE;
-            if ((Name[0] == '.') &&
-                ((Name[1] == '\0') ||
-                 ((Name[1] == '.') && (Name[2] == '\0')))) {
+            if (!KSUCCESS(Status)) {
+                if (Status == STATUS_END_OF_FILE) {
+                    Status = STATUS_PATH_NOT_FOUND;
+                }
 
-                IsDotEntry = TRUE;
+                goto LookupDirectoryEntryEnd;
             }
 
-            if (IsDotEntry == FALSE) {
-                Cluster = (Entry->ClusterHigh << 16) | Entry->ClusterLow;
-                if ((Cluster >= FAT_CLUSTER_BEGIN) &&
-                    (Cluster < Volume->ClusterBad)) {
+            Offset += EntriesRead;
+            if (PotentialNameSize > NameLength) {
+                continue;
+            }
 
-                    Status = FatpSetFileMapping(Volume,
-                                                Cluster,
-                                                Directory->File->SeekTable[0],
-                                                Offset);
+            if (RtlAreStringsEqual(Name, PotentialName, NameLength - 1) !=
+                FALSE) {
 
-                    if (!KSUCCESS(Status)) {
-                        goto LookupDirectoryEntryEnd;
-                    }
-                }
+                ASSERT(Offset != 0);
+
+                Offset -= 1;
+                break;
             }
+        }
+    }
 
-            break;
+    //
+    // Set the mapping between the file and the directory, except for the . and
+    // .. entries. Also, empty files may have a cluster ID of 0, don't save
+    // those either.
+    //
+
+    IsDotEntry = FALSE;
+    if ((Name[0] == '.') &&
+        ((Name[1] == '\0') ||
+         ((Name[1] == '.') && (Name[2] == '\0')))) {
+
+        IsDotEntry = TRUE;
+    }
+
+    if (IsDotEntry == FALSE) {
+        Cluster = (Entry->ClusterHigh << 16) | Entry->ClusterLow;
+        if ((Cluster >= FAT_CLUSTER_BEGIN) &&
+            (Cluster < Volume->ClusterBad)) {
+
+            Status = FatpSetFileMapping(Volume,
+                                        Cluster,
+                                        Directory->File->FirstCluster,
+                                        Offset);
+
+            if (!KSUCCESS(Status)) {
+                goto LookupDirectoryEntryEnd;
+            }
         }
     }
 
@@ -788,6 +833,12 @@ Return Value:
     }
 
     *DirectorySize = DirectoryContext.ClusterPosition.FileByteOffset;
+
+    //
+    // Keep the directory cache in sync with the new name.
+    //
+
+    FatpDirectoryCacheAddEntry(&DirectoryContext, EntryOffset);
     Status = STATUS_SUCCESS;
 
 CreateDirectoryEntryEnd:
@@ -1320,147 +1371,138 @@ Return Value:
 
 {
 
-    ULONG AllocatedCluster;
+    ULONG AllocatedCount;
+
+    return FatpAllocateClusterRun(Volume,
+                                  PreviousCluster,
+                                  1,
+                                  NewCluster,
+                                  &AllocatedCount,
+                                  Flush);
+}
+
+KSTATUS
+FatpAllocateClusterRun (
+    PFAT_VOLUME Volume,
+    ULONG PreviousCluster,
+    ULONG DesiredCount,
+    PULONG NewCluster,
+    PULONG AllocatedCount,
+    BOOL Flush
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates a run of contiguous free clusters, chains them
+    together, and chains the run so that the specified previous cluster points
+    to its first cluster. Fewer clusters than desired may be allocated if no
+    free run is long enough.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    PreviousCluster - Supplies the cluster that should point to the newly
+        allocated run. Specify FAT32_CLUSTER_END if no previous cluster should
+        be updated.
+
+    DesiredCount - Supplies the number of clusters wanted. This must not be
+        zero.
+
+    NewCluster - Supplies a pointer that will receive the first cluster of the
+        run.
+
+    AllocatedCount - Supplies a pointer that will receive the number of
+        clusters allocated.
+
+    Flush - Supplies a boolean indicating if the FAT cache should be flushed.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_INVALID_PARAMETER if an invalid cluster was supplied.
+
+    STATUS_VOLUME_FULL if no free clusters exist.
+
+    Other error codes on device I/O errors.
+
+--*/
+
+{
+
     ULONG BlockShift;
+    ULONG Cluster;
     ULONG ClusterCount;
-    ULONG ClusterEnd;
-    ULONG CurrentCluster;
     PFAT32_INFORMATION_SECTOR Information;
     ULONGLONG InformationBlock;
     PFAT_IO_BUFFER InformationIoBuffer;
     ULONG IoFlags;
-    ULONG SearchStart;
+    ULONG LastCluster;
+    ULONG RunLength;
+    ULONG RunStart;
     KSTATUS Status;
     ULONG Value;
-    PVOID Window;
-    PUSHORT Window16;
-    PULONG Window32;
-    ULONG WindowOffset;
-    ULONG WindowSize;
 
-    AllocatedCluster = FAT_CLUSTER_FREE;
     BlockShift = Volume->BlockShift;
     ClusterCount = Volume->ClusterCount;
     InformationIoBuffer = NULL;
     IoFlags = IO_FLAG_FS_DATA | IO_FLAG_FS_METADATA;
+    RunLength = 0;
+    RunStart = FAT_CLUSTER_FREE;
 
+    ASSERT(DesiredCount != 0);
     ASSERT((PreviousCluster >= Volume->ClusterBad) ||
            (PreviousCluster < ClusterCount));
 
     if ((PreviousCluster < Volume->ClusterBad) &&
         (PreviousCluster >= ClusterCount)) {
 
+        *NewCluster = FAT_CLUSTER_FREE;
+        *AllocatedCount = 0;
         return STATUS_INVALID_PARAMETER;
     }
 
     FatAcquireLock(Volume->Lock);
-    if ((Volume->ClusterSearchStart < FAT_CLUSTER_BEGIN) ||
-        (Volume->ClusterSearchStart >= ClusterCount)) {
-
-        Volume->ClusterSearchStart = FAT_CLUSTER_BEGIN;
-    }
 
     //
-    // Search for a free block. Start just after the last allocated cluster.
+    // Search the allocation bitmap for a free run, starting just after the
+    // last allocated cluster.
     //
 
-    CurrentCluster = Volume->ClusterSearchStart;
-    ClusterEnd = ClusterCount;
-    SearchStart = CurrentCluster;
-    CurrentCluster += 1;
-    WindowSize = FAT_WINDOW_INDEX_TO_CLUSTER(Volume, 1);
-    WindowOffset = MAX_ULONG;
-    while (CurrentCluster != SearchStart) {
-
-        //
-        // If this is the end of the FAT, wrap around to the beginning.
-        //
-
-        if (CurrentCluster >= ClusterEnd) {
-            CurrentCluster = FAT_CLUSTER_BEGIN;
-            WindowOffset = MAX_ULONG;
-            ClusterEnd = SearchStart;
-        }
-
-        //
-        // Read the next window if needed.
-        //
-
-        if (WindowOffset >= WindowSize) {
-            Status = FatpFatCacheGetFatWindow(Volume,
-                                              TRUE,
-                                              CurrentCluster,
-                                              &Window,
-                                              &WindowOffset);
-
-            if (!KSUCCESS(Status)) {
-                goto AllocateClusterEnd;
-            }
-        }
-
-        //
-        // Scan the whole window.
-        //
+    Status = FatpFatCacheFindFreeRun(Volume,
+                                     Volume->ClusterSearchStart + 1,
+                                     DesiredCount,
+                                     &RunStart,
+                                     &RunLength);
 
-        if (Volume->Format == Fat12Format) {
-            while (CurrentCluster < ClusterEnd) {
-                Value = FAT12_READ_CLUSTER(Window, CurrentCluster);
-                if (Value == FAT_CLUSTER_FREE) {
-                    break;
-                }
-
-                CurrentCluster += 1;
-            }
-
-        } else if (Volume->Format == Fat16Format) {
-            Window16 = Window;
-            while ((WindowOffset < WindowSize) &&
-                   (CurrentCluster < ClusterEnd) &&
-                   (Window16[WindowOffset] != FAT_CLUSTER_FREE)) {
-
-                WindowOffset += 1;
-                CurrentCluster += 1;
-            }
-
-        } else {
-            Window32 = Window;
-            while ((WindowOffset < WindowSize) &&
-                   (CurrentCluster < ClusterEnd) &&
-                   (Window32[WindowOffset] != FAT_CLUSTER_FREE)) {
+    if (!KSUCCESS(Status)) {
+        RunStart = FAT_CLUSTER_FREE;
+        RunLength = 0;
+        goto AllocateClusterRunEnd;
+    }
 
-                WindowOffset += 1;
-                CurrentCluster += 1;
-            }
-        }
+    //
+    // Chain the run together, marking the last cluster as the end. Write the
+    // tail first so that a failure part way through never leaves a cluster
+    // pointing at a free one.
+    //
 
-        if ((WindowOffset >= WindowSize) || (CurrentCluster >= ClusterEnd)) {
-            continue;
+    LastCluster = RunStart + RunLength - 1;
+    Cluster = LastCluster + 1;
+    while (Cluster > RunStart) {
+        Cluster -= 1;
+        Value = Cluster + 1;
+        if (Cluster == LastCluster) {
+            Value = Volume->ClusterEnd;
         }
 
-        Status = FatpFatCacheWriteClusterEntry(Volume,
-                                               CurrentCluster,
-                                               Volume->ClusterEnd,
-                                               NULL);
-
+        Status = FatpFatCacheWriteClusterEntry(Volume, Cluster, Value, NULL);
         if (!KSUCCESS(Status)) {
-            goto AllocateClusterEnd;
+            goto AllocateClusterRunEnd;
         }
-
-        //
-        // Mark a cluster as allocated now that it's been written in stone.
-        //
-
-        AllocatedCluster = CurrentCluster;
-        break;
-    }
-
-    //
-    // If nothing was found, sadly return.
-    //
-
-    if (AllocatedCluster == FAT_CLUSTER_FREE) {
-        Status = STATUS_VOLUME_FULL;
-        goto AllocateClusterEnd;
     }
 
     //
@@ -1476,7 +1518,7 @@ Return Value:
 
         if (InformationIoBuffer == NULL) {
             Status = STATUS_INSUFFICIENT_RESOURCES;
-            goto AllocateClusterEnd;
+            goto AllocateClusterRunEnd;
         }
 
         InformationBlock = Volume->InformationByteOffset >> BlockShift;
@@ -1488,21 +1530,24 @@ Return Value:
                                InformationIoBuffer);
 
         if (!KSUCCESS(Status)) {
-            goto AllocateClusterEnd;
+            goto AllocateClusterRunEnd;
         }
 
         Information = FatMapIoBuffer(InformationIoBuffer);
         if (Information == NULL) {
             Status = STATUS_INSUFFICIENT_RESOURCES;
-            goto AllocateClusterEnd;
+            goto AllocateClusterRunEnd;
         }
 
-        Information->LastClusterAllocated = AllocatedCluster;
+        Information->LastClusterAllocated = LastCluster;
 
-        ASSERT(Information->FreeClusters != 0);
+        ASSERT(Information->FreeClusters >= RunLength);
 
-        if (Information->FreeClusters != 0) {
-            Information->FreeClusters -= 1;
+        if (Information->FreeClusters >= RunLength) {
+            Information->FreeClusters -= RunLength;
+
+        } else {
+            Information->FreeClusters = 0;
         }
 
         Status = FatWriteDevice(Volume->Device.DeviceToken,
@@ -1513,11 +1558,11 @@ Return Value:
                                 InformationIoBuffer);
 
         if (!KSUCCESS(Status)) {
-            goto AllocateClusterEnd;
+            goto AllocateClusterRunEnd;
         }
     }
 
-    Volume->ClusterSearchStart = AllocatedCluster;
+    Volume->ClusterSearchStart = LastCluster;
 
     //
     // Lookup the previous block and update it.
@@ -1526,30 +1571,31 @@ Return Value:
     if ((PreviousCluster != 0) && (PreviousCluster < ClusterCount)) {
         Status = FatpFatCacheWriteClusterEntry(Volume,
                                                PreviousCluster,
-                                               AllocatedCluster,
+                                               RunStart,
                                                NULL);
 
         if (!KSUCCESS(Status)) {
-            goto AllocateClusterEnd;
+            goto AllocateClusterRunEnd;
         }
     }
 
     if (Flush != FALSE) {
         Status = FatpFatCacheFlush(Volume, 0);
         if (!KSUCCESS(Status)) {
-            goto AllocateClusterEnd;
+            goto AllocateClusterRunEnd;
         }
     }
 
     Status = STATUS_SUCCESS;
 
-AllocateClusterEnd:
+AllocateClusterRunEnd:
     FatReleaseLock(Volume->Lock);
     if (InformationIoBuffer != NULL) {
         FatFreeIoBuffer(InformationIoBuffer);
     }
 
-    *NewCluster = AllocatedCluster;
+    *NewCluster = RunStart;
+    *AllocatedCount = RunLength;
     return Status;
 }
 
@@ -1715,6 +1761,289 @@ FreeClusterChainEnd:
     return Status;
 }
 
+BOOL
+FatpLookupFileExtent (
+    PFAT_FILE File,
+    ULONG FileCluster,
+    PULONG Cluster,
+    PULONG RunLength
+    )
+
+/*++
+
+Routine Description:
+
+    This routine looks up the volume cluster backing a cluster of a file in
+    the file's extent map.
+
+Arguments:
+
+    File - Supplies a pointer to the open file.
+
+    FileCluster - Supplies the index of the cluster within the file.
+
+    Cluster - Supplies a pointer where the volume cluster number will be
+        returned on success.
+
+    RunLength - Supplies an optional pointer where the number of contiguous
+        clusters starting at the returned cluster will be returned, including
+        the returned cluster itself.
+
+Return Value:
+
+    TRUE if the file cluster is described by the extent map.
+
+    FALSE if the file cluster is beyond the mapped portion of the file. The
+    cluster chain must be walked from the last mapped cluster.
+
+--*/
+
+{
+
+    PFAT_FILE_EXTENT Extent;
+    ULONG High;
+    ULONG Low;
+    ULONG Middle;
+
+    if (FileCluster >= File->MappedClusterCount) {
+        return FALSE;
+    }
+
+    ASSERT(File->ExtentCount != 0);
+
+    //
+    // Binary search for the last extent starting at or before the file
+    // cluster. The map has no holes, so that extent contains it.
+    //
+
+    Low = 0;
+    High = File->ExtentCount - 1;
+    while (Low < High) {
+        Middle = Low + ((High - Low + 1) / 2);
+        if (File->Extents[Middle].FileCluster <= FileCluster) {
+            Low = Middle;
+
+        } else {
+            High = Middle - 1;
+        }
+    }
+
+    Extent = &(File->Extents[Low]);
+
+    ASSERT((FileCluster >= Extent->FileCluster) &&
+           (FileCluster - Extent->FileCluster < Extent->Length));
+
+    *Cluster = Extent->Cluster + (FileCluster - Extent->FileCluster);
+    if (RunLength != NULL) {
+        *RunLength = Extent->Length - (FileCluster - Extent->FileCluster);
+    }
+
+    return TRUE;
+}
+
+VOID
+FatpRecordFileCluster (
+    PFAT_FILE File,
+    ULONG FileCluster,
+    ULONG Cluster
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a cluster discovered while walking a file's cluster
+    chain to the file's extent map. Only the cluster immediately following
+    the mapped portion of the file is recorded; anything else is ignored.
+
+Arguments:
+
+    File - Supplies a pointer to the open file.
+
+    FileCluster - Supplies the index of the cluster within the file.
+
+    Cluster - Supplies the volume cluster number backing that file cluster.
+
+Return Value:
+
+    None. Failure to allocate space for a new extent simply leaves the map
+    shorter.
+
+--*/
+
+{
+
+    ULONG AllocationSize;
+    ULONG Capacity;
+    PVOID DeviceToken;
+    PFAT_FILE_EXTENT Extent;
+    PFAT_FILE_EXTENT NewExtents;
+
+    if (FileCluster != File->MappedClusterCount) {
+        return;
+    }
+
+    ASSERT((Cluster >= FAT_CLUSTER_BEGIN) &&
+           (Cluster < File->Volume->ClusterCount));
+
+    //
+    // Extend the last run if this cluster follows it on the volume.
+    //
+
+    if (File->ExtentCount != 0) {
+        Extent = &(File->Extents[File->ExtentCount - 1]);
+        if (Extent->Cluster + Extent->Length == Cluster) {
+            Extent->Length += 1;
+            File->MappedClusterCount += 1;
+            return;
+        }
+    }
+
+    //
+    // Start a new run, growing the array if needed.
+    //
+
+    if (File->ExtentCount == File->ExtentCapacity) {
+        Capacity = File->ExtentCapacity * 2;
+        if (Capacity == 0) {
+            Capacity = FAT_FILE_INITIAL_EXTENT_CAPACITY;
+        }
+
+        DeviceToken = File->Volume->Device.DeviceToken;
+        AllocationSize = Capacity * sizeof(FAT_FILE_EXTENT);
+        if ((File->OpenFlags & OPEN_FLAG_PAGE_FILE) != 0) {
+            NewExtents = FatAllocateNonPagedMemory(DeviceToken,
+                                                   AllocationSize);
+
+        } else {
+            NewExtents = FatAllocatePagedMemory(DeviceToken, AllocationSize);
+        }
+
+        if (NewExtents == NULL) {
+            return;
+        }
+
+        if (File->Extents != NULL) {
+            RtlCopyMemory(NewExtents,
+                          File->Extents,
+                          File->ExtentCount * sizeof(FAT_FILE_EXTENT));
+
+            if ((File->OpenFlags & OPEN_FLAG_PAGE_FILE) != 0) {
+                FatFreeNonPagedMemory(DeviceToken, File->Extents);
+
+            } else {
+                FatFreePagedMemory(DeviceToken, File->Extents);
+            }
+        }
+
+        File->Extents = NewExtents;
+        File->ExtentCapacity = Capacity;
+    }
+
+    Extent = &(File->Extents[File->ExtentCount]);
+    Extent->FileCluster = FileCluster;
+    Extent->Cluster = Cluster;
+    Extent->Length = 1;
+    File->ExtentCount += 1;
+    File->MappedClusterCount += 1;
+    return;
+}
+
+VOID
+FatpTrimFileExtents (
+    PFAT_FILE File,
+    ULONG ClusterCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine discards the portion of a file's extent map beyond the given
+    number of clusters, usually because the file was truncated.
+
+Arguments:
+
+    File - Supplies a pointer to the open file.
+
+    ClusterCount - Supplies the number of clusters at the start of the file
+        that are still valid.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PFAT_FILE_EXTENT Extent;
+
+    if (ClusterCount >= File->MappedClusterCount) {
+        return;
+    }
+
+    while (File->ExtentCount != 0) {
+        Extent = &(File->Extents[File->ExtentCount - 1]);
+        if (Extent->FileCluster < ClusterCount) {
+            if (Extent->FileCluster + Extent->Length > ClusterCount) {
+                Extent->Length = ClusterCount - Extent->FileCluster;
+            }
+
+            break;
+        }
+
+        File->ExtentCount -= 1;
+    }
+
+    File->MappedClusterCount = ClusterCount;
+    return;
+}
+
+VOID
+FatpDestroyFileExtents (
+    PFAT_FILE File
+    )
+
+/*++
+
+Routine Description:
+
+    This routine frees a file's extent map.
+
+Arguments:
+
+    File - Supplies a pointer to the open file.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PVOID DeviceToken;
+
+    if (File->Extents == NULL) {
+        return;
+    }
+
+    DeviceToken = File->Volume->Device.DeviceToken;
+    if ((File->OpenFlags & OPEN_FLAG_PAGE_FILE) != 0) {
+        FatFreeNonPagedMemory(DeviceToken, File->Extents);
+
+    } else {
+        FatFreePagedMemory(DeviceToken, File->Extents);
+    }
+
+    File->Extents = NULL;
+    File->ExtentCount = 0;
+    File->ExtentCapacity = 0;
+    File->MappedClusterCount = 0;
+    return;
+}
+
 KSTATUS
 FatpIsDirectoryEmpty (
     PFAT_VOLUME Volume,
@@ -1935,6 +2264,7 @@ Return Value:
 
 {
 
+    UCHAR Attributes;
     UCHAR Checksum;
     ULONG Cluster;
     FAT_DIRECTORY_ENTRY DirectoryEntry;
@@ -1942,7 +2272,9 @@ Return Value:
     ULONG EntriesWritten;
     BOOL LocalEntryErased;
     KSTATUS Status;
+    PFAT_VOLUME Volume;
 
+    Attributes = 0;
     LocalEntryErased = FALSE;
 
     //
@@ -1972,6 +2304,7 @@ Return Value:
     Checksum = FatpChecksumDirectoryEntry(&DirectoryEntry);
     Cluster = ((ULONG)(DirectoryEntry.ClusterHigh) << 16) |
               DirectoryEntry.ClusterLow;
+    Attributes = DirectoryEntry.FileAttributes;
 
     //
     // Write out the erased entry.
@@ -2030,11 +2363,24 @@ Return Value:
 EraseDirectoryEntryEnd:
 
     //
-    // Unset the mapping if the directory entry was erased.
+    // Unset the mapping if the directory entry was erased, and forget the name
+    // in the directory cache. If the entry was a directory, its own cache is
+    // stale as well, since its cluster is about to be freed.
     //
 
+    Volume = Directory->File->Volume;
     if (LocalEntryErased != FALSE) {
-        FatpUnsetFileMapping(Directory->File->Volume, Cluster);
+        FatpUnsetFileMapping(Volume, Cluster);
+        FatpDirectoryCacheRemoveEntry(Volume,
+                                      Directory->File->FirstCluster,
+                                      EntryOffset);
+
+        if ((Attributes & FAT_SUBDIRECTORY) != 0) {
+            FatpInvalidateDirectoryCache(Volume, Cluster);
+        }
+
+    } else if (!KSUCCESS(Status)) {
+        FatpInvalidateDirectoryCache(Volume, Directory->File->FirstCluster);
     }
 
     *EntryErased = LocalEntryErased;
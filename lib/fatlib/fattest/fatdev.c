@@ -85,6 +85,15 @@ typedef struct _TEST_IO_BUFFER {
 
 ULONG FatBlockSize = 0;
 
+//
+// Store counters of the device I/O performed, used by the benchmarks.
+//
+
+ULONGLONG FatDeviceReadCount = 0;
+ULONGLONG FatDeviceBlocksRead = 0;
+ULONGLONG FatDeviceWriteCount = 0;
+ULONGLONG FatDeviceBlocksWritten = 0;
+
 //
 // ------------------------------------------------------------------ Functions
 //
@@ -747,6 +756,8 @@ Return Value:
 
     File = (FILE *)DeviceToken;
     fseek(File, FatBlockSize * BlockAddress, SEEK_SET);
+    FatDeviceReadCount += 1;
+    FatDeviceBlocksRead += BlockCount;
 
     //
     // Read from the file.
@@ -817,6 +828,8 @@ Return Value:
 
     File = (FILE *)DeviceToken;
     fseek(File, FatBlockSize * BlockAddress, SEEK_SET);
+    FatDeviceWriteCount += 1;
+    FatDeviceBlocksWritten += BlockCount;
     IoBuffer = (PTEST_IO_BUFFER)FatIoBuffer;
     Buffer = IoBuffer->Data + IoBuffer->CurrentOffset;
     ItemsWritten = fwrite(Buffer, FatBlockSize, BlockCount, File);
@@ -52,11 +52,50 @@ Environment:
 
 #define USAGE_STRING    \
     "Testfat.exe will test the FAT file system implementation.\n\n" \
-    "Usage: Testfat.exe [-v]\n\n" \
-    "    -v  Verbose mode\n\n" \
+    "Usage: Testfat.exe [-v] [-b]\n\n" \
+    "    -v  Verbose mode\n" \
+    "    -b  Run the benchmarks after the tests\n\n" \
 
 #define SECTOR_SIZE            512
 
+//
+// Benchmark parameters. The seek benchmark interleaves appends to two files
+// so that every cluster of each file is its own fragment.
+//
+
+#define BENCHMARK_IMAGE "testbench.test"
+#define BENCHMARK_DISK_SIZE (1024ULL * 1024 * 1024)
+#define BENCHMARK_FILE_SIZE (1024 * 1024 * 64)
+#define BENCHMARK_SEEK_ITERATIONS 20000
+
+//
+// The lookup benchmark fills one directory with files, the way a directory of
+// unified kernel images might look, then looks each one up by name.
+//
+
+#define BENCHMARK_LOOKUP_DISK_SIZE (1024 * 1024 * 64)
+#define BENCHMARK_LOOKUP_FILE_COUNT 5000
+#define BENCHMARK_LOOKUP_DIRECTORY "linux"
+#define BENCHMARK_LOOKUP_FILE_FORMAT "vmlinuz-%04d.efi"
+
+//
+// The write benchmark appends a large file in big chunks, the way an image
+// might be copied onto the volume.
+//
+
+#define BENCHMARK_WRITE_FILE_SIZE (1024ULL * 1024 * 512)
+#define BENCHMARK_WRITE_CHUNK_SIZE (1024 * 1024)
+#define BENCHMARK_RESERVE_FILE_SIZE (1024ULL * 1024 * 256)
+
+//
+// The append benchmark grows many files a cluster at a time in turn, so each
+// new cluster is linked from a tail entry far back in the FAT.
+//
+
+#define BENCHMARK_APPEND_FILE_COUNT 1024
+#define BENCHMARK_APPEND_ROUNDS 8
+#define BENCHMARK_APPEND_FILE_FORMAT "append%04d.dat"
+
 //
 // Disk geometry.
 //
@@ -97,6 +136,40 @@ FormatDisk (
     PVOID *VolumeToken
     );
 
+KSTATUS
+CreateTestFile (
+    PVOID VolumeToken,
+    PFILE_PROPERTIES DirectoryProperties,
+    PSTR FileName,
+    PFILE_ID FileId,
+    PVOID *FileToken
+    );
+
+BOOL
+RunSeekBenchmark (
+    VOID
+    );
+
+BOOL
+RunLookupBenchmark (
+    VOID
+    );
+
+BOOL
+RunWriteBenchmark (
+    VOID
+    );
+
+BOOL
+RunAppendBenchmark (
+    VOID
+    );
+
+ULONG
+GetElapsedMilliseconds (
+    clock_t Start
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -108,12 +181,27 @@ FormatDisk (
 BOOL FatTestVerbose = FALSE;
 BOOL FatTestDebug = FALSE;
 
+//
+// Store a global indicating whether to run the benchmarks.
+//
+
+BOOL FatTestBenchmark = FALSE;
+
 //
 // Store the size of one block on the device.
 //
 
 extern ULONG FatBlockSize;
 
+//
+// Store the device I/O counters kept by the test device layer.
+//
+
+extern ULONGLONG FatDeviceReadCount;
+extern ULONGLONG FatDeviceBlocksRead;
+extern ULONGLONG FatDeviceWriteCount;
+extern ULONGLONG FatDeviceBlocksWritten;
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -196,6 +284,9 @@ Return Value:
             FatTestVerbose = TRUE;
             FatTestDebug = TRUE;
 
+        } else if (strcmp(Argument, "b") == 0) {
+            FatTestBenchmark = TRUE;
+
         } else {
             printf("%s: Invalid option\n\n%s", Argument, USAGE_STRING);
             return 1;
@@ -476,6 +567,20 @@ Return Value:
 
     FatCloseFile(FileToken);
     Result = TRUE;
+    if (FatTestBenchmark != FALSE) {
+        Result = RunSeekBenchmark();
+        if (Result != FALSE) {
+            Result = RunLookupBenchmark();
+        }
+
+        if (Result != FALSE) {
+            Result = RunWriteBenchmark();
+        }
+
+        if (Result != FALSE) {
+            Result = RunAppendBenchmark();
+        }
+    }
 
 MainEnd:
     if (FileIoBuffer != NULL) {
@@ -571,6 +676,1043 @@ Return Value:
     return Status;
 }
 
+KSTATUS
+CreateTestFile (
+    PVOID VolumeToken,
+    PFILE_PROPERTIES DirectoryProperties,
+    PSTR FileName,
+    PFILE_ID FileId,
+    PVOID *FileToken
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates a new regular file in the given directory and opens
+    it for reading and writing.
+
+Arguments:
+
+    VolumeToken - Supplies the token identifying the mounted volume.
+
+    DirectoryProperties - Supplies a pointer to the properties of the
+        directory to create the file in. The size is updated if the directory
+        grew.
+
+    FileName - Supplies the null terminated name of the file to create.
+
+    FileId - Supplies a pointer where the new file's ID will be returned.
+
+    FileToken - Supplies a pointer where the open file token will be returned.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONGLONG NewDirectorySize;
+    FILE_PROPERTIES Properties;
+    KSTATUS Status;
+
+    RtlZeroMemory(&Properties, sizeof(FILE_PROPERTIES));
+    Properties.Type = IoObjectRegularFile;
+    Properties.Permissions = FILE_PERMISSION_USER_READ |
+                             FILE_PERMISSION_USER_WRITE;
+
+    Properties.HardLinkCount = 1;
+    Status = FatCreate(VolumeToken,
+                       DirectoryProperties->FileId,
+                       FileName,
+                       strlen(FileName) + 1,
+                       &NewDirectorySize,
+                       &Properties);
+
+    if (!KSUCCESS(Status)) {
+        printf("Error: Unable to create file %s. Status %d.\n",
+               FileName,
+               Status);
+
+        return Status;
+    }
+
+    if (NewDirectorySize > DirectoryProperties->Size) {
+        DirectoryProperties->Size = NewDirectorySize;
+        FatWriteFileProperties(VolumeToken, DirectoryProperties, 0);
+    }
+
+    *FileId = Properties.FileId;
+    Status = FatOpenFileId(VolumeToken,
+                           Properties.FileId,
+                           IO_ACCESS_READ | IO_ACCESS_WRITE,
+                           OPEN_FLAG_CREATE,
+                           FileToken);
+
+    if (!KSUCCESS(Status)) {
+        printf("Error: Unable to open %s (ID %lld). Status %d\n",
+               FileName,
+               Properties.FileId,
+               Status);
+    }
+
+    return Status;
+}
+
+BOOL
+RunSeekBenchmark (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine measures random seeks and reads within a badly fragmented
+    file. Two files are grown in alternating blocks on a 1GB image so that
+    their clusters interleave, then one is reopened and read at random
+    offsets.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE on failure.
+
+--*/
+
+{
+
+    ULONG BlockIndex;
+    UINTN BytesCompleted;
+    ULONG Elapsed;
+    FILE_ID FileId;
+    ULONG FileIndex;
+    FAT_SEEK_INFORMATION FileSeek[2];
+    PVOID FileToken[2];
+    ULONG FillIndex;
+    FILE *ImageFile;
+    ULONG Iteration;
+    ULONGLONG Offset;
+    PULONG PageBuffer;
+    PFAT_IO_BUFFER PageIoBuffer;
+    FILE_PROPERTIES RootProperties;
+    BOOL Result;
+    clock_t Start;
+    KSTATUS Status;
+    FILE_ID UnusedFileId;
+    PVOID VolumeToken;
+
+    FileToken[0] = NULL;
+    FileToken[1] = NULL;
+    PageIoBuffer = NULL;
+    Result = FALSE;
+    ImageFile = fopen(BENCHMARK_IMAGE, "wb+");
+    if (ImageFile == NULL) {
+        printf("Unable to open benchmark image \"%s\".\n", BENCHMARK_IMAGE);
+        goto RunSeekBenchmarkEnd;
+    }
+
+    Status = FormatDisk(ImageFile,
+                        SECTOR_SIZE,
+                        BENCHMARK_DISK_SIZE / SECTOR_SIZE,
+                        &VolumeToken);
+
+    if (!KSUCCESS(Status)) {
+        goto RunSeekBenchmarkEnd;
+    }
+
+    RtlZeroMemory(&RootProperties, sizeof(FILE_PROPERTIES));
+    Status = FatLookup(VolumeToken, TRUE, 0, NULL, 0, &RootProperties);
+    if (!KSUCCESS(Status)) {
+        goto RunSeekBenchmarkEnd;
+    }
+
+    Status = CreateTestFile(VolumeToken,
+                            &RootProperties,
+                            "seek0.dat",
+                            &FileId,
+                            &(FileToken[0]));
+
+    if (!KSUCCESS(Status)) {
+        goto RunSeekBenchmarkEnd;
+    }
+
+    Status = CreateTestFile(VolumeToken,
+                            &RootProperties,
+                            "seek1.dat",
+                            &UnusedFileId,
+                            &(FileToken[1]));
+
+    if (!KSUCCESS(Status)) {
+        goto RunSeekBenchmarkEnd;
+    }
+
+    PageIoBuffer = FatAllocateIoBuffer(NULL, BLOCK_SIZE);
+    if (PageIoBuffer == NULL) {
+        goto RunSeekBenchmarkEnd;
+    }
+
+    PageBuffer = FatMapIoBuffer(PageIoBuffer);
+
+    //
+    // Grow both files a block at a time, alternating between them. Each
+    // block is stamped with its file and offset so reads can be verified.
+    //
+
+    VPRINT("Fragmenting two %d MB files.\n", BENCHMARK_FILE_SIZE >> 20);
+    RtlZeroMemory(FileSeek, sizeof(FileSeek));
+    for (Offset = 0; Offset < BENCHMARK_FILE_SIZE; Offset += BLOCK_SIZE) {
+        for (FileIndex = 0; FileIndex < 2; FileIndex += 1) {
+            for (FillIndex = 0;
+                 FillIndex < (BLOCK_SIZE / sizeof(ULONG));
+                 FillIndex += 1) {
+
+                PageBuffer[FillIndex] = (FileIndex << 31) |
+                                        ((Offset / sizeof(ULONG)) + FillIndex);
+            }
+
+            Status = FatWriteFile(FileToken[FileIndex],
+                                  &(FileSeek[FileIndex]),
+                                  PageIoBuffer,
+                                  BLOCK_SIZE,
+                                  0,
+                                  NULL,
+                                  &BytesCompleted);
+
+            if ((!KSUCCESS(Status)) || (BytesCompleted != BLOCK_SIZE)) {
+                printf("Error: Benchmark write failed at offset 0x%llx. "
+                       "Status %d.\n",
+                       Offset,
+                       Status);
+
+                goto RunSeekBenchmarkEnd;
+            }
+        }
+    }
+
+    //
+    // Reopen the first file so no cluster positions are remembered, then
+    // read blocks at random.
+    //
+
+    FatCloseFile(FileToken[0]);
+    FileToken[0] = NULL;
+    Status = FatOpenFileId(VolumeToken,
+                           FileId,
+                           IO_ACCESS_READ,
+                           0,
+                           &(FileToken[0]));
+
+    if (!KSUCCESS(Status)) {
+        goto RunSeekBenchmarkEnd;
+    }
+
+    RtlZeroMemory(&(FileSeek[0]), sizeof(FAT_SEEK_INFORMATION));
+    FatDeviceReadCount = 0;
+    FatDeviceBlocksRead = 0;
+    Start = clock();
+    for (Iteration = 0;
+         Iteration < BENCHMARK_SEEK_ITERATIONS;
+         Iteration += 1) {
+
+        BlockIndex = rand() % (BENCHMARK_FILE_SIZE / BLOCK_SIZE);
+        Offset = (ULONGLONG)BlockIndex * BLOCK_SIZE;
+        Status = FatFileSeek(FileToken[0],
+                             NULL,
+                             0,
+                             SeekCommandFromBeginning,
+                             Offset,
+                             &(FileSeek[0]));
+
+        if (!KSUCCESS(Status)) {
+            printf("Error: Could not seek to offset 0x%llx.\n", Offset);
+            goto RunSeekBenchmarkEnd;
+        }
+
+        Status = FatReadFile(FileToken[0],
+                             &(FileSeek[0]),
+                             PageIoBuffer,
+                             BLOCK_SIZE,
+                             0,
+                             NULL,
+                             &BytesCompleted);
+
+        if ((!KSUCCESS(Status)) || (BytesCompleted != BLOCK_SIZE)) {
+            printf("Error: Benchmark read failed at offset 0x%llx. "
+                   "Status %d.\n",
+                   Offset,
+                   Status);
+
+            goto RunSeekBenchmarkEnd;
+        }
+
+        if ((PageBuffer[0] != (ULONG)(Offset / sizeof(ULONG))) ||
+            (PageBuffer[(BLOCK_SIZE / sizeof(ULONG)) - 1] !=
+             (ULONG)((Offset + BLOCK_SIZE) / sizeof(ULONG)) - 1)) {
+
+            printf("Error: Offset 0x%llx read back %x instead of %x.\n",
+                   Offset,
+                   PageBuffer[0],
+                   (ULONG)(Offset / sizeof(ULONG)));
+
+            goto RunSeekBenchmarkEnd;
+        }
+    }
+
+    Elapsed = GetElapsedMilliseconds(Start);
+    printf("Seek benchmark: %d random %d byte reads of a fragmented %d MB "
+           "file took %d ms and %lld device reads.\n",
+           BENCHMARK_SEEK_ITERATIONS,
+           BLOCK_SIZE,
+           BENCHMARK_FILE_SIZE >> 20,
+           Elapsed,
+           FatDeviceReadCount);
+
+    Result = TRUE;
+
+RunSeekBenchmarkEnd:
+    for (FileIndex = 0; FileIndex < 2; FileIndex += 1) {
+        if (FileToken[FileIndex] != NULL) {
+            FatCloseFile(FileToken[FileIndex]);
+        }
+    }
+
+    if (PageIoBuffer != NULL) {
+        FatFreeIoBuffer(PageIoBuffer);
+    }
+
+    if (ImageFile != NULL) {
+        fclose(ImageFile);
+    }
+
+    return Result;
+}
+
+BOOL
+RunLookupBenchmark (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine measures name lookups in a large directory. A few thousand
+    files are created in one directory and each is looked up by name in a
+    scattered order. Then a missing name, an unlinked name, and a recreated
+    name are checked.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE on failure.
+
+--*/
+
+{
+
+    ULONG CreateElapsed;
+    FILE_PROPERTIES DirectoryProperties;
+    ULONG Elapsed;
+    PFILE_ID FileIds;
+    ULONG FileIndex;
+    CHAR FileName[32];
+    PVOID FileToken;
+    FILE *ImageFile;
+    ULONG Iteration;
+    ULONGLONG NewDirectorySize;
+    FILE_PROPERTIES Properties;
+    BOOL Result;
+    FILE_PROPERTIES RootProperties;
+    clock_t Start;
+    KSTATUS Status;
+    BOOL Unlinked;
+    PVOID VolumeToken;
+
+    FileIds = NULL;
+    Result = FALSE;
+    ImageFile = fopen(BENCHMARK_IMAGE, "wb+");
+    if (ImageFile == NULL) {
+        printf("Unable to open benchmark image \"%s\".\n", BENCHMARK_IMAGE);
+        goto RunLookupBenchmarkEnd;
+    }
+
+    FileIds = malloc(BENCHMARK_LOOKUP_FILE_COUNT * sizeof(FILE_ID));
+    if (FileIds == NULL) {
+        goto RunLookupBenchmarkEnd;
+    }
+
+    Status = FormatDisk(ImageFile,
+                        SECTOR_SIZE,
+                        BENCHMARK_LOOKUP_DISK_SIZE / SECTOR_SIZE,
+                        &VolumeToken);
+
+    if (!KSUCCESS(Status)) {
+        goto RunLookupBenchmarkEnd;
+    }
+
+    RtlZeroMemory(&RootProperties, sizeof(FILE_PROPERTIES));
+    Status = FatLookup(VolumeToken, TRUE, 0, NULL, 0, &RootProperties);
+    if (!KSUCCESS(Status)) {
+        goto RunLookupBenchmarkEnd;
+    }
+
+    //
+    // Create the directory to fill.
+    //
+
+    RtlZeroMemory(&DirectoryProperties, sizeof(FILE_PROPERTIES));
+    DirectoryProperties.Type = IoObjectRegularDirectory;
+    DirectoryProperties.Permissions = FILE_PERMISSION_USER_READ |
+                                      FILE_PERMISSION_USER_WRITE |
+                                      FILE_PERMISSION_USER_EXECUTE;
+
+    DirectoryProperties.HardLinkCount = 1;
+    Status = FatCreate(VolumeToken,
+                       RootProperties.FileId,
+                       BENCHMARK_LOOKUP_DIRECTORY,
+                       sizeof(BENCHMARK_LOOKUP_DIRECTORY),
+                       &NewDirectorySize,
+                       &DirectoryProperties);
+
+    if (!KSUCCESS(Status)) {
+        printf("Error: Unable to create directory %s. Status %d.\n",
+               BENCHMARK_LOOKUP_DIRECTORY,
+               Status);
+
+        goto RunLookupBenchmarkEnd;
+    }
+
+    //
+    // Fill it with files.
+    //
+
+    Start = clock();
+    for (FileIndex = 0;
+         FileIndex < BENCHMARK_LOOKUP_FILE_COUNT;
+         FileIndex += 1) {
+
+        snprintf(FileName,
+                 sizeof(FileName),
+                 BENCHMARK_LOOKUP_FILE_FORMAT,
+                 FileIndex);
+
+        Status = CreateTestFile(VolumeToken,
+                                &DirectoryProperties,
+                                FileName,
+                                &(FileIds[FileIndex]),
+                                &FileToken);
+
+        if (!KSUCCESS(Status)) {
+            goto RunLookupBenchmarkEnd;
+        }
+
+        FatCloseFile(FileToken);
+    }
+
+    CreateElapsed = GetElapsedMilliseconds(Start);
+
+    //
+    // Look every file up in a scattered order.
+    //
+
+    FatDeviceReadCount = 0;
+    FatDeviceBlocksRead = 0;
+    Start = clock();
+    for (Iteration = 0;
+         Iteration < BENCHMARK_LOOKUP_FILE_COUNT;
+         Iteration += 1) {
+
+        FileIndex = (Iteration * 7919) % BENCHMARK_LOOKUP_FILE_COUNT;
+        snprintf(FileName,
+                 sizeof(FileName),
+                 BENCHMARK_LOOKUP_FILE_FORMAT,
+                 FileIndex);
+
+        Status = FatLookup(VolumeToken,
+                           FALSE,
+                           DirectoryProperties.FileId,
+                           FileName,
+                           strlen(FileName) + 1,
+                           &Properties);
+
+        if (!KSUCCESS(Status)) {
+            printf("Error: Failed to look up %s. Status %d.\n",
+                   FileName,
+                   Status);
+
+            goto RunLookupBenchmarkEnd;
+        }
+
+        if (Properties.FileId != FileIds[FileIndex]) {
+            printf("Error: Looking up %s returned ID %lld instead of %lld.\n",
+                   FileName,
+                   Properties.FileId,
+                   FileIds[FileIndex]);
+
+            goto RunLookupBenchmarkEnd;
+        }
+    }
+
+    Elapsed = GetElapsedMilliseconds(Start);
+    printf("Lookup benchmark: %d lookups in a directory of %d files took %d "
+           "ms and %lld device reads. Creating the files took %d ms.\n",
+           BENCHMARK_LOOKUP_FILE_COUNT,
+           BENCHMARK_LOOKUP_FILE_COUNT,
+           Elapsed,
+           FatDeviceReadCount,
+           CreateElapsed);
+
+    //
+    // A name that was never created must not be found.
+    //
+
+    Status = FatLookup(VolumeToken,
+                       FALSE,
+                       DirectoryProperties.FileId,
+                       "missing.efi",
+                       sizeof("missing.efi"),
+                       &Properties);
+
+    if (Status != STATUS_PATH_NOT_FOUND) {
+        printf("Error: Looking up a missing file returned %d.\n", Status);
+        goto RunLookupBenchmarkEnd;
+    }
+
+    //
+    // Unlink a file and make sure it is gone, then create it again and make
+    // sure the new file is found.
+    //
+
+    FileIndex = BENCHMARK_LOOKUP_FILE_COUNT / 2;
+    snprintf(FileName,
+             sizeof(FileName),
+             BENCHMARK_LOOKUP_FILE_FORMAT,
+             FileIndex);
+
+    Status = FatUnlink(VolumeToken,
+                       DirectoryProperties.FileId,
+                       FileName,
+                       strlen(FileName) + 1,
+                       FileIds[FileIndex],
+                       &Unlinked);
+
+    if ((!KSUCCESS(Status)) || (Unlinked == FALSE)) {
+        printf("Error: Failed to unlink %s. Status %d.\n", FileName, Status);
+        goto RunLookupBenchmarkEnd;
+    }
+
+    Status = FatLookup(VolumeToken,
+                       FALSE,
+                       DirectoryProperties.FileId,
+                       FileName,
+                       strlen(FileName) + 1,
+                       &Properties);
+
+    if (Status != STATUS_PATH_NOT_FOUND) {
+        printf("Error: Looking up unlinked %s returned %d.\n",
+               FileName,
+               Status);
+
+        goto RunLookupBenchmarkEnd;
+    }
+
+    Status = CreateTestFile(VolumeToken,
+                            &DirectoryProperties,
+                            FileName,
+                            &(FileIds[FileIndex]),
+                            &FileToken);
+
+    if (!KSUCCESS(Status)) {
+        goto RunLookupBenchmarkEnd;
+    }
+
+    FatCloseFile(FileToken);
+    Status = FatLookup(VolumeToken,
+                       FALSE,
+                       DirectoryProperties.FileId,
+                       FileName,
+                       strlen(FileName) + 1,
+                       &Properties);
+
+    if ((!KSUCCESS(Status)) || (Properties.FileId != FileIds[FileIndex])) {
+        printf("Error: Looking up recreated %s failed. Status %d.\n",
+               FileName,
+               Status);
+
+        goto RunLookupBenchmarkEnd;
+    }
+
+    Result = TRUE;
+
+RunLookupBenchmarkEnd:
+    if (FileIds != NULL) {
+        free(FileIds);
+    }
+
+    if (ImageFile != NULL) {
+        fclose(ImageFile);
+    }
+
+    return Result;
+}
+
+BOOL
+RunWriteBenchmark (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine measures the throughput of writing one large file to a fresh
+    1GB image and spot checks a few chunks of it, then times reserving clusters
+    for a second file.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE on failure.
+
+--*/
+
+{
+
+    UINTN BytesCompleted;
+    PULONG ChunkBuffer;
+    PFAT_IO_BUFFER ChunkIoBuffer;
+    ULONG Elapsed;
+    FILE_ID FileId;
+    FAT_SEEK_INFORMATION FileSeek;
+    PVOID FileToken;
+    ULONG FillIndex;
+    FILE *ImageFile;
+    ULONGLONG Offset;
+    FILE_PROPERTIES RootProperties;
+    BOOL Result;
+    clock_t Start;
+    KSTATUS Status;
+    PVOID VolumeToken;
+
+    ChunkIoBuffer = NULL;
+    FileToken = NULL;
+    Result = FALSE;
+    ImageFile = fopen(BENCHMARK_IMAGE, "wb+");
+    if (ImageFile == NULL) {
+        printf("Unable to open benchmark image \"%s\".\n", BENCHMARK_IMAGE);
+        goto RunWriteBenchmarkEnd;
+    }
+
+    Status = FormatDisk(ImageFile,
+                        SECTOR_SIZE,
+                        BENCHMARK_DISK_SIZE / SECTOR_SIZE,
+                        &VolumeToken);
+
+    if (!KSUCCESS(Status)) {
+        goto RunWriteBenchmarkEnd;
+    }
+
+    RtlZeroMemory(&RootProperties, sizeof(FILE_PROPERTIES));
+    Status = FatLookup(VolumeToken, TRUE, 0, NULL, 0, &RootProperties);
+    if (!KSUCCESS(Status)) {
+        goto RunWriteBenchmarkEnd;
+    }
+
+    Status = CreateTestFile(VolumeToken,
+                            &RootProperties,
+                            "write.dat",
+                            &FileId,
+                            &FileToken);
+
+    if (!KSUCCESS(Status)) {
+        goto RunWriteBenchmarkEnd;
+    }
+
+    ChunkIoBuffer = FatAllocateIoBuffer(NULL, BENCHMARK_WRITE_CHUNK_SIZE);
+    if (ChunkIoBuffer == NULL) {
+        goto RunWriteBenchmarkEnd;
+    }
+
+    ChunkBuffer = FatMapIoBuffer(ChunkIoBuffer);
+    for (FillIndex = 0;
+         FillIndex < (BENCHMARK_WRITE_CHUNK_SIZE / sizeof(ULONG));
+         FillIndex += 1) {
+
+        ChunkBuffer[FillIndex] = FillIndex;
+    }
+
+    //
+    // Write the file, stamping the first word of each chunk with its offset
+    // so the spot checks can tell chunks apart.
+    //
+
+    RtlZeroMemory(&FileSeek, sizeof(FAT_SEEK_INFORMATION));
+    FatDeviceWriteCount = 0;
+    FatDeviceBlocksWritten = 0;
+    Start = clock();
+    for (Offset = 0;
+         Offset < BENCHMARK_WRITE_FILE_SIZE;
+         Offset += BENCHMARK_WRITE_CHUNK_SIZE) {
+
+        ChunkBuffer[0] = (ULONG)(Offset / BENCHMARK_WRITE_CHUNK_SIZE);
+        Status = FatWriteFile(FileToken,
+                              &FileSeek,
+                              ChunkIoBuffer,
+                              BENCHMARK_WRITE_CHUNK_SIZE,
+                              0,
+                              NULL,
+                              &BytesCompleted);
+
+        if ((!KSUCCESS(Status)) ||
+            (BytesCompleted != BENCHMARK_WRITE_CHUNK_SIZE)) {
+
+            printf("Error: Benchmark write failed at offset 0x%llx. "
+                   "Status %d.\n",
+                   Offset,
+                   Status);
+
+            goto RunWriteBenchmarkEnd;
+        }
+    }
+
+    Elapsed = GetElapsedMilliseconds(Start);
+    if (Elapsed == 0) {
+        Elapsed = 1;
+    }
+
+    printf("Write benchmark: writing a %lld MB file in %d KB chunks took %d ms "
+           "(%lld MB/s), %lld device writes of %lld blocks.\n",
+           BENCHMARK_WRITE_FILE_SIZE >> 20,
+           BENCHMARK_WRITE_CHUNK_SIZE >> 10,
+           Elapsed,
+           (BENCHMARK_WRITE_FILE_SIZE >> 20) * 1000 / Elapsed,
+           FatDeviceWriteCount,
+           FatDeviceBlocksWritten);
+
+    //
+    // Read back the first, a middle, and the last chunk.
+    //
+
+    for (Offset = 0;
+         Offset < BENCHMARK_WRITE_FILE_SIZE;
+         Offset += (BENCHMARK_WRITE_FILE_SIZE / 2) -
+                   BENCHMARK_WRITE_CHUNK_SIZE) {
+
+        Status = FatFileSeek(FileToken,
+                             NULL,
+                             0,
+                             SeekCommandFromBeginning,
+                             Offset,
+                             &FileSeek);
+
+        if (!KSUCCESS(Status)) {
+            printf("Error: Could not seek to offset 0x%llx.\n", Offset);
+            goto RunWriteBenchmarkEnd;
+        }
+
+        ChunkBuffer[0] = MAX_ULONG;
+        Status = FatReadFile(FileToken,
+                             &FileSeek,
+                             ChunkIoBuffer,
+                             BENCHMARK_WRITE_CHUNK_SIZE,
+                             0,
+                             NULL,
+                             &BytesCompleted);
+
+        if ((!KSUCCESS(Status)) ||
+            (BytesCompleted != BENCHMARK_WRITE_CHUNK_SIZE) ||
+            (ChunkBuffer[0] != (ULONG)(Offset / BENCHMARK_WRITE_CHUNK_SIZE)) ||
+            (ChunkBuffer[1] != 1)) {
+
+            printf("Error: Benchmark read back failed at offset 0x%llx. "
+                   "Status %d.\n",
+                   Offset,
+                   Status);
+
+            goto RunWriteBenchmarkEnd;
+        }
+    }
+
+    //
+    // Also time growing a second file by reserving clusters without writing
+    // them, which is nothing but cluster allocation.
+    //
+
+    FatCloseFile(FileToken);
+    FileToken = NULL;
+    Status = CreateTestFile(VolumeToken,
+                            &RootProperties,
+                            "reserve.dat",
+                            &FileId,
+                            &FileToken);
+
+    if (!KSUCCESS(Status)) {
+        goto RunWriteBenchmarkEnd;
+    }
+
+    Start = clock();
+    Status = FatAllocateFileClusters(VolumeToken,
+                                     FileId,
+                                     BENCHMARK_RESERVE_FILE_SIZE);
+
+    if (!KSUCCESS(Status)) {
+        printf("Error: Failed to reserve clusters. Status %d.\n", Status);
+        goto RunWriteBenchmarkEnd;
+    }
+
+    Elapsed = GetElapsedMilliseconds(Start);
+    printf("Reserving %lld MB of clusters for a file took %d ms.\n",
+           BENCHMARK_RESERVE_FILE_SIZE >> 20,
+           Elapsed);
+
+    Result = TRUE;
+
+RunWriteBenchmarkEnd:
+    if (FileToken != NULL) {
+        FatCloseFile(FileToken);
+    }
+
+    if (ChunkIoBuffer != NULL) {
+        FatFreeIoBuffer(ChunkIoBuffer);
+    }
+
+    if (ImageFile != NULL) {
+        fclose(ImageFile);
+    }
+
+    return Result;
+}
+
+BOOL
+RunAppendBenchmark (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine measures how many sectors are written for each cluster
+    allocated when many files are appended to in turn. Data sectors are
+    subtracted out, leaving the FAT and other metadata writes.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE on failure.
+
+--*/
+
+{
+
+    UINTN BytesCompleted;
+    PFAT_IO_BUFFER ClusterIoBuffer;
+    ULONG ClusterSize;
+    ULONGLONG DataBlocks;
+    ULONG Elapsed;
+    ULONG FileIndex;
+    FILE_ID FileId;
+    CHAR FileName[32];
+    PFAT_SEEK_INFORMATION FileSeeks;
+    PVOID *FileTokens;
+    FILE *ImageFile;
+    ULONGLONG MetadataBlocks;
+    FILE_PROPERTIES RootProperties;
+    ULONG Round;
+    BOOL Result;
+    clock_t Start;
+    KSTATUS Status;
+    PVOID VolumeToken;
+
+    ClusterIoBuffer = NULL;
+    FileSeeks = NULL;
+    FileTokens = NULL;
+    Result = FALSE;
+    ImageFile = fopen(BENCHMARK_IMAGE, "wb+");
+    if (ImageFile == NULL) {
+        printf("Unable to open benchmark image \"%s\".\n", BENCHMARK_IMAGE);
+        goto RunAppendBenchmarkEnd;
+    }
+
+    FileTokens = calloc(BENCHMARK_APPEND_FILE_COUNT, sizeof(PVOID));
+    FileSeeks = calloc(BENCHMARK_APPEND_FILE_COUNT,
+                       sizeof(FAT_SEEK_INFORMATION));
+
+    if ((FileTokens == NULL) || (FileSeeks == NULL)) {
+        goto RunAppendBenchmarkEnd;
+    }
+
+    Status = FormatDisk(ImageFile,
+                        SECTOR_SIZE,
+                        BENCHMARK_DISK_SIZE / SECTOR_SIZE,
+                        &VolumeToken);
+
+    if (!KSUCCESS(Status)) {
+        goto RunAppendBenchmarkEnd;
+    }
+
+    RtlZeroMemory(&RootProperties, sizeof(FILE_PROPERTIES));
+    Status = FatLookup(VolumeToken, TRUE, 0, NULL, 0, &RootProperties);
+    if (!KSUCCESS(Status)) {
+        goto RunAppendBenchmarkEnd;
+    }
+
+    ClusterSize = RootProperties.BlockSize;
+    ClusterIoBuffer = FatAllocateIoBuffer(NULL, ClusterSize);
+    if (ClusterIoBuffer == NULL) {
+        goto RunAppendBenchmarkEnd;
+    }
+
+    RtlZeroMemory(FatMapIoBuffer(ClusterIoBuffer), ClusterSize);
+    for (FileIndex = 0;
+         FileIndex < BENCHMARK_APPEND_FILE_COUNT;
+         FileIndex += 1) {
+
+        snprintf(FileName,
+                 sizeof(FileName),
+                 BENCHMARK_APPEND_FILE_FORMAT,
+                 FileIndex);
+
+        Status = CreateTestFile(VolumeToken,
+                                &RootProperties,
+                                FileName,
+                                &FileId,
+                                &(FileTokens[FileIndex]));
+
+        if (!KSUCCESS(Status)) {
+            goto RunAppendBenchmarkEnd;
+        }
+    }
+
+    //
+    // Each file already owns its first cluster, so the first round fills
+    // those and every round after that allocates one cluster per file.
+    //
+
+    FatDeviceWriteCount = 0;
+    FatDeviceBlocksWritten = 0;
+    Start = clock();
+    for (Round = 0; Round < BENCHMARK_APPEND_ROUNDS + 1; Round += 1) {
+        for (FileIndex = 0;
+             FileIndex < BENCHMARK_APPEND_FILE_COUNT;
+             FileIndex += 1) {
+
+            Status = FatWriteFile(FileTokens[FileIndex],
+                                  &(FileSeeks[FileIndex]),
+                                  ClusterIoBuffer,
+                                  ClusterSize,
+                                  0,
+                                  NULL,
+                                  &BytesCompleted);
+
+            if ((!KSUCCESS(Status)) || (BytesCompleted != ClusterSize)) {
+                printf("Error: Append to file %d failed. Status %d.\n",
+                       FileIndex,
+                       Status);
+
+                goto RunAppendBenchmarkEnd;
+            }
+        }
+    }
+
+    Elapsed = GetElapsedMilliseconds(Start);
+    DataBlocks = ((ULONGLONG)(BENCHMARK_APPEND_ROUNDS + 1) *
+                  BENCHMARK_APPEND_FILE_COUNT * ClusterSize) / SECTOR_SIZE;
+
+    MetadataBlocks = FatDeviceBlocksWritten - DataBlocks;
+    printf("Append benchmark: %d clusters appended across %d files took %d "
+           "ms, %lld device writes, %lld.%02lld metadata sectors written per "
+           "cluster allocated.\n",
+           BENCHMARK_APPEND_ROUNDS * BENCHMARK_APPEND_FILE_COUNT,
+           BENCHMARK_APPEND_FILE_COUNT,
+           Elapsed,
+           FatDeviceWriteCount,
+           MetadataBlocks /
+           (BENCHMARK_APPEND_ROUNDS * BENCHMARK_APPEND_FILE_COUNT),
+           (MetadataBlocks * 100 /
+            (BENCHMARK_APPEND_ROUNDS * BENCHMARK_APPEND_FILE_COUNT)) % 100);
+
+    Result = TRUE;
+
+RunAppendBenchmarkEnd:
+    if (FileTokens != NULL) {
+        for (FileIndex = 0;
+             FileIndex < BENCHMARK_APPEND_FILE_COUNT;
+             FileIndex += 1) {
+
+            if (FileTokens[FileIndex] != NULL) {
+                FatCloseFile(FileTokens[FileIndex]);
+            }
+        }
+
+        free(FileTokens);
+    }
+
+    if (FileSeeks != NULL) {
+        free(FileSeeks);
+    }
+
+    if (ClusterIoBuffer != NULL) {
+        FatFreeIoBuffer(ClusterIoBuffer);
+    }
+
+    if (ImageFile != NULL) {
+        fclose(ImageFile);
+    }
+
+    return Result;
+}
+
+ULONG
+GetElapsedMilliseconds (
+    clock_t Start
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the processor time elapsed since the given start
+    time.
+
+Arguments:
+
+    Start - Supplies the value returned by clock at the start of the interval.
+
+Return Value:
+
+    Returns the number of milliseconds elapsed.
+
+--*/
+
+{
+
+    return (ULONG)(((clock() - Start) * 1000) / CLOCKS_PER_SEC);
+}
+
 VOID
 KdPrintWithArgumentList (
     PCSTR Format,
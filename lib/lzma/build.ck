@@ -0,0 +1,55 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    LZ Library
+
+Abstract:
+
+    This module implements the LZMA and LZ4 compression formats.
+
+Environment:
+
+    Any
+
+--*/
+
+from menv import staticLibrary;
+
+function build() {
+    var buildLib;
+    var entries;
+    var lib;
+    var sources;
+
+    sources = [
+        "lz4.c",
+        "lzmadec.c",
+        "lzmaenc.c"
+    ];
+
+    lib = {
+        "label": "lzma",
+        "inputs": sources,
+    };
+
+    buildLib = {
+        "label": "build_lzma",
+        "output": "lzma",
+        "inputs": sources,
+        "build": true,
+        "prefix": "build"
+    };
+
+    entries = staticLibrary(lib);
+    entries += staticLibrary(buildLib);
+    return entries;
+}
+
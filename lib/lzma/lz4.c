@@ -0,0 +1,469 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    lz4.c
+
+Abstract:
+
+    This module implements encoding and decoding of LZ4 blocks. LZ4 trades
+    compression ratio for decode speed: a block is a series of literal runs
+    and byte-aligned back references, with no entropy coding at all.
+
+Environment:
+
+    Any
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include "lzmap.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+PUCHAR
+LzpLz4WriteLength (
+    PUCHAR Output,
+    PUCHAR OutputEnd,
+    UINTN Length
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+LZ_STATUS
+LzLz4Encode (
+    PUCHAR Destination,
+    PUINTN DestinationSize,
+    PCUCHAR Source,
+    UINTN SourceSize,
+    PLZ_CONTEXT Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine compresses the given data into a single LZ4 block.
+
+Arguments:
+
+    Destination - Supplies a pointer to the buffer where the compressed block
+        will be returned.
+
+    DestinationSize - Supplies a pointer that on input contains the size of the
+        destination buffer. On output, contains the size of the compressed
+        block. A buffer of LZ4_COMPRESS_BOUND(SourceSize) bytes is always big
+        enough.
+
+    Source - Supplies a pointer to the data to compress.
+
+    SourceSize - Supplies the number of bytes to compress.
+
+    Context - Supplies a pointer to the general LZ context, used for
+        allocation.
+
+Return Value:
+
+    LZ status.
+
+--*/
+
+{
+
+    UINTN Anchor;
+    UINTN Candidate;
+    ULONG Hash;
+    PULONG HashTable;
+    UINTN Index;
+    UINTN LiteralLength;
+    UINTN MatchLength;
+    UINTN MatchLimit;
+    PUCHAR Output;
+    PUCHAR OutputEnd;
+    UINTN Position;
+    LZ_STATUS Status;
+    PUCHAR Token;
+    ULONG Word;
+
+    HashTable = Context->Reallocate(NULL, LZ4_HASH_SIZE * sizeof(ULONG));
+    if (HashTable == NULL) {
+        return LzErrorMemory;
+    }
+
+    for (Index = 0; Index < LZ4_HASH_SIZE; Index += 1) {
+        HashTable[Index] = (ULONG)-1;
+    }
+
+    Output = Destination;
+    OutputEnd = Destination + *DestinationSize;
+    Anchor = 0;
+    Position = 0;
+
+    //
+    // Matches may not start in the last twelve bytes, and must leave the last
+    // five bytes as literals.
+    //
+
+    MatchLimit = 0;
+    if (SourceSize > LZ4_MATCH_LIMIT) {
+        MatchLimit = SourceSize - LZ4_MATCH_LIMIT;
+    }
+
+    Status = LzErrorOutputEof;
+    while (Position < MatchLimit) {
+        Word = (ULONG)Source[Position] |
+               ((ULONG)Source[Position + 1] << 8) |
+               ((ULONG)Source[Position + 2] << 16) |
+               ((ULONG)Source[Position + 3] << 24);
+
+        Hash = (Word * 2654435761U) >> (32 - LZ4_HASH_BITS);
+        Candidate = HashTable[Hash];
+        HashTable[Hash] = Position;
+        if ((Candidate == (ULONG)-1) ||
+            (Position - Candidate > LZ4_MAX_DISTANCE) ||
+            (Source[Candidate] != Source[Position]) ||
+            (Source[Candidate + 1] != Source[Position + 1]) ||
+            (Source[Candidate + 2] != Source[Position + 2]) ||
+            (Source[Candidate + 3] != Source[Position + 3])) {
+
+            Position += 1;
+            continue;
+        }
+
+        MatchLength = LZ4_MIN_MATCH;
+        while ((Position + MatchLength < SourceSize - LZ4_LAST_LITERALS) &&
+               (Source[Candidate + MatchLength] ==
+                Source[Position + MatchLength])) {
+
+            MatchLength += 1;
+        }
+
+        //
+        // Emit the token, the pending literals, and the match.
+        //
+
+        LiteralLength = Position - Anchor;
+        if (Output >= OutputEnd) {
+            goto Lz4EncodeEnd;
+        }
+
+        Token = Output;
+        Output += 1;
+        *Token = 0;
+        if (LiteralLength >= LZ4_RUN_MASK) {
+            *Token = LZ4_RUN_MASK << 4;
+            Output = LzpLz4WriteLength(Output,
+                                       OutputEnd,
+                                       LiteralLength - LZ4_RUN_MASK);
+
+        } else {
+            *Token = LiteralLength << 4;
+        }
+
+        if ((Output == NULL) ||
+            (OutputEnd - Output < LiteralLength + 2)) {
+
+            goto Lz4EncodeEnd;
+        }
+
+        for (Index = 0; Index < LiteralLength; Index += 1) {
+            Output[Index] = Source[Anchor + Index];
+        }
+
+        Output += LiteralLength;
+        Output[0] = (UCHAR)(Position - Candidate);
+        Output[1] = (UCHAR)((Position - Candidate) >> 8);
+        Output += 2;
+        if (MatchLength - LZ4_MIN_MATCH >= LZ4_RUN_MASK) {
+            *Token |= LZ4_RUN_MASK;
+            Output = LzpLz4WriteLength(
+                               Output,
+                               OutputEnd,
+                               MatchLength - LZ4_MIN_MATCH - LZ4_RUN_MASK);
+
+            if (Output == NULL) {
+                goto Lz4EncodeEnd;
+            }
+
+        } else {
+            *Token |= MatchLength - LZ4_MIN_MATCH;
+        }
+
+        Position += MatchLength;
+        Anchor = Position;
+    }
+
+    //
+    // The block always ends with a literal run, which may be empty.
+    //
+
+    LiteralLength = SourceSize - Anchor;
+    if (Output >= OutputEnd) {
+        goto Lz4EncodeEnd;
+    }
+
+    Token = Output;
+    Output += 1;
+    if (LiteralLength >= LZ4_RUN_MASK) {
+        *Token = LZ4_RUN_MASK << 4;
+        Output = LzpLz4WriteLength(Output,
+                                   OutputEnd,
+                                   LiteralLength - LZ4_RUN_MASK);
+
+        if (Output == NULL) {
+            goto Lz4EncodeEnd;
+        }
+
+    } else {
+        *Token = LiteralLength << 4;
+    }
+
+    if (OutputEnd - Output < LiteralLength) {
+        goto Lz4EncodeEnd;
+    }
+
+    for (Index = 0; Index < LiteralLength; Index += 1) {
+        Output[Index] = Source[Anchor + Index];
+    }
+
+    Output += LiteralLength;
+    *DestinationSize = Output - Destination;
+    Status = LzSuccess;
+
+Lz4EncodeEnd:
+    Context->Reallocate(HashTable, 0);
+    return Status;
+}
+
+LZ_STATUS
+LzLz4Decode (
+    PUCHAR Destination,
+    PUINTN DestinationSize,
+    PCUCHAR Source,
+    UINTN SourceSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine decompresses a single LZ4 block. Every read and write is
+    bounds checked, so corrupt input cannot overrun either buffer.
+
+Arguments:
+
+    Destination - Supplies a pointer where the uncompressed data will be
+        written.
+
+    DestinationSize - Supplies a pointer that on input contains the size of the
+        destination buffer. On output, contains the number of bytes written.
+
+    Source - Supplies a pointer to the compressed block.
+
+    SourceSize - Supplies the size of the compressed block in bytes.
+
+Return Value:
+
+    LzSuccess if the block decoded completely.
+
+    LzErrorInputEof if the block is truncated.
+
+    LzErrorOutputEof if the data does not fit in the destination buffer.
+
+    LzErrorCorruptData if a match refers to data before the start of the
+    output.
+
+--*/
+
+{
+
+    UCHAR Byte;
+    UINTN Distance;
+    PCUCHAR Input;
+    PCUCHAR InputEnd;
+    UINTN Length;
+    PUCHAR Output;
+    PUCHAR OutputEnd;
+    LZ_STATUS Status;
+    UCHAR Token;
+
+    Input = Source;
+    InputEnd = Source + SourceSize;
+    Output = Destination;
+    OutputEnd = Destination + *DestinationSize;
+    Status = LzErrorInputEof;
+    while (Input < InputEnd) {
+        Token = *Input;
+        Input += 1;
+
+        //
+        // Copy the literal run.
+        //
+
+        Length = Token >> 4;
+        if (Length == LZ4_RUN_MASK) {
+            do {
+                if (Input >= InputEnd) {
+                    goto Lz4DecodeEnd;
+                }
+
+                Byte = *Input;
+                Input += 1;
+                Length += Byte;
+
+            } while (Byte == 0xFF);
+        }
+
+        if (Length > InputEnd - Input) {
+            goto Lz4DecodeEnd;
+        }
+
+        if (Length > OutputEnd - Output) {
+            Status = LzErrorOutputEof;
+            goto Lz4DecodeEnd;
+        }
+
+        while (Length != 0) {
+            *Output = *Input;
+            Output += 1;
+            Input += 1;
+            Length -= 1;
+        }
+
+        //
+        // The last sequence has no match.
+        //
+
+        if (Input == InputEnd) {
+            Status = LzSuccess;
+            break;
+        }
+
+        if (InputEnd - Input < 2) {
+            goto Lz4DecodeEnd;
+        }
+
+        Distance = Input[0] | ((UINTN)Input[1] << 8);
+        Input += 2;
+        if ((Distance == 0) || (Distance > Output - Destination)) {
+            Status = LzErrorCorruptData;
+            goto Lz4DecodeEnd;
+        }
+
+        Length = Token & LZ4_RUN_MASK;
+        if (Length == LZ4_RUN_MASK) {
+            do {
+                if (Input >= InputEnd) {
+                    goto Lz4DecodeEnd;
+                }
+
+                Byte = *Input;
+                Input += 1;
+                Length += Byte;
+
+            } while (Byte == 0xFF);
+        }
+
+        Length += LZ4_MIN_MATCH;
+        if (Length > OutputEnd - Output) {
+            Status = LzErrorOutputEof;
+            goto Lz4DecodeEnd;
+        }
+
+        //
+        // The match may overlap the output, so copy byte by byte.
+        //
+
+        while (Length != 0) {
+            *Output = *(Output - Distance);
+            Output += 1;
+            Length -= 1;
+        }
+    }
+
+Lz4DecodeEnd:
+    *DestinationSize = Output - Destination;
+    return Status;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+PUCHAR
+LzpLz4WriteLength (
+    PUCHAR Output,
+    PUCHAR OutputEnd,
+    UINTN Length
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes the extension bytes of a literal or match length that
+    did not fit in its token nibble.
+
+Arguments:
+
+    Output - Supplies a pointer where the length bytes will be written.
+
+    OutputEnd - Supplies a pointer one beyond the end of the output buffer.
+
+    Length - Supplies the remaining length to write.
+
+Return Value:
+
+    Returns a pointer just after the written bytes on success.
+
+    NULL if the output buffer is too small.
+
+--*/
+
+{
+
+    while (Length >= 0xFF) {
+        if (Output >= OutputEnd) {
+            return NULL;
+        }
+
+        *Output = 0xFF;
+        Output += 1;
+        Length -= 0xFF;
+    }
+
+    if (Output >= OutputEnd) {
+        return NULL;
+    }
+
+    *Output = (UCHAR)Length;
+    Output += 1;
+    return Output;
+}
+
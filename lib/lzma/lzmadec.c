@@ -0,0 +1,877 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    lzmadec.c
+
+Abstract:
+
+    This module implements the LZMA decoder. The decoder works on whole
+    buffers, using the destination buffer itself as the dictionary, so it
+    needs no window allocation and never copies the output.
+
+Environment:
+
+    Any
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include "lzmap.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+/*++
+
+Structure Description:
+
+    This structure stores the state of the range decoder.
+
+Members:
+
+    Range - Stores the current range.
+
+    Code - Stores the current code value within the range.
+
+    Input - Stores a pointer to the next input byte.
+
+    InputEnd - Stores a pointer one beyond the last valid input byte.
+
+    Overrun - Stores a boolean indicating whether the decoder tried to read
+        beyond the end of the input.
+
+--*/
+
+typedef struct _LZMA_RANGE_DECODER {
+    ULONG Range;
+    ULONG Code;
+    PCUCHAR Input;
+    PCUCHAR InputEnd;
+    BOOL Overrun;
+} LZMA_RANGE_DECODER, *PLZMA_RANGE_DECODER;
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+ULONG
+LzpRangeDecodeBit (
+    PLZMA_RANGE_DECODER Decoder,
+    PLZ_PROB Probability
+    );
+
+ULONG
+LzpRangeDecodeDirectBits (
+    PLZMA_RANGE_DECODER Decoder,
+    ULONG BitCount
+    );
+
+ULONG
+LzpRangeDecodeTree (
+    PLZMA_RANGE_DECODER Decoder,
+    PLZ_PROB Probabilities,
+    ULONG BitCount
+    );
+
+ULONG
+LzpRangeDecodeReverseTree (
+    PLZMA_RANGE_DECODER Decoder,
+    PLZ_PROB Probabilities,
+    ULONG BitCount
+    );
+
+ULONG
+LzpLzmaDecodeLength (
+    PLZMA_RANGE_DECODER Decoder,
+    PLZMA_LENGTH_PROBABILITIES Probabilities,
+    ULONG PositionState
+    );
+
+ULONG
+LzpLzmaDecodeDistance (
+    PLZMA_RANGE_DECODER Decoder,
+    PLZMA_PROBABILITIES Probabilities,
+    ULONG Length
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+LZ_STATUS
+LzLzmaDecode (
+    PLZ_CONTEXT Context,
+    PUCHAR Destination,
+    PUINTN DestinationSize,
+    PCUCHAR Source,
+    PUINTN SourceSize,
+    PCUCHAR Properties,
+    ULONG PropertiesSize,
+    BOOL HasEndMark,
+    PLZ_COMPLETION_STATUS CompletionStatus
+    )
+
+/*++
+
+Routine Description:
+
+    This routine decompresses a block of LZMA encoded data in a single shot.
+    It is an error if the destination buffer is not big enough to hold the
+    decompressed data.
+
+Arguments:
+
+    Context - Supplies a pointer to the system context, which should be filled
+        out by the caller.
+
+    Destination - Supplies a pointer where the uncompressed data should be
+        written.
+
+    DestinationSize - Supplies a pointer that on input contains the size of the
+        uncompressed data buffer. On output this will be updated to contain
+        the number of valid bytes in the destination buffer.
+
+    Source - Supplies a pointer to the compressed data.
+
+    SourceSize - Supplies a pointer that on input contains the size of the
+        source buffer. On output this will be updated to contain the number of
+        source bytes consumed.
+
+    Properties - Supplies a pointer to the properties bytes.
+
+    PropertiesSize - Supplies the number of properties bytes in byte given
+        buffer.
+
+    HasEndMark - Supplies a boolean indicating whether an end mark is expected
+        within this block of data. Supply TRUE if the compressed stream was
+        finished with an end mark. Supply FALSE if the given data ends when the
+        source buffer ends.
+
+    CompletionStatus - Supplies a pointer where the completion status will be
+        returned indicating whether an end mark was found or more data is
+        expected. This field only has meaning if the decoding chews through
+        the entire source buffer.
+
+Return Value:
+
+    Returns an LZ status code indicating overall success or failure.
+
+--*/
+
+{
+
+    ULONG Bit;
+    LZMA_RANGE_DECODER Decoder;
+    ULONG Distance;
+    UINTN Index;
+    ULONG Lc;
+    ULONG Length;
+    PLZ_PROB Literal;
+    ULONG LiteralMask;
+    ULONG Lp;
+    ULONG MatchBit;
+    ULONG MatchByte;
+    UINTN OutputEnd;
+    UINTN OutputSize;
+    ULONG Pb;
+    ULONG PositionMask;
+    ULONG PositionState;
+    UCHAR PreviousByte;
+    PLZMA_PROBABILITIES Probabilities;
+    ULONG PropertyByte;
+    ULONG Rep[LZMA_REP_COUNT];
+    ULONG State;
+    LZ_STATUS Status;
+    ULONG Symbol;
+
+    *CompletionStatus = LzCompletionNotSpecified;
+    OutputEnd = *DestinationSize;
+    OutputSize = 0;
+    Probabilities = NULL;
+    Decoder.Input = Source;
+    Decoder.InputEnd = Source + *SourceSize;
+    Decoder.Overrun = FALSE;
+    if (PropertiesSize < LZMA_PROPERTIES_SIZE) {
+        Status = LzErrorUnsupported;
+        goto LzmaDecodeEnd;
+    }
+
+    PropertyByte = Properties[0];
+    if (PropertyByte >= (9 * 5 * 5)) {
+        Status = LzErrorUnsupported;
+        goto LzmaDecodeEnd;
+    }
+
+    Lc = PropertyByte % 9;
+    PropertyByte /= 9;
+    Lp = PropertyByte % 5;
+    Pb = PropertyByte / 5;
+
+    //
+    // The dictionary size in the properties is irrelevant here since the
+    // entire destination buffer serves as the dictionary.
+    //
+
+    if (*SourceSize < 5) {
+        Status = LzErrorInputEof;
+        goto LzmaDecodeEnd;
+    }
+
+    if (Source[0] != 0) {
+        Status = LzErrorCorruptData;
+        goto LzmaDecodeEnd;
+    }
+
+    Decoder.Range = 0xFFFFFFFF;
+    Decoder.Code = ((ULONG)Source[1] << 24) | ((ULONG)Source[2] << 16) |
+                   ((ULONG)Source[3] << 8) | Source[4];
+
+    Decoder.Input += 5;
+    if (Decoder.Code == Decoder.Range) {
+        Status = LzErrorCorruptData;
+        goto LzmaDecodeEnd;
+    }
+
+    Probabilities = LzpLzmaCreateProbabilities(Context, Lc, Lp);
+    if (Probabilities == NULL) {
+        Status = LzErrorMemory;
+        goto LzmaDecodeEnd;
+    }
+
+    LiteralMask = (1 << Lp) - 1;
+    PositionMask = (1 << Pb) - 1;
+    for (Index = 0; Index < LZMA_REP_COUNT; Index += 1) {
+        Rep[Index] = 0;
+    }
+
+    State = 0;
+    Status = LzSuccess;
+    while (TRUE) {
+        if (Decoder.Overrun != FALSE) {
+            Status = LzErrorInputEof;
+            break;
+        }
+
+        //
+        // Without an end mark, the block ends when the output is full. With
+        // one, the mark may still be omitted if the output is exactly full
+        // and the range coder is finished.
+        //
+
+        if ((OutputSize == OutputEnd) &&
+            ((HasEndMark == FALSE) || (Decoder.Code == 0))) {
+
+            *CompletionStatus = LzCompletionMaybeFinishedWithoutMark;
+            break;
+        }
+
+        PositionState = OutputSize & PositionMask;
+        Bit = LzpRangeDecodeBit(
+                             &Decoder,
+                             &(Probabilities->IsMatch[State][PositionState]));
+
+        //
+        // Decode a literal, using the byte at the last match distance to
+        // steer the probabilities if a match was the previous packet.
+        //
+
+        if (Bit == 0) {
+            if (OutputSize == OutputEnd) {
+                Status = LzErrorOutputEof;
+                break;
+            }
+
+            PreviousByte = 0;
+            if (OutputSize != 0) {
+                PreviousByte = Destination[OutputSize - 1];
+            }
+
+            Literal = Probabilities->Literal +
+                      0x300 * ((((OutputSize & LiteralMask) << Lc) +
+                                (PreviousByte >> (8 - Lc))));
+
+            Symbol = 1;
+            if (LZMA_STATE_IS_LITERAL(State) == FALSE) {
+                MatchByte = Destination[OutputSize - Rep[0] - 1];
+                do {
+                    MatchBit = (MatchByte >> 7) & 0x1;
+                    MatchByte <<= 1;
+                    Bit = LzpRangeDecodeBit(
+                                &Decoder,
+                                &(Literal[((1 + MatchBit) << 8) + Symbol]));
+
+                    Symbol = (Symbol << 1) | Bit;
+                    if (MatchBit != Bit) {
+                        break;
+                    }
+
+                } while (Symbol < 0x100);
+            }
+
+            while (Symbol < 0x100) {
+                Symbol = (Symbol << 1) |
+                         LzpRangeDecodeBit(&Decoder, &(Literal[Symbol]));
+            }
+
+            Destination[OutputSize] = (UCHAR)Symbol;
+            OutputSize += 1;
+            State = LZMA_NEXT_STATE_LITERAL(State);
+            continue;
+        }
+
+        //
+        // Decode a rep match, which reuses one of the last four distances.
+        //
+
+        Bit = LzpRangeDecodeBit(&Decoder, &(Probabilities->IsRep[State]));
+        if (Bit != 0) {
+            if ((OutputSize == OutputEnd) || (OutputSize == 0)) {
+                Status = LzErrorCorruptData;
+                break;
+            }
+
+            Bit = LzpRangeDecodeBit(&Decoder, &(Probabilities->IsRepG0[State]));
+            if (Bit == 0) {
+                Bit = LzpRangeDecodeBit(
+                          &Decoder,
+                          &(Probabilities->IsRep0Long[State][PositionState]));
+
+                //
+                // A short rep is a single byte from the last distance.
+                //
+
+                if (Bit == 0) {
+                    State = LZMA_NEXT_STATE_SHORT_REP(State);
+                    Destination[OutputSize] =
+                                       Destination[OutputSize - Rep[0] - 1];
+
+                    OutputSize += 1;
+                    continue;
+                }
+
+            } else {
+                Bit = LzpRangeDecodeBit(&Decoder,
+                                        &(Probabilities->IsRepG1[State]));
+
+                if (Bit == 0) {
+                    Distance = Rep[1];
+
+                } else {
+                    Bit = LzpRangeDecodeBit(&Decoder,
+                                            &(Probabilities->IsRepG2[State]));
+
+                    if (Bit == 0) {
+                        Distance = Rep[2];
+
+                    } else {
+                        Distance = Rep[3];
+                        Rep[3] = Rep[2];
+                    }
+
+                    Rep[2] = Rep[1];
+                }
+
+                Rep[1] = Rep[0];
+                Rep[0] = Distance;
+            }
+
+            Length = LzpLzmaDecodeLength(&Decoder,
+                                         &(Probabilities->RepLength),
+                                         PositionState);
+
+            State = LZMA_NEXT_STATE_REP(State);
+
+        //
+        // Decode a plain match with a new distance.
+        //
+
+        } else {
+            Rep[3] = Rep[2];
+            Rep[2] = Rep[1];
+            Rep[1] = Rep[0];
+            Length = LzpLzmaDecodeLength(&Decoder,
+                                         &(Probabilities->Length),
+                                         PositionState);
+
+            State = LZMA_NEXT_STATE_MATCH(State);
+            Rep[0] = LzpLzmaDecodeDistance(&Decoder, Probabilities, Length);
+            if (Rep[0] == LZMA_END_MARK_DISTANCE) {
+                if (Decoder.Code != 0) {
+                    Status = LzErrorCorruptData;
+
+                } else {
+                    *CompletionStatus = LzCompletionFinishedWithMark;
+                }
+
+                break;
+            }
+
+            if (OutputSize == OutputEnd) {
+                Status = LzErrorOutputEof;
+                break;
+            }
+        }
+
+        //
+        // Copy the match out of the already decoded data. The source and
+        // destination may overlap, so go byte by byte.
+        //
+
+        if (Rep[0] >= OutputSize) {
+            Status = LzErrorCorruptData;
+            break;
+        }
+
+        Length += LZMA_MATCH_MIN;
+        if (Length > OutputEnd - OutputSize) {
+            Status = LzErrorOutputEof;
+            break;
+        }
+
+        Distance = Rep[0] + 1;
+        while (Length != 0) {
+            Destination[OutputSize] = Destination[OutputSize - Distance];
+            OutputSize += 1;
+            Length -= 1;
+        }
+    }
+
+    if ((Status == LzSuccess) && (Decoder.Overrun != FALSE)) {
+        Status = LzErrorInputEof;
+    }
+
+LzmaDecodeEnd:
+    if (Probabilities != NULL) {
+        Context->Reallocate(Probabilities, 0);
+    }
+
+    *DestinationSize = OutputSize;
+    *SourceSize = Decoder.Input - Source;
+    if (Decoder.Input > Decoder.InputEnd) {
+        *SourceSize = Decoder.InputEnd - Source;
+    }
+
+    return Status;
+}
+
+PLZMA_PROBABILITIES
+LzpLzmaCreateProbabilities (
+    PLZ_CONTEXT Context,
+    ULONG Lc,
+    ULONG Lp
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates and initializes an LZMA probability model.
+
+Arguments:
+
+    Context - Supplies a pointer to the LZ context, used for allocation.
+
+    Lc - Supplies the number of literal context bits.
+
+    Lp - Supplies the number of literal position bits.
+
+Return Value:
+
+    Returns a pointer to the new model on success. The caller is responsible
+    for freeing it with the context's reallocate routine.
+
+    NULL on allocation failure.
+
+--*/
+
+{
+
+    UINTN Count;
+    UINTN Index;
+    PLZ_PROB Probability;
+    PLZMA_PROBABILITIES Probabilities;
+    UINTN Size;
+
+    //
+    // The literal probabilities are carved out of the same allocation, right
+    // after the fixed portion of the model.
+    //
+
+    Count = LZMA_LITERAL_PROBABILITY_COUNT(Lc, Lp);
+    Size = sizeof(LZMA_PROBABILITIES) + (Count * sizeof(LZ_PROB));
+    Probabilities = Context->Reallocate(NULL, Size);
+    if (Probabilities == NULL) {
+        return NULL;
+    }
+
+    Probabilities->Literal = (PLZ_PROB)(Probabilities + 1);
+    Probability = (PLZ_PROB)Probabilities;
+    Count = (PUCHAR)&(Probabilities->Literal) - (PUCHAR)Probabilities;
+    Count /= sizeof(LZ_PROB);
+    for (Index = 0; Index < Count; Index += 1) {
+        Probability[Index] = LZMA_PROBABILITY_INITIAL;
+    }
+
+    Count = LZMA_LITERAL_PROBABILITY_COUNT(Lc, Lp);
+    Probability = Probabilities->Literal;
+    for (Index = 0; Index < Count; Index += 1) {
+        Probability[Index] = LZMA_PROBABILITY_INITIAL;
+    }
+
+    return Probabilities;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+ULONG
+LzpRangeDecodeBit (
+    PLZMA_RANGE_DECODER Decoder,
+    PLZ_PROB Probability
+    )
+
+/*++
+
+Routine Description:
+
+    This routine decodes a single bit and adapts its probability.
+
+Arguments:
+
+    Decoder - Supplies a pointer to the range decoder.
+
+    Probability - Supplies a pointer to the probability of the bit being zero.
+
+Return Value:
+
+    Returns the decoded bit.
+
+--*/
+
+{
+
+    ULONG Bit;
+    ULONG Bound;
+
+    Bound = (Decoder->Range >> LZMA_PROBABILITY_BITS) * *Probability;
+    if (Decoder->Code < Bound) {
+        Decoder->Range = Bound;
+        *Probability += (LZMA_PROBABILITY_TOTAL - *Probability) >>
+                        LZMA_MOVE_BITS;
+
+        Bit = 0;
+
+    } else {
+        Decoder->Range -= Bound;
+        Decoder->Code -= Bound;
+        *Probability -= *Probability >> LZMA_MOVE_BITS;
+        Bit = 1;
+    }
+
+    //
+    // Reading past the end of the input shifts in zeros and flags the
+    // overrun, which the main loop turns into an error.
+    //
+
+    if (Decoder->Range < LZMA_TOP_VALUE) {
+        Decoder->Range <<= 8;
+        Decoder->Code <<= 8;
+        if (Decoder->Input < Decoder->InputEnd) {
+            Decoder->Code |= *(Decoder->Input);
+
+        } else {
+            Decoder->Overrun = TRUE;
+        }
+
+        Decoder->Input += 1;
+    }
+
+    return Bit;
+}
+
+ULONG
+LzpRangeDecodeDirectBits (
+    PLZMA_RANGE_DECODER Decoder,
+    ULONG BitCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine decodes bits that were coded with a fixed probability of one
+    half.
+
+Arguments:
+
+    Decoder - Supplies a pointer to the range decoder.
+
+    BitCount - Supplies the number of bits to decode.
+
+Return Value:
+
+    Returns the decoded bits, most significant bit first.
+
+--*/
+
+{
+
+    ULONG Mask;
+    ULONG Result;
+
+    Result = 0;
+    while (BitCount != 0) {
+        Decoder->Range >>= 1;
+        Decoder->Code -= Decoder->Range;
+        Mask = 0 - (Decoder->Code >> 31);
+        Decoder->Code += Decoder->Range & Mask;
+        Result = (Result << 1) + (Mask + 1);
+        if (Decoder->Range < LZMA_TOP_VALUE) {
+            Decoder->Range <<= 8;
+            Decoder->Code <<= 8;
+            if (Decoder->Input < Decoder->InputEnd) {
+                Decoder->Code |= *(Decoder->Input);
+
+            } else {
+                Decoder->Overrun = TRUE;
+            }
+
+            Decoder->Input += 1;
+        }
+
+        BitCount -= 1;
+    }
+
+    return Result;
+}
+
+ULONG
+LzpRangeDecodeTree (
+    PLZMA_RANGE_DECODER Decoder,
+    PLZ_PROB Probabilities,
+    ULONG BitCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine decodes a symbol from a bit tree, most significant bit first.
+
+Arguments:
+
+    Decoder - Supplies a pointer to the range decoder.
+
+    Probabilities - Supplies a pointer to the tree probabilities. Index zero is
+        unused.
+
+    BitCount - Supplies the number of bits in the symbol.
+
+Return Value:
+
+    Returns the decoded symbol.
+
+--*/
+
+{
+
+    ULONG Index;
+    ULONG Node;
+
+    Node = 1;
+    for (Index = 0; Index < BitCount; Index += 1) {
+        Node = (Node << 1) + LzpRangeDecodeBit(Decoder, &(Probabilities[Node]));
+    }
+
+    return Node - (1 << BitCount);
+}
+
+ULONG
+LzpRangeDecodeReverseTree (
+    PLZMA_RANGE_DECODER Decoder,
+    PLZ_PROB Probabilities,
+    ULONG BitCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine decodes a symbol from a bit tree, least significant bit first.
+
+Arguments:
+
+    Decoder - Supplies a pointer to the range decoder.
+
+    Probabilities - Supplies a pointer to the tree probabilities. Index zero is
+        unused.
+
+    BitCount - Supplies the number of bits in the symbol.
+
+Return Value:
+
+    Returns the decoded symbol.
+
+--*/
+
+{
+
+    ULONG Bit;
+    ULONG Index;
+    ULONG Node;
+    ULONG Symbol;
+
+    Node = 1;
+    Symbol = 0;
+    for (Index = 0; Index < BitCount; Index += 1) {
+        Bit = LzpRangeDecodeBit(Decoder, &(Probabilities[Node]));
+        Node = (Node << 1) + Bit;
+        Symbol |= Bit << Index;
+    }
+
+    return Symbol;
+}
+
+ULONG
+LzpLzmaDecodeLength (
+    PLZMA_RANGE_DECODER Decoder,
+    PLZMA_LENGTH_PROBABILITIES Probabilities,
+    ULONG PositionState
+    )
+
+/*++
+
+Routine Description:
+
+    This routine decodes a match length.
+
+Arguments:
+
+    Decoder - Supplies a pointer to the range decoder.
+
+    Probabilities - Supplies a pointer to the length probabilities to use.
+
+    PositionState - Supplies the current position state.
+
+Return Value:
+
+    Returns the match length, minus the minimum match length.
+
+--*/
+
+{
+
+    ULONG Length;
+
+    if (LzpRangeDecodeBit(Decoder, &(Probabilities->Choice)) == 0) {
+        return LzpRangeDecodeTree(Decoder,
+                                  Probabilities->Low[PositionState],
+                                  LZMA_LENGTH_LOW_BITS);
+    }
+
+    if (LzpRangeDecodeBit(Decoder, &(Probabilities->Choice2)) == 0) {
+        Length = LzpRangeDecodeTree(Decoder,
+                                    Probabilities->Mid[PositionState],
+                                    LZMA_LENGTH_MID_BITS);
+
+        return LZMA_LENGTH_LOW_SYMBOLS + Length;
+    }
+
+    Length = LzpRangeDecodeTree(Decoder,
+                                Probabilities->High,
+                                LZMA_LENGTH_HIGH_BITS);
+
+    return LZMA_LENGTH_LOW_SYMBOLS + LZMA_LENGTH_MID_SYMBOLS + Length;
+}
+
+ULONG
+LzpLzmaDecodeDistance (
+    PLZMA_RANGE_DECODER Decoder,
+    PLZMA_PROBABILITIES Probabilities,
+    ULONG Length
+    )
+
+/*++
+
+Routine Description:
+
+    This routine decodes a match distance.
+
+Arguments:
+
+    Decoder - Supplies a pointer to the range decoder.
+
+    Probabilities - Supplies a pointer to the probability model.
+
+    Length - Supplies the match length minus the minimum match length, which
+        selects the slot probabilities.
+
+Return Value:
+
+    Returns the match distance, minus one.
+
+--*/
+
+{
+
+    ULONG DirectBitCount;
+    ULONG Distance;
+    ULONG LengthState;
+    ULONG Slot;
+
+    LengthState = Length;
+    if (LengthState > LZMA_LENGTH_TO_POSITION_STATES - 1) {
+        LengthState = LZMA_LENGTH_TO_POSITION_STATES - 1;
+    }
+
+    Slot = LzpRangeDecodeTree(Decoder,
+                              Probabilities->PositionSlot[LengthState],
+                              LZMA_POSITION_SLOT_BITS);
+
+    if (Slot < LZMA_START_POSITION_MODEL_INDEX) {
+        return Slot;
+    }
+
+    DirectBitCount = (Slot >> 1) - 1;
+    Distance = (2 | (Slot & 0x1)) << DirectBitCount;
+    if (Slot < LZMA_END_POSITION_MODEL_INDEX) {
+        Distance += LzpRangeDecodeReverseTree(
+                        Decoder,
+                        Probabilities->SpecialPosition + Distance - Slot,
+                        DirectBitCount);
+
+    } else {
+        Distance += LzpRangeDecodeDirectBits(
+                                      Decoder,
+                                      DirectBitCount - LZMA_ALIGN_BITS) <<
+                    LZMA_ALIGN_BITS;
+
+        Distance += LzpRangeDecodeReverseTree(Decoder,
+                                              Probabilities->Align,
+                                              LZMA_ALIGN_BITS);
+    }
+
+    return Distance;
+}
+
@@ -0,0 +1,1314 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    lzmaenc.c
+
+Abstract:
+
+    This module implements a block LZMA encoder. It uses a hash chain match
+    finder and greedy parsing, which produces standard LZMA streams at a
+    somewhat lower ratio than the optimal parser in the 7zip encoder. It is
+    intended for build tools packing firmware images.
+
+Environment:
+
+    Build
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include "lzmap.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the number of hash chain heads. Three byte prefixes are hashed into
+// this many buckets.
+//
+
+#define LZMA_HASH_BITS 16
+#define LZMA_HASH_SIZE (1 << LZMA_HASH_BITS)
+
+//
+// Define the value used for an empty hash chain link.
+//
+
+#define LZMA_NO_POSITION ((ULONG)-1)
+
+//
+// Define the largest distance for which a two byte match is worth coding.
+//
+
+#define LZMA_SHORT_MATCH_DISTANCE 0x80
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+/*++
+
+Structure Description:
+
+    This structure stores the state of the range encoder.
+
+Members:
+
+    Low - Stores the low end of the current range. Bit 32 holds a pending
+        carry.
+
+    Range - Stores the current range.
+
+    Cache - Stores the last byte shifted out, which is held back in case a
+        carry needs to propagate into it.
+
+    CacheSize - Stores the number of bytes pending output: the cache byte plus
+        any 0xFF bytes a carry would ripple through.
+
+    Output - Stores a pointer to the next output byte.
+
+    OutputEnd - Stores a pointer one beyond the end of the output buffer.
+
+    Overflow - Stores a boolean indicating whether the output buffer was too
+        small.
+
+--*/
+
+typedef struct _LZMA_RANGE_ENCODER {
+    ULONGLONG Low;
+    ULONG Range;
+    UCHAR Cache;
+    ULONGLONG CacheSize;
+    PUCHAR Output;
+    PUCHAR OutputEnd;
+    BOOL Overflow;
+} LZMA_RANGE_ENCODER, *PLZMA_RANGE_ENCODER;
+
+/*++
+
+Structure Description:
+
+    This structure stores the state of the LZMA encoder.
+
+Members:
+
+    Range - Stores the range encoder.
+
+    Probabilities - Stores a pointer to the probability model.
+
+    Source - Stores a pointer to the data being compressed.
+
+    SourceSize - Stores the number of bytes of source data.
+
+    Head - Stores the most recent position for each hash value.
+
+    Chain - Stores the previous position with the same hash, indexed by
+        position modulo the window size.
+
+    WindowSize - Stores the number of entries in the chain array, which is
+        also the largest distance searched.
+
+    FastBytes - Stores the match length at which the search stops early.
+
+    MatchCount - Stores the number of chain links followed per search.
+
+    Lc - Stores the number of literal context bits.
+
+    Lp - Stores the number of literal position bits.
+
+    Pb - Stores the number of position bits.
+
+    State - Stores the current coder state.
+
+    Rep - Stores the last four match distances, minus one.
+
+--*/
+
+typedef struct _LZMA_ENCODER {
+    LZMA_RANGE_ENCODER Range;
+    PLZMA_PROBABILITIES Probabilities;
+    PCUCHAR Source;
+    UINTN SourceSize;
+    PULONG Head;
+    PULONG Chain;
+    ULONG WindowSize;
+    ULONG FastBytes;
+    ULONG MatchCount;
+    ULONG Lc;
+    ULONG Lp;
+    ULONG Pb;
+    ULONG State;
+    ULONG Rep[LZMA_REP_COUNT];
+} LZMA_ENCODER, *PLZMA_ENCODER;
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+VOID
+LzpRangeEncodeBit (
+    PLZMA_RANGE_ENCODER Encoder,
+    PLZ_PROB Probability,
+    ULONG Bit
+    );
+
+VOID
+LzpRangeEncodeDirectBits (
+    PLZMA_RANGE_ENCODER Encoder,
+    ULONG Value,
+    ULONG BitCount
+    );
+
+VOID
+LzpRangeEncodeTree (
+    PLZMA_RANGE_ENCODER Encoder,
+    PLZ_PROB Probabilities,
+    ULONG BitCount,
+    ULONG Symbol
+    );
+
+VOID
+LzpRangeEncodeReverseTree (
+    PLZMA_RANGE_ENCODER Encoder,
+    PLZ_PROB Probabilities,
+    ULONG BitCount,
+    ULONG Symbol
+    );
+
+VOID
+LzpRangeEncoderShiftLow (
+    PLZMA_RANGE_ENCODER Encoder
+    );
+
+VOID
+LzpLzmaEncodeLiteral (
+    PLZMA_ENCODER Encoder,
+    UINTN Position
+    );
+
+VOID
+LzpLzmaEncodeMatch (
+    PLZMA_ENCODER Encoder,
+    UINTN Position,
+    ULONG Distance,
+    ULONG Length
+    );
+
+VOID
+LzpLzmaEncodeRepMatch (
+    PLZMA_ENCODER Encoder,
+    UINTN Position,
+    ULONG RepIndex,
+    ULONG Length
+    );
+
+VOID
+LzpLzmaEncodeLength (
+    PLZMA_RANGE_ENCODER Encoder,
+    PLZMA_LENGTH_PROBABILITIES Probabilities,
+    ULONG Length,
+    ULONG PositionState
+    );
+
+ULONG
+LzpLzmaFindMatch (
+    PLZMA_ENCODER Encoder,
+    UINTN Position,
+    PULONG Distance
+    );
+
+ULONG
+LzpLzmaMatchLength (
+    PLZMA_ENCODER Encoder,
+    UINTN Position,
+    UINTN Candidate
+    );
+
+VOID
+LzpLzmaInsertPosition (
+    PLZMA_ENCODER Encoder,
+    UINTN Position
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+VOID
+LzLzmaEncoderInitializeProperties (
+    PLZMA_ENCODER_PROPERTIES Properties
+    )
+
+/*++
+
+Routine Description:
+
+    This routine initializes LZMA encoder properties to their defaults.
+
+Arguments:
+
+    Properties - Supplies a pointer to the properties to initialize.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    Properties->Level = 5;
+    Properties->DictionarySize = 1 << 24;
+    Properties->ReduceSize = -1ULL;
+    Properties->Lc = 3;
+    Properties->Lp = 0;
+    Properties->Pb = 2;
+    Properties->Algorithm = 1;
+    Properties->FastBytes = 32;
+    Properties->BinTreeMode = TRUE;
+    Properties->HashByteCount = 4;
+    Properties->MatchCount = 32;
+    Properties->WriteEndMark = FALSE;
+    Properties->ThreadCount = 2;
+    return;
+}
+
+LZ_STATUS
+LzLzmaEncode (
+    PUCHAR Destination,
+    PUINTN DestinationSize,
+    PCUCHAR Source,
+    UINTN SourceSize,
+    PLZMA_ENCODER_PROPERTIES Properties,
+    PUCHAR EncodedProperties,
+    PUINTN EncodedPropertiesSize,
+    BOOL WriteEndMark,
+    PLZ_CONTEXT Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine LZMA encodes the given data block.
+
+Arguments:
+
+    Destination - Supplies a pointer to buffer where the compressed data will
+        be returned.
+
+    DestinationSize - Supplies a pointer that on input contains the size of the
+        destination buffer. On output, will contain the size of the encoded
+        data.
+
+    Source - Supplies a pointer to the data to compress.
+
+    SourceSize - Supplies the number of bytes in the source buffer.
+
+    Properties - Supplies a pointer to the encoding properties. Only the
+        dictionary size, lc, lp, pb, fast bytes, and match count properties
+        are honored; the match finder is always a hash chain.
+
+    EncodedProperties - Supplies a pointer where the encoded properties will be
+        returned on success.
+
+    EncodedPropertiesSize - Supplies a pointer that on input contains the size
+        of the encoded properties buffer. On output, contains the size of the
+        encoded properties.
+
+    WriteEndMark - Supplies a boolean indicating whether or not to write an
+        end marker.
+
+    Context - Supplies a pointer to the general LZ context.
+
+Return Value:
+
+    LZ status.
+
+--*/
+
+{
+
+    ULONG Distance;
+    LZMA_ENCODER Encoder;
+    UINTN Index;
+    ULONG Length;
+    ULONG MainLength;
+    UINTN Position;
+    ULONG RepIndex;
+    ULONG RepLength;
+    BOOL Searched;
+    LZ_STATUS Status;
+    ULONG WindowSize;
+
+    if ((Properties->Lc < 0) || (Properties->Lc > LZMA_LC_MAX) ||
+        (Properties->Lp < 0) || (Properties->Lp > LZMA_LP_MAX) ||
+        (Properties->Pb < 0) || (Properties->Pb > LZMA_PB_MAX) ||
+        (Properties->DictionarySize < LZMA_MINIMUM_DICT_SIZE) ||
+        (Properties->FastBytes < 5) ||
+        (Properties->FastBytes > LZMA_MATCH_MAX) ||
+        (Properties->MatchCount == 0)) {
+
+        return LzErrorInvalidParameter;
+    }
+
+    if (*EncodedPropertiesSize < LZMA_PROPERTIES_SIZE) {
+        return LzErrorInvalidParameter;
+    }
+
+    EncodedProperties[0] = (((Properties->Pb * 5) + Properties->Lp) * 9) +
+                           Properties->Lc;
+
+    EncodedProperties[1] = (UCHAR)Properties->DictionarySize;
+    EncodedProperties[2] = (UCHAR)(Properties->DictionarySize >> 8);
+    EncodedProperties[3] = (UCHAR)(Properties->DictionarySize >> 16);
+    EncodedProperties[4] = (UCHAR)(Properties->DictionarySize >> 24);
+    *EncodedPropertiesSize = LZMA_PROPERTIES_SIZE;
+
+    //
+    // The chain only needs to cover the smaller of the dictionary and the
+    // input, since no match can reach further back than either.
+    //
+
+    WindowSize = Properties->DictionarySize;
+    if (WindowSize > SourceSize) {
+        WindowSize = SourceSize;
+        if (WindowSize == 0) {
+            WindowSize = 1;
+        }
+    }
+
+    Encoder.Range.Low = 0;
+    Encoder.Range.Range = 0xFFFFFFFF;
+    Encoder.Range.Cache = 0;
+    Encoder.Range.CacheSize = 1;
+    Encoder.Range.Output = Destination;
+    Encoder.Range.OutputEnd = Destination + *DestinationSize;
+    Encoder.Range.Overflow = FALSE;
+    Encoder.Source = Source;
+    Encoder.SourceSize = SourceSize;
+    Encoder.WindowSize = WindowSize;
+    Encoder.FastBytes = Properties->FastBytes;
+    Encoder.MatchCount = Properties->MatchCount;
+    Encoder.Lc = Properties->Lc;
+    Encoder.Lp = Properties->Lp;
+    Encoder.Pb = Properties->Pb;
+    Encoder.State = 0;
+    for (Index = 0; Index < LZMA_REP_COUNT; Index += 1) {
+        Encoder.Rep[Index] = 0;
+    }
+
+    Encoder.Chain = NULL;
+    Encoder.Head = NULL;
+    Encoder.Probabilities = LzpLzmaCreateProbabilities(Context,
+                                                       Encoder.Lc,
+                                                       Encoder.Lp);
+
+    if (Encoder.Probabilities == NULL) {
+        Status = LzErrorMemory;
+        goto LzmaEncodeEnd;
+    }
+
+    Encoder.Head = Context->Reallocate(NULL, LZMA_HASH_SIZE * sizeof(ULONG));
+    Encoder.Chain = Context->Reallocate(NULL, WindowSize * sizeof(ULONG));
+    if ((Encoder.Head == NULL) || (Encoder.Chain == NULL)) {
+        Status = LzErrorMemory;
+        goto LzmaEncodeEnd;
+    }
+
+    for (Index = 0; Index < LZMA_HASH_SIZE; Index += 1) {
+        Encoder.Head[Index] = LZMA_NO_POSITION;
+    }
+
+    Position = 0;
+    while (Position < SourceSize) {
+
+        //
+        // Look for the longest match among the recent distances first, since
+        // those are cheaper to code than a new distance.
+        //
+
+        RepLength = 0;
+        RepIndex = 0;
+        for (Index = 0; Index < LZMA_REP_COUNT; Index += 1) {
+            if (Encoder.Rep[Index] >= Position) {
+                continue;
+            }
+
+            Length = LzpLzmaMatchLength(&Encoder,
+                                        Position,
+                                        Position - Encoder.Rep[Index] - 1);
+
+            if (Length > RepLength) {
+                RepLength = Length;
+                RepIndex = Index;
+            }
+        }
+
+        MainLength = 0;
+        Distance = 0;
+        Searched = FALSE;
+        if (RepLength < Encoder.FastBytes) {
+            Searched = TRUE;
+            MainLength = LzpLzmaFindMatch(&Encoder, Position, &Distance);
+            if ((MainLength == LZMA_MATCH_MIN) &&
+                (Distance >= LZMA_SHORT_MATCH_DISTANCE)) {
+
+                MainLength = 0;
+            }
+        }
+
+        //
+        // Prefer a rep match unless a new match is clearly longer.
+        //
+
+        if ((RepLength >= LZMA_MATCH_MIN) && (RepLength + 1 >= MainLength)) {
+            LzpLzmaEncodeRepMatch(&Encoder, Position, RepIndex, RepLength);
+            Length = RepLength;
+
+        } else if (MainLength >= LZMA_MATCH_MIN) {
+            LzpLzmaEncodeMatch(&Encoder, Position, Distance, MainLength);
+            Length = MainLength;
+
+        } else {
+            LzpLzmaEncodeLiteral(&Encoder, Position);
+            Length = 1;
+        }
+
+        //
+        // Add every covered position to the match finder. The first one was
+        // already added by the search.
+        //
+
+        if (Searched == FALSE) {
+            LzpLzmaInsertPosition(&Encoder, Position);
+        }
+
+        for (Index = 1; Index < Length; Index += 1) {
+            LzpLzmaInsertPosition(&Encoder, Position + Index);
+        }
+
+        Position += Length;
+        if (Encoder.Range.Overflow != FALSE) {
+            break;
+        }
+    }
+
+    if (WriteEndMark != FALSE) {
+        LzpLzmaEncodeMatch(&Encoder,
+                           Position,
+                           LZMA_END_MARK_DISTANCE,
+                           LZMA_MATCH_MIN);
+    }
+
+    for (Index = 0; Index < 5; Index += 1) {
+        LzpRangeEncoderShiftLow(&(Encoder.Range));
+    }
+
+    if (Encoder.Range.Overflow != FALSE) {
+        Status = LzErrorOutputEof;
+        goto LzmaEncodeEnd;
+    }
+
+    *DestinationSize = Encoder.Range.Output - Destination;
+    Status = LzSuccess;
+
+LzmaEncodeEnd:
+    if (Encoder.Probabilities != NULL) {
+        Context->Reallocate(Encoder.Probabilities, 0);
+    }
+
+    if (Encoder.Head != NULL) {
+        Context->Reallocate(Encoder.Head, 0);
+    }
+
+    if (Encoder.Chain != NULL) {
+        Context->Reallocate(Encoder.Chain, 0);
+    }
+
+    return Status;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+VOID
+LzpRangeEncodeBit (
+    PLZMA_RANGE_ENCODER Encoder,
+    PLZ_PROB Probability,
+    ULONG Bit
+    )
+
+/*++
+
+Routine Description:
+
+    This routine encodes a single bit and adapts its probability.
+
+Arguments:
+
+    Encoder - Supplies a pointer to the range encoder.
+
+    Probability - Supplies a pointer to the probability of the bit being zero.
+
+    Bit - Supplies the bit to encode.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Bound;
+
+    Bound = (Encoder->Range >> LZMA_PROBABILITY_BITS) * *Probability;
+    if (Bit == 0) {
+        Encoder->Range = Bound;
+        *Probability += (LZMA_PROBABILITY_TOTAL - *Probability) >>
+                        LZMA_MOVE_BITS;
+
+    } else {
+        Encoder->Low += Bound;
+        Encoder->Range -= Bound;
+        *Probability -= *Probability >> LZMA_MOVE_BITS;
+    }
+
+    while (Encoder->Range < LZMA_TOP_VALUE) {
+        Encoder->Range <<= 8;
+        LzpRangeEncoderShiftLow(Encoder);
+    }
+
+    return;
+}
+
+VOID
+LzpRangeEncodeDirectBits (
+    PLZMA_RANGE_ENCODER Encoder,
+    ULONG Value,
+    ULONG BitCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine encodes bits with a fixed probability of one half.
+
+Arguments:
+
+    Encoder - Supplies a pointer to the range encoder.
+
+    Value - Supplies the bits to encode.
+
+    BitCount - Supplies the number of bits to encode, most significant first.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    while (BitCount != 0) {
+        BitCount -= 1;
+        Encoder->Range >>= 1;
+        if (((Value >> BitCount) & 0x1) != 0) {
+            Encoder->Low += Encoder->Range;
+        }
+
+        while (Encoder->Range < LZMA_TOP_VALUE) {
+            Encoder->Range <<= 8;
+            LzpRangeEncoderShiftLow(Encoder);
+        }
+    }
+
+    return;
+}
+
+VOID
+LzpRangeEncodeTree (
+    PLZMA_RANGE_ENCODER Encoder,
+    PLZ_PROB Probabilities,
+    ULONG BitCount,
+    ULONG Symbol
+    )
+
+/*++
+
+Routine Description:
+
+    This routine encodes a symbol with a bit tree, most significant bit first.
+
+Arguments:
+
+    Encoder - Supplies a pointer to the range encoder.
+
+    Probabilities - Supplies a pointer to the tree probabilities. Index zero is
+        unused.
+
+    BitCount - Supplies the number of bits in the symbol.
+
+    Symbol - Supplies the symbol to encode.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Bit;
+    ULONG Node;
+
+    Node = 1;
+    while (BitCount != 0) {
+        BitCount -= 1;
+        Bit = (Symbol >> BitCount) & 0x1;
+        LzpRangeEncodeBit(Encoder, &(Probabilities[Node]), Bit);
+        Node = (Node << 1) | Bit;
+    }
+
+    return;
+}
+
+VOID
+LzpRangeEncodeReverseTree (
+    PLZMA_RANGE_ENCODER Encoder,
+    PLZ_PROB Probabilities,
+    ULONG BitCount,
+    ULONG Symbol
+    )
+
+/*++
+
+Routine Description:
+
+    This routine encodes a symbol with a bit tree, least significant bit
+    first.
+
+Arguments:
+
+    Encoder - Supplies a pointer to the range encoder.
+
+    Probabilities - Supplies a pointer to the tree probabilities. Index zero is
+        unused.
+
+    BitCount - Supplies the number of bits in the symbol.
+
+    Symbol - Supplies the symbol to encode.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Bit;
+    ULONG Node;
+
+    Node = 1;
+    while (BitCount != 0) {
+        Bit = Symbol & 0x1;
+        LzpRangeEncodeBit(Encoder, &(Probabilities[Node]), Bit);
+        Node = (Node << 1) | Bit;
+        Symbol >>= 1;
+        BitCount -= 1;
+    }
+
+    return;
+}
+
+VOID
+LzpRangeEncoderShiftLow (
+    PLZMA_RANGE_ENCODER Encoder
+    )
+
+/*++
+
+Routine Description:
+
+    This routine shifts the top byte out of the low value, resolving any
+    pending carry into the cached bytes.
+
+Arguments:
+
+    Encoder - Supplies a pointer to the range encoder.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UCHAR Byte;
+
+    if (((ULONG)Encoder->Low < 0xFF000000) || ((Encoder->Low >> 32) != 0)) {
+        Byte = Encoder->Cache;
+        do {
+            if (Encoder->Output < Encoder->OutputEnd) {
+                *(Encoder->Output) = Byte + (UCHAR)(Encoder->Low >> 32);
+                Encoder->Output += 1;
+
+            } else {
+                Encoder->Overflow = TRUE;
+            }
+
+            Byte = 0xFF;
+            Encoder->CacheSize -= 1;
+
+        } while (Encoder->CacheSize != 0);
+
+        Encoder->Cache = (UCHAR)((ULONG)Encoder->Low >> 24);
+    }
+
+    Encoder->CacheSize += 1;
+    Encoder->Low = (ULONG)Encoder->Low << 8;
+    return;
+}
+
+VOID
+LzpLzmaEncodeLiteral (
+    PLZMA_ENCODER Encoder,
+    UINTN Position
+    )
+
+/*++
+
+Routine Description:
+
+    This routine encodes the byte at the given position as a literal.
+
+Arguments:
+
+    Encoder - Supplies a pointer to the encoder.
+
+    Position - Supplies the position of the byte to encode.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Bit;
+    ULONG Byte;
+    ULONG Index;
+    PLZ_PROB Literal;
+    BOOL Matched;
+    ULONG MatchBit;
+    ULONG MatchByte;
+    ULONG PositionState;
+    UCHAR PreviousByte;
+    ULONG Symbol;
+
+    PositionState = Position & ((1 << Encoder->Pb) - 1);
+    LzpRangeEncodeBit(
+              &(Encoder->Range),
+              &(Encoder->Probabilities->IsMatch[Encoder->State][PositionState]),
+              0);
+
+    PreviousByte = 0;
+    if (Position != 0) {
+        PreviousByte = Encoder->Source[Position - 1];
+    }
+
+    Literal = Encoder->Probabilities->Literal +
+              0x300 * ((((Position & ((1 << Encoder->Lp) - 1)) <<
+                         Encoder->Lc) +
+                        (PreviousByte >> (8 - Encoder->Lc))));
+
+    Byte = Encoder->Source[Position];
+    Matched = FALSE;
+    MatchByte = 0;
+    if (LZMA_STATE_IS_LITERAL(Encoder->State) == FALSE) {
+        Matched = TRUE;
+        MatchByte = Encoder->Source[Position - Encoder->Rep[0] - 1];
+    }
+
+    //
+    // After a match, the byte at the last distance steers the probabilities
+    // until the first bit that differs from it.
+    //
+
+    Symbol = 1;
+    for (Index = 8; Index != 0; Index -= 1) {
+        Bit = (Byte >> (Index - 1)) & 0x1;
+        if (Matched != FALSE) {
+            MatchBit = (MatchByte >> (Index - 1)) & 0x1;
+            LzpRangeEncodeBit(&(Encoder->Range),
+                              &(Literal[((1 + MatchBit) << 8) + Symbol]),
+                              Bit);
+
+            if (MatchBit != Bit) {
+                Matched = FALSE;
+            }
+
+        } else {
+            LzpRangeEncodeBit(&(Encoder->Range), &(Literal[Symbol]), Bit);
+        }
+
+        Symbol = (Symbol << 1) | Bit;
+    }
+
+    Encoder->State = LZMA_NEXT_STATE_LITERAL(Encoder->State);
+    return;
+}
+
+VOID
+LzpLzmaEncodeMatch (
+    PLZMA_ENCODER Encoder,
+    UINTN Position,
+    ULONG Distance,
+    ULONG Length
+    )
+
+/*++
+
+Routine Description:
+
+    This routine encodes a match with a new distance.
+
+Arguments:
+
+    Encoder - Supplies a pointer to the encoder.
+
+    Position - Supplies the position the match starts at.
+
+    Distance - Supplies the match distance minus one.
+
+    Length - Supplies the match length.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG DirectBitCount;
+    ULONG LengthState;
+    ULONG PositionState;
+    PLZMA_PROBABILITIES Probabilities;
+    ULONG Reduced;
+    ULONG Slot;
+
+    Probabilities = Encoder->Probabilities;
+    PositionState = Position & ((1 << Encoder->Pb) - 1);
+    LzpRangeEncodeBit(&(Encoder->Range),
+                      &(Probabilities->IsMatch[Encoder->State][PositionState]),
+                      1);
+
+    LzpRangeEncodeBit(&(Encoder->Range),
+                      &(Probabilities->IsRep[Encoder->State]),
+                      0);
+
+    Length -= LZMA_MATCH_MIN;
+    LzpLzmaEncodeLength(&(Encoder->Range),
+                        &(Probabilities->Length),
+                        Length,
+                        PositionState);
+
+    //
+    // The slot is the position of the highest set bit of the distance plus
+    // the bit below it.
+    //
+
+    if (Distance < LZMA_START_POSITION_MODEL_INDEX) {
+        Slot = Distance;
+
+    } else {
+        Slot = 31;
+        while ((Distance & (1U << Slot)) == 0) {
+            Slot -= 1;
+        }
+
+        Slot = (Slot << 1) | ((Distance >> (Slot - 1)) & 0x1);
+    }
+
+    LengthState = Length;
+    if (LengthState > LZMA_LENGTH_TO_POSITION_STATES - 1) {
+        LengthState = LZMA_LENGTH_TO_POSITION_STATES - 1;
+    }
+
+    LzpRangeEncodeTree(&(Encoder->Range),
+                       Probabilities->PositionSlot[LengthState],
+                       LZMA_POSITION_SLOT_BITS,
+                       Slot);
+
+    if (Slot >= LZMA_START_POSITION_MODEL_INDEX) {
+        DirectBitCount = (Slot >> 1) - 1;
+        Reduced = Distance - ((2 | (Slot & 0x1)) << DirectBitCount);
+        if (Slot < LZMA_END_POSITION_MODEL_INDEX) {
+            LzpRangeEncodeReverseTree(
+                                &(Encoder->Range),
+                                Probabilities->SpecialPosition +
+                                ((2 | (Slot & 0x1)) << DirectBitCount) - Slot,
+                                DirectBitCount,
+                                Reduced);
+
+        } else {
+            LzpRangeEncodeDirectBits(&(Encoder->Range),
+                                     Reduced >> LZMA_ALIGN_BITS,
+                                     DirectBitCount - LZMA_ALIGN_BITS);
+
+            LzpRangeEncodeReverseTree(&(Encoder->Range),
+                                      Probabilities->Align,
+                                      LZMA_ALIGN_BITS,
+                                      Reduced & (LZMA_ALIGN_SIZE - 1));
+        }
+    }
+
+    Encoder->Rep[3] = Encoder->Rep[2];
+    Encoder->Rep[2] = Encoder->Rep[1];
+    Encoder->Rep[1] = Encoder->Rep[0];
+    Encoder->Rep[0] = Distance;
+    Encoder->State = LZMA_NEXT_STATE_MATCH(Encoder->State);
+    return;
+}
+
+VOID
+LzpLzmaEncodeRepMatch (
+    PLZMA_ENCODER Encoder,
+    UINTN Position,
+    ULONG RepIndex,
+    ULONG Length
+    )
+
+/*++
+
+Routine Description:
+
+    This routine encodes a match that reuses one of the last four distances.
+
+Arguments:
+
+    Encoder - Supplies a pointer to the encoder.
+
+    Position - Supplies the position the match starts at.
+
+    RepIndex - Supplies the index of the recent distance to reuse.
+
+    Length - Supplies the match length.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Distance;
+    ULONG Index;
+    ULONG PositionState;
+    PLZMA_PROBABILITIES Probabilities;
+    ULONG State;
+
+    Probabilities = Encoder->Probabilities;
+    PositionState = Position & ((1 << Encoder->Pb) - 1);
+    State = Encoder->State;
+    LzpRangeEncodeBit(&(Encoder->Range),
+                      &(Probabilities->IsMatch[State][PositionState]),
+                      1);
+
+    LzpRangeEncodeBit(&(Encoder->Range), &(Probabilities->IsRep[State]), 1);
+    if (RepIndex == 0) {
+        LzpRangeEncodeBit(&(Encoder->Range),
+                          &(Probabilities->IsRepG0[State]),
+                          0);
+
+        LzpRangeEncodeBit(&(Encoder->Range),
+                          &(Probabilities->IsRep0Long[State][PositionState]),
+                          1);
+
+    } else {
+        LzpRangeEncodeBit(&(Encoder->Range),
+                          &(Probabilities->IsRepG0[State]),
+                          1);
+
+        if (RepIndex == 1) {
+            LzpRangeEncodeBit(&(Encoder->Range),
+                              &(Probabilities->IsRepG1[State]),
+                              0);
+
+        } else {
+            LzpRangeEncodeBit(&(Encoder->Range),
+                              &(Probabilities->IsRepG1[State]),
+                              1);
+
+            LzpRangeEncodeBit(&(Encoder->Range),
+                              &(Probabilities->IsRepG2[State]),
+                              RepIndex - 2);
+        }
+
+        Distance = Encoder->Rep[RepIndex];
+        for (Index = RepIndex; Index != 0; Index -= 1) {
+            Encoder->Rep[Index] = Encoder->Rep[Index - 1];
+        }
+
+        Encoder->Rep[0] = Distance;
+    }
+
+    LzpLzmaEncodeLength(&(Encoder->Range),
+                        &(Probabilities->RepLength),
+                        Length - LZMA_MATCH_MIN,
+                        PositionState);
+
+    Encoder->State = LZMA_NEXT_STATE_REP(State);
+    return;
+}
+
+VOID
+LzpLzmaEncodeLength (
+    PLZMA_RANGE_ENCODER Encoder,
+    PLZMA_LENGTH_PROBABILITIES Probabilities,
+    ULONG Length,
+    ULONG PositionState
+    )
+
+/*++
+
+Routine Description:
+
+    This routine encodes a match length.
+
+Arguments:
+
+    Encoder - Supplies a pointer to the range encoder.
+
+    Probabilities - Supplies a pointer to the length probabilities to use.
+
+    Length - Supplies the match length minus the minimum match length.
+
+    PositionState - Supplies the current position state.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    if (Length < LZMA_LENGTH_LOW_SYMBOLS) {
+        LzpRangeEncodeBit(Encoder, &(Probabilities->Choice), 0);
+        LzpRangeEncodeTree(Encoder,
+                           Probabilities->Low[PositionState],
+                           LZMA_LENGTH_LOW_BITS,
+                           Length);
+
+        return;
+    }
+
+    LzpRangeEncodeBit(Encoder, &(Probabilities->Choice), 1);
+    Length -= LZMA_LENGTH_LOW_SYMBOLS;
+    if (Length < LZMA_LENGTH_MID_SYMBOLS) {
+        LzpRangeEncodeBit(Encoder, &(Probabilities->Choice2), 0);
+        LzpRangeEncodeTree(Encoder,
+                           Probabilities->Mid[PositionState],
+                           LZMA_LENGTH_MID_BITS,
+                           Length);
+
+        return;
+    }
+
+    LzpRangeEncodeBit(Encoder, &(Probabilities->Choice2), 1);
+    LzpRangeEncodeTree(Encoder,
+                       Probabilities->High,
+                       LZMA_LENGTH_HIGH_BITS,
+                       Length - LZMA_LENGTH_MID_SYMBOLS);
+
+    return;
+}
+
+ULONG
+LzpLzmaFindMatch (
+    PLZMA_ENCODER Encoder,
+    UINTN Position,
+    PULONG Distance
+    )
+
+/*++
+
+Routine Description:
+
+    This routine searches the hash chain for the longest match at the given
+    position, and adds the position to the chain.
+
+Arguments:
+
+    Encoder - Supplies a pointer to the encoder.
+
+    Position - Supplies the position to find a match for.
+
+    Distance - Supplies a pointer where the distance of the best match minus
+        one will be returned.
+
+Return Value:
+
+    Returns the length of the best match, or zero if there is none.
+
+--*/
+
+{
+
+    ULONG BestLength;
+    ULONG Candidate;
+    ULONG Hash;
+    ULONG Length;
+    ULONG Links;
+
+    BestLength = 0;
+    if (Position + 3 > Encoder->SourceSize) {
+        return 0;
+    }
+
+    Hash = ((ULONG)Encoder->Source[Position] << 16) |
+           ((ULONG)Encoder->Source[Position + 1] << 8) |
+           Encoder->Source[Position + 2];
+
+    Hash = (Hash * 2654435761U) >> (32 - LZMA_HASH_BITS);
+    Candidate = Encoder->Head[Hash];
+    Links = Encoder->MatchCount;
+    while ((Candidate != LZMA_NO_POSITION) && (Links != 0)) {
+        if (Position - Candidate > Encoder->WindowSize) {
+            break;
+        }
+
+        Length = LzpLzmaMatchLength(Encoder, Position, Candidate);
+        if (Length > BestLength) {
+            BestLength = Length;
+            *Distance = Position - Candidate - 1;
+            if (Length >= Encoder->FastBytes) {
+                break;
+            }
+        }
+
+        Candidate = Encoder->Chain[Candidate % Encoder->WindowSize];
+        Links -= 1;
+    }
+
+    Encoder->Chain[Position % Encoder->WindowSize] = Encoder->Head[Hash];
+    Encoder->Head[Hash] = Position;
+    return BestLength;
+}
+
+ULONG
+LzpLzmaMatchLength (
+    PLZMA_ENCODER Encoder,
+    UINTN Position,
+    UINTN Candidate
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines how many bytes at the given position match the
+    bytes at an earlier position.
+
+Arguments:
+
+    Encoder - Supplies a pointer to the encoder.
+
+    Position - Supplies the current position.
+
+    Candidate - Supplies the earlier position to compare against.
+
+Return Value:
+
+    Returns the match length, capped at the longest length LZMA can code.
+
+--*/
+
+{
+
+    ULONG Length;
+    UINTN Limit;
+
+    Limit = Encoder->SourceSize - Position;
+    if (Limit > LZMA_MATCH_MAX) {
+        Limit = LZMA_MATCH_MAX;
+    }
+
+    Length = 0;
+    while ((Length < Limit) &&
+           (Encoder->Source[Candidate + Length] ==
+            Encoder->Source[Position + Length])) {
+
+        Length += 1;
+    }
+
+    return Length;
+}
+
+VOID
+LzpLzmaInsertPosition (
+    PLZMA_ENCODER Encoder,
+    UINTN Position
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a position to the hash chains without searching.
+
+Arguments:
+
+    Encoder - Supplies a pointer to the encoder.
+
+    Position - Supplies the position to add.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Hash;
+
+    if (Position + 3 > Encoder->SourceSize) {
+        return;
+    }
+
+    Hash = ((ULONG)Encoder->Source[Position] << 16) |
+           ((ULONG)Encoder->Source[Position + 1] << 8) |
+           Encoder->Source[Position + 2];
+
+    Hash = (Hash * 2654435761U) >> (32 - LZMA_HASH_BITS);
+    Encoder->Chain[Position % Encoder->WindowSize] = Encoder->Head[Hash];
+    Encoder->Head[Hash] = Position;
+    return;
+}
+
@@ -0,0 +1,261 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    lzmap.h
+
+Abstract:
+
+    This header contains internal definitions for the LZ compression library.
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <minoca/lib/types.h>
+#include <minoca/lib/lzma.h>
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+//
+// This macro returns the next state after a literal, match, rep match, or
+// short rep is coded in the given state.
+//
+
+#define LZMA_NEXT_STATE_LITERAL(_State) \
+    (((_State) < 4) ? 0 : (((_State) < 10) ? ((_State) - 3) : ((_State) - 6)))
+
+#define LZMA_NEXT_STATE_MATCH(_State) (((_State) < 7) ? 7 : 10)
+#define LZMA_NEXT_STATE_REP(_State) (((_State) < 7) ? 8 : 11)
+#define LZMA_NEXT_STATE_SHORT_REP(_State) (((_State) < 7) ? 9 : 11)
+
+//
+// This macro evaluates to non-zero if the previous packet coded in the given
+// state was a literal, in which case literals are coded without a match byte.
+//
+
+#define LZMA_STATE_IS_LITERAL(_State) ((_State) < 7)
+
+//
+// This macro returns the size of the literal probability array for the given
+// lc and lp values.
+//
+
+#define LZMA_LITERAL_PROBABILITY_COUNT(_Lc, _Lp) (0x300 << ((_Lc) + (_Lp)))
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the number of bytes in the encoded properties.
+//
+
+#define LZMA_PROPERTIES_SIZE 5
+
+//
+// Define the range coder constants.
+//
+
+#define LZMA_TOP_VALUE (1 << 24)
+#define LZMA_PROBABILITY_BITS 11
+#define LZMA_PROBABILITY_TOTAL (1 << LZMA_PROBABILITY_BITS)
+#define LZMA_PROBABILITY_INITIAL (LZMA_PROBABILITY_TOTAL / 2)
+#define LZMA_MOVE_BITS 5
+
+//
+// Define the model dimensions.
+//
+
+#define LZMA_STATE_COUNT 12
+#define LZMA_POSITION_BITS_MAX 4
+#define LZMA_POSITION_STATES_MAX (1 << LZMA_POSITION_BITS_MAX)
+#define LZMA_LC_MAX 8
+#define LZMA_LP_MAX 4
+#define LZMA_PB_MAX 4
+
+#define LZMA_LENGTH_LOW_BITS 3
+#define LZMA_LENGTH_MID_BITS 3
+#define LZMA_LENGTH_HIGH_BITS 8
+#define LZMA_LENGTH_LOW_SYMBOLS (1 << LZMA_LENGTH_LOW_BITS)
+#define LZMA_LENGTH_MID_SYMBOLS (1 << LZMA_LENGTH_MID_BITS)
+#define LZMA_LENGTH_HIGH_SYMBOLS (1 << LZMA_LENGTH_HIGH_BITS)
+
+#define LZMA_MATCH_MIN 2
+#define LZMA_MATCH_MAX                                                        \
+    (LZMA_MATCH_MIN + LZMA_LENGTH_LOW_SYMBOLS + LZMA_LENGTH_MID_SYMBOLS +    \
+     LZMA_LENGTH_HIGH_SYMBOLS - 1)
+
+#define LZMA_LENGTH_TO_POSITION_STATES 4
+#define LZMA_POSITION_SLOT_BITS 6
+#define LZMA_START_POSITION_MODEL_INDEX 4
+#define LZMA_END_POSITION_MODEL_INDEX 14
+#define LZMA_FULL_DISTANCES (1 << (LZMA_END_POSITION_MODEL_INDEX >> 1))
+#define LZMA_ALIGN_BITS 4
+#define LZMA_ALIGN_SIZE (1 << LZMA_ALIGN_BITS)
+#define LZMA_REP_COUNT 4
+
+//
+// Define the distance that marks the end of the stream.
+//
+
+#define LZMA_END_MARK_DISTANCE 0xFFFFFFFF
+
+//
+// Define the LZ4 block format constants. The last match must start at least
+// twelve bytes before the end of the block, and the last five bytes are
+// always literals.
+//
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_MATCH_LIMIT 12
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MAX_DISTANCE 0xFFFF
+#define LZ4_RUN_MASK 0x0F
+#define LZ4_HASH_BITS 12
+#define LZ4_HASH_SIZE (1 << LZ4_HASH_BITS)
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+typedef USHORT LZ_PROB, *PLZ_PROB;
+
+/*++
+
+Structure Description:
+
+    This structure stores the adaptive probabilities used to code a match
+    length.
+
+Members:
+
+    Choice - Stores the probability that the length is not a low length.
+
+    Choice2 - Stores the probability that a non-low length is a high length.
+
+    Low - Stores the bit trees for lengths 0 through 7, per position state.
+
+    Mid - Stores the bit trees for lengths 8 through 15, per position state.
+
+    High - Stores the bit tree for lengths 16 through 271.
+
+--*/
+
+typedef struct _LZMA_LENGTH_PROBABILITIES {
+    LZ_PROB Choice;
+    LZ_PROB Choice2;
+    LZ_PROB Low[LZMA_POSITION_STATES_MAX][LZMA_LENGTH_LOW_SYMBOLS];
+    LZ_PROB Mid[LZMA_POSITION_STATES_MAX][LZMA_LENGTH_MID_SYMBOLS];
+    LZ_PROB High[LZMA_LENGTH_HIGH_SYMBOLS];
+} LZMA_LENGTH_PROBABILITIES, *PLZMA_LENGTH_PROBABILITIES;
+
+/*++
+
+Structure Description:
+
+    This structure stores the complete LZMA probability model. It is shared by
+    the encoder and decoder, which must update it identically.
+
+Members:
+
+    IsMatch - Stores the probabilities that the next packet is a match rather
+        than a literal, per state and position state.
+
+    IsRep - Stores the probabilities that a match is a rep match.
+
+    IsRepG0 - Stores the probabilities that a rep match does not use rep0.
+
+    IsRepG1 - Stores the probabilities that a rep match does not use rep1.
+
+    IsRepG2 - Stores the probabilities that a rep match does not use rep2.
+
+    IsRep0Long - Stores the probabilities that a rep0 match is longer than a
+        single byte, per state and position state.
+
+    PositionSlot - Stores the bit trees for the distance slot, per length
+        state.
+
+    SpecialPosition - Stores the reverse bit trees for the low bits of
+        distances in the middle slots.
+
+    Align - Stores the reverse bit tree for the low four bits of large
+        distances.
+
+    Length - Stores the length probabilities for normal matches.
+
+    RepLength - Stores the length probabilities for rep matches.
+
+    Literal - Stores a pointer to the literal probabilities, which are sized
+        according to the lc and lp properties.
+
+--*/
+
+typedef struct _LZMA_PROBABILITIES {
+    LZ_PROB IsMatch[LZMA_STATE_COUNT][LZMA_POSITION_STATES_MAX];
+    LZ_PROB IsRep[LZMA_STATE_COUNT];
+    LZ_PROB IsRepG0[LZMA_STATE_COUNT];
+    LZ_PROB IsRepG1[LZMA_STATE_COUNT];
+    LZ_PROB IsRepG2[LZMA_STATE_COUNT];
+    LZ_PROB IsRep0Long[LZMA_STATE_COUNT][LZMA_POSITION_STATES_MAX];
+    LZ_PROB PositionSlot[LZMA_LENGTH_TO_POSITION_STATES]
+                        [1 << LZMA_POSITION_SLOT_BITS];
+
+    LZ_PROB SpecialPosition[1 + LZMA_FULL_DISTANCES -
+                            LZMA_END_POSITION_MODEL_INDEX];
+
+    LZ_PROB Align[LZMA_ALIGN_SIZE];
+    LZMA_LENGTH_PROBABILITIES Length;
+    LZMA_LENGTH_PROBABILITIES RepLength;
+    PLZ_PROB Literal;
+} LZMA_PROBABILITIES, *PLZMA_PROBABILITIES;
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// -------------------------------------------------------- Function Prototypes
+//
+
+PLZMA_PROBABILITIES
+LzpLzmaCreateProbabilities (
+    PLZ_CONTEXT Context,
+    ULONG Lc,
+    ULONG Lp
+    );
+
+/*++
+
+Routine Description:
+
+    This routine allocates and initializes an LZMA probability model.
+
+Arguments:
+
+    Context - Supplies a pointer to the LZ context, used for allocation.
+
+    Lc - Supplies the number of literal context bits.
+
+    Lp - Supplies the number of literal position bits.
+
+Return Value:
+
+    Returns a pointer to the new model on success. The caller is responsible
+    for freeing it with the context's reallocate routine.
+
+    NULL on allocation failure.
+
+--*/
+
@@ -0,0 +1,51 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    LZ Test
+
+Abstract:
+
+    This program tests the LZ compression library in an application.
+
+Environment:
+
+    Test
+
+--*/
+
+from menv import application;
+
+function build() {
+    var buildApp;
+    var buildLibs;
+    var entries;
+    var sources;
+
+    sources = [
+        "lzmatest.c"
+    ];
+
+    buildLibs = [
+        "lib/lzma:build_lzma"
+    ];
+
+    buildApp = {
+        "label": "build_lzmatest",
+        "output": "lzmatest",
+        "inputs": sources + buildLibs,
+        "build": true,
+        "prefix": "build"
+    };
+
+    entries = application(buildApp);
+    return entries;
+}
+
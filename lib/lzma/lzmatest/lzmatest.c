@@ -0,0 +1,947 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    lzmatest.c
+
+Abstract:
+
+    This module implements the LZ library test program. It round trips a set
+    of generated buffers through the LZMA and LZ4 encoders and decoders, and
+    makes sure damaged input is rejected without overrunning any buffer.
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <minoca/lib/types.h>
+#include <minoca/lib/lzma.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+#define USAGE_STRING \
+    "Lzmatest will test the LZMA and LZ4 implementations.\n\n" \
+    "Usage: lzmatest [-v] [-b]\n\n" \
+    "    -v  Verbose mode\n" \
+    "    -b  Run the decode benchmarks after the tests\n\n" \
+
+//
+// Define the number of damaged copies of each buffer to try decoding.
+//
+
+#define CORRUPTION_ITERATIONS 16
+
+//
+// Define the guard bytes placed after each decode buffer to catch overruns.
+//
+
+#define GUARD_SIZE 64
+#define GUARD_BYTE 0xA5
+
+//
+// Define the benchmark parameters.
+//
+
+#define BENCHMARK_SIZE (1024 * 1024 * 4)
+#define BENCHMARK_ITERATIONS 16
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+#define VPRINT(_Format, _Args...)       \
+    {                                   \
+                                        \
+        if (LzTestVerbose != FALSE) {   \
+            printf(_Format, ## _Args);  \
+        }                               \
+    }
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+typedef enum _TEST_PATTERN {
+    TestPatternZero,
+    TestPatternRandom,
+    TestPatternText,
+    TestPatternCode,
+    TestPatternCount
+} TEST_PATTERN, *PTEST_PATTERN;
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+ULONG
+TestRoundTrip (
+    PUCHAR Buffer,
+    UINTN Size,
+    PCSTR Description
+    );
+
+ULONG
+TestLzma (
+    PUCHAR Buffer,
+    UINTN Size,
+    PLZMA_ENCODER_PROPERTIES Properties,
+    BOOL EndMark,
+    PCSTR Description
+    );
+
+ULONG
+TestLz4 (
+    PUCHAR Buffer,
+    UINTN Size,
+    PCSTR Description
+    );
+
+BOOL
+CheckGuard (
+    PUCHAR Buffer,
+    UINTN Size
+    );
+
+VOID
+FillBuffer (
+    PUCHAR Buffer,
+    UINTN Size,
+    TEST_PATTERN Pattern
+    );
+
+VOID
+RunDecodeBenchmark (
+    VOID
+    );
+
+PVOID
+TestReallocate (
+    PVOID Allocation,
+    UINTN NewSize
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+BOOL LzTestVerbose = FALSE;
+
+LZ_CONTEXT LzTestContext = {
+    NULL,
+    TestReallocate,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
+
+PCSTR LzTestPatternNames[TestPatternCount] = {
+    "zero",
+    "random",
+    "text",
+    "code"
+};
+
+PCSTR LzTestWords[] = {
+    "firmware", "volume", "section", "driver", "protocol", "handle", "the",
+    "image", "loaded", "memory", "boot", "services", "event", "of", "a",
+    "timer", "console", "device", "path", "variable", "runtime", "to"
+};
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+INT
+main (
+    INT ArgumentCount,
+    CHAR **Arguments
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is the main entry point for the program.
+
+Arguments:
+
+    ArgumentCount - Supplies the number of command line arguments the program
+        was invoked with.
+
+    Arguments - Supplies a tokenized array of command line arguments.
+
+Return Value:
+
+    Returns an integer exit code. 0 for success, nonzero otherwise.
+
+--*/
+
+{
+
+    PSTR Argument;
+    BOOL Benchmark;
+    PUCHAR Buffer;
+    CHAR Description[64];
+    ULONG Failures;
+    TEST_PATTERN Pattern;
+    UINTN Size;
+    UINTN Sizes[] = {0, 1, 2, 5, 13, 17, 100, 255, 4096, 65536, 300000};
+    ULONG SizeIndex;
+
+    Benchmark = FALSE;
+    Failures = 0;
+    srand(time(NULL));
+    while ((ArgumentCount > 1) && (Arguments[1][0] == '-')) {
+        Argument = &(Arguments[1][1]);
+        if (strcmp(Argument, "v") == 0) {
+            LzTestVerbose = TRUE;
+
+        } else if (strcmp(Argument, "b") == 0) {
+            Benchmark = TRUE;
+
+        } else {
+            printf("%s: Invalid option\n\n%s", Argument, USAGE_STRING);
+            return 1;
+        }
+
+        ArgumentCount -= 1;
+        Arguments += 1;
+    }
+
+    for (SizeIndex = 0;
+         SizeIndex < sizeof(Sizes) / sizeof(Sizes[0]);
+         SizeIndex += 1) {
+
+        Size = Sizes[SizeIndex];
+        Buffer = malloc(Size + 1);
+        if (Buffer == NULL) {
+            printf("Error: Failed to allocate %ld bytes.\n", (long)Size);
+            return 1;
+        }
+
+        for (Pattern = 0; Pattern < TestPatternCount; Pattern += 1) {
+            FillBuffer(Buffer, Size, Pattern);
+            snprintf(Description,
+                     sizeof(Description),
+                     "%s %ld",
+                     LzTestPatternNames[Pattern],
+                     (long)Size);
+
+            Failures += TestRoundTrip(Buffer, Size, Description);
+        }
+
+        free(Buffer);
+    }
+
+    if (Failures != 0) {
+        printf("*** %d failure(s) in LZ test. ***\n", Failures);
+        return Failures;
+    }
+
+    printf("All LZ tests passed.\n");
+    if (Benchmark != FALSE) {
+        RunDecodeBenchmark();
+    }
+
+    return 0;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+ULONG
+TestRoundTrip (
+    PUCHAR Buffer,
+    UINTN Size,
+    PCSTR Description
+    )
+
+/*++
+
+Routine Description:
+
+    This routine round trips the given buffer through both codecs with a
+    handful of different LZMA settings.
+
+Arguments:
+
+    Buffer - Supplies a pointer to the data to test.
+
+    Size - Supplies the size of the data in bytes.
+
+    Description - Supplies a description of the data for failure messages.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    ULONG Failures;
+    LZMA_ENCODER_PROPERTIES Properties;
+
+    Failures = 0;
+    LzLzmaEncoderInitializeProperties(&Properties);
+    Failures += TestLzma(Buffer, Size, &Properties, FALSE, Description);
+    Failures += TestLzma(Buffer, Size, &Properties, TRUE, Description);
+
+    //
+    // Exercise the literal position bits, a different position mask, a tiny
+    // dictionary, and a short match search.
+    //
+
+    Properties.Lc = 0;
+    Properties.Lp = 2;
+    Properties.Pb = 0;
+    Properties.DictionarySize = LZMA_MINIMUM_DICT_SIZE;
+    Properties.FastBytes = 5;
+    Properties.MatchCount = 1;
+    Failures += TestLzma(Buffer, Size, &Properties, FALSE, Description);
+    Properties.Lc = 8;
+    Properties.Lp = 0;
+    Properties.Pb = 4;
+    Properties.FastBytes = 273;
+    Properties.MatchCount = 256;
+    Failures += TestLzma(Buffer, Size, &Properties, TRUE, Description);
+    Failures += TestLz4(Buffer, Size, Description);
+    return Failures;
+}
+
+ULONG
+TestLzma (
+    PUCHAR Buffer,
+    UINTN Size,
+    PLZMA_ENCODER_PROPERTIES Properties,
+    BOOL EndMark,
+    PCSTR Description
+    )
+
+/*++
+
+Routine Description:
+
+    This routine round trips the given buffer through the LZMA codec, then
+    tries decoding truncated and damaged copies of the encoded data.
+
+Arguments:
+
+    Buffer - Supplies a pointer to the data to test.
+
+    Size - Supplies the size of the data in bytes.
+
+    Properties - Supplies the encoder properties to use.
+
+    EndMark - Supplies a boolean indicating whether to write an end mark.
+
+    Description - Supplies a description of the data for failure messages.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    PUCHAR Compressed;
+    UINTN CompressedSize;
+    LZ_COMPLETION_STATUS Completion;
+    PUCHAR Damaged;
+    UINTN DecodedSize;
+    PUCHAR Decompressed;
+    UCHAR EncodedProperties[LZMA_HEADER_SIZE];
+    UINTN EncodedPropertiesSize;
+    ULONG Failures;
+    ULONG Iteration;
+    UINTN SourceSize;
+    LZ_STATUS Status;
+
+    Failures = 0;
+    CompressedSize = Size + (Size / 2) + 64;
+    Compressed = malloc(CompressedSize);
+    Damaged = malloc(CompressedSize);
+    Decompressed = malloc(Size + GUARD_SIZE);
+    if ((Compressed == NULL) || (Damaged == NULL) || (Decompressed == NULL)) {
+        printf("LZMA %s: Allocation failure.\n", Description);
+        Failures += 1;
+        goto TestLzmaEnd;
+    }
+
+    EncodedPropertiesSize = sizeof(EncodedProperties);
+    Status = LzLzmaEncode(Compressed,
+                          &CompressedSize,
+                          Buffer,
+                          Size,
+                          Properties,
+                          EncodedProperties,
+                          &EncodedPropertiesSize,
+                          EndMark,
+                          &LzTestContext);
+
+    if (Status != LzSuccess) {
+        printf("LZMA %s: Encode failed: %d.\n", Description, Status);
+        Failures += 1;
+        goto TestLzmaEnd;
+    }
+
+    VPRINT("LZMA %s (lc %d lp %d pb %d%s): %ld -> %ld\n",
+           Description,
+           Properties->Lc,
+           Properties->Lp,
+           Properties->Pb,
+           (EndMark != FALSE) ? " mark" : "",
+           (long)Size,
+           (long)CompressedSize);
+
+    memset(Decompressed, GUARD_BYTE, Size + GUARD_SIZE);
+    DecodedSize = Size;
+    SourceSize = CompressedSize;
+    Status = LzLzmaDecode(&LzTestContext,
+                          Decompressed,
+                          &DecodedSize,
+                          Compressed,
+                          &SourceSize,
+                          EncodedProperties,
+                          EncodedPropertiesSize,
+                          EndMark,
+                          &Completion);
+
+    if ((Status != LzSuccess) || (DecodedSize != Size) ||
+        (memcmp(Decompressed, Buffer, Size) != 0) ||
+        (CheckGuard(Decompressed + Size, GUARD_SIZE) == FALSE)) {
+
+        printf("LZMA %s: Round trip failed: status %d, size %ld.\n",
+               Description,
+               Status,
+               (long)DecodedSize);
+
+        Failures += 1;
+        goto TestLzmaEnd;
+    }
+
+    if ((EndMark != FALSE) && (Completion != LzCompletionFinishedWithMark) &&
+        (Completion != LzCompletionMaybeFinishedWithoutMark)) {
+
+        printf("LZMA %s: Bad completion status %d.\n", Description, Completion);
+        Failures += 1;
+    }
+
+    //
+    // A truncated stream must fail, unless the missing bytes happened to be
+    // ones the decoder never needed.
+    //
+
+    if (CompressedSize > 6) {
+        DecodedSize = Size;
+        SourceSize = CompressedSize / 2;
+        memset(Decompressed, GUARD_BYTE, Size + GUARD_SIZE);
+        Status = LzLzmaDecode(&LzTestContext,
+                              Decompressed,
+                              &DecodedSize,
+                              Compressed,
+                              &SourceSize,
+                              EncodedProperties,
+                              EncodedPropertiesSize,
+                              EndMark,
+                              &Completion);
+
+        if (((Status == LzSuccess) &&
+             (memcmp(Decompressed, Buffer, Size) != 0)) ||
+            (CheckGuard(Decompressed + Size, GUARD_SIZE) == FALSE)) {
+
+            printf("LZMA %s: Truncated stream decoded wrong.\n", Description);
+            Failures += 1;
+        }
+    }
+
+    //
+    // Damaged streams may decode to garbage, but must never write beyond the
+    // destination buffer.
+    //
+
+    for (Iteration = 0; Iteration < CORRUPTION_ITERATIONS; Iteration += 1) {
+        memcpy(Damaged, Compressed, CompressedSize);
+        Damaged[rand() % CompressedSize] ^= 1 << (rand() % 8);
+        DecodedSize = Size;
+        SourceSize = CompressedSize;
+        memset(Decompressed, GUARD_BYTE, Size + GUARD_SIZE);
+        LzLzmaDecode(&LzTestContext,
+                     Decompressed,
+                     &DecodedSize,
+                     Damaged,
+                     &SourceSize,
+                     EncodedProperties,
+                     EncodedPropertiesSize,
+                     EndMark,
+                     &Completion);
+
+        if ((DecodedSize > Size) || (SourceSize > CompressedSize) ||
+            (CheckGuard(Decompressed + Size, GUARD_SIZE) == FALSE)) {
+
+            printf("LZMA %s: Damaged stream overran.\n", Description);
+            Failures += 1;
+            break;
+        }
+    }
+
+TestLzmaEnd:
+    free(Compressed);
+    free(Damaged);
+    free(Decompressed);
+    return Failures;
+}
+
+ULONG
+TestLz4 (
+    PUCHAR Buffer,
+    UINTN Size,
+    PCSTR Description
+    )
+
+/*++
+
+Routine Description:
+
+    This routine round trips the given buffer through the LZ4 codec, then
+    tries decoding truncated and damaged copies of the encoded block.
+
+Arguments:
+
+    Buffer - Supplies a pointer to the data to test.
+
+    Size - Supplies the size of the data in bytes.
+
+    Description - Supplies a description of the data for failure messages.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    PUCHAR Compressed;
+    UINTN CompressedSize;
+    PUCHAR Damaged;
+    UINTN DecodedSize;
+    PUCHAR Decompressed;
+    ULONG Failures;
+    ULONG Iteration;
+    LZ_STATUS Status;
+
+    Failures = 0;
+    CompressedSize = LZ4_COMPRESS_BOUND(Size);
+    Compressed = malloc(CompressedSize);
+    Damaged = malloc(CompressedSize);
+    Decompressed = malloc(Size + GUARD_SIZE);
+    if ((Compressed == NULL) || (Damaged == NULL) || (Decompressed == NULL)) {
+        printf("LZ4 %s: Allocation failure.\n", Description);
+        Failures += 1;
+        goto TestLz4End;
+    }
+
+    Status = LzLz4Encode(Compressed,
+                         &CompressedSize,
+                         Buffer,
+                         Size,
+                         &LzTestContext);
+
+    if (Status != LzSuccess) {
+        printf("LZ4 %s: Encode failed: %d.\n", Description, Status);
+        Failures += 1;
+        goto TestLz4End;
+    }
+
+    VPRINT("LZ4 %s: %ld -> %ld\n",
+           Description,
+           (long)Size,
+           (long)CompressedSize);
+
+    memset(Decompressed, GUARD_BYTE, Size + GUARD_SIZE);
+    DecodedSize = Size;
+    Status = LzLz4Decode(Decompressed,
+                         &DecodedSize,
+                         Compressed,
+                         CompressedSize);
+    if ((Status != LzSuccess) || (DecodedSize != Size) ||
+        (memcmp(Decompressed, Buffer, Size) != 0) ||
+        (CheckGuard(Decompressed + Size, GUARD_SIZE) == FALSE)) {
+
+        printf("LZ4 %s: Round trip failed: status %d, size %ld.\n",
+               Description,
+               Status,
+               (long)DecodedSize);
+
+        Failures += 1;
+        goto TestLz4End;
+    }
+
+    //
+    // A block cut off anywhere short of its end must be reported as such.
+    //
+
+    if (CompressedSize > 1) {
+        DecodedSize = Size;
+        memset(Decompressed, GUARD_BYTE, Size + GUARD_SIZE);
+        Status = LzLz4Decode(Decompressed,
+                             &DecodedSize,
+                             Compressed,
+                             CompressedSize - 1);
+
+        if ((Status == LzSuccess) && (DecodedSize == Size)) {
+            printf("LZ4 %s: Truncated block decoded.\n", Description);
+            Failures += 1;
+        }
+
+        if (CheckGuard(Decompressed + Size, GUARD_SIZE) == FALSE) {
+            printf("LZ4 %s: Truncated block overran.\n", Description);
+            Failures += 1;
+        }
+    }
+
+    for (Iteration = 0; Iteration < CORRUPTION_ITERATIONS; Iteration += 1) {
+        memcpy(Damaged, Compressed, CompressedSize);
+        Damaged[rand() % CompressedSize] ^= 1 << (rand() % 8);
+        DecodedSize = Size;
+        memset(Decompressed, GUARD_BYTE, Size + GUARD_SIZE);
+        LzLz4Decode(Decompressed, &DecodedSize, Damaged, CompressedSize);
+        if ((DecodedSize > Size) ||
+            (CheckGuard(Decompressed + Size, GUARD_SIZE) == FALSE)) {
+
+            printf("LZ4 %s: Damaged block overran.\n", Description);
+            Failures += 1;
+            break;
+        }
+    }
+
+TestLz4End:
+    free(Compressed);
+    free(Damaged);
+    free(Decompressed);
+    return Failures;
+}
+
+BOOL
+CheckGuard (
+    PUCHAR Buffer,
+    UINTN Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines whether the guard bytes after a buffer are intact.
+
+Arguments:
+
+    Buffer - Supplies a pointer to the guard bytes.
+
+    Size - Supplies the number of guard bytes.
+
+Return Value:
+
+    TRUE if the guard is intact.
+
+    FALSE if something wrote over it.
+
+--*/
+
+{
+
+    UINTN Index;
+
+    for (Index = 0; Index < Size; Index += 1) {
+        if (Buffer[Index] != GUARD_BYTE) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+VOID
+FillBuffer (
+    PUCHAR Buffer,
+    UINTN Size,
+    TEST_PATTERN Pattern
+    )
+
+/*++
+
+Routine Description:
+
+    This routine fills a buffer with test data.
+
+Arguments:
+
+    Buffer - Supplies a pointer to the buffer to fill.
+
+    Size - Supplies the size of the buffer in bytes.
+
+    Pattern - Supplies the kind of data to generate.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN Copy;
+    UINTN Distance;
+    UINTN Index;
+    PCSTR Word;
+    UINTN WordCount;
+
+    switch (Pattern) {
+    case TestPatternZero:
+        memset(Buffer, 0, Size);
+        break;
+
+    case TestPatternRandom:
+        for (Index = 0; Index < Size; Index += 1) {
+            Buffer[Index] = rand();
+        }
+
+        break;
+
+    //
+    // Text is a stream of words from a small vocabulary, which has lots of
+    // short matches at varying distances.
+    //
+
+    case TestPatternText:
+        WordCount = sizeof(LzTestWords) / sizeof(LzTestWords[0]);
+        Index = 0;
+        while (Index < Size) {
+            Word = LzTestWords[rand() % WordCount];
+            while ((*Word != '\0') && (Index < Size)) {
+                Buffer[Index] = *Word;
+                Index += 1;
+                Word += 1;
+            }
+
+            if (Index < Size) {
+                Buffer[Index] = ' ';
+                if ((rand() % 12) == 0) {
+                    Buffer[Index] = '\n';
+                }
+
+                Index += 1;
+            }
+        }
+
+        break;
+
+    //
+    // Code-like data is random bytes with frequent copies of earlier runs,
+    // some far back and some overlapping, plus long runs now and then.
+    //
+
+    case TestPatternCode:
+        Index = 0;
+        while (Index < Size) {
+            if ((Index > 16) && ((rand() % 3) == 0)) {
+                Distance = 1 + (rand() % Index);
+                Copy = 3 + (rand() % 40);
+                if ((rand() % 50) == 0) {
+                    Copy += rand() % 2000;
+                }
+
+                while ((Copy != 0) && (Index < Size)) {
+                    Buffer[Index] = Buffer[Index - Distance];
+                    Index += 1;
+                    Copy -= 1;
+                }
+
+            } else {
+                Buffer[Index] = rand() % 64;
+                Index += 1;
+            }
+        }
+
+        break;
+
+    default:
+        break;
+    }
+
+    return;
+}
+
+VOID
+RunDecodeBenchmark (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine measures the decode throughput of both codecs on code-like
+    data.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PUCHAR Buffer;
+    LZ_COMPLETION_STATUS Completion;
+    UCHAR EncodedProperties[LZMA_HEADER_SIZE];
+    UINTN EncodedPropertiesSize;
+    clock_t End;
+    ULONG Iteration;
+    PUCHAR Lz4Buffer;
+    UINTN Lz4Size;
+    PUCHAR LzmaBuffer;
+    UINTN LzmaSize;
+    PUCHAR Output;
+    UINTN OutputSize;
+    LZMA_ENCODER_PROPERTIES Properties;
+    double Seconds;
+    UINTN SourceSize;
+    clock_t Start;
+
+    Buffer = malloc(BENCHMARK_SIZE);
+    Output = malloc(BENCHMARK_SIZE);
+    LzmaSize = BENCHMARK_SIZE + (BENCHMARK_SIZE / 2);
+    LzmaBuffer = malloc(LzmaSize);
+    Lz4Size = LZ4_COMPRESS_BOUND(BENCHMARK_SIZE);
+    Lz4Buffer = malloc(Lz4Size);
+    if ((Buffer == NULL) || (Output == NULL) || (LzmaBuffer == NULL) ||
+        (Lz4Buffer == NULL)) {
+
+        goto RunDecodeBenchmarkEnd;
+    }
+
+    FillBuffer(Buffer, BENCHMARK_SIZE, TestPatternCode);
+    LzLzmaEncoderInitializeProperties(&Properties);
+    EncodedPropertiesSize = sizeof(EncodedProperties);
+    LzLzmaEncode(LzmaBuffer,
+                 &LzmaSize,
+                 Buffer,
+                 BENCHMARK_SIZE,
+                 &Properties,
+                 EncodedProperties,
+                 &EncodedPropertiesSize,
+                 FALSE,
+                 &LzTestContext);
+
+    LzLz4Encode(Lz4Buffer, &Lz4Size, Buffer, BENCHMARK_SIZE, &LzTestContext);
+    printf("Benchmark input: %d bytes, LZMA %ld bytes, LZ4 %ld bytes.\n",
+           BENCHMARK_SIZE,
+           (long)LzmaSize,
+           (long)Lz4Size);
+
+    Start = clock();
+    for (Iteration = 0; Iteration < BENCHMARK_ITERATIONS; Iteration += 1) {
+        OutputSize = BENCHMARK_SIZE;
+        SourceSize = LzmaSize;
+        LzLzmaDecode(&LzTestContext,
+                     Output,
+                     &OutputSize,
+                     LzmaBuffer,
+                     &SourceSize,
+                     EncodedProperties,
+                     EncodedPropertiesSize,
+                     FALSE,
+                     &Completion);
+    }
+
+    End = clock();
+    Seconds = (double)(End - Start) / CLOCKS_PER_SEC;
+    printf("LZMA decode: %.1f MB/s\n",
+           (BENCHMARK_SIZE / 1048576.0) * BENCHMARK_ITERATIONS / Seconds);
+
+    Start = clock();
+    for (Iteration = 0; Iteration < BENCHMARK_ITERATIONS; Iteration += 1) {
+        OutputSize = BENCHMARK_SIZE;
+        LzLz4Decode(Output, &OutputSize, Lz4Buffer, Lz4Size);
+    }
+
+    End = clock();
+    Seconds = (double)(End - Start) / CLOCKS_PER_SEC;
+    printf("LZ4 decode: %.1f MB/s\n",
+           (BENCHMARK_SIZE / 1048576.0) * BENCHMARK_ITERATIONS / Seconds);
+
+RunDecodeBenchmarkEnd:
+    free(Buffer);
+    free(Output);
+    free(LzmaBuffer);
+    free(Lz4Buffer);
+    return;
+}
+
+PVOID
+TestReallocate (
+    PVOID Allocation,
+    UINTN NewSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates, reallocates, or frees memory for the LZ library.
+
+Arguments:
+
+    Allocation - Supplies an optional pointer to the allocation to resize or
+        free.
+
+    NewSize - Supplies the size of the desired allocation, or zero to free.
+
+Return Value:
+
+    Returns a pointer to the allocation on success.
+
+    NULL on allocation failure, or in the case the memory is being freed.
+
+--*/
+
+{
+
+    if (NewSize == 0) {
+        free(Allocation);
+        return NULL;
+    }
+
+    return realloc(Allocation, NewSize);
+}
+
@@ -56,8 +56,6 @@ Environment:
 
 #define EFI_PCAT_DISK_MAGIC 0x73446350 // 'sDcP'
 
-#define EFI_PCAT_MAX_SECTORS_PER_TRANSFER 0x08
-
 #define EFI_CB_BLOCK_IO_DEVICE_PATH_GUID                  \
     {                                                       \
         0xCF31FAC5, 0xC24E, 0x11D2,                         \
@@ -203,8 +201,16 @@ EfipPcatBlockOperation (
     PEFI_PCAT_DISK Disk,
     BOOLEAN Write,
     VOID *Buffer,
-    UINT32 AbsoluteSector,
-    UINT32 SectorCount
+    UINT64 AbsoluteSector,
+    UINTN SectorCount
+    );
+
+EFI_STATUS
+EfipPcatValidateTransfer (
+    PEFI_PCAT_DISK Disk,
+    UINT32 MediaId,
+    EFI_LBA Lba,
+    UINTN BufferSize
     );
 
 EFI_STATUS
@@ -212,6 +218,13 @@ EfipPcatResetDisk (
     UINT8 DriveNumber
     );
 
+EFIAPI
+VOID
+EfipPcatExitBootServicesNotify (
+    EFI_EVENT Event,
+    VOID *Context
+    );
+
 struct pci_dev *
 pci_dev_find_class(
     uint8_t,
@@ -277,6 +290,12 @@ extern struct pci_access *pacc;
 
 static storage_devices current_devices;
 
+//
+// Store the event used to flush disk write caches at ExitBootServices.
+//
+
+EFI_EVENT EfiPcatExitBootServicesEvent;
+
 //
 // ------------------------------------------------------------------ Functions
 //
@@ -349,6 +368,17 @@ Return Value:
     current_devices.total = count;
     current_devices.curr_device = 0;
 
+    //
+    // Writes are left in the drive caches until someone flushes them. Make
+    // sure everything is committed before the OS takes over.
+    //
+
+    EfiCreateEvent(EVT_SIGNAL_EXIT_BOOT_SERVICES,
+                   TPL_NOTIFY,
+                   EfipPcatExitBootServicesNotify,
+                   NULL,
+                   &EfiPcatExitBootServicesEvent);
+
     return storage_show();
 }
 
@@ -444,42 +474,32 @@ Return Value:
 {
 
     PEFI_PCAT_DISK Disk;
-    UINTN SectorCount;
-    UINTN SectorsThisRound;
     EFI_STATUS Status;
+    UINTN Token;
 
     Disk = EFI_PCAT_DISK_FROM_THIS(This);
-    if (MediaId != Disk->Media.MediaId) {
-        return EFI_MEDIA_CHANGED;
+    Status = EfipPcatValidateTransfer(Disk, MediaId, Lba, BufferSize);
+    if (EFI_ERROR(Status)) {
+        return Status;
     }
 
-    if (Disk->Media.MediaPresent == FALSE) {
-        return EFI_NO_MEDIA;
+    if (BufferSize == 0) {
+        return EFI_SUCCESS;
     }
 
-    Status = EFI_SUCCESS;
-    SectorCount = BufferSize / Disk->SectorSize;
-    while (SectorCount != 0) {
-        SectorsThisRound = EFI_PCAT_MAX_SECTORS_PER_TRANSFER;
-        if (SectorsThisRound > SectorCount) {
-            SectorsThisRound = SectorCount;
-        }
-
-        Status = EfipPcatBlockOperation(Disk,
-                                        FALSE,
-                                        Buffer,
-                                        (UINT32)Lba,
-                                        SectorsThisRound);
-
-        if (EFI_ERROR(Status)) {
-            break;
-        }
+    //
+    // Hand the whole request to the block device, which splits it however
+    // its hardware requires.
+    //
 
-        Lba += SectorsThisRound;
-        Buffer += SectorsThisRound * Disk->SectorSize;
-        SectorCount -= SectorsThisRound;
-    }
+    Token = EfiCorePerfStart(EfiPerfRecordBlockRead, "disk", Lba);
+    Status = EfipPcatBlockOperation(Disk,
+                                    FALSE,
+                                    Buffer,
+                                    Lba,
+                                    BufferSize / Disk->SectorSize);
 
+    EfiCorePerfEnd(Token);
     return Status;
 }
 
@@ -536,42 +556,32 @@ Return Value:
 {
 
     PEFI_PCAT_DISK Disk;
-    UINTN SectorCount;
-    UINTN SectorsThisRound;
     EFI_STATUS Status;
+    UINTN Token;
 
     Disk = EFI_PCAT_DISK_FROM_THIS(This);
-    if (MediaId != Disk->Media.MediaId) {
-        return EFI_MEDIA_CHANGED;
+    Status = EfipPcatValidateTransfer(Disk, MediaId, Lba, BufferSize);
+    if (EFI_ERROR(Status)) {
+        return Status;
     }
 
-    if (Disk->Media.MediaPresent == FALSE) {
-        return EFI_NO_MEDIA;
+    if (BufferSize == 0) {
+        return EFI_SUCCESS;
     }
 
-    Status = EFI_SUCCESS;
-    SectorCount = BufferSize / Disk->SectorSize;
-    while (SectorCount != 0) {
-        SectorsThisRound = EFI_PCAT_MAX_SECTORS_PER_TRANSFER;
-        if (SectorsThisRound > SectorCount) {
-            SectorsThisRound = SectorCount;
-        }
-
-        Status = EfipPcatBlockOperation(Disk,
-                                        TRUE,
-                                        Buffer,
-                                        (UINT32)Lba,
-                                        SectorsThisRound);
-
-        if (EFI_ERROR(Status)) {
-            break;
-        }
+    //
+    // Hand the whole request to the block device, which splits it however
+    // its hardware requires.
+    //
 
-        Lba += SectorsThisRound;
-        Buffer += SectorsThisRound * Disk->SectorSize;
-        SectorCount -= SectorsThisRound;
-    }
+    Token = EfiCorePerfStart(EfiPerfRecordBlockWrite, "disk", Lba);
+    Status = EfipPcatBlockOperation(Disk,
+                                    TRUE,
+                                    Buffer,
+                                    Lba,
+                                    BufferSize / Disk->SectorSize);
 
+    EfiCorePerfEnd(Token);
     return Status;
 }
 
@@ -604,6 +614,19 @@ Return Value:
 
 {
 
+    BlockDev *bd;
+    PEFI_PCAT_DISK Disk;
+
+    Disk = EFI_PCAT_DISK_FROM_THIS(This);
+    bd = current_devices.known_devices[Disk->DriveNumber];
+    if ((bd == NULL) || (bd->ops.flush == NULL)) {
+        return EFI_SUCCESS;
+    }
+
+    if (bd->ops.flush(&bd->ops) != 0) {
+        return EFI_DEVICE_ERROR;
+    }
+
     return EFI_SUCCESS;
 }
 
@@ -701,15 +724,16 @@ EfipPcatBlockOperation (
     PEFI_PCAT_DISK Disk,
     BOOLEAN Write,
     VOID *Buffer,
-    UINT32 AbsoluteSector,
-    UINT32 SectorCount
+    UINT64 AbsoluteSector,
+    UINTN SectorCount
     )
 
 /*++
 
 Routine Description:
 
-    This routine uses the BIOS to read from or write to the disk.
+    This routine reads from or writes to the block device backing the disk
+    in a single request.
 
 Arguments:
 
@@ -739,7 +763,7 @@ Return Value:
 {
 
     BlockDev *bd;
-    EFI_STATUS Status;
+    lba_t Completed;
 
     bd = current_devices.known_devices[Disk->DriveNumber];
     if (!bd) {
@@ -747,18 +771,87 @@ Return Value:
     }
 
     if (Write != FALSE) {
-        Status = bd->ops.write(&bd->ops, AbsoluteSector, SectorCount, Buffer);
+        Completed = bd->ops.write(&bd->ops,
+                                  AbsoluteSector,
+                                  SectorCount,
+                                  Buffer);
+
     } else {
-        Status = bd->ops.read(&bd->ops, AbsoluteSector, SectorCount, Buffer);
+        Completed = bd->ops.read(&bd->ops, AbsoluteSector, SectorCount, Buffer);
     }
 
-    if (EFI_ERROR(Status)) {
+    if (Completed != SectorCount) {
         return EFI_DEVICE_ERROR;
     }
 
     return EFI_SUCCESS;
 }
 
+EFI_STATUS
+EfipPcatValidateTransfer (
+    PEFI_PCAT_DISK Disk,
+    UINT32 MediaId,
+    EFI_LBA Lba,
+    UINTN BufferSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine validates the parameters of a block I/O read or write.
+
+Arguments:
+
+    Disk - Supplies a pointer to the disk being accessed.
+
+    MediaId - Supplies the media identifier supplied by the caller.
+
+    Lba - Supplies the starting logical block address of the transfer.
+
+    BufferSize - Supplies the size of the transfer in bytes.
+
+Return Value:
+
+    EFI_SUCCESS if the transfer is valid.
+
+    EFI_MEDIA_CHANGED if the media ID does not match the current device.
+
+    EFI_NO_MEDIA if there is no media in the device.
+
+    EFI_BAD_BUFFER_SIZE if the buffer was not a multiple of the device block
+    size.
+
+    EFI_INVALID_PARAMETER if the transfer runs off the end of the device.
+
+--*/
+
+{
+
+    UINT64 SectorCount;
+
+    if (MediaId != Disk->Media.MediaId) {
+        return EFI_MEDIA_CHANGED;
+    }
+
+    if (Disk->Media.MediaPresent == FALSE) {
+        return EFI_NO_MEDIA;
+    }
+
+    if ((BufferSize % Disk->SectorSize) != 0) {
+        return EFI_BAD_BUFFER_SIZE;
+    }
+
+    SectorCount = BufferSize / Disk->SectorSize;
+    if ((Lba > Disk->TotalSectors) ||
+        (SectorCount > Disk->TotalSectors - Lba)) {
+
+        return EFI_INVALID_PARAMETER;
+    }
+
+    return EFI_SUCCESS;
+}
+
 EFI_STATUS
 EfipPcatResetDisk (
     UINT8 DriveNumber
@@ -795,6 +888,47 @@ Return Value:
     return EFI_UNSUPPORTED;
 }
 
+EFIAPI
+VOID
+EfipPcatExitBootServicesNotify (
+    EFI_EVENT Event,
+    VOID *Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called when boot services are exiting. It flushes the
+    write caches of all disks.
+
+Arguments:
+
+    Event - Supplies the event that fired.
+
+    Context - Supplies an unused context pointer.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    BlockDev *bd;
+    int i;
+
+    for (i = 0; i < current_devices.total; i++) {
+        bd = current_devices.known_devices[i];
+        if ((bd != NULL) && (bd->ops.flush != NULL)) {
+            bd->ops.flush(&bd->ops);
+        }
+    }
+
+    return;
+}
+
 struct pci_dev *pci_dev_find_class(uint8_t class, uint8_t sub)
 {
     struct pci_dev *tmp;
@@ -0,0 +1,69 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    Coreboot Disk Test
+
+Abstract:
+
+    This program tests the coreboot platform's Block I/O layer against block
+    devices in memory.
+
+Environment:
+
+    Test
+
+--*/
+
+from menv import application;
+
+function build() {
+    var buildApp;
+    var entries;
+    var includes;
+    var sources;
+    var sourcesConfig;
+
+    sources = [
+        "../disk.c",
+        "diskstub.c",
+        "disktest.c",
+        "../../../lib/blockdev/list.c"
+    ];
+
+    //
+    // The local directory comes first so its stand-ins for the libpayload
+    // headers are found.
+    //
+
+    includes = [
+        "$S/uefi/plat/cb/disktest",
+        "$S/uefi/plat/cb",
+        "$S/uefi/include"
+    ];
+
+    sourcesConfig = {
+        "CFLAGS": ["-fshort-wchar", "-DEFI_X86"],
+    };
+
+    buildApp = {
+        "label": "build_disktest",
+        "output": "disktest",
+        "inputs": sources,
+        "sources_config": sourcesConfig,
+        "includes": includes,
+        "build": true,
+        "prefix": "build"
+    };
+
+    entries = application(buildApp);
+    return entries;
+}
+
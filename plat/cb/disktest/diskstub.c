@@ -0,0 +1,894 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    diskstub.c
+
+Abstract:
+
+    This module implements the firmware services, PCI access, and AHCI
+    controller the coreboot disk code is linked against when it is tested on
+    the build machine. The disks themselves live in host memory.
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include "disktest.h"
+
+#include <pci.h>
+#include <pci/pci.h>
+#include <dev/ahci.h>
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the PCI configuration space offset of the subclass and class codes,
+// and the value there for an AHCI controller.
+//
+
+#define DISK_TEST_PCI_CLASS_OFFSET 0xA
+#define DISK_TEST_PCI_CLASS_AHCI 0x0106
+
+//
+// On x64 the firmware calling convention is the Microsoft one, whose variable
+// argument lists differ from the host's.
+//
+
+#if defined(__amd64)
+
+#define DISK_TEST_VA_LIST __builtin_ms_va_list
+#define DISK_TEST_VA_START(_Marker, _Parameter) \
+    __builtin_ms_va_start(_Marker, _Parameter)
+
+#define DISK_TEST_VA_END(_Marker) __builtin_ms_va_end(_Marker)
+
+#else
+
+#define DISK_TEST_VA_LIST VA_LIST
+#define DISK_TEST_VA_START(_Marker, _Parameter) VA_START(_Marker, _Parameter)
+#define DISK_TEST_VA_END(_Marker) VA_END(_Marker)
+
+#endif
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+EFIAPI
+EFI_STATUS
+DiskTestAllocatePool (
+    EFI_MEMORY_TYPE PoolType,
+    UINTN Size,
+    VOID **Buffer
+    );
+
+EFIAPI
+EFI_STATUS
+DiskTestFreePool (
+    VOID *Buffer
+    );
+
+EFIAPI
+VOID
+DiskTestCopyMem (
+    VOID *Destination,
+    VOID *Source,
+    UINTN Length
+    );
+
+EFIAPI
+EFI_STATUS
+DiskTestCreateEvent (
+    UINT32 Type,
+    EFI_TPL NotifyTpl,
+    EFI_EVENT_NOTIFY NotifyFunction,
+    VOID *NotifyContext,
+    EFI_EVENT *Event
+    );
+
+EFIAPI
+EFI_STATUS
+DiskTestInstallMultipleProtocolInterfaces (
+    EFI_HANDLE *Handle,
+    ...
+    );
+
+int
+DiskTestUpdateController (
+    BlockDevCtrlrOps *Ops
+    );
+
+lba_t
+DiskTestRead (
+    BlockDevOps *Ops,
+    lba_t Start,
+    lba_t Count,
+    void *Buffer
+    );
+
+lba_t
+DiskTestWrite (
+    BlockDevOps *Ops,
+    lba_t Start,
+    lba_t Count,
+    const void *Buffer
+    );
+
+int
+DiskTestFlush (
+    BlockDevOps *Ops
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// The disk code only reaches the boot services through the shortcut macros.
+// Only the services it calls are filled in.
+//
+
+EFI_BOOT_SERVICES DiskTestBootServices;
+EFI_BOOT_SERVICES *EfiBootServices = &DiskTestBootServices;
+
+EFI_GUID EfiBlockIoProtocolGuid = EFI_BLOCK_IO_PROTOCOL_GUID;
+EFI_GUID EfiDevicePathProtocolGuid = EFI_DEVICE_PATH_PROTOCOL_GUID;
+
+PDISK_TEST_RAM_DISK DiskTestDisks[DISK_TEST_MAX_DISKS];
+UINTN DiskTestDiskCount;
+EFI_BLOCK_IO_PROTOCOL *DiskTestBlockIo[DISK_TEST_MAX_DISKS];
+UINTN DiskTestBlockIoCount;
+UINT32 DiskTestEventType;
+EFI_EVENT_NOTIFY DiskTestEventNotify;
+UINTN DiskTestPerfStarts;
+UINTN DiskTestPerfEnds;
+
+//
+// These lists are normally defined by the block device library.
+//
+
+ListNode fixed_block_devices;
+ListNode removable_block_devices;
+ListNode fixed_block_dev_controllers;
+ListNode removable_block_dev_controllers;
+
+//
+// The PCI bus has a single device on it, the AHCI controller.
+//
+
+struct pci_dev DiskTestPciDevice = {
+    NULL,
+    0,
+    0,
+    0x1F,
+    2
+};
+
+struct pci_access DiskTestPciAccess = {
+    &DiskTestPciDevice
+};
+
+struct pci_access *pacc = &DiskTestPciAccess;
+
+AhciCtrlr DiskTestAhciController;
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+VOID
+DiskTestInitializeServices (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine fills in the boot services the disk code calls.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    DiskTestBootServices.AllocatePool = DiskTestAllocatePool;
+    DiskTestBootServices.FreePool = DiskTestFreePool;
+    DiskTestBootServices.CopyMem = DiskTestCopyMem;
+    DiskTestBootServices.CreateEvent = DiskTestCreateEvent;
+    DiskTestBootServices.InstallMultipleProtocolInterfaces =
+                                     DiskTestInstallMultipleProtocolInterfaces;
+
+    return;
+}
+
+VOID
+DiskTestInitializeRamDisk (
+    PDISK_TEST_RAM_DISK Disk,
+    PCSTR Name,
+    UINT32 BlockSize,
+    lba_t BlockCount,
+    BOOLEAN Store,
+    BOOLEAN Flush
+    )
+
+/*++
+
+Routine Description:
+
+    This routine sets up a block device backed by host memory.
+
+Arguments:
+
+    Disk - Supplies a pointer to the disk to initialize.
+
+    Name - Supplies the name of the block device.
+
+    BlockSize - Supplies the size of a block in bytes.
+
+    BlockCount - Supplies the number of blocks on the disk.
+
+    Store - Supplies a boolean indicating whether the disk keeps what is
+        written to it (TRUE) or makes up its contents (FALSE).
+
+    Flush - Supplies a boolean indicating whether the disk has a write cache
+        to flush.
+
+Return Value:
+
+    None. The data pointer is NULL if the allocation failed.
+
+--*/
+
+{
+
+    memset(Disk, 0, sizeof(DISK_TEST_RAM_DISK));
+    Disk->BlockDev.ops.read = DiskTestRead;
+    Disk->BlockDev.ops.write = DiskTestWrite;
+    if (Flush != FALSE) {
+        Disk->BlockDev.ops.flush = DiskTestFlush;
+    }
+
+    Disk->BlockDev.name = Name;
+    Disk->BlockDev.block_size = BlockSize;
+    Disk->BlockDev.block_count = BlockCount;
+    if (Store != FALSE) {
+        Disk->Data = calloc(BlockCount, BlockSize);
+    }
+
+    return;
+}
+
+VOID
+DiskTestDestroyRamDisk (
+    PDISK_TEST_RAM_DISK Disk
+    )
+
+/*++
+
+Routine Description:
+
+    This routine frees the memory behind a host memory block device.
+
+Arguments:
+
+    Disk - Supplies a pointer to the disk to tear down.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    if (Disk->Data != NULL) {
+        free(Disk->Data);
+        Disk->Data = NULL;
+    }
+
+    return;
+}
+
+UINT8
+DiskTestPatternByte (
+    lba_t Block,
+    UINTN Offset
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the contents of a disk that does not store its data.
+
+Arguments:
+
+    Block - Supplies the block being read.
+
+    Offset - Supplies the byte offset within the block.
+
+Return Value:
+
+    Returns the byte at that location.
+
+--*/
+
+{
+
+    //
+    // Fold the upper half of the address in so that a block read from the
+    // wrong 4GB region shows up.
+    //
+
+    return (UINT8)(Block ^ (Block >> 32) ^ (Offset * 31));
+}
+
+UINTN
+EfiCorePerfStart (
+    EFI_PERF_RECORD_TYPE Type,
+    CONST CHAR8 *Name,
+    UINT64 Data
+    )
+
+/*++
+
+Routine Description:
+
+    This routine stands in for opening a performance trace record. It only
+    counts how many were opened.
+
+Arguments:
+
+    Type - Supplies the kind of work being timed.
+
+    Name - Supplies an optional name for the record.
+
+    Data - Supplies record specific data.
+
+Return Value:
+
+    Returns a token to pass to the end routine.
+
+--*/
+
+{
+
+    DiskTestPerfStarts += 1;
+    return DiskTestPerfStarts;
+}
+
+VOID
+EfiCorePerfEnd (
+    UINTN Token
+    )
+
+/*++
+
+Routine Description:
+
+    This routine stands in for closing a performance trace record.
+
+Arguments:
+
+    Token - Supplies the token returned when the record was opened.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    DiskTestPerfEnds += 1;
+    return;
+}
+
+uint16_t
+pci_read_word (
+    struct pci_dev *Device,
+    int Offset
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads a 16-bit value from a device's PCI configuration space.
+
+Arguments:
+
+    Device - Supplies the device to read from.
+
+    Offset - Supplies the byte offset to read.
+
+Return Value:
+
+    Returns the value at that offset. Only the class code is implemented.
+
+--*/
+
+{
+
+    if ((Device == &DiskTestPciDevice) &&
+        (Offset == DISK_TEST_PCI_CLASS_OFFSET)) {
+
+        return DISK_TEST_PCI_CLASS_AHCI;
+    }
+
+    return 0xFFFF;
+}
+
+AhciCtrlr *
+new_ahci_ctrlr (
+    pcidev_t Device
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates the AHCI controller. Updating it reports the test's
+    disks.
+
+Arguments:
+
+    Device - Supplies the PCI address of the controller.
+
+Return Value:
+
+    Returns a pointer to the controller.
+
+--*/
+
+{
+
+    DiskTestAhciController.ctrlr.ops.update = DiskTestUpdateController;
+    DiskTestAhciController.ctrlr.need_update = 1;
+    DiskTestAhciController.dev = Device;
+    return &DiskTestAhciController;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+EFIAPI
+EFI_STATUS
+DiskTestAllocatePool (
+    EFI_MEMORY_TYPE PoolType,
+    UINTN Size,
+    VOID **Buffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates memory from the host heap.
+
+Arguments:
+
+    PoolType - Supplies the type of pool to allocate.
+
+    Size - Supplies the number of bytes to allocate.
+
+    Buffer - Supplies a pointer where a pointer to the allocation will be
+        returned.
+
+Return Value:
+
+    EFI_SUCCESS on success.
+
+    EFI_OUT_OF_RESOURCES if the allocation failed.
+
+--*/
+
+{
+
+    *Buffer = malloc(Size);
+    if (*Buffer == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    return EFI_SUCCESS;
+}
+
+EFIAPI
+EFI_STATUS
+DiskTestFreePool (
+    VOID *Buffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine frees memory allocated from the host heap.
+
+Arguments:
+
+    Buffer - Supplies a pointer to the buffer to free.
+
+Return Value:
+
+    EFI_SUCCESS always.
+
+--*/
+
+{
+
+    free(Buffer);
+    return EFI_SUCCESS;
+}
+
+EFIAPI
+VOID
+DiskTestCopyMem (
+    VOID *Destination,
+    VOID *Source,
+    UINTN Length
+    )
+
+/*++
+
+Routine Description:
+
+    This routine copies the contents of one buffer to another.
+
+Arguments:
+
+    Destination - Supplies a pointer to the destination of the copy.
+
+    Source - Supplies a pointer to the source of the copy.
+
+    Length - Supplies the number of bytes to copy.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    memmove(Destination, Source, Length);
+    return;
+}
+
+EFIAPI
+EFI_STATUS
+DiskTestCreateEvent (
+    UINT32 Type,
+    EFI_TPL NotifyTpl,
+    EFI_EVENT_NOTIFY NotifyFunction,
+    VOID *NotifyContext,
+    EFI_EVENT *Event
+    )
+
+/*++
+
+Routine Description:
+
+    This routine records the event the disk layer creates, so the test can
+    signal it by hand.
+
+Arguments:
+
+    Type - Supplies the event type.
+
+    NotifyTpl - Supplies the task priority level of the notification.
+
+    NotifyFunction - Supplies the notification routine.
+
+    NotifyContext - Supplies the context passed to the notification routine.
+
+    Event - Supplies a pointer where the event will be returned.
+
+Return Value:
+
+    EFI_SUCCESS always.
+
+--*/
+
+{
+
+    DiskTestEventType = Type;
+    DiskTestEventNotify = NotifyFunction;
+    *Event = (EFI_EVENT)&DiskTestEventType;
+    return EFI_SUCCESS;
+}
+
+EFIAPI
+EFI_STATUS
+DiskTestInstallMultipleProtocolInterfaces (
+    EFI_HANDLE *Handle,
+    ...
+    )
+
+/*++
+
+Routine Description:
+
+    This routine records the block I/O protocols the disk layer installs.
+
+Arguments:
+
+    Handle - Supplies a pointer to the handle to install on.
+
+    ... - Supplies pairs of protocol GUIDs and interfaces, terminated by a
+        NULL GUID.
+
+Return Value:
+
+    EFI_SUCCESS on success.
+
+    EFI_OUT_OF_RESOURCES if too many disks were installed.
+
+--*/
+
+{
+
+    DISK_TEST_VA_LIST ArgumentList;
+    EFI_GUID *Guid;
+    VOID *Interface;
+    EFI_STATUS Status;
+
+    Status = EFI_SUCCESS;
+    DISK_TEST_VA_START(ArgumentList, Handle);
+    while (TRUE) {
+        Guid = VA_ARG(ArgumentList, EFI_GUID *);
+        if (Guid == NULL) {
+            break;
+        }
+
+        Interface = VA_ARG(ArgumentList, VOID *);
+        if (memcmp(Guid, &EfiBlockIoProtocolGuid, sizeof(EFI_GUID)) == 0) {
+            if (DiskTestBlockIoCount == DISK_TEST_MAX_DISKS) {
+                Status = EFI_OUT_OF_RESOURCES;
+                break;
+            }
+
+            DiskTestBlockIo[DiskTestBlockIoCount] = Interface;
+            DiskTestBlockIoCount += 1;
+        }
+    }
+
+    DISK_TEST_VA_END(ArgumentList);
+
+    //
+    // The location of the handle is unique to each disk, so it serves as the
+    // new handle.
+    //
+
+    if (*Handle == NULL) {
+        *Handle = (EFI_HANDLE)Handle;
+    }
+
+    return Status;
+}
+
+int
+DiskTestUpdateController (
+    BlockDevCtrlrOps *Ops
+    )
+
+/*++
+
+Routine Description:
+
+    This routine scans the stub AHCI controller, adding the test's disks to
+    the list of fixed block devices.
+
+Arguments:
+
+    Ops - Supplies a pointer to the controller operations.
+
+Return Value:
+
+    0 always.
+
+--*/
+
+{
+
+    UINTN Index;
+
+    //
+    // Each disk is inserted at the head of the list, so go backwards to leave
+    // the list in drive number order.
+    //
+
+    for (Index = DiskTestDiskCount; Index != 0; Index -= 1) {
+        list_insert_after(&(DiskTestDisks[Index - 1]->BlockDev.list_node),
+                          &fixed_block_devices);
+    }
+
+    DiskTestAhciController.ctrlr.need_update = 0;
+    return 0;
+}
+
+lba_t
+DiskTestRead (
+    BlockDevOps *Ops,
+    lba_t Start,
+    lba_t Count,
+    void *Buffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads blocks from a host memory disk.
+
+Arguments:
+
+    Ops - Supplies a pointer to the block device operations.
+
+    Start - Supplies the first block to read.
+
+    Count - Supplies the number of blocks to read.
+
+    Buffer - Supplies the buffer where the data will be returned.
+
+Return Value:
+
+    Returns the number of blocks read.
+
+--*/
+
+{
+
+    UINT32 BlockSize;
+    PDISK_TEST_RAM_DISK Disk;
+    UINTN Offset;
+    UINT8 *Output;
+
+    Disk = container_of(Ops, DISK_TEST_RAM_DISK, BlockDev.ops);
+    BlockSize = Disk->BlockDev.block_size;
+    Disk->Calls += 1;
+    Disk->LastStart = Start;
+    Disk->LastCount = Count;
+    if ((Start > Disk->BlockDev.block_count) ||
+        (Count > Disk->BlockDev.block_count - Start)) {
+
+        return 0;
+    }
+
+    if (Disk->ShortTransfers != 0) {
+        Disk->ShortTransfers -= 1;
+        Count -= 1;
+    }
+
+    if (Disk->Data != NULL) {
+        memcpy(Buffer, Disk->Data + (Start * BlockSize), Count * BlockSize);
+
+    } else {
+        Output = Buffer;
+        for (Offset = 0; Offset < Count * BlockSize; Offset += 1) {
+            Output[Offset] = DiskTestPatternByte(Start + (Offset / BlockSize),
+                                                 Offset % BlockSize);
+        }
+    }
+
+    return Count;
+}
+
+lba_t
+DiskTestWrite (
+    BlockDevOps *Ops,
+    lba_t Start,
+    lba_t Count,
+    const void *Buffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes blocks to a host memory disk.
+
+Arguments:
+
+    Ops - Supplies a pointer to the block device operations.
+
+    Start - Supplies the first block to write.
+
+    Count - Supplies the number of blocks to write.
+
+    Buffer - Supplies the data to write.
+
+Return Value:
+
+    Returns the number of blocks written.
+
+--*/
+
+{
+
+    UINT32 BlockSize;
+    PDISK_TEST_RAM_DISK Disk;
+
+    Disk = container_of(Ops, DISK_TEST_RAM_DISK, BlockDev.ops);
+    BlockSize = Disk->BlockDev.block_size;
+    Disk->Calls += 1;
+    Disk->LastStart = Start;
+    Disk->LastCount = Count;
+    if ((Start > Disk->BlockDev.block_count) ||
+        (Count > Disk->BlockDev.block_count - Start)) {
+
+        return 0;
+    }
+
+    if (Disk->ShortTransfers != 0) {
+        Disk->ShortTransfers -= 1;
+        Count -= 1;
+    }
+
+    if (Disk->Data != NULL) {
+        memcpy(Disk->Data + (Start * BlockSize), Buffer, Count * BlockSize);
+    }
+
+    return Count;
+}
+
+int
+DiskTestFlush (
+    BlockDevOps *Ops
+    )
+
+/*++
+
+Routine Description:
+
+    This routine flushes the write cache of a host memory disk, which just
+    counts the request.
+
+Arguments:
+
+    Ops - Supplies a pointer to the block device operations.
+
+Return Value:
+
+    0 always.
+
+--*/
+
+{
+
+    PDISK_TEST_RAM_DISK Disk;
+
+    Disk = container_of(Ops, DISK_TEST_RAM_DISK, BlockDev.ops);
+    Disk->Flushes += 1;
+    return 0;
+}
+
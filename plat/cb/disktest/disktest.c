@@ -0,0 +1,1092 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    disktest.c
+
+Abstract:
+
+    This module implements the coreboot disk test program. It runs the
+    platform's Block I/O layer against block devices backed by host memory,
+    checking that transfers reach the block device whole and intact, and
+    measures how fast data moves through the layer.
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include "disktest.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+#define USAGE_STRING \
+    "Disktest will test the coreboot Block I/O layer.\n\n" \
+    "Usage: disktest [-v] [-b]\n\n" \
+    "    -v  Verbose mode\n" \
+    "    -b  Run the throughput benchmark after the tests\n\n" \
+
+//
+// Define the disks the test sets up: a 512 byte sector disk, a removable 4KB
+// sector disk with no write cache, and an 8TB disk that makes up its
+// contents.
+//
+
+#define DISK_TEST_SMALL_DRIVE 0
+#define DISK_TEST_LARGE_SECTOR_DRIVE 1
+#define DISK_TEST_HUGE_DRIVE 2
+#define DISK_TEST_DISK_COUNT 3
+
+#define DISK_TEST_SMALL_BLOCKS (64ULL * 1024 * 2)
+#define DISK_TEST_LARGE_SECTOR_BLOCKS (16ULL * 256)
+#define DISK_TEST_HUGE_BLOCKS (8ULL * 1024 * 1024 * 1024 * 2)
+
+//
+// Define the number of random transfers issued against each disk, and the
+// largest of them in bytes.
+//
+
+#define DISK_TEST_ITERATIONS 4000
+#define DISK_TEST_MAX_TRANSFER (1024 * 1024)
+
+//
+// Define the largest transfer to a disk that makes up its contents, in blocks.
+// Every byte read is checked against the pattern, so these are kept short.
+//
+
+#define DISK_TEST_MAX_PATTERN_BLOCKS 32
+
+//
+// Define the number of bytes each benchmark run moves, and the largest
+// transfer size it tries.
+//
+
+#define DISK_BENCHMARK_BYTES (2048ULL * 1024 * 1024)
+#define DISK_BENCHMARK_MAX_TRANSFER (4 * 1024 * 1024)
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+ULONG
+TestEnumeration (
+    VOID
+    );
+
+ULONG
+TestRandomTransfers (
+    UINTN Drive
+    );
+
+ULONG
+TestInvalidTransfers (
+    UINTN Drive
+    );
+
+ULONG
+TestLargeAddresses (
+    UINTN Drive
+    );
+
+ULONG
+TestFlush (
+    VOID
+    );
+
+VOID
+RunThroughputBenchmark (
+    UINTN Drive
+    );
+
+ULONG
+CheckTransfer (
+    UINTN Drive,
+    PCSTR Description,
+    UINTN CallsBefore,
+    EFI_LBA Lba,
+    UINTN BlockCount
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+BOOLEAN DiskTestVerbose = FALSE;
+
+DISK_TEST_RAM_DISK DiskTestRamDisks[DISK_TEST_DISK_COUNT];
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+INT
+main (
+    INT ArgumentCount,
+    CHAR **Arguments
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is the main entry point for the program.
+
+Arguments:
+
+    ArgumentCount - Supplies the number of command line arguments the program
+        was invoked with.
+
+    Arguments - Supplies a tokenized array of command line arguments.
+
+Return Value:
+
+    Returns an integer exit code. 0 for success, nonzero otherwise.
+
+--*/
+
+{
+
+    PSTR Argument;
+    BOOLEAN Benchmark;
+    UINTN Drive;
+    ULONG Failures;
+
+    Benchmark = FALSE;
+    Failures = 0;
+    srand(time(NULL));
+    while ((ArgumentCount > 1) && (Arguments[1][0] == '-')) {
+        Argument = &(Arguments[1][1]);
+        if (strcmp(Argument, "v") == 0) {
+            DiskTestVerbose = TRUE;
+
+        } else if (strcmp(Argument, "b") == 0) {
+            Benchmark = TRUE;
+
+        } else {
+            printf("%s: Invalid option\n\n%s", Argument, USAGE_STRING);
+            return 1;
+        }
+
+        ArgumentCount -= 1;
+        Arguments += 1;
+    }
+
+    DiskTestInitializeServices();
+    DiskTestInitializeRamDisk(&(DiskTestRamDisks[DISK_TEST_SMALL_DRIVE]),
+                              "ram0",
+                              512,
+                              DISK_TEST_SMALL_BLOCKS,
+                              TRUE,
+                              TRUE);
+
+    DiskTestInitializeRamDisk(
+                           &(DiskTestRamDisks[DISK_TEST_LARGE_SECTOR_DRIVE]),
+                           "ram1",
+                           4096,
+                           DISK_TEST_LARGE_SECTOR_BLOCKS,
+                           TRUE,
+                           FALSE);
+
+    DiskTestRamDisks[DISK_TEST_LARGE_SECTOR_DRIVE].BlockDev.removable = 1;
+    DiskTestInitializeRamDisk(&(DiskTestRamDisks[DISK_TEST_HUGE_DRIVE]),
+                              "huge",
+                              512,
+                              DISK_TEST_HUGE_BLOCKS,
+                              FALSE,
+                              TRUE);
+
+    for (Drive = 0; Drive < DISK_TEST_DISK_COUNT; Drive += 1) {
+        if ((Drive != DISK_TEST_HUGE_DRIVE) &&
+            (DiskTestRamDisks[Drive].Data == NULL)) {
+
+            printf("Error: Failed to allocate disk %ld.\n", (long)Drive);
+            Failures += 1;
+            goto MainEnd;
+        }
+
+        DiskTestDisks[Drive] = &(DiskTestRamDisks[Drive]);
+    }
+
+    DiskTestDiskCount = DISK_TEST_DISK_COUNT;
+    Failures += TestEnumeration();
+    if (Failures != 0) {
+        goto MainEnd;
+    }
+
+    Failures += TestRandomTransfers(DISK_TEST_SMALL_DRIVE);
+    Failures += TestRandomTransfers(DISK_TEST_LARGE_SECTOR_DRIVE);
+    Failures += TestInvalidTransfers(DISK_TEST_SMALL_DRIVE);
+    Failures += TestInvalidTransfers(DISK_TEST_LARGE_SECTOR_DRIVE);
+    Failures += TestLargeAddresses(DISK_TEST_HUGE_DRIVE);
+    Failures += TestFlush();
+    if (DiskTestPerfStarts != DiskTestPerfEnds) {
+        printf("Error: %ld performance records opened but %ld closed.\n",
+               (long)DiskTestPerfStarts,
+               (long)DiskTestPerfEnds);
+
+        Failures += 1;
+    }
+
+MainEnd:
+    if (Failures != 0) {
+        printf("*** %d failure(s) in disk test. ***\n", Failures);
+
+    } else {
+        printf("All disk tests passed.\n");
+        if (Benchmark != FALSE) {
+            RunThroughputBenchmark(DISK_TEST_SMALL_DRIVE);
+        }
+    }
+
+    for (Drive = 0; Drive < DISK_TEST_DISK_COUNT; Drive += 1) {
+        DiskTestDestroyRamDisk(&(DiskTestRamDisks[Drive]));
+    }
+
+    return Failures;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+ULONG
+TestEnumeration (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine enumerates the disks behind the stub AHCI controller and
+    makes sure each one got a Block I/O protocol describing it.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    BlockDev *BlockDevice;
+    EFI_BLOCK_IO_PROTOCOL *BlockIo;
+    UINTN Drive;
+    ULONG Failures;
+    EFI_STATUS Status;
+
+    Failures = 0;
+    Status = EfipPcatEnumerateDisks();
+    if (EFI_ERROR(Status)) {
+        printf("Error: Failed to enumerate disks: 0x%lx.\n", (long)Status);
+        return 1;
+    }
+
+    if (DiskTestBlockIoCount != DISK_TEST_DISK_COUNT) {
+        printf("Error: %ld disks installed, expected %d.\n",
+               (long)DiskTestBlockIoCount,
+               DISK_TEST_DISK_COUNT);
+
+        return 1;
+    }
+
+    for (Drive = 0; Drive < DISK_TEST_DISK_COUNT; Drive += 1) {
+        BlockIo = DiskTestBlockIo[Drive];
+        BlockDevice = &(DiskTestRamDisks[Drive].BlockDev);
+        if ((BlockIo->Media == NULL) ||
+            (BlockIo->Media->MediaPresent == FALSE) ||
+            (BlockIo->Media->BlockSize != BlockDevice->block_size) ||
+            (BlockIo->Media->LastBlock != BlockDevice->block_count - 1) ||
+            (BlockIo->Media->RemovableMedia != BlockDevice->removable)) {
+
+            printf("Error: Disk %ld media does not match its block device.\n",
+                   (long)Drive);
+
+            Failures += 1;
+        }
+    }
+
+    if ((DiskTestEventType != EVT_SIGNAL_EXIT_BOOT_SERVICES) ||
+        (DiskTestEventNotify == NULL)) {
+
+        printf("Error: No ExitBootServices flush event was created.\n");
+        Failures += 1;
+    }
+
+    return Failures;
+}
+
+ULONG
+TestRandomTransfers (
+    UINTN Drive
+    )
+
+/*++
+
+Routine Description:
+
+    This routine issues random reads and writes against a disk that stores its
+    data, checking the data against a copy kept by the test and making sure
+    every transfer reached the block device as one request.
+
+Arguments:
+
+    Drive - Supplies the drive number to test.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    UINT8 *Buffer;
+    UINTN BlockCount;
+    EFI_BLOCK_IO_PROTOCOL *BlockIo;
+    UINT32 BlockSize;
+    UINTN ByteIndex;
+    UINTN CallsBefore;
+    UINT8 *Data;
+    PDISK_TEST_RAM_DISK Disk;
+    ULONG Failures;
+    UINTN Iteration;
+    EFI_LBA Lba;
+    UINTN MaxBlocks;
+    UINT8 *Random;
+    UINTN Reads;
+    UINT8 *Shadow;
+    EFI_STATUS Status;
+    UINT64 TotalBlocks;
+    UINTN Writes;
+
+    Disk = DiskTestDisks[Drive];
+    BlockIo = DiskTestBlockIo[Drive];
+    BlockSize = Disk->BlockDev.block_size;
+    TotalBlocks = Disk->BlockDev.block_count;
+    MaxBlocks = DISK_TEST_MAX_TRANSFER / BlockSize;
+    Failures = 0;
+    Reads = 0;
+    Writes = 0;
+    Buffer = malloc(DISK_TEST_MAX_TRANSFER);
+    Random = malloc(DISK_TEST_MAX_TRANSFER * 2);
+    Shadow = calloc(TotalBlocks, BlockSize);
+    if ((Buffer == NULL) || (Random == NULL) || (Shadow == NULL)) {
+        printf("Error: Failed to allocate transfer buffers.\n");
+        Failures += 1;
+        goto TestRandomTransfersEnd;
+    }
+
+    //
+    // Writes come from random offsets into a block of random data, so that
+    // no two are likely to write the same thing.
+    //
+
+    for (ByteIndex = 0;
+         ByteIndex < DISK_TEST_MAX_TRANSFER * 2;
+         ByteIndex += 1) {
+
+        Random[ByteIndex] = rand();
+    }
+
+    memcpy(Shadow, Disk->Data, TotalBlocks * BlockSize);
+    for (Iteration = 0; Iteration < DISK_TEST_ITERATIONS; Iteration += 1) {
+
+        //
+        // Favor small transfers, but regularly go up to the maximum, and
+        // regularly run right up to the end of the disk.
+        //
+
+        if ((rand() % 4) == 0) {
+            BlockCount = (rand() % MaxBlocks) + 1;
+
+        } else {
+            BlockCount = (rand() % 16) + 1;
+        }
+
+        if ((rand() % 8) == 0) {
+            Lba = TotalBlocks - BlockCount;
+
+        } else {
+            Lba = rand() % (TotalBlocks - BlockCount + 1);
+        }
+
+        CallsBefore = Disk->Calls;
+        if ((rand() % 2) == 0) {
+            Data = Random + (rand() % DISK_TEST_MAX_TRANSFER);
+            Status = BlockIo->WriteBlocks(BlockIo,
+                                          BlockIo->Media->MediaId,
+                                          Lba,
+                                          BlockCount * BlockSize,
+                                          Data);
+
+            if (EFI_ERROR(Status)) {
+                printf("Error: Disk %ld write of %ld blocks at 0x%llx failed: "
+                       "0x%lx.\n",
+                       (long)Drive,
+                       (long)BlockCount,
+                       (unsigned long long)Lba,
+                       (long)Status);
+
+                Failures += 1;
+                break;
+            }
+
+            memcpy(Shadow + (Lba * BlockSize), Data, BlockCount * BlockSize);
+
+            Writes += 1;
+            Failures += CheckTransfer(Drive,
+                                      "write",
+                                      CallsBefore,
+                                      Lba,
+                                      BlockCount);
+
+        } else {
+            memset(Buffer, 0xA5, BlockCount * BlockSize);
+            Status = BlockIo->ReadBlocks(BlockIo,
+                                         BlockIo->Media->MediaId,
+                                         Lba,
+                                         BlockCount * BlockSize,
+                                         Buffer);
+
+            if (EFI_ERROR(Status)) {
+                printf("Error: Disk %ld read of %ld blocks at 0x%llx failed: "
+                       "0x%lx.\n",
+                       (long)Drive,
+                       (long)BlockCount,
+                       (unsigned long long)Lba,
+                       (long)Status);
+
+                Failures += 1;
+                break;
+            }
+
+            Reads += 1;
+            Failures += CheckTransfer(Drive,
+                                      "read",
+                                      CallsBefore,
+                                      Lba,
+                                      BlockCount);
+
+            if (memcmp(Buffer,
+                       Shadow + (Lba * BlockSize),
+                       BlockCount * BlockSize) != 0) {
+
+                printf("Error: Disk %ld read of %ld blocks at 0x%llx returned "
+                       "the wrong data.\n",
+                       (long)Drive,
+                       (long)BlockCount,
+                       (unsigned long long)Lba);
+
+                Failures += 1;
+            }
+        }
+
+        if (Failures != 0) {
+            break;
+        }
+    }
+
+    if ((Failures == 0) &&
+        (memcmp(Shadow, Disk->Data, TotalBlocks * BlockSize) != 0)) {
+
+        printf("Error: Disk %ld contents do not match what was written.\n",
+               (long)Drive);
+
+        Failures += 1;
+    }
+
+    VPRINT("Disk %ld: %ld reads, %ld writes.\n",
+           (long)Drive,
+           (long)Reads,
+           (long)Writes);
+
+TestRandomTransfersEnd:
+    if (Buffer != NULL) {
+        free(Buffer);
+    }
+
+    if (Random != NULL) {
+        free(Random);
+    }
+
+    if (Shadow != NULL) {
+        free(Shadow);
+    }
+
+    return Failures;
+}
+
+ULONG
+TestInvalidTransfers (
+    UINTN Drive
+    )
+
+/*++
+
+Routine Description:
+
+    This routine makes sure transfers the Block I/O layer should refuse never
+    reach the block device, and that a block device coming up short is
+    reported as an error.
+
+Arguments:
+
+    Drive - Supplies the drive number to test.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    UINT8 *Buffer;
+    EFI_BLOCK_IO_PROTOCOL *BlockIo;
+    UINT32 BlockSize;
+    UINTN CallsBefore;
+    PDISK_TEST_RAM_DISK Disk;
+    ULONG Failures;
+    EFI_LBA LastBlock;
+    UINT32 MediaId;
+    EFI_STATUS Status;
+
+    Disk = DiskTestDisks[Drive];
+    BlockIo = DiskTestBlockIo[Drive];
+    BlockSize = Disk->BlockDev.block_size;
+    LastBlock = BlockIo->Media->LastBlock;
+    MediaId = BlockIo->Media->MediaId;
+    Failures = 0;
+    Buffer = malloc(BlockSize * 2);
+    if (Buffer == NULL) {
+        return 1;
+    }
+
+    CallsBefore = Disk->Calls;
+    Status = BlockIo->ReadBlocks(BlockIo, MediaId + 1, 0, BlockSize, Buffer);
+    if (Status != EFI_MEDIA_CHANGED) {
+        printf("Error: Disk %ld read with a stale media ID returned 0x%lx.\n",
+               (long)Drive,
+               (long)Status);
+
+        Failures += 1;
+    }
+
+    Status = BlockIo->WriteBlocks(BlockIo, MediaId, 0, BlockSize - 1, Buffer);
+    if (Status != EFI_BAD_BUFFER_SIZE) {
+        printf("Error: Disk %ld partial block write returned 0x%lx.\n",
+               (long)Drive,
+               (long)Status);
+
+        Failures += 1;
+    }
+
+    Status = BlockIo->ReadBlocks(BlockIo,
+                                 MediaId,
+                                 LastBlock,
+                                 BlockSize * 2,
+                                 Buffer);
+
+    if (Status != EFI_INVALID_PARAMETER) {
+        printf("Error: Disk %ld read off the end returned 0x%lx.\n",
+               (long)Drive,
+               (long)Status);
+
+        Failures += 1;
+    }
+
+    Status = BlockIo->WriteBlocks(BlockIo,
+                                  MediaId,
+                                  LastBlock + 1,
+                                  BlockSize,
+                                  Buffer);
+
+    if (Status != EFI_INVALID_PARAMETER) {
+        printf("Error: Disk %ld write past the end returned 0x%lx.\n",
+               (long)Drive,
+               (long)Status);
+
+        Failures += 1;
+    }
+
+    //
+    // Make sure a block address large enough to wrap around when added to the
+    // count is caught.
+    //
+
+    Status = BlockIo->ReadBlocks(BlockIo,
+                                 MediaId,
+                                 (EFI_LBA)-1,
+                                 BlockSize * 2,
+                                 Buffer);
+
+    if (Status != EFI_INVALID_PARAMETER) {
+        printf("Error: Disk %ld read at a wrapping address returned 0x%lx.\n",
+               (long)Drive,
+               (long)Status);
+
+        Failures += 1;
+    }
+
+    BlockIo->Media->MediaPresent = FALSE;
+    Status = BlockIo->ReadBlocks(BlockIo, MediaId, 0, BlockSize, Buffer);
+    BlockIo->Media->MediaPresent = TRUE;
+    if (Status != EFI_NO_MEDIA) {
+        printf("Error: Disk %ld read with no media returned 0x%lx.\n",
+               (long)Drive,
+               (long)Status);
+
+        Failures += 1;
+    }
+
+    Status = BlockIo->ReadBlocks(BlockIo, MediaId, LastBlock + 1, 0, Buffer);
+    if (Status != EFI_SUCCESS) {
+        printf("Error: Disk %ld empty read returned 0x%lx.\n",
+               (long)Drive,
+               (long)Status);
+
+        Failures += 1;
+    }
+
+    if (Disk->Calls != CallsBefore) {
+        printf("Error: Disk %ld saw %ld requests that should have been "
+               "refused.\n",
+               (long)Drive,
+               (long)(Disk->Calls - CallsBefore));
+
+        Failures += 1;
+    }
+
+    Disk->ShortTransfers = 1;
+    Status = BlockIo->ReadBlocks(BlockIo, MediaId, 0, BlockSize * 2, Buffer);
+    if (Status != EFI_DEVICE_ERROR) {
+        printf("Error: Disk %ld short read returned 0x%lx.\n",
+               (long)Drive,
+               (long)Status);
+
+        Failures += 1;
+    }
+
+    Disk->ShortTransfers = 1;
+    Status = BlockIo->WriteBlocks(BlockIo, MediaId, 0, BlockSize * 2, Buffer);
+    if (Status != EFI_DEVICE_ERROR) {
+        printf("Error: Disk %ld short write returned 0x%lx.\n",
+               (long)Drive,
+               (long)Status);
+
+        Failures += 1;
+    }
+
+    Disk->ShortTransfers = 0;
+    free(Buffer);
+    return Failures;
+}
+
+ULONG
+TestLargeAddresses (
+    UINTN Drive
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads and writes blocks beyond 2TB on a disk that makes up its
+    contents, making sure all 64 bits of the block address make it to the
+    block device.
+
+Arguments:
+
+    Drive - Supplies the drive number to test.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    UINT8 *Buffer;
+    UINTN BlockCount;
+    EFI_BLOCK_IO_PROTOCOL *BlockIo;
+    UINT32 BlockSize;
+    UINTN ByteIndex;
+    UINTN CallsBefore;
+    PDISK_TEST_RAM_DISK Disk;
+    ULONG Failures;
+    UINTN Iteration;
+    EFI_LBA Lba;
+    EFI_STATUS Status;
+    UINT64 TotalBlocks;
+
+    Disk = DiskTestDisks[Drive];
+    BlockIo = DiskTestBlockIo[Drive];
+    BlockSize = Disk->BlockDev.block_size;
+    TotalBlocks = Disk->BlockDev.block_count;
+    Failures = 0;
+    Buffer = malloc(BlockSize * DISK_TEST_MAX_PATTERN_BLOCKS);
+    if (Buffer == NULL) {
+        return 1;
+    }
+
+    for (Iteration = 0; Iteration < DISK_TEST_ITERATIONS; Iteration += 1) {
+        BlockCount = (rand() % DISK_TEST_MAX_PATTERN_BLOCKS) + 1;
+        Lba = (((UINT64)rand() << 32) ^ rand()) %
+              (TotalBlocks - BlockCount + 1);
+
+        if (Lba < 0x100000000ULL) {
+            Lba += 0x100000000ULL;
+        }
+
+        CallsBefore = Disk->Calls;
+        if ((rand() % 2) == 0) {
+            Status = BlockIo->WriteBlocks(BlockIo,
+                                          BlockIo->Media->MediaId,
+                                          Lba,
+                                          BlockCount * BlockSize,
+                                          Buffer);
+
+            if (EFI_ERROR(Status)) {
+                printf("Error: Write of %ld blocks at 0x%llx failed: 0x%lx.\n",
+                       (long)BlockCount,
+                       (unsigned long long)Lba,
+                       (long)Status);
+
+                Failures += 1;
+                break;
+            }
+
+            Failures += CheckTransfer(Drive,
+                                      "write",
+                                      CallsBefore,
+                                      Lba,
+                                      BlockCount);
+
+        } else {
+            Status = BlockIo->ReadBlocks(BlockIo,
+                                         BlockIo->Media->MediaId,
+                                         Lba,
+                                         BlockCount * BlockSize,
+                                         Buffer);
+
+            if (EFI_ERROR(Status)) {
+                printf("Error: Read of %ld blocks at 0x%llx failed: 0x%lx.\n",
+                       (long)BlockCount,
+                       (unsigned long long)Lba,
+                       (long)Status);
+
+                Failures += 1;
+                break;
+            }
+
+            Failures += CheckTransfer(Drive,
+                                      "read",
+                                      CallsBefore,
+                                      Lba,
+                                      BlockCount);
+
+            for (ByteIndex = 0;
+                 ByteIndex < BlockCount * BlockSize;
+                 ByteIndex += 1) {
+
+                if (Buffer[ByteIndex] !=
+                    DiskTestPatternByte(Lba + (ByteIndex / BlockSize),
+                                        ByteIndex % BlockSize)) {
+
+                    printf("Error: Read of %ld blocks at 0x%llx returned the "
+                           "wrong data at offset 0x%lx.\n",
+                           (long)BlockCount,
+                           (unsigned long long)Lba,
+                           (long)ByteIndex);
+
+                    Failures += 1;
+                    break;
+                }
+            }
+        }
+
+        if (Failures != 0) {
+            break;
+        }
+    }
+
+    free(Buffer);
+    return Failures;
+}
+
+ULONG
+TestFlush (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine makes sure flushing a disk reaches its block device, that a
+    disk with no write cache can still be flushed, and that every disk is
+    flushed when boot services exit.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    EFI_BLOCK_IO_PROTOCOL *BlockIo;
+    UINTN Drive;
+    ULONG Failures;
+    UINTN Flushes[DISK_TEST_DISK_COUNT];
+    EFI_STATUS Status;
+
+    Failures = 0;
+    for (Drive = 0; Drive < DISK_TEST_DISK_COUNT; Drive += 1) {
+        BlockIo = DiskTestBlockIo[Drive];
+        Flushes[Drive] = DiskTestDisks[Drive]->Flushes;
+        Status = BlockIo->FlushBlocks(BlockIo);
+        if (EFI_ERROR(Status)) {
+            printf("Error: Disk %ld flush failed: 0x%lx.\n",
+                   (long)Drive,
+                   (long)Status);
+
+            Failures += 1;
+        }
+
+        if ((DiskTestDisks[Drive]->BlockDev.ops.flush != NULL) &&
+            (DiskTestDisks[Drive]->Flushes != Flushes[Drive] + 1)) {
+
+            printf("Error: Disk %ld flush did not reach the block device.\n",
+                   (long)Drive);
+
+            Failures += 1;
+        }
+
+        Flushes[Drive] = DiskTestDisks[Drive]->Flushes;
+    }
+
+    DiskTestEventNotify(NULL, NULL);
+    for (Drive = 0; Drive < DISK_TEST_DISK_COUNT; Drive += 1) {
+        if ((DiskTestDisks[Drive]->BlockDev.ops.flush != NULL) &&
+            (DiskTestDisks[Drive]->Flushes != Flushes[Drive] + 1)) {
+
+            printf("Error: Disk %ld was not flushed at ExitBootServices.\n",
+                   (long)Drive);
+
+            Failures += 1;
+        }
+    }
+
+    return Failures;
+}
+
+VOID
+RunThroughputBenchmark (
+    UINTN Drive
+    )
+
+/*++
+
+Routine Description:
+
+    This routine measures how fast data moves through the Block I/O layer into
+    and out of a disk in host memory, for a range of transfer sizes. Each run
+    walks sequentially through the disk, wrapping at the end. Since the disk
+    is only a memory copy, the results show the cost of the layer itself as
+    transfers get smaller.
+
+Arguments:
+
+    Drive - Supplies the drive number to run against.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN BlockCount;
+    EFI_BLOCK_IO_PROTOCOL *BlockIo;
+    UINT32 BlockSize;
+    UINT8 *Buffer;
+    UINTN Calls;
+    PDISK_TEST_RAM_DISK Disk;
+    clock_t End;
+    EFI_LBA Lba;
+    double Rate[2];
+    double Seconds;
+    clock_t Start;
+    EFI_STATUS Status;
+    UINT64 TotalBlocks;
+    UINT64 Transferred;
+    UINTN TransferSize;
+    UINTN Write;
+
+    Disk = DiskTestDisks[Drive];
+    BlockIo = DiskTestBlockIo[Drive];
+    BlockSize = Disk->BlockDev.block_size;
+    TotalBlocks = Disk->BlockDev.block_count;
+    Buffer = malloc(DISK_BENCHMARK_MAX_TRANSFER);
+    if (Buffer == NULL) {
+        return;
+    }
+
+    memset(Buffer, 0x5A, DISK_BENCHMARK_MAX_TRANSFER);
+    printf("Block I/O to a %lld MB RAM disk in MB/s (read / write, block "
+           "device requests per transfer):\n",
+           (long long)(TotalBlocks * BlockSize / (1024 * 1024)));
+
+    for (TransferSize = BlockSize;
+         TransferSize <= DISK_BENCHMARK_MAX_TRANSFER;
+         TransferSize *= 4) {
+
+        BlockCount = TransferSize / BlockSize;
+        Calls = Disk->Calls;
+        for (Write = 0; Write < 2; Write += 1) {
+            Lba = 0;
+            Transferred = 0;
+            Start = clock();
+            while (Transferred < DISK_BENCHMARK_BYTES) {
+                if (Lba + BlockCount > TotalBlocks) {
+                    Lba = 0;
+                }
+
+                if (Write != 0) {
+                    Status = BlockIo->WriteBlocks(BlockIo,
+                                                  BlockIo->Media->MediaId,
+                                                  Lba,
+                                                  TransferSize,
+                                                  Buffer);
+
+                } else {
+                    Status = BlockIo->ReadBlocks(BlockIo,
+                                                 BlockIo->Media->MediaId,
+                                                 Lba,
+                                                 TransferSize,
+                                                 Buffer);
+                }
+
+                if (EFI_ERROR(Status)) {
+                    printf("Error: Benchmark transfer failed: 0x%lx.\n",
+                           (long)Status);
+
+                    goto RunThroughputBenchmarkEnd;
+                }
+
+                Lba += BlockCount;
+                Transferred += TransferSize;
+            }
+
+            End = clock();
+            Seconds = (double)(End - Start) / CLOCKS_PER_SEC;
+            if (Seconds <= 0) {
+                Seconds = 1.0 / CLOCKS_PER_SEC;
+            }
+
+            Rate[Write] = Transferred / Seconds / (1024.0 * 1024.0);
+        }
+
+        Calls = Disk->Calls - Calls;
+        printf("    %7ld bytes: %.0f / %.0f, %.2f\n",
+               (long)TransferSize,
+               Rate[0],
+               Rate[1],
+               (double)Calls / (2 * DISK_BENCHMARK_BYTES / TransferSize));
+    }
+
+RunThroughputBenchmarkEnd:
+    free(Buffer);
+    return;
+}
+
+ULONG
+CheckTransfer (
+    UINTN Drive,
+    PCSTR Description,
+    UINTN CallsBefore,
+    EFI_LBA Lba,
+    UINTN BlockCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine makes sure a transfer that just completed reached the block
+    device as a single request covering exactly the blocks asked for.
+
+Arguments:
+
+    Drive - Supplies the drive number the transfer went to.
+
+    Description - Supplies a description of the transfer for error messages.
+
+    CallsBefore - Supplies the number of requests the block device had seen
+        before the transfer.
+
+    Lba - Supplies the first block of the transfer.
+
+    BlockCount - Supplies the number of blocks in the transfer.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    PDISK_TEST_RAM_DISK Disk;
+
+    Disk = DiskTestDisks[Drive];
+    if ((Disk->Calls != CallsBefore + 1) ||
+        (Disk->LastStart != Lba) ||
+        (Disk->LastCount != BlockCount)) {
+
+        printf("Error: Disk %ld %s of %ld blocks at 0x%llx became %ld "
+               "request(s), the last for %lld blocks at 0x%llx.\n",
+               (long)Drive,
+               Description,
+               (long)BlockCount,
+               (unsigned long long)Lba,
+               (long)(Disk->Calls - CallsBefore),
+               (long long)Disk->LastCount,
+               (unsigned long long)Disk->LastStart);
+
+        return 1;
+    }
+
+    return 0;
+}
+
@@ -0,0 +1,248 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    disktest.h
+
+Abstract:
+
+    This header contains definitions shared across the coreboot disk test
+    program.
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <minoca/lib/types.h>
+#include <uefifw.h>
+#include <minoca/uefi/protocol/blockio.h>
+#include <blockdev/blockdev.h>
+#include "cbfw.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+#define VPRINT(_Format, _Args...)       \
+    {                                   \
+                                        \
+        if (DiskTestVerbose != FALSE) { \
+            printf(_Format, ## _Args);  \
+        }                               \
+    }
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the most disks the stub AHCI controller can report.
+//
+
+#define DISK_TEST_MAX_DISKS 8
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+/*++
+
+Structure Description:
+
+    This structure describes a block device backed by host memory, standing in
+    for a disk behind the AHCI controller.
+
+Members:
+
+    BlockDev - Stores the block device handed to the disk layer.
+
+    Data - Stores a pointer to the contents of the disk. If this is NULL, the
+        disk stores nothing: reads return a pattern derived from each block's
+        address and writes are discarded. This allows disks far larger than
+        host memory.
+
+    Calls - Stores the number of read and write requests the disk has seen.
+
+    Flushes - Stores the number of flush requests the disk has seen.
+
+    LastStart - Stores the starting block of the most recent request.
+
+    LastCount - Stores the block count of the most recent request.
+
+    ShortTransfers - Stores the number of upcoming requests that should
+        complete one block short, to simulate a device error.
+
+--*/
+
+typedef struct _DISK_TEST_RAM_DISK {
+    BlockDev BlockDev;
+    UINT8 *Data;
+    UINTN Calls;
+    UINTN Flushes;
+    lba_t LastStart;
+    lba_t LastCount;
+    UINTN ShortTransfers;
+} DISK_TEST_RAM_DISK, *PDISK_TEST_RAM_DISK;
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+extern BOOLEAN DiskTestVerbose;
+
+//
+// Store the disks the stub AHCI controller reports when it is updated, in
+// drive number order.
+//
+
+extern PDISK_TEST_RAM_DISK DiskTestDisks[DISK_TEST_MAX_DISKS];
+extern UINTN DiskTestDiskCount;
+
+//
+// Store the block I/O protocols the disk layer installed, in the order it
+// installed them.
+//
+
+extern EFI_BLOCK_IO_PROTOCOL *DiskTestBlockIo[DISK_TEST_MAX_DISKS];
+extern UINTN DiskTestBlockIoCount;
+
+//
+// Store the event the disk layer created to flush at ExitBootServices.
+//
+
+extern UINT32 DiskTestEventType;
+extern EFI_EVENT_NOTIFY DiskTestEventNotify;
+
+//
+// Store the number of performance records opened and closed.
+//
+
+extern UINTN DiskTestPerfStarts;
+extern UINTN DiskTestPerfEnds;
+
+//
+// -------------------------------------------------------- Function Prototypes
+//
+
+VOID
+DiskTestInitializeServices (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine fills in the boot services the disk code calls.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+VOID
+DiskTestInitializeRamDisk (
+    PDISK_TEST_RAM_DISK Disk,
+    PCSTR Name,
+    UINT32 BlockSize,
+    lba_t BlockCount,
+    BOOLEAN Store,
+    BOOLEAN Flush
+    );
+
+/*++
+
+Routine Description:
+
+    This routine sets up a block device backed by host memory.
+
+Arguments:
+
+    Disk - Supplies a pointer to the disk to initialize.
+
+    Name - Supplies the name of the block device.
+
+    BlockSize - Supplies the size of a block in bytes.
+
+    BlockCount - Supplies the number of blocks on the disk.
+
+    Store - Supplies a boolean indicating whether the disk keeps what is
+        written to it (TRUE) or makes up its contents (FALSE).
+
+    Flush - Supplies a boolean indicating whether the disk has a write cache
+        to flush.
+
+Return Value:
+
+    None. The data pointer is NULL if the allocation failed.
+
+--*/
+
+VOID
+DiskTestDestroyRamDisk (
+    PDISK_TEST_RAM_DISK Disk
+    );
+
+/*++
+
+Routine Description:
+
+    This routine frees the memory behind a host memory block device.
+
+Arguments:
+
+    Disk - Supplies a pointer to the disk to tear down.
+
+Return Value:
+
+    None.
+
+--*/
+
+UINT8
+DiskTestPatternByte (
+    lba_t Block,
+    UINTN Offset
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns the contents of a disk that does not store its data.
+
+Arguments:
+
+    Block - Supplies the block being read.
+
+    Offset - Supplies the byte offset within the block.
+
+Return Value:
+
+    Returns the byte at that location.
+
+--*/
+
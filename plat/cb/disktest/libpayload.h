@@ -0,0 +1,40 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    libpayload.h
+
+Abstract:
+
+    This header stands in for the libpayload master header when the coreboot
+    disk code is built on the build machine for testing. It supplies only
+    what that code uses, on top of the C library.
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+#define ARRAY_SIZE(_Array) (sizeof(_Array) / sizeof((_Array)[0]))
+
@@ -0,0 +1,48 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    pci.h
+
+Abstract:
+
+    This header stands in for the libpayload PCI header when the coreboot
+    disk code is built on the build machine for testing.
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <stdint.h>
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+//
+// This macro encodes a PCI bus, device, and function the same way libpayload
+// does.
+//
+
+#define PCI_DEV(_Bus, _Device, _Function) \
+    (((_Bus) << 16) | ((_Device) << 11) | ((_Function) << 8))
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+typedef uint32_t pcidev_t;
+
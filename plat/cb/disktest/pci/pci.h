@@ -0,0 +1,57 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    pci.h
+
+Abstract:
+
+    This header stands in for the libpci compatible header in libpayload when
+    the coreboot disk code is built on the build machine for testing. The test
+    program supplies the device list and configuration space reads.
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <stdint.h>
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+struct pci_dev {
+    struct pci_dev *next;
+    uint16_t domain;
+    uint8_t bus;
+    uint8_t dev;
+    uint8_t func;
+};
+
+struct pci_access {
+    struct pci_dev *devices;
+};
+
+//
+// -------------------------------------------------------- Function Prototypes
+//
+
+uint16_t
+pci_read_word (
+    struct pci_dev *Device,
+    int Offset
+    );
+
@@ -214,7 +214,8 @@ Return Value:
 
     //
     // Clock interrupts are not supported as the BIOS may have 16-bit real mode
-    // interrupts coming in.
+    // interrupts coming in. Without a periodic tick the core runs tickless,
+    // polling the earliest timer deadline whenever events are checked.
     //
 
     *ClockTimerInterruptNumber = 0;
@@ -31,6 +31,7 @@ from menv import application;
 function build() {
     var acpiTool;
     var app;
+    var buildLibs;
     var entries;
     var genffsCommand;
     var includes;
@@ -45,9 +46,13 @@ function build() {
         "$S/uefi/include"
     ];
 
+    buildLibs = [
+        "lib/lzma:build_lzma"
+    ];
+
     app = {
         "label": "genffs",
-        "inputs": sources,
+        "inputs": sources + buildLibs,
         "includes": includes,
         "build": true
     };
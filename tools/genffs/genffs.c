@@ -36,9 +36,12 @@ Environment:
 #include <time.h>
 #include <unistd.h>
 
+#include <minoca/lib/types.h>
+#include <minoca/lib/status.h>
 #include "uefifw.h"
 #include "efiffs.h"
 #include "peimage.h"
+#include <minoca/lib/lzma.h>
 
 //
 // --------------------------------------------------------------------- Macros
@@ -80,6 +83,12 @@ Environment:
 // ------------------------------------------------------ Data Type Definitions
 //
 
+typedef enum _GFFS_COMPRESSION_TYPE {
+    GffsCompressionNone,
+    GffsCompressionLzma,
+    GffsCompressionLz4
+} GFFS_COMPRESSION_TYPE, *PGFFS_COMPRESSION_TYPE;
+
 //
 // ----------------------------------------------- Internal Function Prototypes
 //
@@ -95,6 +104,19 @@ GffsGetSectionContents (
     UINT32 *MaxAlignment
     );
 
+EFI_STATUS
+GffsCompressSections (
+    GFFS_COMPRESSION_TYPE Compression,
+    UINT8 **FileBuffer,
+    UINT32 *FileSize
+    );
+
+PVOID
+GffsReallocate (
+    PVOID Allocation,
+    UINTN NewSize
+    );
+
 UINT8
 GffsStringToType (
     CHAR8 *String
@@ -221,6 +243,18 @@ CHAR8 *GffsValidAlignmentStrings[] = {
 UINT32 GffsValidAlignments[] = {0, 8, 16, 128, 512, 1024, 4096, 32768, 65536};
 
 EFI_GUID GffsZeroGuid = {0};
+EFI_GUID GffsLzmaGuid = EFI_LZMA_CUSTOM_DECOMPRESS_GUID;
+EFI_GUID GffsLz4Guid = EFI_LZ4_CUSTOM_DECOMPRESS_GUID;
+
+LZ_CONTEXT GffsLzContext = {
+    NULL,
+    GffsReallocate,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
 
 UINTN GffsDebugLevel = LOG_LEVEL_DEFAULT;
 BOOLEAN GffsErrorOccurred = FALSE;
@@ -261,6 +295,7 @@ Return Value:
     CHAR8 *AfterScan;
     UINT32 Alignment;
     EFI_FFS_FILE_ATTRIBUTES Attributes;
+    GFFS_COMPRESSION_TYPE Compression;
     UINT32 DefaultFileAlignment;
     UINT8 DefaultFileSectionType;
     FILE *FfsFile;
@@ -286,6 +321,7 @@ Return Value:
     Index = 0;
     Attributes = 0;
     Alignment = 0;
+    Compression = GffsCompressionNone;
     DefaultFileSectionType = 0;
     DefaultFileAlignment = 0;
     FileType = EFI_FV_FILETYPE_ALL;
@@ -487,6 +523,30 @@ Return Value:
             continue;
         }
 
+        if ((strcasecmp(Arguments[0], "-c") == 0) ||
+            (strcasecmp(Arguments[0], "--compress") == 0)) {
+
+            if ((Arguments[1] == NULL) || (Arguments[1][0] == '-')) {
+                GFFS_LOG_ERROR("Compression type is missing for -c option.\n");
+                goto mainEnd;
+            }
+
+            if (strcasecmp(Arguments[1], "LZMA") == 0) {
+                Compression = GffsCompressionLzma;
+
+            } else if (strcasecmp(Arguments[1], "LZ4") == 0) {
+                Compression = GffsCompressionLz4;
+
+            } else {
+                GFFS_LOG_ERROR("Invalid compression type %s.\n", Arguments[1]);
+                goto mainEnd;
+            }
+
+            ArgumentCount -= 2;
+            Arguments += 2;
+            continue;
+        }
+
         if ((strcasecmp(Arguments[0], "-v") == 0) ||
             (strcasecmp(Arguments[0], "--verbose") == 0)) {
 
@@ -772,6 +832,18 @@ Return Value:
         goto mainEnd;
     }
 
+    //
+    // Wrap all the sections up in a single compressed GUIDed section if
+    // requested.
+    //
+
+    if (Compression != GffsCompressionNone) {
+        Status = GffsCompressSections(Compression, &FileBuffer, &FileSize);
+        if (EFI_ERROR(Status)) {
+            goto mainEnd;
+        }
+    }
+
     //
     // Create the Ffs file header.
     //
@@ -1197,6 +1269,210 @@ Return Value:
     return EFI_SUCCESS;
 }
 
+EFI_STATUS
+GffsCompressSections (
+    GFFS_COMPRESSION_TYPE Compression,
+    UINT8 **FileBuffer,
+    UINT32 *FileSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine compresses the gathered sections of the file and wraps them
+    in a single GUIDed section that requires processing. LZMA data is preceded
+    by the standard 13 byte LZMA header, and LZ4 data by its 32-bit
+    uncompressed size.
+
+Arguments:
+
+    Compression - Supplies the compression algorithm to use.
+
+    FileBuffer - Supplies a pointer to the buffer of sections. On success, this
+        is replaced by a newly allocated buffer containing the GUIDed section,
+        and the original buffer is freed.
+
+    FileSize - Supplies a pointer that on input contains the size of the
+        sections. On output, contains the size of the GUIDed section.
+
+Return Value:
+
+    EFI_SUCCESS on success.
+
+    EFI_OUT_OF_RESOURCES on allocation failure.
+
+    EFI_ABORTED if the data could not be compressed.
+
+--*/
+
+{
+
+    UINT8 *Buffer;
+    UINTN BufferSize;
+    UINTN CompressedSize;
+    UINT8 *Data;
+    UINT32 DataOffset;
+    UINTN EncodedPropertiesSize;
+    EFI_GUID *Guid;
+    EFI_GUID_DEFINED_SECTION *GuidedSection;
+    EFI_GUID_DEFINED_SECTION2 *GuidedSection2;
+    UINT32 HeaderSize;
+    UINT32 Index;
+    LZMA_ENCODER_PROPERTIES Properties;
+    UINT32 SectionSize;
+    LZ_STATUS Status;
+    UINT64 UncompressedSize;
+
+    //
+    // Incompressible data grows a little, so leave room for that.
+    //
+
+    BufferSize = sizeof(EFI_GUID_DEFINED_SECTION2) + LZMA_HEADER_SIZE +
+                 LZ4_COMPRESS_BOUND(*FileSize) + (*FileSize / 32) + 1024;
+
+    Buffer = malloc(BufferSize);
+    if (Buffer == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    //
+    // Compress assuming the larger section header, and shift the data down
+    // later if the smaller one turns out to be enough.
+    //
+
+    HeaderSize = sizeof(EFI_GUID_DEFINED_SECTION2);
+    Data = Buffer + HeaderSize;
+    if (Compression == GffsCompressionLzma) {
+        Guid = &GffsLzmaGuid;
+        LzLzmaEncoderInitializeProperties(&Properties);
+        CompressedSize = BufferSize - HeaderSize - LZMA_HEADER_SIZE;
+        EncodedPropertiesSize = LZMA_HEADER_SIZE - sizeof(UINT64);
+        Status = LzLzmaEncode(Data + LZMA_HEADER_SIZE,
+                              &CompressedSize,
+                              *FileBuffer,
+                              *FileSize,
+                              &Properties,
+                              Data,
+                              &EncodedPropertiesSize,
+                              FALSE,
+                              &GffsLzContext);
+
+        UncompressedSize = *FileSize;
+        for (Index = 0; Index < sizeof(UINT64); Index += 1) {
+            Data[EncodedPropertiesSize + Index] =
+                                       (UINT8)(UncompressedSize >> (Index * 8));
+        }
+
+        CompressedSize += LZMA_HEADER_SIZE;
+
+    } else {
+
+        assert(Compression == GffsCompressionLz4);
+
+        Guid = &GffsLz4Guid;
+        CompressedSize = BufferSize - HeaderSize - EFI_LZ4_SECTION_HEADER_SIZE;
+        Status = LzLz4Encode(Data + EFI_LZ4_SECTION_HEADER_SIZE,
+                             &CompressedSize,
+                             *FileBuffer,
+                             *FileSize,
+                             &GffsLzContext);
+
+        for (Index = 0; Index < EFI_LZ4_SECTION_HEADER_SIZE; Index += 1) {
+            Data[Index] = (UINT8)(*FileSize >> (Index * 8));
+        }
+
+        CompressedSize += EFI_LZ4_SECTION_HEADER_SIZE;
+    }
+
+    if (Status != LzSuccess) {
+        GFFS_LOG_ERROR("Error: Failed to compress sections: %d.\n", Status);
+        free(Buffer);
+        return EFI_ABORTED;
+    }
+
+    GFFS_LOG_VERBOSE("Compressed %u bytes of sections to %u bytes.\n",
+                     (unsigned)*FileSize,
+                     (unsigned)CompressedSize);
+
+    //
+    // Build the GUIDed section header in front of the compressed data.
+    //
+
+    if (CompressedSize + sizeof(EFI_GUID_DEFINED_SECTION) < MAX_FFS_SIZE) {
+        HeaderSize = sizeof(EFI_GUID_DEFINED_SECTION);
+        memmove(Buffer + HeaderSize, Data, CompressedSize);
+    }
+
+    SectionSize = CompressedSize + HeaderSize;
+    DataOffset = HeaderSize;
+    if (HeaderSize == sizeof(EFI_GUID_DEFINED_SECTION2)) {
+        GuidedSection2 = (EFI_GUID_DEFINED_SECTION2 *)Buffer;
+        GuidedSection2->CommonHeader.AsUint32 = 0x00FFFFFF;
+        GuidedSection2->CommonHeader.Elements.Type = EFI_SECTION_GUID_DEFINED;
+        GuidedSection2->CommonHeader.Elements.ExtendedSize = SectionSize;
+        memcpy(&(GuidedSection2->SectionDefinitionGuid),
+               Guid,
+               sizeof(EFI_GUID));
+
+        GuidedSection2->DataOffset = DataOffset;
+        GuidedSection2->Attributes = EFI_GUIDED_SECTION_PROCESSING_REQUIRED;
+
+    } else {
+        GuidedSection = (EFI_GUID_DEFINED_SECTION *)Buffer;
+        GuidedSection->CommonHeader.AsUint32 = SectionSize;
+        GuidedSection->CommonHeader.Elements.Type = EFI_SECTION_GUID_DEFINED;
+        memcpy(&(GuidedSection->SectionDefinitionGuid),
+               Guid,
+               sizeof(EFI_GUID));
+
+        GuidedSection->DataOffset = DataOffset;
+        GuidedSection->Attributes = EFI_GUIDED_SECTION_PROCESSING_REQUIRED;
+    }
+
+    free(*FileBuffer);
+    *FileBuffer = Buffer;
+    *FileSize = SectionSize;
+    return EFI_SUCCESS;
+}
+
+PVOID
+GffsReallocate (
+    PVOID Allocation,
+    UINTN NewSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates, reallocates, or frees memory for the LZ library.
+
+Arguments:
+
+    Allocation - Supplies an optional pointer to the allocation to resize or
+        free.
+
+    NewSize - Supplies the size of the desired allocation, or zero to free.
+
+Return Value:
+
+    Returns a pointer to the allocation on success.
+
+    NULL on allocation failure, or in the case the memory is being freed.
+
+--*/
+
+{
+
+    if (NewSize == 0) {
+        free(Allocation);
+        return NULL;
+    }
+
+    return realloc(Allocation, NewSize);
+}
+
 UINT8
 GffsStringToType (
     CHAR8 *String
@@ -1750,6 +2026,9 @@ Return Value:
             "SectionAlign points to section alignment, which support\n"
             "the alignment scope 1~64K. It is specified together\n"
             "with sectionfile to point its alignment in FFS file.\n"
+            "  -c Type, --compress Type\n"
+            "Compress all sections into a single GUIDed section. Valid\n"
+            "types are LZMA and LZ4.\n"
             "  -v, --verbose         Turn on verbose output with informational "
             "messages.\n"
             "  -q, --quiet           Disable all messages except key message "